@@ -0,0 +1,181 @@
+#!/bin/bash
+# ESP32S3 Camera heap soak test
+#
+# Churns HTTP connections against a device for a long time (short /stream
+# sessions, captures, thumbnails, /metrics, /logs and the web UI) and samples
+# the heap figures from /metrics at a fixed interval. A largest free block
+# that keeps falling while free bytes stay level is fragmentation.
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+DEFAULT_IP="192.168.1.224"
+
+print_status() {
+    echo -e "${GREEN}[INFO]${NC} $1"
+}
+
+print_error() {
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+print_title() {
+    echo -e "${BLUE}=== $1 ===${NC}"
+}
+
+usage() {
+    echo "Usage: $0 [IP] [MINUTES] [INTERVAL] [CLIENTS] [CSV_FILE]"
+    echo ""
+    echo "  IP        Device IP address (default: $DEFAULT_IP)"
+    echo "  MINUTES   Soak duration (default: 30)"
+    echo "  INTERVAL  Seconds between heap samples (default: 30)"
+    echo "  CLIENTS   Parallel churn loops (default: 3)"
+    echo "  CSV_FILE  Also save the samples to this file"
+    echo ""
+    echo "Example:"
+    echo "  $0 192.168.1.100 240 60 4 soak.csv"
+}
+
+# Value of one /metrics line, e.g. metric "$M" 'heap_free_bytes{caps="internal"}'
+metric() {
+    echo "$1" | awk -v name="$2" '$1 == name { print $2; exit }'
+}
+
+# One churn loop: a random mix of short requests, run until killed
+churn() {
+    local base=$1
+    local count=0
+    local app
+    # The script is served under a content-hashed name; take it from the page
+    app=$(curl -s --max-time 10 --compressed "$base/" | grep -o '/app\.[0-9a-f]*\.js' | head -n 1)
+    local paths=("/capture" "/thumb?scale=1/4" "/thumb?scale=1/8" "/metrics" "/logs" "/" "${app:-/}")
+
+    while true; do
+        if [ $((RANDOM % 3)) -eq 0 ]; then
+            # A stream session of 1-4 s, cut off by the client
+            curl -s -o /dev/null --max-time $((RANDOM % 4 + 1)) "$base/stream"
+        else
+            curl -s -o /dev/null --max-time 10 "$base${paths[$((RANDOM % ${#paths[@]}))]}"
+        fi
+        count=$((count + 1))
+        echo "$count" > "$CHURN_DIR/$BASHPID"
+    done
+}
+
+churn_total() {
+    cat "$CHURN_DIR"/* 2>/dev/null | awk '{ s += $1 } END { print s + 0 }'
+}
+
+sample() {
+    local elapsed=$1
+    local m
+    m=$(curl -s --max-time 10 "$BASE_URL/metrics")
+    if [ -z "$m" ]; then
+        print_error "No /metrics response at ${elapsed}s"
+        return 1
+    fi
+
+    local row
+    row="$elapsed,$(churn_total)"
+    for caps in internal dma psram; do
+        row="$row,$(metric "$m" "heap_free_bytes{caps=\"$caps\"}")"
+        row="$row,$(metric "$m" "heap_largest_free_block_bytes{caps=\"$caps\"}")"
+        row="$row,$(metric "$m" "heap_fragmentation_permille{caps=\"$caps\"}")"
+    done
+    row="$row,$(metric "$m" session_arenas_high_water),$(metric "$m" session_arena_spills_total)"
+    row="$row,$(metric "$m" uptime_ms)"
+
+    echo "$row" >> "$SAMPLES"
+    echo "$row" | awk -F, '{ printf "%7s %8s | %8s %8s %5.1f%% | %8s %8s | %9s %9s | %3s %6s\n",
+                             $1, $2, $3, $4, $5 / 10, $6, $7, $9, $10, $12, $13 }'
+}
+
+cleanup() {
+    kill "${pids[@]}" 2>/dev/null
+    wait "${pids[@]}" 2>/dev/null
+    rm -rf "$CHURN_DIR"
+}
+
+main() {
+    if [ "$1" = "help" ] || [ "$1" = "-h" ] || [ "$1" = "--help" ]; then
+        usage
+        exit 0
+    fi
+
+    IP=${1:-$DEFAULT_IP}
+    MINUTES=${2:-30}
+    INTERVAL=${3:-30}
+    CLIENTS=${4:-3}
+    OUTPUT=$5
+    BASE_URL="http://$IP"
+
+    if ! command -v curl &> /dev/null; then
+        print_error "curl is not installed"
+        exit 1
+    fi
+
+    print_title "ESP32S3 Camera Heap Soak Test"
+
+    if ! curl -s -o /dev/null --max-time 5 "$BASE_URL/metrics"; then
+        print_error "Cannot reach $BASE_URL/metrics"
+        exit 1
+    fi
+
+    CHURN_DIR=$(mktemp -d)
+    SAMPLES="$CHURN_DIR/samples.csv"
+    : > "$SAMPLES"
+    pids=()
+    trap 'cleanup; exit 130' INT TERM
+
+    print_status "Churning connections from $CLIENTS loop(s) for $MINUTES min, sampling every $INTERVAL s"
+    echo ""
+    echo "   time requests | internal  largest  frag |      dma  largest |     psram   largest | arena spills"
+
+    sample 0
+    for i in $(seq 1 "$CLIENTS"); do
+        churn "$BASE_URL" &
+        pids+=($!)
+    done
+
+    local end=$((SECONDS + MINUTES * 60))
+    local start=$SECONDS
+    while [ $SECONDS -lt $end ]; do
+        sleep "$INTERVAL"
+        sample $((SECONDS - start))
+    done
+
+    kill "${pids[@]}" 2>/dev/null
+    wait "${pids[@]}" 2>/dev/null
+    # Let closing sessions settle before the final sample
+    sleep 5
+    sample $((SECONDS - start))
+
+    echo ""
+    print_title "Drift (first -> last sample)"
+    awk -F, 'NR == 1 { f = $0; split($0, a, ",") } { split($0, b, ",") }
+             { if (NR == 1 || $4 < minl) minl = $4 }
+             END {
+                 printf "requests:                 %d\n", b[2]
+                 printf "internal free:            %d -> %d (%+d)\n", a[3], b[3], b[3] - a[3]
+                 printf "internal largest block:   %d -> %d (%+d), lowest %d\n", a[4], b[4], b[4] - a[4], minl
+                 printf "dma largest block:        %d -> %d (%+d)\n", a[7], b[7], b[7] - a[7]
+                 printf "psram free:               %d -> %d (%+d)\n", a[9], b[9], b[9] - a[9]
+                 printf "session arena spills:     %d\n", b[13]
+                 if (b[14] < a[14]) print "WARNING: uptime went backwards, the device rebooted during the soak"
+             }' "$SAMPLES"
+
+    if [ -n "$OUTPUT" ]; then
+        {
+            echo "elapsed_s,requests,internal_free,internal_largest,internal_frag_permille,dma_free,dma_largest,dma_frag_permille,psram_free,psram_largest,psram_frag_permille,arena_high_water,arena_spills,uptime_ms"
+            cat "$SAMPLES"
+        } > "$OUTPUT"
+        print_status "Samples saved to $OUTPUT"
+    fi
+
+    rm -rf "$CHURN_DIR"
+}
+
+main "$@"
@@ -0,0 +1,102 @@
+#!/bin/bash
+# ESP32S3 Camera task layout benchmark
+#
+# Opens N /stream clients for a fixed duration while the device is under load,
+# then scrapes /metrics and prints the frame-interval jitter and per-task CPU /
+# stack usage. Flash each layout (menuconfig -> ESP32S3Cam Task Layout), run
+# this script with the same arguments, and compare the reports.
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+NC='\033[0m' # No Color
+
+DEFAULT_IP="192.168.1.224"
+
+print_status() {
+    echo -e "${GREEN}[INFO]${NC} $1"
+}
+
+print_error() {
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+print_title() {
+    echo -e "${BLUE}=== $1 ===${NC}"
+}
+
+usage() {
+    echo "Usage: $0 [IP] [SECONDS] [CLIENTS] [OUTPUT_FILE]"
+    echo ""
+    echo "  IP           Device IP address (default: $DEFAULT_IP)"
+    echo "  SECONDS      Stream duration per run (default: 60)"
+    echo "  CLIENTS      Concurrent /stream clients (default: 1)"
+    echo "  OUTPUT_FILE  Also save the raw /metrics scrape to this file"
+    echo ""
+    echo "Example:"
+    echo "  $0 192.168.1.100 120 2 split.metrics"
+}
+
+main() {
+    if [ "$1" = "help" ] || [ "$1" = "-h" ] || [ "$1" = "--help" ]; then
+        usage
+        exit 0
+    fi
+
+    IP=${1:-$DEFAULT_IP}
+    DURATION=${2:-60}
+    CLIENTS=${3:-1}
+    OUTPUT=$4
+    BASE_URL="http://$IP"
+
+    if ! command -v curl &> /dev/null; then
+        print_error "curl is not installed"
+        exit 1
+    fi
+
+    print_title "ESP32S3 Camera Task Layout Benchmark"
+
+    if ! curl -s -o /dev/null --max-time 5 "$BASE_URL/metrics"; then
+        print_error "Cannot reach $BASE_URL/metrics"
+        exit 1
+    fi
+
+    # Prime the CPU-usage window so the report covers only the benchmark run
+    curl -s -o /dev/null --max-time 5 "$BASE_URL/metrics"
+
+    print_status "Streaming from $CLIENTS client(s) for $DURATION s..."
+    pids=()
+    for i in $(seq 1 "$CLIENTS"); do
+        curl -s -o /dev/null -w "client $i: %{size_download} bytes\n" \
+            --max-time "$DURATION" "$BASE_URL/stream" &
+        pids+=($!)
+    done
+
+    # Scrape while the streams are still running so the sender tasks show up busy
+    sleep $((DURATION > 2 ? DURATION - 2 : DURATION))
+    METRICS=$(curl -s --max-time 5 "$BASE_URL/metrics")
+
+    wait "${pids[@]}" 2>/dev/null
+
+    if [ -z "$METRICS" ]; then
+        print_error "Failed to scrape /metrics"
+        exit 1
+    fi
+
+    if [ -n "$OUTPUT" ]; then
+        echo "$METRICS" > "$OUTPUT"
+        print_status "Raw metrics saved to $OUTPUT"
+    fi
+
+    print_title "Stream timing"
+    echo "$METRICS" | grep -E "^stream_"
+
+    print_title "Task CPU usage (% of one core)"
+    echo "$METRICS" | grep -E "^task_cpu_percent" | sort -t' ' -k2 -rn
+
+    print_title "Task stack high-water marks (bytes free)"
+    echo "$METRICS" | grep -E "^task_stack_hwm_bytes" | sort -t' ' -k2 -n
+}
+
+main "$@"
@@ -2,16 +2,266 @@
 #include "wifi_init.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_event.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "camera_init.h"
+#include "camera_profile.h"
+#include "capture_pipeline.h"
 #include "video_stream.h"
 #include "http_server.h"
+#include "ota_update.h"
+#include "ota_pull.h"
+#include "metrics.h"
+#include "thumbnail.h"
+#include "burst.h"
+#include "static_assets.h"
+#include "async_log.h"
+#include "heap_monitor.h"
+#include "push_upload.h"
+#include "mcast_stream.h"
+#include "qos_arbiter.h"
+#include "exposure.h"
+#include "lifecycle.h"
 
 static const char *TAG = "main";
 
+#define LIFECYCLE_QUEUE_LEN 16
+#define CAMERA_INIT_TASK_STACK_SIZE 4096
+#define CAMERA_INIT_TASK_PRIORITY 5
+
+typedef struct
+{
+    lifecycle_service_t service;
+    lifecycle_state_t state;
+} lifecycle_msg_t;
+
+static QueueHandle_t s_lifecycle_queue = NULL;
+static lifecycle_t s_lifecycle;
+static bool s_boot_reported = false;
+static bool s_services_up = false;
+
+static uint32_t boot_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void post_state(lifecycle_service_t service, lifecycle_state_t state)
+{
+    lifecycle_msg_t msg = {.service = service, .state = state};
+    if (xQueueSend(s_lifecycle_queue, &msg, 0) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Lifecycle queue full, dropped %s -> %s",
+                 lifecycle_service_name(service), lifecycle_state_name(state));
+    }
+}
+
+static void network_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (event_id == WIFI_LINK_EVENT_UP)
+    {
+        post_state(LIFECYCLE_SVC_WIFI, LIFECYCLE_STATE_UP);
+    }
+    else if (event_id == WIFI_LINK_EVENT_LOST)
+    {
+        post_state(LIFECYCLE_SVC_WIFI, LIFECYCLE_STATE_DOWN);
+    }
+}
+
+static void camera_init_task(void *pvParameters)
+{
+    esp_err_t ret = camera_init();
+    if (ret == ESP_OK)
+    {
+        ret = capture_pipeline_start();
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Camera initialization failed: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Application will continue without camera functionality");
+    }
+    post_state(LIFECYCLE_SVC_CAMERA, ret == ESP_OK ? LIFECYCLE_STATE_UP : LIFECYCLE_STATE_FAILED);
+    vTaskDelete(NULL);
+}
+
+static void report_boot_timing(void)
+{
+    bool was_up = s_services_up;
+    s_services_up = lifecycle_all_up(&s_lifecycle);
+    if (!s_services_up || was_up)
+    {
+        return;
+    }
+
+    if (!s_boot_reported)
+    {
+        s_boot_reported = true;
+        ESP_LOGI(TAG, "Boot timing: camera=%lu ms, wifi=%lu ms, http=%lu ms, stream=%lu ms, ota=%lu ms",
+                 (unsigned long)s_lifecycle.first_up_ms[LIFECYCLE_SVC_CAMERA],
+                 (unsigned long)s_lifecycle.first_up_ms[LIFECYCLE_SVC_WIFI],
+                 (unsigned long)s_lifecycle.first_up_ms[LIFECYCLE_SVC_HTTP],
+                 (unsigned long)s_lifecycle.first_up_ms[LIFECYCLE_SVC_STREAM],
+                 (unsigned long)s_lifecycle.first_up_ms[LIFECYCLE_SVC_OTA]);
+        ESP_LOGI(TAG, "Access the camera stream at: http://<device_ip>/");
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Services restored %lu ms after WiFi reconnect",
+                 (unsigned long)(boot_ms() - s_lifecycle.last_change_ms[LIFECYCLE_SVC_WIFI]));
+    }
+}
+
+static lifecycle_state_t start_service(lifecycle_service_t service)
+{
+    esp_err_t ret = ESP_FAIL;
+
+    switch (service)
+    {
+    case LIFECYCLE_SVC_HTTP:
+        ret = http_server_init();
+        if (ret == ESP_OK && metrics_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Metrics endpoint unavailable");
+        }
+        if (ret == ESP_OK && static_assets_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Web UI unavailable");
+        }
+        if (ret == ESP_OK && async_log_http_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Log tail endpoint unavailable");
+        }
+        if (ret == ESP_OK && qos_arbiter_http_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "QoS endpoint unavailable");
+        }
+        if (ret == ESP_OK && exposure_http_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Exposure endpoint unavailable");
+        }
+        if (ret == ESP_OK && camera_profile_http_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Profile endpoint unavailable");
+        }
+        break;
+    case LIFECYCLE_SVC_STREAM:
+        ret = video_stream_init(http_server_get_handle());
+        if (ret == ESP_OK && thumbnail_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Thumbnail endpoint unavailable");
+        }
+        if (ret == ESP_OK && burst_init() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Burst endpoint unavailable");
+        }
+        if (ret == ESP_OK)
+        {
+            esp_err_t push_ret = push_upload_start();
+            if (push_ret != ESP_OK && push_ret != ESP_ERR_NOT_SUPPORTED)
+            {
+                ESP_LOGW(TAG, "Push upload unavailable");
+            }
+            esp_err_t mcast_ret = mcast_stream_start();
+            if (mcast_ret != ESP_OK && mcast_ret != ESP_ERR_NOT_SUPPORTED)
+            {
+                ESP_LOGW(TAG, "Multicast stream unavailable");
+            }
+        }
+        break;
+    case LIFECYCLE_SVC_OTA:
+        ret = ota_init();
+        if (ret == ESP_OK)
+        {
+            esp_err_t pull_ret = ota_pull_start();
+            if (pull_ret != ESP_OK && pull_ret != ESP_ERR_NOT_SUPPORTED)
+            {
+                ESP_LOGW(TAG, "Pull OTA unavailable");
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start %s: %s", lifecycle_service_name(service), esp_err_to_name(ret));
+        return LIFECYCLE_STATE_FAILED;
+    }
+    return LIFECYCLE_STATE_UP;
+}
+
+static void stop_service(lifecycle_service_t service)
+{
+    switch (service)
+    {
+    case LIFECYCLE_SVC_HTTP:
+        http_server_stop();
+        break;
+    case LIFECYCLE_SVC_STREAM:
+        mcast_stream_stop();
+        push_upload_stop();
+        burst_deinit();
+        thumbnail_deinit();
+        video_stream_stop();
+        break;
+    case LIFECYCLE_SVC_OTA:
+        ota_pull_stop();
+        ota_deinit();
+        break;
+    default:
+        break;
+    }
+}
+
+static void handle_state(lifecycle_service_t service, lifecycle_state_t state)
+{
+    uint32_t now = boot_ms();
+    lifecycle_state_t prev = s_lifecycle.state[service];
+    uint32_t actions = lifecycle_update(&s_lifecycle, service, state, now);
+
+    if (prev != state)
+    {
+        ESP_LOGI(TAG, "[%lu ms] %s: %s -> %s", (unsigned long)now, lifecycle_service_name(service),
+                 lifecycle_state_name(prev), lifecycle_state_name(state));
+    }
+
+    // Dependents are stopped before the services they rely on
+    for (int s = LIFECYCLE_SVC_COUNT - 1; s >= 0; s--)
+    {
+        if (actions & LIFECYCLE_ACTION_STOP(s))
+        {
+            ESP_LOGI(TAG, "Stopping %s", lifecycle_service_name(s));
+            stop_service(s);
+        }
+    }
+
+    for (int s = 0; s < LIFECYCLE_SVC_COUNT; s++)
+    {
+        if (actions & LIFECYCLE_ACTION_START(s))
+        {
+            handle_state(s, start_service(s));
+        }
+    }
+
+    report_boot_timing();
+}
+
 void app_main(void)
 {
+    // Before anything logs from a hot path
+    if (async_log_init() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Asynchronous logging unavailable, logging to UART directly");
+    }
+    heap_monitor_init();
+    if (qos_arbiter_init() != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Bandwidth arbiter unavailable, streams and OTA run unthrottled");
+    }
+
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
@@ -22,62 +272,41 @@ void app_main(void)
 
     ESP_LOGI(TAG, "Starting application...");
 
-    // Initialize camera first
-    ESP_LOGI(TAG, "Initializing camera...");
-    esp_err_t camera_ret = camera_init();
-    if (camera_ret != ESP_OK)
+    lifecycle_reset(&s_lifecycle);
+    s_lifecycle_queue = xQueueCreate(LIFECYCLE_QUEUE_LEN, sizeof(lifecycle_msg_t));
+    if (s_lifecycle_queue == NULL)
     {
-        ESP_LOGE(TAG, "Camera initialization failed: %s", esp_err_to_name(camera_ret));
-        ESP_LOGE(TAG, "Application will continue without camera functionality");
+        ESP_LOGE(TAG, "Failed to create lifecycle queue");
+        return;
     }
-    else
+
+    // Network events must be observed from the very first connection attempt
+    ret = esp_event_loop_create_default();
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)
     {
-        ESP_LOGI(TAG, "Camera initialized successfully");
+        ESP_LOGE(TAG, "esp_event_loop_create_default failed: %s", esp_err_to_name(ret));
+        return;
+    }
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_LINK_EVENT, ESP_EVENT_ANY_ID,
+                                               &network_event_handler, NULL));
+
+    // Camera init and WiFi association run in parallel
+    if (xTaskCreate(camera_init_task, "camera_init", CAMERA_INIT_TASK_STACK_SIZE,
+                    NULL, CAMERA_INIT_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create camera init task");
+        post_state(LIFECYCLE_SVC_CAMERA, LIFECYCLE_STATE_FAILED);
     }
 
-    // Initialize WiFi as a background task (non-blocking)
     wifi_init_task();
     ESP_LOGI(TAG, "WiFi initialization started in background");
 
     while (1)
     {
-        wifi_status_t status = wifi_get_status();
-
-        if (status == WIFI_STATUS_CONNECTED)
+        lifecycle_msg_t msg;
+        if (xQueueReceive(s_lifecycle_queue, &msg, portMAX_DELAY) == pdTRUE)
         {
-            if (wifi_is_http_server_running())
-            {
-                // Initialize video streaming if camera is ready and streaming not started
-                if (camera_get_status() == CAM_STATUS_READY &&
-                    video_stream_get_status() != VIDEO_STREAM_RUNNING)
-                {
-
-                    httpd_handle_t server_handle = http_server_get_handle();
-                    if (server_handle != NULL)
-                    {
-                        esp_err_t stream_ret = video_stream_init(server_handle);
-                        if (stream_ret == ESP_OK)
-                        {
-                            ESP_LOGI(TAG, "Video streaming initialized successfully");
-                            ESP_LOGI(TAG, "Access the camera stream at: http://<device_ip>/");
-                        }
-                        else
-                        {
-                            ESP_LOGE(TAG, "Failed to initialize video streaming: %s", esp_err_to_name(stream_ret));
-                        }
-                    }
-                }
-            }
-        }
-        else if (status == WIFI_STATUS_CONNECTING)
-        {
-            ESP_LOGI(TAG, "WiFi connecting...");
+            handle_state(msg.service, msg.state);
         }
-        else
-        {
-            ESP_LOGI(TAG, "WiFi disconnected, waiting for connection...");
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(30000)); // Check every 30 seconds
     }
 }
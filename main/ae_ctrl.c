@@ -0,0 +1,185 @@
+#include "ae_ctrl.h"
+#include <math.h>
+#include <string.h>
+
+#define AE_GAMMA 2.2f
+#define AE_SEARCH_STEPS 12      // bisection on log2(factor), to about 0.2%
+
+// Sensor output level for linear light x, 0-1
+static float ae_encode(float x)
+{
+    return x >= 1.0f ? 255.0f : 255.0f * powf(x, 1.0f / AE_GAMMA);
+}
+
+void ae_ctrl_init(ae_ctrl_t *ae, const ae_ctrl_config_t *config, ae_setting_t initial)
+{
+    memset(ae, 0, sizeof(*ae));
+    ae->config = *config;
+    if (ae->config.exposure_min == 0) {
+        ae->config.exposure_min = 1;
+    }
+    for (int i = 0; i < LUMA_HIST_BINS; i++) {
+        float level = (float)((i << LUMA_HIST_SHIFT) + (1 << (LUMA_HIST_SHIFT - 1))) - 0.5f;
+        ae->lin[i] = powf(level / 255.0f, AE_GAMMA);
+    }
+    ae_ctrl_set(ae, initial);
+}
+
+void ae_ctrl_set(ae_ctrl_t *ae, ae_setting_t setting)
+{
+    ae->setting = setting;
+    ae->settle = ae->config.settle_frames;
+    ae->limited = false;
+}
+
+float ae_ctrl_predict(const ae_ctrl_t *ae, const luma_hist_t *hist, float factor)
+{
+    if (hist->count == 0) {
+        return 0.0f;
+    }
+
+    float sum = 0.0f;
+    for (int i = 0; i < LUMA_HIST_BINS; i++) {
+        if (hist->bins[i] != 0) {
+            sum += hist->bins[i] * ae_encode(ae->lin[i] * factor);
+        }
+    }
+    return sum / hist->count;
+}
+
+// Exposure factor that brings the predicted mean to the target
+static float ae_ctrl_solve(const ae_ctrl_t *ae, const luma_hist_t *hist)
+{
+    float lo = -log2f(AE_CTRL_MAX_STEP);
+    float hi = log2f(AE_CTRL_MAX_STEP);
+    float target = ae->config.target;
+
+    if (ae_ctrl_predict(ae, hist, exp2f(hi)) <= target) {
+        return AE_CTRL_MAX_STEP;
+    }
+    if (ae_ctrl_predict(ae, hist, exp2f(lo)) >= target) {
+        return 1.0f / AE_CTRL_MAX_STEP;
+    }
+    for (int i = 0; i < AE_SEARCH_STEPS; i++) {
+        float mid = (lo + hi) / 2.0f;
+        if (ae_ctrl_predict(ae, hist, exp2f(mid)) < target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return exp2f((lo + hi) / 2.0f);
+}
+
+// Linear light at the upper edge of bin i
+static float ae_ctrl_bin_top(int bin)
+{
+    return powf(((float)((bin + 1) << LUMA_HIST_SHIFT) - 0.5f) / 255.0f, AE_GAMMA);
+}
+
+// Largest factor that pushes at most clip_permille more of the frame into
+// the top bin, at least 1. Highlights that are clipped already (a window
+// behind the subject) do not hold the rest of the frame back.
+static float ae_ctrl_clip_limit(const ae_ctrl_t *ae, const luma_hist_t *hist)
+{
+    uint64_t limit = (uint64_t)hist->count * ae->config.clip_permille;
+    uint64_t above = 0;
+
+    for (int i = LUMA_HIST_BINS - 2; i > 0; i--) {
+        above += hist->bins[i];
+        if (above * 1000 > limit) {
+            // Bins above i may reach the top bin; the top of bin i stops
+            // just short of it
+            float factor = ae_ctrl_bin_top(LUMA_HIST_BINS - 2) / ae_ctrl_bin_top(i);
+            return factor > 1.0f ? factor : 1.0f;
+        }
+    }
+    return AE_CTRL_MAX_STEP;
+}
+
+// Split a total exposure into lines and gain, preferring lines
+static ae_setting_t ae_ctrl_split(const ae_ctrl_config_t *config, float total)
+{
+    ae_setting_t setting = { .exposure = config->exposure_min, .gain = 0 };
+    float max_total = (float)config->exposure_max * (config->gain_max + 1);
+
+    if (total <= config->exposure_min) {
+        return setting;
+    }
+    if (total > max_total) {
+        total = max_total;
+    }
+
+    if (total > config->exposure_max) {
+        setting.gain = (uint8_t)ceilf(total / config->exposure_max) - 1;
+        if (setting.gain > config->gain_max) {
+            setting.gain = config->gain_max;
+        }
+    }
+    float exposure = roundf(total / (setting.gain + 1));
+    if (exposure < config->exposure_min) {
+        exposure = config->exposure_min;
+    } else if (exposure > config->exposure_max) {
+        exposure = config->exposure_max;
+    }
+    setting.exposure = (uint16_t)exposure;
+    return setting;
+}
+
+bool ae_ctrl_update(ae_ctrl_t *ae, const luma_hist_t *hist)
+{
+    if (hist->count == 0) {
+        return false;
+    }
+
+    ae->stats.frames++;
+    if (ae->settle > 0) {
+        ae->settle--;
+        ae->stats.settling++;
+        if (!ae->converged) {
+            ae->off_target_frames++;
+        }
+        return false;
+    }
+
+    // Hysteresis: once converged, only leave on twice the tolerance
+    int error = (int)hist->mean - ae->config.target;
+    int band = ae->converged ? 2 * ae->config.tolerance : ae->config.tolerance;
+    if (error >= -band && error <= band) {
+        if (!ae->converged) {
+            ae->converged = true;
+            ae->stats.last_converge_frames = ae->off_target_frames;
+            if (ae->off_target_frames > ae->stats.max_converge_frames) {
+                ae->stats.max_converge_frames = ae->off_target_frames;
+            }
+        }
+        ae->limited = false;
+        return false;
+    }
+    if (ae->converged) {
+        ae->converged = false;
+        ae->off_target_frames = 0;
+    }
+    ae->off_target_frames++;
+
+    float factor = ae_ctrl_solve(ae, hist);
+    if (factor > 1.0f) {
+        float clip = ae_ctrl_clip_limit(ae, hist);
+        if (factor > clip) {
+            factor = clip;
+        }
+    }
+
+    ae_setting_t next = ae_ctrl_split(&ae->config, ae_ctrl_total(ae->setting) * factor);
+    if (next.exposure == ae->setting.exposure && next.gain == ae->setting.gain) {
+        // At a limit, or held back by the highlights
+        ae->limited = true;
+        return false;
+    }
+
+    ae->setting = next;
+    ae->settle = ae->config.settle_frames;
+    ae->limited = false;
+    ae->stats.adjustments++;
+    return true;
+}
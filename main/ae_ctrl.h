@@ -0,0 +1,79 @@
+#ifndef AE_CTRL_H
+#define AE_CTRL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "luma_hist.h"
+
+// Exposure and gain controller for the OV2640.
+//
+// The sensor's own AEC steps a little per frame and takes a second or more
+// to settle after the lights change. This one meters on the luma histogram
+// instead: it linearizes every bin (gamma 2.2), finds the exposure factor
+// that brings the predicted mean to the target, and applies it in one step.
+// A step is limited to 8x either way, and may clip no more than
+// clip_permille of the frame that was not clipped before. Clipped highlights
+// and crushed shadows make the prediction fall short, never overshoot, so a
+// large change takes two or three steps. Frames still exposed with the
+// previous setting are skipped.
+//
+// Total exposure is aec_value (sensor lines) x (agc_gain + 1): the OV2640's
+// gain table is close to agc_gain + 1 times. Exposure is used up to
+// exposure_max before any gain is added, as gain only adds noise. No
+// ESP-IDF dependencies.
+
+#define AE_CTRL_MAX_STEP 8.0f   // largest exposure factor per adjustment
+
+typedef struct {
+    uint8_t target;             // mean luma to converge on
+    uint8_t tolerance;          // converged within target +- tolerance
+    uint16_t exposure_min;      // aec_value, 0-1200 lines
+    uint16_t exposure_max;
+    uint8_t gain_max;           // agc_gain, 0-30
+    uint8_t settle_frames;      // frames after a change that still show the old setting
+    uint16_t clip_permille;     // share of the frame an increase may newly clip
+} ae_ctrl_config_t;
+
+typedef struct {
+    uint16_t exposure;
+    uint8_t gain;
+} ae_setting_t;
+
+typedef struct {
+    uint32_t frames;            // histograms fed in
+    uint32_t settling;          // of those, skipped after a change
+    uint32_t adjustments;
+    uint32_t last_converge_frames;  // from leaving the target band to being back
+    uint32_t max_converge_frames;
+} ae_ctrl_stats_t;
+
+typedef struct {
+    ae_ctrl_config_t config;
+    ae_setting_t setting;
+    float lin[LUMA_HIST_BINS];  // linear light at each bin's centre
+    uint8_t settle;
+    bool converged;
+    bool limited;               // off target with the setting at its limit
+    uint32_t off_target_frames;
+    ae_ctrl_stats_t stats;
+} ae_ctrl_t;
+
+void ae_ctrl_init(ae_ctrl_t *ae, const ae_ctrl_config_t *config, ae_setting_t initial);
+
+// Start from `setting`, e.g. after the sensor was reset to it. The next
+// settle_frames histograms are skipped.
+void ae_ctrl_set(ae_ctrl_t *ae, ae_setting_t setting);
+
+// Feed the histogram of a frame. Returns true if ae->setting changed and
+// should be programmed into the sensor.
+bool ae_ctrl_update(ae_ctrl_t *ae, const luma_hist_t *hist);
+
+// Mean luma the histogram would have with its exposure scaled by `factor`
+float ae_ctrl_predict(const ae_ctrl_t *ae, const luma_hist_t *hist, float factor);
+
+static inline uint32_t ae_ctrl_total(ae_setting_t setting)
+{
+    return (uint32_t)setting.exposure * (setting.gain + 1u);
+}
+
+#endif // AE_CTRL_H
@@ -0,0 +1,273 @@
+#include "async_log.h"
+#include "log_ring.h"
+#include "http_server.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "async_log";
+
+#ifdef CONFIG_APP_ASYNC_LOG
+
+#define ASYNC_LOG_DRAIN_PERIOD_MS 20
+#define ASYNC_LOG_TAIL_SIZE (CONFIG_APP_LOG_TAIL_KB * 1024)
+
+static log_ring_slot_t s_slots[CONFIG_APP_LOG_RING_SLOTS];
+static log_ring_t s_ring;
+static vprintf_like_t s_console;    // the vprintf esp_log used before us
+static TaskHandle_t s_drain_task;
+static uint32_t s_reported_dropped;
+
+// Tail of everything drained, for /logs; written by the drain task only
+static char *s_tail;
+static uint32_t s_tail_total;
+static SemaphoreHandle_t s_tail_lock;
+
+static int async_log_vprintf(const char *fmt, va_list args)
+{
+    uint32_t suppressed;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    // Each ESP_LOGx call site has its own format string
+    if (!log_ring_admit(&s_ring, (uintptr_t)fmt, now_ms, &suppressed)) {
+        return 0;
+    }
+
+    log_ring_slot_t *slot = log_ring_reserve(&s_ring);
+    if (slot == NULL) {
+        return 0;
+    }
+
+    int len = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    if (len < 0) {
+        len = 0;
+    } else if (len >= (int)sizeof(slot->text)) {
+        len = sizeof(slot->text) - 1;
+        slot->text[len - 1] = '\n';
+    }
+    slot->len = len;
+    slot->suppressed = suppressed > UINT16_MAX ? UINT16_MAX : suppressed;
+    log_ring_commit(&s_ring, slot);
+    return len;
+}
+
+static int console_printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int ret = s_console(fmt, args);
+    va_end(args);
+    return ret;
+}
+
+static void tail_append(const char *text, size_t len)
+{
+    if (s_tail == NULL) {
+        return;
+    }
+
+    xSemaphoreTake(s_tail_lock, portMAX_DELAY);
+    while (len > 0) {
+        size_t pos = s_tail_total % ASYNC_LOG_TAIL_SIZE;
+        size_t n = ASYNC_LOG_TAIL_SIZE - pos;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s_tail + pos, text, n);
+        s_tail_total += n;
+        text += n;
+        len -= n;
+    }
+    xSemaphoreGive(s_tail_lock);
+}
+
+static void emit(const char *text, size_t len)
+{
+    console_printf("%.*s", (int)len, text);
+    tail_append(text, len);
+}
+
+// Lines about the logger itself bypass the ring
+static void emit_note(uint32_t count, const char *what)
+{
+    char line[80];
+    int len = snprintf(line, sizeof(line), "W (%lu) %s: %lu %s\n", (unsigned long)esp_log_timestamp(), TAG,
+                       (unsigned long)count, what);
+    emit(line, len);
+}
+
+static void log_drain_task(void *arg)
+{
+    log_ring_stats_t stats;
+
+    for (;;) {
+        log_ring_get_stats(&s_ring, &stats);
+        if (stats.dropped != s_reported_dropped) {
+            emit_note(stats.dropped - s_reported_dropped, "lines dropped, log ring full");
+            s_reported_dropped = stats.dropped;
+        }
+
+        log_ring_slot_t *slot;
+        while ((slot = log_ring_peek(&s_ring)) != NULL) {
+            if (slot->suppressed > 0) {
+                emit_note(slot->suppressed, "repeated lines suppressed");
+            }
+            emit(slot->text, slot->len);
+            log_ring_release(&s_ring);
+        }
+        fflush(stdout);
+
+        vTaskDelay(pdMS_TO_TICKS(ASYNC_LOG_DRAIN_PERIOD_MS));
+    }
+}
+
+esp_err_t async_log_init(void)
+{
+    if (s_drain_task != NULL) {
+        return ESP_OK;
+    }
+
+    if (log_ring_init(&s_ring, s_slots, CONFIG_APP_LOG_RING_SLOTS, CONFIG_APP_LOG_RATE_LIMIT_BURST,
+                      CONFIG_APP_LOG_RATE_LIMIT_WINDOW_MS) == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // The tail is optional: without PSRAM /logs is unavailable
+    s_tail_lock = xSemaphoreCreateMutex();
+    s_tail = heap_caps_malloc(ASYNC_LOG_TAIL_SIZE, MALLOC_CAP_SPIRAM);
+    if (s_tail_lock == NULL || s_tail == NULL) {
+        free(s_tail);
+        s_tail = NULL;
+    }
+
+    if (xTaskCreatePinnedToCore(log_drain_task, "log_drain", LOG_TASK_STACK_SIZE, NULL,
+                                LOG_TASK_PRIORITY, &s_drain_task, LOG_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create log drain task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_console = esp_log_set_vprintf(async_log_vprintf);
+    ESP_LOGI(TAG, "Asynchronous logging: %lu line ring, %d KB tail%s", (unsigned long)(s_ring.mask + 1),
+             s_tail != NULL ? CONFIG_APP_LOG_TAIL_KB : 0, s_tail != NULL ? "" : " (no PSRAM)");
+    return ESP_OK;
+}
+
+static esp_err_t logs_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char value[12];
+    char offset[12];
+    uint32_t since = 0;
+    bool has_since = false;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+        char *end;
+        unsigned long v = strtoul(value, &end, 10);
+        if (end == value || *end != '\0') {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "since must be a byte offset");
+        }
+        since = v;
+        has_since = true;
+    }
+
+    // Snapshot the tail so the drain task is not held up by the network
+    session_arena_t *arena = http_server_arena_open();
+    char *copy = arena != NULL ? session_arena_alloc(arena, ASYNC_LOG_TAIL_SIZE) : NULL;
+    if (copy == NULL) {
+        http_server_arena_close(arena);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+
+    xSemaphoreTake(s_tail_lock, portMAX_DELAY);
+    uint32_t total = s_tail_total;
+    uint32_t avail = total < ASYNC_LOG_TAIL_SIZE ? total : ASYNC_LOG_TAIL_SIZE;
+    uint32_t start = total - avail;
+    if (has_since && since > start && since <= total) {
+        start = since;
+    }
+    size_t len = total - start;
+    size_t pos = start % ASYNC_LOG_TAIL_SIZE;
+    size_t first = ASYNC_LOG_TAIL_SIZE - pos < len ? ASYNC_LOG_TAIL_SIZE - pos : len;
+    memcpy(copy, s_tail + pos, first);
+    memcpy(copy + first, s_tail, len - first);
+    xSemaphoreGive(s_tail_lock);
+
+    snprintf(offset, sizeof(offset), "%lu", (unsigned long)total);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_set_hdr(req, "X-Log-Offset", offset);
+    esp_err_t ret = httpd_resp_send(req, copy, len);
+    http_server_arena_close(arena);
+    return ret;
+}
+
+esp_err_t async_log_http_init(void)
+{
+    if (s_tail == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    httpd_uri_t logs_uri = {
+        .uri = "/logs",
+        .method = HTTP_GET,
+        .handler = logs_handler,
+        .user_ctx = NULL
+    };
+    return http_server_register_handler(&logs_uri);
+}
+
+esp_err_t async_log_http_deinit(void)
+{
+    if (s_tail == NULL) {
+        return ESP_OK;
+    }
+    return http_server_unregister_handler("/logs", HTTP_GET);
+}
+
+void async_log_get_stats(async_log_stats_t *stats)
+{
+    log_ring_stats_t ring;
+
+    log_ring_get_stats(&s_ring, &ring);
+    stats->ring_slots = ring.capacity;
+    stats->lines_written = ring.written;
+    stats->lines_dropped = ring.dropped;
+    stats->lines_suppressed = ring.suppressed;
+    stats->tail_size = s_tail != NULL ? ASYNC_LOG_TAIL_SIZE : 0;
+    stats->tail_total = s_tail_total;
+}
+
+#else // CONFIG_APP_ASYNC_LOG
+
+esp_err_t async_log_init(void)
+{
+    ESP_LOGI(TAG, "Asynchronous logging disabled");
+    return ESP_OK;
+}
+
+esp_err_t async_log_http_init(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t async_log_http_deinit(void)
+{
+    return ESP_OK;
+}
+
+void async_log_get_stats(async_log_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_APP_ASYNC_LOG
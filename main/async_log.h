@@ -0,0 +1,36 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Asynchronous log backend, see "ESP32S3Cam Logging" in menuconfig.
+//
+// Installed as the esp_log vprintf hook: an ESP_LOGx call formats its line
+// into a lock-free ring and returns without touching the UART. A low-priority
+// drain task writes the lines to the console and into a tail buffer served
+// by GET /logs. Lines repeated by one call site are rate-limited.
+
+typedef struct {
+    uint32_t ring_slots;
+    uint32_t lines_written;     // accepted into the ring
+    uint32_t lines_dropped;     // ring full
+    uint32_t lines_suppressed;  // rate limited
+    uint32_t tail_size;
+    uint32_t tail_total;        // bytes drained since boot (the /logs offset)
+} async_log_stats_t;
+
+// Hook esp_log and start the drain task. Call first thing in app_main.
+esp_err_t async_log_init(void);
+
+// Register the /logs handler. GET /logs returns the tail as text/plain;
+// /logs?since=N only the bytes after offset N (the X-Log-Offset header of
+// the previous response), for polling.
+esp_err_t async_log_http_init(void);
+
+// Unregister the /logs handler
+esp_err_t async_log_http_deinit(void);
+
+void async_log_get_stats(async_log_stats_t *stats);
+
+#endif // ASYNC_LOG_H
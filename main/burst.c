@@ -0,0 +1,238 @@
+#include "burst.h"
+#include "burst_buffer.h"
+#include "capture_pipeline.h"
+#include "http_server.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "burst";
+
+#define BURST_DEFAULT_FRAMES 10
+#define BURST_MAX_INTERVAL_MS 10000
+#define BURST_FRAME_TIMEOUT_MS 1000
+#define BURST_CAPACITY_PSRAM (CONFIG_APP_BURST_BUFFER_KB * 1024)
+#define BURST_CAPACITY_DRAM (48 * 1024)
+#define BURST_BOUNDARY "burst-7d3f1c2a9b"
+#define BURST_STACK_SIZE 4096
+
+// A burst can take minutes (n frames at up to 10 s apart), so the request is
+// detached from the httpd task and collected and sent by the burst task, one
+// burst at a time
+typedef struct {
+    httpd_req_t *req;
+    uint32_t n;
+    uint32_t interval_ms;
+} burst_job_t;
+
+static QueueHandle_t s_jobs = NULL;
+
+// Only touched from the burst task
+static burst_buffer_t s_burst;
+static burst_stats_t s_stats;
+
+static frame_t *burst_source(void *ctx, uint32_t after_seq, uint32_t timeout_ms)
+{
+    return capture_pipeline_get_frame(after_seq, timeout_ms);
+}
+
+static bool query_uint(const char *query, const char *key, uint32_t max, uint32_t *value)
+{
+    char buf[12];
+
+    if (httpd_query_key_value(query, key, buf, sizeof(buf)) != ESP_OK) {
+        return true; // keep the default
+    }
+    char *end;
+    long v = strtol(buf, &end, 10);
+    if (end == buf || *end != '\0' || v < 0 || (unsigned long)v > max) {
+        return false;
+    }
+    *value = (uint32_t)v;
+    return true;
+}
+
+static esp_err_t burst_send(httpd_req_t *req, const burst_buffer_t *burst)
+{
+    char part[192];
+    char rate[16];
+    char count[12];
+    uint32_t mfps = burst_buffer_rate_mfps(burst);
+
+    snprintf(rate, sizeof(rate), "%lu.%03lu", (unsigned long)(mfps / 1000), (unsigned long)(mfps % 1000));
+    snprintf(count, sizeof(count), "%lu", (unsigned long)burst->count);
+
+    httpd_resp_set_type(req, "multipart/mixed; boundary=" BURST_BOUNDARY);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+    httpd_resp_set_hdr(req, "X-Burst-Frames", count);
+    httpd_resp_set_hdr(req, "X-Burst-Rate-Fps", rate);
+
+    for (uint32_t i = 0; i < burst->count; i++) {
+        const burst_frame_t *f = &burst->frames[i];
+        int len = snprintf(part, sizeof(part),
+                           "--" BURST_BOUNDARY "\r\n"
+                           "Content-Type: image/jpeg\r\n"
+                           "Content-Length: %u\r\n"
+                           "X-Frame-Seq: %lu\r\n"
+                           "X-Timestamp-Us: %lld\r\n"
+                           "X-Offset-Us: %lld\r\n"
+                           "\r\n",
+                           (unsigned)f->len, (unsigned long)f->seq, (long long)f->timestamp_us,
+                           (long long)(f->timestamp_us - burst->frames[0].timestamp_us));
+
+        esp_err_t ret = httpd_resp_send_chunk(req, part, len);
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, (const char *)burst_buffer_frame_data(burst, i), f->len);
+        }
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, "\r\n", 2);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    esp_err_t ret = httpd_resp_send_chunk(req, "--" BURST_BOUNDARY "--\r\n", HTTPD_RESP_USE_STRLEN);
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return ret;
+}
+
+static esp_err_t burst_run(httpd_req_t *req, uint32_t n, uint32_t interval_ms)
+{
+    bool psram = esp_psram_is_initialized();
+    size_t capacity = psram ? BURST_CAPACITY_PSRAM : BURST_CAPACITY_DRAM;
+    void *memory = heap_caps_malloc(capacity, psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (memory == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u byte burst buffer", (unsigned)capacity);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Out of memory", HTTPD_RESP_USE_STRLEN);
+    }
+
+    burst_buffer_t *burst = &s_burst;
+    burst_buffer_init(burst, memory, capacity, CONFIG_APP_BURST_MAX_FRAMES);
+    burst_buffer_collect(burst, burst_source, NULL, n, interval_ms, BURST_FRAME_TIMEOUT_MS);
+
+    uint32_t mfps = burst_buffer_rate_mfps(burst);
+    ESP_LOGI(TAG, "Burst: %lu/%lu frames, %lu KB, %lu.%03lu fps (%lu skipped for interval)",
+             (unsigned long)burst->count, (unsigned long)n, (unsigned long)(burst->used / 1024),
+             (unsigned long)(mfps / 1000), (unsigned long)(mfps % 1000), (unsigned long)burst->frames_skipped);
+
+    s_stats.requests++;
+    s_stats.frames += burst->count;
+    s_stats.last_frames = burst->count;
+    s_stats.last_rate_mfps = mfps;
+
+    esp_err_t ret;
+    if (burst->count == 0) {
+        httpd_resp_send_500(req);
+        ret = ESP_FAIL;
+    } else {
+        ret = burst_send(req, burst);
+    }
+
+    heap_caps_free(memory);
+    return ret;
+}
+
+static void burst_task(void *pvParameters)
+{
+    burst_job_t job;
+
+    while (true) {
+        if (xQueueReceive(s_jobs, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        if (burst_run(job.req, job.n, job.interval_ms) != ESP_OK) {
+            ESP_LOGW(TAG, "Burst response failed");
+        }
+        httpd_req_async_handler_complete(job.req);
+    }
+}
+
+static esp_err_t burst_handler(httpd_req_t *req)
+{
+    char query[48] = "";
+    burst_job_t job = { .n = BURST_DEFAULT_FRAMES, .interval_ms = 0 };
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (!query_uint(query, "n", CONFIG_APP_BURST_MAX_FRAMES, &job.n) || job.n == 0 ||
+        !query_uint(query, "interval_ms", BURST_MAX_INTERVAL_MS, &job.interval_ms)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "n or interval_ms out of range");
+    }
+
+    if (!capture_pipeline_is_running()) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    // One burst runs and one more may wait for it; anything beyond that is
+    // turned away rather than holding its socket for minutes
+    if (uxQueueSpacesAvailable(s_jobs) == 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_send(req, "Burst in progress", HTTPD_RESP_USE_STRLEN);
+    }
+
+    esp_err_t ret = httpd_req_async_handler_begin(req, &job.req);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to detach burst request: %s", esp_err_to_name(ret));
+        httpd_resp_send_500(req);
+        return ret;
+    }
+    if (xQueueSend(s_jobs, &job, 0) != pdTRUE) {
+        httpd_resp_set_status(job.req, "503 Service Unavailable");
+        httpd_resp_set_hdr(job.req, "Retry-After", "5");
+        httpd_resp_send(job.req, "Burst in progress", HTTPD_RESP_USE_STRLEN);
+        httpd_req_async_handler_complete(job.req);
+    }
+    return ESP_OK;
+}
+
+esp_err_t burst_init(void)
+{
+    // Created once; kept across a stop and start of the service
+    if (s_jobs == NULL) {
+        s_jobs = xQueueCreate(1, sizeof(burst_job_t));
+        if (s_jobs == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        // Writes frames to a socket for a long time, like a stream sender
+        if (xTaskCreatePinnedToCore(burst_task, "burst", BURST_STACK_SIZE, NULL, STREAM_SENDER_PRIORITY, NULL,
+                                    STREAM_SENDER_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create burst task");
+            vQueueDelete(s_jobs);
+            s_jobs = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    httpd_uri_t burst_uri = {
+        .uri = "/burst",
+        .method = HTTP_GET,
+        .handler = burst_handler,
+        .user_ctx = NULL
+    };
+
+    return http_server_register_handler(&burst_uri);
+}
+
+esp_err_t burst_deinit(void)
+{
+    return http_server_unregister_handler("/burst", HTTP_GET);
+}
+
+void burst_get_stats(burst_stats_t *stats)
+{
+    *stats = s_stats;
+}
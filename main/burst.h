@@ -0,0 +1,26 @@
+#ifndef BURST_H
+#define BURST_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Burst statistics
+typedef struct {
+    uint32_t requests;
+    uint32_t frames;            // frames returned, all bursts
+    uint32_t last_frames;
+    uint32_t last_rate_mfps;    // achieved capture rate of the last burst, fps x 1000
+} burst_stats_t;
+
+// Register GET /burst?n=10&interval_ms=0. Frames are captured back to back
+// into a PSRAM buffer and returned as one multipart/mixed response with
+// per-frame sequence numbers and timestamps. Bursts run on their own task,
+// one at a time; the first call creates it.
+esp_err_t burst_init(void);
+
+// Unregister /burst
+esp_err_t burst_deinit(void);
+
+void burst_get_stats(burst_stats_t *stats);
+
+#endif // BURST_H
@@ -0,0 +1,79 @@
+#include "burst_buffer.h"
+#include <string.h>
+
+void burst_buffer_init(burst_buffer_t *burst, void *memory, size_t capacity, uint32_t max_frames)
+{
+    memset(burst, 0, sizeof(*burst));
+    burst->memory = memory;
+    burst->capacity = capacity;
+    burst->max_frames = max_frames > BURST_MAX_FRAMES ? BURST_MAX_FRAMES : max_frames;
+}
+
+bool burst_buffer_append(burst_buffer_t *burst, const frame_t *frame)
+{
+    if (burst->count >= burst->max_frames || frame->len > burst->capacity - burst->used) {
+        return false;
+    }
+
+    burst_frame_t *entry = &burst->frames[burst->count++];
+    entry->offset = burst->used;
+    entry->len = frame->len;
+    entry->timestamp_us = frame->timestamp_us;
+    entry->seq = frame->seq;
+    entry->width = frame->width;
+    entry->height = frame->height;
+
+    memcpy(burst->memory + burst->used, frame->data, frame->len);
+    burst->used += frame->len;
+    return true;
+}
+
+uint32_t burst_buffer_collect(burst_buffer_t *burst, burst_source_fn source, void *ctx,
+                       uint32_t n, uint32_t interval_ms, uint32_t timeout_ms)
+{
+    uint32_t last_seq = 0;
+    int64_t next_due_us = 0;
+
+    // The first frame is the next one captured, not one already waiting
+    frame_t *latest = source(ctx, 0, 0);
+    if (latest != NULL) {
+        last_seq = latest->seq;
+        frame_unref(latest);
+    }
+
+    while (burst->count < n) {
+        frame_t *frame = source(ctx, last_seq, timeout_ms);
+        if (frame == NULL) {
+            break;
+        }
+        last_seq = frame->seq;
+
+        if (burst->count > 0 && frame->timestamp_us < next_due_us) {
+            burst->frames_skipped++;
+            frame_unref(frame);
+            continue;
+        }
+
+        bool stored = burst_buffer_append(burst, frame);
+        frame_unref(frame);
+        if (!stored) {
+            break;
+        }
+        next_due_us = burst->frames[burst->count - 1].timestamp_us + (int64_t)interval_ms * 1000;
+    }
+
+    return burst->count;
+}
+
+uint32_t burst_buffer_rate_mfps(const burst_buffer_t *burst)
+{
+    if (burst->count < 2) {
+        return 0;
+    }
+
+    int64_t span_us = burst->frames[burst->count - 1].timestamp_us - burst->frames[0].timestamp_us;
+    if (span_us <= 0) {
+        return 0;
+    }
+    return (uint32_t)((int64_t)(burst->count - 1) * 1000000000LL / span_us);
+}
@@ -0,0 +1,62 @@
+#ifndef BURST_BUFFER_H
+#define BURST_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_pool.h"
+
+// Bounded in-memory store for a burst of frames.
+//
+// Frames are copied back to back into one caller-supplied region (PSRAM on
+// the device), so a burst never holds frame pool slabs and the capture task
+// keeps running while the burst is sent. Collection is driven through a
+// frame source callback and only depends on frame_pool, so it can run
+// against a synthetic camera on any host.
+
+#define BURST_MAX_FRAMES 32
+
+typedef struct {
+    size_t offset;
+    size_t len;
+    int64_t timestamp_us;
+    uint32_t seq;
+    uint16_t width;
+    uint16_t height;
+} burst_frame_t;
+
+typedef struct {
+    uint8_t *memory;
+    size_t capacity;
+    size_t used;
+    burst_frame_t frames[BURST_MAX_FRAMES];
+    uint32_t count;
+    uint32_t max_frames;
+    uint32_t frames_skipped;    // newer frames passed over to honour the interval
+} burst_buffer_t;
+
+// Returns a referenced frame with seq > after_seq, or NULL after timeout_ms
+typedef frame_t *(*burst_source_fn)(void *ctx, uint32_t after_seq, uint32_t timeout_ms);
+
+// max_frames is clamped to BURST_MAX_FRAMES
+void burst_buffer_init(burst_buffer_t *burst, void *memory, size_t capacity, uint32_t max_frames);
+
+// Copy a frame into the buffer; false if the frame or byte limit is reached
+bool burst_buffer_append(burst_buffer_t *burst, const frame_t *frame);
+
+static inline const uint8_t *burst_buffer_frame_data(const burst_buffer_t *burst, uint32_t index)
+{
+    return burst->memory + burst->frames[index].offset;
+}
+
+// Collect up to n consecutive frames, at least interval_ms apart by capture
+// timestamp (0 = every frame). Stops early when the buffer is full or the
+// source times out. Returns the number of frames collected.
+uint32_t burst_buffer_collect(burst_buffer_t *burst, burst_source_fn source, void *ctx,
+                       uint32_t n, uint32_t interval_ms, uint32_t timeout_ms);
+
+// Achieved capture rate in frames per second x 1000 (0 with fewer than two
+// frames)
+uint32_t burst_buffer_rate_mfps(const burst_buffer_t *burst);
+
+#endif // BURST_BUFFER_H
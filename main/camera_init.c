@@ -1,12 +1,97 @@
 #include "camera_init.h"
+#include "camera_profile.h"
+#include "dram_stream.h"
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_psram.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 static const char *TAG = "camera_init";
 static volatile cam_status_t s_camera_status = CAM_STATUS_NOT_INITIALIZED;
+// Held for every call into the driver or the sensor, and for the whole of a
+// deinit and init on the capture task, so the HTTP server and the QoS
+// arbiter never touch a sensor that is being torn down. Created by the
+// first camera_init(); nothing before it finds the camera ready anyway.
+static SemaphoreHandle_t s_sensor_lock = NULL;
+static sensor_roi_window_t s_roi;
+static bool s_roi_active = false;
+static uint32_t s_xclk_hz = CAMERA_XCLK_FREQ_HZ;
 
-esp_err_t camera_init(void)
+#define OV2640_COM2 0x109     // sensor bank
+#define OV2640_COM2_STDBY 0x10
+
+// Longer than any SCCB write or profile load, shorter than a reinit
+#define CAMERA_SENSOR_WAIT_MS 100
+
+static bool camera_lock(TickType_t wait)
+{
+    return s_sensor_lock != NULL && xSemaphoreTake(s_sensor_lock, wait) == pdTRUE;
+}
+
+static void camera_unlock(void)
+{
+    xSemaphoreGive(s_sensor_lock);
+}
+
+bool camera_sensor_lock(void)
+{
+    if (s_sensor_lock == NULL) {
+        return false;
+    }
+    if (!camera_lock(pdMS_TO_TICKS(CAMERA_SENSOR_WAIT_MS))) {
+        ESP_LOGW(TAG, "Camera busy, sensor access rejected");
+        return false;
+    }
+    return true;
+}
+
+void camera_sensor_unlock(void)
+{
+    camera_unlock();
+}
+
+// Initial settings for sensors without profiles, see camera_profile.h
+static void camera_apply_defaults(sensor_t *s)
+{
+    s->set_brightness(s, 0);     // -2 to 2
+    s->set_contrast(s, 0);       // -2 to 2
+    s->set_saturation(s, 0);     // -2 to 2
+    s->set_special_effect(s, 0); // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
+    s->set_whitebal(s, 1);       // 0 = disable , 1 = enable
+    s->set_awb_gain(s, 1);       // 0 = disable , 1 = enable
+    s->set_wb_mode(s, 0);        // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
+    s->set_exposure_ctrl(s, 1);  // 0 = disable , 1 = enable
+    s->set_aec2(s, 0);           // 0 = disable , 1 = enable
+    s->set_ae_level(s, 0);       // -2 to 2
+    s->set_aec_value(s, 300);    // 0 to 1200
+    s->set_gain_ctrl(s, 1);      // 0 = disable , 1 = enable
+    s->set_agc_gain(s, 0);       // 0 to 30
+    s->set_gainceiling(s, (gainceiling_t)0);  // 0 to 6
+    s->set_bpc(s, 0);            // 0 = disable , 1 = enable
+    s->set_wpc(s, 1);            // 0 = disable , 1 = enable
+    s->set_raw_gma(s, 1);        // 0 = disable , 1 = enable
+    s->set_lenc(s, 1);           // 0 = disable , 1 = enable
+    s->set_hmirror(s, 0);        // 0 = disable , 1 = enable
+    s->set_vflip(s, 0);          // 0 = disable , 1 = enable
+    s->set_dcw(s, 1);            // 0 = disable , 1 = enable
+    s->set_colorbar(s, 0);       // 0 = disable , 1 = enable
+}
+
+// After a driver init or a sensor reset nothing is known about the registers
+static void camera_apply_settings(sensor_t *s)
+{
+    camera_profile_invalidate();
+    esp_err_t err = camera_profile_load(s, camera_profile_current());
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        camera_apply_defaults(s);
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to load sensor profile %s", camera_profile_current());
+    }
+}
+
+static esp_err_t camera_init_locked(void)
 {
     if (s_camera_status == CAM_STATUS_READY) {
         ESP_LOGW(TAG, "Camera is already initialized");
@@ -33,6 +118,13 @@ esp_err_t camera_init(void)
         fb_location = CAMERA_FB_IN_PSRAM;
         jpeg_quality = CAMERA_JPEG_QUALITY;
         ESP_LOGI(TAG, "Using PSRAM for frame buffers");
+    } else if (dram_stream_active()) {
+        // Streamed from the one driver buffer without a copy, see dram_stream.h
+        frame_size = DRAM_STREAM_FRAME_SIZE;
+        fb_count = 1;
+        fb_location = CAMERA_FB_IN_DRAM;
+        jpeg_quality = DRAM_STREAM_QUALITY;
+        ESP_LOGI(TAG, "Using one internal DRAM frame buffer, streamed in place");
     } else {
         // No PSRAM - use conservative settings
         frame_size = FRAMESIZE_CIF;  // 352x288
@@ -42,6 +134,11 @@ esp_err_t camera_init(void)
         ESP_LOGI(TAG, "Using internal DRAM for frame buffers");
     }
 
+    // Uncompressed frames are several times larger than JPEG ones
+    if (CAMERA_PIXEL_FORMAT != PIXFORMAT_JPEG) {
+        frame_size = psram_found ? CAMERA_RAW_FRAME_SIZE : FRAMESIZE_QQVGA;
+    }
+
     camera_config_t config = {
         .pin_pwdn = CAM_PIN_PWDN,
         .pin_reset = CAM_PIN_RESET,
@@ -60,8 +157,8 @@ esp_err_t camera_init(void)
         .pin_href = CAM_PIN_HREF,
         .pin_pclk = CAM_PIN_PCLK,
         
-        .xclk_freq_hz = 10000000,  // 10MHz for better stability
-        .ledc_timer = LEDC_TIMER_0,
+        .xclk_freq_hz = s_xclk_hz,  // lowered by camera_set_xclk() if frames get corrupted
+        .ledc_timer = CAM_XCLK_LEDC_TIMER,
         .ledc_channel = LEDC_CHANNEL_0,
         
         .pixel_format = CAMERA_PIXEL_FORMAT,
@@ -73,8 +170,9 @@ esp_err_t camera_init(void)
         .sccb_i2c_port = 0  // Use I2C port 0 (default)
     };
 
-    ESP_LOGI(TAG, "Camera config: frame_size=%d, fb_count=%d, fb_location=%s, jpeg_quality=%d", 
-             frame_size, fb_count, fb_location == CAMERA_FB_IN_PSRAM ? "PSRAM" : "DRAM", jpeg_quality);
+    ESP_LOGI(TAG, "Camera config: frame_size=%d, fb_count=%d, fb_location=%s, jpeg_quality=%d, xclk=%lu MHz", 
+             frame_size, fb_count, fb_location == CAMERA_FB_IN_PSRAM ? "PSRAM" : "DRAM", jpeg_quality,
+             (unsigned long)(s_xclk_hz / 1000000));
 
     esp_err_t err = esp_camera_init(&config);
     if (err != ESP_OK) {
@@ -86,29 +184,7 @@ esp_err_t camera_init(void)
     // Set initial sensor settings for better image quality
     sensor_t * s = esp_camera_sensor_get();
     if (s != NULL) {
-        // Initial settings for OV2640
-        s->set_brightness(s, 0);     // -2 to 2
-        s->set_contrast(s, 0);       // -2 to 2
-        s->set_saturation(s, 0);     // -2 to 2
-        s->set_special_effect(s, 0); // 0 to 6 (0 - No Effect, 1 - Negative, 2 - Grayscale, 3 - Red Tint, 4 - Green Tint, 5 - Blue Tint, 6 - Sepia)
-        s->set_whitebal(s, 1);       // 0 = disable , 1 = enable
-        s->set_awb_gain(s, 1);       // 0 = disable , 1 = enable
-        s->set_wb_mode(s, 0);        // 0 to 4 - if awb_gain enabled (0 - Auto, 1 - Sunny, 2 - Cloudy, 3 - Office, 4 - Home)
-        s->set_exposure_ctrl(s, 1);  // 0 = disable , 1 = enable
-        s->set_aec2(s, 0);           // 0 = disable , 1 = enable
-        s->set_ae_level(s, 0);       // -2 to 2
-        s->set_aec_value(s, 300);    // 0 to 1200
-        s->set_gain_ctrl(s, 1);      // 0 = disable , 1 = enable
-        s->set_agc_gain(s, 0);       // 0 to 30
-        s->set_gainceiling(s, (gainceiling_t)0);  // 0 to 6
-        s->set_bpc(s, 0);            // 0 = disable , 1 = enable
-        s->set_wpc(s, 1);            // 0 = disable , 1 = enable
-        s->set_raw_gma(s, 1);        // 0 = disable , 1 = enable
-        s->set_lenc(s, 1);           // 0 = disable , 1 = enable
-        s->set_hmirror(s, 0);        // 0 = disable , 1 = enable
-        s->set_vflip(s, 0);          // 0 = disable , 1 = enable
-        s->set_dcw(s, 1);            // 0 = disable , 1 = enable
-        s->set_colorbar(s, 0);       // 0 = disable , 1 = enable
+        camera_apply_settings(s);
     }
 
     s_camera_status = CAM_STATUS_READY;
@@ -116,7 +192,22 @@ esp_err_t camera_init(void)
     return ESP_OK;
 }
 
-esp_err_t camera_deinit(void)
+esp_err_t camera_init(void)
+{
+    if (s_sensor_lock == NULL) {
+        s_sensor_lock = xSemaphoreCreateMutex();
+        if (s_sensor_lock == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    camera_lock(portMAX_DELAY);
+    esp_err_t err = camera_init_locked();
+    camera_unlock();
+    return err;
+}
+
+static esp_err_t camera_deinit_locked(void)
 {
     if (s_camera_status == CAM_STATUS_NOT_INITIALIZED) {
         ESP_LOGW(TAG, "Camera is not initialized");
@@ -125,6 +216,7 @@ esp_err_t camera_deinit(void)
 
     ESP_LOGI(TAG, "Deinitializing camera...");
     esp_err_t err = esp_camera_deinit();
+    s_roi_active = false;
     if (err == ESP_OK) {
         s_camera_status = CAM_STATUS_NOT_INITIALIZED;
         ESP_LOGI(TAG, "Camera deinitialized successfully");
@@ -135,6 +227,27 @@ esp_err_t camera_deinit(void)
     return err;
 }
 
+esp_err_t camera_deinit(void)
+{
+    if (!camera_lock(portMAX_DELAY)) {
+        return ESP_OK;
+    }
+    esp_err_t err = camera_deinit_locked();
+    camera_unlock();
+    return err;
+}
+
+esp_err_t camera_reinit(void)
+{
+    if (!camera_lock(portMAX_DELAY)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    camera_deinit_locked();
+    esp_err_t err = camera_init_locked();
+    camera_unlock();
+    return err;
+}
+
 cam_status_t camera_get_status(void)
 {
     return s_camera_status;
@@ -161,7 +274,7 @@ void camera_return_frame(camera_fb_t* fb)
     }
 }
 
-esp_err_t camera_set_quality(int quality)
+static esp_err_t camera_set_quality_locked(int quality)
 {
     if (s_camera_status != CAM_STATUS_READY) {
         ESP_LOGE(TAG, "Camera is not ready");
@@ -176,6 +289,7 @@ esp_err_t camera_set_quality(int quality)
     sensor_t * s = esp_camera_sensor_get();
     if (s != NULL) {
         s->set_quality(s, quality);
+        camera_profile_invalidate();
         ESP_LOGI(TAG, "Camera quality set to %d", quality);
         return ESP_OK;
     }
@@ -183,7 +297,74 @@ esp_err_t camera_set_quality(int quality)
     return ESP_ERR_NOT_FOUND;
 }
 
-esp_err_t camera_set_framesize(framesize_t framesize)
+esp_err_t camera_set_quality(int quality)
+{
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_set_quality_locked(quality);
+    camera_unlock();
+    return ret;
+}
+
+static int camera_get_quality_locked(void)
+{
+    sensor_t * s = s_camera_status == CAM_STATUS_READY ? esp_camera_sensor_get() : NULL;
+    return s != NULL ? s->status.quality : -1;
+}
+
+int camera_get_quality(void)
+{
+    if (!camera_sensor_lock()) {
+        return -1;
+    }
+    int ret = camera_get_quality_locked();
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_sensor_reset_locked(void)
+{
+    if (s_camera_status != CAM_STATUS_READY) {
+        ESP_LOGE(TAG, "Camera is not ready");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sensor_t * s = esp_camera_sensor_get();
+    if (s == NULL || s->reset == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // The reset restores the sensor's register defaults over SCCB; the
+    // driver (DMA, frame buffers) is left running
+    framesize_t framesize = s->status.framesize;
+    int quality = s->status.quality;
+    if (s->reset(s) != 0) {
+        ESP_LOGE(TAG, "Sensor reset failed");
+        return ESP_FAIL;
+    }
+    if (s->set_pixformat(s, CAMERA_PIXEL_FORMAT) != 0 || s->set_framesize(s, framesize) != 0) {
+        ESP_LOGE(TAG, "Failed to reprogram sensor after reset");
+        return ESP_FAIL;
+    }
+    s->set_quality(s, quality);
+    camera_apply_settings(s);
+    s_roi_active = false;
+    ESP_LOGI(TAG, "Sensor reset, framesize %d quality %d restored", framesize, quality);
+    return ESP_OK;
+}
+
+esp_err_t camera_sensor_reset(void)
+{
+    if (!camera_lock(portMAX_DELAY)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_sensor_reset_locked();
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_set_framesize_locked(framesize_t framesize)
 {
     if (s_camera_status != CAM_STATUS_READY) {
         ESP_LOGE(TAG, "Camera is not ready");
@@ -193,9 +374,287 @@ esp_err_t camera_set_framesize(framesize_t framesize)
     sensor_t * s = esp_camera_sensor_get();
     if (s != NULL) {
         s->set_framesize(s, framesize);
+        camera_profile_invalidate();
+        s_roi_active = false;
         ESP_LOGI(TAG, "Camera framesize set to %d", framesize);
         return ESP_OK;
     }
     
     return ESP_ERR_NOT_FOUND;
 }
+
+esp_err_t camera_set_framesize(framesize_t framesize)
+{
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_set_framesize_locked(framesize);
+    camera_unlock();
+    return ret;
+}
+
+uint32_t camera_get_xclk(void)
+{
+    return s_xclk_hz;
+}
+
+static esp_err_t camera_set_xclk_locked(uint32_t xclk_hz)
+{
+    if (xclk_hz == s_xclk_hz) {
+        return ESP_OK;
+    }
+    if (s_camera_status != CAM_STATUS_READY) {
+        s_xclk_hz = xclk_hz;
+        return ESP_OK;
+    }
+
+    // The OV2640 derives its PLL and JPEG timing from XCLK at init, so the
+    // driver is brought up again rather than only retuning the LEDC timer
+    sensor_t * s = esp_camera_sensor_get();
+    framesize_t framesize = s != NULL ? s->status.framesize : CAMERA_FRAME_SIZE;
+    int quality = s != NULL ? s->status.quality : CAMERA_JPEG_QUALITY;
+
+    camera_deinit_locked();
+    ESP_LOGW(TAG, "Changing XCLK from %lu to %lu MHz", (unsigned long)(s_xclk_hz / 1000000),
+             (unsigned long)(xclk_hz / 1000000));
+    s_xclk_hz = xclk_hz;
+
+    esp_err_t err = camera_init_locked();
+    if (err != ESP_OK) {
+        return err;
+    }
+    camera_set_framesize_locked(framesize);
+    camera_set_quality_locked(quality);
+    return ESP_OK;
+}
+
+esp_err_t camera_set_xclk(uint32_t xclk_hz)
+{
+    if (!camera_lock(portMAX_DELAY)) {
+        // Before the first camera_init(), which will use it
+        s_xclk_hz = xclk_hz;
+        return ESP_OK;
+    }
+    esp_err_t ret = camera_set_xclk_locked(xclk_hz);
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_standby_locked(bool standby, uint32_t standby_xclk_hz)
+{
+    if (s_camera_status != CAM_STATUS_READY) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sensor_t * s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // The sensor is only addressed at full XCLK: told before the clock is
+    // slowed and woken after it is back
+    esp_err_t err = ESP_OK;
+    if (!standby) {
+        err = ledc_set_freq(LEDC_LOW_SPEED_MODE, CAM_XCLK_LEDC_TIMER, s_xclk_hz);
+    }
+    if (err == ESP_OK && s->id.PID == OV2640_PID && s->set_reg != NULL &&
+        s->set_reg(s, OV2640_COM2, OV2640_COM2_STDBY, standby ? OV2640_COM2_STDBY : 0) != 0) {
+        ESP_LOGE(TAG, "Failed to %s sensor standby", standby ? "enter" : "leave");
+        err = ESP_FAIL;
+    }
+    if (err == ESP_OK && standby) {
+        err = ledc_set_freq(LEDC_LOW_SPEED_MODE, CAM_XCLK_LEDC_TIMER, standby_xclk_hz);
+    }
+    return err;
+}
+
+esp_err_t camera_standby(bool standby, uint32_t standby_xclk_hz)
+{
+    if (!camera_lock(portMAX_DELAY)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_standby_locked(standby, standby_xclk_hz);
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_set_exposure_locked(int aec_value, int agc_gain)
+{
+    if (s_camera_status != CAM_STATUS_READY) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (aec_value < 0 || aec_value > 1200 || agc_gain < 0 || agc_gain > 30) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sensor_t * s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Called for every adjustment, so only the registers that change are
+    // written; each is an SCCB transaction
+    if (s->status.aec || s->status.agc) {
+        camera_profile_invalidate();
+    }
+    if (s->status.aec) {
+        s->set_exposure_ctrl(s, 0);
+    }
+    if (s->status.agc) {
+        s->set_gain_ctrl(s, 0);
+    }
+    if (s->status.aec_value != aec_value) {
+        s->set_aec_value(s, aec_value);
+    }
+    if (s->status.agc_gain != agc_gain) {
+        s->set_agc_gain(s, agc_gain);
+    }
+    ESP_LOGD(TAG, "Exposure %d lines, gain %d", aec_value, agc_gain);
+    return ESP_OK;
+}
+
+esp_err_t camera_set_exposure(int aec_value, int agc_gain)
+{
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_set_exposure_locked(aec_value, agc_gain);
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_set_auto_exposure_locked(void)
+{
+    if (s_camera_status != CAM_STATUS_READY) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sensor_t * s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    s->set_exposure_ctrl(s, 1);
+    s->set_gain_ctrl(s, 1);
+    camera_profile_invalidate();
+    ESP_LOGI(TAG, "Sensor AEC/AGC enabled");
+    return ESP_OK;
+}
+
+esp_err_t camera_set_auto_exposure(void)
+{
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_set_auto_exposure_locked();
+    camera_unlock();
+    return ret;
+}
+
+static bool camera_auto_exposure_locked(void)
+{
+    sensor_t * s = s_camera_status == CAM_STATUS_READY ? esp_camera_sensor_get() : NULL;
+    return s != NULL && (s->status.aec || s->status.agc);
+}
+
+bool camera_auto_exposure(void)
+{
+    if (!camera_sensor_lock()) {
+        return false;
+    }
+    bool ret = camera_auto_exposure_locked();
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_set_roi_locked(const sensor_roi_rect_t *roi, sensor_roi_window_t *applied)
+{
+    if (s_camera_status != CAM_STATUS_READY) {
+        ESP_LOGE(TAG, "Camera is not ready");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sensor_t * s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s->id.PID != OV2640_PID || s->set_res_raw == NULL) {
+        // set_res_raw() takes different arguments on every sensor
+        ESP_LOGE(TAG, "ROI is only supported on the OV2640");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    sensor_roi_window_t win;
+    framesize_t framesize = s->status.framesize;
+    if (!sensor_roi_map(roi, resolution[framesize].width, resolution[framesize].height, &win)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // For the OV2640 startX selects the readout mode and endX/endY, startY,
+    // scale and binning are unused
+    if (s->set_res_raw(s, win.mode, 0, 0, 0, win.offset_x, win.offset_y, win.window_w, win.window_h,
+                       win.out_w, win.out_h, false, false) != 0) {
+        ESP_LOGE(TAG, "Failed to set sensor window");
+        return ESP_FAIL;
+    }
+    camera_profile_invalidate();
+
+    s_roi = win;
+    s_roi_active = true;
+    ESP_LOGI(TAG, "ROI %u,%u %ux%u -> %s window %ux%u at %u,%u, output %ux%u",
+             win.applied.x, win.applied.y, win.applied.w, win.applied.h, sensor_roi_mode_name(win.mode),
+             win.window_w, win.window_h, win.offset_x, win.offset_y, win.out_w, win.out_h);
+    if (applied != NULL) {
+        *applied = win;
+    }
+    return ESP_OK;
+}
+
+esp_err_t camera_set_roi(const sensor_roi_rect_t *roi, sensor_roi_window_t *applied)
+{
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_set_roi_locked(roi, applied);
+    camera_unlock();
+    return ret;
+}
+
+static esp_err_t camera_reset_roi_locked(void)
+{
+    if (s_camera_status != CAM_STATUS_READY) {
+        ESP_LOGE(TAG, "Camera is not ready");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sensor_t * s = esp_camera_sensor_get();
+    if (s == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // set_framesize() reprograms the standard full-view window
+    if (s->set_framesize(s, s->status.framesize) != 0) {
+        return ESP_FAIL;
+    }
+    camera_profile_invalidate();
+    s_roi_active = false;
+    ESP_LOGI(TAG, "ROI cleared");
+    return ESP_OK;
+}
+
+esp_err_t camera_reset_roi(void)
+{
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = camera_reset_roi_locked();
+    camera_unlock();
+    return ret;
+}
+
+bool camera_get_roi(sensor_roi_window_t *window)
+{
+    if (s_roi_active && window != NULL) {
+        *window = s_roi;
+    }
+    return s_roi_active;
+}
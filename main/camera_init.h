@@ -1,8 +1,10 @@
 #ifndef CAMERA_INIT_H
 #define CAMERA_INIT_H
 
+#include "sdkconfig.h"
 #include "esp_camera.h"
 #include "esp_err.h"
+#include "sensor_roi.h"
 
 // Camera initialization status
 typedef enum {
@@ -32,20 +34,77 @@ typedef enum {
 #define CAM_PIN_PCLK    13  // PCLK
 
 #define LED_GPIO_NUM 21 // LED GPIO for status indication
+#define CAM_XCLK_LEDC_TIMER LEDC_TIMER_0  // XCLK is generated by this LEDC timer
 
 // Camera configuration
 #define CAMERA_FRAME_SIZE FRAMESIZE_VGA   // 640x480 with PSRAM
+#if defined(CONFIG_APP_PIXEL_FORMAT_YUV422)
+#define CAMERA_PIXEL_FORMAT PIXFORMAT_YUV422   // encoded by the capture task
+#elif defined(CONFIG_APP_PIXEL_FORMAT_GRAYSCALE)
+#define CAMERA_PIXEL_FORMAT PIXFORMAT_GRAYSCALE
+#else
 #define CAMERA_PIXEL_FORMAT PIXFORMAT_JPEG
+#endif
+#define CAMERA_RAW_FRAME_SIZE FRAMESIZE_QVGA  // raw frames with PSRAM; QQVGA without
 #define CAMERA_JPEG_QUALITY 12  // 0-63 lower means higher quality
 #define CAMERA_FB_COUNT 2       // Use dual buffers with PSRAM
+#define CAMERA_XCLK_FREQ_HZ (CONFIG_APP_CAMERA_XCLK_MHZ * 1000000)
+#define CAMERA_XCLK_FALLBACK_HZ (CONFIG_APP_CAMERA_XCLK_FALLBACK_MHZ * 1000000)
 
 // Function declarations
+//
+// Every function below that touches the sensor holds a lock for the call.
+// The capture task, which may reinitialize the driver, waits for it; calls
+// from other tasks give up after a short wait and report the camera as not
+// ready (ESP_ERR_INVALID_STATE, -1 or false) while a reinit is under way.
 esp_err_t camera_init(void);
 esp_err_t camera_deinit(void);
+// camera_deinit() and camera_init() with the lock held throughout
+esp_err_t camera_reinit(void);
 cam_status_t camera_get_status(void);
 camera_fb_t* camera_get_frame(void);
 void camera_return_frame(camera_fb_t* fb);
 esp_err_t camera_set_quality(int quality);
+// Current JPEG quality, or -1 if the camera is not ready
+int camera_get_quality(void);
 esp_err_t camera_set_framesize(framesize_t framesize);
 
+// For sensor access outside this file, e.g. through esp_camera_sensor_get().
+// Returns false, without the lock, if the camera is busy or not set up.
+bool camera_sensor_lock(void);
+void camera_sensor_unlock(void);
+
+// XCLK used by the current (or next) camera_init
+uint32_t camera_get_xclk(void);
+// Change XCLK, reinitializing the driver if the camera is up. Frame size and
+// quality are kept; the ROI is cleared.
+esp_err_t camera_set_xclk(uint32_t xclk_hz);
+
+// Reset the sensor over SCCB and reprogram frame size, quality and the
+// initial settings, leaving the driver running. Clears the ROI.
+esp_err_t camera_sensor_reset(void);
+
+// Put the sensor in standby and slow XCLK to standby_xclk_hz, or undo both.
+// On the OV2640 standby stops the outputs, so the DMA gets no frames;
+// other sensors only get the slower clock. The driver stays initialized and
+// the frames in its buffers are stale after a resume.
+esp_err_t camera_standby(bool standby, uint32_t standby_xclk_hz);
+
+// Manual exposure: aec_value in sensor lines (0-1200) and agc_gain (0-30,
+// about agc_gain + 1 times). Turns the sensor's AEC and AGC off.
+esp_err_t camera_set_exposure(int aec_value, int agc_gain);
+// Hand exposure and gain back to the sensor's AEC and AGC
+esp_err_t camera_set_auto_exposure(void);
+// True if the sensor's AEC or AGC is on, as after init or a sensor reset
+bool camera_auto_exposure(void);
+
+// Reprogram the OV2640 window so only `roi` (full-resolution sensor pixels)
+// is captured, at up to the configured frame size. Frames already in the
+// driver's buffers still show the old window. `applied` may be NULL.
+esp_err_t camera_set_roi(const sensor_roi_rect_t *roi, sensor_roi_window_t *applied);
+// Back to the full field of view at the configured frame size
+esp_err_t camera_reset_roi(void);
+// Returns false when the full field of view is being captured
+bool camera_get_roi(sensor_roi_window_t *window);
+
 #endif // CAMERA_INIT_H
@@ -0,0 +1,214 @@
+#include "camera_profile.h"
+#include "camera_init.h"
+#include "sensor_profile.h"
+#include "http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "camera_profile";
+
+// Registers as last written by camera_profile_load(). It is trusted only
+// while s_generation has not moved since: camera_profile_invalidate() is
+// called from other tasks and only bumps the counter.
+static sensor_reg_cache_t s_cache;
+static uint32_t s_cache_generation;
+static volatile uint32_t s_generation = 1;
+
+static const sensor_profile_t *s_profile = NULL;   // NULL until the first load
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static camera_profile_stats_t s_stats;
+
+// The only register access esp32-camera exports is set_reg(), which reads
+// the register to keep the bits outside mask, so every write in the batch
+// is a read-modify-write. The driver remembers the selected bank, so the
+// sorted batch switches banks at most once.
+static bool camera_profile_write(void *ctx, const sensor_reg_t *regs, size_t count)
+{
+    sensor_t *s = ctx;
+
+    for (size_t i = 0; i < count; i++) {
+        if (s->set_reg(s, regs[i].reg, regs[i].mask, regs[i].value) != 0) {
+            ESP_LOGE(TAG, "Failed to write sensor register 0x%03x", regs[i].reg);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Keep the driver's view in step, as its setters would have
+static void camera_profile_sync_status(sensor_t *s, const sensor_profile_t *profile)
+{
+    if (profile->quality >= 0) {
+        s->status.quality = (uint8_t)profile->quality;
+    }
+    s->status.gainceiling = profile->gainceiling;
+    s->status.aec = profile->aec;
+    s->status.aec2 = profile->aec2;
+    s->status.agc = profile->agc;
+    s->status.awb = profile->awb;
+    s->status.awb_gain = profile->awb_gain;
+    s->status.raw_gma = profile->raw_gma;
+    s->status.lenc = profile->lenc;
+    s->status.bpc = profile->bpc;
+    s->status.wpc = profile->wpc;
+    s->status.dcw = profile->dcw;
+    s->status.hmirror = profile->hmirror;
+    s->status.vflip = profile->vflip;
+    s->status.colorbar = profile->colorbar;
+}
+
+esp_err_t camera_profile_load(sensor_t *s, const char *name)
+{
+    const sensor_profile_t *profile = sensor_profile_find(name);
+    if (profile == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s->id.PID != OV2640_PID || s->set_reg == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    sensor_reg_table_t table;
+    sensor_profile_compile(profile, &table);
+
+    // A write by someone else during the load leaves the counter moved, so
+    // the cache is cleared again on the next load
+    uint32_t generation = s_generation;
+    if (s_cache_generation != generation) {
+        sensor_reg_cache_clear(&s_cache);
+        s_cache_generation = generation;
+    }
+
+    sensor_apply_result_t result;
+    int64_t start = esp_timer_get_time();
+    bool ok = sensor_profile_apply(&s_cache, &table, camera_profile_write, s, &result);
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+
+    if (ok) {
+        camera_profile_sync_status(s, profile);
+        s_profile = profile;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    if (ok) {
+        s_stats.loads++;
+        s_stats.last_apply_us = elapsed_us;
+        if (elapsed_us > s_stats.max_apply_us) {
+            s_stats.max_apply_us = elapsed_us;
+        }
+        s_stats.last_written = result.written;
+        s_stats.last_unchanged = result.unchanged;
+        s_stats.registers_written += result.written;
+    } else {
+        s_stats.failures++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to load profile %s", profile->name);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Profile %s: %u registers written, %u unchanged, in %lu us", profile->name,
+             result.written, result.unchanged, (unsigned long)elapsed_us);
+    return ESP_OK;
+}
+
+esp_err_t camera_set_profile(const char *name)
+{
+    if (sensor_profile_find(name) == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    // Not while the capture task reinitializes the driver
+    if (!camera_sensor_lock()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+    sensor_t *s = camera_get_status() == CAM_STATUS_READY ? esp_camera_sensor_get() : NULL;
+    if (s != NULL) {
+        err = camera_profile_load(s, name);
+    }
+    camera_sensor_unlock();
+    return err;
+}
+
+const char *camera_profile_current(void)
+{
+    const sensor_profile_t *profile = s_profile;
+    return profile != NULL ? profile->name : CAMERA_PROFILE_DEFAULT;
+}
+
+void camera_profile_invalidate(void)
+{
+    s_generation++;
+}
+
+void camera_profile_get_stats(camera_profile_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    stats->name = camera_profile_current();
+}
+
+// GET /profile lists the profiles and the last load;
+// /profile?name=<name> switches to another one
+static esp_err_t profile_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char value[16];
+    char json[384];
+    camera_profile_stats_t stats;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "name", value, sizeof(value)) == ESP_OK) {
+        esp_err_t err = camera_set_profile(value);
+        if (err == ESP_ERR_NOT_FOUND) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown profile");
+        }
+        if (err == ESP_ERR_INVALID_STATE) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            httpd_resp_set_hdr(req, "Retry-After", "5");
+            return httpd_resp_send(req, "Camera not ready", HTTPD_RESP_USE_STRLEN);
+        }
+        if (err != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, esp_err_to_name(err));
+        }
+    }
+
+    camera_profile_get_stats(&stats);
+    size_t len = snprintf(json, sizeof(json), "{\"profile\":\"%s\",\"profiles\":[", stats.name);
+    for (int i = 0; sensor_profile_get(i) != NULL; i++) {
+        len += snprintf(json + len, sizeof(json) - len, "%s\"%s\"", i == 0 ? "" : ",",
+                        sensor_profile_get(i)->name);
+    }
+    snprintf(json + len, sizeof(json) - len,
+             "],\"loads\":%lu,\"failures\":%lu,\"last_apply_us\":%lu,\"max_apply_us\":%lu,"
+             "\"last_written\":%u,\"last_unchanged\":%u,\"registers_written\":%lu}",
+             (unsigned long)stats.loads, (unsigned long)stats.failures,
+             (unsigned long)stats.last_apply_us, (unsigned long)stats.max_apply_us,
+             stats.last_written, stats.last_unchanged, (unsigned long)stats.registers_written);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t camera_profile_http_init(void)
+{
+    httpd_uri_t profile_uri = {
+        .uri = "/profile",
+        .method = HTTP_GET,
+        .handler = profile_handler,
+        .user_ctx = NULL
+    };
+    return http_server_register_handler(&profile_uri);
+}
+
+esp_err_t camera_profile_http_deinit(void)
+{
+    return http_server_unregister_handler("/profile", HTTP_GET);
+}
@@ -0,0 +1,62 @@
+#ifndef CAMERA_PROFILE_H
+#define CAMERA_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_camera.h"
+
+// Sensor profiles on the OV2640, see sensor_profile.h and APP_SENSOR_PROFILE
+// in menuconfig.
+//
+// camera_init loads the current profile after every driver init and sensor
+// reset, which writes all of its registers; switching profiles later with
+// GET /profile?name=<name> writes only the registers the two profiles set
+// differently. Any other sensor write that may touch those registers
+// (quality, exposure, frame size, ROI) calls camera_profile_invalidate(), so
+// the next load writes everything again. Other sensors get the driver's
+// setters, as before.
+
+#if defined(CONFIG_APP_SENSOR_PROFILE_NIGHT)
+#define CAMERA_PROFILE_DEFAULT "night"
+#elif defined(CONFIG_APP_SENSOR_PROFILE_LOWBW)
+#define CAMERA_PROFILE_DEFAULT "lowbw"
+#elif defined(CONFIG_APP_SENSOR_PROFILE_HIGHFPS)
+#define CAMERA_PROFILE_DEFAULT "highfps"
+#else
+#define CAMERA_PROFILE_DEFAULT "day"
+#endif
+
+typedef struct {
+    const char *name;           // current profile
+    uint32_t loads;
+    uint32_t failures;
+    uint32_t last_apply_us;
+    uint32_t max_apply_us;
+    uint8_t last_written;       // registers written by the last load
+    uint8_t last_unchanged;
+    uint32_t registers_written;
+} camera_profile_stats_t;
+
+// Load the profile `name` onto `s` and update s->status to match. Returns
+// ESP_ERR_NOT_FOUND for an unknown name and ESP_ERR_NOT_SUPPORTED if the
+// sensor is not an OV2640.
+esp_err_t camera_profile_load(sensor_t *s, const char *name);
+
+// Switch the running camera to profile `name`
+esp_err_t camera_set_profile(const char *name);
+
+// Name of the profile loaded last, or to be loaded by the next camera_init
+const char *camera_profile_current(void);
+
+// The sensor's registers may no longer match the last load
+void camera_profile_invalidate(void);
+
+void camera_profile_get_stats(camera_profile_stats_t *stats);
+
+// Register / unregister GET /profile
+esp_err_t camera_profile_http_init(void);
+esp_err_t camera_profile_http_deinit(void);
+
+#endif // CAMERA_PROFILE_H
@@ -0,0 +1,141 @@
+#include "capture_demand.h"
+#include <string.h>
+
+void capture_demand_init(capture_demand_t *d, uint32_t idle_ms, uint32_t resume_target_ms, uint32_t now_ms)
+{
+    memset(d, 0, sizeof(*d));
+    d->idle_ms = idle_ms;
+    d->resume_target_ms = resume_target_ms;
+    d->state = CAPTURE_DEMAND_ACTIVE;
+    d->last_demand_ms = now_ms;
+    d->state_ms = now_ms;
+}
+
+bool capture_demand_restart(capture_demand_t *d, uint32_t now_ms)
+{
+    bool asleep = d->state == CAPTURE_DEMAND_STANDBY;
+
+    if (asleep) {
+        d->stats.standby_ms += now_ms - d->state_ms;
+    }
+    d->state = CAPTURE_DEMAND_ACTIVE;
+    d->state_ms = now_ms;
+    d->last_demand_ms = now_ms;
+    d->wake_pending = false;
+    return asleep;
+}
+
+static bool capture_demand_note(capture_demand_t *d, uint32_t now_ms)
+{
+    d->last_demand_ms = now_ms;
+    if (d->state != CAPTURE_DEMAND_STANDBY || d->wake_pending) {
+        return false;
+    }
+    d->wake_pending = true;
+    d->wake_ms = now_ms;
+    return true;
+}
+
+bool capture_demand_acquire(capture_demand_t *d, capture_consumer_t consumer, uint32_t now_ms)
+{
+    d->holders[consumer]++;
+    return capture_demand_note(d, now_ms);
+}
+
+void capture_demand_release(capture_demand_t *d, capture_consumer_t consumer, uint32_t now_ms)
+{
+    if (d->holders[consumer] > 0) {
+        d->holders[consumer]--;
+    }
+    // The idle time starts when the last one leaves
+    d->last_demand_ms = now_ms;
+}
+
+bool capture_demand_touch(capture_demand_t *d, uint32_t now_ms)
+{
+    return capture_demand_note(d, now_ms);
+}
+
+uint32_t capture_demand_holders(const capture_demand_t *d)
+{
+    uint32_t holders = 0;
+
+    for (int i = 0; i < CAPTURE_CONSUMER_COUNT; i++) {
+        holders += d->holders[i];
+    }
+    return holders;
+}
+
+capture_demand_action_t capture_demand_poll(capture_demand_t *d, uint32_t now_ms)
+{
+    switch (d->state) {
+    case CAPTURE_DEMAND_ACTIVE:
+        if (d->idle_ms == 0 || capture_demand_holders(d) > 0 || now_ms - d->last_demand_ms < d->idle_ms) {
+            break;
+        }
+        d->state = CAPTURE_DEMAND_STANDBY;
+        d->state_ms = now_ms;
+        d->wake_pending = false;
+        d->stats.suspends++;
+        return CAPTURE_DEMAND_SUSPEND;
+    case CAPTURE_DEMAND_STANDBY:
+        if (!d->wake_pending) {
+            break;
+        }
+        d->stats.standby_ms += now_ms - d->state_ms;
+        d->state = CAPTURE_DEMAND_RESUMING;
+        d->state_ms = now_ms;
+        d->wake_pending = false;
+        d->stats.resumes++;
+        return CAPTURE_DEMAND_RESUME;
+    case CAPTURE_DEMAND_RESUMING:
+        break;
+    }
+    return CAPTURE_DEMAND_NONE;
+}
+
+bool capture_demand_frame(capture_demand_t *d, uint32_t now_ms)
+{
+    if (d->state != CAPTURE_DEMAND_RESUMING) {
+        return false;
+    }
+
+    uint32_t elapsed = now_ms - d->wake_ms;
+    d->state = CAPTURE_DEMAND_ACTIVE;
+    d->state_ms = now_ms;
+    // A reader that only touched gets a full idle period from its frame
+    d->last_demand_ms = now_ms;
+    d->stats.last_resume_ms = elapsed;
+    d->stats.resume_ms_total += elapsed;
+    if (elapsed > d->stats.max_resume_ms) {
+        d->stats.max_resume_ms = elapsed;
+    }
+    if (elapsed > d->resume_target_ms) {
+        d->stats.resumes_over_target++;
+        return true;
+    }
+    return false;
+}
+
+uint64_t capture_demand_standby_ms(const capture_demand_t *d, uint32_t now_ms)
+{
+    uint64_t total = d->stats.standby_ms;
+
+    if (d->state == CAPTURE_DEMAND_STANDBY) {
+        total += now_ms - d->state_ms;
+    }
+    return total;
+}
+
+const char *capture_demand_state_name(capture_demand_state_t state)
+{
+    switch (state) {
+    case CAPTURE_DEMAND_ACTIVE:
+        return "active";
+    case CAPTURE_DEMAND_STANDBY:
+        return "standby";
+    case CAPTURE_DEMAND_RESUMING:
+        return "resuming";
+    }
+    return "unknown";
+}
@@ -0,0 +1,87 @@
+#ifndef CAPTURE_DEMAND_H
+#define CAPTURE_DEMAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Consumer tracking for the capture pipeline's standby mode.
+//
+// Long-lived consumers (stream clients, the multicast sender, a push upload
+// session) hold the pipeline with acquire/release; one-shot readers of the
+// latest frame (/capture, /thumb, /burst, long polls) touch it on every
+// request. Once nothing has held or touched it for idle_ms the capture task
+// is told to suspend: sensor standby, throttled XCLK, no DMA. The first
+// acquire or touch after that asks for a resume, and the time from that
+// request to the first frame is measured against resume_target_ms. Only
+// depends on the clock passed in, so it can be exercised on any host.
+
+typedef enum {
+    CAPTURE_CONSUMER_STREAM,    // /stream clients, multicast sender
+    CAPTURE_CONSUMER_RECORDER,  // push upload session
+    CAPTURE_CONSUMER_COUNT
+} capture_consumer_t;
+
+typedef enum {
+    CAPTURE_DEMAND_ACTIVE,
+    CAPTURE_DEMAND_STANDBY,
+    CAPTURE_DEMAND_RESUMING     // woken, waiting for the first frame
+} capture_demand_state_t;
+
+typedef enum {
+    CAPTURE_DEMAND_NONE,
+    CAPTURE_DEMAND_SUSPEND,
+    CAPTURE_DEMAND_RESUME
+} capture_demand_action_t;
+
+typedef struct {
+    uint32_t suspends;
+    uint32_t resumes;
+    uint32_t last_resume_ms;    // request to first frame
+    uint32_t max_resume_ms;
+    uint64_t resume_ms_total;
+    uint32_t resumes_over_target;
+    uint64_t standby_ms;        // completed standby periods
+} capture_demand_stats_t;
+
+typedef struct {
+    uint32_t idle_ms;           // 0 never suspends
+    uint32_t resume_target_ms;
+    capture_demand_state_t state;
+    uint16_t holders[CAPTURE_CONSUMER_COUNT];
+    uint32_t last_demand_ms;    // last touch, release or resumed frame
+    uint32_t state_ms;          // when the state was entered
+    bool wake_pending;          // demand arrived in standby
+    uint32_t wake_ms;           // when it arrived
+    capture_demand_stats_t stats;
+} capture_demand_t;
+
+// Starts active, as if touched at now_ms
+void capture_demand_init(capture_demand_t *d, uint32_t idle_ms, uint32_t resume_target_ms, uint32_t now_ms);
+
+// The capture task starts over, running: a standby or resume in progress is
+// dropped and the idle time counts from now_ms. Holders and stats are kept.
+// Returns true if the sensor was left in standby.
+bool capture_demand_restart(capture_demand_t *d, uint32_t now_ms);
+
+// Returns true when the capture task has to be woken up for a resume
+bool capture_demand_acquire(capture_demand_t *d, capture_consumer_t consumer, uint32_t now_ms);
+void capture_demand_release(capture_demand_t *d, capture_consumer_t consumer, uint32_t now_ms);
+bool capture_demand_touch(capture_demand_t *d, uint32_t now_ms);
+
+// Called by the capture task before every capture and while suspended.
+// Returns what to do with the sensor now.
+capture_demand_action_t capture_demand_poll(capture_demand_t *d, uint32_t now_ms);
+
+// A frame was captured. Ends a resume, recording its time to first frame;
+// returns true if that was over resume_target_ms.
+bool capture_demand_frame(capture_demand_t *d, uint32_t now_ms);
+
+// Consumers holding the pipeline, all kinds
+uint32_t capture_demand_holders(const capture_demand_t *d);
+
+// Total standby time including the current period
+uint64_t capture_demand_standby_ms(const capture_demand_t *d, uint32_t now_ms);
+
+const char *capture_demand_state_name(capture_demand_state_t state);
+
+#endif // CAPTURE_DEMAND_H
@@ -0,0 +1,840 @@
+#include "capture_pipeline.h"
+#include "camera_init.h"
+#include "scene_change.h"
+#include "jpeg_dc.h"
+#include "jpeg_check.h"
+#include "jpeg_enc.h"
+#include "exposure.h"
+#include "dram_stream.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_psram.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include <string.h>
+
+static const char *TAG = "capture";
+
+#define CAPTURE_SLAB_SIZE_PSRAM (CONFIG_APP_FRAME_POOL_SLAB_KB * 1024)
+#define CAPTURE_SLAB_COUNT_PSRAM CONFIG_APP_FRAME_POOL_SLABS
+#define CAPTURE_SLAB_SIZE_DRAM (32 * 1024) // CIF at quality 20 fits comfortably
+#define CAPTURE_SLAB_COUNT_DRAM 2
+#define CAPTURE_RETRY_DELAY_MS 100
+#define CAPTURE_WAIT_SLICE_MS 10
+#define CAPTURE_RESYNC_FRAMES 2 // one per driver buffer
+#define CAPTURE_THUMB_SIZE_PSRAM ((1600 / 8) * (1200 / 8)) // UXGA luma DC thumbnail
+#define CAPTURE_THUMB_SIZE_DRAM ((352 / 8) * (288 / 8))    // CIF
+
+#define CAPTURE_NEW_FRAME_BIT BIT0
+#define CAPTURE_STOPPED_BIT BIT1
+#define CAPTURE_WAKE_BIT BIT2
+
+static frame_pool_t s_pool;
+static void *s_pool_memory = NULL;
+static EventGroupHandle_t s_events = NULL;
+static volatile bool s_running = false;
+
+// The latest published frame holds one reference of its own. It is swapped
+// and referenced under a spinlock so a reader can never take a reference to
+// a frame whose last reference is being dropped concurrently.
+static portMUX_TYPE s_latest_lock = portMUX_INITIALIZER_UNLOCKED;
+static frame_t *s_latest = NULL;
+static uint32_t s_seq = 0;
+
+static capture_stats_t s_stats;
+static volatile uint32_t s_resync_request = 0;
+static TaskHandle_t volatile s_publish_notify = NULL;
+
+#define CAPTURE_RAW_STAGES_MAX 4
+#define CAPTURE_ENCODE_EWMA_SHIFT 4 // 1/16 weight per frame
+
+typedef struct {
+    capture_raw_stage_t fn;
+    void *ctx;
+} capture_raw_stage_entry_t;
+
+static capture_raw_stage_entry_t s_raw_stages[CAPTURE_RAW_STAGES_MAX];
+static int s_raw_stage_count = 0;
+// Only allocated once a raw frame arrives
+static jpeg_enc_t *s_encoder = NULL;
+
+#ifdef CONFIG_APP_JPEG_VALIDATE
+#define CAPTURE_CORRUPT_WINDOW 100 // frames per corruption rate sample
+
+static jpeg_check_rate_t s_corrupt_rate;
+#endif
+
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+#define CAPTURE_WD_FAILED_RETRY_MS 60000
+#define CAPTURE_WD_RESTART_MAGIC 0x43575244 // "CWRD"
+#define CAPTURE_WD_RESTART_LOG_MS 200
+
+// Only touched by the capture task once started; read for metrics, where a
+// torn update only affects a statistic
+static capture_watchdog_t s_watchdog;
+static bool s_watchdog_ready = false;
+
+// Survive the watchdog's own software restart, so it still shows in /metrics
+static RTC_NOINIT_ATTR uint32_t s_restart_magic;
+static RTC_NOINIT_ATTR uint32_t s_restart_count;
+#endif
+
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+// Only touched by the capture task once started
+static scene_change_t s_scene;
+static uint8_t *s_thumbs = NULL;
+#endif
+
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+#define CAPTURE_IDLE_MS CONFIG_APP_CAPTURE_IDLE_MS
+#define CAPTURE_STANDBY_XCLK_HZ (CONFIG_APP_CAPTURE_STANDBY_XCLK_MHZ * 1000000)
+#define CAPTURE_RESUME_TARGET_MS CONFIG_APP_CAPTURE_RESUME_TARGET_MS
+#define CAPTURE_STANDBY_POLL_MS 1000
+
+// Consumers come and go on other tasks; the capture task polls
+static portMUX_TYPE s_demand_lock = portMUX_INITIALIZER_UNLOCKED;
+static capture_demand_t s_demand;
+static bool s_demand_ready = false;
+// Frames up to this one were captured before the last standby
+static volatile uint32_t s_standby_seq = 0;
+#endif
+
+#if defined(CONFIG_APP_CAPTURE_WATCHDOG) || defined(CONFIG_APP_CAPTURE_STANDBY)
+static uint32_t capture_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+#endif
+
+static void capture_publish(frame_t *frame)
+{
+    portENTER_CRITICAL(&s_latest_lock);
+    frame_t *old = s_latest;
+    s_latest = frame;
+    portEXIT_CRITICAL(&s_latest_lock);
+
+    frame_unref(old);
+
+    // Set-then-clear wakes every task blocked on the bit at this moment
+    xEventGroupSetBits(s_events, CAPTURE_NEW_FRAME_BIT);
+    xEventGroupClearBits(s_events, CAPTURE_NEW_FRAME_BIT);
+
+    TaskHandle_t notify = s_publish_notify;
+    if (notify != NULL) {
+        xTaskNotifyGive(notify);
+    }
+}
+
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+// Runs on the capture task, so the driver is never reinitialized under a
+// pending esp_camera_fb_get(). The HTTP server and its clients stay up;
+// their sensor calls are turned away until the reinit is done.
+static void capture_recover(capture_watchdog_action_t action)
+{
+    esp_err_t ret = ESP_OK;
+    uint32_t idle_ms = capture_watchdog_idle_ms(&s_watchdog, capture_now_ms());
+
+    ESP_LOGW(TAG, "No frame for %lu ms (%lu failed captures), trying %s", (unsigned long)idle_ms,
+             (unsigned long)s_watchdog.consecutive_failures, capture_watchdog_action_name(action));
+
+    switch (action) {
+    case CAPTURE_WD_ACTION_SENSOR_RESET:
+        ret = camera_sensor_reset();
+        break;
+    case CAPTURE_WD_ACTION_REINIT:
+        ret = camera_reinit();
+        break;
+    case CAPTURE_WD_ACTION_RESTART:
+        if (s_restart_magic != CAPTURE_WD_RESTART_MAGIC) {
+            s_restart_magic = CAPTURE_WD_RESTART_MAGIC;
+            s_restart_count = 0;
+        }
+        s_restart_count++;
+        ESP_LOGE(TAG, "Camera did not recover, restarting");
+        vTaskDelay(pdMS_TO_TICKS(CAPTURE_WD_RESTART_LOG_MS));
+        esp_restart();
+        break;
+    default:
+        break;
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s failed: %s", capture_watchdog_action_name(action), esp_err_to_name(ret));
+    }
+    // The first frames after a reset may be torn or still use the old window
+    capture_pipeline_resync();
+    capture_watchdog_action_done(&s_watchdog, ret == ESP_OK, capture_now_ms());
+}
+
+static void capture_watchdog_check(void)
+{
+    capture_watchdog_state_t before = s_watchdog.state;
+    capture_watchdog_action_t action = capture_watchdog_poll(&s_watchdog, capture_now_ms());
+
+    if (action != CAPTURE_WD_ACTION_NONE) {
+        capture_recover(action);
+    } else if (before != CAPTURE_WD_FAILED && s_watchdog.state == CAPTURE_WD_FAILED) {
+        ESP_LOGE(TAG, "Camera recovery failed, retrying every %d s", CAPTURE_WD_FAILED_RETRY_MS / 1000);
+    }
+}
+#endif
+
+#ifdef CONFIG_APP_JPEG_VALIDATE
+static jpeg_check_result_t capture_check(const camera_fb_t *fb)
+{
+#ifdef CONFIG_APP_JPEG_VALIDATE_SEGMENTS
+    return jpeg_check(fb->buf, fb->len, true);
+#else
+    return jpeg_check(fb->buf, fb->len, false);
+#endif
+}
+
+// Count a checked frame. Returns true when the corruption rate calls for a
+// lower XCLK.
+static bool capture_count_frame(bool bad)
+{
+    bool over = jpeg_check_rate_add(&s_corrupt_rate, bad);
+    if (s_corrupt_rate.frames == 0) {
+        s_stats.corrupt_permille = s_corrupt_rate.last_permille;
+    }
+    return over && camera_get_xclk() > CAMERA_XCLK_FALLBACK_HZ;
+}
+
+// Frame rate is worth less than frames that decode. Stays at the lower
+// clock until the next reboot.
+static void capture_xclk_fallback(void)
+{
+    ESP_LOGW(TAG, "%u per mille of frames corrupt at %lu MHz XCLK, falling back to %d MHz",
+             s_corrupt_rate.last_permille, (unsigned long)(camera_get_xclk() / 1000000),
+             CONFIG_APP_CAMERA_XCLK_FALLBACK_MHZ);
+    s_stats.xclk_fallbacks++;
+
+    esp_err_t ret = camera_set_xclk(CAMERA_XCLK_FALLBACK_HZ);
+    if (ret != ESP_OK) {
+        // Left to the stall watchdog, if enabled
+        ESP_LOGE(TAG, "Camera reinit at %d MHz failed: %s", CONFIG_APP_CAMERA_XCLK_FALLBACK_MHZ,
+                 esp_err_to_name(ret));
+    }
+    capture_pipeline_resync();
+}
+#endif
+
+// Copy a JPEG frame from the driver into a slab
+static frame_t *capture_copy(const camera_fb_t *fb)
+{
+    if (fb->len > s_pool.slab_size) {
+        s_stats.frames_oversize++;
+        return NULL;
+    }
+
+    frame_t *frame = frame_pool_alloc(&s_pool);
+    if (!frame) {
+        s_stats.frames_dropped++;
+        return NULL;
+    }
+
+    memcpy(frame_pool_slab(frame), fb->buf, fb->len);
+    frame->len = fb->len;
+    frame->width = fb->width;
+    frame->height = fb->height;
+    frame->format = fb->format;
+    return frame;
+}
+
+// The sensor's quality setting (0-63, lower is better) drives the encoder
+// too, so sensor profiles (/profile) and the QoS arbiter work the same in
+// raw mode
+static int capture_encode_quality(void)
+{
+    int quality = camera_get_quality();
+    if (quality < 0) {
+        quality = CAMERA_JPEG_QUALITY;
+    }
+    quality = 100 - quality * 3 / 2;
+    return quality < 1 ? 1 : quality;
+}
+
+// Run the processing stages on a raw frame from the driver, then encode it
+// straight into a slab
+static frame_t *capture_encode(camera_fb_t *fb)
+{
+    jpeg_enc_format_t format;
+
+    if (fb->format == PIXFORMAT_YUV422) {
+        format = JPEG_ENC_YUYV;
+    } else if (fb->format == PIXFORMAT_GRAYSCALE) {
+        format = JPEG_ENC_GRAYSCALE;
+    } else {
+        s_stats.frames_unsupported++;
+        return NULL;
+    }
+
+    capture_raw_frame_t raw = {
+        .data = fb->buf,
+        .len = fb->len,
+        .width = fb->width,
+        .height = fb->height,
+        .format = fb->format,
+    };
+    for (int i = 0; i < s_raw_stage_count; i++) {
+        s_raw_stages[i].fn(&raw, s_raw_stages[i].ctx);
+    }
+
+    if (s_encoder == NULL) {
+        // Tables are touched for every coefficient; keep them out of PSRAM
+        s_encoder = heap_caps_malloc(sizeof(*s_encoder), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (s_encoder == NULL) {
+            s_stats.frames_dropped++;
+            return NULL;
+        }
+        jpeg_enc_init(s_encoder, capture_encode_quality());
+    }
+
+    frame_t *frame = frame_pool_alloc(&s_pool);
+    if (!frame) {
+        s_stats.frames_dropped++;
+        return NULL;
+    }
+
+    jpeg_enc_set_quality(s_encoder, capture_encode_quality());
+    int64_t start = esp_timer_get_time();
+    size_t len = jpeg_enc_encode(s_encoder, fb->buf, fb->width, fb->height, 0, format, frame_pool_slab(frame),
+                                 s_pool.slab_size);
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+
+    if (len == 0) {
+        frame_unref(frame);
+        s_stats.frames_oversize++;
+        return NULL;
+    }
+
+    s_stats.frames_encoded++;
+    if (s_stats.encode_us_avg == 0) {
+        s_stats.encode_us_avg = elapsed_us;
+    } else {
+        int32_t dev = (int32_t)elapsed_us - (int32_t)s_stats.encode_us_avg;
+        s_stats.encode_us_avg += dev / (1 << CAPTURE_ENCODE_EWMA_SHIFT);
+    }
+    if (elapsed_us > s_stats.encode_us_max) {
+        s_stats.encode_us_max = elapsed_us;
+    }
+
+    frame->len = len;
+    frame->width = fb->width;
+    frame->height = fb->height;
+    frame->format = PIXFORMAT_JPEG;
+    return frame;
+}
+
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+// Suspend or resume the sensor as the consumers call for. Returns true while
+// it is in standby, after waiting for a consumer to show up.
+static bool capture_standby_step(void)
+{
+    uint32_t now = capture_now_ms();
+
+    portENTER_CRITICAL(&s_demand_lock);
+    capture_demand_action_t action = capture_demand_poll(&s_demand, now);
+    capture_demand_state_t state = s_demand.state;
+    portEXIT_CRITICAL(&s_demand_lock);
+
+    if (action == CAPTURE_DEMAND_SUSPEND) {
+        s_standby_seq = s_seq;
+        esp_err_t ret = camera_standby(true, CAPTURE_STANDBY_XCLK_HZ);
+        ESP_LOGI(TAG, "No consumers for %d ms, sensor standby at %d MHz XCLK%s", CAPTURE_IDLE_MS,
+                 CONFIG_APP_CAPTURE_STANDBY_XCLK_MHZ, ret == ESP_OK ? "" : " (failed)");
+    } else if (action == CAPTURE_DEMAND_RESUME) {
+        esp_err_t ret = camera_standby(false, CAPTURE_STANDBY_XCLK_HZ);
+        if (ret != ESP_OK) {
+            // Left to the stall watchdog, if enabled
+            ESP_LOGE(TAG, "Sensor resume failed: %s", esp_err_to_name(ret));
+        }
+        // The driver buffers still hold frames from before the standby
+        capture_pipeline_resync();
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+        // Time in standby is not a stall
+        capture_watchdog_reset(&s_watchdog, now);
+#endif
+    }
+
+    if (state != CAPTURE_DEMAND_STANDBY) {
+        return false;
+    }
+    xEventGroupWaitBits(s_events, CAPTURE_WAKE_BIT, pdTRUE, pdFALSE, pdMS_TO_TICKS(CAPTURE_STANDBY_POLL_MS));
+    return true;
+}
+
+// A frame went out; the first one after a resume ends it
+static void capture_standby_frame(void)
+{
+    portENTER_CRITICAL(&s_demand_lock);
+    bool resumed = s_demand.state == CAPTURE_DEMAND_RESUMING;
+    bool slow = capture_demand_frame(&s_demand, capture_now_ms());
+    uint32_t elapsed = s_demand.stats.last_resume_ms;
+    portEXIT_CRITICAL(&s_demand_lock);
+
+    if (slow) {
+        ESP_LOGW(TAG, "Resumed from standby in %lu ms, target %d ms", (unsigned long)elapsed,
+                 CAPTURE_RESUME_TARGET_MS);
+    } else if (resumed) {
+        ESP_LOGI(TAG, "Resumed from standby in %lu ms", (unsigned long)elapsed);
+    }
+}
+#endif
+
+static void capture_task(void *pvParameters)
+{
+    uint32_t resync_seen = s_resync_request;
+    uint32_t resync_skip = 0;
+
+    ESP_LOGI(TAG, "Capture task started");
+
+    while (s_running) {
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+        if (capture_standby_step()) {
+            continue;
+        }
+#endif
+        camera_fb_t *fb = camera_get_frame();
+        if (!fb) {
+            s_stats.capture_failures++;
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+            capture_watchdog_failure(&s_watchdog);
+            capture_watchdog_check();
+#endif
+            vTaskDelay(pdMS_TO_TICKS(CAPTURE_RETRY_DELAY_MS));
+            continue;
+        }
+
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+        // Any frame from the driver, even one dropped below, means the
+        // sensor and the DMA are working
+        if (s_watchdog.state != CAPTURE_WD_OK) {
+            ESP_LOGI(TAG, "Camera recovered after %lu ms",
+                     (unsigned long)capture_watchdog_idle_ms(&s_watchdog, capture_now_ms()));
+        }
+        capture_watchdog_frame(&s_watchdog, capture_now_ms());
+#endif
+
+        // Frames captured before a sensor change was acknowledged are stale
+        if (s_resync_request != resync_seen) {
+            resync_seen = s_resync_request;
+            resync_skip = CAPTURE_RESYNC_FRAMES;
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+            if (s_thumbs != NULL) {
+                scene_change_reset(&s_scene);
+            }
+#endif
+        }
+        if (resync_skip > 0) {
+            resync_skip--;
+            s_stats.frames_resync++;
+            camera_return_frame(fb);
+            continue;
+        }
+
+#ifdef CONFIG_APP_JPEG_VALIDATE
+        if (fb->format == PIXFORMAT_JPEG) {
+            jpeg_check_result_t result = capture_check(fb);
+            if (result != JPEG_CHECK_OK) {
+                s_stats.frames_corrupt[result]++;
+                // The driver buffer goes back before a reinit
+                camera_return_frame(fb);
+                if (capture_count_frame(true)) {
+                    capture_xclk_fallback();
+                }
+                continue;
+            }
+        }
+#endif
+
+        // No copy at all: the frame goes to the clients from the driver buffer
+        if (dram_stream_active()) {
+            dram_stream_forward(fb);
+            camera_return_frame(fb);
+            s_seq++;
+            s_stats.frames_captured++;
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+            capture_standby_frame();
+#endif
+#ifdef CONFIG_APP_JPEG_VALIDATE
+            if (capture_count_frame(false)) {
+                capture_xclk_fallback();
+            }
+#endif
+            continue;
+        }
+
+        // The only copy: the driver buffer goes straight back to the camera
+        frame_t *frame = fb->format == PIXFORMAT_JPEG ? capture_copy(fb) : capture_encode(fb);
+        camera_return_frame(fb);
+        if (!frame) {
+            continue;
+        }
+
+        // The driver reports the configured frame size even when the sensor
+        // window (ROI) produces a different one
+        if (frame->format == PIXFORMAT_JPEG) {
+            jpeg_dc_size(frame->data, frame->len, &frame->width, &frame->height);
+        }
+
+        frame->unchanged = false;
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+        if (s_thumbs != NULL && frame->format == PIXFORMAT_JPEG) {
+            frame->unchanged = !scene_change_update(&s_scene, frame->data, frame->len);
+#ifdef CONFIG_APP_JPEG_VALIDATE
+            // The thumbnail decode walked the Huffman codes, which catches
+            // the slipped or flipped bytes a marker scan cannot see
+            if (s_scene.undecodable) {
+                frame_unref(frame);
+                s_stats.frames_undecodable++;
+                if (capture_count_frame(true)) {
+                    capture_xclk_fallback();
+                }
+                continue;
+            }
+#endif
+#ifdef CONFIG_APP_AUTO_EXPOSURE
+            if (s_scene.thumb != NULL) {
+                exposure_process(s_scene.thumb, s_scene.ref_w, s_scene.ref_h);
+            }
+#endif
+            if (frame->unchanged) {
+                s_stats.frames_unchanged++;
+            }
+        }
+#endif
+
+#ifdef CONFIG_APP_JPEG_VALIDATE
+        if (frame->format == PIXFORMAT_JPEG && capture_count_frame(false)) {
+            capture_xclk_fallback();
+        }
+#endif
+
+        frame->timestamp_us = esp_timer_get_time();
+        frame->seq = ++s_seq;
+        s_stats.frames_captured++;
+        capture_publish(frame);
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+        capture_standby_frame();
+#endif
+    }
+
+    ESP_LOGI(TAG, "Capture task stopped");
+    xEventGroupSetBits(s_events, CAPTURE_STOPPED_BIT);
+    vTaskDelete(NULL);
+}
+
+esp_err_t capture_pipeline_start(void)
+{
+    if (s_running) {
+        return ESP_OK;
+    }
+
+    if (s_events == NULL) {
+        s_events = xEventGroupCreate();
+        if (s_events == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (dram_stream_active()) {
+        esp_err_t ret = dram_stream_start();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        ESP_LOGI(TAG, "DRAM stream: frames go from the driver buffer to the clients, no frame pool");
+    } else if (s_pool_memory == NULL) {
+        size_t slab_size;
+        uint32_t slab_count;
+        uint32_t caps;
+
+        if (esp_psram_is_initialized()) {
+            slab_size = CAPTURE_SLAB_SIZE_PSRAM;
+            slab_count = CAPTURE_SLAB_COUNT_PSRAM;
+            caps = MALLOC_CAP_SPIRAM;
+        } else {
+            slab_size = CAPTURE_SLAB_SIZE_DRAM;
+            slab_count = CAPTURE_SLAB_COUNT_DRAM;
+            caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+        }
+
+        s_pool_memory = heap_caps_malloc(slab_size * slab_count, caps);
+        if (s_pool_memory == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate frame pool (%u x %u bytes)",
+                     (unsigned)slab_count, (unsigned)slab_size);
+            return ESP_ERR_NO_MEM;
+        }
+
+        frame_pool_init(&s_pool, s_pool_memory, slab_size, slab_count);
+        ESP_LOGI(TAG, "Frame pool: %u slabs of %u KB in %s", (unsigned)slab_count,
+                 (unsigned)(slab_size / 1024), caps == MALLOC_CAP_SPIRAM ? "PSRAM" : "DRAM");
+    }
+
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+    if (dram_stream_active()) {
+        // Frames are not published, so there is nothing to compare
+    } else if (s_thumbs == NULL) {
+        bool psram = esp_psram_is_initialized();
+        size_t thumb_size = psram ? CAPTURE_THUMB_SIZE_PSRAM : CAPTURE_THUMB_SIZE_DRAM;
+        s_thumbs = heap_caps_malloc(2 * thumb_size, psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (s_thumbs == NULL) {
+            // Not fatal, every frame is simply treated as changed
+            ESP_LOGW(TAG, "Failed to allocate scene change thumbnails, duplicate suppression disabled");
+        } else {
+            scene_change_init(&s_scene, s_thumbs, s_thumbs + thumb_size, thumb_size,
+                              CONFIG_APP_SCENE_CHANGE_BLOCK_DELTA, CONFIG_APP_SCENE_CHANGE_PERMILLE);
+        }
+    } else {
+        scene_change_reset(&s_scene);
+    }
+#endif
+
+#ifdef CONFIG_APP_JPEG_VALIDATE
+    jpeg_check_rate_init(&s_corrupt_rate, CAPTURE_CORRUPT_WINDOW, CONFIG_APP_XCLK_FALLBACK_PERMILLE);
+#endif
+
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+    // Time spent stopped is not a stall
+    if (!s_watchdog_ready) {
+        const capture_watchdog_config_t wd_config = {
+            .stall_ms = CONFIG_APP_CAPTURE_STALL_MS,
+            .max_failures = CONFIG_APP_CAPTURE_STALL_FAILURES,
+            .settle_ms = CONFIG_APP_CAPTURE_RECOVERY_SETTLE_MS,
+            .reinit_attempts = CONFIG_APP_CAPTURE_REINIT_ATTEMPTS,
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG_RESTART
+            .allow_restart = true,
+#endif
+            .failed_retry_ms = CAPTURE_WD_FAILED_RETRY_MS,
+        };
+        capture_watchdog_init(&s_watchdog, &wd_config, capture_now_ms());
+        s_watchdog_ready = true;
+    } else {
+        capture_watchdog_reset(&s_watchdog, capture_now_ms());
+    }
+#endif
+
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+    // Idle time counts from the start; a stop in standby left the sensor
+    // asleep
+    bool asleep = false;
+    portENTER_CRITICAL(&s_demand_lock);
+    if (!s_demand_ready) {
+        capture_demand_init(&s_demand, CAPTURE_IDLE_MS, CAPTURE_RESUME_TARGET_MS, capture_now_ms());
+        s_demand_ready = true;
+    } else {
+        asleep = capture_demand_restart(&s_demand, capture_now_ms());
+    }
+    portEXIT_CRITICAL(&s_demand_lock);
+    if (asleep) {
+        camera_standby(false, CAPTURE_STANDBY_XCLK_HZ);
+        capture_pipeline_resync();
+    }
+#endif
+
+    xEventGroupClearBits(s_events, CAPTURE_STOPPED_BIT | CAPTURE_WAKE_BIT);
+    s_running = true;
+    if (xTaskCreatePinnedToCore(capture_task, "capture", CAPTURE_TASK_STACK_SIZE, NULL,
+                                CAPTURE_TASK_PRIORITY, NULL, CAPTURE_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create capture task");
+        s_running = false;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t capture_pipeline_stop(void)
+{
+    if (!s_running) {
+        return ESP_OK;
+    }
+
+    s_running = false;
+    // The task finishes its current esp_camera_fb_get(), which is bounded by
+    // the driver's frame timeout, or its standby wait
+    xEventGroupSetBits(s_events, CAPTURE_WAKE_BIT);
+    xEventGroupWaitBits(s_events, CAPTURE_STOPPED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    return ESP_OK;
+}
+
+bool capture_pipeline_is_running(void)
+{
+    return s_running;
+}
+
+void capture_pipeline_resync(void)
+{
+    s_resync_request++;
+}
+
+frame_t *capture_pipeline_get_frame(uint32_t after_seq, uint32_t timeout_ms)
+{
+    if (s_events == NULL) {
+        return NULL;
+    }
+
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+    // Every reader is demand; after a standby the latest frame is stale, so
+    // wait for one captured since
+    capture_pipeline_touch();
+    if (after_seq < s_standby_seq) {
+        after_seq = s_standby_seq;
+    }
+#endif
+
+    while (true) {
+        frame_t *frame = NULL;
+
+        portENTER_CRITICAL(&s_latest_lock);
+        if (s_latest != NULL && s_latest->seq > after_seq) {
+            frame = frame_ref(s_latest);
+        }
+        portEXIT_CRITICAL(&s_latest_lock);
+
+        if (frame != NULL) {
+            return frame;
+        }
+
+        int64_t remaining_ms = (deadline_us - esp_timer_get_time()) / 1000;
+        if (remaining_ms <= 0) {
+            return NULL;
+        }
+
+        // A publish between the check above and this wait is only noticed at
+        // the end of the slice, so keep the slice short
+        uint32_t wait_ms = remaining_ms < CAPTURE_WAIT_SLICE_MS ? (uint32_t)remaining_ms : CAPTURE_WAIT_SLICE_MS;
+        xEventGroupWaitBits(s_events, CAPTURE_NEW_FRAME_BIT, pdFALSE, pdFALSE, pdMS_TO_TICKS(wait_ms));
+    }
+}
+
+void capture_pipeline_set_publish_notify(TaskHandle_t task)
+{
+    s_publish_notify = task;
+}
+
+uint32_t capture_pipeline_latest_seq(void)
+{
+    portENTER_CRITICAL(&s_latest_lock);
+    uint32_t seq = s_latest != NULL ? s_latest->seq : 0;
+    portEXIT_CRITICAL(&s_latest_lock);
+    return seq;
+}
+
+esp_err_t capture_pipeline_add_raw_stage(capture_raw_stage_t stage, void *ctx)
+{
+    if (s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_raw_stage_count >= CAPTURE_RAW_STAGES_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_raw_stages[s_raw_stage_count].fn = stage;
+    s_raw_stages[s_raw_stage_count].ctx = ctx;
+    s_raw_stage_count++;
+    return ESP_OK;
+}
+
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+static void capture_wake(bool wake)
+{
+    if (wake && s_events != NULL) {
+        xEventGroupSetBits(s_events, CAPTURE_WAKE_BIT);
+    }
+}
+
+void capture_pipeline_acquire(capture_consumer_t consumer)
+{
+    portENTER_CRITICAL(&s_demand_lock);
+    bool wake = s_demand_ready && capture_demand_acquire(&s_demand, consumer, capture_now_ms());
+    portEXIT_CRITICAL(&s_demand_lock);
+    capture_wake(wake);
+}
+
+void capture_pipeline_release(capture_consumer_t consumer)
+{
+    portENTER_CRITICAL(&s_demand_lock);
+    if (s_demand_ready) {
+        capture_demand_release(&s_demand, consumer, capture_now_ms());
+    }
+    portEXIT_CRITICAL(&s_demand_lock);
+}
+
+void capture_pipeline_touch(void)
+{
+    portENTER_CRITICAL(&s_demand_lock);
+    bool wake = s_demand_ready && capture_demand_touch(&s_demand, capture_now_ms());
+    portEXIT_CRITICAL(&s_demand_lock);
+    capture_wake(wake);
+}
+#else
+void capture_pipeline_acquire(capture_consumer_t consumer)
+{
+}
+
+void capture_pipeline_release(capture_consumer_t consumer)
+{
+}
+
+void capture_pipeline_touch(void)
+{
+}
+#endif
+
+capture_watchdog_state_t capture_pipeline_health(void)
+{
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+    return s_watchdog.state;
+#else
+    return CAPTURE_WD_OK;
+#endif
+}
+
+void capture_pipeline_get_stats(capture_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->latest_seq = s_seq;
+    stats->xclk_hz = camera_get_xclk();
+#ifdef CONFIG_APP_CAPTURE_WATCHDOG
+    stats->health = s_watchdog.state;
+    stats->idle_ms = s_running ? capture_watchdog_idle_ms(&s_watchdog, capture_now_ms()) : 0;
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+    if (s_demand.state == CAPTURE_DEMAND_STANDBY) {
+        stats->idle_ms = 0; // no frames expected
+    }
+#endif
+    stats->watchdog = s_watchdog.stats;
+    stats->watchdog_restarts = s_restart_magic == CAPTURE_WD_RESTART_MAGIC ? s_restart_count : 0;
+#else
+    stats->health = CAPTURE_WD_OK;
+    stats->idle_ms = 0;
+    memset(&stats->watchdog, 0, sizeof(stats->watchdog));
+    stats->watchdog_restarts = 0;
+#endif
+#ifdef CONFIG_APP_CAPTURE_STANDBY
+    portENTER_CRITICAL(&s_demand_lock);
+    stats->standby_enabled = true;
+    stats->demand_state = s_demand.state;
+    stats->consumers = capture_demand_holders(&s_demand);
+    stats->demand = s_demand.stats;
+    stats->demand.standby_ms = capture_demand_standby_ms(&s_demand, capture_now_ms());
+    portEXIT_CRITICAL(&s_demand_lock);
+#else
+    stats->standby_enabled = false;
+    stats->demand_state = CAPTURE_DEMAND_ACTIVE;
+    stats->consumers = 0;
+    memset(&stats->demand, 0, sizeof(stats->demand));
+#endif
+    if (s_pool_memory != NULL) {
+        frame_pool_get_stats(&s_pool, &stats->pool);
+    } else {
+        memset(&stats->pool, 0, sizeof(stats->pool));
+    }
+}
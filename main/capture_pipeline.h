@@ -0,0 +1,108 @@
+#ifndef CAPTURE_PIPELINE_H
+#define CAPTURE_PIPELINE_H
+
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "frame_pool.h"
+#include "capture_watchdog.h"
+#include "capture_demand.h"
+#include "jpeg_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Capture pipeline statistics
+typedef struct {
+    uint32_t frames_captured;
+    uint32_t frames_dropped;    // pool exhausted, consumers holding every slab
+    uint32_t frames_oversize;   // larger than a slab
+    uint32_t capture_failures;  // driver returned no frame
+    uint32_t frames_unchanged;  // near-identical to the last changed frame
+    uint32_t frames_resync;     // discarded after a sensor reconfiguration
+    uint32_t frames_corrupt[JPEG_CHECK_COUNT]; // failed jpeg_check(), by result
+    uint32_t frames_undecodable; // entropy data the scene change decode rejected
+    uint32_t corrupt_permille;  // of the last 100 checked frames
+    uint32_t frames_encoded;    // raw frames encoded to JPEG by the capture task
+    uint32_t frames_unsupported; // raw format the encoder does not take
+    uint32_t encode_us_avg;
+    uint32_t encode_us_max;
+    uint32_t xclk_hz;
+    uint32_t xclk_fallbacks;
+    uint32_t latest_seq;
+    frame_pool_stats_t pool;
+    capture_watchdog_state_t health;
+    uint32_t idle_ms;           // since the last good frame
+    capture_watchdog_stats_t watchdog;
+    uint32_t watchdog_restarts; // device restarts by the watchdog since power-on
+    bool standby_enabled;
+    capture_demand_state_t demand_state;
+    uint32_t consumers;         // holding the pipeline, see capture_pipeline_acquire()
+    capture_demand_stats_t demand;
+} capture_stats_t;
+
+// A raw frame from the sensor, before it is encoded
+typedef struct {
+    uint8_t *data;              // driver buffer; stages may modify it in place
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    pixformat_t format;         // PIXFORMAT_YUV422 (Y0 U Y1 V) or PIXFORMAT_GRAYSCALE
+} capture_raw_frame_t;
+
+// Processing stage, run on the capture task for every raw frame in
+// registration order while the driver buffer is held; keep it short
+typedef void (*capture_raw_stage_t)(capture_raw_frame_t *frame, void *ctx);
+
+// Allocate the frame pool and start the capture task. The camera must be
+// initialized; the driver buffer is copied (raw formats: encoded) into the
+// pool once and returned to the driver immediately.
+esp_err_t capture_pipeline_start(void);
+
+// Stop the capture task and wait for it to exit. Frames still referenced by
+// consumers stay valid until they are unreferenced.
+esp_err_t capture_pipeline_stop(void);
+
+bool capture_pipeline_is_running(void);
+
+// Discard the next few driver frames, which may still carry the old sensor
+// window or be torn by the change, and restart scene-change tracking. Call
+// after reprogramming the sensor; streams continue without a reinit.
+void capture_pipeline_resync(void);
+
+// Get a reference to the latest frame with a sequence number greater than
+// after_seq, waiting up to timeout_ms for one to be captured. Pass 0 to get
+// the latest frame available. The caller must frame_unref() the result.
+// Counts as demand, see capture_pipeline_touch(); in or just after a
+// standby only frames captured since are returned.
+frame_t *capture_pipeline_get_frame(uint32_t after_seq, uint32_t timeout_ms);
+
+// Notify `task` (xTaskNotifyGive) on every publish, for a consumer that
+// waits for other events too and so cannot block in
+// capture_pipeline_get_frame(). One task at a time; NULL to stop.
+void capture_pipeline_set_publish_notify(TaskHandle_t task);
+
+// Sequence number of the latest published frame, 0 before the first. Frames
+// are numbered from 1 at boot and the number only grows.
+uint32_t capture_pipeline_latest_seq(void);
+
+// With APP_CAPTURE_STANDBY the sensor goes to standby once no consumer has
+// held the pipeline or read a frame for a while, and resumes on the next
+// demand. Long-lived consumers hold it from start to end; one-shot readers
+// touch it, which capture_pipeline_get_frame() does for them. No-ops when
+// standby is disabled.
+void capture_pipeline_acquire(capture_consumer_t consumer);
+void capture_pipeline_release(capture_consumer_t consumer);
+void capture_pipeline_touch(void);
+
+// Register a raw frame processing stage, before capture_pipeline_start().
+// Stages only see frames when the sensor is not in JPEG mode, see "Sensor
+// pixel format" in menuconfig.
+esp_err_t capture_pipeline_add_raw_stage(capture_raw_stage_t stage, void *ctx);
+
+// CAPTURE_WD_RECOVERING while the stall watchdog is resetting the sensor or
+// the driver, CAPTURE_WD_FAILED once it has given up. Always CAPTURE_WD_OK
+// when the watchdog is disabled.
+capture_watchdog_state_t capture_pipeline_health(void);
+
+void capture_pipeline_get_stats(capture_stats_t *stats);
+
+#endif // CAPTURE_PIPELINE_H
@@ -0,0 +1,147 @@
+#include "capture_watchdog.h"
+#include <string.h>
+
+static const char *const s_state_names[] = {
+    [CAPTURE_WD_OK] = "ok",
+    [CAPTURE_WD_RECOVERING] = "recovering",
+    [CAPTURE_WD_FAILED] = "failed",
+};
+
+static const char *const s_action_names[] = {
+    [CAPTURE_WD_ACTION_NONE] = "none",
+    [CAPTURE_WD_ACTION_SENSOR_RESET] = "sensor reset",
+    [CAPTURE_WD_ACTION_REINIT] = "driver reinit",
+    [CAPTURE_WD_ACTION_RESTART] = "restart",
+};
+
+const char *capture_watchdog_state_name(capture_watchdog_state_t state)
+{
+    return state <= CAPTURE_WD_FAILED ? s_state_names[state] : "unknown";
+}
+
+const char *capture_watchdog_action_name(capture_watchdog_action_t action)
+{
+    return action <= CAPTURE_WD_ACTION_RESTART ? s_action_names[action] : "unknown";
+}
+
+void capture_watchdog_init(capture_watchdog_t *wd, const capture_watchdog_config_t *config, uint32_t now_ms)
+{
+    memset(wd, 0, sizeof(*wd));
+    wd->config = *config;
+    wd->last_good_ms = now_ms;
+}
+
+void capture_watchdog_reset(capture_watchdog_t *wd, uint32_t now_ms)
+{
+    wd->state = CAPTURE_WD_OK;
+    wd->last_action = CAPTURE_WD_ACTION_NONE;
+    wd->last_good_ms = now_ms;
+    wd->consecutive_failures = 0;
+    wd->reinits_done = 0;
+}
+
+void capture_watchdog_frame(capture_watchdog_t *wd, uint32_t now_ms)
+{
+    if (wd->state != CAPTURE_WD_OK) {
+        uint32_t outage = now_ms - wd->stall_start_ms;
+        wd->stats.recoveries++;
+        wd->stats.last_recovery_ms = outage;
+        if (outage > wd->stats.max_recovery_ms) {
+            wd->stats.max_recovery_ms = outage;
+        }
+        wd->state = CAPTURE_WD_OK;
+        wd->last_action = CAPTURE_WD_ACTION_NONE;
+    }
+    wd->last_good_ms = now_ms;
+    wd->consecutive_failures = 0;
+}
+
+void capture_watchdog_failure(capture_watchdog_t *wd)
+{
+    wd->consecutive_failures++;
+    wd->stats.failures++;
+}
+
+static capture_watchdog_action_t capture_watchdog_request(capture_watchdog_t *wd, capture_watchdog_action_t action,
+                                                          uint32_t now_ms)
+{
+    wd->last_action = action;
+    wd->action_ms = now_ms;
+
+    switch (action) {
+    case CAPTURE_WD_ACTION_SENSOR_RESET:
+        wd->stats.sensor_resets++;
+        break;
+    case CAPTURE_WD_ACTION_REINIT:
+        wd->stats.reinits++;
+        wd->reinits_done++;
+        break;
+    case CAPTURE_WD_ACTION_RESTART:
+        wd->stats.restarts++;
+        break;
+    default:
+        break;
+    }
+    return action;
+}
+
+// The last action had its chance; try the next, more expensive one
+static capture_watchdog_action_t capture_watchdog_escalate(capture_watchdog_t *wd, uint32_t now_ms)
+{
+    if (wd->reinits_done < wd->config.reinit_attempts) {
+        return capture_watchdog_request(wd, CAPTURE_WD_ACTION_REINIT, now_ms);
+    }
+    if (wd->config.allow_restart) {
+        return capture_watchdog_request(wd, CAPTURE_WD_ACTION_RESTART, now_ms);
+    }
+
+    wd->state = CAPTURE_WD_FAILED;
+    wd->last_action = CAPTURE_WD_ACTION_NONE;
+    wd->action_ms = now_ms;
+    return CAPTURE_WD_ACTION_NONE;
+}
+
+capture_watchdog_action_t capture_watchdog_poll(capture_watchdog_t *wd, uint32_t now_ms)
+{
+    switch (wd->state) {
+    case CAPTURE_WD_OK:
+        if (wd->consecutive_failures < wd->config.max_failures &&
+            now_ms - wd->last_good_ms < wd->config.stall_ms) {
+            return CAPTURE_WD_ACTION_NONE;
+        }
+        wd->state = CAPTURE_WD_RECOVERING;
+        wd->stall_start_ms = wd->last_good_ms;
+        wd->reinits_done = 0;
+        wd->stats.stalls++;
+        return capture_watchdog_request(wd, CAPTURE_WD_ACTION_SENSOR_RESET, now_ms);
+
+    case CAPTURE_WD_RECOVERING:
+        if (now_ms - wd->action_ms < wd->config.settle_ms) {
+            return CAPTURE_WD_ACTION_NONE;
+        }
+        return capture_watchdog_escalate(wd, now_ms);
+
+    case CAPTURE_WD_FAILED:
+        // Keep trying now and then; the sensor may have been reseated
+        if (wd->config.failed_retry_ms == 0 || now_ms - wd->action_ms < wd->config.failed_retry_ms) {
+            return CAPTURE_WD_ACTION_NONE;
+        }
+        wd->stats.reinits++;
+        wd->action_ms = now_ms;
+        return CAPTURE_WD_ACTION_REINIT;
+    }
+    return CAPTURE_WD_ACTION_NONE;
+}
+
+void capture_watchdog_action_done(capture_watchdog_t *wd, bool ok, uint32_t now_ms)
+{
+    if (!ok && wd->state == CAPTURE_WD_RECOVERING) {
+        // Escalate on the next poll rather than waiting out settle_ms
+        wd->action_ms = now_ms - wd->config.settle_ms;
+    }
+}
+
+uint32_t capture_watchdog_idle_ms(const capture_watchdog_t *wd, uint32_t now_ms)
+{
+    return now_ms - wd->last_good_ms;
+}
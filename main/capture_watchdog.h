@@ -0,0 +1,88 @@
+#ifndef CAPTURE_WATCHDOG_H
+#define CAPTURE_WATCHDOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Stall detection and escalating recovery for the capture task.
+//
+// The capture task reports every good frame and every failed capture; the
+// watchdog declares a stall after too many consecutive failures or too long
+// without a good frame and then asks for recovery actions in increasing
+// order of cost: an SCCB sensor reset, a camera driver reinit (repeated up
+// to reinit_attempts times) and finally a restart of the device. Each action
+// gets settle_ms to produce a good frame before the next one is requested.
+// Time-to-recovery is measured from the last good frame before the stall.
+// Only depends on the clock passed in, so it can be exercised on any host.
+
+typedef enum {
+    CAPTURE_WD_OK,
+    CAPTURE_WD_RECOVERING,
+    CAPTURE_WD_FAILED         // every action tried and restart not allowed
+} capture_watchdog_state_t;
+
+typedef enum {
+    CAPTURE_WD_ACTION_NONE,
+    CAPTURE_WD_ACTION_SENSOR_RESET,
+    CAPTURE_WD_ACTION_REINIT,
+    CAPTURE_WD_ACTION_RESTART
+} capture_watchdog_action_t;
+
+typedef struct {
+    uint32_t stall_ms;          // no good frame for this long is a stall
+    uint32_t max_failures;      // consecutive failed captures that are a stall
+    uint32_t settle_ms;         // time an action gets to produce a good frame
+    uint8_t reinit_attempts;    // driver reinits before a restart
+    bool allow_restart;
+    uint32_t failed_retry_ms;   // FAILED: interval between further reinits
+} capture_watchdog_config_t;
+
+typedef struct {
+    uint32_t stalls;
+    uint32_t recoveries;
+    uint32_t sensor_resets;
+    uint32_t reinits;
+    uint32_t restarts;          // requested; the last thing a device does
+    uint32_t failures;          // failed captures, all time
+    uint32_t last_recovery_ms;  // outage of the last recovered stall
+    uint32_t max_recovery_ms;
+} capture_watchdog_stats_t;
+
+typedef struct {
+    capture_watchdog_config_t config;
+    capture_watchdog_state_t state;
+    capture_watchdog_action_t last_action;
+    uint32_t last_good_ms;
+    uint32_t stall_start_ms;    // last good frame before the stall
+    uint32_t action_ms;         // when last_action was requested
+    uint32_t consecutive_failures;
+    uint8_t reinits_done;       // in the current stall
+    capture_watchdog_stats_t stats;
+} capture_watchdog_t;
+
+void capture_watchdog_init(capture_watchdog_t *wd, const capture_watchdog_config_t *config, uint32_t now_ms);
+
+// Start over, e.g. after the capture task was stopped on purpose; keeps stats
+void capture_watchdog_reset(capture_watchdog_t *wd, uint32_t now_ms);
+
+// A frame was captured. Ends a stall, recording the time to recovery.
+void capture_watchdog_frame(capture_watchdog_t *wd, uint32_t now_ms);
+
+// A capture returned no frame
+void capture_watchdog_failure(capture_watchdog_t *wd);
+
+// Check for a stall or an action that did not help. Returns the recovery
+// action to perform now, if any.
+capture_watchdog_action_t capture_watchdog_poll(capture_watchdog_t *wd, uint32_t now_ms);
+
+// Report the outcome of an action returned by poll. A failed action is
+// escalated on the next poll instead of after settle_ms.
+void capture_watchdog_action_done(capture_watchdog_t *wd, bool ok, uint32_t now_ms);
+
+// Milliseconds since the last good frame
+uint32_t capture_watchdog_idle_ms(const capture_watchdog_t *wd, uint32_t now_ms);
+
+const char *capture_watchdog_state_name(capture_watchdog_state_t state);
+const char *capture_watchdog_action_name(capture_watchdog_action_t action);
+
+#endif // CAPTURE_WATCHDOG_H
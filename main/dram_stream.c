@@ -0,0 +1,425 @@
+#include "dram_stream.h"
+#include "frame_fanout.h"
+#include "video_stream.h"
+#include "qos_arbiter.h"
+#include "capture_pipeline.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_psram.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_APP_DRAM_STREAM
+
+static const char *TAG = "dram_stream";
+
+#define DRAM_STREAM_CLIENTS CONFIG_APP_DRAM_STREAM_CLIENTS
+#define DRAM_STREAM_STACK_SIZE 4096
+
+// Content-Length is the frame's, so the connection stays open for the next
+// request
+#define DRAM_CAPTURE_RESPONSE_HEADER \
+    "HTTP/1.1 200 OK\r\n" \
+    "Content-Type: image/jpeg\r\n" \
+    "Content-Length: %u\r\n" \
+    "Content-Disposition: inline; filename=capture.jpg\r\n" \
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n" \
+    "Access-Control-Allow-Origin: *\r\n" \
+    "\r\n"
+
+#define DRAM_IDLE_RESPONSE \
+    "HTTP/1.1 503 Service Unavailable\r\n" \
+    "Content-Type: text/plain\r\n" \
+    "Content-Length: 24\r\n" \
+    "Retry-After: 1\r\n" \
+    "\r\n" \
+    "No frame from the camera"
+
+// How often dram_tx looks for idle clients while no frame comes
+#define DRAM_STREAM_IDLE_CHECK_MS 500
+
+typedef enum {
+    DRAM_CLIENT_FREE,
+    DRAM_CLIENT_RESERVED,       // being detached from the httpd task
+    DRAM_CLIENT_NEW,            // response header not written yet
+    DRAM_CLIENT_LIVE,
+} dram_client_state_t;
+
+typedef struct {
+    volatile dram_client_state_t state;
+    httpd_req_t *req;
+    int fd;
+    bool capture;
+    uint32_t last_sent_ms;      // last frame written completely, or when added
+} dram_client_t;
+
+// Slots are claimed by the httpd task and released by the dram_tx task
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static dram_client_t s_clients[DRAM_STREAM_CLIENTS];
+static dram_stream_stats_t s_stats;
+
+// The capture task lends the driver buffer to dram_tx, which gives s_sent
+// back once it is done with it
+static TaskHandle_t s_sender_task = NULL;
+static SemaphoreHandle_t s_sent = NULL;
+static const camera_fb_t *volatile s_fb = NULL;
+
+// Only touched by the dram_tx task
+static frame_fanout_t s_fanout;
+static uint32_t s_last_offer_ms;
+static uint32_t s_last_frame_ms;
+
+static uint32_t dram_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+bool dram_stream_active(void)
+{
+    return !esp_psram_is_initialized();
+}
+
+esp_err_t dram_stream_add_client(httpd_req_t *req, bool capture)
+{
+    dram_client_t *client = NULL;
+
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < DRAM_STREAM_CLIENTS; i++) {
+        if (s_clients[i].state == DRAM_CLIENT_FREE) {
+            client = &s_clients[i];
+            client->state = DRAM_CLIENT_RESERVED;
+            s_stats.clients++;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (client == NULL) {
+        ESP_LOGW(TAG, "All %d DRAM stream slots busy, rejecting client", DRAM_STREAM_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_send(req, "Too many stream clients", HTTPD_RESP_USE_STRLEN);
+    }
+
+    // Detach the request from the httpd task; dram_tx answers it
+    httpd_req_t *async_req = NULL;
+    esp_err_t res = httpd_req_async_handler_begin(req, &async_req);
+    int fd = res == ESP_OK ? httpd_req_to_sockfd(async_req) : -1;
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Failed to detach request: %s", esp_err_to_name(res));
+        if (async_req != NULL) {
+            httpd_req_async_handler_complete(async_req);
+        }
+        portENTER_CRITICAL(&s_lock);
+        client->state = DRAM_CLIENT_FREE;
+        s_stats.clients--;
+        portEXIT_CRITICAL(&s_lock);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    client->req = async_req;
+    client->fd = fd;
+    client->capture = capture;
+    client->last_sent_ms = dram_now_ms();
+    portENTER_CRITICAL(&s_lock);
+    client->state = DRAM_CLIENT_NEW;
+    portEXIT_CRITICAL(&s_lock);
+    // Wakes the sensor if it is in standby
+    capture_pipeline_acquire(CAPTURE_CONSUMER_STREAM);
+    ESP_LOGI(TAG, "%s client (fd %d) waiting for the next frame", capture ? "Capture" : "Stream", fd);
+    return ESP_OK;
+}
+
+// A capture that was written keeps its session for the next request; a
+// stream, written to the socket directly, ends by closing it
+static void dram_client_close(dram_client_t *client, bool failed)
+{
+    httpd_handle_t handle = client->req->handle;
+
+    httpd_req_async_handler_complete(client->req);
+    if (failed || !client->capture) {
+        httpd_sess_trigger_close(handle, client->fd);
+    }
+    capture_pipeline_release(CAPTURE_CONSUMER_STREAM);
+    if (failed) {
+        ESP_LOGW(TAG, "Client (fd %d) write failed or timed out, disconnecting", client->fd);
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    client->req = NULL;
+    client->state = DRAM_CLIENT_FREE;
+    s_stats.clients--;
+    if (failed) {
+        s_stats.client_drops++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// True if the socket takes more data right now
+static bool dram_client_writable(const dram_client_t *client)
+{
+    fd_set wfds;
+    struct timeval tv = { 0 };
+
+    FD_ZERO(&wfds);
+    FD_SET(client->fd, &wfds);
+    return select(client->fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
+
+// Pick the clients for this frame and give each its header. Returns the
+// number of stream clients that missed it because their socket was full.
+static uint32_t dram_stream_select(const camera_fb_t *fb, uint32_t now, bool admit, bool *throttled)
+{
+    uint32_t skipped = 0;
+    char hdr[FRAME_FANOUT_HDR_LEN];
+
+    for (int i = 0; i < DRAM_STREAM_CLIENTS; i++) {
+        dram_client_t *client = &s_clients[i];
+        if (client->state != DRAM_CLIENT_NEW && client->state != DRAM_CLIENT_LIVE) {
+            continue;
+        }
+        // Paused or paced by the bandwidth arbiter (OTA running, egress cap);
+        // a capture is a single frame and always answered
+        if (!admit && !client->capture) {
+            *throttled = true;
+            continue;
+        }
+        // Still draining the last frame: this one is dropped for that client
+        // rather than holding up the others and the sensor. A client that
+        // has not drained it within the send timeout has stopped reading.
+        if (client->state == DRAM_CLIENT_LIVE && !dram_client_writable(client)) {
+            if (now - client->last_sent_ms >= DRAM_STREAM_SEND_TIMEOUT_MS) {
+                dram_client_close(client, true);
+            } else {
+                skipped++;
+            }
+            continue;
+        }
+
+        int len;
+        if (client->capture) {
+            len = snprintf(hdr, sizeof(hdr), DRAM_CAPTURE_RESPONSE_HEADER, (unsigned)fb->len);
+        } else if (client->state == DRAM_CLIENT_NEW) {
+            len = snprintf(hdr, sizeof(hdr), STREAM_RESPONSE_HEADER STREAM_BOUNDARY STREAM_PART, (unsigned)fb->len);
+        } else {
+            len = snprintf(hdr, sizeof(hdr), STREAM_BOUNDARY STREAM_PART, (unsigned)fb->len);
+        }
+        if (frame_fanout_add(&s_fanout, i, hdr, len)) {
+            client->state = DRAM_CLIENT_LIVE;
+        }
+    }
+    return skipped;
+}
+
+// Write the frame to every selected client until all have it or the
+// deadline passes, waiting on the sockets that are full
+static void dram_stream_write(void)
+{
+    while (s_fanout.sending > 0) {
+        fd_set wfds;
+        int max_fd = -1;
+
+        FD_ZERO(&wfds);
+        for (int i = 0; i < DRAM_STREAM_CLIENTS; i++) {
+            const uint8_t *data;
+            size_t len = frame_fanout_pending(&s_fanout, i, &data);
+            if (len == 0) {
+                continue;
+            }
+            int sent = send(s_clients[i].fd, data, len, MSG_DONTWAIT);
+            if (sent > 0) {
+                frame_fanout_wrote(&s_fanout, i, sent);
+            } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                frame_fanout_fail(&s_fanout, i);
+            }
+            if (frame_fanout_state(&s_fanout, i) == FRAME_FANOUT_SENDING) {
+                FD_SET(s_clients[i].fd, &wfds);
+                max_fd = s_clients[i].fd > max_fd ? s_clients[i].fd : max_fd;
+            }
+        }
+
+        uint32_t now = dram_now_ms();
+        if (s_fanout.sending == 0 || frame_fanout_expire(&s_fanout, now) > 0) {
+            break;
+        }
+        uint32_t wait_ms = frame_fanout_remaining(&s_fanout, now);
+        struct timeval tv = {
+            .tv_sec = wait_ms / 1000,
+            .tv_usec = (wait_ms % 1000) * 1000,
+        };
+        select(max_fd + 1, NULL, &wfds, NULL, &tv);
+    }
+}
+
+// The camera has not produced a frame for a while. A client that has waited
+// out DRAM_STREAM_IDLE_TIMEOUT_MS too is answered 503 if nothing was written
+// to it yet, or has its stream ended; streams are kept while the watchdog
+// brings the camera back.
+static void dram_stream_expire_idle(uint32_t now)
+{
+    uint32_t closed = 0;
+
+    if (now - s_last_frame_ms < DRAM_STREAM_IDLE_TIMEOUT_MS) {
+        return;
+    }
+    bool recovering = capture_pipeline_health() == CAPTURE_WD_RECOVERING;
+
+    for (int i = 0; i < DRAM_STREAM_CLIENTS; i++) {
+        dram_client_t *client = &s_clients[i];
+        if ((client->state != DRAM_CLIENT_NEW && client->state != DRAM_CLIENT_LIVE) ||
+            now - client->last_sent_ms < DRAM_STREAM_IDLE_TIMEOUT_MS || (recovering && !client->capture)) {
+            continue;
+        }
+        bool failed = false;
+        if (client->state == DRAM_CLIENT_NEW) {
+            size_t len = strlen(DRAM_IDLE_RESPONSE);
+            failed = send(client->fd, DRAM_IDLE_RESPONSE, len, MSG_DONTWAIT) != (int)len;
+        }
+        ESP_LOGW(TAG, "No frame for %d ms, closing %s client (fd %d)", DRAM_STREAM_IDLE_TIMEOUT_MS,
+                 client->capture ? "capture" : "stream", client->fd);
+        dram_client_close(client, failed);
+        closed++;
+    }
+
+    if (closed > 0) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.clients_idle += closed;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+static void dram_stream_send(const camera_fb_t *fb)
+{
+    uint32_t now = dram_now_ms();
+    s_last_frame_ms = now;
+    bool admit = qos_arbiter_admit(QOS_FLOW_STREAM, s_last_offer_ms, now);
+    if (admit) {
+        s_last_offer_ms = now;
+    }
+
+    bool throttled = false;
+    frame_fanout_begin(&s_fanout, fb->buf, fb->len, now, DRAM_STREAM_SEND_TIMEOUT_MS);
+    uint32_t skipped = dram_stream_select(fb, now, admit, &throttled);
+    dram_stream_write();
+
+    bool sent = false;
+    now = dram_now_ms();
+    for (int i = 0; i < DRAM_STREAM_CLIENTS; i++) {
+        dram_client_t *client = &s_clients[i];
+        frame_fanout_state_t state = frame_fanout_state(&s_fanout, i);
+        if (state == FRAME_FANOUT_DONE) {
+            sent = true;
+            client->last_sent_ms = now;
+            if (client->capture) {
+                dram_client_close(client, false);
+            }
+        } else if (state == FRAME_FANOUT_FAILED) {
+            dram_client_close(client, true);
+        }
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.frames_sent += sent;
+    s_stats.frames_skipped += skipped;
+    if (throttled) {
+        s_stats.frames_throttled++;
+    }
+    s_stats.bytes_sent += s_fanout.bytes;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static void dram_sender_task(void *pvParameters)
+{
+    while (true) {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DRAM_STREAM_IDLE_CHECK_MS)) == 0) {
+            dram_stream_expire_idle(dram_now_ms());
+            continue;
+        }
+        dram_stream_send(s_fb);
+        xSemaphoreGive(s_sent);
+    }
+}
+
+esp_err_t dram_stream_start(void)
+{
+    if (s_sender_task != NULL) {
+        return ESP_OK;
+    }
+
+    s_sent = xSemaphoreCreateBinary();
+    if (s_sent == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Sends like a stream sender, so it runs like one
+    if (xTaskCreatePinnedToCore(dram_sender_task, "dram_tx", DRAM_STREAM_STACK_SIZE, NULL,
+                                STREAM_SENDER_PRIORITY, &s_sender_task, STREAM_SENDER_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create DRAM stream sender task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void dram_stream_forward(const camera_fb_t *fb)
+{
+    if (s_stats.clients == 0 || fb->format != PIXFORMAT_JPEG || s_sender_task == NULL) {
+        return;
+    }
+
+    // dram_tx gives up on slow clients after DRAM_STREAM_SEND_TIMEOUT_MS, so
+    // this wait is bounded
+    int64_t start_us = esp_timer_get_time();
+    s_fb = fb;
+    xTaskNotifyGive(s_sender_task);
+    xSemaphoreTake(s_sent, portMAX_DELAY);
+
+    uint32_t waited_us = (uint32_t)(esp_timer_get_time() - start_us);
+    if (waited_us > s_stats.send_us_max) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.send_us_max = waited_us;
+        portEXIT_CRITICAL(&s_lock);
+    }
+}
+
+void dram_stream_get_stats(dram_stream_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    stats->active = dram_stream_active();
+}
+
+#else // CONFIG_APP_DRAM_STREAM
+
+bool dram_stream_active(void)
+{
+    return false;
+}
+
+esp_err_t dram_stream_start(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t dram_stream_add_client(httpd_req_t *req, bool capture)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void dram_stream_forward(const camera_fb_t *fb)
+{
+}
+
+void dram_stream_get_stats(dram_stream_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_APP_DRAM_STREAM
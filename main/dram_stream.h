@@ -0,0 +1,79 @@
+#ifndef DRAM_STREAM_H
+#define DRAM_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_camera.h"
+#include "esp_http_server.h"
+
+// Streaming without a frame pool for boards without PSRAM, see
+// APP_DRAM_STREAM under "ESP32S3Cam Memory" in menuconfig.
+//
+// The sensor fills a single DRAM buffer owned by the driver. The capture
+// task hands every frame to dram_stream_forward() while it holds that
+// buffer, and the dram_tx task writes it to the /stream and /capture clients
+// straight from there, all of them at once with non-blocking sends (see
+// frame_fanout.h). APP_DRAM_STREAM selects APP_JPEG_VALIDATE, so the frame
+// has passed jpeg_check and runs from SOI to EOI; its length goes out as
+// Content-Length on every stream part and capture. The capture task never
+// touches a socket; it only waits, at most DRAM_STREAM_SEND_TIMEOUT_MS, for
+// the buffer to come back.
+
+#if defined(CONFIG_APP_DRAM_STREAM_HVGA)
+#define DRAM_STREAM_FRAME_SIZE FRAMESIZE_HVGA
+#elif defined(CONFIG_APP_DRAM_STREAM_CIF)
+#define DRAM_STREAM_FRAME_SIZE FRAMESIZE_CIF
+#else
+#define DRAM_STREAM_FRAME_SIZE FRAMESIZE_VGA
+#endif
+
+#ifdef CONFIG_APP_DRAM_STREAM
+#define DRAM_STREAM_QUALITY CONFIG_APP_DRAM_STREAM_QUALITY
+#else
+#define DRAM_STREAM_QUALITY 12
+#endif
+
+// Longest the sensor waits for its buffer; a client that has not taken the
+// whole frame by then is disconnected, as is one whose socket has stayed
+// full for that long since its last frame
+#define DRAM_STREAM_SEND_TIMEOUT_MS 1000
+
+// With no frame from the camera for this long, waiting captures and new
+// streams get 503 and running streams end, unless the stall watchdog is
+// recovering the camera (then streams are kept)
+#define DRAM_STREAM_IDLE_TIMEOUT_MS 3000
+
+typedef struct {
+    bool active;
+    uint32_t clients;
+    uint32_t frames_sent;       // written whole to at least one client
+    uint32_t frames_throttled;  // held back from /stream by the bandwidth arbiter
+    uint32_t frames_skipped;    // per client: its socket was still full, so it missed the frame
+    uint64_t bytes_sent;
+    uint32_t client_drops;      // write failed or timed out
+    uint32_t clients_idle;      // closed after DRAM_STREAM_IDLE_TIMEOUT_MS without a frame
+    uint32_t send_us_max;       // longest the capture task waited for the buffer
+} dram_stream_stats_t;
+
+// True when CONFIG_APP_DRAM_STREAM is set and no PSRAM was found; fixed
+// from boot
+bool dram_stream_active(void);
+
+// Start the dram_tx task; called by capture_pipeline_start() when active
+esp_err_t dram_stream_start(void);
+
+// Take over a /stream (capture = false) or /capture request; the response
+// starts with the next frame. Answers 503 itself when every client slot is
+// taken.
+esp_err_t dram_stream_add_client(httpd_req_t *req, bool capture);
+
+// Have the dram_tx task write a driver frame buffer to the clients, and
+// wait until it is done with it; called by the capture task before it
+// returns the buffer
+void dram_stream_forward(const camera_fb_t *fb);
+
+void dram_stream_get_stats(dram_stream_stats_t *stats);
+
+#endif // DRAM_STREAM_H
@@ -0,0 +1,208 @@
+#include "exposure.h"
+#include "camera_init.h"
+#include "http_server.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <string.h>
+
+const char *exposure_mode_name(exposure_mode_t mode)
+{
+    return mode == EXPOSURE_MODE_FAST ? "fast" : "sensor";
+}
+
+#ifdef CONFIG_APP_AUTO_EXPOSURE
+
+static const char *TAG = "exposure";
+
+#define EXPOSURE_TOLERANCE 8          // luma levels either side of the target
+#define EXPOSURE_MIN_LINES 4
+#define EXPOSURE_CLIP_PERMILLE 20
+#define EXPOSURE_INITIAL_LINES 300    // where the sensor's own AEC starts
+#define EXPOSURE_HIST_PER_CHUNK 16
+
+// The controller belongs to the capture task; s_stats is its published copy
+static ae_ctrl_t s_ae;
+static bool s_ready = false;
+static exposure_mode_t s_mode = EXPOSURE_MODE_SENSOR;
+static volatile exposure_mode_t s_requested = EXPOSURE_MODE_FAST;
+static uint32_t s_takeovers = 0;
+static uint32_t s_write_errors = 0;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static exposure_stats_t s_stats;
+
+static void exposure_apply(void)
+{
+    if (camera_set_exposure(s_ae.setting.exposure, s_ae.setting.gain) != ESP_OK) {
+        s_write_errors++;
+    }
+}
+
+void exposure_process(const uint8_t *luma, uint16_t width, uint16_t height)
+{
+    luma_hist_t hist;
+
+    if (!s_ready) {
+        ae_ctrl_config_t config = {
+            .target = CONFIG_APP_AE_TARGET_LUMA,
+            .tolerance = EXPOSURE_TOLERANCE,
+            .exposure_min = EXPOSURE_MIN_LINES,
+            .exposure_max = CONFIG_APP_AE_MAX_EXPOSURE,
+            .gain_max = CONFIG_APP_AE_MAX_GAIN,
+            .settle_frames = CONFIG_APP_AE_SETTLE_FRAMES,
+            .clip_permille = EXPOSURE_CLIP_PERMILLE,
+        };
+        ae_ctrl_init(&s_ae, &config, (ae_setting_t){ .exposure = EXPOSURE_INITIAL_LINES, .gain = 0 });
+        s_ready = true;
+    }
+
+    exposure_mode_t mode = s_requested;
+    if (mode != s_mode) {
+        if (mode == EXPOSURE_MODE_SENSOR) {
+            camera_set_auto_exposure();
+        }
+        s_mode = mode;
+        ESP_LOGI(TAG, "Exposure control: %s", exposure_mode_name(mode));
+    }
+
+    luma_hist_compute(&hist, luma, width, height, 0);
+
+    if (s_mode == EXPOSURE_MODE_FAST) {
+        if (camera_auto_exposure()) {
+            // First frame, or the sensor was reset or reinitialized; this
+            // frame was exposed by its AEC, so it says nothing about ours
+            s_takeovers++;
+            ESP_LOGI(TAG, "Taking exposure over from the sensor at %u lines, gain %u",
+                     s_ae.setting.exposure, s_ae.setting.gain);
+            ae_ctrl_set(&s_ae, s_ae.setting);
+            exposure_apply();
+        } else if (ae_ctrl_update(&s_ae, &hist)) {
+            exposure_apply();
+        }
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.converged = s_ae.converged;
+    s_stats.limited = s_ae.limited;
+    s_stats.setting = s_ae.setting;
+    s_stats.target = s_ae.config.target;
+    s_stats.hist = hist;
+    s_stats.ae = s_ae.stats;
+    s_stats.takeovers = s_takeovers;
+    s_stats.write_errors = s_write_errors;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void exposure_set_mode(exposure_mode_t mode)
+{
+    s_requested = mode;
+}
+
+void exposure_get_stats(exposure_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    stats->enabled = true;
+    // Applied with the next frame
+    stats->mode = s_requested;
+}
+
+// GET /exposure reports the controller and the last histogram;
+// /exposure?mode=sensor hands control back to the sensor's AEC
+static esp_err_t exposure_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char value[8];
+    char json[512];
+    exposure_stats_t stats;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "mode", value, sizeof(value)) == ESP_OK) {
+        if (strcmp(value, "fast") == 0) {
+            exposure_set_mode(EXPOSURE_MODE_FAST);
+        } else if (strcmp(value, "sensor") == 0) {
+            exposure_set_mode(EXPOSURE_MODE_SENSOR);
+        } else {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "mode must be fast or sensor");
+        }
+    }
+
+    exposure_get_stats(&stats);
+    snprintf(json, sizeof(json),
+             "{\"mode\":\"%s\",\"converged\":%s,\"limited\":%s,\"exposure\":%u,\"gain\":%u,"
+             "\"target\":%u,\"mean\":%u,\"p5\":%u,\"p50\":%u,\"p95\":%u,\"dark_permille\":%u,"
+             "\"clip_permille\":%u,\"frames\":%lu,\"adjustments\":%lu,\"last_converge_frames\":%lu,"
+             "\"max_converge_frames\":%lu,\"takeovers\":%lu,\"histogram\":[",
+             exposure_mode_name(stats.mode), stats.converged ? "true" : "false",
+             stats.limited ? "true" : "false", stats.setting.exposure, stats.setting.gain, stats.target,
+             stats.hist.mean, stats.hist.p5, stats.hist.p50, stats.hist.p95, stats.hist.dark_permille,
+             stats.hist.clip_permille, (unsigned long)stats.ae.frames, (unsigned long)stats.ae.adjustments,
+             (unsigned long)stats.ae.last_converge_frames, (unsigned long)stats.ae.max_converge_frames,
+             (unsigned long)stats.takeovers);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    esp_err_t ret = httpd_resp_sendstr_chunk(req, json);
+
+    // Bins of 4 levels, lowest first
+    for (int i = 0; i < LUMA_HIST_BINS && ret == ESP_OK; i += EXPOSURE_HIST_PER_CHUNK) {
+        size_t len = 0;
+        for (int j = i; j < i + EXPOSURE_HIST_PER_CHUNK; j++) {
+            len += snprintf(json + len, sizeof(json) - len, "%s%lu", j == 0 ? "" : ",",
+                            (unsigned long)stats.hist.bins[j]);
+        }
+        ret = httpd_resp_sendstr_chunk(req, json);
+    }
+    if (ret == ESP_OK) {
+        ret = httpd_resp_sendstr_chunk(req, "]}");
+    }
+    if (ret == ESP_OK) {
+        ret = httpd_resp_sendstr_chunk(req, NULL);
+    }
+    return ret;
+}
+
+esp_err_t exposure_http_init(void)
+{
+    httpd_uri_t exposure_uri = {
+        .uri = "/exposure",
+        .method = HTTP_GET,
+        .handler = exposure_handler,
+        .user_ctx = NULL
+    };
+    return http_server_register_handler(&exposure_uri);
+}
+
+esp_err_t exposure_http_deinit(void)
+{
+    return http_server_unregister_handler("/exposure", HTTP_GET);
+}
+
+#else // CONFIG_APP_AUTO_EXPOSURE
+
+void exposure_process(const uint8_t *luma, uint16_t width, uint16_t height)
+{
+}
+
+void exposure_set_mode(exposure_mode_t mode)
+{
+}
+
+void exposure_get_stats(exposure_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+esp_err_t exposure_http_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t exposure_http_deinit(void)
+{
+    return ESP_OK;
+}
+
+#endif // CONFIG_APP_AUTO_EXPOSURE
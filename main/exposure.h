@@ -0,0 +1,51 @@
+#ifndef EXPOSURE_H
+#define EXPOSURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ae_ctrl.h"
+#include "luma_hist.h"
+
+// Fast auto exposure, see APP_AUTO_EXPOSURE in menuconfig.
+//
+// The capture task hands over the luma thumbnail of every frame it keeps.
+// In "fast" mode ae_ctrl sets the sensor's exposure and gain and the
+// sensor's AEC/AGC stay off; a sensor reset or driver reinit turns them back
+// on, which is noticed on the next frame and undone. In "sensor" mode only
+// the statistics are kept. GET /exposure reports both, and
+// /exposure?mode=fast|sensor switches until the next reboot.
+
+typedef enum {
+    EXPOSURE_MODE_SENSOR,
+    EXPOSURE_MODE_FAST
+} exposure_mode_t;
+
+typedef struct {
+    bool enabled;
+    exposure_mode_t mode;
+    bool converged;
+    bool limited;               // off target at the exposure or gain limit
+    ae_setting_t setting;
+    uint8_t target;
+    luma_hist_t hist;           // of the last metered frame
+    ae_ctrl_stats_t ae;
+    uint32_t takeovers;         // times the sensor's AEC had to be turned off
+    uint32_t write_errors;
+} exposure_stats_t;
+
+// Capture task: meter a width x height luma thumbnail
+void exposure_process(const uint8_t *luma, uint16_t width, uint16_t height);
+
+// Takes effect on the next frame
+void exposure_set_mode(exposure_mode_t mode);
+
+const char *exposure_mode_name(exposure_mode_t mode);
+
+void exposure_get_stats(exposure_stats_t *stats);
+
+// Register / unregister GET /exposure; nothing to do when disabled
+esp_err_t exposure_http_init(void);
+esp_err_t exposure_http_deinit(void);
+
+#endif // EXPOSURE_H
@@ -0,0 +1,103 @@
+#include "frame_fanout.h"
+#include <string.h>
+
+void frame_fanout_begin(frame_fanout_t *f, const uint8_t *body, size_t body_len, uint32_t now_ms,
+                        uint32_t timeout_ms)
+{
+    for (int i = 0; i < FRAME_FANOUT_MAX; i++) {
+        f->slots[i].state = FRAME_FANOUT_IDLE;
+        f->slots[i].hdr_len = 0;
+        f->slots[i].offset = 0;
+    }
+    f->body = body;
+    f->body_len = body_len;
+    f->started_ms = now_ms;
+    f->timeout_ms = timeout_ms;
+    f->sending = 0;
+    f->bytes = 0;
+}
+
+bool frame_fanout_add(frame_fanout_t *f, int slot, const char *hdr, size_t hdr_len)
+{
+    if (slot < 0 || slot >= FRAME_FANOUT_MAX || hdr_len > FRAME_FANOUT_HDR_LEN) {
+        return false;
+    }
+
+    frame_fanout_slot_t *s = &f->slots[slot];
+    if (s->state == FRAME_FANOUT_SENDING) {
+        f->sending--;
+    }
+    memcpy(s->hdr, hdr, hdr_len);
+    s->hdr_len = hdr_len;
+    s->offset = 0;
+    s->state = FRAME_FANOUT_SENDING;
+    f->sending++;
+    return true;
+}
+
+size_t frame_fanout_pending(const frame_fanout_t *f, int slot, const uint8_t **data)
+{
+    const frame_fanout_slot_t *s = &f->slots[slot];
+    if (s->state != FRAME_FANOUT_SENDING) {
+        *data = NULL;
+        return 0;
+    }
+
+    if (s->offset < s->hdr_len) {
+        *data = (const uint8_t *)s->hdr + s->offset;
+        return s->hdr_len - s->offset;
+    }
+    size_t body_offset = s->offset - s->hdr_len;
+    *data = f->body + body_offset;
+    return f->body_len - body_offset;
+}
+
+void frame_fanout_wrote(frame_fanout_t *f, int slot, size_t n)
+{
+    frame_fanout_slot_t *s = &f->slots[slot];
+    if (s->state != FRAME_FANOUT_SENDING) {
+        return;
+    }
+
+    size_t total = s->hdr_len + f->body_len;
+    if (n > total - s->offset) {
+        n = total - s->offset;
+    }
+    s->offset += n;
+    f->bytes += n;
+    if (s->offset == total) {
+        s->state = FRAME_FANOUT_DONE;
+        f->sending--;
+    }
+}
+
+void frame_fanout_fail(frame_fanout_t *f, int slot)
+{
+    frame_fanout_slot_t *s = &f->slots[slot];
+    if (s->state == FRAME_FANOUT_SENDING) {
+        s->state = FRAME_FANOUT_FAILED;
+        f->sending--;
+    }
+}
+
+int frame_fanout_expire(frame_fanout_t *f, uint32_t now_ms)
+{
+    if (f->sending == 0 || now_ms - f->started_ms < f->timeout_ms) {
+        return 0;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < FRAME_FANOUT_MAX; i++) {
+        if (f->slots[i].state == FRAME_FANOUT_SENDING) {
+            frame_fanout_fail(f, i);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+uint32_t frame_fanout_remaining(const frame_fanout_t *f, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - f->started_ms;
+    return elapsed < f->timeout_ms ? f->timeout_ms - elapsed : 0;
+}
@@ -0,0 +1,78 @@
+#ifndef FRAME_FANOUT_H
+#define FRAME_FANOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One frame written to several clients at once, for the DRAM stream
+// (CONFIG_APP_DRAM_STREAM), whose only frame buffer belongs to the driver and
+// has to go back before the sensor can capture the next frame.
+//
+// Every client taking part has its own header (response header, part header
+// or both, with the frame's Content-Length) followed by the shared body. The
+// caller writes what frame_fanout_pending() hands out with non-blocking
+// sends and reports the bytes written, client by client, so a slow client
+// never holds up a fast one. A part cannot be cut short once its length has
+// gone out, so a client that has not taken the whole frame when the deadline
+// passes has failed and has to be disconnected. No ESP-IDF dependencies.
+
+#define FRAME_FANOUT_MAX 8
+#define FRAME_FANOUT_HDR_LEN 384
+
+typedef enum {
+    FRAME_FANOUT_IDLE,          // not taking part in this frame
+    FRAME_FANOUT_SENDING,
+    FRAME_FANOUT_DONE,          // header and body written
+    FRAME_FANOUT_FAILED,        // write error, or the deadline passed
+} frame_fanout_state_t;
+
+typedef struct {
+    frame_fanout_state_t state;
+    char hdr[FRAME_FANOUT_HDR_LEN];
+    size_t hdr_len;
+    size_t offset;              // header and body bytes written
+} frame_fanout_slot_t;
+
+typedef struct {
+    frame_fanout_slot_t slots[FRAME_FANOUT_MAX];
+    const uint8_t *body;
+    size_t body_len;
+    uint32_t started_ms;
+    uint32_t timeout_ms;
+    uint8_t sending;            // slots still FRAME_FANOUT_SENDING
+    uint64_t bytes;             // written for this frame, headers included
+} frame_fanout_t;
+
+// Start on a frame; every slot goes back to idle. body must stay valid until
+// no slot is sending any more.
+void frame_fanout_begin(frame_fanout_t *f, const uint8_t *body, size_t body_len, uint32_t now_ms,
+                        uint32_t timeout_ms);
+
+// Have a slot take part, with hdr written before the body. Returns false for
+// a slot out of range or a header longer than FRAME_FANOUT_HDR_LEN.
+bool frame_fanout_add(frame_fanout_t *f, int slot, const char *hdr, size_t hdr_len);
+
+// Bytes the slot still has to write, and a pointer to them: the rest of its
+// header, then the rest of the body. 0 unless the slot is sending.
+size_t frame_fanout_pending(const frame_fanout_t *f, int slot, const uint8_t **data);
+
+// Record a write of n bytes; the slot is done after its last byte
+void frame_fanout_wrote(frame_fanout_t *f, int slot, size_t n);
+
+// A write to the slot failed
+void frame_fanout_fail(frame_fanout_t *f, int slot);
+
+// Fail every slot still sending once the deadline has passed. Returns the
+// number failed.
+int frame_fanout_expire(frame_fanout_t *f, uint32_t now_ms);
+
+// Milliseconds left until the deadline, 0 once it has passed
+uint32_t frame_fanout_remaining(const frame_fanout_t *f, uint32_t now_ms);
+
+static inline frame_fanout_state_t frame_fanout_state(const frame_fanout_t *f, int slot)
+{
+    return f->slots[slot].state;
+}
+
+#endif // FRAME_FANOUT_H
@@ -0,0 +1,87 @@
+#include "frame_pool.h"
+#include <string.h>
+
+bool frame_pool_init(frame_pool_t *pool, void *memory, size_t slab_size, uint32_t slab_count)
+{
+    if (pool == NULL || memory == NULL || slab_size == 0 ||
+        slab_count == 0 || slab_count > FRAME_POOL_MAX_SLABS) {
+        return false;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->slab_size = slab_size;
+    pool->slab_count = slab_count;
+
+    for (uint32_t i = 0; i < slab_count; i++) {
+        frame_t *frame = &pool->frames[i];
+        frame->pool = pool;
+        frame->slab = (uint8_t *)memory + i * slab_size;
+        frame->data = frame->slab;
+        frame->index = i;
+        atomic_init(&frame->refcount, 0);
+    }
+
+    uint32_t mask = slab_count == 32 ? 0xFFFFFFFFu : ((1u << slab_count) - 1);
+    atomic_init(&pool->free_mask, mask);
+    atomic_init(&pool->in_use, 0);
+    atomic_init(&pool->high_water, 0);
+    atomic_init(&pool->alloc_failures, 0);
+    return true;
+}
+
+frame_t *frame_pool_alloc(frame_pool_t *pool)
+{
+    unsigned int mask = atomic_load_explicit(&pool->free_mask, memory_order_relaxed);
+
+    while (mask != 0) {
+        uint32_t index = (uint32_t)__builtin_ctz(mask);
+        unsigned int desired = mask & ~(1u << index);
+        if (atomic_compare_exchange_weak_explicit(&pool->free_mask, &mask, desired,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            frame_t *frame = &pool->frames[index];
+            atomic_store_explicit(&frame->refcount, 1, memory_order_relaxed);
+            frame->len = 0;
+            frame->seq = 0;
+
+            unsigned int in_use = atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed) + 1;
+            unsigned int high = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+            while (in_use > high &&
+                   !atomic_compare_exchange_weak_explicit(&pool->high_water, &high, in_use,
+                                                          memory_order_relaxed, memory_order_relaxed)) {
+            }
+            return frame;
+        }
+        // mask was reloaded by the failed CAS
+    }
+
+    atomic_fetch_add_explicit(&pool->alloc_failures, 1, memory_order_relaxed);
+    return NULL;
+}
+
+frame_t *frame_ref(frame_t *frame)
+{
+    atomic_fetch_add_explicit(&frame->refcount, 1, memory_order_relaxed);
+    return frame;
+}
+
+void frame_unref(frame_t *frame)
+{
+    if (frame == NULL) {
+        return;
+    }
+
+    if (atomic_fetch_sub_explicit(&frame->refcount, 1, memory_order_acq_rel) == 1) {
+        frame_pool_t *pool = frame->pool;
+        atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+        atomic_fetch_or_explicit(&pool->free_mask, 1u << frame->index, memory_order_release);
+    }
+}
+
+void frame_pool_get_stats(frame_pool_t *pool, frame_pool_stats_t *stats)
+{
+    stats->slab_count = pool->slab_count;
+    stats->slab_size = (uint32_t)pool->slab_size;
+    stats->in_use = atomic_load(&pool->in_use);
+    stats->high_water = atomic_load(&pool->high_water);
+    stats->alloc_failures = atomic_load(&pool->alloc_failures);
+}
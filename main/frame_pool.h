@@ -0,0 +1,78 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size slab pool of refcounted, immutable frames.
+//
+// The capture task allocates a slab, copies the driver buffer into it once
+// and publishes it; every consumer (stream senders, /capture, ...) takes its
+// own reference and the slab returns to the pool when the last one is
+// dropped. Allocation and release are lock-free (a CAS on a free bitmap and
+// an atomic refcount), so the pool itself can be stress-tested on any host.
+// The slab memory is supplied by the caller (PSRAM on the device).
+
+#define FRAME_POOL_MAX_SLABS 32
+
+typedef struct frame_pool frame_pool_t;
+
+typedef struct {
+    // Read-only for consumers once the frame has been published
+    const uint8_t *data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint8_t format;
+    int64_t timestamp_us;
+    uint32_t seq;
+    bool unchanged;     // near-identical to the last changed frame
+
+    // Private
+    frame_pool_t *pool;
+    uint8_t *slab;
+    uint32_t index;
+    atomic_uint refcount;
+} frame_t;
+
+struct frame_pool {
+    frame_t frames[FRAME_POOL_MAX_SLABS];
+    size_t slab_size;
+    uint32_t slab_count;
+    atomic_uint free_mask;
+    atomic_uint in_use;
+    atomic_uint high_water;
+    atomic_uint alloc_failures;
+};
+
+typedef struct {
+    uint32_t slab_count;
+    uint32_t slab_size;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t alloc_failures;
+} frame_pool_stats_t;
+
+// Carve `memory` (at least slab_size * slab_count bytes) into slabs
+bool frame_pool_init(frame_pool_t *pool, void *memory, size_t slab_size, uint32_t slab_count);
+
+// Take a free slab with refcount 1, or NULL if the pool is exhausted
+frame_t *frame_pool_alloc(frame_pool_t *pool);
+
+// Writable view of a freshly allocated frame, for the producer only
+static inline uint8_t *frame_pool_slab(frame_t *frame)
+{
+    return frame->slab;
+}
+
+// Add a reference; returns the same frame for convenience
+frame_t *frame_ref(frame_t *frame);
+
+// Drop a reference; the slab is recycled when the count reaches zero
+void frame_unref(frame_t *frame);
+
+void frame_pool_get_stats(frame_pool_t *pool, frame_pool_stats_t *stats);
+
+#endif // FRAME_POOL_H
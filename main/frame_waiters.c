@@ -0,0 +1,95 @@
+#include "frame_waiters.h"
+#include <string.h>
+
+void frame_waiters_init(frame_waiters_t *w, uint8_t capacity)
+{
+    memset(w, 0, sizeof(*w));
+    if (capacity < 1) {
+        capacity = 1;
+    } else if (capacity > FRAME_WAITERS_MAX) {
+        capacity = FRAME_WAITERS_MAX;
+    }
+    w->capacity = capacity;
+}
+
+bool frame_waiters_add(frame_waiters_t *w, void *ctx, uint32_t after_seq, uint32_t now_ms, uint32_t timeout_ms)
+{
+    if (w->count >= w->capacity) {
+        w->stats.rejected++;
+        return false;
+    }
+
+    frame_waiter_t *slot = &w->slots[w->count++];
+    slot->ctx = ctx;
+    slot->after_seq = after_seq;
+    slot->parked_ms = now_ms;
+    slot->deadline_ms = now_ms + timeout_ms;
+    w->stats.parked++;
+    return true;
+}
+
+// Order does not matter, so the last slot fills the hole
+static void *frame_waiters_remove(frame_waiters_t *w, int i)
+{
+    void *ctx = w->slots[i].ctx;
+    w->slots[i] = w->slots[--w->count];
+    return ctx;
+}
+
+frame_wait_result_t frame_waiters_pop(frame_waiters_t *w, uint32_t latest_seq, uint32_t now_ms, void **ctx)
+{
+    for (int i = 0; i < w->count; i++) {
+        if (latest_seq > w->slots[i].after_seq) {
+            uint32_t waited = now_ms - w->slots[i].parked_ms;
+            if (waited > w->stats.max_wait_ms) {
+                w->stats.max_wait_ms = waited;
+            }
+            w->stats.delivered++;
+            *ctx = frame_waiters_remove(w, i);
+            return FRAME_WAIT_READY;
+        }
+    }
+    for (int i = 0; i < w->count; i++) {
+        if ((int32_t)(now_ms - w->slots[i].deadline_ms) >= 0) {
+            w->stats.timed_out++;
+            *ctx = frame_waiters_remove(w, i);
+            return FRAME_WAIT_TIMEOUT;
+        }
+    }
+    return FRAME_WAIT_NONE;
+}
+
+bool frame_waiters_drop(frame_waiters_t *w, void **ctx)
+{
+    if (w->count == 0) {
+        return false;
+    }
+    *ctx = frame_waiters_remove(w, w->count - 1);
+    return true;
+}
+
+uint32_t frame_waiters_min_after(const frame_waiters_t *w)
+{
+    uint32_t min = UINT32_MAX;
+    for (int i = 0; i < w->count; i++) {
+        if (w->slots[i].after_seq < min) {
+            min = w->slots[i].after_seq;
+        }
+    }
+    return min;
+}
+
+uint32_t frame_waiters_next_timeout(const frame_waiters_t *w, uint32_t now_ms)
+{
+    uint32_t next = UINT32_MAX;
+    for (int i = 0; i < w->count; i++) {
+        int32_t left = (int32_t)(w->slots[i].deadline_ms - now_ms);
+        if (left <= 0) {
+            return 0;
+        }
+        if ((uint32_t)left < next) {
+            next = (uint32_t)left;
+        }
+    }
+    return next;
+}
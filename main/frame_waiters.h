@@ -0,0 +1,70 @@
+#ifndef FRAME_WAITERS_H
+#define FRAME_WAITERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Parked long-poll requests waiting for a frame newer than the one they have.
+//
+// /capture?after=N parks its request here when frame N is still the latest;
+// one task then waits for the next publish and answers every waiter whose
+// sequence number it passes, or lets it time out. The table is small and
+// scanned linearly, since it never holds more requests than there are
+// sockets. ctx is opaque (the async httpd request on the device). No ESP-IDF
+// dependencies.
+
+#ifndef FRAME_WAITERS_MAX
+#define FRAME_WAITERS_MAX 8
+#endif
+
+typedef enum {
+    FRAME_WAIT_NONE,            // nobody is due
+    FRAME_WAIT_READY,           // a frame newer than after_seq exists
+    FRAME_WAIT_TIMEOUT
+} frame_wait_result_t;
+
+typedef struct {
+    void *ctx;
+    uint32_t after_seq;
+    uint32_t parked_ms;
+    uint32_t deadline_ms;
+} frame_waiter_t;
+
+typedef struct {
+    uint32_t parked;
+    uint32_t delivered;
+    uint32_t timed_out;
+    uint32_t rejected;          // the table was full
+    uint32_t max_wait_ms;       // longest park before a delivery
+} frame_waiters_stats_t;
+
+typedef struct {
+    frame_waiter_t slots[FRAME_WAITERS_MAX];
+    uint8_t capacity;
+    uint8_t count;
+    frame_waiters_stats_t stats;
+} frame_waiters_t;
+
+// capacity is clamped to 1..FRAME_WAITERS_MAX
+void frame_waiters_init(frame_waiters_t *w, uint8_t capacity);
+
+// Returns false (and counts a rejection) when the table is full
+bool frame_waiters_add(frame_waiters_t *w, void *ctx, uint32_t after_seq, uint32_t now_ms, uint32_t timeout_ms);
+
+// Remove one waiter that is due: one that latest_seq satisfies first, then
+// one whose deadline passed. Call until it returns FRAME_WAIT_NONE.
+frame_wait_result_t frame_waiters_pop(frame_waiters_t *w, uint32_t latest_seq, uint32_t now_ms, void **ctx);
+
+// Remove any waiter, without counting it as delivered or timed out, to
+// refuse it on shutdown. Returns false when empty.
+bool frame_waiters_drop(frame_waiters_t *w, void **ctx);
+
+// Oldest sequence number any waiter has; a frame newer than this is due to
+// someone. UINT32_MAX when empty.
+uint32_t frame_waiters_min_after(const frame_waiters_t *w);
+
+// Milliseconds until the earliest deadline, 0 if one passed, UINT32_MAX when
+// empty
+uint32_t frame_waiters_next_timeout(const frame_waiters_t *w, uint32_t now_ms);
+
+#endif // FRAME_WAITERS_H
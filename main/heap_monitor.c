@@ -0,0 +1,101 @@
+#include "heap_monitor.h"
+#include "http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "heap_monitor";
+
+static const uint32_t s_caps[HEAP_MONITOR_CAPS_COUNT] = {
+    [HEAP_MONITOR_INTERNAL] = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    [HEAP_MONITOR_DMA] = MALLOC_CAP_DMA,
+    [HEAP_MONITOR_PSRAM] = MALLOC_CAP_SPIRAM,
+};
+
+static const char *const s_caps_names[HEAP_MONITOR_CAPS_COUNT] = {
+    [HEAP_MONITOR_INTERNAL] = "internal",
+    [HEAP_MONITOR_DMA] = "dma",
+    [HEAP_MONITOR_PSRAM] = "psram",
+};
+
+// Written from the report timer and the httpd task; a torn update only
+// affects a statistic
+static uint32_t s_min_largest[HEAP_MONITOR_CAPS_COUNT];
+static esp_timer_handle_t s_report_timer;
+
+const char *heap_monitor_caps_name(heap_monitor_caps_t caps)
+{
+    return caps < HEAP_MONITOR_CAPS_COUNT ? s_caps_names[caps] : "unknown";
+}
+
+void heap_monitor_sample(heap_monitor_caps_t caps, heap_monitor_sample_t *sample)
+{
+    multi_heap_info_t info;
+
+    heap_caps_get_info(&info, s_caps[caps]);
+    sample->total_bytes = heap_caps_get_total_size(s_caps[caps]);
+    sample->free_bytes = info.total_free_bytes;
+    sample->largest_free_block = info.largest_free_block;
+    sample->min_free_bytes = info.minimum_free_bytes;
+    sample->free_blocks = info.free_blocks;
+    sample->allocated_blocks = info.allocated_blocks;
+    sample->fragmentation_permille = info.total_free_bytes == 0 ? 0 :
+        1000 - (uint16_t)((uint64_t)info.largest_free_block * 1000 / info.total_free_bytes);
+
+    if (s_min_largest[caps] == 0 || info.largest_free_block < s_min_largest[caps]) {
+        s_min_largest[caps] = info.largest_free_block;
+    }
+    sample->min_largest_free_block = s_min_largest[caps];
+}
+
+static void heap_report(void *arg)
+{
+    for (int caps = 0; caps < HEAP_MONITOR_CAPS_COUNT; caps++) {
+        heap_monitor_sample_t sample;
+        heap_monitor_sample(caps, &sample);
+        if (sample.total_bytes == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s: free %lu, largest %lu (low %lu), frag %u.%u%%, %lu free blocks",
+                 s_caps_names[caps], (unsigned long)sample.free_bytes,
+                 (unsigned long)sample.largest_free_block, (unsigned long)sample.min_largest_free_block,
+                 sample.fragmentation_permille / 10, sample.fragmentation_permille % 10,
+                 (unsigned long)sample.free_blocks);
+    }
+
+    session_arena_stats_t arenas;
+    if (http_server_get_arena_stats(&arenas)) {
+        ESP_LOGI(TAG, "session arenas: %lu/%lu in use (high %lu), peak %lu of %lu bytes, %lu spills",
+                 (unsigned long)arenas.in_use, (unsigned long)arenas.count, (unsigned long)arenas.high_water,
+                 (unsigned long)arenas.peak_used, (unsigned long)arenas.block_size,
+                 (unsigned long)arenas.spills);
+    }
+}
+
+esp_err_t heap_monitor_init(void)
+{
+    heap_monitor_sample_t sample;
+
+    // Baseline for the since-start minimum
+    for (int caps = 0; caps < HEAP_MONITOR_CAPS_COUNT; caps++) {
+        heap_monitor_sample(caps, &sample);
+    }
+
+    if (CONFIG_APP_HEAP_REPORT_INTERVAL_S == 0 || s_report_timer != NULL) {
+        return ESP_OK;
+    }
+
+    const esp_timer_create_args_t args = {
+        .callback = heap_report,
+        .name = "heap_report",
+    };
+    esp_err_t ret = esp_timer_create(&args, &s_report_timer);
+    if (ret == ESP_OK) {
+        ret = esp_timer_start_periodic(s_report_timer, (uint64_t)CONFIG_APP_HEAP_REPORT_INTERVAL_S * 1000000);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start heap report timer: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
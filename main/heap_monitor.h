@@ -0,0 +1,41 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Heap fragmentation monitor, see "ESP32S3Cam Memory" in menuconfig.
+//
+// Samples free bytes and the largest free block per memory capability. A
+// falling largest block with steady free bytes is fragmentation: the camera
+// driver and WiFi need contiguous internal (DMA-capable) RAM, so that is the
+// number to watch over long uptimes.
+
+typedef enum {
+    HEAP_MONITOR_INTERNAL,
+    HEAP_MONITOR_DMA,
+    HEAP_MONITOR_PSRAM,
+    HEAP_MONITOR_CAPS_COUNT
+} heap_monitor_caps_t;
+
+typedef struct {
+    uint32_t total_bytes;
+    uint32_t free_bytes;
+    uint32_t largest_free_block;
+    uint32_t min_free_bytes;            // since boot
+    uint32_t min_largest_free_block;    // since the monitor started
+    uint32_t free_blocks;
+    uint32_t allocated_blocks;
+    uint16_t fragmentation_permille;    // 1000 - 1000 * largest / free
+} heap_monitor_sample_t;
+
+// Start the periodic report (CONFIG_APP_HEAP_REPORT_INTERVAL_S, 0 = never)
+esp_err_t heap_monitor_init(void);
+
+// Sample one capability now; also updates the since-start minimum
+void heap_monitor_sample(heap_monitor_caps_t caps, heap_monitor_sample_t *sample);
+
+// "internal", "dma" or "psram"
+const char *heap_monitor_caps_name(heap_monitor_caps_t caps);
+
+#endif // HEAP_MONITOR_H
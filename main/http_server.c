@@ -1,6 +1,9 @@
 #include "http_server.h"
+#include "web_assets.h"
+#include "task_layout.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
+#include "esp_heap_caps.h"
 #include <string.h>
 
 static const char *TAG = "http_server";
@@ -9,7 +12,50 @@ static volatile http_server_status_t s_server_status = HTTP_SERVER_STOPPED;
 
 #define HTTP_SERVER_PORT 80
 #define HTTP_SERVER_MAX_URI_LEN 512
-#define HTTP_SERVER_MAX_HANDLERS 10
+// API endpoints, with room for a few more; every web asset gets a handler
+// on top, so adding a file to main/web/ cannot run the table out
+#define HTTP_SERVER_MAX_ENDPOINTS 16
+#define HTTP_SESSION_ARENA_COUNT CONFIG_APP_SESSION_ARENAS
+#define HTTP_SESSION_ARENA_SIZE (CONFIG_APP_SESSION_ARENA_KB * 1024)
+
+// Scratch memory for request handlers. Allocated on the first start and kept
+// across restarts, so a WiFi reconnect does not free and re-allocate it.
+static session_arena_pool_t s_arenas;
+static void *s_arena_memory = NULL;
+
+// Spills are rare and short-lived; keep them out of internal RAM if possible
+static void *arena_spill_alloc(size_t size)
+{
+    void *ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (ptr == NULL)
+    {
+        ptr = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return ptr;
+}
+
+static esp_err_t arenas_init(void)
+{
+    if (s_arena_memory != NULL)
+    {
+        return ESP_OK;
+    }
+
+    s_arena_memory = heap_caps_malloc(HTTP_SESSION_ARENA_COUNT * HTTP_SESSION_ARENA_SIZE,
+                                      MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (s_arena_memory == NULL ||
+        !session_arena_pool_init(&s_arenas, s_arena_memory, HTTP_SESSION_ARENA_SIZE, HTTP_SESSION_ARENA_COUNT,
+                                 arena_spill_alloc, heap_caps_free))
+    {
+        ESP_LOGE(TAG, "Failed to allocate %d session arenas", HTTP_SESSION_ARENA_COUNT);
+        heap_caps_free(s_arena_memory);
+        s_arena_memory = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "%d session arenas of %d bytes", HTTP_SESSION_ARENA_COUNT, HTTP_SESSION_ARENA_SIZE);
+    return ESP_OK;
+}
 
 esp_err_t http_server_init(void)
 {
@@ -22,15 +68,33 @@ esp_err_t http_server_init(void)
     s_server_status = HTTP_SERVER_STARTING;
     ESP_LOGI(TAG, "Starting HTTP server...");
 
+    // Before the server opens its first session
+    esp_err_t ret = arenas_init();
+    if (ret != ESP_OK)
+    {
+        s_server_status = HTTP_SERVER_ERROR;
+        return ret;
+    }
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = HTTP_SERVER_PORT;
-    config.max_uri_handlers = HTTP_SERVER_MAX_HANDLERS;
+    config.max_uri_handlers = HTTP_SERVER_MAX_ENDPOINTS + web_assets_count;
     config.max_resp_headers = 8;
     config.max_open_sockets = 7;
-    config.stack_size = 8192;
-    config.task_priority = 5;
-
-    esp_err_t ret = httpd_start(&s_server, &config);
+    // Polling clients keep their connection between requests. When every
+    // socket is taken, a new connection closes the least recently used one
+    // rather than being refused, and TCP keep-alive finds pollers that went
+    // away without closing (about 20 s).
+    config.lru_purge_enable = true;
+    config.keep_alive_enable = true;
+    config.keep_alive_idle = 5;
+    config.keep_alive_interval = 5;
+    config.keep_alive_count = 3;
+    config.stack_size = HTTPD_TASK_STACK_SIZE;
+    config.task_priority = HTTPD_TASK_PRIORITY;
+    config.core_id = HTTPD_TASK_CORE;
+
+    ret = httpd_start(&s_server, &config);
     if (ret != ESP_OK) 
     {
         ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(ret));
@@ -135,3 +199,27 @@ esp_err_t http_server_unregister_handler(const char *uri, httpd_method_t method)
     
     return ret;
 }
+
+session_arena_t *http_server_arena_open(void)
+{
+    if (s_arena_memory == NULL)
+    {
+        return NULL;
+    }
+    return session_arena_open(&s_arenas);
+}
+
+void http_server_arena_close(session_arena_t *arena)
+{
+    session_arena_close(arena);
+}
+
+bool http_server_get_arena_stats(session_arena_stats_t *stats)
+{
+    if (s_arena_memory == NULL)
+    {
+        return false;
+    }
+    session_arena_get_stats(&s_arenas, stats);
+    return true;
+}
@@ -3,6 +3,7 @@
 
 #include "esp_http_server.h"
 #include "esp_err.h"
+#include "session_arena.h"
 
 // HTTP Server status
 typedef enum {
@@ -30,4 +31,13 @@ esp_err_t http_server_register_handler(const httpd_uri_t *uri_handler);
 // Unregister a URI handler
 esp_err_t http_server_unregister_handler(const char *uri, httpd_method_t method);
 
+// Scratch memory for one request, from the pool allocated at the first
+// http_server_init. NULL when the pool is not set up or every arena is in
+// use. Close it once the response has been sent.
+session_arena_t *http_server_arena_open(void);
+void http_server_arena_close(session_arena_t *arena);
+
+// Returns false before the first http_server_init
+bool http_server_get_arena_stats(session_arena_stats_t *stats);
+
 #endif // HTTP_SERVER_H
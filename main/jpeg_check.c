@@ -0,0 +1,169 @@
+#include "jpeg_check.h"
+#include <string.h>
+
+#define JPEG_MARKER_DHT 0xC4
+#define JPEG_MARKER_RST0 0xD0
+#define JPEG_MARKER_RST7 0xD7
+#define JPEG_MARKER_SOI 0xD8
+#define JPEG_MARKER_EOI 0xD9
+#define JPEG_MARKER_SOS 0xDA
+#define JPEG_MARKER_DQT 0xDB
+#define JPEG_MARKER_TEM 0x01
+
+static const char *const s_result_names[JPEG_CHECK_COUNT] = {
+    [JPEG_CHECK_OK] = "ok",
+    [JPEG_CHECK_TOO_SHORT] = "too_short",
+    [JPEG_CHECK_NO_SOI] = "no_soi",
+    [JPEG_CHECK_NO_EOI] = "no_eoi",
+    [JPEG_CHECK_BAD_SEGMENT] = "bad_segment",
+    [JPEG_CHECK_NO_FRAME] = "no_frame",
+    [JPEG_CHECK_BAD_ENTROPY] = "bad_entropy",
+};
+
+const char *jpeg_check_result_name(jpeg_check_result_t result)
+{
+    return result < JPEG_CHECK_COUNT ? s_result_names[result] : "unknown";
+}
+
+static bool jpeg_is_sof(uint8_t marker)
+{
+    return marker >= 0xC0 && marker <= 0xCF && marker != JPEG_MARKER_DHT && marker != 0xC8 && marker != 0xCC;
+}
+
+// Entropy data may only contain stuffed 0xFF 0x00, fill bytes and RSTn
+// markers counting up modulo 8. Any other marker ends the scan; *next points
+// at it, or at `end` (the EOI).
+static jpeg_check_result_t jpeg_check_entropy(const uint8_t *p, const uint8_t *end, const uint8_t **next)
+{
+    uint8_t rst = 0;
+
+    while (p < end) {
+        const uint8_t *ff = memchr(p, 0xFF, end - p);
+        if (ff == NULL) {
+            break;
+        }
+
+        // ff[1] is at most the EOI's own 0xFF
+        uint8_t marker = ff[1];
+        if (marker == 0x00 || marker == 0xFF) {
+            p = ff + (marker == 0x00 ? 2 : 1);
+        } else if (marker >= JPEG_MARKER_RST0 && marker <= JPEG_MARKER_RST7) {
+            if (marker != JPEG_MARKER_RST0 + rst) {
+                return JPEG_CHECK_BAD_ENTROPY;
+            }
+            rst = (rst + 1) & 7;
+            p = ff + 2;
+        } else if (marker == JPEG_MARKER_SOI || marker == JPEG_MARKER_EOI || marker == JPEG_MARKER_TEM) {
+            // An EOI before the end is a truncated frame with another one
+            // behind it
+            return JPEG_CHECK_BAD_ENTROPY;
+        } else {
+            *next = ff;
+            return JPEG_CHECK_OK;
+        }
+    }
+
+    *next = end;
+    return JPEG_CHECK_OK;
+}
+
+// Walk the segments between SOI and `end`, the final EOI
+static jpeg_check_result_t jpeg_check_segments(const uint8_t *p, const uint8_t *end)
+{
+    bool sof = false;
+    bool dqt = false;
+    int scans = 0;
+
+    while (p < end) {
+        if (end - p < 4 || p[0] != 0xFF) {
+            return JPEG_CHECK_BAD_SEGMENT;
+        }
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            p++;
+            continue;
+        }
+        if (marker == JPEG_MARKER_TEM || marker == JPEG_MARKER_SOI || marker == JPEG_MARKER_EOI ||
+            (marker >= JPEG_MARKER_RST0 && marker <= JPEG_MARKER_RST7)) {
+            return JPEG_CHECK_BAD_SEGMENT;
+        }
+
+        const uint8_t *seg = p + 2;
+        size_t seg_len = ((size_t)seg[0] << 8) | seg[1];
+        if (seg_len < 2 || seg_len > (size_t)(end - seg)) {
+            return JPEG_CHECK_BAD_SEGMENT;
+        }
+
+        if (jpeg_is_sof(marker)) {
+            // Length, precision, height, width, component count, 3 bytes each
+            if (seg_len < 8 || seg[7] == 0 || seg_len != 8 + 3 * (size_t)seg[7] || (seg[5] == 0 && seg[6] == 0)) {
+                return JPEG_CHECK_BAD_SEGMENT;
+            }
+            sof = true;
+        } else if (marker == JPEG_MARKER_DQT) {
+            dqt = true;
+        } else if (marker == JPEG_MARKER_SOS) {
+            if (!sof || !dqt) {
+                return JPEG_CHECK_NO_FRAME;
+            }
+            uint8_t ns = seg[2];
+            if (ns == 0 || ns > 4 || seg_len != 6 + 2 * (size_t)ns) {
+                return JPEG_CHECK_BAD_SEGMENT;
+            }
+            jpeg_check_result_t result = jpeg_check_entropy(seg + seg_len, end, &p);
+            if (result != JPEG_CHECK_OK) {
+                return result;
+            }
+            scans++;
+            continue;
+        }
+        p = seg + seg_len;
+    }
+
+    return scans > 0 ? JPEG_CHECK_OK : JPEG_CHECK_NO_FRAME;
+}
+
+jpeg_check_result_t jpeg_check(const uint8_t *jpeg, size_t len, bool walk_segments)
+{
+    if (jpeg == NULL || len < JPEG_CHECK_MIN_LEN) {
+        return JPEG_CHECK_TOO_SHORT;
+    }
+    if (jpeg[0] != 0xFF || jpeg[1] != JPEG_MARKER_SOI) {
+        return JPEG_CHECK_NO_SOI;
+    }
+    // The camera driver trims the frame right after the last EOI it finds
+    if (jpeg[len - 2] != 0xFF || jpeg[len - 1] != JPEG_MARKER_EOI) {
+        return JPEG_CHECK_NO_EOI;
+    }
+    if (!walk_segments) {
+        return JPEG_CHECK_OK;
+    }
+    return jpeg_check_segments(jpeg + 2, jpeg + len - 2);
+}
+
+void jpeg_check_rate_init(jpeg_check_rate_t *rate, uint16_t window, uint16_t permille)
+{
+    memset(rate, 0, sizeof(*rate));
+    rate->window = window;
+    rate->permille = permille;
+}
+
+bool jpeg_check_rate_add(jpeg_check_rate_t *rate, bool bad)
+{
+    if (rate->window == 0) {
+        return false;
+    }
+
+    rate->frames++;
+    if (bad) {
+        rate->bad++;
+    }
+    if (rate->frames < rate->window) {
+        return false;
+    }
+
+    rate->last_permille = (uint16_t)((uint32_t)rate->bad * 1000 / rate->frames);
+    rate->frames = 0;
+    rate->bad = 0;
+    return rate->last_permille > rate->permille;
+}
@@ -0,0 +1,50 @@
+#ifndef JPEG_CHECK_H
+#define JPEG_CHECK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fast integrity check for JPEG frames from the sensor.
+//
+// At high XCLK rates a marginal DVP link corrupts or truncates frames: a
+// dropped PCLK edge shifts every following byte, so the entropy data grows
+// markers that cannot be there. The basic check only looks at SOI, EOI and
+// the length. The segment walk also validates every header segment length,
+// requires a frame header and a scan, and scans the entropy data for
+// anything but stuffed bytes and RSTn markers in sequence. It is a memchr()
+// over the frame, with no Huffman decoding, and has no ESP-IDF dependencies.
+
+#define JPEG_CHECK_MIN_LEN 128 // smaller than the headers of any sensor frame
+
+typedef enum {
+    JPEG_CHECK_OK,
+    JPEG_CHECK_TOO_SHORT,
+    JPEG_CHECK_NO_SOI,
+    JPEG_CHECK_NO_EOI,          // truncated, or trailing garbage
+    JPEG_CHECK_BAD_SEGMENT,     // header segment length out of bounds
+    JPEG_CHECK_NO_FRAME,        // no SOF, DQT or SOS before the entropy data
+    JPEG_CHECK_BAD_ENTROPY,     // invalid marker or RSTn out of sequence
+    JPEG_CHECK_COUNT
+} jpeg_check_result_t;
+
+jpeg_check_result_t jpeg_check(const uint8_t *jpeg, size_t len, bool walk_segments);
+
+const char *jpeg_check_result_name(jpeg_check_result_t result);
+
+// Corruption rate over consecutive windows of frames
+typedef struct {
+    uint16_t window;            // frames per window
+    uint16_t permille;          // bad frames per mille that trip the window
+    uint16_t frames;
+    uint16_t bad;
+    uint16_t last_permille;     // of the last complete window
+} jpeg_check_rate_t;
+
+void jpeg_check_rate_init(jpeg_check_rate_t *rate, uint16_t window, uint16_t permille);
+
+// Count a frame. Returns true when it completes a window whose share of bad
+// frames is above the threshold.
+bool jpeg_check_rate_add(jpeg_check_rate_t *rate, bool bad);
+
+#endif // JPEG_CHECK_H
@@ -0,0 +1,457 @@
+#include "jpeg_dc.h"
+#include <string.h>
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_SOF1 0xC1
+#define JPEG_MARKER_DHT 0xC4
+#define JPEG_MARKER_SOI 0xD8
+#define JPEG_MARKER_EOI 0xD9
+#define JPEG_MARKER_SOS 0xDA
+#define JPEG_MARKER_DQT 0xDB
+#define JPEG_MARKER_DRI 0xDD
+
+// Zero bytes fed past the end of the entropy data before giving up
+#define JPEG_MAX_PAD_BYTES 4
+
+typedef struct {
+    uint8_t id;
+    uint8_t h;
+    uint8_t v;
+    uint8_t tq;
+    uint8_t td;
+    uint8_t ta;
+} jpeg_component_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t acc;       // bits are MSB-aligned
+    int bits;
+    int pad_bytes;
+    bool marker;        // stopped at a marker, p points at its 0xFF
+} jpeg_bits_t;
+
+static void bits_fill(jpeg_bits_t *br)
+{
+    while (br->bits <= 24) {
+        uint32_t byte = 0;
+        if (!br->marker && br->p < br->end) {
+            byte = *br->p;
+            if (byte == 0xFF) {
+                if (br->p + 1 < br->end && br->p[1] == 0x00) {
+                    br->p += 2;
+                } else {
+                    br->marker = true;
+                    byte = 0;
+                    br->pad_bytes++;
+                }
+            } else {
+                br->p++;
+            }
+        } else {
+            br->pad_bytes++;
+        }
+        br->acc |= byte << (24 - br->bits);
+        br->bits += 8;
+    }
+}
+
+static uint32_t bits_get(jpeg_bits_t *br, int n)
+{
+    if (n == 0) {
+        return 0;
+    }
+    bits_fill(br);
+    uint32_t v = br->acc >> (32 - n);
+    br->acc <<= n;
+    br->bits -= n;
+    return v;
+}
+
+static int32_t bits_extend(uint32_t v, int s)
+{
+    return v < (1u << (s - 1)) ? (int32_t)v - (int32_t)((1u << s) - 1) : (int32_t)v;
+}
+
+static int huff_decode(jpeg_bits_t *br, const jpeg_dc_huff_t *h)
+{
+    bits_fill(br);
+
+    uint32_t look = br->acc >> (32 - JPEG_DC_LOOKAHEAD_BITS);
+    int len = h->lookup_len[look];
+    if (len) {
+        br->acc <<= len;
+        br->bits -= len;
+        return h->lookup_sym[look];
+    }
+
+    for (len = JPEG_DC_LOOKAHEAD_BITS + 1; len <= 16; len++) {
+        int32_t code = br->acc >> (32 - len);
+        if (code <= h->maxcode[len]) {
+            br->acc <<= len;
+            br->bits -= len;
+            return h->huffval[h->valoffset[len] + code];
+        }
+    }
+    return -1;
+}
+
+// Build canonical decode tables (ITU T.81 annex C / F.2.2.3)
+static bool huff_build(jpeg_dc_huff_t *h, const uint8_t counts[16], const uint8_t *symbols)
+{
+    int32_t code = 0;
+    int k = 0;
+
+    memset(h->lookup_len, 0, sizeof(h->lookup_len));
+    for (int len = 1; len <= 16; len++) {
+        h->valoffset[len] = k - code;
+        for (int i = 0; i < counts[len - 1]; i++) {
+            if (len <= JPEG_DC_LOOKAHEAD_BITS) {
+                int shift = JPEG_DC_LOOKAHEAD_BITS - len;
+                for (int j = 0; j < (1 << shift); j++) {
+                    h->lookup_len[(code << shift) | j] = len;
+                    h->lookup_sym[(code << shift) | j] = symbols[k];
+                }
+            }
+            h->huffval[k] = symbols[k];
+            k++;
+            code++;
+        }
+        if (code > (1 << len)) {
+            return false;
+        }
+        h->maxcode[len] = counts[len - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+    h->maxcode[17] = INT32_MAX;
+    h->present = true;
+    return true;
+}
+
+static bool parse_dht(jpeg_dc_decoder_t *dec, const uint8_t *p, size_t len)
+{
+    while (len >= 17) {
+        uint8_t tc = p[0] >> 4;
+        uint8_t th = p[0] & 0x0F;
+        const uint8_t *counts = p + 1;
+        size_t total = 0;
+        for (int i = 0; i < 16; i++) {
+            total += counts[i];
+        }
+        if (tc > 1 || th >= JPEG_DC_MAX_TABLES || total > 256 || len < 17 + total) {
+            return false;
+        }
+        jpeg_dc_huff_t *h = tc == 0 ? &dec->dc[th] : &dec->ac[th];
+        if (!huff_build(h, counts, p + 17)) {
+            return false;
+        }
+        p += 17 + total;
+        len -= 17 + total;
+    }
+    return len == 0;
+}
+
+static bool parse_dqt(jpeg_dc_decoder_t *dec, const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        uint8_t pq = p[0] >> 4;
+        uint8_t tq = p[0] & 0x0F;
+        size_t size = pq ? 129 : 65;
+        if (tq >= JPEG_DC_MAX_TABLES || len < size) {
+            return false;
+        }
+        // The first entry in zigzag order quantizes the DC coefficient
+        dec->qt_dc[tq] = pq ? (p[1] << 8) | p[2] : p[1];
+        p += size;
+        len -= size;
+    }
+    return true;
+}
+
+static inline uint8_t dc_to_luma(int32_t dc, uint16_t q)
+{
+    int32_t v = ((dc * q) >> 3) + 128;
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Skip one block's AC coefficients
+static bool skip_ac(jpeg_bits_t *br, const jpeg_dc_huff_t *ac)
+{
+    for (int k = 1; k < 64;) {
+        int rs = huff_decode(br, ac);
+        if (rs < 0) {
+            return false;
+        }
+        int r = rs >> 4;
+        int s = rs & 0x0F;
+        if (s == 0) {
+            if (r != 15) {
+                break; // EOB
+            }
+            k += 16;
+        } else {
+            bits_get(br, s);
+            k += r + 1;
+        }
+    }
+    return true;
+}
+
+static bool restart(jpeg_bits_t *br)
+{
+    br->acc = 0;
+    br->bits = 0;
+    br->pad_bytes = 0;
+    br->marker = false;
+    // Normally the reader is stopped right at the RSTn marker
+    while (br->p + 1 < br->end) {
+        if (br->p[0] == 0xFF && br->p[1] >= 0xD0 && br->p[1] <= 0xD7) {
+            br->p += 2;
+            return true;
+        }
+        br->p++;
+    }
+    return false;
+}
+
+bool jpeg_dc_luma(jpeg_dc_decoder_t *dec, const uint8_t *jpeg, size_t len,
+                  uint8_t *out, size_t out_size, jpeg_dc_info_t *info)
+{
+    jpeg_component_t comps[JPEG_DC_MAX_COMPONENTS];
+    jpeg_component_t *scan[JPEG_DC_MAX_COMPONENTS];
+    int ncomps = 0;
+    int nscan = 0;
+    uint16_t restart_interval = 0;
+    const uint8_t *p = jpeg;
+    const uint8_t *end = jpeg + len;
+
+    memset(info, 0, sizeof(*info));
+    for (int i = 0; i < JPEG_DC_MAX_TABLES; i++) {
+        dec->dc[i].present = false;
+        dec->ac[i].present = false;
+        dec->qt_dc[i] = 0;
+    }
+
+    if (len < 4 || p[0] != 0xFF || p[1] != JPEG_MARKER_SOI) {
+        return false;
+    }
+    p += 2;
+
+    // Header segments up to and including SOS
+    while (true) {
+        if (end - p < 4 || p[0] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            p++; // fill byte
+            continue;
+        }
+        if (marker == JPEG_MARKER_EOI) {
+            return false;
+        }
+
+        size_t seg_len = (p[2] << 8) | p[3];
+        if (seg_len < 2 || (size_t)(end - p - 2) < seg_len) {
+            return false;
+        }
+        const uint8_t *seg = p + 4;
+        size_t body = seg_len - 2;
+        p += 2 + seg_len;
+
+        if (marker == JPEG_MARKER_SOF0 || marker == JPEG_MARKER_SOF1) {
+            if (body < 6 || seg[0] != 8) {
+                return false;
+            }
+            info->height = (seg[1] << 8) | seg[2];
+            info->width = (seg[3] << 8) | seg[4];
+            ncomps = seg[5];
+            if (ncomps < 1 || ncomps > JPEG_DC_MAX_COMPONENTS || body < 6 + 3 * (size_t)ncomps ||
+                info->width == 0 || info->height == 0) {
+                return false;
+            }
+            for (int i = 0; i < ncomps; i++) {
+                comps[i].id = seg[6 + 3 * i];
+                comps[i].h = seg[7 + 3 * i] >> 4;
+                comps[i].v = seg[7 + 3 * i] & 0x0F;
+                comps[i].tq = seg[8 + 3 * i];
+                if (comps[i].h < 1 || comps[i].h > 4 || comps[i].v < 1 || comps[i].v > 4 ||
+                    comps[i].tq >= JPEG_DC_MAX_TABLES) {
+                    return false;
+                }
+            }
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != JPEG_MARKER_DHT && marker != 0xC8 &&
+                   marker != 0xCC) {
+            return false; // progressive, lossless or arithmetic coded
+        } else if (marker == JPEG_MARKER_DHT) {
+            if (!parse_dht(dec, seg, body)) {
+                return false;
+            }
+        } else if (marker == JPEG_MARKER_DQT) {
+            if (!parse_dqt(dec, seg, body)) {
+                return false;
+            }
+        } else if (marker == JPEG_MARKER_DRI) {
+            if (body < 2) {
+                return false;
+            }
+            restart_interval = (seg[0] << 8) | seg[1];
+        } else if (marker == JPEG_MARKER_SOS) {
+            if (ncomps == 0 || body < 1) {
+                return false;
+            }
+            nscan = seg[0];
+            if (nscan < 1 || nscan > ncomps || body < 1 + 2 * (size_t)nscan + 3) {
+                return false;
+            }
+            for (int i = 0; i < nscan; i++) {
+                scan[i] = NULL;
+                for (int c = 0; c < ncomps; c++) {
+                    if (comps[c].id == seg[1 + 2 * i]) {
+                        scan[i] = &comps[c];
+                    }
+                }
+                if (scan[i] == NULL) {
+                    return false;
+                }
+                scan[i]->td = seg[2 + 2 * i] >> 4;
+                scan[i]->ta = seg[2 + 2 * i] & 0x0F;
+                if (scan[i]->td >= JPEG_DC_MAX_TABLES || scan[i]->ta >= JPEG_DC_MAX_TABLES ||
+                    !dec->dc[scan[i]->td].present || !dec->ac[scan[i]->ta].present) {
+                    return false;
+                }
+            }
+            break;
+        }
+    }
+
+    // Only the first scan is decoded, so it has to carry the luma component
+    jpeg_component_t *luma = &comps[0];
+    bool interleaved = nscan > 1;
+    if (scan[0] != luma && !interleaved) {
+        return false;
+    }
+
+    int hmax = 1;
+    int vmax = 1;
+    for (int i = 0; i < ncomps; i++) {
+        hmax = comps[i].h > hmax ? comps[i].h : hmax;
+        vmax = comps[i].v > vmax ? comps[i].v : vmax;
+    }
+
+    int luma_w = (info->width * luma->h + hmax - 1) / hmax;
+    int luma_h = (info->height * luma->v + vmax - 1) / vmax;
+    info->thumb_w = (luma_w + 7) / 8;
+    info->thumb_h = (luma_h + 7) / 8;
+    if ((size_t)info->thumb_w * info->thumb_h > out_size) {
+        return false;
+    }
+
+    int mcus_x;
+    int mcus_y;
+    if (interleaved) {
+        mcus_x = (info->width + 8 * hmax - 1) / (8 * hmax);
+        mcus_y = (info->height + 8 * vmax - 1) / (8 * vmax);
+    } else {
+        // A single-component scan has one block per MCU
+        mcus_x = info->thumb_w;
+        mcus_y = info->thumb_h;
+    }
+
+    jpeg_bits_t br = {
+        .p = p,
+        .end = end,
+    };
+    int32_t pred[JPEG_DC_MAX_COMPONENTS] = {0};
+    uint32_t mcus_left = restart_interval;
+
+    for (int my = 0; my < mcus_y; my++) {
+        for (int mx = 0; mx < mcus_x; mx++) {
+            if (restart_interval) {
+                if (mcus_left == 0) {
+                    if (!restart(&br)) {
+                        return false;
+                    }
+                    memset(pred, 0, sizeof(pred));
+                    mcus_left = restart_interval;
+                }
+                mcus_left--;
+            }
+
+            for (int i = 0; i < nscan; i++) {
+                jpeg_component_t *c = scan[i];
+                int bh = interleaved ? c->h : 1;
+                int bv = interleaved ? c->v : 1;
+                int ci = c - comps;
+
+                for (int v = 0; v < bv; v++) {
+                    for (int h = 0; h < bh; h++) {
+                        int s = huff_decode(&br, &dec->dc[c->td]);
+                        if (s < 0 || s > 11) {
+                            return false;
+                        }
+                        if (s) {
+                            pred[ci] += bits_extend(bits_get(&br, s), s);
+                        }
+                        if (!skip_ac(&br, &dec->ac[c->ta])) {
+                            return false;
+                        }
+
+                        if (c == luma) {
+                            int bx = mx * bh + h;
+                            int by = my * bv + v;
+                            if (bx < info->thumb_w && by < info->thumb_h) {
+                                out[by * info->thumb_w + bx] = dc_to_luma(pred[ci], dec->qt_dc[c->tq]);
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (br.pad_bytes > JPEG_MAX_PAD_BYTES) {
+                return false; // truncated
+            }
+        }
+    }
+
+    return true;
+}
+
+bool jpeg_dc_size(const uint8_t *jpeg, size_t len, uint16_t *width, uint16_t *height)
+{
+    const uint8_t *p = jpeg;
+    const uint8_t *end = jpeg + len;
+
+    if (len < 4 || p[0] != 0xFF || p[1] != JPEG_MARKER_SOI) {
+        return false;
+    }
+    p += 2;
+
+    while (end - p >= 4 && p[0] == 0xFF) {
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            p++;
+            continue;
+        }
+        if (marker == JPEG_MARKER_SOS || marker == JPEG_MARKER_EOI) {
+            break;
+        }
+
+        size_t seg_len = (p[2] << 8) | p[3];
+        if (seg_len < 2 || (size_t)(end - p - 2) < seg_len) {
+            break;
+        }
+        // Any SOFn; C4, C8 and CC share the range but are not frame headers
+        if (marker >= 0xC0 && marker <= 0xCF && marker != JPEG_MARKER_DHT && marker != 0xC8 &&
+            marker != 0xCC) {
+            if (seg_len < 7) {
+                break;
+            }
+            *height = (p[5] << 8) | p[6];
+            *width = (p[7] << 8) | p[8];
+            return true;
+        }
+        p += 2 + seg_len;
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef JPEG_DC_H
+#define JPEG_DC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Luma thumbnail straight from the entropy-coded data of a baseline JPEG.
+//
+// The DC coefficient of an 8x8 block is eight times the block's mean sample,
+// so decoding only the Huffman stream (AC coefficients are skipped, there is
+// no IDCT and no colour conversion) yields a 1/8-scale grayscale image. This
+// is a fraction of the cost of a full decode and has no ESP-IDF dependencies.
+//
+// Supported: baseline and extended sequential Huffman JPEGs (SOF0/SOF1) with
+// any chroma subsampling and restart intervals. Progressive and arithmetic
+// coded files are rejected.
+
+#define JPEG_DC_LOOKAHEAD_BITS 9
+#define JPEG_DC_MAX_TABLES 4
+#define JPEG_DC_MAX_COMPONENTS 4
+
+typedef struct {
+    int32_t maxcode[18];
+    int32_t valoffset[17];
+    uint8_t lookup_len[1 << JPEG_DC_LOOKAHEAD_BITS];
+    uint8_t lookup_sym[1 << JPEG_DC_LOOKAHEAD_BITS];
+    uint8_t huffval[256];
+    bool present;
+} jpeg_dc_huff_t;
+
+// Decoder tables, about 6 KB; keep one per task that decodes
+typedef struct {
+    jpeg_dc_huff_t dc[JPEG_DC_MAX_TABLES];
+    jpeg_dc_huff_t ac[JPEG_DC_MAX_TABLES];
+    uint16_t qt_dc[JPEG_DC_MAX_TABLES];
+} jpeg_dc_decoder_t;
+
+typedef struct {
+    uint16_t width;     // image size in pixels
+    uint16_t height;
+    uint16_t thumb_w;   // thumbnail size, one pixel per luma block
+    uint16_t thumb_h;
+} jpeg_dc_info_t;
+
+// Decode the luma DC thumbnail of `jpeg` into `out` (row-major, thumb_w *
+// thumb_h bytes). Returns false if the file is unsupported or corrupt, or if
+// the thumbnail does not fit in out_size; info is filled as far as parsed.
+bool jpeg_dc_luma(jpeg_dc_decoder_t *dec, const uint8_t *jpeg, size_t len,
+                  uint8_t *out, size_t out_size, jpeg_dc_info_t *info);
+
+// Image size from the frame header, without touching the entropy data
+bool jpeg_dc_size(const uint8_t *jpeg, size_t len, uint16_t *width, uint16_t *height);
+
+#endif // JPEG_DC_H
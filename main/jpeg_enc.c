@@ -0,0 +1,424 @@
+#include "jpeg_enc.h"
+#include <string.h>
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_DHT 0xC4
+#define JPEG_MARKER_SOI 0xD8
+#define JPEG_MARKER_EOI 0xD9
+#define JPEG_MARKER_SOS 0xDA
+#define JPEG_MARKER_DQT 0xDB
+#define JPEG_MARKER_APP0 0xE0
+
+// Worst case for one MCU of four blocks: every coefficient at its longest
+// code, every output byte stuffed
+#define JPEG_ENC_MCU_MAX_BYTES (4 * 64 * 27 / 8 * 2)
+
+static const uint8_t s_zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// ITU-T T.81 Annex K, natural order
+static const uint8_t s_qt_base[2][64] = {
+    {
+        16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+        14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+        18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+        49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+    },
+    {
+        17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    },
+};
+
+static const uint8_t s_dc_bits[2][16] = {
+    {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0},
+    {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0},
+};
+
+static const uint8_t s_dc_vals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t s_ac_bits[2][16] = {
+    {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d},
+    {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77},
+};
+
+static const uint8_t s_ac_vals[2][162] = {
+    {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    },
+    {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    },
+};
+
+// cos(k * pi / 16) * sqrt(2), k > 0, and 1 for k = 0
+static const float s_aan_scale[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f,
+};
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+    uint32_t acc;               // only the low `bits` bits are pending
+    int bits;
+} jpeg_bw_t;
+
+static void huff_build(jpeg_enc_huff_t *huff, const uint8_t *bits, const uint8_t *vals)
+{
+    uint16_t code = 0;
+    int k = 0;
+
+    memset(huff, 0, sizeof(*huff));
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            huff->code[vals[k]] = code++;
+            huff->size[vals[k]] = len;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+void jpeg_enc_set_quality(jpeg_enc_t *enc, int quality)
+{
+    if (quality < 1) {
+        quality = 1;
+    } else if (quality > 100) {
+        quality = 100;
+    }
+    if (quality == enc->quality) {
+        return;
+    }
+    enc->quality = quality;
+
+    // libjpeg's scaling, so quality numbers mean the same as elsewhere
+    int percent = quality < 50 ? 5000 / quality : 200 - 2 * quality;
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < 64; i++) {
+            int q = (s_qt_base[t][i] * percent + 50) / 100;
+            q = q < 1 ? 1 : (q > 255 ? 255 : q);
+            enc->scale[t][i] = 1.0f / (q * s_aan_scale[i / 8] * s_aan_scale[i % 8] * 8.0f);
+        }
+        for (int k = 0; k < 64; k++) {
+            int q = (s_qt_base[t][s_zigzag[k]] * percent + 50) / 100;
+            enc->qt[t][k] = q < 1 ? 1 : (q > 255 ? 255 : q);
+        }
+    }
+}
+
+void jpeg_enc_init(jpeg_enc_t *enc, int quality)
+{
+    memset(enc, 0, sizeof(*enc));
+    for (int t = 0; t < 2; t++) {
+        huff_build(&enc->dc[t], s_dc_bits[t], s_dc_vals);
+        huff_build(&enc->ac[t], s_ac_bits[t], s_ac_vals[t]);
+    }
+    jpeg_enc_set_quality(enc, quality);
+}
+
+// AAN forward DCT (Arai, Agui and Nakajima), in place; the output of
+// coefficient (u, v) is scaled by s_aan_scale[u] * s_aan_scale[v] * 8
+static void jpeg_fdct(float *d)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        // Rows, then columns
+        int step = pass == 0 ? 1 : 8;
+        int next = pass == 0 ? 8 : 1;
+        float *p = d;
+
+        for (int i = 0; i < 8; i++, p += next) {
+            float tmp0 = p[0 * step] + p[7 * step];
+            float tmp7 = p[0 * step] - p[7 * step];
+            float tmp1 = p[1 * step] + p[6 * step];
+            float tmp6 = p[1 * step] - p[6 * step];
+            float tmp2 = p[2 * step] + p[5 * step];
+            float tmp5 = p[2 * step] - p[5 * step];
+            float tmp3 = p[3 * step] + p[4 * step];
+            float tmp4 = p[3 * step] - p[4 * step];
+
+            float tmp10 = tmp0 + tmp3;
+            float tmp13 = tmp0 - tmp3;
+            float tmp11 = tmp1 + tmp2;
+            float tmp12 = tmp1 - tmp2;
+
+            p[0 * step] = tmp10 + tmp11;
+            p[4 * step] = tmp10 - tmp11;
+
+            float z1 = (tmp12 + tmp13) * 0.707106781f;
+            p[2 * step] = tmp13 + z1;
+            p[6 * step] = tmp13 - z1;
+
+            tmp10 = tmp4 + tmp5;
+            tmp11 = tmp5 + tmp6;
+            tmp12 = tmp6 + tmp7;
+
+            float z5 = (tmp10 - tmp12) * 0.382683433f;
+            float z2 = 0.541196100f * tmp10 + z5;
+            float z4 = 1.306562965f * tmp12 + z5;
+            float z3 = tmp11 * 0.707106781f;
+            float z11 = tmp7 + z3;
+            float z13 = tmp7 - z3;
+
+            p[5 * step] = z13 + z2;
+            p[3 * step] = z13 - z2;
+            p[1 * step] = z11 + z4;
+            p[7 * step] = z11 - z4;
+        }
+    }
+}
+
+static inline void bw_byte(jpeg_bw_t *bw, uint8_t byte)
+{
+    // Room is checked per MCU, see JPEG_ENC_MCU_MAX_BYTES
+    *bw->p++ = byte;
+    if (byte == 0xFF) {
+        *bw->p++ = 0x00;
+    }
+}
+
+static inline void bw_put(jpeg_bw_t *bw, uint32_t code, int size)
+{
+    bw->acc = (bw->acc << size) | code;
+    bw->bits += size;
+    while (bw->bits >= 8) {
+        bw->bits -= 8;
+        bw_byte(bw, (uint8_t)(bw->acc >> bw->bits));
+    }
+}
+
+static void bw_flush(jpeg_bw_t *bw)
+{
+    // Pad the last byte with 1 bits
+    if (bw->bits > 0) {
+        bw_put(bw, 0x7F, 7);
+    }
+    bw->bits = 0;
+}
+
+static inline int jpeg_category(int v)
+{
+    if (v < 0) {
+        v = -v;
+    }
+    return v == 0 ? 0 : 32 - __builtin_clz((unsigned)v);
+}
+
+static void encode_block(jpeg_bw_t *bw, float *block, const float *scale, const jpeg_enc_huff_t *dc,
+                         const jpeg_enc_huff_t *ac, int *pred)
+{
+    int coef[64];
+
+    jpeg_fdct(block);
+    for (int k = 0; k < 64; k++) {
+        int z = s_zigzag[k];
+        float v = block[z] * scale[z];
+        int q = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+        coef[k] = q > 1023 ? 1023 : (q < -1023 ? -1023 : q);
+    }
+
+    int diff = coef[0] - *pred;
+    *pred = coef[0];
+    int cat = jpeg_category(diff);
+    bw_put(bw, dc->code[cat], dc->size[cat]);
+    if (cat) {
+        bw_put(bw, (diff < 0 ? diff - 1 : diff) & ((1u << cat) - 1), cat);
+    }
+
+    int last = 63;
+    while (last > 0 && coef[last] == 0) {
+        last--;
+    }
+
+    int run = 0;
+    for (int k = 1; k <= last; k++) {
+        int v = coef[k];
+        if (v == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            bw_put(bw, ac->code[0xF0], ac->size[0xF0]);
+            run -= 16;
+        }
+        cat = jpeg_category(v);
+        int sym = (run << 4) | cat;
+        bw_put(bw, ac->code[sym], ac->size[sym]);
+        bw_put(bw, (v < 0 ? v - 1 : v) & ((1u << cat) - 1), cat);
+        run = 0;
+    }
+    if (last < 63) {
+        bw_put(bw, ac->code[0x00], ac->size[0x00]);
+    }
+}
+
+// Load an 8x8 block of one-byte samples `pitch` bytes apart, replicating the
+// last row and column past the image edge, level shifted
+static void load_block(float *block, const uint8_t *src, size_t stride, int pitch, int x0, int y0, int w, int h)
+{
+    for (int r = 0; r < 8; r++) {
+        int y = y0 + r < h ? y0 + r : h - 1;
+        const uint8_t *row = src + (size_t)y * stride;
+        if (x0 + 8 <= w) {
+            const uint8_t *s = row + (size_t)x0 * pitch;
+            for (int c = 0; c < 8; c++) {
+                block[r * 8 + c] = (float)s[c * pitch] - 128.0f;
+            }
+        } else {
+            for (int c = 0; c < 8; c++) {
+                int x = x0 + c < w ? x0 + c : w - 1;
+                block[r * 8 + c] = (float)row[(size_t)x * pitch] - 128.0f;
+            }
+        }
+    }
+}
+
+static uint8_t *put_marker(uint8_t *p, uint8_t marker, uint16_t len)
+{
+    *p++ = 0xFF;
+    *p++ = marker;
+    if (len) {
+        *p++ = len >> 8;
+        *p++ = len & 0xFF;
+    }
+    return p;
+}
+
+static uint8_t *put_dht(uint8_t *p, uint8_t class_id, const uint8_t *bits, const uint8_t *vals)
+{
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+        count += bits[i];
+    }
+    p = put_marker(p, JPEG_MARKER_DHT, 2 + 1 + 16 + count);
+    *p++ = class_id;
+    memcpy(p, bits, 16);
+    memcpy(p + 16, vals, count);
+    return p + 16 + count;
+}
+
+// Everything up to and including SOS; at most 619 bytes
+static uint8_t *put_headers(const jpeg_enc_t *enc, uint8_t *p, uint16_t width, uint16_t height, int comps)
+{
+    static const uint8_t jfif[14] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+
+    p = put_marker(p, JPEG_MARKER_SOI, 0);
+    p = put_marker(p, JPEG_MARKER_APP0, 2 + sizeof(jfif));
+    memcpy(p, jfif, sizeof(jfif));
+    p += sizeof(jfif);
+
+    int tables = comps > 1 ? 2 : 1;
+    p = put_marker(p, JPEG_MARKER_DQT, 2 + tables * 65);
+    for (int t = 0; t < tables; t++) {
+        *p++ = t;
+        memcpy(p, enc->qt[t], 64);
+        p += 64;
+    }
+
+    p = put_marker(p, JPEG_MARKER_SOF0, 8 + 3 * comps);
+    *p++ = 8;
+    *p++ = height >> 8;
+    *p++ = height & 0xFF;
+    *p++ = width >> 8;
+    *p++ = width & 0xFF;
+    *p++ = comps;
+    for (int c = 0; c < comps; c++) {
+        *p++ = c + 1;
+        *p++ = c == 0 ? (comps > 1 ? 0x21 : 0x11) : 0x11; // luma 2x1 for 4:2:2
+        *p++ = c == 0 ? 0 : 1;
+    }
+
+    for (int t = 0; t < tables; t++) {
+        p = put_dht(p, 0x00 | t, s_dc_bits[t], s_dc_vals);
+        p = put_dht(p, 0x10 | t, s_ac_bits[t], s_ac_vals[t]);
+    }
+
+    p = put_marker(p, JPEG_MARKER_SOS, 6 + 2 * comps);
+    *p++ = comps;
+    for (int c = 0; c < comps; c++) {
+        *p++ = c + 1;
+        *p++ = c == 0 ? 0x00 : 0x11;
+    }
+    *p++ = 0;
+    *p++ = 63;
+    *p++ = 0;
+    return p;
+}
+
+#define JPEG_ENC_HEADER_MAX 640
+
+size_t jpeg_enc_encode(const jpeg_enc_t *enc, const uint8_t *src, uint16_t width, uint16_t height,
+                       size_t stride, jpeg_enc_format_t format, uint8_t *out, size_t out_size)
+{
+    bool yuyv = format == JPEG_ENC_YUYV;
+    float block[64];
+
+    if (src == NULL || width == 0 || height == 0 || (yuyv && (width & 1))) {
+        return 0;
+    }
+    if (stride == 0) {
+        stride = (size_t)width * (yuyv ? 2 : 1);
+    }
+    if (out_size < JPEG_ENC_HEADER_MAX + JPEG_ENC_MCU_MAX_BYTES + 2) {
+        return 0;
+    }
+
+    jpeg_bw_t bw = {
+        .p = put_headers(enc, out, width, height, yuyv ? 3 : 1),
+        .end = out + out_size - 2, // keep room for EOI
+    };
+    int pred[3] = {0, 0, 0};
+    int mcu_w = yuyv ? 16 : 8;
+
+    for (int y = 0; y < height; y += 8) {
+        for (int x = 0; x < width; x += mcu_w) {
+            if (bw.end - bw.p < JPEG_ENC_MCU_MAX_BYTES) {
+                return 0;
+            }
+            if (!yuyv) {
+                load_block(block, src, stride, 1, x, y, width, height);
+                encode_block(&bw, block, enc->scale[0], &enc->dc[0], &enc->ac[0], &pred[0]);
+                continue;
+            }
+
+            // Y at every even byte; U and V at bytes 1 and 3 of each pixel pair
+            load_block(block, src, stride, 2, x, y, width, height);
+            encode_block(&bw, block, enc->scale[0], &enc->dc[0], &enc->ac[0], &pred[0]);
+            load_block(block, src, stride, 2, x + 8 < width ? x + 8 : width - 1, y, width, height);
+            encode_block(&bw, block, enc->scale[0], &enc->dc[0], &enc->ac[0], &pred[0]);
+            load_block(block, src + 1, stride, 4, x / 2, y, width / 2, height);
+            encode_block(&bw, block, enc->scale[1], &enc->dc[1], &enc->ac[1], &pred[1]);
+            load_block(block, src + 3, stride, 4, x / 2, y, width / 2, height);
+            encode_block(&bw, block, enc->scale[1], &enc->dc[1], &enc->ac[1], &pred[2]);
+        }
+    }
+
+    bw_flush(&bw);
+    uint8_t *p = put_marker(bw.p, JPEG_MARKER_EOI, 0);
+    return p - out;
+}
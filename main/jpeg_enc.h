@@ -0,0 +1,49 @@
+#ifndef JPEG_ENC_H
+#define JPEG_ENC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Baseline JPEG encoder for raw sensor frames.
+//
+// Takes grayscale (one byte per pixel) or YUYV 4:2:2 (Y0 U Y1 V, the OV2640's
+// YUV422 order) and writes a baseline JFIF with the standard Huffman tables.
+// YUYV is coded as 4:2:2 with no chroma resampling. The forward DCT is the
+// AAN single-precision float algorithm with its output scaling folded into
+// the quantization multipliers, so a block costs 80 multiplies and 464 adds
+// before quantization; the ESP32-S3 FPU does each in one cycle. Output decodes
+// with jpeg_dc.h and any baseline decoder. No ESP-IDF dependencies.
+
+typedef enum {
+    JPEG_ENC_GRAYSCALE,
+    JPEG_ENC_YUYV
+} jpeg_enc_format_t;
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t size[256];
+} jpeg_enc_huff_t;
+
+// Encoder tables, about 4 KB; keep one per task that encodes
+typedef struct {
+    int quality;
+    uint8_t qt[2][64];          // zigzag order, as written to DQT
+    float scale[2][64];         // natural order, 1 / (qt * AAN scale * 8)
+    jpeg_enc_huff_t dc[2];
+    jpeg_enc_huff_t ac[2];
+} jpeg_enc_t;
+
+// quality 1-100 as in libjpeg; 0 is treated as 1
+void jpeg_enc_init(jpeg_enc_t *enc, int quality);
+
+// Rebuild the quantization tables if quality changed
+void jpeg_enc_set_quality(jpeg_enc_t *enc, int quality);
+
+// Encode a width x height image with `stride` bytes per row (0 for packed).
+// Returns the JPEG size, or 0 if it does not fit in out_size or the
+// arguments are invalid (YUYV needs an even width).
+size_t jpeg_enc_encode(const jpeg_enc_t *enc, const uint8_t *src, uint16_t width, uint16_t height,
+                       size_t stride, jpeg_enc_format_t format, uint8_t *out, size_t out_size);
+
+#endif // JPEG_ENC_H
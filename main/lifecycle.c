@@ -0,0 +1,139 @@
+#include "lifecycle.h"
+#include <string.h>
+
+#define SVC_BIT(svc) (1u << (svc))
+
+// Services that must be UP before each service may start.
+// CAMERA and WIFI are driven externally and have no dependencies.
+static const uint32_t s_dependencies[LIFECYCLE_SVC_COUNT] = {
+    [LIFECYCLE_SVC_CAMERA] = 0,
+    [LIFECYCLE_SVC_WIFI]   = 0,
+    [LIFECYCLE_SVC_HTTP]   = SVC_BIT(LIFECYCLE_SVC_WIFI),
+    [LIFECYCLE_SVC_STREAM] = SVC_BIT(LIFECYCLE_SVC_HTTP) | SVC_BIT(LIFECYCLE_SVC_CAMERA),
+    [LIFECYCLE_SVC_OTA]    = SVC_BIT(LIFECYCLE_SVC_HTTP),
+};
+
+static bool is_managed(lifecycle_service_t svc)
+{
+    return s_dependencies[svc] != 0;
+}
+
+static bool deps_in_state(const lifecycle_t *lc, lifecycle_service_t svc, lifecycle_state_t state)
+{
+    for (int dep = 0; dep < LIFECYCLE_SVC_COUNT; dep++) {
+        if ((s_dependencies[svc] & SVC_BIT(dep)) && lc->state[dep] != state) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool any_dep_failed(const lifecycle_t *lc, lifecycle_service_t svc)
+{
+    for (int dep = 0; dep < LIFECYCLE_SVC_COUNT; dep++) {
+        if ((s_dependencies[svc] & SVC_BIT(dep)) && lc->state[dep] == LIFECYCLE_STATE_FAILED) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void set_state(lifecycle_t *lc, lifecycle_service_t svc, lifecycle_state_t state, uint32_t now_ms)
+{
+    if (lc->state[svc] == state) {
+        return;
+    }
+    lc->state[svc] = state;
+    lc->last_change_ms[svc] = now_ms;
+    if (state == LIFECYCLE_STATE_UP) {
+        lc->up_count[svc]++;
+        if (lc->first_up_ms[svc] == 0) {
+            // Keep 0 as the "never up" marker even for a service up at t=0
+            lc->first_up_ms[svc] = now_ms ? now_ms : 1;
+        }
+    }
+}
+
+void lifecycle_reset(lifecycle_t *lc)
+{
+    memset(lc, 0, sizeof(*lc));
+}
+
+uint32_t lifecycle_update(lifecycle_t *lc, lifecycle_service_t svc,
+                          lifecycle_state_t state, uint32_t now_ms)
+{
+    if (svc >= LIFECYCLE_SVC_COUNT) {
+        return 0;
+    }
+
+    set_state(lc, svc, state, now_ms);
+
+    uint32_t actions = 0;
+
+    // Stops first. Walk in dependency order so a stopped service cascades to
+    // its dependents; the caller executes the stops in reverse order.
+    for (int s = 0; s < LIFECYCLE_SVC_COUNT; s++) {
+        if (!is_managed(s)) {
+            continue;
+        }
+        lifecycle_state_t cur = lc->state[s];
+        if ((cur == LIFECYCLE_STATE_UP || cur == LIFECYCLE_STATE_STARTING) &&
+            !deps_in_state(lc, s, LIFECYCLE_STATE_UP)) {
+            actions |= LIFECYCLE_ACTION_STOP(s);
+            set_state(lc, s, LIFECYCLE_STATE_DOWN, now_ms);
+        } else if (cur == LIFECYCLE_STATE_FAILED && !deps_in_state(lc, s, LIFECYCLE_STATE_UP)) {
+            // Dependency went away: allow a fresh attempt when it returns
+            set_state(lc, s, LIFECYCLE_STATE_DOWN, now_ms);
+        }
+    }
+
+    // Then starts, in dependency order. A service stopped in this pass is not
+    // restarted in the same pass.
+    for (int s = 0; s < LIFECYCLE_SVC_COUNT; s++) {
+        if (!is_managed(s) || (actions & LIFECYCLE_ACTION_STOP(s))) {
+            continue;
+        }
+        if (lc->state[s] == LIFECYCLE_STATE_DOWN && deps_in_state(lc, s, LIFECYCLE_STATE_UP)) {
+            actions |= LIFECYCLE_ACTION_START(s);
+            set_state(lc, s, LIFECYCLE_STATE_STARTING, now_ms);
+        }
+    }
+
+    return actions;
+}
+
+bool lifecycle_all_up(const lifecycle_t *lc)
+{
+    if (lc->state[LIFECYCLE_SVC_WIFI] != LIFECYCLE_STATE_UP) {
+        return false;
+    }
+    for (int s = 0; s < LIFECYCLE_SVC_COUNT; s++) {
+        if (!is_managed(s) || lc->state[s] == LIFECYCLE_STATE_UP) {
+            continue;
+        }
+        // A service blocked by a failed dependency will never come up
+        if (!any_dep_failed(lc, s)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char *lifecycle_service_name(lifecycle_service_t svc)
+{
+    static const char *names[LIFECYCLE_SVC_COUNT] = {
+        "camera", "wifi", "http", "stream", "ota"
+    };
+    return svc < LIFECYCLE_SVC_COUNT ? names[svc] : "unknown";
+}
+
+const char *lifecycle_state_name(lifecycle_state_t state)
+{
+    switch (state) {
+        case LIFECYCLE_STATE_DOWN:     return "down";
+        case LIFECYCLE_STATE_STARTING: return "starting";
+        case LIFECYCLE_STATE_UP:       return "up";
+        case LIFECYCLE_STATE_FAILED:   return "failed";
+    }
+    return "unknown";
+}
@@ -0,0 +1,58 @@
+#ifndef LIFECYCLE_H
+#define LIFECYCLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Service lifecycle state machine.
+//
+// Plain C with no ESP-IDF dependencies: the caller feeds it state changes
+// (camera ready, WiFi got IP, HTTP started, ...) together with a millisecond
+// timestamp, and it answers with the start/stop actions whose dependencies are
+// now satisfied or broken. app_main owns the event queue and executes the
+// actions, reporting each result back as another state change.
+
+// Services, in start order
+typedef enum {
+    LIFECYCLE_SVC_CAMERA,
+    LIFECYCLE_SVC_WIFI,
+    LIFECYCLE_SVC_HTTP,
+    LIFECYCLE_SVC_STREAM,
+    LIFECYCLE_SVC_OTA,
+    LIFECYCLE_SVC_COUNT
+} lifecycle_service_t;
+
+typedef enum {
+    LIFECYCLE_STATE_DOWN,
+    LIFECYCLE_STATE_STARTING,
+    LIFECYCLE_STATE_UP,
+    LIFECYCLE_STATE_FAILED
+} lifecycle_state_t;
+
+// Action bits returned by lifecycle_update()
+#define LIFECYCLE_ACTION_START(svc) (1u << (svc))
+#define LIFECYCLE_ACTION_STOP(svc)  (1u << ((svc) + LIFECYCLE_SVC_COUNT))
+
+typedef struct {
+    lifecycle_state_t state[LIFECYCLE_SVC_COUNT];
+    uint32_t first_up_ms[LIFECYCLE_SVC_COUNT];   // 0 = never up
+    uint32_t last_change_ms[LIFECYCLE_SVC_COUNT];
+    uint32_t up_count[LIFECYCLE_SVC_COUNT];
+} lifecycle_t;
+
+// Reset every service to DOWN
+void lifecycle_reset(lifecycle_t *lc);
+
+// Record a state change for a service and return the resulting action mask.
+// Managed services (HTTP, STREAM, OTA) that are asked to start are moved to
+// STARTING; services asked to stop are moved to DOWN.
+uint32_t lifecycle_update(lifecycle_t *lc, lifecycle_service_t svc,
+                          lifecycle_state_t state, uint32_t now_ms);
+
+// True once every service that can come up (camera permitting) is UP
+bool lifecycle_all_up(const lifecycle_t *lc);
+
+const char *lifecycle_service_name(lifecycle_service_t svc);
+const char *lifecycle_state_name(lifecycle_state_t state);
+
+#endif // LIFECYCLE_H
@@ -0,0 +1,136 @@
+#include "log_ring.h"
+#include <string.h>
+
+uint32_t log_ring_init(log_ring_t *ring, log_ring_slot_t *slots, uint32_t slot_count,
+                       uint32_t burst, uint32_t window_ms)
+{
+    memset(ring, 0, sizeof(*ring));
+    if (slot_count < 2) {
+        return 0;
+    }
+
+    uint32_t capacity = 1;
+    while (capacity * 2 <= slot_count) {
+        capacity *= 2;
+    }
+
+    ring->slots = slots;
+    ring->mask = capacity - 1;
+    for (uint32_t i = 0; i < capacity; i++) {
+        atomic_init(&slots[i].seq, i);
+    }
+    atomic_init(&ring->head, 0);
+
+    for (int i = 0; i < LOG_RING_LIMIT_ENTRIES; i++) {
+        atomic_init(&ring->limits[i].key, 0);
+        atomic_init(&ring->limits[i].window_start_ms, 0);
+        atomic_init(&ring->limits[i].count, 0);
+        atomic_init(&ring->limits[i].suppressed, 0);
+    }
+    ring->limit_burst = burst;
+    ring->limit_window_ms = window_ms;
+
+    atomic_init(&ring->written, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->suppressed, 0);
+    return capacity;
+}
+
+bool log_ring_admit(log_ring_t *ring, uintptr_t key, uint32_t now_ms, uint32_t *suppressed)
+{
+    *suppressed = 0;
+    if (ring->limit_burst == 0 || key == 0) {
+        return true;
+    }
+
+    // Format strings are at least 4-byte aligned, drop the low bits
+    uint32_t hash = (uint32_t)(key >> 2) * 2654435761u;
+    log_ring_limit_t *limit = &ring->limits[(hash >> 24) % LOG_RING_LIMIT_ENTRIES];
+
+    uintptr_t owner = atomic_load_explicit(&limit->key, memory_order_relaxed);
+    if (owner != key) {
+        uintptr_t empty = 0;
+        if (owner != 0 || !atomic_compare_exchange_strong_explicit(&limit->key, &empty, key,
+                                                                    memory_order_relaxed,
+                                                                    memory_order_relaxed)) {
+            // Table entry taken by another call site: not limited
+            return true;
+        }
+    }
+
+    // Start a new window; only one writer wins the CAS, the others count
+    // against the fresh window
+    uint32_t start = atomic_load_explicit(&limit->window_start_ms, memory_order_relaxed);
+    if (now_ms - start >= ring->limit_window_ms &&
+        atomic_compare_exchange_strong_explicit(&limit->window_start_ms, &start, now_ms,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        atomic_store_explicit(&limit->count, 1, memory_order_relaxed);
+        *suppressed = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+        return true;
+    }
+
+    if (atomic_fetch_add_explicit(&limit->count, 1, memory_order_relaxed) < ring->limit_burst) {
+        *suppressed = atomic_exchange_explicit(&limit->suppressed, 0, memory_order_relaxed);
+        return true;
+    }
+
+    atomic_fetch_add_explicit(&limit->suppressed, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ring->suppressed, 1, memory_order_relaxed);
+    return false;
+}
+
+log_ring_slot_t *log_ring_reserve(log_ring_t *ring)
+{
+    unsigned int pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    for (;;) {
+        log_ring_slot_t *slot = &ring->slots[pos & ring->mask];
+        unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                return slot;
+            }
+            // pos was reloaded by the failed CAS
+        } else if (diff < 0) {
+            // The slot still holds a line from the previous lap: full
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+void log_ring_commit(log_ring_t *ring, log_ring_slot_t *slot)
+{
+    // The slot was reserved at position seq; seq + 1 marks it readable
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ring->written, 1, memory_order_relaxed);
+}
+
+log_ring_slot_t *log_ring_peek(log_ring_t *ring)
+{
+    log_ring_slot_t *slot = &ring->slots[ring->tail & ring->mask];
+    unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    return seq == ring->tail + 1 ? slot : NULL;
+}
+
+void log_ring_release(log_ring_t *ring)
+{
+    log_ring_slot_t *slot = &ring->slots[ring->tail & ring->mask];
+    // Hand the slot to the writer one lap ahead
+    atomic_store_explicit(&slot->seq, ring->tail + ring->mask + 1, memory_order_release);
+    ring->tail++;
+}
+
+void log_ring_get_stats(log_ring_t *ring, log_ring_stats_t *stats)
+{
+    stats->capacity = ring->slots != NULL ? ring->mask + 1 : 0;
+    stats->written = atomic_load(&ring->written);
+    stats->dropped = atomic_load(&ring->dropped);
+    stats->suppressed = atomic_load(&ring->suppressed);
+}
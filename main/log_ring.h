@@ -0,0 +1,86 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded, lock-free queue of formatted log lines.
+//
+// Any number of tasks format straight into a reserved slot and publish it
+// with one atomic store; a single drain task consumes slots in order. A
+// writer never waits: when the ring is full the line is dropped and counted.
+// Slot claiming follows the bounded MPMC queue by D. Vyukov (a per-slot
+// sequence number and a CAS on the head).
+//
+// A small per-call-site limiter (keyed by the format string pointer) caps how
+// many lines one call site may emit per window, so an error repeated on every
+// frame cannot flood the ring. The count of suppressed lines is reported with
+// the next line let through. No ESP-IDF dependencies.
+
+#define LOG_RING_LINE_MAX 120
+#define LOG_RING_LIMIT_ENTRIES 16
+
+typedef struct {
+    atomic_uint seq;
+    uint16_t len;
+    uint16_t suppressed;    // lines from this call site dropped before this one
+    char text[LOG_RING_LINE_MAX];
+} log_ring_slot_t;
+
+typedef struct {
+    atomic_uintptr_t key;
+    atomic_uint window_start_ms;
+    atomic_uint count;
+    atomic_uint suppressed;
+} log_ring_limit_t;
+
+typedef struct {
+    log_ring_slot_t *slots;
+    uint32_t mask;
+    atomic_uint head;           // next slot to reserve (writers)
+    uint32_t tail;              // next slot to consume (drain task only)
+
+    log_ring_limit_t limits[LOG_RING_LIMIT_ENTRIES];
+    uint32_t limit_burst;       // 0 disables rate limiting
+    uint32_t limit_window_ms;
+
+    atomic_uint written;
+    atomic_uint dropped;        // ring full
+    atomic_uint suppressed;     // rate limited
+} log_ring_t;
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t suppressed;
+} log_ring_stats_t;
+
+// Use `slots` (slot_count entries, rounded down to a power of two) as the
+// ring. Lines from one call site beyond `burst` per `window_ms` are
+// suppressed; burst 0 disables the limiter. Returns the usable slot count,
+// 0 if slot_count < 2.
+uint32_t log_ring_init(log_ring_t *ring, log_ring_slot_t *slots, uint32_t slot_count,
+                       uint32_t burst, uint32_t window_ms);
+
+// Rate-limit check for a line from call site `key` (0 is never limited).
+// Returns false if the line should be dropped. When it returns true,
+// *suppressed is the number of lines of this call site dropped since the
+// last one admitted.
+bool log_ring_admit(log_ring_t *ring, uintptr_t key, uint32_t now_ms, uint32_t *suppressed);
+
+// Reserve a slot for writing; NULL (and counted as dropped) if the ring is
+// full. The caller fills text/len/suppressed and then commits.
+log_ring_slot_t *log_ring_reserve(log_ring_t *ring);
+void log_ring_commit(log_ring_t *ring, log_ring_slot_t *slot);
+
+// Drain side, single consumer: oldest committed slot or NULL, then release
+// it once its text has been used
+log_ring_slot_t *log_ring_peek(log_ring_t *ring);
+void log_ring_release(log_ring_t *ring);
+
+void log_ring_get_stats(log_ring_t *ring, log_ring_stats_t *stats);
+
+#endif // LOG_RING_H
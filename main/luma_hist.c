@@ -0,0 +1,50 @@
+#include "luma_hist.h"
+#include <string.h>
+
+uint8_t luma_hist_percentile(const luma_hist_t *hist, uint16_t permille)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    // Pixels at or below the returned bin reach the requested share
+    uint64_t want = ((uint64_t)hist->count * permille + 999) / 1000;
+    uint32_t seen = 0;
+    int bin = 0;
+    for (; bin < LUMA_HIST_BINS - 1; bin++) {
+        seen += hist->bins[bin];
+        if (seen >= want) {
+            break;
+        }
+    }
+    // Middle of the bin
+    return (uint8_t)((bin << LUMA_HIST_SHIFT) + (1 << (LUMA_HIST_SHIFT - 1)));
+}
+
+void luma_hist_compute(luma_hist_t *hist, const uint8_t *luma, uint16_t width, uint16_t height, size_t stride)
+{
+    memset(hist, 0, sizeof(*hist));
+    if (luma == NULL || width == 0 || height == 0) {
+        return;
+    }
+    if (stride == 0) {
+        stride = width;
+    }
+
+    uint64_t sum = 0;
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t *row = luma + (size_t)y * stride;
+        for (uint16_t x = 0; x < width; x++) {
+            hist->bins[row[x] >> LUMA_HIST_SHIFT]++;
+            sum += row[x];
+        }
+    }
+
+    hist->count = (uint32_t)width * height;
+    hist->mean = (uint8_t)((sum + hist->count / 2) / hist->count);
+    hist->p5 = luma_hist_percentile(hist, 50);
+    hist->p50 = luma_hist_percentile(hist, 500);
+    hist->p95 = luma_hist_percentile(hist, 950);
+    hist->dark_permille = (uint16_t)((uint64_t)hist->bins[0] * 1000 / hist->count);
+    hist->clip_permille = (uint16_t)((uint64_t)hist->bins[LUMA_HIST_BINS - 1] * 1000 / hist->count);
+}
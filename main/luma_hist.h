@@ -0,0 +1,35 @@
+#ifndef LUMA_HIST_H
+#define LUMA_HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Luma statistics for exposure control.
+//
+// Built from a downscaled frame, normally the 1/8 scale DC thumbnail the
+// scene-change stage has already decoded, so a VGA frame costs 4800 pixels.
+// 64 bins of 4 levels each are plenty to meter on and keep the histogram
+// small enough to serve as JSON. No ESP-IDF dependencies.
+
+#define LUMA_HIST_BINS 64
+#define LUMA_HIST_SHIFT 2       // levels per bin = 1 << LUMA_HIST_SHIFT
+
+typedef struct {
+    uint32_t bins[LUMA_HIST_BINS];
+    uint32_t count;
+    uint8_t mean;
+    uint8_t p5;                 // percentiles, to bin resolution
+    uint8_t p50;
+    uint8_t p95;
+    uint16_t dark_permille;     // share in the darkest bin
+    uint16_t clip_permille;     // share in the brightest bin
+} luma_hist_t;
+
+// Histogram a width x height luma plane with `stride` bytes per row (0 for
+// packed). An empty plane leaves count at 0.
+void luma_hist_compute(luma_hist_t *hist, const uint8_t *luma, uint16_t width, uint16_t height, size_t stride);
+
+// Luma level below which `permille` of the pixels fall
+uint8_t luma_hist_percentile(const luma_hist_t *hist, uint16_t permille);
+
+#endif // LUMA_HIST_H
@@ -0,0 +1,64 @@
+#include "mcast_frag.h"
+
+static void put_be16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+bool mcast_frag_begin(mcast_frag_t *frag, const uint8_t *data, size_t len, uint32_t seq,
+                      uint32_t timestamp_ms, uint16_t payload_max)
+{
+    if (data == NULL || len == 0 || payload_max == 0 || payload_max > MCAST_FRAG_PAYLOAD_MAX) {
+        return false;
+    }
+    size_t count = (len + payload_max - 1) / payload_max;
+    if (count > MCAST_FRAG_COUNT_MAX) {
+        return false;
+    }
+
+    frag->data = data;
+    frag->len = (uint32_t)len;
+    frag->seq = seq;
+    frag->timestamp_ms = timestamp_ms;
+    frag->payload_max = payload_max;
+    frag->count = (uint16_t)count;
+    frag->next = 0;
+    return true;
+}
+
+size_t mcast_frag_next(mcast_frag_t *frag, uint8_t hdr[MCAST_FRAG_HEADER_LEN], const uint8_t **payload)
+{
+    if (frag->next >= frag->count) {
+        return 0;
+    }
+
+    uint32_t offset = (uint32_t)frag->next * frag->payload_max;
+    uint32_t slice = frag->len - offset;
+    if (slice > frag->payload_max) {
+        slice = frag->payload_max;
+    }
+
+    hdr[0] = MCAST_FRAG_MAGIC0;
+    hdr[1] = MCAST_FRAG_MAGIC1;
+    hdr[2] = MCAST_FRAG_VERSION;
+    hdr[3] = 0;
+    put_be32(hdr + 4, frag->seq);
+    put_be32(hdr + 8, frag->len);
+    put_be32(hdr + 12, offset);
+    put_be16(hdr + 16, frag->next);
+    put_be16(hdr + 18, frag->count);
+    put_be32(hdr + 20, frag->timestamp_ms);
+
+    *payload = frag->data + offset;
+    frag->next++;
+    return slice;
+}
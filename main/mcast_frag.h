@@ -0,0 +1,57 @@
+#ifndef MCAST_FRAG_H
+#define MCAST_FRAG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fragmentation of JPEG frames into UDP datagrams for the multicast stream.
+//
+// Every datagram carries a 24-byte big-endian header followed by one slice
+// of the frame:
+//
+//   0  magic "EM"        2  version (1)        3  flags (0)
+//   4  frame sequence    8  frame length      12  offset of this slice
+//  16  fragment index   18  fragment count    20  capture time, ms (low 32 bits)
+//
+// Fragments are independent, so a receiver can place each one at its offset
+// in any order and deliver the frame once all `count` have arrived; a frame
+// with a lost fragment is dropped as a whole. mcast_view.py is the receiver.
+// No ESP-IDF dependencies.
+
+#define MCAST_FRAG_MAGIC0 'E'
+#define MCAST_FRAG_MAGIC1 'M'
+#define MCAST_FRAG_VERSION 1
+#define MCAST_FRAG_HEADER_LEN 24
+#define MCAST_FRAG_DATAGRAM_MAX 1472     // 1500-byte MTU less the IPv4 and UDP headers
+#define MCAST_FRAG_PAYLOAD_MAX (MCAST_FRAG_DATAGRAM_MAX - MCAST_FRAG_HEADER_LEN)
+#define MCAST_FRAG_COUNT_MAX 0xFFFF
+
+// One frame being split
+typedef struct {
+    const uint8_t *data;
+    uint32_t len;
+    uint32_t seq;
+    uint32_t timestamp_ms;
+    uint16_t payload_max;
+    uint16_t count;
+    uint16_t next;
+} mcast_frag_t;
+
+// Start splitting `len` bytes into slices of at most payload_max bytes.
+// Returns false for an empty frame, a payload_max of 0 or above
+// MCAST_FRAG_PAYLOAD_MAX, or a frame that needs more than 65535 fragments.
+bool mcast_frag_begin(mcast_frag_t *frag, const uint8_t *data, size_t len, uint32_t seq,
+                      uint32_t timestamp_ms, uint16_t payload_max);
+
+// Write the next fragment's header to hdr and point *payload at its slice.
+// Returns the slice length, or 0 once every fragment has been produced.
+size_t mcast_frag_next(mcast_frag_t *frag, uint8_t hdr[MCAST_FRAG_HEADER_LEN], const uint8_t **payload);
+
+// Fragments the frame needs
+static inline uint16_t mcast_frag_count(const mcast_frag_t *frag)
+{
+    return frag->count;
+}
+
+#endif // MCAST_FRAG_H
@@ -0,0 +1,271 @@
+#include "mcast_stream.h"
+#include "mcast_frag.h"
+#include "capture_pipeline.h"
+#include "qos_arbiter.h"
+#include "task_layout.h"
+#include "esp_camera.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "lwip/sockets.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef CONFIG_APP_MCAST_STREAM
+
+static const char *TAG = "mcast_stream";
+
+#define MCAST_FRAME_WAIT_MS 100
+#define MCAST_SEND_RETRIES 20       // ticks to wait for TX buffers before giving up on a frame
+#define MCAST_RATE_WINDOW_MS 1000
+#define MCAST_STOPPED_BIT BIT0
+
+#if CONFIG_APP_MCAST_MAX_FPS > 0
+#define MCAST_MIN_INTERVAL_MS (1000 / CONFIG_APP_MCAST_MAX_FPS)
+#else
+#define MCAST_MIN_INTERVAL_MS 0
+#endif
+
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+#define MCAST_KEEPALIVE_MS CONFIG_APP_STREAM_KEEPALIVE_MS
+#else
+#define MCAST_KEEPALIVE_MS 0
+#endif
+
+static int s_fd = -1;
+static struct sockaddr_in s_group;
+static volatile bool s_running = false;
+static EventGroupHandle_t s_events = NULL;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static mcast_stream_stats_t s_stats;
+
+static uint32_t mcast_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Send every fragment of one frame. Datagrams go out back to back; when the
+// Wi-Fi driver runs out of TX buffers the send is retried a tick later, and
+// the rest of the frame is abandoned if it stays full.
+static void mcast_send_frame(const frame_t *frame)
+{
+    mcast_frag_t frag;
+    uint8_t hdr[MCAST_FRAG_HEADER_LEN];
+    const uint8_t *payload;
+    size_t len;
+    uint32_t datagrams = 0;
+    size_t bytes = 0;
+    bool failed = false;
+
+    if (!mcast_frag_begin(&frag, frame->data, frame->len, frame->seq,
+                          (uint32_t)(frame->timestamp_us / 1000), MCAST_FRAG_PAYLOAD_MAX)) {
+        return;
+    }
+
+    while (!failed && (len = mcast_frag_next(&frag, hdr, &payload)) > 0) {
+        struct iovec iov[2] = {
+            { .iov_base = hdr, .iov_len = sizeof(hdr) },
+            { .iov_base = (void *)payload, .iov_len = len },
+        };
+        struct msghdr msg = {
+            .msg_name = &s_group,
+            .msg_namelen = sizeof(s_group),
+            .msg_iov = iov,
+            .msg_iovlen = 2,
+        };
+
+        int retries = 0;
+        while (sendmsg(s_fd, &msg, 0) < 0) {
+            bool no_buffers = errno == ENOMEM || errno == ENOBUFS || errno == EAGAIN;
+            if (!no_buffers || ++retries > MCAST_SEND_RETRIES || !s_running) {
+                ESP_LOGD(TAG, "Frame %lu abandoned at fragment %u/%u: errno %d", (unsigned long)frame->seq,
+                         frag.next, mcast_frag_count(&frag), errno);
+                failed = true;
+                break;
+            }
+            vTaskDelay(1);
+        }
+        if (!failed) {
+            datagrams++;
+            bytes += sizeof(hdr) + len;
+        }
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (failed) {
+        s_stats.frames_dropped++;
+        s_stats.send_errors++;
+    } else {
+        s_stats.frames_sent++;
+    }
+    s_stats.datagrams_sent += datagrams;
+    s_stats.bytes_sent += bytes;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void mcast_task(void *pvParameters)
+{
+    uint32_t last_seq = 0;
+    uint32_t now_ms = mcast_now_ms();
+    // The first frame is always sent, changed or not
+    uint32_t last_offer_ms = now_ms - MCAST_KEEPALIVE_MS - MCAST_MIN_INTERVAL_MS;
+    uint32_t rate_start_ms = now_ms;
+    uint64_t rate_start_bytes;
+
+    portENTER_CRITICAL(&s_stats_lock);
+    rate_start_bytes = s_stats.bytes_sent;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    // Nobody says whether the group has listeners, so the sender is one
+    capture_pipeline_acquire(CAPTURE_CONSUMER_STREAM);
+    while (s_running) {
+        frame_t *frame = capture_pipeline_get_frame(last_seq, MCAST_FRAME_WAIT_MS);
+        now_ms = mcast_now_ms();
+        if (frame != NULL) {
+            last_seq = frame->seq;
+            bool send = frame->format == PIXFORMAT_JPEG;
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+            if (send && frame->unchanged && now_ms - last_offer_ms < MCAST_KEEPALIVE_MS) {
+                send = false;
+            }
+#endif
+            if (send && (now_ms - last_offer_ms < MCAST_MIN_INTERVAL_MS ||
+                         !qos_arbiter_admit(QOS_FLOW_STREAM, last_offer_ms, now_ms))) {
+                send = false;
+                portENTER_CRITICAL(&s_stats_lock);
+                s_stats.frames_throttled++;
+                portEXIT_CRITICAL(&s_stats_lock);
+            }
+            if (send) {
+                last_offer_ms = now_ms;
+                mcast_send_frame(frame);
+            }
+            frame_unref(frame);
+        }
+
+        uint32_t elapsed = now_ms - rate_start_ms;
+        if (elapsed >= MCAST_RATE_WINDOW_MS) {
+            portENTER_CRITICAL(&s_stats_lock);
+            uint64_t bytes = s_stats.bytes_sent;
+            s_stats.rate_kbps = (uint32_t)((bytes - rate_start_bytes) * 8 / elapsed);
+            portEXIT_CRITICAL(&s_stats_lock);
+            rate_start_ms = now_ms;
+            rate_start_bytes = bytes;
+        }
+    }
+
+    capture_pipeline_release(CAPTURE_CONSUMER_STREAM);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.running = false;
+    s_stats.rate_kbps = 0;
+    portEXIT_CRITICAL(&s_stats_lock);
+    xEventGroupSetBits(s_events, MCAST_STOPPED_BIT);
+    vTaskDelete(NULL);
+}
+
+static int mcast_open_socket(void)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        return -1;
+    }
+
+    uint8_t ttl = CONFIG_APP_MCAST_TTL;
+    uint8_t loop = 0;
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) != 0) {
+        ESP_LOGW(TAG, "Cannot set multicast options: errno %d", errno);
+    }
+    return fd;
+}
+
+esp_err_t mcast_stream_start(void)
+{
+    if (s_running) {
+        return ESP_OK;
+    }
+
+    memset(&s_group, 0, sizeof(s_group));
+    s_group.sin_family = AF_INET;
+    s_group.sin_port = htons(CONFIG_APP_MCAST_PORT);
+    if (inet_aton(CONFIG_APP_MCAST_GROUP, &s_group.sin_addr) == 0 ||
+        (ntohl(s_group.sin_addr.s_addr) >> 28) != 0xE) {
+        ESP_LOGE(TAG, "Invalid multicast group \"%s\"", CONFIG_APP_MCAST_GROUP);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_events == NULL) {
+        s_events = xEventGroupCreate();
+        if (s_events == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_fd = mcast_open_socket();
+    if (s_fd < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    xEventGroupClearBits(s_events, MCAST_STOPPED_BIT);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.enabled = true;
+    s_stats.running = true;
+    portEXIT_CRITICAL(&s_stats_lock);
+    s_running = true;
+    if (xTaskCreatePinnedToCore(mcast_task, "mcast_stream", MCAST_TASK_STACK_SIZE, NULL,
+                                MCAST_TASK_PRIORITY, NULL, MCAST_TASK_CORE) != pdPASS) {
+        s_running = false;
+        s_stats.running = false;
+        close(s_fd);
+        s_fd = -1;
+        ESP_LOGE(TAG, "Failed to create multicast task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Multicasting frames to %s:%d (TTL %d)", CONFIG_APP_MCAST_GROUP, CONFIG_APP_MCAST_PORT,
+             CONFIG_APP_MCAST_TTL);
+    return ESP_OK;
+}
+
+esp_err_t mcast_stream_stop(void)
+{
+    if (!s_running) {
+        return ESP_OK;
+    }
+
+    s_running = false;
+    // Bounded by one frame wait plus the TX buffer retries
+    xEventGroupWaitBits(s_events, MCAST_STOPPED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    close(s_fd);
+    s_fd = -1;
+    ESP_LOGI(TAG, "Multicast stream stopped");
+    return ESP_OK;
+}
+
+void mcast_stream_get_stats(mcast_stream_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#else // CONFIG_APP_MCAST_STREAM
+
+esp_err_t mcast_stream_start(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t mcast_stream_stop(void)
+{
+    return ESP_OK;
+}
+
+void mcast_stream_get_stats(mcast_stream_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_APP_MCAST_STREAM
@@ -0,0 +1,39 @@
+#ifndef MCAST_STREAM_H
+#define MCAST_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// UDP multicast stream, see "ESP32S3Cam Multicast Stream" in menuconfig.
+//
+// For many viewers on one LAN: every frame from the capture pipeline is
+// split into datagrams (mcast_frag.h) and sent once to CONFIG_APP_MCAST_GROUP,
+// so device egress does not grow with the number of receivers and no HTTP
+// socket is used per viewer. There are no retransmissions; a receiver that
+// loses a fragment skips that frame. mcast_view.py joins the group,
+// reassembles the frames and can re-serve them as MJPEG.
+
+typedef struct {
+    bool enabled;
+    bool running;
+    uint32_t frames_sent;
+    uint32_t frames_dropped;    // abandoned part-way after a send failed
+    uint32_t frames_throttled;  // skipped by the frame rate cap or the bandwidth arbiter
+    uint32_t datagrams_sent;
+    uint32_t send_errors;
+    uint64_t bytes_sent;        // UDP payload, headers included
+    uint32_t rate_kbps;         // over the last second
+} mcast_stream_stats_t;
+
+// Open the socket and start the sender task. Returns ESP_ERR_NOT_SUPPORTED
+// when multicast is disabled and ESP_ERR_INVALID_ARG for a group address
+// outside 224.0.0.0/4.
+esp_err_t mcast_stream_start(void);
+
+// Stop the sender task and wait for it to exit
+esp_err_t mcast_stream_stop(void);
+
+void mcast_stream_get_stats(mcast_stream_stats_t *stats);
+
+#endif // MCAST_STREAM_H
@@ -0,0 +1,386 @@
+#include "metrics.h"
+#include "http_server.h"
+#include "video_stream.h"
+#include "capture_pipeline.h"
+#include "thumbnail.h"
+#include "burst.h"
+#include "async_log.h"
+#include "heap_monitor.h"
+#include "push_upload.h"
+#include "mcast_stream.h"
+#include "ota_pull.h"
+#include "dram_stream.h"
+#include "qos_arbiter.h"
+#include "exposure.h"
+#include "camera_profile.h"
+#include "wifi_init.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "metrics";
+
+#define METRICS_LINE_LEN 160
+#define METRICS_MAX_TASKS 40
+
+// Run-time counters from the previous scrape, so CPU usage is reported over
+// the interval between two requests rather than since boot
+typedef struct {
+    UBaseType_t task_number;
+    uint32_t run_time;
+} task_sample_t;
+
+static task_sample_t s_prev_samples[METRICS_MAX_TASKS];
+static int s_prev_count = 0;
+static uint32_t s_prev_total = 0;
+
+static esp_err_t send_line(httpd_req_t *req, const char *fmt, ...)
+{
+    char line[METRICS_LINE_LEN];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    return httpd_resp_sendstr_chunk(req, line);
+}
+
+static uint32_t prev_run_time(UBaseType_t task_number, bool *found)
+{
+    for (int i = 0; i < s_prev_count; i++) {
+        if (s_prev_samples[i].task_number == task_number) {
+            *found = true;
+            return s_prev_samples[i].run_time;
+        }
+    }
+    *found = false;
+    return 0;
+}
+
+static esp_err_t send_task_metrics(httpd_req_t *req)
+{
+    UBaseType_t count = uxTaskGetNumberOfTasks();
+    if (count > METRICS_MAX_TASKS) {
+        count = METRICS_MAX_TASKS;
+    }
+
+    session_arena_t *arena = http_server_arena_open();
+    TaskStatus_t *tasks = arena != NULL ? session_arena_alloc(arena, count * sizeof(TaskStatus_t)) : NULL;
+    if (tasks == NULL) {
+        http_server_arena_close(arena);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t total = 0;
+    count = uxTaskGetSystemState(tasks, count, &total);
+    uint32_t elapsed = total - s_prev_total;
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *t = &tasks[i];
+        bool found;
+        uint32_t prev = prev_run_time(t->xTaskNumber, &found);
+        uint32_t delta = found ? t->ulRunTimeCounter - prev : t->ulRunTimeCounter;
+        uint32_t window = found ? elapsed : total;
+        // Percent of one core over the window
+        float cpu = window ? (100.0f * delta) / window : 0.0f;
+
+        BaseType_t core = xTaskGetCoreID(t->xHandle);
+        char core_str[4];
+        if (core == tskNO_AFFINITY) {
+            strcpy(core_str, "any");
+        } else {
+            snprintf(core_str, sizeof(core_str), "%d", (int)core);
+        }
+
+        send_line(req, "task_cpu_percent{task=\"%s\",core=\"%s\",prio=\"%u\"} %.1f\n",
+                  t->pcTaskName, core_str, (unsigned)t->uxCurrentPriority, cpu);
+        // ESP-IDF stacks are byte-addressed, so the high-water mark is in bytes
+        send_line(req, "task_stack_hwm_bytes{task=\"%s\"} %lu\n",
+                  t->pcTaskName, (unsigned long)t->usStackHighWaterMark);
+    }
+
+    s_prev_count = count;
+    for (UBaseType_t i = 0; i < count; i++) {
+        s_prev_samples[i].task_number = tasks[i].xTaskNumber;
+        s_prev_samples[i].run_time = tasks[i].ulRunTimeCounter;
+    }
+    s_prev_total = total;
+
+    http_server_arena_close(arena);
+    return ESP_OK;
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+
+    send_line(req, "uptime_ms %llu\n", (unsigned long long)(esp_timer_get_time() / 1000));
+    for (int caps = 0; caps < HEAP_MONITOR_CAPS_COUNT; caps++) {
+        heap_monitor_sample_t heap;
+        heap_monitor_sample(caps, &heap);
+        const char *name = heap_monitor_caps_name(caps);
+        send_line(req, "heap_free_bytes{caps=\"%s\"} %lu\n", name, (unsigned long)heap.free_bytes);
+        send_line(req, "heap_min_free_bytes{caps=\"%s\"} %lu\n", name, (unsigned long)heap.min_free_bytes);
+        send_line(req, "heap_largest_free_block_bytes{caps=\"%s\"} %lu\n", name,
+                  (unsigned long)heap.largest_free_block);
+        send_line(req, "heap_min_largest_free_block_bytes{caps=\"%s\"} %lu\n", name,
+                  (unsigned long)heap.min_largest_free_block);
+        send_line(req, "heap_free_blocks{caps=\"%s\"} %lu\n", name, (unsigned long)heap.free_blocks);
+        send_line(req, "heap_fragmentation_permille{caps=\"%s\"} %u\n", name,
+                  (unsigned)heap.fragmentation_permille);
+    }
+
+    session_arena_stats_t arenas;
+    if (http_server_get_arena_stats(&arenas)) {
+        send_line(req, "session_arenas %lu\n", (unsigned long)arenas.count);
+        send_line(req, "session_arena_bytes %lu\n", (unsigned long)arenas.block_size);
+        send_line(req, "session_arenas_in_use %lu\n", (unsigned long)arenas.in_use);
+        send_line(req, "session_arenas_high_water %lu\n", (unsigned long)arenas.high_water);
+        send_line(req, "session_arena_peak_used_bytes %lu\n", (unsigned long)arenas.peak_used);
+        send_line(req, "session_arena_opens_total %lu\n", (unsigned long)arenas.opens);
+        send_line(req, "session_arena_exhausted_total %lu\n", (unsigned long)arenas.exhausted);
+        send_line(req, "session_arena_spills_total %lu\n", (unsigned long)arenas.spills);
+    }
+
+    capture_stats_t capture;
+    capture_pipeline_get_stats(&capture);
+    send_line(req, "capture_frames_total %lu\n", (unsigned long)capture.frames_captured);
+    send_line(req, "capture_frames_dropped_total %lu\n", (unsigned long)capture.frames_dropped);
+    send_line(req, "capture_frames_oversize_total %lu\n", (unsigned long)capture.frames_oversize);
+    send_line(req, "capture_failures_total %lu\n", (unsigned long)capture.capture_failures);
+    send_line(req, "capture_frames_unchanged_total %lu\n", (unsigned long)capture.frames_unchanged);
+    send_line(req, "capture_frames_resync_total %lu\n", (unsigned long)capture.frames_resync);
+    for (int i = JPEG_CHECK_OK + 1; i < JPEG_CHECK_COUNT; i++) {
+        send_line(req, "capture_frames_corrupt_total{reason=\"%s\"} %lu\n", jpeg_check_result_name(i),
+                  (unsigned long)capture.frames_corrupt[i]);
+    }
+    send_line(req, "capture_frames_corrupt_total{reason=\"undecodable\"} %lu\n",
+              (unsigned long)capture.frames_undecodable);
+    send_line(req, "capture_corrupt_permille %lu\n", (unsigned long)capture.corrupt_permille);
+    send_line(req, "capture_frames_encoded_total %lu\n", (unsigned long)capture.frames_encoded);
+    send_line(req, "capture_frames_unsupported_total %lu\n", (unsigned long)capture.frames_unsupported);
+    send_line(req, "capture_encode_us_avg %lu\n", (unsigned long)capture.encode_us_avg);
+    send_line(req, "capture_encode_us_max %lu\n", (unsigned long)capture.encode_us_max);
+    send_line(req, "camera_xclk_hz %lu\n", (unsigned long)capture.xclk_hz);
+    send_line(req, "camera_xclk_fallbacks_total %lu\n", (unsigned long)capture.xclk_fallbacks);
+
+    exposure_stats_t exposure;
+    exposure_get_stats(&exposure);
+    if (exposure.enabled) {
+        send_line(req, "ae_mode{mode=\"%s\"} 1\n", exposure_mode_name(exposure.mode));
+        send_line(req, "ae_converged %u\n", exposure.converged ? 1u : 0u);
+        send_line(req, "ae_limited %u\n", exposure.limited ? 1u : 0u);
+        send_line(req, "ae_exposure_lines %u\n", (unsigned)exposure.setting.exposure);
+        send_line(req, "ae_gain_index %u\n", (unsigned)exposure.setting.gain);
+        send_line(req, "ae_luma_mean %u\n", (unsigned)exposure.hist.mean);
+        send_line(req, "ae_luma_p5 %u\n", (unsigned)exposure.hist.p5);
+        send_line(req, "ae_luma_p95 %u\n", (unsigned)exposure.hist.p95);
+        send_line(req, "ae_clip_permille %u\n", (unsigned)exposure.hist.clip_permille);
+        send_line(req, "ae_adjustments_total %lu\n", (unsigned long)exposure.ae.adjustments);
+        send_line(req, "ae_last_converge_frames %lu\n", (unsigned long)exposure.ae.last_converge_frames);
+        send_line(req, "ae_max_converge_frames %lu\n", (unsigned long)exposure.ae.max_converge_frames);
+        send_line(req, "ae_takeovers_total %lu\n", (unsigned long)exposure.takeovers);
+        send_line(req, "ae_write_errors_total %lu\n", (unsigned long)exposure.write_errors);
+    }
+
+    camera_profile_stats_t profile;
+    camera_profile_get_stats(&profile);
+    send_line(req, "sensor_profile{name=\"%s\"} 1\n", profile.name);
+    send_line(req, "sensor_profile_loads_total %lu\n", (unsigned long)profile.loads);
+    send_line(req, "sensor_profile_failures_total %lu\n", (unsigned long)profile.failures);
+    send_line(req, "sensor_profile_apply_us %lu\n", (unsigned long)profile.last_apply_us);
+    send_line(req, "sensor_profile_apply_us_max %lu\n", (unsigned long)profile.max_apply_us);
+    send_line(req, "sensor_profile_registers_written_total %lu\n", (unsigned long)profile.registers_written);
+    // 0 ok, 1 recovering, 2 failed
+    send_line(req, "capture_health %d\n", (int)capture.health);
+    send_line(req, "capture_idle_ms %lu\n", (unsigned long)capture.idle_ms);
+    send_line(req, "capture_stalls_total %lu\n", (unsigned long)capture.watchdog.stalls);
+    send_line(req, "capture_recoveries_total %lu\n", (unsigned long)capture.watchdog.recoveries);
+    send_line(req, "capture_sensor_resets_total %lu\n", (unsigned long)capture.watchdog.sensor_resets);
+    send_line(req, "capture_reinits_total %lu\n", (unsigned long)capture.watchdog.reinits);
+    send_line(req, "capture_watchdog_restarts_total %lu\n", (unsigned long)capture.watchdog_restarts);
+    send_line(req, "capture_last_recovery_ms %lu\n", (unsigned long)capture.watchdog.last_recovery_ms);
+    send_line(req, "capture_max_recovery_ms %lu\n", (unsigned long)capture.watchdog.max_recovery_ms);
+    if (capture.standby_enabled) {
+        send_line(req, "capture_demand_state{state=\"%s\"} 1\n", capture_demand_state_name(capture.demand_state));
+        send_line(req, "capture_consumers %lu\n", (unsigned long)capture.consumers);
+        send_line(req, "capture_suspends_total %lu\n", (unsigned long)capture.demand.suspends);
+        send_line(req, "capture_resumes_total %lu\n", (unsigned long)capture.demand.resumes);
+        send_line(req, "capture_resume_ms %lu\n", (unsigned long)capture.demand.last_resume_ms);
+        send_line(req, "capture_resume_ms_max %lu\n", (unsigned long)capture.demand.max_resume_ms);
+        send_line(req, "capture_resume_ms_total %llu\n", (unsigned long long)capture.demand.resume_ms_total);
+        send_line(req, "capture_resumes_over_target_total %lu\n",
+                  (unsigned long)capture.demand.resumes_over_target);
+        send_line(req, "capture_standby_ms_total %llu\n", (unsigned long long)capture.demand.standby_ms);
+    }
+    send_line(req, "frame_pool_slabs %lu\n", (unsigned long)capture.pool.slab_count);
+    send_line(req, "frame_pool_in_use %lu\n", (unsigned long)capture.pool.in_use);
+    send_line(req, "frame_pool_high_water %lu\n", (unsigned long)capture.pool.high_water);
+
+    video_stream_stats_t stream;
+    video_stream_get_stats(&stream);
+    send_line(req, "stream_clients %lu\n", (unsigned long)stream.active_clients);
+    send_line(req, "stream_frames_sent_total %lu\n", (unsigned long)stream.frames_sent);
+    send_line(req, "stream_bytes_sent_total %llu\n", (unsigned long long)stream.bytes_sent);
+    send_line(req, "stream_frame_interval_avg_us %lu\n", (unsigned long)stream.frame_interval_avg_us);
+    send_line(req, "stream_frame_interval_jitter_us %lu\n", (unsigned long)stream.frame_interval_jitter_us);
+    send_line(req, "stream_frame_interval_max_us %lu\n", (unsigned long)stream.frame_interval_max_us);
+    send_line(req, "stream_queue_drops_total %lu\n", (unsigned long)stream.queue_drops);
+    send_line(req, "stream_stall_disconnects_total %lu\n", (unsigned long)stream.stall_disconnects);
+    send_line(req, "stream_frames_suppressed_total %lu\n", (unsigned long)stream.frames_suppressed);
+    send_line(req, "stream_frames_throttled_total %lu\n", (unsigned long)stream.frames_throttled);
+    send_line(req, "capture_poll_waiting %lu\n", (unsigned long)stream.poll_waiting);
+    send_line(req, "capture_poll_delivered_total %lu\n", (unsigned long)stream.poll_delivered);
+    send_line(req, "capture_poll_timeouts_total %lu\n", (unsigned long)stream.poll_timeouts);
+    send_line(req, "capture_poll_rejected_total %lu\n", (unsigned long)stream.poll_rejected);
+    send_line(req, "capture_poll_send_timeouts_total %lu\n", (unsigned long)stream.poll_send_timeouts);
+    send_line(req, "capture_poll_latency_avg_us %lu\n", (unsigned long)stream.poll_latency_avg_us);
+    send_line(req, "capture_poll_latency_max_us %lu\n", (unsigned long)stream.poll_latency_max_us);
+
+    for (int i = 0; i < STREAM_SENDER_COUNT; i++) {
+        video_stream_client_stats_t client;
+        if (!video_stream_get_client_stats(i, &client) || !client.active) {
+            continue;
+        }
+        send_line(req, "stream_client_frames_sent{sender=\"%d\",fd=\"%d\"} %lu\n", i, client.fd,
+                  (unsigned long)client.frames_sent);
+        send_line(req, "stream_client_queue_drops{sender=\"%d\",fd=\"%d\"} %lu\n", i, client.fd,
+                  (unsigned long)client.frames_dropped);
+        send_line(req, "stream_client_queued_frames{sender=\"%d\",fd=\"%d\"} %u\n", i, client.fd,
+                  (unsigned)client.queued);
+        send_line(req, "stream_client_bytes_sent{sender=\"%d\",fd=\"%d\"} %llu\n", i, client.fd,
+                  (unsigned long long)client.bytes_sent);
+    }
+
+    thumbnail_stats_t thumb;
+    thumbnail_get_stats(&thumb);
+    send_line(req, "thumb_requests_total %lu\n", (unsigned long)thumb.requests);
+    send_line(req, "thumb_cache_hits_total %lu\n", (unsigned long)thumb.cache_hits);
+    send_line(req, "thumb_failures_total %lu\n", (unsigned long)thumb.failures);
+    send_line(req, "thumb_last_build_ms %lu\n", (unsigned long)thumb.last_build_ms);
+
+    burst_stats_t burst;
+    burst_get_stats(&burst);
+    send_line(req, "burst_requests_total %lu\n", (unsigned long)burst.requests);
+    send_line(req, "burst_frames_total %lu\n", (unsigned long)burst.frames);
+    send_line(req, "burst_last_frames %lu\n", (unsigned long)burst.last_frames);
+    send_line(req, "burst_last_rate_fps %lu.%03lu\n", (unsigned long)(burst.last_rate_mfps / 1000),
+              (unsigned long)(burst.last_rate_mfps % 1000));
+
+    push_upload_stats_t push;
+    push_upload_get_stats(&push);
+    if (push.enabled) {
+        send_line(req, "push_connected %u\n", push.connected ? 1u : 0u);
+        send_line(req, "push_connects_total %lu\n", (unsigned long)push.connects);
+        send_line(req, "push_connect_failures_total %lu\n", (unsigned long)push.connect_failures);
+        send_line(req, "push_disconnects_total %lu\n", (unsigned long)push.disconnects);
+        send_line(req, "push_frames_total %lu\n", (unsigned long)push.frames_sent);
+        send_line(req, "push_frames_dropped_total %lu\n", (unsigned long)push.frames_dropped);
+        send_line(req, "push_frames_throttled_total %lu\n", (unsigned long)push.frames_throttled);
+        send_line(req, "push_batches_total %lu\n", (unsigned long)push.batches_sent);
+        send_line(req, "push_bytes_total %llu\n", (unsigned long long)push.bytes_sent);
+        send_line(req, "push_rate_kbps %lu\n", (unsigned long)push.rate_kbps);
+        send_line(req, "push_backoff_ms %lu\n", (unsigned long)push.backoff_ms);
+    }
+
+    mcast_stream_stats_t mcast;
+    mcast_stream_get_stats(&mcast);
+    if (mcast.enabled) {
+        send_line(req, "mcast_running %u\n", mcast.running ? 1u : 0u);
+        send_line(req, "mcast_frames_total %lu\n", (unsigned long)mcast.frames_sent);
+        send_line(req, "mcast_frames_dropped_total %lu\n", (unsigned long)mcast.frames_dropped);
+        send_line(req, "mcast_frames_throttled_total %lu\n", (unsigned long)mcast.frames_throttled);
+        send_line(req, "mcast_datagrams_total %lu\n", (unsigned long)mcast.datagrams_sent);
+        send_line(req, "mcast_send_errors_total %lu\n", (unsigned long)mcast.send_errors);
+        send_line(req, "mcast_bytes_total %llu\n", (unsigned long long)mcast.bytes_sent);
+        send_line(req, "mcast_rate_kbps %lu\n", (unsigned long)mcast.rate_kbps);
+    }
+
+    dram_stream_stats_t dram;
+    dram_stream_get_stats(&dram);
+    if (dram.active) {
+        send_line(req, "dram_stream_clients %lu\n", (unsigned long)dram.clients);
+        send_line(req, "dram_stream_frames_total %lu\n", (unsigned long)dram.frames_sent);
+        send_line(req, "dram_stream_frames_throttled_total %lu\n", (unsigned long)dram.frames_throttled);
+        send_line(req, "dram_stream_frames_skipped_total %lu\n", (unsigned long)dram.frames_skipped);
+        send_line(req, "dram_stream_bytes_total %llu\n", (unsigned long long)dram.bytes_sent);
+        send_line(req, "dram_stream_client_drops_total %lu\n", (unsigned long)dram.client_drops);
+        send_line(req, "dram_stream_clients_idle_total %lu\n", (unsigned long)dram.clients_idle);
+        send_line(req, "dram_stream_send_us_max %lu\n", (unsigned long)dram.send_us_max);
+    }
+
+    ota_pull_stats_t pull;
+    ota_pull_get_stats(&pull);
+    if (pull.enabled) {
+        send_line(req, "ota_pull_state{state=\"%s\"} 1\n", ota_pull_state_name(pull.state));
+        send_line(req, "ota_pull_checks_total %lu\n", (unsigned long)pull.checks);
+        send_line(req, "ota_pull_updates_total %lu\n", (unsigned long)pull.updates);
+        send_line(req, "ota_pull_failures_total %lu\n", (unsigned long)pull.failures);
+        send_line(req, "ota_pull_bytes_total %llu\n", (unsigned long long)pull.bytes_received);
+        send_line(req, "ota_pull_requests_total %lu\n", (unsigned long)pull.requests);
+        send_line(req, "ota_pull_resumes_total %lu\n", (unsigned long)pull.resumes);
+        send_line(req, "ota_pull_retries_total %lu\n", (unsigned long)pull.retries);
+        send_line(req, "ota_pull_written_bytes %lu\n", (unsigned long)pull.written);
+        send_line(req, "ota_pull_last_ms %lu\n", (unsigned long)pull.last_ms);
+        send_line(req, "ota_pull_last_rate_kbps %lu\n", (unsigned long)pull.last_rate_kbps);
+    }
+
+    qos_arbiter_stats_t qos;
+    qos_arbiter_get_stats(&qos);
+    send_line(req, "qos_policy{policy=\"%s\"} 1\n", qos_policy_mode_name(qos.mode));
+    send_line(req, "qos_ota_active %u\n", qos.ota_active ? 1u : 0u);
+    send_line(req, "qos_stream_paused %u\n", qos.decision.paused[QOS_FLOW_STREAM] ? 1u : 0u);
+    send_line(req, "qos_upload_paused %u\n", qos.decision.paused[QOS_FLOW_UPLOAD] ? 1u : 0u);
+    send_line(req, "qos_frame_interval_ms %lu\n", (unsigned long)qos.decision.frame_interval_ms);
+    send_line(req, "qos_jpeg_quality %u\n", (unsigned)qos.decision.quality);
+    send_line(req, "qos_ota_cap_kbps %lu\n", (unsigned long)qos.decision.ota_kbps);
+    send_line(req, "qos_egress_cap_kbps %lu\n", (unsigned long)qos.egress_cap_kbps);
+    send_line(req, "qos_egress_kbps %lu\n", (unsigned long)qos.egress_kbps);
+    send_line(req, "qos_decision_changes_total %lu\n", (unsigned long)qos.changes);
+
+    async_log_stats_t log;
+    async_log_get_stats(&log);
+    send_line(req, "log_lines_total %lu\n", (unsigned long)log.lines_written);
+    send_line(req, "log_lines_dropped_total %lu\n", (unsigned long)log.lines_dropped);
+    send_line(req, "log_lines_suppressed_total %lu\n", (unsigned long)log.lines_suppressed);
+
+    wifi_reconnect_stats_t wifi;
+    if (wifi_get_reconnect_stats(&wifi)) {
+        send_line(req, "wifi_reconnects_total %lu\n", (unsigned long)wifi.reconnects);
+        send_line(req, "wifi_link_lost_total %lu\n", (unsigned long)wifi.link_lost);
+        send_line(req, "wifi_reconnect_last_ms %lu\n", (unsigned long)wifi.last_latency_ms);
+        send_line(req, "wifi_reconnect_avg_ms %lu\n", (unsigned long)wifi.avg_latency_ms);
+        send_line(req, "wifi_reconnect_max_ms %lu\n", (unsigned long)wifi.max_latency_ms);
+    }
+
+    esp_err_t ret = send_task_metrics(req);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to collect task metrics: %s", esp_err_to_name(ret));
+    }
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t metrics_init(void)
+{
+    httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+        .user_ctx = NULL
+    };
+
+    return http_server_register_handler(&metrics_uri);
+}
+
+esp_err_t metrics_deinit(void)
+{
+    return http_server_unregister_handler("/metrics", HTTP_GET);
+}
@@ -0,0 +1,12 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "esp_err.h"
+
+// Register the /metrics handler (plain-text, one "name{labels} value" per line)
+esp_err_t metrics_init(void);
+
+// Unregister the /metrics handler
+esp_err_t metrics_deinit(void);
+
+#endif // METRICS_H
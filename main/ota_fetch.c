@@ -0,0 +1,751 @@
+#include "ota_fetch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define OTA_FETCH_IMAGE_MAGIC 0xE9
+#define OTA_FETCH_APP_DESC_MAGIC 0xABCD5432
+#define OTA_FETCH_CHIP_ID_OFFSET 12
+#define OTA_FETCH_APP_DESC_OFFSET 32
+#define OTA_FETCH_VERSION_OFFSET (OTA_FETCH_APP_DESC_OFFSET + 16)
+#define OTA_FETCH_PROJECT_OFFSET (OTA_FETCH_VERSION_OFFSET + 32)
+
+#define OTA_FETCH_SELECT_MS 100
+#define OTA_FETCH_RETRY_DELAY_MS 200
+#define OTA_FETCH_PACE_MAX_MS 500
+
+static uint32_t ota_fetch_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static uint32_t ota_fetch_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void ota_fetch_copy_field(char *dst, const uint8_t *src)
+{
+    size_t len = strnlen((const char *)src, OTA_FETCH_FIELD_MAX - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+bool ota_fetch_parse_image(const uint8_t *buf, size_t len, ota_fetch_image_t *image)
+{
+    if (len < OTA_FETCH_PROBE_LEN || buf[0] != OTA_FETCH_IMAGE_MAGIC ||
+        ota_fetch_le32(buf + OTA_FETCH_APP_DESC_OFFSET) != OTA_FETCH_APP_DESC_MAGIC) {
+        return false;
+    }
+    image->chip_id = buf[OTA_FETCH_CHIP_ID_OFFSET] | (buf[OTA_FETCH_CHIP_ID_OFFSET + 1] << 8);
+    ota_fetch_copy_field(image->version, buf + OTA_FETCH_VERSION_OFFSET);
+    ota_fetch_copy_field(image->project, buf + OTA_FETCH_PROJECT_OFFSET);
+    return true;
+}
+
+static const char *ota_fetch_version_digits(const char *v)
+{
+    return (*v == 'v' || *v == 'V') ? v + 1 : v;
+}
+
+int ota_fetch_version_cmp(const char *a, const char *b)
+{
+    a = ota_fetch_version_digits(a);
+    b = ota_fetch_version_digits(b);
+
+    // One component per round; a side that has run out counts as 0
+    while ((*a >= '0' && *a <= '9') || (*b >= '0' && *b <= '9')) {
+        char *end;
+        unsigned long na = 0, nb = 0;
+        if (*a >= '0' && *a <= '9') {
+            na = strtoul(a, &end, 10);
+            a = (*end == '.' && end[1] >= '0' && end[1] <= '9') ? end + 1 : "";
+        }
+        if (*b >= '0' && *b <= '9') {
+            nb = strtoul(b, &end, 10);
+            b = (*end == '.' && end[1] >= '0' && end[1] <= '9') ? end + 1 : "";
+        }
+        if (na != nb) {
+            return na < nb ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bool ota_fetch_is_newer(const char *running, const char *offered)
+{
+    const char *r = ota_fetch_version_digits(running);
+    const char *o = ota_fetch_version_digits(offered);
+
+    if (*r >= '0' && *r <= '9' && *o >= '0' && *o <= '9') {
+        return ota_fetch_version_cmp(running, offered) < 0;
+    }
+    return strcmp(running, offered) != 0;
+}
+
+int ota_fetch_request(const ota_fetch_target_t *target, uint32_t start, uint32_t end,
+                      char *buf, size_t size)
+{
+    char host[80];
+
+    if (target->port == 80) {
+        snprintf(host, sizeof(host), "%s", target->host);
+    } else {
+        snprintf(host, sizeof(host), "%s:%u", target->host, (unsigned)target->port);
+    }
+    int len = snprintf(buf, size,
+                       "GET %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "Range: bytes=%lu-%lu\r\n"
+                       "User-Agent: ESP32S3Cam-ota\r\n"
+                       "\r\n",
+                       target->path, host, (unsigned long)start, (unsigned long)(end - 1));
+    return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+// Value of a header line if it is `name`, else NULL
+static const char *ota_fetch_header(const char *line, size_t len, const char *name)
+{
+    size_t name_len = strlen(name);
+
+    if (len <= name_len || line[name_len] != ':' || strncasecmp(line, name, name_len) != 0) {
+        return NULL;
+    }
+    const char *value = line + name_len + 1;
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    return value;
+}
+
+bool ota_fetch_parse_response(const char *head, size_t len, ota_fetch_response_t *response)
+{
+    char line[160];
+    const char *p = head;
+    const char *end = head + len;
+    bool first = true;
+
+    memset(response, 0, sizeof(*response));
+    response->content_length = -1;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) {
+            eol = end;
+        }
+        const char *line_start = p;
+        size_t line_len = eol - p;
+        if (line_len > 0 && p[line_len - 1] == '\r') {
+            line_len--;
+        }
+        p = eol + 1;
+        if (line_len == 0) {
+            break;
+        }
+        // Longer lines are headers this parser has no use for
+        if (line_len >= sizeof(line)) {
+            continue;
+        }
+        memcpy(line, line_start, line_len);
+        line[line_len] = '\0';
+
+        if (first) {
+            int minor;
+            if (sscanf(line, "HTTP/1.%d %d", &minor, &response->status) != 2) {
+                return false;
+            }
+            response->keep_alive = minor >= 1;
+            first = false;
+            continue;
+        }
+
+        const char *value;
+        if ((value = ota_fetch_header(line, line_len, "Content-Length")) != NULL) {
+            response->content_length = strtoll(value, NULL, 10);
+        } else if ((value = ota_fetch_header(line, line_len, "Content-Range")) != NULL) {
+            unsigned long start, last, total;
+            if (sscanf(value, "bytes %lu-%lu/%lu", &start, &last, &total) == 3 && start <= last && last < total) {
+                response->has_range = true;
+                response->range_start = start;
+                response->range_end = last;
+                response->range_total = total;
+            }
+        } else if ((value = ota_fetch_header(line, line_len, "Connection")) != NULL) {
+            if (strncasecmp(value, "close", 5) == 0) {
+                response->keep_alive = false;
+            } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+                response->keep_alive = true;
+            }
+        }
+    }
+    return !first;
+}
+
+void ota_fetch_plan_init(ota_fetch_plan_t *plan, uint32_t size, uint32_t chunk_size, int slots)
+{
+    memset(plan, 0, sizeof(*plan));
+    plan->size = size;
+    plan->chunk_size = chunk_size;
+    plan->slots = slots;
+}
+
+bool ota_fetch_plan_next(ota_fetch_plan_t *plan, int slot, uint32_t *start, uint32_t *end)
+{
+    ota_fetch_chunk_t *chunk = &plan->chunks[slot];
+
+    if (!chunk->assigned) {
+        if (plan->next >= plan->size) {
+            return false;
+        }
+        chunk->assigned = true;
+        chunk->start = plan->next;
+        chunk->end = plan->size - plan->next > plan->chunk_size ? plan->next + plan->chunk_size : plan->size;
+        chunk->received = 0;
+        plan->next = chunk->end;
+    } else if (chunk->start + chunk->received >= chunk->end) {
+        return false;
+    }
+    *start = chunk->start + chunk->received;
+    *end = chunk->end;
+    return true;
+}
+
+void ota_fetch_plan_received(ota_fetch_plan_t *plan, int slot, uint32_t len)
+{
+    plan->chunks[slot].received += len;
+}
+
+int ota_fetch_plan_writable(const ota_fetch_plan_t *plan)
+{
+    for (int i = 0; i < plan->slots; i++) {
+        const ota_fetch_chunk_t *chunk = &plan->chunks[i];
+        if (chunk->assigned && chunk->start == plan->written && chunk->start + chunk->received == chunk->end) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ota_fetch_plan_written(ota_fetch_plan_t *plan, int slot)
+{
+    plan->written = plan->chunks[slot].end;
+    plan->chunks[slot].assigned = false;
+}
+
+bool ota_fetch_plan_done(const ota_fetch_plan_t *plan)
+{
+    return plan->written >= plan->size;
+}
+
+// Wait until the socket is writable (want_write) or readable. Returns > 0
+// when ready, 0 on timeout and < 0 on error.
+static int ota_fetch_wait(int fd, bool want_write, uint32_t timeout_ms)
+{
+    fd_set fds;
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    return select(fd + 1, want_write ? NULL : &fds, want_write ? &fds : NULL, NULL, &tv);
+}
+
+static int ota_fetch_connect(const ota_fetch_target_t *target, uint32_t timeout_ms)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    char port[6];
+
+    snprintf(port, sizeof(port), "%u", (unsigned)target->port);
+    if (getaddrinfo(target->host, port, &hints, &res) != 0 || res == NULL) {
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int ret = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (ret != 0 && errno == EINPROGRESS) {
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        if (ota_fetch_wait(fd, true, timeout_ms) > 0 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) == 0 && so_error == 0) {
+            ret = 0;
+        }
+    }
+    if (ret != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Requests are a few hundred bytes, so this only waits when the socket
+// buffer is full of a previous request the server has not read
+static bool ota_fetch_send_all(int fd, const char *data, size_t len, uint32_t timeout_ms)
+{
+    uint32_t start = ota_fetch_now_ms();
+
+    while (len > 0) {
+        int sent = send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent > 0) {
+            data += sent;
+            len -= sent;
+            continue;
+        }
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return false;
+        }
+        if (ota_fetch_now_ms() - start > timeout_ms) {
+            return false;
+        }
+        ota_fetch_wait(fd, true, OTA_FETCH_SELECT_MS);
+    }
+    return true;
+}
+
+// Length of the response head including the empty line, or 0 if incomplete
+static size_t ota_fetch_head_len(const char *buf, size_t len)
+{
+    for (size_t i = 3; i < len; i++) {
+        if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Checks a response against the requested [start, end) of an image of
+// `size` bytes (0 if not known yet)
+static ota_fetch_err_t ota_fetch_check_response(const ota_fetch_response_t *response, uint32_t start,
+                                                uint32_t end, uint32_t size)
+{
+    if (response->status == 200) {
+        return OTA_FETCH_ERR_NO_RANGES;
+    }
+    if (response->status != 206 || !response->has_range) {
+        return OTA_FETCH_ERR_HTTP;
+    }
+    if (size != 0 && response->range_total != size) {
+        return OTA_FETCH_ERR_CHANGED;
+    }
+    uint32_t last = end - 1 < response->range_total - 1 ? end - 1 : response->range_total - 1;
+    if (response->range_start != start || response->range_end != last ||
+        (response->content_length >= 0 && response->content_length != (int64_t)(last - start + 1))) {
+        return OTA_FETCH_ERR_HTTP;
+    }
+    return OTA_FETCH_OK;
+}
+
+ota_fetch_err_t ota_fetch_probe(const ota_fetch_target_t *target, uint32_t timeout_ms,
+                                ota_fetch_image_t *image, uint32_t *size)
+{
+    char head[OTA_FETCH_HEAD_MAX + OTA_FETCH_PROBE_LEN];
+    size_t len = 0;
+    size_t head_len = 0;
+    ota_fetch_response_t response;
+    ota_fetch_err_t err = OTA_FETCH_ERR_TIMEOUT;
+
+    int fd = ota_fetch_connect(target, timeout_ms);
+    if (fd < 0) {
+        return OTA_FETCH_ERR_CONNECT;
+    }
+
+    int req_len = ota_fetch_request(target, 0, OTA_FETCH_PROBE_LEN, head, sizeof(head));
+    if (req_len < 0 || !ota_fetch_send_all(fd, head, req_len, timeout_ms)) {
+        close(fd);
+        return req_len < 0 ? OTA_FETCH_ERR_HTTP : OTA_FETCH_ERR_CONNECT;
+    }
+
+    uint32_t start = ota_fetch_now_ms();
+    while (ota_fetch_now_ms() - start < timeout_ms) {
+        if (ota_fetch_wait(fd, false, OTA_FETCH_SELECT_MS) <= 0) {
+            continue;
+        }
+        int n = recv(fd, head + len, sizeof(head) - len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            err = OTA_FETCH_ERR_CONNECT;
+            break;
+        }
+        len += n;
+
+        if (head_len == 0) {
+            head_len = ota_fetch_head_len(head, len);
+            if (head_len == 0) {
+                if (len >= OTA_FETCH_HEAD_MAX) {
+                    err = OTA_FETCH_ERR_HTTP;
+                    break;
+                }
+                continue;
+            }
+            if (!ota_fetch_parse_response(head, head_len, &response)) {
+                err = OTA_FETCH_ERR_HTTP;
+                break;
+            }
+            err = ota_fetch_check_response(&response, 0, OTA_FETCH_PROBE_LEN, 0);
+            if (err != OTA_FETCH_OK) {
+                break;
+            }
+            err = OTA_FETCH_ERR_TIMEOUT;
+        }
+        size_t body_len = response.range_end + 1;
+        if (len - head_len >= body_len) {
+            *size = response.range_total;
+            err = ota_fetch_parse_image((const uint8_t *)head + head_len, body_len, image)
+                  ? OTA_FETCH_OK : OTA_FETCH_ERR_IMAGE;
+            break;
+        }
+    }
+    close(fd);
+    return err;
+}
+
+typedef enum {
+    OTA_CONN_CLOSED,
+    OTA_CONN_IDLE,                  // kept alive between requests
+    OTA_CONN_HEAD,
+    OTA_CONN_BODY
+} ota_conn_state_t;
+
+typedef struct {
+    int fd;
+    ota_conn_state_t state;
+    bool reused;                    // request sent on a kept-alive connection
+    bool keep_alive;
+    uint32_t request_start;
+    uint32_t request_end;
+    uint32_t last_progress_ms;
+    uint32_t retry_at_ms;
+    size_t head_len;
+    char head[OTA_FETCH_HEAD_MAX];
+} ota_conn_t;
+
+typedef struct {
+    const ota_fetch_config_t *config;
+    ota_fetch_plan_t plan;
+    ota_conn_t conns[OTA_FETCH_MAX_CONNECTIONS];
+    ota_fetch_result_t *result;
+    uint32_t start_ms;
+} ota_fetch_t;
+
+static void ota_conn_close(ota_conn_t *conn)
+{
+    if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    conn->state = OTA_CONN_CLOSED;
+}
+
+// The connection dropped or stalled; its chunk is continued on a new one
+static ota_fetch_err_t ota_conn_retry(ota_fetch_t *f, ota_conn_t *conn, uint32_t now_ms)
+{
+    // A kept-alive connection the server closed before answering is not
+    // a failure of the mirror
+    bool counted = !(conn->reused && conn->state == OTA_CONN_HEAD && conn->head_len == 0);
+
+    ota_conn_close(conn);
+    if (!counted) {
+        return OTA_FETCH_OK;
+    }
+    f->result->retries++;
+    conn->retry_at_ms = now_ms + OTA_FETCH_RETRY_DELAY_MS;
+    return f->result->retries > f->config->max_retries ? OTA_FETCH_ERR_TIMEOUT : OTA_FETCH_OK;
+}
+
+static uint8_t *ota_conn_buffer(ota_fetch_t *f, int slot)
+{
+    const ota_fetch_chunk_t *chunk = &f->plan.chunks[slot];
+    return f->config->buffers + (size_t)slot * f->config->chunk_size + chunk->received;
+}
+
+static ota_fetch_err_t ota_conn_request(ota_fetch_t *f, int slot, uint32_t now_ms)
+{
+    ota_conn_t *conn = &f->conns[slot];
+    uint32_t start, end;
+    char request[OTA_FETCH_REQUEST_MAX];
+
+    if ((int32_t)(now_ms - conn->retry_at_ms) < 0 || !ota_fetch_plan_next(&f->plan, slot, &start, &end)) {
+        return OTA_FETCH_OK;
+    }
+    int len = ota_fetch_request(&f->config->target, start, end, request, sizeof(request));
+    if (len < 0) {
+        return OTA_FETCH_ERR_HTTP;
+    }
+
+    conn->reused = conn->fd >= 0;
+    if (conn->fd < 0) {
+        conn->fd = ota_fetch_connect(&f->config->target, f->config->timeout_ms);
+        if (conn->fd < 0) {
+            return ota_conn_retry(f, conn, now_ms);
+        }
+        f->result->connects++;
+    }
+    conn->state = OTA_CONN_HEAD;
+    conn->head_len = 0;
+    conn->request_start = start;
+    conn->request_end = end;
+    conn->last_progress_ms = now_ms;
+    if (!ota_fetch_send_all(conn->fd, request, len, f->config->timeout_ms)) {
+        return ota_conn_retry(f, conn, now_ms);
+    }
+    f->result->requests++;
+    if (f->plan.chunks[slot].received > 0) {
+        f->result->resumes++;
+    }
+    return OTA_FETCH_OK;
+}
+
+// Body bytes for the slot's chunk. Returns false if the server sent more
+// than it announced.
+static bool ota_conn_body(ota_fetch_t *f, int slot, const uint8_t *data, size_t len)
+{
+    ota_conn_t *conn = &f->conns[slot];
+    const ota_fetch_chunk_t *chunk = &f->plan.chunks[slot];
+
+    if (len > conn->request_end - (chunk->start + chunk->received)) {
+        return false;
+    }
+    if (data != NULL) {
+        memcpy(ota_conn_buffer(f, slot), data, len);
+    }
+    ota_fetch_plan_received(&f->plan, slot, len);
+    f->result->received += len;
+    if (chunk->start + chunk->received == conn->request_end) {
+        if (conn->keep_alive) {
+            conn->state = OTA_CONN_IDLE;
+        } else {
+            ota_conn_close(conn);
+        }
+    }
+    return true;
+}
+
+static ota_fetch_err_t ota_conn_read(ota_fetch_t *f, int slot, uint32_t now_ms)
+{
+    ota_conn_t *conn = &f->conns[slot];
+    const ota_fetch_chunk_t *chunk = &f->plan.chunks[slot];
+    int n;
+
+    if (conn->state == OTA_CONN_HEAD) {
+        n = recv(conn->fd, conn->head + conn->head_len, sizeof(conn->head) - conn->head_len, 0);
+    } else {
+        n = recv(conn->fd, ota_conn_buffer(f, slot), conn->request_end - (chunk->start + chunk->received), 0);
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return OTA_FETCH_OK;
+    }
+    if (n <= 0) {
+        return ota_conn_retry(f, conn, now_ms);
+    }
+    conn->last_progress_ms = now_ms;
+
+    if (conn->state == OTA_CONN_BODY) {
+        return ota_conn_body(f, slot, NULL, n) ? OTA_FETCH_OK : ota_conn_retry(f, conn, now_ms);
+    }
+
+    conn->head_len += n;
+    size_t head_len = ota_fetch_head_len(conn->head, conn->head_len);
+    if (head_len == 0) {
+        return conn->head_len < sizeof(conn->head) ? OTA_FETCH_OK : OTA_FETCH_ERR_HTTP;
+    }
+
+    ota_fetch_response_t response;
+    if (!ota_fetch_parse_response(conn->head, head_len, &response)) {
+        return OTA_FETCH_ERR_HTTP;
+    }
+    // Overloaded or restarting mirror: try again later
+    if (response.status == 503 || response.status == 429 || response.status == 408) {
+        return ota_conn_retry(f, conn, now_ms);
+    }
+    ota_fetch_err_t err = ota_fetch_check_response(&response, conn->request_start, conn->request_end,
+                                                   f->plan.size);
+    if (err != OTA_FETCH_OK) {
+        return err;
+    }
+
+    conn->keep_alive = response.keep_alive;
+    conn->state = OTA_CONN_BODY;
+    size_t extra = conn->head_len - head_len;
+    if (extra > 0 && !ota_conn_body(f, slot, (const uint8_t *)conn->head + head_len, extra)) {
+        return ota_conn_retry(f, conn, now_ms);
+    }
+    return OTA_FETCH_OK;
+}
+
+static ota_fetch_err_t ota_fetch_step(ota_fetch_t *f)
+{
+    const ota_fetch_config_t *config = f->config;
+    uint32_t now_ms = ota_fetch_now_ms();
+    ota_fetch_err_t err;
+
+    // Hand over what is complete, in image order, before anything else: the
+    // slots cannot fetch their next chunk until theirs is written
+    int slot;
+    while ((slot = ota_fetch_plan_writable(&f->plan)) >= 0) {
+        const ota_fetch_chunk_t *chunk = &f->plan.chunks[slot];
+        if (!config->sink(config->ctx, config->buffers + (size_t)slot * config->chunk_size,
+                          chunk->end - chunk->start)) {
+            return OTA_FETCH_ERR_SINK;
+        }
+        ota_fetch_plan_written(&f->plan, slot);
+    }
+    if (ota_fetch_plan_done(&f->plan)) {
+        return OTA_FETCH_OK;
+    }
+
+    for (int i = 0; i < config->connections; i++) {
+        ota_conn_t *conn = &f->conns[i];
+        if (conn->state == OTA_CONN_CLOSED || conn->state == OTA_CONN_IDLE) {
+            if ((err = ota_conn_request(f, i, now_ms)) != OTA_FETCH_OK) {
+                return err;
+            }
+        } else if (now_ms - conn->last_progress_ms > config->timeout_ms) {
+            if ((err = ota_conn_retry(f, conn, now_ms)) != OTA_FETCH_OK) {
+                return err;
+            }
+        }
+    }
+
+    // Not reading leaves the mirror to the TCP window
+    if (config->pace != NULL) {
+        uint32_t delay_ms = config->pace(config->ctx, f->result->received, now_ms - f->start_ms);
+        if (delay_ms > 0) {
+            usleep((delay_ms > OTA_FETCH_PACE_MAX_MS ? OTA_FETCH_PACE_MAX_MS : delay_ms) * 1000);
+            return OTA_FETCH_OK;
+        }
+    }
+
+    fd_set fds;
+    int max_fd = -1;
+    FD_ZERO(&fds);
+    for (int i = 0; i < config->connections; i++) {
+        const ota_conn_t *conn = &f->conns[i];
+        if (conn->state == OTA_CONN_HEAD || conn->state == OTA_CONN_BODY) {
+            FD_SET(conn->fd, &fds);
+            max_fd = conn->fd > max_fd ? conn->fd : max_fd;
+        }
+    }
+    if (max_fd < 0) {
+        // Every connection is waiting to retry
+        usleep(OTA_FETCH_SELECT_MS * 1000);
+        return OTA_FETCH_OK;
+    }
+
+    struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = OTA_FETCH_SELECT_MS * 1000,
+    };
+    if (select(max_fd + 1, &fds, NULL, NULL, &tv) <= 0) {
+        return OTA_FETCH_OK;
+    }
+    now_ms = ota_fetch_now_ms();
+    for (int i = 0; i < config->connections; i++) {
+        ota_conn_t *conn = &f->conns[i];
+        if ((conn->state == OTA_CONN_HEAD || conn->state == OTA_CONN_BODY) && FD_ISSET(conn->fd, &fds)) {
+            if ((err = ota_conn_read(f, i, now_ms)) != OTA_FETCH_OK) {
+                return err;
+            }
+        }
+    }
+    return OTA_FETCH_OK;
+}
+
+ota_fetch_err_t ota_fetch_run(const ota_fetch_config_t *config, uint32_t size, ota_fetch_result_t *result)
+{
+    // About 1 KB per connection, off the caller's stack
+    ota_fetch_t *f = calloc(1, sizeof(*f));
+    if (f == NULL) {
+        return OTA_FETCH_ERR_NO_MEM;
+    }
+
+    memset(result, 0, sizeof(*result));
+    f->config = config;
+    f->result = result;
+    f->start_ms = ota_fetch_now_ms();
+    ota_fetch_plan_init(&f->plan, size, config->chunk_size, config->connections);
+    for (int i = 0; i < OTA_FETCH_MAX_CONNECTIONS; i++) {
+        f->conns[i].fd = -1;
+        f->conns[i].retry_at_ms = f->start_ms;
+    }
+
+    ota_fetch_err_t err = OTA_FETCH_OK;
+    while (!ota_fetch_plan_done(&f->plan)) {
+        if (config->cancel != NULL && *config->cancel) {
+            err = OTA_FETCH_ERR_CANCELLED;
+            break;
+        }
+        if ((err = ota_fetch_step(f)) != OTA_FETCH_OK) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < OTA_FETCH_MAX_CONNECTIONS; i++) {
+        ota_conn_close(&f->conns[i]);
+    }
+    result->elapsed_ms = ota_fetch_now_ms() - f->start_ms;
+    free(f);
+
+    if (result->elapsed_ms > 0) {
+        result->rate_kbps = (uint32_t)(result->received * 8 / result->elapsed_ms);
+    }
+    return err;
+}
+
+const char *ota_fetch_err_name(ota_fetch_err_t err)
+{
+    switch (err) {
+    case OTA_FETCH_OK:
+        return "ok";
+    case OTA_FETCH_ERR_CONNECT:
+        return "connect";
+    case OTA_FETCH_ERR_HTTP:
+        return "http";
+    case OTA_FETCH_ERR_NO_RANGES:
+        return "no_ranges";
+    case OTA_FETCH_ERR_CHANGED:
+        return "changed";
+    case OTA_FETCH_ERR_IMAGE:
+        return "image";
+    case OTA_FETCH_ERR_TIMEOUT:
+        return "timeout";
+    case OTA_FETCH_ERR_SINK:
+        return "sink";
+    case OTA_FETCH_ERR_NO_MEM:
+        return "no_mem";
+    case OTA_FETCH_ERR_CANCELLED:
+        return "cancelled";
+    }
+    return "unknown";
+}
@@ -0,0 +1,164 @@
+#ifndef OTA_FETCH_H
+#define OTA_FETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Firmware download from an HTTP mirror with range requests.
+//
+// The image is split into chunks, one per connection at a time: each
+// connection fetches its chunk with "Range: bytes=a-b" into its own buffer,
+// and the chunks are handed to the sink strictly in image order, so the
+// next ones are already downloading while one is written to flash. A
+// connection that drops or stalls reconnects and asks for the rest of its
+// chunk only. Before downloading, the first bytes of the image are fetched
+// to read its app description (project, version) from the header.
+//
+// Uses only POSIX sockets, which lwIP provides on the device, so the same
+// code runs against a mirror from a Linux host.
+
+#define OTA_FETCH_MAX_CONNECTIONS 4
+#define OTA_FETCH_HEAD_MAX 1024     // response status line and headers
+#define OTA_FETCH_REQUEST_MAX 256
+#define OTA_FETCH_FIELD_MAX 32      // version and project name, with the NUL
+
+// esp_image_header_t (24 bytes), the first esp_image_segment_header_t (8)
+// and esp_app_desc_t (256)
+#define OTA_FETCH_PROBE_LEN 288
+
+typedef enum {
+    OTA_FETCH_OK,
+    OTA_FETCH_ERR_CONNECT,          // cannot resolve or connect
+    OTA_FETCH_ERR_HTTP,             // not a 206 for the requested range
+    OTA_FETCH_ERR_NO_RANGES,        // the mirror ignores Range
+    OTA_FETCH_ERR_CHANGED,          // the image size changed during the download
+    OTA_FETCH_ERR_IMAGE,            // no app description in the header
+    OTA_FETCH_ERR_TIMEOUT,          // out of retries
+    OTA_FETCH_ERR_SINK,             // the sink refused a chunk
+    OTA_FETCH_ERR_NO_MEM,
+    OTA_FETCH_ERR_CANCELLED
+} ota_fetch_err_t;
+
+typedef struct {
+    const char *host;
+    uint16_t port;
+    const char *path;
+} ota_fetch_target_t;
+
+typedef struct {
+    uint16_t chip_id;               // esp_chip_id_t
+    char version[OTA_FETCH_FIELD_MAX];
+    char project[OTA_FETCH_FIELD_MAX];
+} ota_fetch_image_t;
+
+typedef struct {
+    int status;
+    int64_t content_length;         // -1 if absent
+    bool has_range;                 // Content-Range: bytes start-end/total
+    uint32_t range_start;
+    uint32_t range_end;             // inclusive
+    uint32_t range_total;
+    bool keep_alive;
+} ota_fetch_response_t;
+
+// Chunk a connection is working on; the image range [start, end)
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t received;
+    bool assigned;
+} ota_fetch_chunk_t;
+
+typedef struct {
+    uint32_t size;
+    uint32_t chunk_size;
+    int slots;
+    uint32_t next;                  // first byte not assigned to a chunk
+    uint32_t written;               // bytes handed to the sink
+    ota_fetch_chunk_t chunks[OTA_FETCH_MAX_CONNECTIONS];
+} ota_fetch_plan_t;
+
+// Chunks of the image in order. Returns false to abort the download.
+typedef bool (*ota_fetch_sink_fn)(void *ctx, const uint8_t *data, size_t len);
+
+// How long to hold off reading, given the bytes received so far; NULL reads
+// at full speed
+typedef uint32_t (*ota_fetch_pace_fn)(void *ctx, uint64_t received, uint32_t elapsed_ms);
+
+typedef struct {
+    ota_fetch_target_t target;
+    int connections;                // 1..OTA_FETCH_MAX_CONNECTIONS
+    uint32_t chunk_size;
+    uint8_t *buffers;               // connections * chunk_size
+    uint32_t timeout_ms;            // without progress on a connection
+    uint32_t max_retries;           // reconnects over the whole download
+    ota_fetch_sink_fn sink;
+    ota_fetch_pace_fn pace;
+    void *ctx;
+    volatile bool *cancel;          // optional, polled between reads
+} ota_fetch_config_t;
+
+typedef struct {
+    uint64_t received;              // body bytes, including re-fetched ones
+    uint32_t elapsed_ms;
+    uint32_t rate_kbps;
+    uint32_t requests;
+    uint32_t resumes;               // requests continuing a partial chunk
+    uint32_t connects;
+    uint32_t retries;               // dropped or stalled connections
+} ota_fetch_result_t;
+
+// Image header
+
+bool ota_fetch_parse_image(const uint8_t *buf, size_t len, ota_fetch_image_t *image);
+
+// Compares dotted numeric versions ("1.10.2", "v2.0-rc1" as 2.0);
+// missing components count as 0
+int ota_fetch_version_cmp(const char *a, const char *b);
+
+// Whether `offered` should replace `running`: newer by number when both
+// start with a number, otherwise (git hashes, ...) just different
+bool ota_fetch_is_newer(const char *running, const char *offered);
+
+// HTTP
+
+// GET request head for [start, end). Returns the length, or -1 if it does
+// not fit.
+int ota_fetch_request(const ota_fetch_target_t *target, uint32_t start, uint32_t end,
+                      char *buf, size_t size);
+
+// Parses a response head, status line to the empty line
+bool ota_fetch_parse_response(const char *head, size_t len, ota_fetch_response_t *response);
+
+// Chunk planning, one slot per connection
+
+void ota_fetch_plan_init(ota_fetch_plan_t *plan, uint32_t size, uint32_t chunk_size, int slots);
+
+// Range the slot's connection should request next: the rest of its chunk
+// after a dropped connection, or a new chunk once the previous one has been
+// written. Returns false while its chunk waits to be written or nothing is
+// left to assign.
+bool ota_fetch_plan_next(ota_fetch_plan_t *plan, int slot, uint32_t *start, uint32_t *end);
+
+void ota_fetch_plan_received(ota_fetch_plan_t *plan, int slot, uint32_t len);
+
+// Slot holding the complete chunk that comes next in the image, or -1
+int ota_fetch_plan_writable(const ota_fetch_plan_t *plan);
+
+void ota_fetch_plan_written(ota_fetch_plan_t *plan, int slot);
+
+bool ota_fetch_plan_done(const ota_fetch_plan_t *plan);
+
+// Network
+
+// Reads the image header and size from the mirror
+ota_fetch_err_t ota_fetch_probe(const ota_fetch_target_t *target, uint32_t timeout_ms,
+                                ota_fetch_image_t *image, uint32_t *size);
+
+// Downloads `size` bytes into the sink
+ota_fetch_err_t ota_fetch_run(const ota_fetch_config_t *config, uint32_t size, ota_fetch_result_t *result);
+
+const char *ota_fetch_err_name(ota_fetch_err_t err);
+
+#endif // OTA_FETCH_H
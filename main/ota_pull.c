@@ -0,0 +1,456 @@
+#include "ota_pull.h"
+#include "ota_fetch.h"
+#include "ota_update.h"
+#include "push_proto.h"
+#include "http_server.h"
+#include "qos_arbiter.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_APP_OTA_PULL
+
+static const char *TAG = "ota_pull";
+
+#define OTA_PULL_CONNECTIONS CONFIG_APP_OTA_PULL_CONNECTIONS
+#define OTA_PULL_CHUNK_SIZE (CONFIG_APP_OTA_PULL_CHUNK_KB * 1024)
+#define OTA_PULL_TIMEOUT_MS CONFIG_APP_OTA_PULL_TIMEOUT_MS
+#define OTA_PULL_RETRIES CONFIG_APP_OTA_PULL_RETRIES
+#define OTA_PULL_INTERVAL_MS (CONFIG_APP_OTA_PULL_INTERVAL_MIN * 60 * 1000)
+#define OTA_PULL_FIRST_CHECK_MS 60000   // let the boot settle before the first periodic check
+#define OTA_PULL_RESTART_DELAY_MS 2000
+#define OTA_PULL_CHECK_BIT BIT0
+#define OTA_PULL_STOPPED_BIT BIT1
+
+static push_proto_target_t s_target;
+static volatile bool s_running = false;
+static volatile bool s_cancel = false;
+static volatile bool s_force = false;
+static EventGroupHandle_t s_events = NULL;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static ota_pull_stats_t s_stats;
+
+typedef struct {
+    esp_ota_handle_t handle;
+    uint32_t next_log;
+} ota_pull_write_t;
+
+static uint32_t ota_pull_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void ota_pull_set_state(ota_pull_state_t state, const char *error)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.state = state;
+    if (state == OTA_PULL_FAILED) {
+        s_stats.failures++;
+        s_stats.last_error = error;
+    } else if (state == OTA_PULL_CHECKING) {
+        s_stats.checks++;
+        s_stats.last_error = NULL;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static bool ota_pull_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    ota_pull_write_t *w = ctx;
+
+    esp_err_t err = esp_ota_write(w->handle, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.written += len;
+    uint32_t written = s_stats.written;
+    uint32_t size = s_stats.image_size;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (written >= w->next_log) {
+        ESP_LOGI(TAG, "Progress: %lu/%lu bytes (%lu%%)", (unsigned long)written, (unsigned long)size,
+                 (unsigned long)((uint64_t)written * 100 / size));
+        w->next_log += size / 10;
+    }
+    return true;
+}
+
+static uint32_t ota_pull_pace(void *ctx, uint64_t received, uint32_t elapsed_ms)
+{
+    return qos_arbiter_ota_delay_ms(received, elapsed_ms);
+}
+
+// Download `size` bytes into the next OTA partition and make it the boot
+// partition. Returns the reason on failure.
+static const char *ota_pull_download(const esp_partition_t *partition, uint32_t size)
+{
+    ota_pull_write_t w = {
+        .next_log = size / 10,
+    };
+    ota_fetch_result_t result;
+
+    // One chunk per connection; the sink writes one while the others fill
+    uint8_t *buffers = heap_caps_malloc(OTA_PULL_CONNECTIONS * OTA_PULL_CHUNK_SIZE, MALLOC_CAP_SPIRAM);
+    if (buffers == NULL) {
+        buffers = heap_caps_malloc(OTA_PULL_CONNECTIONS * OTA_PULL_CHUNK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (buffers == NULL) {
+        return "no memory for chunk buffers";
+    }
+
+    // Sectors are erased as the writes reach them instead of all up front,
+    // so the erase overlaps the download
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &w.handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        heap_caps_free(buffers);
+        return "esp_ota_begin failed";
+    }
+
+    ota_fetch_config_t config = {
+        .target = {
+            .host = s_target.host,
+            .port = s_target.port,
+            .path = s_target.path,
+        },
+        .connections = OTA_PULL_CONNECTIONS,
+        .chunk_size = OTA_PULL_CHUNK_SIZE,
+        .buffers = buffers,
+        .timeout_ms = OTA_PULL_TIMEOUT_MS,
+        .max_retries = OTA_PULL_RETRIES,
+        .sink = ota_pull_sink,
+        .pace = ota_pull_pace,
+        .ctx = &w,
+        .cancel = &s_cancel,
+    };
+
+    // Streams and the uploader make room as for an upload to /ota
+    qos_arbiter_ota_begin();
+    ota_fetch_err_t fetch_err = ota_fetch_run(&config, size, &result);
+    qos_arbiter_ota_end();
+    heap_caps_free(buffers);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.bytes_received += result.received;
+    s_stats.requests += result.requests;
+    s_stats.resumes += result.resumes;
+    s_stats.retries += result.retries;
+    s_stats.last_ms = result.elapsed_ms;
+    s_stats.last_rate_kbps = result.rate_kbps;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (fetch_err != OTA_FETCH_OK) {
+        ESP_LOGE(TAG, "Download failed after %lu ms: %s", (unsigned long)result.elapsed_ms,
+                 ota_fetch_err_name(fetch_err));
+        esp_ota_abort(w.handle);
+        return ota_fetch_err_name(fetch_err);
+    }
+    ESP_LOGI(TAG, "Downloaded %lu bytes in %lu ms (%lu kbit/s): %lu requests on %lu connections, "
+             "%lu resumed, %lu retries", (unsigned long)size, (unsigned long)result.elapsed_ms,
+             (unsigned long)result.rate_kbps, (unsigned long)result.requests, (unsigned long)result.connects,
+             (unsigned long)result.resumes, (unsigned long)result.retries);
+
+    // Verifies the image, as for /ota
+    err = esp_ota_end(w.handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        return "image verification failed";
+    }
+    err = esp_ota_set_boot_partition(partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return "cannot set boot partition";
+    }
+    return NULL;
+}
+
+static void ota_pull_run(bool force)
+{
+    const esp_app_desc_t *running = esp_app_get_description();
+    ota_fetch_target_t target = {
+        .host = s_target.host,
+        .port = s_target.port,
+        .path = s_target.path,
+    };
+    ota_fetch_image_t image;
+    uint32_t size = 0;
+
+    ota_pull_set_state(OTA_PULL_CHECKING, NULL);
+    ota_fetch_err_t fetch_err = ota_fetch_probe(&target, OTA_PULL_TIMEOUT_MS, &image, &size);
+    if (fetch_err != OTA_FETCH_OK) {
+        ESP_LOGW(TAG, "Cannot read the image header from %s: %s", CONFIG_APP_OTA_PULL_URL,
+                 ota_fetch_err_name(fetch_err));
+        ota_pull_set_state(OTA_PULL_FAILED, ota_fetch_err_name(fetch_err));
+        return;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    snprintf(s_stats.mirror_version, sizeof(s_stats.mirror_version), "%s", image.version);
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (image.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID || strcmp(image.project, running->project_name) != 0) {
+        ESP_LOGW(TAG, "Mirror image is %s for chip %u, not %s for chip %u", image.project,
+                 (unsigned)image.chip_id, running->project_name, (unsigned)CONFIG_IDF_FIRMWARE_CHIP_ID);
+        ota_pull_set_state(OTA_PULL_FAILED, "image for another project or chip");
+        return;
+    }
+    if (!force && !ota_fetch_is_newer(running->version, image.version)) {
+        ESP_LOGI(TAG, "Up to date: running %s, mirror has %s", running->version, image.version);
+        ota_pull_set_state(OTA_PULL_UP_TO_DATE, NULL);
+        return;
+    }
+
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL || size > partition->size) {
+        ESP_LOGE(TAG, "Image of %lu bytes does not fit the OTA partition", (unsigned long)size);
+        ota_pull_set_state(OTA_PULL_FAILED, "image too large");
+        return;
+    }
+    if (!ota_update_claim()) {
+        ota_pull_set_state(OTA_PULL_FAILED, "another update is in progress");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Updating %s -> %s from %s (%lu bytes) into %s", running->version, image.version,
+             CONFIG_APP_OTA_PULL_URL, (unsigned long)size, partition->label);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.state = OTA_PULL_DOWNLOADING;
+    s_stats.image_size = size;
+    s_stats.written = 0;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    const char *error = ota_pull_download(partition, size);
+    ota_update_release();
+    if (error != NULL) {
+        ota_pull_set_state(OTA_PULL_FAILED, error);
+        return;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.updates++;
+    s_stats.state = OTA_PULL_REBOOTING;
+    portEXIT_CRITICAL(&s_stats_lock);
+    ESP_LOGI(TAG, "Update to %s successful, restarting in 2 seconds...", image.version);
+    vTaskDelay(pdMS_TO_TICKS(OTA_PULL_RESTART_DELAY_MS));
+    esp_restart();
+}
+
+static void ota_pull_task(void *pvParameters)
+{
+    uint32_t next_check_ms = ota_pull_now_ms() + OTA_PULL_FIRST_CHECK_MS;
+
+    while (s_running) {
+        TickType_t wait = portMAX_DELAY;
+        if (OTA_PULL_INTERVAL_MS > 0) {
+            int32_t left = (int32_t)(next_check_ms - ota_pull_now_ms());
+            wait = left > 0 ? pdMS_TO_TICKS(left) : 0;
+        }
+        EventBits_t bits = xEventGroupWaitBits(s_events, OTA_PULL_CHECK_BIT, pdTRUE, pdFALSE, wait);
+        if (!s_running) {
+            break;
+        }
+
+        bool requested = (bits & OTA_PULL_CHECK_BIT) != 0;
+        if (!requested && (OTA_PULL_INTERVAL_MS == 0 || (int32_t)(next_check_ms - ota_pull_now_ms()) > 0)) {
+            continue;
+        }
+        bool force = requested && s_force;
+        s_force = false;
+        ota_pull_run(force);
+        next_check_ms = ota_pull_now_ms() + OTA_PULL_INTERVAL_MS;
+    }
+
+    xEventGroupSetBits(s_events, OTA_PULL_STOPPED_BIT);
+    vTaskDelete(NULL);
+}
+
+esp_err_t ota_pull_check(bool force)
+{
+    if (!s_running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    ota_pull_state_t state = s_stats.state;
+    portEXIT_CRITICAL(&s_stats_lock);
+    if (state == OTA_PULL_CHECKING || state == OTA_PULL_DOWNLOADING || state == OTA_PULL_REBOOTING) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_force = force;
+    xEventGroupSetBits(s_events, OTA_PULL_CHECK_BIT);
+    return ESP_OK;
+}
+
+// GET /ota/pull reports the last check; ?check=1 checks now and installs a
+// newer image, ?force=1 installs whatever the mirror has
+static esp_err_t ota_pull_handler(httpd_req_t *req)
+{
+    char query[32] = "";
+    char value[4];
+    char json[512];
+    ota_pull_stats_t stats;
+    esp_err_t err = ESP_OK;
+    bool requested = false;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "force", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0) {
+        err = ota_pull_check(true);
+        requested = true;
+    } else if (httpd_query_key_value(query, "check", value, sizeof(value)) == ESP_OK && strcmp(value, "1") == 0) {
+        err = ota_pull_check(false);
+        requested = true;
+    }
+    if (requested && err != ESP_OK) {
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "A check is already running", HTTPD_RESP_USE_STRLEN);
+    }
+
+    ota_pull_get_stats(&stats);
+    snprintf(json, sizeof(json),
+             "{\"state\":\"%s\",\"requested\":%s,\"running\":\"%s\",\"mirror\":\"%s\",\"url\":\"%s\","
+             "\"checks\":%lu,\"updates\":%lu,\"failures\":%lu,\"last_error\":\"%s\","
+             "\"size\":%lu,\"written\":%lu,\"requests\":%lu,\"resumes\":%lu,\"retries\":%lu,"
+             "\"last_ms\":%lu,\"last_rate_kbps\":%lu}",
+             ota_pull_state_name(stats.state), requested ? "true" : "false", esp_app_get_description()->version,
+             stats.mirror_version, CONFIG_APP_OTA_PULL_URL, (unsigned long)stats.checks,
+             (unsigned long)stats.updates, (unsigned long)stats.failures,
+             stats.last_error != NULL ? stats.last_error : "", (unsigned long)stats.image_size,
+             (unsigned long)stats.written, (unsigned long)stats.requests, (unsigned long)stats.resumes,
+             (unsigned long)stats.retries, (unsigned long)stats.last_ms, (unsigned long)stats.last_rate_kbps);
+
+    if (requested) {
+        httpd_resp_set_status(req, "202 Accepted");
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t ota_pull_start(void)
+{
+    if (s_running) {
+        return ESP_OK;
+    }
+
+    if (!push_proto_parse_url(CONFIG_APP_OTA_PULL_URL, &s_target) || s_target.mode != PUSH_PROTO_HTTP) {
+        ESP_LOGE(TAG, "Invalid mirror URL \"%s\"", CONFIG_APP_OTA_PULL_URL);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_events == NULL) {
+        s_events = xEventGroupCreate();
+        if (s_events == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xEventGroupClearBits(s_events, OTA_PULL_CHECK_BIT | OTA_PULL_STOPPED_BIT);
+    s_stats.enabled = true;
+    s_cancel = false;
+    s_running = true;
+    if (xTaskCreatePinnedToCore(ota_pull_task, "ota_pull", OTA_PULL_TASK_STACK_SIZE, NULL,
+                                OTA_PULL_TASK_PRIORITY, NULL, OTA_PULL_TASK_CORE) != pdPASS) {
+        s_running = false;
+        ESP_LOGE(TAG, "Failed to create pull OTA task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_uri_t pull_uri = {
+        .uri = "/ota/pull",
+        .method = HTTP_GET,
+        .handler = ota_pull_handler,
+        .user_ctx = NULL
+    };
+    if (http_server_register_handler(&pull_uri) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to register /ota/pull, periodic checks only");
+    }
+
+    ESP_LOGI(TAG, "Pull OTA from %s, %s", CONFIG_APP_OTA_PULL_URL,
+             OTA_PULL_INTERVAL_MS > 0 ? "checked periodically" : "checked on request");
+    return ESP_OK;
+}
+
+esp_err_t ota_pull_stop(void)
+{
+    if (!s_running) {
+        return ESP_OK;
+    }
+
+    http_server_unregister_handler("/ota/pull", HTTP_GET);
+    s_running = false;
+    s_cancel = true;
+    xEventGroupSetBits(s_events, OTA_PULL_CHECK_BIT);
+    // Bounded by the probe timeout or one step of a download
+    xEventGroupWaitBits(s_events, OTA_PULL_STOPPED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    if (s_stats.state == OTA_PULL_CHECKING || s_stats.state == OTA_PULL_DOWNLOADING) {
+        s_stats.state = OTA_PULL_IDLE;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    ESP_LOGI(TAG, "Pull OTA stopped");
+    return ESP_OK;
+}
+
+void ota_pull_get_stats(ota_pull_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#else // CONFIG_APP_OTA_PULL
+
+esp_err_t ota_pull_start(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t ota_pull_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t ota_pull_check(bool force)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void ota_pull_get_stats(ota_pull_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_APP_OTA_PULL
+
+const char *ota_pull_state_name(ota_pull_state_t state)
+{
+    switch (state) {
+    case OTA_PULL_IDLE:
+        return "idle";
+    case OTA_PULL_CHECKING:
+        return "checking";
+    case OTA_PULL_DOWNLOADING:
+        return "downloading";
+    case OTA_PULL_UP_TO_DATE:
+        return "up_to_date";
+    case OTA_PULL_FAILED:
+        return "failed";
+    case OTA_PULL_REBOOTING:
+        return "rebooting";
+    }
+    return "unknown";
+}
@@ -0,0 +1,61 @@
+#ifndef OTA_PULL_H
+#define OTA_PULL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Pull OTA, see "ESP32S3Cam Pull OTA" in menuconfig.
+//
+// The device checks CONFIG_APP_OTA_PULL_URL on a local mirror every
+// CONFIG_APP_OTA_PULL_INTERVAL_MIN minutes or when asked through
+// GET /ota/pull?check=1. The image header is read first, and only an image
+// for this project and chip with a newer version is downloaded: over
+// several connections with range requests (ota_fetch.h), written to the
+// next OTA partition while the following chunks arrive. The device then
+// boots into it. ota_mirror.py is a mirror for the LAN.
+
+typedef enum {
+    OTA_PULL_IDLE,
+    OTA_PULL_CHECKING,
+    OTA_PULL_DOWNLOADING,
+    OTA_PULL_UP_TO_DATE,
+    OTA_PULL_FAILED,
+    OTA_PULL_REBOOTING
+} ota_pull_state_t;
+
+typedef struct {
+    bool enabled;
+    ota_pull_state_t state;
+    char mirror_version[32];        // from the last check, empty if none
+    const char *last_error;         // why the last check failed, or NULL
+    uint32_t checks;
+    uint32_t updates;               // images downloaded and activated
+    uint32_t failures;
+    uint32_t image_size;            // of the current or last download
+    uint32_t written;               // bytes of it in flash
+    uint64_t bytes_received;        // all downloads, re-fetched bytes included
+    uint32_t requests;
+    uint32_t resumes;               // range requests continuing a dropped chunk
+    uint32_t retries;               // connections dropped or stalled
+    uint32_t last_ms;               // duration of the last download
+    uint32_t last_rate_kbps;
+} ota_pull_stats_t;
+
+// Start the check task and register GET /ota/pull. Returns
+// ESP_ERR_NOT_SUPPORTED when pull OTA is disabled and ESP_ERR_INVALID_ARG
+// for a malformed URL.
+esp_err_t ota_pull_start(void);
+
+// Cancel a download, stop the task and unregister the endpoint
+esp_err_t ota_pull_stop(void);
+
+// Ask the task to check the mirror now. With force the image is installed
+// even if it is not newer. ESP_ERR_INVALID_STATE while a check is running.
+esp_err_t ota_pull_check(bool force);
+
+void ota_pull_get_stats(ota_pull_stats_t *stats);
+
+const char *ota_pull_state_name(ota_pull_state_t state);
+
+#endif // OTA_PULL_H
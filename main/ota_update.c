@@ -1,16 +1,37 @@
 #include "ota_update.h"
 #include "http_server.h"
+#include "qos_arbiter.h"
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "esp_ota_ops.h"
 #include "esp_flash_partitions.h"
 #include "esp_partition.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 static const char *TAG = "OTA";
 
-esp_err_t ota_handler(httpd_req_t *req)
+static portMUX_TYPE s_claim_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_claimed = false;
+
+bool ota_update_claim(void)
+{
+    portENTER_CRITICAL(&s_claim_lock);
+    bool claimed = !s_claimed;
+    s_claimed = true;
+    portEXIT_CRITICAL(&s_claim_lock);
+    return claimed;
+}
+
+void ota_update_release(void)
+{
+    portENTER_CRITICAL(&s_claim_lock);
+    s_claimed = false;
+    portEXIT_CRITICAL(&s_claim_lock);
+}
+
+static esp_err_t ota_receive(httpd_req_t *req)
 {
     esp_ota_handle_t ota_handle = 0;
     const esp_partition_t *ota_partition = NULL;
@@ -49,6 +70,7 @@ esp_err_t ota_handler(httpd_req_t *req)
     char buffer[1024];
     int data_read;
     size_t total_received = 0;
+    int64_t start_us = esp_timer_get_time();
 
     while (remaining > 0)
     {
@@ -83,6 +105,15 @@ esp_err_t ota_handler(httpd_req_t *req)
         remaining -= data_read;
         total_received += data_read;
 
+        // Under the stream-first policy the image is received at a capped
+        // rate; the sender is slowed down by the TCP window
+        uint32_t delay_ms = qos_arbiter_ota_delay_ms(total_received,
+                                                     (uint32_t)((esp_timer_get_time() - start_us) / 1000));
+        if (delay_ms > 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(delay_ms));
+        }
+
         // Log progress every 64KB
         if (total_received % (64 * 1024) == 0 || remaining == 0)
         {
@@ -120,6 +151,24 @@ esp_err_t ota_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+esp_err_t ota_handler(httpd_req_t *req)
+{
+    if (!ota_update_claim())
+    {
+        ESP_LOGW(TAG, "Rejecting OTA upload, another update is in progress");
+        httpd_resp_set_status(req, "409 Conflict");
+        return httpd_resp_send(req, "Another update is in progress", HTTPD_RESP_USE_STRLEN);
+    }
+
+    // Streams and the uploader are paused, degraded or left alone for the
+    // duration of the transfer, depending on the bandwidth policy
+    qos_arbiter_ota_begin();
+    esp_err_t err = ota_receive(req);
+    qos_arbiter_ota_end();
+    ota_update_release();
+    return err;
+}
+
 esp_err_t ota_init(void)
 {
     ESP_LOGI(TAG, "Initializing OTA functionality...");
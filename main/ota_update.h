@@ -1,6 +1,7 @@
 #ifndef OTA_UPDATE_H
 #define OTA_UPDATE_H
 
+#include <stdbool.h>
 #include "esp_err.h"
 
 // Initialize OTA functionality (registers OTA handler with HTTP server)
@@ -9,6 +10,11 @@ esp_err_t ota_init(void);
 // Remove OTA functionality (unregisters OTA handler)
 esp_err_t ota_deinit(void);
 
+// Only one update writes the OTA partition at a time: /ota and pull OTA
+// (ota_pull.h) claim it first. Returns false if the other one holds it.
+bool ota_update_claim(void);
+void ota_update_release(void);
+
 // Legacy function for backward compatibility
 void start_ota_update(void);
 
@@ -0,0 +1,154 @@
+#include "push_batch.h"
+#include <stdio.h>
+#include <string.h>
+
+// Room for the chunk-size line in front of the payload and "\r\n" after it,
+// so a sealed batch is one contiguous write
+#define PUSH_BATCH_CHUNK_RESERVE 10
+#define PUSH_BATCH_CHUNK_TRAILER 2
+
+void push_batch_init(push_batch_t *batch, uint8_t *buf, size_t capacity)
+{
+    batch->buf = buf;
+    batch->capacity = capacity;
+    push_batch_reset(batch);
+}
+
+void push_batch_reset(push_batch_t *batch)
+{
+    batch->len = 0;
+    batch->frames = 0;
+    batch->first_ms = 0;
+}
+
+size_t push_batch_max_payload(const push_batch_t *batch)
+{
+    size_t overhead = PUSH_BATCH_CHUNK_RESERVE + PUSH_BATCH_CHUNK_TRAILER;
+    return batch->capacity > overhead ? batch->capacity - overhead : 0;
+}
+
+bool push_batch_append(push_batch_t *batch, const void *hdr, size_t hdr_len, const void *body, size_t body_len,
+                       const void *trailer, size_t trailer_len, uint32_t now_ms)
+{
+    size_t need = hdr_len + body_len + trailer_len;
+    if (need > push_batch_max_payload(batch) - batch->len) {
+        return false;
+    }
+
+    uint8_t *p = batch->buf + PUSH_BATCH_CHUNK_RESERVE + batch->len;
+    memcpy(p, hdr, hdr_len);
+    memcpy(p + hdr_len, body, body_len);
+    memcpy(p + hdr_len + body_len, trailer, trailer_len);
+    batch->len += need;
+
+    if (batch->frames++ == 0) {
+        batch->first_ms = now_ms;
+    }
+    return true;
+}
+
+bool push_batch_due(const push_batch_t *batch, uint32_t now_ms, uint32_t max_age_ms)
+{
+    return batch->frames > 0 && now_ms - batch->first_ms >= max_age_ms;
+}
+
+void push_batch_seal(push_batch_t *batch, bool chunked, push_out_t *out)
+{
+    uint8_t *payload = batch->buf + PUSH_BATCH_CHUNK_RESERVE;
+    uint8_t *start = payload;
+    size_t len = batch->len;
+
+    if (chunked) {
+        // Right-align the chunk-size line against the payload
+        char line[PUSH_BATCH_CHUNK_RESERVE + 1];
+        int line_len = snprintf(line, sizeof(line), "%x\r\n", (unsigned)len);
+        start = payload - line_len;
+        memcpy(start, line, line_len);
+        memcpy(payload + len, "\r\n", 2);
+        len += line_len + 2;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->segs[0].data = start;
+    out->segs[0].len = len;
+    out->count = 1;
+    out->frames = batch->frames;
+}
+
+void push_out_frame(push_out_t *out, frame_t *frame, const void *hdr, size_t hdr_len,
+                    const void *trailer, size_t trailer_len, bool chunked)
+{
+    memset(out, 0, sizeof(*out));
+    if (hdr_len > sizeof(out->part_hdr)) {
+        hdr_len = sizeof(out->part_hdr);
+    }
+    memcpy(out->part_hdr, hdr, hdr_len);
+    out->frame = frame;
+    out->frames = 1;
+
+    if (chunked) {
+        int len = snprintf(out->chunk_hdr, sizeof(out->chunk_hdr), "%x\r\n",
+                           (unsigned)(hdr_len + frame->len + trailer_len));
+        out->segs[out->count++] = (push_seg_t){ (const uint8_t *)out->chunk_hdr, (size_t)len };
+    }
+    out->segs[out->count++] = (push_seg_t){ (const uint8_t *)out->part_hdr, hdr_len };
+    out->segs[out->count++] = (push_seg_t){ frame->data, frame->len };
+    if (trailer_len > 0) {
+        out->segs[out->count++] = (push_seg_t){ trailer, trailer_len };
+    }
+    if (chunked) {
+        out->segs[out->count++] = (push_seg_t){ (const uint8_t *)"\r\n", 2 };
+    }
+}
+
+bool push_out_busy(const push_out_t *out)
+{
+    return out->index < out->count;
+}
+
+int push_out_pending(const push_out_t *out, push_seg_t *segs, int max)
+{
+    int n = 0;
+
+    for (int i = out->index; i < out->count && n < max; i++) {
+        segs[n] = out->segs[i];
+        if (i == out->index) {
+            segs[n].data += out->offset;
+            segs[n].len -= out->offset;
+        }
+        n++;
+    }
+    return n;
+}
+
+bool push_out_wrote(push_out_t *out, size_t n)
+{
+    while (n > 0 && out->index < out->count) {
+        size_t left = out->segs[out->index].len - out->offset;
+        if (n < left) {
+            out->offset += n;
+            return false;
+        }
+        n -= left;
+        out->index++;
+        out->offset = 0;
+    }
+
+    // Skip empty segments so a finished out is never reported busy
+    while (out->index < out->count && out->segs[out->index].len == 0) {
+        out->index++;
+    }
+    if (out->index < out->count) {
+        return false;
+    }
+
+    frame_unref(out->frame);
+    out->frame = NULL;
+    return true;
+}
+
+void push_out_clear(push_out_t *out)
+{
+    frame_unref(out->frame);
+    memset(out, 0, sizeof(*out));
+}
@@ -0,0 +1,82 @@
+#ifndef PUSH_BATCH_H
+#define PUSH_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_pool.h"
+
+// Upload batching for the push uploader.
+//
+// Small frames are copied, with their wire headers, into a batch buffer and
+// sent with one write once the buffer is full or the oldest frame has waited
+// long enough; the pool slab is released as soon as the frame is copied.
+// Frames too large for a batch are sent straight from their slab. Either way
+// what is being sent is described by a push_out_t, a short list of segments
+// written with non-blocking scatter/gather sends. With chunked transfer
+// encoding a batch or a large frame is one chunk. No ESP-IDF dependencies.
+
+#define PUSH_OUT_MAX_SEGS 5
+#define PUSH_OUT_HDR_MAX 160     // fits PUSH_PROTO_FRAME_HEADER_MAX
+
+typedef struct {
+    uint8_t *buf;
+    size_t capacity;
+    size_t len;             // payload bytes after the chunk header reserve
+    uint32_t frames;
+    uint32_t first_ms;      // when the first frame was added
+} push_batch_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} push_seg_t;
+
+typedef struct {
+    push_seg_t segs[PUSH_OUT_MAX_SEGS];
+    uint8_t count;
+    uint8_t index;          // first segment not completely written
+    size_t offset;          // bytes of segs[index] already written
+    frame_t *frame;         // slab referenced by the segments, if any
+    uint32_t frames;        // frames carried
+    char chunk_hdr[12];
+    char part_hdr[PUSH_OUT_HDR_MAX];
+} push_out_t;
+
+// Use `buf` (capacity bytes) for batches
+void push_batch_init(push_batch_t *batch, uint8_t *buf, size_t capacity);
+void push_batch_reset(push_batch_t *batch);
+
+// Largest frame (header + body + trailer) a batch can carry
+size_t push_batch_max_payload(const push_batch_t *batch);
+
+// Copy one frame's header, body and trailer into the batch. Returns false if
+// it does not fit in the space left.
+bool push_batch_append(push_batch_t *batch, const void *hdr, size_t hdr_len, const void *body, size_t body_len,
+                       const void *trailer, size_t trailer_len, uint32_t now_ms);
+
+// True when the batch holds frames and the oldest has waited max_age_ms
+bool push_batch_due(const push_batch_t *batch, uint32_t now_ms, uint32_t max_age_ms);
+
+// Describe the batch as the next thing to send, as one chunk if `chunked`.
+// The batch must not be modified until `out` is done.
+void push_batch_seal(push_batch_t *batch, bool chunked, push_out_t *out);
+
+// Describe a single large frame; takes over the caller's reference
+void push_out_frame(push_out_t *out, frame_t *frame, const void *hdr, size_t hdr_len,
+                    const void *trailer, size_t trailer_len, bool chunked);
+
+bool push_out_busy(const push_out_t *out);
+
+// Remaining segments (the first one adjusted for what was written) for a
+// scatter/gather send. Returns the number of segments filled.
+int push_out_pending(const push_out_t *out, push_seg_t *segs, int max);
+
+// Record n bytes written. Returns true when everything has been written, in
+// which case the frame reference, if any, has been dropped.
+bool push_out_wrote(push_out_t *out, size_t n);
+
+// Abandon what is left, dropping the frame reference
+void push_out_clear(push_out_t *out);
+
+#endif // PUSH_BATCH_H
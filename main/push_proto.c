@@ -0,0 +1,119 @@
+#include "push_proto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+bool push_proto_parse_url(const char *url, push_proto_target_t *target)
+{
+    const char *p;
+
+    memset(target, 0, sizeof(*target));
+    if (strncmp(url, "http://", 7) == 0) {
+        target->mode = PUSH_PROTO_HTTP;
+        target->port = 80;
+        p = url + 7;
+    } else if (strncmp(url, "tcp://", 6) == 0) {
+        target->mode = PUSH_PROTO_TCP;
+        p = url + 6;
+    } else {
+        return false;
+    }
+
+    size_t host_len = strcspn(p, ":/");
+    if (host_len == 0 || host_len >= sizeof(target->host)) {
+        return false;
+    }
+    memcpy(target->host, p, host_len);
+    p += host_len;
+
+    if (*p == ':') {
+        char *end;
+        long port = strtol(p + 1, &end, 10);
+        if (end == p + 1 || port <= 0 || port > 65535) {
+            return false;
+        }
+        target->port = (uint16_t)port;
+        p = end;
+    }
+    if (target->port == 0) {
+        return false;
+    }
+
+    const char *path = *p == '/' ? p : "/";
+    if (*p != '\0' && *p != '/') {
+        return false;
+    }
+    if (strlen(path) >= sizeof(target->path)) {
+        return false;
+    }
+    strcpy(target->path, path);
+    return true;
+}
+
+int push_proto_session_header(const push_proto_target_t *target, const char *device_id,
+                              char *buf, size_t size)
+{
+    int len;
+
+    if (target->mode == PUSH_PROTO_TCP) {
+        len = snprintf(buf, size, "ECAM/1 %s\n", device_id);
+    } else {
+        len = snprintf(buf, size,
+                       "POST %s HTTP/1.1\r\n"
+                       "Host: %s:%u\r\n"
+                       "User-Agent: ESP32S3Cam\r\n"
+                       "X-Device-Id: %s\r\n"
+                       "Content-Type: multipart/x-mixed-replace;boundary=" PUSH_PROTO_BOUNDARY "\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "\r\n",
+                       target->path, target->host, (unsigned)target->port, device_id);
+    }
+    return len >= 0 && (size_t)len < size ? len : -1;
+}
+
+int push_proto_frame_header(push_proto_mode_t mode, const frame_t *frame, char *buf, size_t size)
+{
+    if (mode == PUSH_PROTO_TCP) {
+        if (size < PUSH_PROTO_TCP_HEADER_LEN) {
+            return -1;
+        }
+        uint8_t *p = (uint8_t *)buf;
+        uint64_t ts = (uint64_t)frame->timestamp_us;
+        memcpy(p, PUSH_PROTO_TCP_MAGIC, 4);
+        put_be32(p + 4, frame->seq);
+        put_be32(p + 8, (uint32_t)(ts >> 32));
+        put_be32(p + 12, (uint32_t)ts);
+        put_be32(p + 16, (uint32_t)frame->len);
+        return PUSH_PROTO_TCP_HEADER_LEN;
+    }
+
+    int len = snprintf(buf, size,
+                       "--" PUSH_PROTO_BOUNDARY "\r\n"
+                       "Content-Type: image/jpeg\r\n"
+                       "Content-Length: %u\r\n"
+                       "X-Frame-Seq: %lu\r\n"
+                       "X-Timestamp-Us: %lld\r\n"
+                       "\r\n",
+                       (unsigned)frame->len, (unsigned long)frame->seq, (long long)frame->timestamp_us);
+    return len >= 0 && (size_t)len < size ? len : -1;
+}
+
+const char *push_proto_frame_trailer(push_proto_mode_t mode, size_t *len)
+{
+    *len = mode == PUSH_PROTO_HTTP ? 2 : 0;
+    return "\r\n";
+}
+
+int push_proto_chunk_header(size_t chunk_len, char *buf, size_t size)
+{
+    int len = snprintf(buf, size, "%x\r\n", (unsigned)chunk_len);
+    return len >= 0 && (size_t)len < size ? len : -1;
+}
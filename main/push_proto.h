@@ -0,0 +1,58 @@
+#ifndef PUSH_PROTO_H
+#define PUSH_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_pool.h"
+
+// Wire format of the push uploader.
+//
+// The ingest URL picks the transport:
+//  - http://host[:port]/path: one long-lived chunked POST whose body is a
+//    multipart/x-mixed-replace stream, each part one JPEG frame with the same
+//    headers as /stream plus X-Frame-Seq and X-Timestamp-Us
+//  - tcp://host:port: a persistent connection that starts with the line
+//    "ECAM/1 <device-id>\n" followed by one record per frame: the magic
+//    "ECF1", seq (u32), timestamp_us (u64) and length (u32), all big-endian,
+//    then the JPEG bytes
+// No ESP-IDF dependencies.
+
+#define PUSH_PROTO_BOUNDARY "push-5e8a0c3f71"
+#define PUSH_PROTO_TCP_MAGIC "ECF1"
+#define PUSH_PROTO_TCP_HEADER_LEN 20
+#define PUSH_PROTO_HOST_MAX 64
+#define PUSH_PROTO_PATH_MAX 96
+#define PUSH_PROTO_FRAME_HEADER_MAX 160
+#define PUSH_PROTO_CHUNK_HEADER_MAX 10   // "%x\r\n" for up to 256 MB
+
+typedef enum {
+    PUSH_PROTO_HTTP,
+    PUSH_PROTO_TCP
+} push_proto_mode_t;
+
+typedef struct {
+    push_proto_mode_t mode;
+    char host[PUSH_PROTO_HOST_MAX];
+    uint16_t port;
+    char path[PUSH_PROTO_PATH_MAX];
+} push_proto_target_t;
+
+// Parse an ingest URL; the port defaults to 80 for http and is required for tcp
+bool push_proto_parse_url(const char *url, push_proto_target_t *target);
+
+// Bytes sent once after connecting: the POST request head or the TCP hello.
+// Returns the length, or -1 if it does not fit.
+int push_proto_session_header(const push_proto_target_t *target, const char *device_id,
+                              char *buf, size_t size);
+
+// Header that precedes a frame's JPEG bytes. Returns the length, or -1.
+int push_proto_frame_header(push_proto_mode_t mode, const frame_t *frame, char *buf, size_t size);
+
+// Bytes that follow a frame's JPEG bytes ("\r\n" between multipart parts, none for tcp)
+const char *push_proto_frame_trailer(push_proto_mode_t mode, size_t *len);
+
+// "%x\r\n" chunk-size line. Returns the length.
+int push_proto_chunk_header(size_t chunk_len, char *buf, size_t size);
+
+#endif // PUSH_PROTO_H
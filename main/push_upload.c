@@ -0,0 +1,529 @@
+#include "push_upload.h"
+#include "push_proto.h"
+#include "push_batch.h"
+#include "capture_pipeline.h"
+#include "qos_arbiter.h"
+#include "task_layout.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef CONFIG_APP_PUSH_UPLOAD
+
+static const char *TAG = "push_upload";
+
+#define PUSH_BATCH_SIZE (CONFIG_APP_PUSH_BATCH_KB * 1024)
+#define PUSH_BATCH_MAX_AGE_MS CONFIG_APP_PUSH_BATCH_MS
+#define PUSH_STALL_TIMEOUT_MS CONFIG_APP_PUSH_STALL_TIMEOUT_MS
+#define PUSH_BACKOFF_MIN_MS 500
+#define PUSH_BACKOFF_MAX_MS CONFIG_APP_PUSH_BACKOFF_MAX_MS
+#define PUSH_CONNECT_TIMEOUT_MS 5000
+#define PUSH_FRAME_WAIT_MS 20
+#define PUSH_WRITE_SLICE_MS 10
+#define PUSH_RATE_WINDOW_MS 1000
+#define PUSH_SETTLED_MS 10000 // a session this long resets the backoff
+#define PUSH_STOPPED_BIT BIT0
+
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+#define PUSH_KEEPALIVE_MS CONFIG_APP_STREAM_KEEPALIVE_MS
+#else
+#define PUSH_KEEPALIVE_MS 0
+#endif
+
+static push_proto_target_t s_target;
+static volatile bool s_running = false;
+static EventGroupHandle_t s_events = NULL;
+static uint8_t *s_batch_memory = NULL;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static push_upload_stats_t s_stats;
+
+// One connection's upload state: two batch buffers, one being filled while
+// the other (or a single large frame) is written
+typedef struct {
+    int fd;
+    bool chunked;
+    push_batch_t batches[2];
+    push_batch_t *filling;
+    push_out_t out;
+    frame_t *large;             // waiting for `out` to free up
+    char large_hdr[PUSH_PROTO_FRAME_HEADER_MAX];
+    int large_hdr_len;
+    uint32_t last_seq;
+    uint32_t last_progress_ms;
+    uint32_t last_offer_ms;
+    uint32_t rate_start_ms;
+    uint64_t rate_start_bytes;
+    bool sent_any;
+} push_session_t;
+
+static uint32_t push_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void push_stats_add(uint32_t frames, uint32_t batches, uint32_t dropped, size_t bytes)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.frames_sent += frames;
+    s_stats.batches_sent += batches;
+    s_stats.frames_dropped += dropped;
+    s_stats.bytes_sent += bytes;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+// Wait until the socket is writable (want_write) or readable. Returns > 0
+// when ready, 0 on timeout and < 0 on error.
+static int push_wait(int fd, bool want_write, uint32_t timeout_ms)
+{
+    fd_set fds;
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    return select(fd + 1, want_write ? NULL : &fds, want_write ? &fds : NULL, NULL, &tv);
+}
+
+static int push_connect(void)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    char port[6];
+
+    snprintf(port, sizeof(port), "%u", (unsigned)s_target.port);
+    int err = getaddrinfo(s_target.host, port, &hints, &res);
+    if (err != 0 || res == NULL) {
+        ESP_LOGW(TAG, "Cannot resolve %s: %d", s_target.host, err);
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    // Non-blocking from here on: the connect is bounded and every send is
+    // MSG_DONTWAIT anyway
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    int ret = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (ret != 0 && errno == EINPROGRESS) {
+        int so_error = 0;
+        socklen_t len = sizeof(so_error);
+        if (push_wait(fd, true, PUSH_CONNECT_TIMEOUT_MS) > 0 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len) == 0 && so_error == 0) {
+            ret = 0;
+        } else {
+            errno = so_error ? so_error : ETIMEDOUT;
+        }
+    }
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Cannot connect to %s:%u: errno %d", s_target.host, (unsigned)s_target.port, errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static esp_err_t push_write_all(int fd, const char *data, size_t len)
+{
+    uint32_t start = push_now_ms();
+
+    while (len > 0) {
+        int sent = send(fd, data, len, MSG_DONTWAIT);
+        if (sent > 0) {
+            data += sent;
+            len -= sent;
+            continue;
+        }
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return ESP_FAIL;
+        }
+        if (push_now_ms() - start > PUSH_STALL_TIMEOUT_MS) {
+            return ESP_ERR_TIMEOUT;
+        }
+        push_wait(fd, true, PUSH_WRITE_SLICE_MS);
+    }
+    return ESP_OK;
+}
+
+// Hand the filling batch to the link and start filling the other buffer,
+// which `out` no longer uses
+static void push_seal_filling(push_session_t *s)
+{
+    push_batch_seal(s->filling, s->chunked, &s->out);
+    s->filling = s->filling == &s->batches[0] ? &s->batches[1] : &s->batches[0];
+    push_batch_reset(s->filling);
+}
+
+// Take a new frame from the pipeline into the filling batch, or hold it as
+// the next large frame
+static void push_take_frame(push_session_t *s, frame_t *frame, uint32_t now_ms)
+{
+    char hdr[PUSH_PROTO_FRAME_HEADER_MAX];
+    size_t trailer_len;
+    const char *trailer = push_proto_frame_trailer(s_target.mode, &trailer_len);
+    int hdr_len = push_proto_frame_header(s_target.mode, frame, hdr, sizeof(hdr));
+    size_t need = hdr_len + frame->len + trailer_len;
+
+    if (hdr_len < 0) {
+        frame_unref(frame);
+        return;
+    }
+
+    if (need > push_batch_max_payload(s->filling)) {
+        if (s->large != NULL) {
+            // Still waiting for the link; the newer frame wins
+            frame_unref(s->large);
+            push_stats_add(0, 0, 1, 0);
+        }
+        s->large = frame;
+        memcpy(s->large_hdr, hdr, hdr_len);
+        s->large_hdr_len = hdr_len;
+        return;
+    }
+
+    if (!push_batch_append(s->filling, hdr, hdr_len, frame->data, frame->len, trailer, trailer_len, now_ms)) {
+        if (push_out_busy(&s->out)) {
+            // Both buffers in use: start the filling batch over with the newest frame
+            push_stats_add(0, 0, s->filling->frames, 0);
+            push_batch_reset(s->filling);
+        } else {
+            push_seal_filling(s);
+        }
+        push_batch_append(s->filling, hdr, hdr_len, frame->data, frame->len, trailer, trailer_len, now_ms);
+    }
+    frame_unref(frame);
+}
+
+// Give the link the next thing to send once it is free
+static void push_schedule(push_session_t *s, uint32_t now_ms)
+{
+    if (push_out_busy(&s->out)) {
+        return;
+    }
+
+    // Batched frames are older than a pending large frame, send them first
+    if (s->filling->frames > 0 && (s->large != NULL || push_batch_due(s->filling, now_ms, PUSH_BATCH_MAX_AGE_MS))) {
+        push_seal_filling(s);
+    } else if (s->large != NULL) {
+        size_t trailer_len;
+        const char *trailer = push_proto_frame_trailer(s_target.mode, &trailer_len);
+        push_out_frame(&s->out, s->large, s->large_hdr, s->large_hdr_len, trailer, trailer_len, s->chunked);
+        s->large = NULL;
+    }
+}
+
+// Write as much of `out` as the socket takes. Returns ESP_FAIL on a socket
+// error; EAGAIN is not an error.
+static esp_err_t push_send(push_session_t *s, uint32_t now_ms, bool *blocked)
+{
+    push_seg_t segs[PUSH_OUT_MAX_SEGS];
+    struct iovec iov[PUSH_OUT_MAX_SEGS];
+    struct msghdr msg = { 0 };
+
+    *blocked = false;
+    int count = push_out_pending(&s->out, segs, PUSH_OUT_MAX_SEGS);
+    if (count == 0) {
+        return ESP_OK;
+    }
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = (void *)segs[i].data;
+        iov[i].iov_len = segs[i].len;
+    }
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    int sent = sendmsg(s->fd, &msg, MSG_DONTWAIT);
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            *blocked = true;
+            return ESP_OK;
+        }
+        return ESP_FAIL;
+    }
+
+    s->last_progress_ms = now_ms;
+    uint32_t frames = s->out.frames;
+    if (push_out_wrote(&s->out, sent)) {
+        push_stats_add(frames, frames > 1 ? 1 : 0, 0, sent);
+        s->sent_any = true;
+    } else {
+        push_stats_add(0, 0, 0, sent);
+    }
+    return ESP_OK;
+}
+
+// Anything the server sends mid-stream is an error response or a close
+static bool push_server_closed(push_session_t *s)
+{
+    char buf[64];
+
+    if (push_wait(s->fd, false, 0) <= 0) {
+        return false;
+    }
+    int n = recv(s->fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+    if (n < 0) {
+        return errno != EAGAIN && errno != EWOULDBLOCK;
+    }
+    if (n == 0) {
+        ESP_LOGW(TAG, "Ingest server closed the connection");
+        return true;
+    }
+    buf[n] = '\0';
+    if (s_target.mode == PUSH_PROTO_HTTP) {
+        if (strncmp(buf, "HTTP/1.1 100", 12) == 0) {
+            return false;
+        }
+        buf[strcspn(buf, "\r\n")] = '\0';
+        ESP_LOGW(TAG, "Ingest server replied \"%s\"", buf);
+        return true;
+    }
+    // Nothing is expected back over raw TCP
+    return false;
+}
+
+static void push_update_rate(push_session_t *s, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - s->rate_start_ms;
+    if (elapsed < PUSH_RATE_WINDOW_MS) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    uint64_t bytes = s_stats.bytes_sent;
+    s_stats.rate_kbps = (uint32_t)((bytes - s->rate_start_bytes) * 8 / elapsed);
+    portEXIT_CRITICAL(&s_stats_lock);
+    s->rate_start_ms = now_ms;
+    s->rate_start_bytes = bytes;
+}
+
+// Run one connection until it fails or the uploader is stopped. Returns true
+// if at least one frame was delivered.
+static bool push_session(int fd)
+{
+    char head[256];
+    push_session_t s = {
+        .fd = fd,
+        .chunked = s_target.mode == PUSH_PROTO_HTTP,
+    };
+
+    push_batch_init(&s.batches[0], s_batch_memory, PUSH_BATCH_SIZE);
+    push_batch_init(&s.batches[1], s_batch_memory + PUSH_BATCH_SIZE, PUSH_BATCH_SIZE);
+    s.filling = &s.batches[0];
+
+    int head_len = push_proto_session_header(&s_target, CONFIG_APP_PUSH_DEVICE_ID, head, sizeof(head));
+    if (head_len < 0 || push_write_all(fd, head, head_len) != ESP_OK) {
+        return false;
+    }
+
+    uint32_t now_ms = push_now_ms();
+    s.last_progress_ms = now_ms;
+    s.rate_start_ms = now_ms;
+    portENTER_CRITICAL(&s_stats_lock);
+    s.rate_start_bytes = s_stats.bytes_sent;
+    s_stats.connected = true;
+    s_stats.connects++;
+    portEXIT_CRITICAL(&s_stats_lock);
+    // The first frame is always sent, changed or not
+    s.last_offer_ms = now_ms - PUSH_KEEPALIVE_MS;
+    ESP_LOGI(TAG, "Pushing to %s:%u%s", s_target.host, (unsigned)s_target.port,
+             s_target.mode == PUSH_PROTO_HTTP ? s_target.path : " (tcp)");
+
+    // Only while connected: backoff between sessions lets the sensor sleep
+    capture_pipeline_acquire(CAPTURE_CONSUMER_RECORDER);
+    bool blocked = false;
+    while (s_running) {
+        // Do not sit on a frame wait while the socket could take data
+        uint32_t wait_ms = push_out_busy(&s.out) && !blocked ? 0 : PUSH_FRAME_WAIT_MS;
+        frame_t *frame = capture_pipeline_get_frame(s.last_seq, wait_ms);
+        now_ms = push_now_ms();
+        if (frame != NULL) {
+            s.last_seq = frame->seq;
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+            if (frame->unchanged && now_ms - s.last_offer_ms < PUSH_KEEPALIVE_MS) {
+                frame_unref(frame);
+                frame = NULL;
+            }
+#endif
+            if (frame != NULL && !qos_arbiter_admit(QOS_FLOW_UPLOAD, s.last_offer_ms, now_ms)) {
+                frame_unref(frame);
+                frame = NULL;
+                portENTER_CRITICAL(&s_stats_lock);
+                s_stats.frames_throttled++;
+                portEXIT_CRITICAL(&s_stats_lock);
+            }
+            if (frame != NULL) {
+                s.last_offer_ms = now_ms;
+                push_take_frame(&s, frame, now_ms);
+            }
+        }
+
+        push_schedule(&s, now_ms);
+        if (push_send(&s, now_ms, &blocked) != ESP_OK) {
+            ESP_LOGW(TAG, "Upload failed: errno %d", errno);
+            break;
+        }
+        if (blocked) {
+            push_wait(fd, true, PUSH_WRITE_SLICE_MS);
+        }
+
+        if (push_out_busy(&s.out) && now_ms - s.last_progress_ms > PUSH_STALL_TIMEOUT_MS) {
+            ESP_LOGW(TAG, "Ingest server accepted nothing for %d ms", PUSH_STALL_TIMEOUT_MS);
+            break;
+        }
+        if (push_server_closed(&s)) {
+            break;
+        }
+        push_update_rate(&s, now_ms);
+    }
+
+    capture_pipeline_release(CAPTURE_CONSUMER_RECORDER);
+    push_out_clear(&s.out);
+    frame_unref(s.large);
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.connected = false;
+    s_stats.rate_kbps = 0;
+    if (s_running) {
+        s_stats.disconnects++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+    return s.sent_any;
+}
+
+static void push_task(void *pvParameters)
+{
+    uint32_t backoff_ms = PUSH_BACKOFF_MIN_MS;
+
+    while (s_running) {
+        int fd = push_connect();
+        if (fd >= 0) {
+            uint32_t start_ms = push_now_ms();
+            bool delivered = push_session(fd);
+            close(fd);
+            if (delivered && push_now_ms() - start_ms >= PUSH_SETTLED_MS) {
+                backoff_ms = PUSH_BACKOFF_MIN_MS;
+            }
+        } else {
+            portENTER_CRITICAL(&s_stats_lock);
+            s_stats.connect_failures++;
+            portEXIT_CRITICAL(&s_stats_lock);
+        }
+        if (!s_running) {
+            break;
+        }
+
+        portENTER_CRITICAL(&s_stats_lock);
+        s_stats.backoff_ms = backoff_ms;
+        portEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGI(TAG, "Reconnecting in %lu ms", (unsigned long)backoff_ms);
+        for (uint32_t waited = 0; waited < backoff_ms && s_running; waited += PUSH_FRAME_WAIT_MS) {
+            vTaskDelay(pdMS_TO_TICKS(PUSH_FRAME_WAIT_MS));
+        }
+        backoff_ms = backoff_ms * 2 > PUSH_BACKOFF_MAX_MS ? PUSH_BACKOFF_MAX_MS : backoff_ms * 2;
+    }
+
+    xEventGroupSetBits(s_events, PUSH_STOPPED_BIT);
+    vTaskDelete(NULL);
+}
+
+esp_err_t push_upload_start(void)
+{
+    if (s_running) {
+        return ESP_OK;
+    }
+
+    if (!push_proto_parse_url(CONFIG_APP_PUSH_URL, &s_target)) {
+        ESP_LOGE(TAG, "Invalid push URL \"%s\"", CONFIG_APP_PUSH_URL);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_events == NULL) {
+        s_events = xEventGroupCreate();
+        if (s_events == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    // Kept across restarts, like the frame pool
+    if (s_batch_memory == NULL) {
+        s_batch_memory = heap_caps_malloc(2 * PUSH_BATCH_SIZE, MALLOC_CAP_SPIRAM);
+        if (s_batch_memory == NULL) {
+            s_batch_memory = heap_caps_malloc(2 * PUSH_BATCH_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (s_batch_memory == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate upload batches");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xEventGroupClearBits(s_events, PUSH_STOPPED_BIT);
+    s_stats.enabled = true;
+    s_stats.backoff_ms = 0;
+    s_running = true;
+    if (xTaskCreatePinnedToCore(push_task, "push_upload", PUSH_TASK_STACK_SIZE, NULL,
+                                PUSH_TASK_PRIORITY, NULL, PUSH_TASK_CORE) != pdPASS) {
+        s_running = false;
+        ESP_LOGE(TAG, "Failed to create push upload task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Push upload to %s started", CONFIG_APP_PUSH_URL);
+    return ESP_OK;
+}
+
+esp_err_t push_upload_stop(void)
+{
+    if (!s_running) {
+        return ESP_OK;
+    }
+
+    s_running = false;
+    // Bounded by the connect timeout or one frame wait
+    xEventGroupWaitBits(s_events, PUSH_STOPPED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    ESP_LOGI(TAG, "Push upload stopped");
+    return ESP_OK;
+}
+
+void push_upload_get_stats(push_upload_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+#else // CONFIG_APP_PUSH_UPLOAD
+
+esp_err_t push_upload_start(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t push_upload_stop(void)
+{
+    return ESP_OK;
+}
+
+void push_upload_get_stats(push_upload_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif // CONFIG_APP_PUSH_UPLOAD
@@ -0,0 +1,40 @@
+#ifndef PUSH_UPLOAD_H
+#define PUSH_UPLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Push uploader, see "ESP32S3Cam Push Upload" in menuconfig.
+//
+// For devices behind NAT: instead of waiting for /stream to be pulled, the
+// device connects out to CONFIG_APP_PUSH_URL and sends frames from the
+// capture pipeline as they arrive (wire format in push_proto.h). Uploads are
+// pipelined: the next batch is filled while the previous one is still being
+// written. A dropped connection is retried with exponential backoff.
+
+typedef struct {
+    bool enabled;
+    bool connected;
+    uint32_t connects;          // sessions established
+    uint32_t connect_failures;
+    uint32_t disconnects;       // sessions ended by an error, stall or the server
+    uint32_t frames_sent;
+    uint32_t frames_dropped;    // replaced by a newer frame while the link was busy
+    uint32_t frames_throttled;  // skipped by the bandwidth arbiter
+    uint32_t batches_sent;      // writes carrying more than one frame
+    uint64_t bytes_sent;
+    uint32_t rate_kbps;         // over the last second
+    uint32_t backoff_ms;        // current reconnect delay
+} push_upload_stats_t;
+
+// Start the upload task. Returns ESP_ERR_NOT_SUPPORTED when push upload is
+// disabled and ESP_ERR_INVALID_ARG for a malformed URL.
+esp_err_t push_upload_start(void);
+
+// Stop the upload task and wait for it to exit
+esp_err_t push_upload_stop(void);
+
+void push_upload_get_stats(push_upload_stats_t *stats);
+
+#endif // PUSH_UPLOAD_H
@@ -0,0 +1,256 @@
+#include "qos_arbiter.h"
+#include "http_server.h"
+#include "video_stream.h"
+#include "push_upload.h"
+#include "mcast_stream.h"
+#include "dram_stream.h"
+#include "camera_init.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "qos";
+
+#define QOS_SAMPLE_INTERVAL_MS 500
+
+#if defined(CONFIG_APP_QOS_POLICY_OTA_PAUSE)
+#define QOS_DEFAULT_POLICY QOS_POLICY_OTA_PAUSE
+#elif defined(CONFIG_APP_QOS_POLICY_OTA_DEGRADE)
+#define QOS_DEFAULT_POLICY QOS_POLICY_OTA_DEGRADE
+#elif defined(CONFIG_APP_QOS_POLICY_STREAM_FIRST)
+#define QOS_DEFAULT_POLICY QOS_POLICY_STREAM_FIRST
+#else
+#define QOS_DEFAULT_POLICY QOS_POLICY_NONE
+#endif
+
+// The policy state is updated from the sample timer and the OTA handler;
+// the decision is read by every stream sender for every frame
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static qos_policy_t s_policy;
+static bool s_ota_active = false;
+static uint32_t s_changes = 0;
+static esp_timer_handle_t s_timer = NULL;
+
+static uint32_t qos_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void qos_default_config(qos_policy_config_t *config)
+{
+    config->mode = QOS_DEFAULT_POLICY;
+    config->egress_cap_kbps = CONFIG_APP_QOS_EGRESS_CAP_KBPS;
+    config->base_quality = CAMERA_JPEG_QUALITY;
+    config->max_quality = CONFIG_APP_QOS_MAX_JPEG_QUALITY;
+    config->min_fps = CONFIG_APP_QOS_MIN_FPS;
+    config->ota_fps = CONFIG_APP_QOS_OTA_FPS;
+    config->ota_quality = CONFIG_APP_QOS_OTA_JPEG_QUALITY;
+    config->ota_kbps = CONFIG_APP_QOS_OTA_KBPS;
+}
+
+static void qos_evaluate(void)
+{
+    video_stream_stats_t stream;
+    push_upload_stats_t push;
+    mcast_stream_stats_t mcast;
+    dram_stream_stats_t dram;
+    qos_decision_t decision;
+
+    video_stream_get_stats(&stream);
+    push_upload_get_stats(&push);
+    mcast_stream_get_stats(&mcast);
+    dram_stream_get_stats(&dram);
+
+    // The multicast sender is one stream however many receivers it has
+    qos_sample_t sample = {
+        .streams = stream.active_clients + dram.clients + (mcast.running ? 1 : 0),
+        .upload = push.connected,
+        .egress_bytes = stream.bytes_sent + push.bytes_sent + mcast.bytes_sent + dram.bytes_sent,
+        .egress_frames = stream.frames_sent + push.frames_sent + mcast.frames_sent + dram.frames_sent,
+    };
+
+    portENTER_CRITICAL(&s_lock);
+    sample.ota = s_ota_active;
+    bool changed = qos_policy_update(&s_policy, &sample, qos_now_ms());
+    if (changed) {
+        s_changes++;
+    }
+    decision = s_policy.decision;
+    qos_policy_mode_t mode = s_policy.config.mode;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (changed) {
+        ESP_LOGI(TAG, "%s%s: streams %s, upload %s, frame interval %lu ms, quality %u, OTA cap %lu kbps",
+                 qos_policy_mode_name(mode), sample.ota ? " (OTA)" : "",
+                 decision.paused[QOS_FLOW_STREAM] ? "paused" : "on",
+                 decision.paused[QOS_FLOW_UPLOAD] ? "paused" : "on",
+                 (unsigned long)decision.frame_interval_ms, decision.quality,
+                 (unsigned long)decision.ota_kbps);
+    }
+
+    // Compared against the sensor rather than the last value set, so the
+    // quality is re-applied after a camera reinit; retried on the next
+    // sample if the camera is not up yet or is being reinitialized
+    int quality = camera_get_quality();
+    if (quality >= 0 && quality != decision.quality) {
+        camera_set_quality(decision.quality);
+    }
+}
+
+static void qos_sample(void *arg)
+{
+    qos_evaluate();
+}
+
+esp_err_t qos_arbiter_init(void)
+{
+    qos_policy_config_t config;
+
+    if (s_timer != NULL) {
+        return ESP_OK;
+    }
+
+    qos_default_config(&config);
+    qos_policy_init(&s_policy, &config, qos_now_ms());
+
+    const esp_timer_create_args_t args = {
+        .callback = qos_sample,
+        .name = "qos_sample",
+    };
+    esp_err_t ret = esp_timer_create(&args, &s_timer);
+    if (ret == ESP_OK) {
+        ret = esp_timer_start_periodic(s_timer, QOS_SAMPLE_INTERVAL_MS * 1000);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start QoS sample timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Bandwidth policy %s, egress cap %lu kbps", qos_policy_mode_name(config.mode),
+             (unsigned long)config.egress_cap_kbps);
+    return ESP_OK;
+}
+
+bool qos_arbiter_admit(qos_flow_t flow, uint32_t last_ms, uint32_t now_ms)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool admit = qos_decision_admit(&s_policy.decision, flow, last_ms, now_ms);
+    portEXIT_CRITICAL(&s_lock);
+    return admit;
+}
+
+void qos_arbiter_ota_begin(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_ota_active = true;
+    portEXIT_CRITICAL(&s_lock);
+    qos_evaluate();
+}
+
+void qos_arbiter_ota_end(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_ota_active = false;
+    portEXIT_CRITICAL(&s_lock);
+    qos_evaluate();
+}
+
+uint32_t qos_arbiter_ota_delay_ms(uint64_t received, uint32_t elapsed_ms)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t kbps = s_policy.decision.ota_kbps;
+    portEXIT_CRITICAL(&s_lock);
+    return qos_pace_delay_ms(received, elapsed_ms, kbps);
+}
+
+void qos_arbiter_get_stats(qos_arbiter_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_lock);
+    stats->mode = s_policy.config.mode;
+    stats->egress_cap_kbps = s_policy.config.egress_cap_kbps;
+    stats->ota_active = s_ota_active;
+    stats->decision = s_policy.decision;
+    stats->egress_kbps = s_policy.egress_kbps;
+    stats->frame_bytes_avg = s_policy.frame_bytes_avg;
+    stats->changes = s_changes;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+// GET /qos reports the policy and the current decision;
+// /qos?policy=stream_first&cap_kbps=4000 changes either until the next reboot
+static esp_err_t qos_handler(httpd_req_t *req)
+{
+    char query[64] = "";
+    char value[16];
+    char json[320];
+    qos_arbiter_stats_t stats;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+
+    portENTER_CRITICAL(&s_lock);
+    qos_policy_config_t config = s_policy.config;
+    portEXIT_CRITICAL(&s_lock);
+
+    bool update = false;
+    if (httpd_query_key_value(query, "policy", value, sizeof(value)) == ESP_OK) {
+        if (!qos_policy_mode_parse(value, &config.mode)) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                       "policy must be none, ota_pause, ota_degrade or stream_first");
+        }
+        update = true;
+    }
+    if (httpd_query_key_value(query, "cap_kbps", value, sizeof(value)) == ESP_OK) {
+        char *end;
+        long cap = strtol(value, &end, 10);
+        if (end == value || *end != '\0' || cap < 0 || cap > 1000000) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "cap_kbps out of range");
+        }
+        config.egress_cap_kbps = (uint32_t)cap;
+        update = true;
+    }
+
+    if (update) {
+        portENTER_CRITICAL(&s_lock);
+        qos_policy_configure(&s_policy, &config);
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGI(TAG, "Bandwidth policy set to %s, egress cap %lu kbps", qos_policy_mode_name(config.mode),
+                 (unsigned long)config.egress_cap_kbps);
+        qos_evaluate();
+    }
+
+    qos_arbiter_get_stats(&stats);
+    snprintf(json, sizeof(json),
+             "{\"policy\":\"%s\",\"egress_cap_kbps\":%lu,\"ota_active\":%s,\"stream_paused\":%s,"
+             "\"upload_paused\":%s,\"frame_interval_ms\":%lu,\"jpeg_quality\":%u,\"ota_kbps\":%lu,"
+             "\"egress_kbps\":%lu,\"frame_bytes_avg\":%lu}",
+             qos_policy_mode_name(stats.mode), (unsigned long)stats.egress_cap_kbps,
+             stats.ota_active ? "true" : "false",
+             stats.decision.paused[QOS_FLOW_STREAM] ? "true" : "false",
+             stats.decision.paused[QOS_FLOW_UPLOAD] ? "true" : "false",
+             (unsigned long)stats.decision.frame_interval_ms, stats.decision.quality,
+             (unsigned long)stats.decision.ota_kbps, (unsigned long)stats.egress_kbps,
+             (unsigned long)stats.frame_bytes_avg);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t qos_arbiter_http_init(void)
+{
+    httpd_uri_t qos_uri = {
+        .uri = "/qos",
+        .method = HTTP_GET,
+        .handler = qos_handler,
+        .user_ctx = NULL
+    };
+    return http_server_register_handler(&qos_uri);
+}
+
+esp_err_t qos_arbiter_http_deinit(void)
+{
+    return http_server_unregister_handler("/qos", HTTP_GET);
+}
@@ -0,0 +1,49 @@
+#ifndef QOS_ARBITER_H
+#define QOS_ARBITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "qos_policy.h"
+
+// Bandwidth arbiter, see "ESP32S3Cam Bandwidth QoS" in menuconfig.
+//
+// Twice a second the stream clients, the multicast sender, the push uploader
+// and the OTA handler are sampled and qos_policy decides who gets the
+// bandwidth. The decision is applied through the existing knobs: stream and
+// multicast senders and the uploader skip frames they are not admitted for,
+// the sensor's JPEG quality is changed, and the OTA handler paces its reads.
+// The policy can be changed at run time with
+// GET /qos?policy=<name>&cap_kbps=<n>, until the next reboot.
+
+typedef struct {
+    qos_policy_mode_t mode;
+    uint32_t egress_cap_kbps;
+    bool ota_active;
+    qos_decision_t decision;
+    uint32_t egress_kbps;       // streams + upload, last sample interval
+    uint32_t frame_bytes_avg;
+    uint32_t changes;           // decisions that differed from the previous one
+} qos_arbiter_stats_t;
+
+// Start sampling with the configured policy
+esp_err_t qos_arbiter_init(void);
+
+// Register / unregister GET /qos
+esp_err_t qos_arbiter_http_init(void);
+esp_err_t qos_arbiter_http_deinit(void);
+
+// True if a consumer of `flow` that last sent a frame at last_ms may send
+// one now. Called for every frame, so it only reads the current decision.
+bool qos_arbiter_admit(qos_flow_t flow, uint32_t last_ms, uint32_t now_ms);
+
+// Bracket an OTA transfer; the decision is re-evaluated immediately
+void qos_arbiter_ota_begin(void);
+void qos_arbiter_ota_end(void);
+
+// Delay before the OTA handler reads more, after `received` bytes in elapsed_ms
+uint32_t qos_arbiter_ota_delay_ms(uint64_t received, uint32_t elapsed_ms);
+
+void qos_arbiter_get_stats(qos_arbiter_stats_t *stats);
+
+#endif // QOS_ARBITER_H
@@ -0,0 +1,187 @@
+#include "qos_policy.h"
+#include <string.h>
+
+#define QOS_FRAME_EWMA_SHIFT 2      // 1/4 weight per sample
+#define QOS_QUALITY_STEP 4
+#define QOS_QUALITY_HOLD_MS 2000    // let frame sizes settle before the next step
+#define QOS_INTERVAL_MAX_MS 10000
+#define QOS_PACE_DELAY_MAX_MS 1000
+
+static const char *const s_mode_names[QOS_POLICY_COUNT] = {
+    [QOS_POLICY_NONE] = "none",
+    [QOS_POLICY_OTA_PAUSE] = "ota_pause",
+    [QOS_POLICY_OTA_DEGRADE] = "ota_degrade",
+    [QOS_POLICY_STREAM_FIRST] = "stream_first",
+};
+
+const char *qos_policy_mode_name(qos_policy_mode_t mode)
+{
+    return mode < QOS_POLICY_COUNT ? s_mode_names[mode] : "unknown";
+}
+
+bool qos_policy_mode_parse(const char *name, qos_policy_mode_t *mode)
+{
+    for (int i = 0; i < QOS_POLICY_COUNT; i++) {
+        if (strcmp(name, s_mode_names[i]) == 0) {
+            *mode = (qos_policy_mode_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void qos_policy_init(qos_policy_t *policy, const qos_policy_config_t *config, uint32_t now_ms)
+{
+    memset(policy, 0, sizeof(*policy));
+    policy->config = *config;
+    policy->cap_quality = config->base_quality;
+    policy->decision.quality = config->base_quality;
+    policy->quality_step_ms = now_ms;
+    policy->last_ms = now_ms;
+}
+
+void qos_policy_configure(qos_policy_t *policy, const qos_policy_config_t *config)
+{
+    policy->config = *config;
+    if (policy->cap_quality < config->base_quality) {
+        policy->cap_quality = config->base_quality;
+    }
+    if (policy->cap_quality > config->max_quality) {
+        policy->cap_quality = config->max_quality;
+    }
+}
+
+static void qos_measure(qos_policy_t *policy, const qos_sample_t *sample, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - policy->last_ms;
+
+    if (policy->primed && elapsed > 0) {
+        uint64_t bytes = sample->egress_bytes - policy->last_bytes;
+        uint32_t frames = sample->egress_frames - policy->last_frames;
+
+        policy->egress_kbps = (uint32_t)(bytes * 8 / elapsed);
+        if (frames > 0) {
+            uint32_t frame_bytes = (uint32_t)(bytes / frames);
+            if (policy->frame_bytes_avg == 0) {
+                policy->frame_bytes_avg = frame_bytes;
+            } else {
+                int32_t dev = (int32_t)frame_bytes - (int32_t)policy->frame_bytes_avg;
+                policy->frame_bytes_avg += dev / (1 << QOS_FRAME_EWMA_SHIFT);
+            }
+        }
+    }
+
+    policy->primed = true;
+    policy->last_ms = now_ms;
+    policy->last_bytes = sample->egress_bytes;
+    policy->last_frames = sample->egress_frames;
+}
+
+// Spacing that keeps `flows` consumers of frames averaging frame_bytes_avg
+// within the egress cap, and the quality step that keeps that spacing near
+// the minimum frame rate
+static uint32_t qos_egress_interval(qos_policy_t *policy, uint32_t flows, uint32_t now_ms)
+{
+    const qos_policy_config_t *config = &policy->config;
+
+    if (flows == 0) {
+        // Nobody to protect; the next client starts at full quality
+        policy->cap_quality = config->base_quality;
+        return 0;
+    }
+    if (config->egress_cap_kbps == 0 || policy->frame_bytes_avg == 0) {
+        return 0;
+    }
+
+    // bits / (kbit/s) = ms
+    uint32_t interval = (uint32_t)((uint64_t)flows * policy->frame_bytes_avg * 8 / config->egress_cap_kbps);
+    uint32_t min_fps_interval = config->min_fps ? 1000 / config->min_fps : QOS_INTERVAL_MAX_MS;
+
+    if (now_ms - policy->quality_step_ms >= QOS_QUALITY_HOLD_MS) {
+        if (interval > min_fps_interval && policy->cap_quality < config->max_quality) {
+            uint32_t q = policy->cap_quality + QOS_QUALITY_STEP;
+            policy->cap_quality = q > config->max_quality ? config->max_quality : q;
+            policy->quality_step_ms = now_ms;
+        } else if (interval * 2 < min_fps_interval && policy->cap_quality > config->base_quality) {
+            // Twice the headroom before stepping back, so a finer quality's
+            // larger frames do not immediately push it over again
+            int q = (int)policy->cap_quality - QOS_QUALITY_STEP;
+            policy->cap_quality = q < config->base_quality ? config->base_quality : (uint8_t)q;
+            policy->quality_step_ms = now_ms;
+        }
+    }
+    return interval;
+}
+
+static bool qos_decision_equal(const qos_decision_t *a, const qos_decision_t *b)
+{
+    for (int flow = 0; flow < QOS_FLOW_COUNT; flow++) {
+        if (a->paused[flow] != b->paused[flow]) {
+            return false;
+        }
+    }
+    return a->frame_interval_ms == b->frame_interval_ms && a->quality == b->quality && a->ota_kbps == b->ota_kbps;
+}
+
+bool qos_policy_update(qos_policy_t *policy, const qos_sample_t *sample, uint32_t now_ms)
+{
+    const qos_policy_config_t *config = &policy->config;
+    qos_decision_t next = {0};
+    uint32_t flows = sample->streams + (sample->upload ? 1 : 0);
+
+    qos_measure(policy, sample, now_ms);
+    next.frame_interval_ms = qos_egress_interval(policy, flows, now_ms);
+    next.quality = policy->cap_quality;
+
+    if (sample->ota) {
+        switch (config->mode) {
+        case QOS_POLICY_OTA_PAUSE:
+            next.paused[QOS_FLOW_STREAM] = true;
+            next.paused[QOS_FLOW_UPLOAD] = true;
+            break;
+        case QOS_POLICY_OTA_DEGRADE:
+            if (config->ota_fps > 0 && 1000u / config->ota_fps > next.frame_interval_ms) {
+                next.frame_interval_ms = 1000u / config->ota_fps;
+            }
+            if (config->ota_quality > next.quality) {
+                next.quality = config->ota_quality;
+            }
+            break;
+        case QOS_POLICY_STREAM_FIRST:
+            next.ota_kbps = config->ota_kbps;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (next.frame_interval_ms > QOS_INTERVAL_MAX_MS) {
+        next.frame_interval_ms = QOS_INTERVAL_MAX_MS;
+    }
+
+    bool changed = !qos_decision_equal(&next, &policy->decision);
+    policy->decision = next;
+    return changed;
+}
+
+bool qos_decision_admit(const qos_decision_t *decision, qos_flow_t flow, uint32_t last_ms, uint32_t now_ms)
+{
+    if (decision->paused[flow]) {
+        return false;
+    }
+    return now_ms - last_ms >= decision->frame_interval_ms;
+}
+
+uint32_t qos_pace_delay_ms(uint64_t bytes, uint32_t elapsed_ms, uint32_t kbps)
+{
+    if (kbps == 0) {
+        return 0;
+    }
+
+    uint64_t due_ms = bytes * 8 / kbps;
+    if (due_ms <= elapsed_ms) {
+        return 0;
+    }
+    due_ms -= elapsed_ms;
+    return due_ms > QOS_PACE_DELAY_MAX_MS ? QOS_PACE_DELAY_MAX_MS : (uint32_t)due_ms;
+}
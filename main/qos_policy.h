@@ -0,0 +1,90 @@
+#ifndef QOS_POLICY_H
+#define QOS_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bandwidth policy engine for the QoS arbiter.
+//
+// Fed a periodic sample of what is running (stream clients, the push
+// uploader, an OTA transfer) and the cumulative bytes and frames sent, it
+// decides how the frame consumers are paced, which JPEG quality the sensor
+// uses and how fast an OTA image is received. The decision depends only on
+// the samples and the clock passed in, so traffic can be simulated on any
+// host. No ESP-IDF dependencies.
+
+typedef enum {
+    QOS_POLICY_NONE,          // only the egress cap, if any
+    QOS_POLICY_OTA_PAUSE,     // no frames are sent while OTA runs
+    QOS_POLICY_OTA_DEGRADE,   // low frame rate and quality while OTA runs
+    QOS_POLICY_STREAM_FIRST,  // OTA is received at a capped rate
+    QOS_POLICY_COUNT
+} qos_policy_mode_t;
+
+typedef enum {
+    QOS_FLOW_STREAM,          // /stream clients
+    QOS_FLOW_UPLOAD,          // push uploader
+    QOS_FLOW_COUNT
+} qos_flow_t;
+
+typedef struct {
+    qos_policy_mode_t mode;
+    uint32_t egress_cap_kbps;   // streams + upload, 0 = unlimited
+    uint8_t base_quality;       // JPEG quality when nothing is constrained
+    uint8_t max_quality;        // coarsest quality the egress cap may use
+    uint8_t min_fps;            // per consumer; below this the cap lowers quality instead
+    uint8_t ota_fps;            // OTA_DEGRADE: per-consumer frame rate during OTA
+    uint8_t ota_quality;        // OTA_DEGRADE: JPEG quality during OTA
+    uint32_t ota_kbps;          // STREAM_FIRST: OTA receive rate
+} qos_policy_config_t;
+
+typedef struct {
+    uint32_t streams;           // active stream clients
+    bool upload;                // push uploader connected
+    bool ota;                   // OTA transfer in progress
+    uint64_t egress_bytes;      // cumulative, streams + upload
+    uint32_t egress_frames;     // cumulative, streams + upload
+} qos_sample_t;
+
+typedef struct {
+    bool paused[QOS_FLOW_COUNT];
+    uint32_t frame_interval_ms; // minimum spacing of frames per consumer, 0 = unpaced
+    uint8_t quality;            // JPEG quality (0-63, higher is coarser)
+    uint32_t ota_kbps;          // OTA receive cap, 0 = unlimited
+} qos_decision_t;
+
+typedef struct {
+    qos_policy_config_t config;
+    qos_decision_t decision;
+    uint8_t cap_quality;        // quality chosen by the egress cap controller
+    uint32_t quality_step_ms;   // when cap_quality last changed
+    uint32_t frame_bytes_avg;   // EWMA of bytes per frame sent
+    uint32_t egress_kbps;       // over the last sample interval
+    uint32_t last_ms;
+    uint64_t last_bytes;
+    uint32_t last_frames;
+    bool primed;
+} qos_policy_t;
+
+void qos_policy_init(qos_policy_t *policy, const qos_policy_config_t *config, uint32_t now_ms);
+
+// Change the policy or cap at run time; takes effect on the next update
+void qos_policy_configure(qos_policy_t *policy, const qos_policy_config_t *config);
+
+// Re-evaluate from a new sample. Returns true if the decision changed.
+bool qos_policy_update(qos_policy_t *policy, const qos_sample_t *sample, uint32_t now_ms);
+
+// True if a consumer of `flow` that last sent a frame at last_ms may send one now
+bool qos_decision_admit(const qos_decision_t *decision, qos_flow_t flow, uint32_t last_ms, uint32_t now_ms);
+
+// How long to wait before receiving more so that `bytes` received in
+// elapsed_ms stays at or below kbps; 0 when unlimited or already behind
+uint32_t qos_pace_delay_ms(uint64_t bytes, uint32_t elapsed_ms, uint32_t kbps);
+
+// "none", "ota_pause", "ota_degrade" or "stream_first"
+const char *qos_policy_mode_name(qos_policy_mode_t mode);
+
+// Inverse of qos_policy_mode_name; returns false for an unknown name
+bool qos_policy_mode_parse(const char *name, qos_policy_mode_t *mode);
+
+#endif // QOS_POLICY_H
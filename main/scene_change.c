@@ -0,0 +1,69 @@
+#include "scene_change.h"
+
+void scene_change_init(scene_change_t *sc, uint8_t *buf_a, uint8_t *buf_b, size_t capacity,
+                       uint8_t block_delta, uint16_t changed_permille)
+{
+    sc->reference = buf_a;
+    sc->current = buf_b;
+    sc->capacity = capacity;
+    sc->block_delta = block_delta;
+    sc->changed_permille = changed_permille;
+    sc->undecodable = false;
+    scene_change_reset(sc);
+}
+
+void scene_change_reset(scene_change_t *sc)
+{
+    sc->has_reference = false;
+    sc->ref_w = 0;
+    sc->ref_h = 0;
+    sc->thumb = NULL;
+}
+
+uint32_t scene_change_count(const uint8_t *a, const uint8_t *b, size_t n, uint8_t delta, uint32_t limit)
+{
+    uint32_t count = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        int d = (int)a[i] - (int)b[i];
+        if (d > delta || d < -delta) {
+            if (++count > limit) {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+bool scene_change_update(scene_change_t *sc, const uint8_t *jpeg, size_t len)
+{
+    jpeg_dc_info_t info;
+
+    if (!jpeg_dc_luma(&sc->decoder, jpeg, len, sc->current, sc->capacity, &info)) {
+        // A thumbnail too large for the buffers is not the frame's fault
+        sc->undecodable = (size_t)info.thumb_w * info.thumb_h <= sc->capacity;
+        scene_change_reset(sc);
+        return true;
+    }
+    sc->undecodable = false;
+
+    size_t blocks = (size_t)info.thumb_w * info.thumb_h;
+    bool changed = true;
+
+    if (sc->has_reference && info.thumb_w == sc->ref_w && info.thumb_h == sc->ref_h) {
+        uint32_t limit = (uint32_t)(blocks * sc->changed_permille / 1000);
+        uint32_t count = scene_change_count(sc->reference, sc->current, blocks, sc->block_delta, limit);
+        changed = count > limit;
+    }
+
+    if (changed) {
+        uint8_t *tmp = sc->reference;
+        sc->reference = sc->current;
+        sc->current = tmp;
+        sc->ref_w = info.thumb_w;
+        sc->ref_h = info.thumb_h;
+        sc->has_reference = true;
+    }
+    sc->thumb = changed ? sc->reference : sc->current;
+    return changed;
+}
@@ -0,0 +1,48 @@
+#ifndef SCENE_CHANGE_H
+#define SCENE_CHANGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "jpeg_dc.h"
+
+// Static-scene detection for the capture pipeline.
+//
+// Each JPEG is reduced to its luma DC thumbnail (jpeg_dc.h) and compared with
+// the thumbnail of the last frame that was considered changed. A block counts
+// as changed when its mean luma moved by more than block_delta; the frame is
+// changed when more than changed_permille of the blocks did. Comparing against
+// the last changed frame rather than the previous one means a slow drift is
+// still detected once it adds up. No ESP-IDF dependencies.
+
+typedef struct {
+    jpeg_dc_decoder_t decoder;
+    uint8_t *reference;         // thumbnail of the last changed frame
+    uint8_t *current;
+    size_t capacity;            // bytes in each thumbnail buffer
+    uint16_t ref_w;
+    uint16_t ref_h;
+    bool has_reference;
+    bool undecodable;           // the last frame's entropy data is corrupt
+    const uint8_t *thumb;       // the last frame's thumbnail (ref_w x ref_h), NULL if none
+    uint8_t block_delta;
+    uint16_t changed_permille;
+} scene_change_t;
+
+// buf_a and buf_b each hold `capacity` bytes, enough for the largest
+// thumbnail (width / 8 * height / 8); larger frames are always "changed"
+void scene_change_init(scene_change_t *sc, uint8_t *buf_a, uint8_t *buf_b, size_t capacity,
+                       uint8_t block_delta, uint16_t changed_permille);
+
+// Returns false if the frame is near-identical to the reference. Frames that
+// cannot be decoded are reported as changed and set `undecodable`.
+bool scene_change_update(scene_change_t *sc, const uint8_t *jpeg, size_t len);
+
+// Forget the reference so the next frame is reported as changed
+void scene_change_reset(scene_change_t *sc);
+
+// Similarity kernel: number of positions where a and b differ by more than
+// delta, stopping early once `limit` is exceeded
+uint32_t scene_change_count(const uint8_t *a, const uint8_t *b, size_t n, uint8_t delta, uint32_t limit);
+
+#endif // SCENE_CHANGE_H
@@ -0,0 +1,185 @@
+#include "sensor_profile.h"
+#include <string.h>
+
+// OV2640 registers, as esp32-camera's ov2640.c programs them
+#define OV2640_QS       SENSOR_REG(SENSOR_BANK_DSP, 0x44)
+#define OV2640_CTRL2    SENSOR_REG(SENSOR_BANK_DSP, 0x86)
+#define OV2640_CTRL3    SENSOR_REG(SENSOR_BANK_DSP, 0x87)
+#define OV2640_CTRL0    SENSOR_REG(SENSOR_BANK_DSP, 0xC2)
+#define OV2640_CTRL1    SENSOR_REG(SENSOR_BANK_DSP, 0xC3)
+#define OV2640_REG04    SENSOR_REG(SENSOR_BANK_SENSOR, 0x04)
+#define OV2640_COM7     SENSOR_REG(SENSOR_BANK_SENSOR, 0x12)
+#define OV2640_COM8     SENSOR_REG(SENSOR_BANK_SENSOR, 0x13)
+#define OV2640_COM9     SENSOR_REG(SENSOR_BANK_SENSOR, 0x14)
+
+#define CTRL0_AEC_EN    0x80
+#define CTRL1_RAW_GMA   0x20
+#define CTRL1_AWB       0x08
+#define CTRL1_AWB_GAIN  0x04
+#define CTRL1_LENC      0x02
+#define CTRL2_DCW       0x20
+#define CTRL3_BPC       0x80
+#define CTRL3_WPC       0x40
+#define REG04_HFLIP     0x80
+#define REG04_VFLIP     0x50  // VFLIP_IMG and VREF_EN, as set_vflip() writes them
+#define COM7_COLOR_BAR  0x02
+#define COM8_AGC_EN     0x04
+#define COM8_AEC_EN     0x01
+#define COM9_DEFAULT    0x08  // set_gainceiling() writes the whole register
+
+// "day" matches what camera_init used to set one call at a time
+static const sensor_profile_t s_profiles[] = {
+    {
+        .name = "day", .quality = -1, .gainceiling = 0,
+        .aec = true, .aec2 = false, .agc = true, .awb = true, .awb_gain = true,
+        .raw_gma = true, .lenc = true, .bpc = false, .wpc = true, .dcw = true,
+    },
+    {
+        // Up to 32x gain and DSP exposure control, at the cost of frame rate;
+        // both pixel corrections against the extra noise
+        .name = "night", .quality = -1, .gainceiling = 4,
+        .aec = true, .aec2 = true, .agc = true, .awb = true, .awb_gain = true,
+        .raw_gma = true, .lenc = true, .bpc = true, .wpc = true, .dcw = true,
+    },
+    {
+        // Smaller frames until the bandwidth arbiter picks another quality
+        .name = "lowbw", .quality = 30, .gainceiling = 0,
+        .aec = true, .aec2 = false, .agc = true, .awb = true, .awb_gain = true,
+        .raw_gma = true, .lenc = true, .bpc = false, .wpc = true, .dcw = true,
+    },
+    {
+        // Gain rather than long exposures, and frames that leave the DVP
+        // sooner
+        .name = "highfps", .quality = 15, .gainceiling = 3,
+        .aec = true, .aec2 = false, .agc = true, .awb = true, .awb_gain = true,
+        .raw_gma = true, .lenc = true, .bpc = false, .wpc = true, .dcw = true,
+    },
+};
+
+#define SENSOR_PROFILE_COUNT ((int)(sizeof(s_profiles) / sizeof(s_profiles[0])))
+
+const sensor_profile_t *sensor_profile_find(const char *name)
+{
+    for (int i = 0; i < SENSOR_PROFILE_COUNT; i++) {
+        if (strcmp(s_profiles[i].name, name) == 0) {
+            return &s_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+const sensor_profile_t *sensor_profile_get(int index)
+{
+    return index >= 0 && index < SENSOR_PROFILE_COUNT ? &s_profiles[index] : NULL;
+}
+
+// Merge one setting into the table, which is kept sorted by register
+static void table_set(sensor_reg_table_t *table, uint16_t reg, uint8_t mask, bool on, uint8_t bits)
+{
+    int i = 0;
+
+    while (i < table->count && table->regs[i].reg < reg) {
+        i++;
+    }
+    if (i == table->count || table->regs[i].reg != reg) {
+        if (table->count == SENSOR_PROFILE_MAX_REGS) {
+            return;
+        }
+        memmove(&table->regs[i + 1], &table->regs[i], (table->count - i) * sizeof(table->regs[0]));
+        table->regs[i].reg = reg;
+        table->regs[i].mask = 0;
+        table->regs[i].value = 0;
+        table->count++;
+    }
+    table->regs[i].mask |= mask;
+    table->regs[i].value = (uint8_t)((table->regs[i].value & ~mask) | (on ? bits & mask : 0));
+}
+
+void sensor_profile_compile(const sensor_profile_t *profile, sensor_reg_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+
+    if (profile->quality >= 0) {
+        table_set(table, OV2640_QS, 0xFF, true, (uint8_t)(profile->quality & 0x3F));
+    }
+    table_set(table, OV2640_CTRL2, CTRL2_DCW, profile->dcw, CTRL2_DCW);
+    table_set(table, OV2640_CTRL3, CTRL3_BPC, profile->bpc, CTRL3_BPC);
+    table_set(table, OV2640_CTRL3, CTRL3_WPC, profile->wpc, CTRL3_WPC);
+    table_set(table, OV2640_CTRL0, CTRL0_AEC_EN, profile->aec2, CTRL0_AEC_EN);
+    table_set(table, OV2640_CTRL1, CTRL1_RAW_GMA, profile->raw_gma, CTRL1_RAW_GMA);
+    table_set(table, OV2640_CTRL1, CTRL1_AWB, profile->awb, CTRL1_AWB);
+    table_set(table, OV2640_CTRL1, CTRL1_AWB_GAIN, profile->awb_gain, CTRL1_AWB_GAIN);
+    table_set(table, OV2640_CTRL1, CTRL1_LENC, profile->lenc, CTRL1_LENC);
+    table_set(table, OV2640_REG04, REG04_HFLIP, profile->hmirror, REG04_HFLIP);
+    table_set(table, OV2640_REG04, REG04_VFLIP, profile->vflip, REG04_VFLIP);
+    table_set(table, OV2640_COM7, COM7_COLOR_BAR, profile->colorbar, COM7_COLOR_BAR);
+    table_set(table, OV2640_COM8, COM8_AEC_EN, profile->aec, COM8_AEC_EN);
+    table_set(table, OV2640_COM8, COM8_AGC_EN, profile->agc, COM8_AGC_EN);
+    uint8_t ceiling = profile->gainceiling > 6 ? 6 : profile->gainceiling;
+    table_set(table, OV2640_COM9, 0xFF, true, (uint8_t)(COM9_DEFAULT | ceiling << 5));
+}
+
+void sensor_reg_cache_clear(sensor_reg_cache_t *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+}
+
+static sensor_reg_cache_entry_t *cache_lookup(sensor_reg_cache_t *cache, uint16_t reg, bool add)
+{
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->entries[i].reg == reg) {
+            return &cache->entries[i];
+        }
+    }
+    if (!add || cache->count == SENSOR_REG_CACHE_SIZE) {
+        return NULL;
+    }
+    sensor_reg_cache_entry_t *entry = &cache->entries[cache->count++];
+    entry->reg = reg;
+    entry->value = 0;
+    entry->known = 0;
+    return entry;
+}
+
+bool sensor_profile_apply(sensor_reg_cache_t *cache, const sensor_reg_table_t *table,
+                          sensor_reg_write_fn write, void *ctx, sensor_apply_result_t *result)
+{
+    sensor_reg_t batch[SENSOR_PROFILE_MAX_REGS];
+    sensor_apply_result_t res = {0};
+    size_t count = 0;
+
+    for (int i = 0; i < table->count; i++) {
+        const sensor_reg_t *r = &table->regs[i];
+        const sensor_reg_cache_entry_t *entry = cache_lookup(cache, r->reg, false);
+        if (entry != NULL && (entry->known & r->mask) == r->mask &&
+            (entry->value & r->mask) == (r->value & r->mask)) {
+            res.unchanged++;
+            continue;
+        }
+        if (count > 0 && SENSOR_REG_BANK(batch[count - 1].reg) != SENSOR_REG_BANK(r->reg)) {
+            res.bank_switches++;
+        }
+        batch[count++] = *r;
+    }
+
+    bool ok = count == 0 || write(ctx, batch, count);
+    for (size_t i = 0; i < count; i++) {
+        sensor_reg_cache_entry_t *entry = cache_lookup(cache, batch[i].reg, ok);
+        if (entry == NULL) {
+            continue;
+        }
+        if (ok) {
+            entry->value = (uint8_t)((entry->value & ~batch[i].mask) | (batch[i].value & batch[i].mask));
+            entry->known |= batch[i].mask;
+        } else {
+            // Some of the batch may have been written
+            entry->known = 0;
+        }
+    }
+
+    res.written = ok ? (uint8_t)count : 0;
+    if (result != NULL) {
+        *result = res;
+    }
+    return ok;
+}
@@ -0,0 +1,100 @@
+#ifndef SENSOR_PROFILE_H
+#define SENSOR_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Named OV2640 sensor profiles and a register loader that writes only what
+// changed.
+//
+// A profile is a set of the driver's sensor_t settings (AEC, AGC, AWB, gain
+// ceiling, DSP corrections, orientation, JPEG quality). It compiles into a
+// table with one entry per register, so settings that share a register (the
+// four DSP flags in CTRL1, AEC and AGC in COM8) become a single write, sorted
+// by register bank. Applying a table compares it with a cache of what was
+// last written and hands only the registers that differ to the bus in one
+// call; a register the cache knows nothing about, as after a sensor reset,
+// is always written. The bus is a function pointer, so the loader runs
+// against a mock SCCB bus on any host. No ESP-IDF dependencies.
+
+// Register address as sensor_t::set_reg() takes it: bank in bit 8
+#define SENSOR_BANK_DSP 0
+#define SENSOR_BANK_SENSOR 1
+#define SENSOR_REG(bank, addr) ((uint16_t)((bank) << 8 | (addr)))
+#define SENSOR_REG_BANK(reg) (((reg) >> 8) & 0x01)
+
+#define SENSOR_PROFILE_MAX_REGS 12
+#define SENSOR_REG_CACHE_SIZE 16
+
+// Bits in mask are set from value; the rest of the register is kept
+typedef struct {
+    uint16_t reg;
+    uint8_t mask;
+    uint8_t value;
+} sensor_reg_t;
+
+typedef struct {
+    sensor_reg_t regs[SENSOR_PROFILE_MAX_REGS];
+    uint8_t count;
+} sensor_reg_table_t;
+
+// Field names and ranges follow camera_status_t in esp32-camera
+typedef struct {
+    const char *name;
+    int8_t quality;             // 0-63, -1 keeps the current one
+    uint8_t gainceiling;        // 0-6: 2x to 128x
+    bool aec;
+    bool aec2;                  // DSP AEC: longer exposures, lower frame rate in the dark
+    bool agc;
+    bool awb;
+    bool awb_gain;
+    bool raw_gma;
+    bool lenc;
+    bool bpc;
+    bool wpc;
+    bool dcw;
+    bool hmirror;
+    bool vflip;
+    bool colorbar;
+} sensor_profile_t;
+
+typedef struct {
+    uint16_t reg;
+    uint8_t value;
+    uint8_t known;              // bits of value that match the sensor
+} sensor_reg_cache_entry_t;
+
+typedef struct {
+    sensor_reg_cache_entry_t entries[SENSOR_REG_CACHE_SIZE];
+    uint8_t count;
+} sensor_reg_cache_t;
+
+// Write `count` registers in one transaction, in order. Returns false if any
+// write failed.
+typedef bool (*sensor_reg_write_fn)(void *ctx, const sensor_reg_t *regs, size_t count);
+
+typedef struct {
+    uint8_t written;
+    uint8_t unchanged;
+    uint8_t bank_switches;      // bank selects in the batch after the first
+} sensor_apply_result_t;
+
+// Built-in profiles: "day", "night", "lowbw", "highfps". sensor_profile_get()
+// returns NULL past the last one.
+const sensor_profile_t *sensor_profile_find(const char *name);
+const sensor_profile_t *sensor_profile_get(int index);
+
+void sensor_profile_compile(const sensor_profile_t *profile, sensor_reg_table_t *table);
+
+// Forget every register, as after a sensor reset or a driver reinit
+void sensor_reg_cache_clear(sensor_reg_cache_t *cache);
+
+// Write the registers of `table` that differ from the cache with a single
+// call to `write` (none if nothing changed) and record them. When the write
+// fails the batch's registers are forgotten and false is returned. `result`
+// may be NULL.
+bool sensor_profile_apply(sensor_reg_cache_t *cache, const sensor_reg_table_t *table,
+                          sensor_reg_write_fn write, void *ctx, sensor_apply_result_t *result);
+
+#endif // SENSOR_PROFILE_H
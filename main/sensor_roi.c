@@ -0,0 +1,108 @@
+#include "sensor_roi.h"
+
+typedef struct {
+    sensor_roi_mode_t mode;
+    uint8_t div;        // full-resolution pixels per readout pixel
+    uint16_t max_w;     // readout size of the mode
+    uint16_t max_h;
+} sensor_roi_mode_info_t;
+
+// Most binned first; CIF reads out 296 lines, not 300
+#define SENSOR_ROI_MODE_COUNT 3
+
+static const sensor_roi_mode_info_t s_modes[SENSOR_ROI_MODE_COUNT] = {
+    { SENSOR_ROI_MODE_CIF, 4, 400, 296 },
+    { SENSOR_ROI_MODE_SVGA, 2, 800, 600 },
+    { SENSOR_ROI_MODE_UXGA, 1, 1600, 1200 },
+};
+
+static uint16_t clamp_u16(uint32_t v, uint16_t lo, uint16_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+bool sensor_roi_map(const sensor_roi_rect_t *roi, uint16_t max_out_w, uint16_t max_out_h,
+                    sensor_roi_window_t *win)
+{
+    if (max_out_w < 16 || max_out_h < 8) {
+        return false;
+    }
+
+    // Clamp to the sensor, moving the ROI rather than shrinking it
+    sensor_roi_rect_t r;
+    r.w = clamp_u16(roi->w, SENSOR_ROI_MIN_W, SENSOR_ROI_FULL_W);
+    r.h = clamp_u16(roi->h, SENSOR_ROI_MIN_H, SENSOR_ROI_FULL_H);
+    r.x = roi->x + r.w > SENSOR_ROI_FULL_W ? SENSOR_ROI_FULL_W - r.w : roi->x;
+    r.y = roi->y + r.h > SENSOR_ROI_FULL_H ? SENSOR_ROI_FULL_H - r.h : roi->y;
+
+    // Output keeps the ROI aspect ratio and is never larger than the ROI
+    uint32_t out_w = max_out_w;
+    uint32_t out_h = max_out_h;
+    if ((uint32_t)r.w * max_out_h > (uint32_t)r.h * max_out_w) {
+        out_h = (uint32_t)max_out_w * r.h / r.w;
+    } else {
+        out_w = (uint32_t)max_out_h * r.w / r.h;
+    }
+    if (out_w > r.w) {
+        out_h = out_h * r.w / out_w;
+        out_w = r.w;
+    }
+    if (out_h > r.h) {
+        out_w = out_w * r.h / out_h;
+        out_h = r.h;
+    }
+    // JPEG MCUs are 16x8 for the OV2640's 4:2:2 output
+    out_w &= ~15u;
+    out_h &= ~7u;
+    if (out_w < 16) {
+        out_w = 16;
+    }
+    if (out_h < 8) {
+        out_h = 8;
+    }
+
+    for (int i = 0; i < SENSOR_ROI_MODE_COUNT; i++) {
+        const sensor_roi_mode_info_t *m = &s_modes[i];
+        uint32_t win_w = (r.w / m->div) & ~3u;
+        uint32_t win_h = (r.h / m->div) & ~3u;
+        uint32_t off_x = r.x / m->div;
+        uint32_t off_y = r.y / m->div;
+        bool last = i == SENSOR_ROI_MODE_COUNT - 1;
+
+        if (off_y + win_h > m->max_h) {
+            off_y = win_h <= m->max_h ? m->max_h - win_h : 0;
+        }
+        if (!last && (win_w < out_w || win_h < out_h || off_x + win_w > m->max_w || win_h > m->max_h)) {
+            continue;
+        }
+
+        win->mode = m->mode;
+        win->offset_x = off_x;
+        win->offset_y = off_y;
+        win->window_w = win_w;
+        win->window_h = win_h;
+        win->out_w = out_w;
+        win->out_h = out_h;
+        win->applied.x = off_x * m->div;
+        win->applied.y = off_y * m->div;
+        win->applied.w = win_w * m->div;
+        win->applied.h = win_h * m->div;
+        return true;
+    }
+
+    return false;
+}
+
+const char *sensor_roi_mode_name(sensor_roi_mode_t mode)
+{
+    switch (mode) {
+    case SENSOR_ROI_MODE_UXGA:
+        return "UXGA";
+    case SENSOR_ROI_MODE_SVGA:
+        return "SVGA";
+    case SENSOR_ROI_MODE_CIF:
+        return "CIF";
+    default:
+        return "?";
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SENSOR_ROI_H
+#define SENSOR_ROI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Region-of-interest to OV2640 sensor window mapping.
+//
+// The OV2640 reads out its array in one of three modes: UXGA (full
+// resolution), SVGA (2x binned) or CIF (4x binned). The DSP then crops a
+// window from that readout and scales it down to the output size. A ROI is
+// given in full-resolution sensor pixels; the mapping picks the most binned
+// mode that still has at least one readout pixel per output pixel (binned
+// modes run at a higher frame rate), aligns the window as the registers
+// require and keeps the ROI aspect ratio without ever upscaling. The result
+// is the argument list of sensor_t::set_res_raw() for the OV2640. No ESP-IDF
+// dependencies.
+
+#define SENSOR_ROI_FULL_W 1600
+#define SENSOR_ROI_FULL_H 1200
+#define SENSOR_ROI_MIN_W 64
+#define SENSOR_ROI_MIN_H 48
+
+// Values match ov2640_sensor_mode_t in esp32-camera
+typedef enum {
+    SENSOR_ROI_MODE_UXGA = 0,
+    SENSOR_ROI_MODE_SVGA = 1,
+    SENSOR_ROI_MODE_CIF = 2
+} sensor_roi_mode_t;
+
+// Rectangle in full-resolution sensor pixels
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+} sensor_roi_rect_t;
+
+typedef struct {
+    sensor_roi_mode_t mode;
+    uint16_t offset_x;          // window offset in readout pixels of `mode`
+    uint16_t offset_y;
+    uint16_t window_w;          // window size in readout pixels, multiple of 4
+    uint16_t window_h;
+    uint16_t out_w;             // DSP output size, multiple of 16 x 8
+    uint16_t out_h;
+    sensor_roi_rect_t applied;  // effective ROI after clamping and alignment
+} sensor_roi_window_t;
+
+// Map `roi` to a sensor window with an output no larger than max_out_w x
+// max_out_h. The ROI is clamped to the sensor. Returns false only if the
+// maximum output size is too small to be usable.
+bool sensor_roi_map(const sensor_roi_rect_t *roi, uint16_t max_out_w, uint16_t max_out_h,
+                    sensor_roi_window_t *win);
+
+const char *sensor_roi_mode_name(sensor_roi_mode_t mode);
+
+#endif // SENSOR_ROI_H
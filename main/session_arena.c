@@ -0,0 +1,125 @@
+#include "session_arena.h"
+#include <string.h>
+
+static void stat_max(atomic_uint *stat, unsigned int value)
+{
+    unsigned int current = atomic_load_explicit(stat, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(stat, &current, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+bool session_arena_pool_init(session_arena_pool_t *pool, void *memory, size_t block_size, uint32_t count,
+                             session_arena_spill_alloc_fn spill_alloc, session_arena_spill_free_fn spill_free)
+{
+    if (pool == NULL || memory == NULL || block_size < SESSION_ARENA_ALIGN ||
+        count == 0 || count > SESSION_ARENA_MAX) {
+        return false;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->block_size = block_size & ~(size_t)(SESSION_ARENA_ALIGN - 1);
+    pool->count = count;
+    pool->spill_alloc = spill_alloc;
+    pool->spill_free = spill_free;
+
+    for (uint32_t i = 0; i < count; i++) {
+        session_arena_t *arena = &pool->arenas[i];
+        arena->pool = pool;
+        arena->base = (uint8_t *)memory + i * pool->block_size;
+        arena->index = i;
+    }
+
+    atomic_init(&pool->free_mask, (1u << count) - 1);
+    atomic_init(&pool->in_use, 0);
+    atomic_init(&pool->high_water, 0);
+    atomic_init(&pool->peak_used, 0);
+    atomic_init(&pool->opens, 0);
+    atomic_init(&pool->exhausted, 0);
+    atomic_init(&pool->spills, 0);
+    atomic_init(&pool->spill_failures, 0);
+    return true;
+}
+
+session_arena_t *session_arena_open(session_arena_pool_t *pool)
+{
+    unsigned int mask = atomic_load_explicit(&pool->free_mask, memory_order_relaxed);
+
+    while (mask != 0) {
+        uint32_t index = (uint32_t)__builtin_ctz(mask);
+        unsigned int desired = mask & ~(1u << index);
+        if (atomic_compare_exchange_weak_explicit(&pool->free_mask, &mask, desired,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            session_arena_t *arena = &pool->arenas[index];
+            arena->used = 0;
+            arena->spill_count = 0;
+
+            atomic_fetch_add_explicit(&pool->opens, 1, memory_order_relaxed);
+            unsigned int in_use = atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed) + 1;
+            stat_max(&pool->high_water, in_use);
+            return arena;
+        }
+        // mask was reloaded by the failed CAS
+    }
+
+    atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+    return NULL;
+}
+
+void *session_arena_alloc(session_arena_t *arena, size_t size)
+{
+    session_arena_pool_t *pool = arena->pool;
+    size_t rounded = (size + SESSION_ARENA_ALIGN - 1) & ~(size_t)(SESSION_ARENA_ALIGN - 1);
+
+    if (rounded >= size && rounded <= pool->block_size - arena->used) {
+        void *ptr = arena->base + arena->used;
+        arena->used += rounded;
+        stat_max(&pool->peak_used, (unsigned int)arena->used);
+        return ptr;
+    }
+
+    void *ptr = NULL;
+    if (pool->spill_alloc != NULL && arena->spill_count < SESSION_ARENA_MAX_SPILLS) {
+        ptr = pool->spill_alloc(size);
+    }
+    if (ptr == NULL) {
+        atomic_fetch_add_explicit(&pool->spill_failures, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    arena->spills[arena->spill_count++] = ptr;
+    atomic_fetch_add_explicit(&pool->spills, 1, memory_order_relaxed);
+    return ptr;
+}
+
+void session_arena_close(session_arena_t *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    session_arena_pool_t *pool = arena->pool;
+    for (uint32_t i = 0; i < arena->spill_count; i++) {
+        pool->spill_free(arena->spills[i]);
+        arena->spills[i] = NULL;
+    }
+    arena->spill_count = 0;
+    arena->used = 0;
+
+    atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+    atomic_fetch_or_explicit(&pool->free_mask, 1u << arena->index, memory_order_release);
+}
+
+void session_arena_get_stats(session_arena_pool_t *pool, session_arena_stats_t *stats)
+{
+    stats->count = pool->count;
+    stats->block_size = (uint32_t)pool->block_size;
+    stats->in_use = atomic_load(&pool->in_use);
+    stats->high_water = atomic_load(&pool->high_water);
+    stats->peak_used = atomic_load(&pool->peak_used);
+    stats->opens = atomic_load(&pool->opens);
+    stats->exhausted = atomic_load(&pool->exhausted);
+    stats->spills = atomic_load(&pool->spills);
+    stats->spill_failures = atomic_load(&pool->spill_failures);
+}
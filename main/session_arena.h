@@ -0,0 +1,84 @@
+#ifndef SESSION_ARENA_H
+#define SESSION_ARENA_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pool of fixed-size arenas for per-request scratch memory.
+//
+// Handlers that need temporary buffers (response snapshots, task lists,
+// headers) open an arena, bump-allocate from it and close it when the
+// response is sent; nothing is freed individually. The blocks are carved
+// from one region allocated once, so connect/disconnect churn never touches
+// the heap. A request that outgrows its block spills to the heap through the
+// supplied allocator; spills are counted, freed on close, and tell whether
+// the block size is too small. Open/close are lock-free (a CAS on a free
+// bitmap, as in frame_pool) and the pool has no ESP-IDF dependencies.
+
+#define SESSION_ARENA_MAX 16
+#define SESSION_ARENA_MAX_SPILLS 4
+#define SESSION_ARENA_ALIGN 8
+
+typedef void *(*session_arena_spill_alloc_fn)(size_t size);
+typedef void (*session_arena_spill_free_fn)(void *ptr);
+
+typedef struct session_arena_pool session_arena_pool_t;
+
+typedef struct {
+    // Private
+    session_arena_pool_t *pool;
+    uint8_t *base;
+    size_t used;
+    uint32_t index;
+    void *spills[SESSION_ARENA_MAX_SPILLS];
+    uint32_t spill_count;
+} session_arena_t;
+
+struct session_arena_pool {
+    session_arena_t arenas[SESSION_ARENA_MAX];
+    size_t block_size;
+    uint32_t count;
+    session_arena_spill_alloc_fn spill_alloc;
+    session_arena_spill_free_fn spill_free;
+    atomic_uint free_mask;
+    atomic_uint in_use;
+    atomic_uint high_water;
+    atomic_uint peak_used;      // most bytes used in one block
+    atomic_uint opens;
+    atomic_uint exhausted;      // open failed, every arena in use
+    atomic_uint spills;
+    atomic_uint spill_failures;
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t block_size;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t peak_used;
+    uint32_t opens;
+    uint32_t exhausted;
+    uint32_t spills;
+    uint32_t spill_failures;
+} session_arena_stats_t;
+
+// Carve `memory` (at least block_size * count bytes, 8-byte aligned) into
+// arenas. spill_alloc/spill_free may be NULL to disable spilling.
+bool session_arena_pool_init(session_arena_pool_t *pool, void *memory, size_t block_size, uint32_t count,
+                             session_arena_spill_alloc_fn spill_alloc, session_arena_spill_free_fn spill_free);
+
+// Take a free arena; NULL if all are in use
+session_arena_t *session_arena_open(session_arena_pool_t *pool);
+
+// size bytes, 8-byte aligned, valid until close. Falls back to a spill when
+// the block is full; NULL only if that fails too.
+void *session_arena_alloc(session_arena_t *arena, size_t size);
+
+// Free the spills and return the arena to its pool. NULL is ignored.
+void session_arena_close(session_arena_t *arena);
+
+void session_arena_get_stats(session_arena_pool_t *pool, session_arena_stats_t *stats);
+
+#endif // SESSION_ARENA_H
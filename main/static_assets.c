@@ -0,0 +1,106 @@
+#include "static_assets.h"
+#include "web_assets.h"
+#include "http_server.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include <string.h>
+
+static const char *TAG = "static_assets";
+
+#define STATIC_ASSETS_IF_NONE_MATCH_LEN 128
+
+// Only touched from the httpd task
+static static_assets_stats_t s_stats;
+
+// If-None-Match may carry a list of ETags, optionally weak ("W/"), or "*"
+static bool etag_matches(const char *header, const char *etag)
+{
+    size_t etag_len = strlen(etag);
+    const char *p = header;
+
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
+        }
+        if (strncmp(p, etag, etag_len) == 0 && (p[etag_len] == '\0' || p[etag_len] == ',' || p[etag_len] == ' ')) {
+            return true;
+        }
+        while (*p && *p != ',') {
+            p++;
+        }
+    }
+    return false;
+}
+
+static esp_err_t static_asset_handler(httpd_req_t *req)
+{
+    const web_asset_t *asset = req->user_ctx;
+    char if_none_match[STATIC_ASSETS_IF_NONE_MATCH_LEN];
+
+    httpd_resp_set_hdr(req, "ETag", asset->etag);
+    httpd_resp_set_hdr(req, "Cache-Control", asset->cache_control);
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        etag_matches(if_none_match, asset->etag)) {
+        s_stats.not_modified++;
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Every browser accepts gzip; there is no uncompressed copy on the device
+    httpd_resp_set_type(req, asset->content_type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    s_stats.responses++;
+    s_stats.bytes_sent += asset->gzip_len;
+    return httpd_resp_send(req, (const char *)asset->gzip_data, asset->gzip_len);
+}
+
+esp_err_t static_assets_init(void)
+{
+    size_t packed = 0;
+    size_t total = 0;
+
+    for (size_t i = 0; i < web_assets_count; i++) {
+        httpd_uri_t uri = {
+            .uri = web_assets[i].uri,
+            .method = HTTP_GET,
+            .handler = static_asset_handler,
+            .user_ctx = (void *)&web_assets[i]
+        };
+        esp_err_t ret = http_server_register_handler(&uri);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        packed += web_assets[i].gzip_len;
+        total += web_assets[i].size;
+    }
+
+    ESP_LOGI(TAG, "Serving %u web assets (%u bytes, %u gzipped)", (unsigned)web_assets_count,
+             (unsigned)total, (unsigned)packed);
+    return ESP_OK;
+}
+
+esp_err_t static_assets_deinit(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    for (size_t i = 0; i < web_assets_count; i++) {
+        esp_err_t err = http_server_unregister_handler(web_assets[i].uri, HTTP_GET);
+        if (err != ESP_OK) {
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+void static_assets_get_stats(static_assets_stats_t *stats)
+{
+    *stats = s_stats;
+}
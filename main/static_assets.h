@@ -0,0 +1,23 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Static asset statistics
+typedef struct {
+    uint32_t responses;         // 200 responses
+    uint32_t not_modified;      // 304 responses
+    uint64_t bytes_sent;        // gzipped body bytes
+} static_assets_stats_t;
+
+// Register a GET handler for every embedded web asset. Assets are sent
+// gzipped with a strong ETag; a matching If-None-Match gets 304.
+esp_err_t static_assets_init(void);
+
+// Unregister the asset handlers
+esp_err_t static_assets_deinit(void);
+
+void static_assets_get_stats(static_assets_stats_t *stats);
+
+#endif // STATIC_ASSETS_H
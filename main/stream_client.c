@@ -0,0 +1,105 @@
+#include "stream_client.h"
+#include <string.h>
+
+void stream_client_init(stream_client_t *client, uint8_t depth, uint32_t stall_timeout_ms, uint32_t now_ms)
+{
+    memset(client, 0, sizeof(*client));
+    if (depth < 1) {
+        depth = 1;
+    } else if (depth > STREAM_CLIENT_QUEUE_MAX) {
+        depth = STREAM_CLIENT_QUEUE_MAX;
+    }
+    client->depth = depth;
+    client->stall_timeout_ms = stall_timeout_ms;
+    client->last_progress_ms = now_ms;
+}
+
+void stream_client_offer(stream_client_t *client, frame_t *frame, uint32_t now_ms)
+{
+    if (client->inflight == NULL && client->count == 0) {
+        client->last_progress_ms = now_ms;
+    }
+
+    if (client->count == client->depth) {
+        frame_unref(client->queue[client->head]);
+        client->head = (client->head + 1) % client->depth;
+        client->count--;
+        client->frames_dropped++;
+    }
+
+    uint8_t tail = (client->head + client->count) % client->depth;
+    client->queue[tail] = frame;
+    client->count++;
+}
+
+frame_t *stream_client_current(stream_client_t *client)
+{
+    if (client->inflight == NULL && client->count > 0) {
+        client->inflight = client->queue[client->head];
+        client->queue[client->head] = NULL;
+        client->head = (client->head + 1) % client->depth;
+        client->count--;
+        client->hdr_len = 0;
+        client->offset = 0;
+    }
+    return client->inflight;
+}
+
+size_t stream_client_pending(const stream_client_t *client, const uint8_t **data)
+{
+    const frame_t *frame = client->inflight;
+    if (frame == NULL) {
+        *data = NULL;
+        return 0;
+    }
+
+    if (client->offset < client->hdr_len) {
+        *data = (const uint8_t *)client->hdr + client->offset;
+        return client->hdr_len - client->offset;
+    }
+
+    size_t body_off = client->offset - client->hdr_len;
+    *data = frame->data + body_off;
+    return frame->len - body_off;
+}
+
+void stream_client_wrote(stream_client_t *client, size_t n, uint32_t now_ms)
+{
+    if (client->inflight == NULL || n == 0) {
+        return;
+    }
+
+    client->offset += n;
+    client->bytes_sent += n;
+    client->last_progress_ms = now_ms;
+
+    if (client->offset >= client->hdr_len + client->inflight->len) {
+        frame_unref(client->inflight);
+        client->inflight = NULL;
+        client->offset = 0;
+        client->hdr_len = 0;
+        client->frames_sent++;
+    }
+}
+
+bool stream_client_stalled(const stream_client_t *client, uint32_t now_ms)
+{
+    if (client->inflight == NULL && client->count == 0) {
+        return false;
+    }
+    return now_ms - client->last_progress_ms > client->stall_timeout_ms;
+}
+
+void stream_client_flush(stream_client_t *client)
+{
+    while (client->count > 0) {
+        frame_unref(client->queue[client->head]);
+        client->queue[client->head] = NULL;
+        client->head = (client->head + 1) % client->depth;
+        client->count--;
+    }
+    frame_unref(client->inflight);
+    client->inflight = NULL;
+    client->offset = 0;
+    client->hdr_len = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef STREAM_CLIENT_H
+#define STREAM_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "frame_pool.h"
+
+// Per-connection send queue for a streaming client.
+//
+// Frames are offered as soon as they are captured; the queue is bounded and
+// latest-frame-wins, so when a client cannot keep up the oldest queued frame
+// is dropped (and counted) instead of blocking the capture side. One frame at
+// a time is "in flight": its multipart header and body are written with
+// non-blocking socket writes and progress is tracked here, which is also how
+// a stalled client is detected. Only depends on frame_pool, so it can be
+// exercised on any host.
+
+#define STREAM_CLIENT_QUEUE_MAX 2
+#define STREAM_CLIENT_HDR_LEN 96
+
+typedef struct {
+    frame_t *queue[STREAM_CLIENT_QUEUE_MAX];
+    uint8_t depth;
+    uint8_t head;
+    uint8_t count;
+
+    // Frame currently being written: hdr first, then the frame body
+    frame_t *inflight;
+    char hdr[STREAM_CLIENT_HDR_LEN];
+    size_t hdr_len;
+    size_t offset;
+
+    uint32_t stall_timeout_ms;
+    uint32_t last_progress_ms;
+
+    uint32_t frames_sent;
+    uint32_t frames_dropped;
+    uint64_t bytes_sent;
+} stream_client_t;
+
+// depth is clamped to 1..STREAM_CLIENT_QUEUE_MAX
+void stream_client_init(stream_client_t *client, uint8_t depth, uint32_t stall_timeout_ms, uint32_t now_ms);
+
+// Queue a frame, taking over the caller's reference. If the queue is full the
+// oldest queued frame is dropped. The stall clock starts when an idle client
+// is given something to send.
+void stream_client_offer(stream_client_t *client, frame_t *frame, uint32_t now_ms);
+
+// Current in-flight frame, promoting the oldest queued frame if none is in
+// flight. Returns NULL when there is nothing to send. The caller fills hdr and
+// hdr_len when a new frame is promoted (offset == 0 and hdr_len == 0).
+frame_t *stream_client_current(stream_client_t *client);
+
+// Bytes of the in-flight frame (header + body) still to be written, and a
+// pointer to them. Returns 0 when nothing is in flight.
+size_t stream_client_pending(const stream_client_t *client, const uint8_t **data);
+
+// Record a write of n bytes. Completes (and unreferences) the in-flight frame
+// once its last byte is written.
+void stream_client_wrote(stream_client_t *client, size_t n, uint32_t now_ms);
+
+// True if there is data waiting and no byte could be written for longer than
+// the stall timeout
+bool stream_client_stalled(const stream_client_t *client, uint32_t now_ms);
+
+// Drop every queued and in-flight frame
+void stream_client_flush(stream_client_t *client);
+
+#endif // STREAM_CLIENT_H
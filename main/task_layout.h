@@ -0,0 +1,53 @@
+#ifndef TASK_LAYOUT_H
+#define TASK_LAYOUT_H
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
+// Task topology, see "ESP32S3Cam Task Layout" in menuconfig.
+// A configured core of -1 maps to tskNO_AFFINITY.
+
+#define TASK_LAYOUT_CORE(core) ((core) < 0 ? tskNO_AFFINITY : (core))
+
+#define HTTPD_TASK_CORE             TASK_LAYOUT_CORE(CONFIG_APP_HTTPD_CORE)
+#define HTTPD_TASK_PRIORITY         CONFIG_APP_HTTPD_PRIORITY
+#define HTTPD_TASK_STACK_SIZE       CONFIG_APP_HTTPD_STACK_SIZE
+
+#define CAPTURE_TASK_CORE           TASK_LAYOUT_CORE(CONFIG_APP_CAPTURE_TASK_CORE)
+#define CAPTURE_TASK_PRIORITY       CONFIG_APP_CAPTURE_TASK_PRIORITY
+#define CAPTURE_TASK_STACK_SIZE     CONFIG_APP_CAPTURE_TASK_STACK_SIZE
+
+#define STREAM_SENDER_COUNT         CONFIG_APP_STREAM_SENDER_COUNT
+#define STREAM_SENDER_CORE          TASK_LAYOUT_CORE(CONFIG_APP_STREAM_SENDER_CORE)
+#define STREAM_SENDER_PRIORITY      CONFIG_APP_STREAM_SENDER_PRIORITY
+#define STREAM_SENDER_STACK_SIZE    CONFIG_APP_STREAM_SENDER_STACK_SIZE
+
+#define WIFI_TASK_CORE              TASK_LAYOUT_CORE(CONFIG_APP_WIFI_TASK_CORE)
+#define WIFI_TASK_PRIORITY          CONFIG_APP_WIFI_TASK_PRIORITY
+#define WIFI_TASK_STACK_SIZE        CONFIG_APP_WIFI_TASK_STACK_SIZE
+
+#ifdef CONFIG_APP_ASYNC_LOG
+#define LOG_TASK_CORE               TASK_LAYOUT_CORE(CONFIG_APP_LOG_TASK_CORE)
+#define LOG_TASK_PRIORITY           CONFIG_APP_LOG_TASK_PRIORITY
+#define LOG_TASK_STACK_SIZE         CONFIG_APP_LOG_TASK_STACK_SIZE
+#endif
+
+#ifdef CONFIG_APP_PUSH_UPLOAD
+#define PUSH_TASK_CORE              TASK_LAYOUT_CORE(CONFIG_APP_PUSH_TASK_CORE)
+#define PUSH_TASK_PRIORITY          CONFIG_APP_PUSH_TASK_PRIORITY
+#define PUSH_TASK_STACK_SIZE        CONFIG_APP_PUSH_TASK_STACK_SIZE
+#endif
+
+#ifdef CONFIG_APP_MCAST_STREAM
+#define MCAST_TASK_CORE             TASK_LAYOUT_CORE(CONFIG_APP_MCAST_TASK_CORE)
+#define MCAST_TASK_PRIORITY         CONFIG_APP_MCAST_TASK_PRIORITY
+#define MCAST_TASK_STACK_SIZE       CONFIG_APP_MCAST_TASK_STACK_SIZE
+#endif
+
+#ifdef CONFIG_APP_OTA_PULL
+#define OTA_PULL_TASK_CORE          TASK_LAYOUT_CORE(CONFIG_APP_OTA_PULL_TASK_CORE)
+#define OTA_PULL_TASK_PRIORITY      CONFIG_APP_OTA_PULL_TASK_PRIORITY
+#define OTA_PULL_TASK_STACK_SIZE    CONFIG_APP_OTA_PULL_TASK_STACK_SIZE
+#endif
+
+#endif // TASK_LAYOUT_H
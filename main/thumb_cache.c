@@ -0,0 +1,83 @@
+#include "thumb_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool thumb_cache_parse_scale(const char *value, int *shift)
+{
+    if (value == NULL || value[0] == '\0') {
+        *shift = 2;
+        return true;
+    }
+
+    // Accept "1/4" as well as "4"
+    const char *denom = strchr(value, '/');
+    if (denom != NULL && strncmp(value, "1/", 2) != 0) {
+        return false;
+    }
+    const char *digits = denom ? denom + 1 : value;
+    char *end;
+    long n = strtol(digits, &end, 10);
+    if (end == digits || *end != '\0') {
+        return false;
+    }
+    switch (n) {
+    case 2:
+        *shift = 1;
+        return true;
+    case 4:
+        *shift = 2;
+        return true;
+    case 8:
+        *shift = 3;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static thumb_cache_entry_t *entry_for(const thumb_cache_t *cache, int shift)
+{
+    if (shift < 1 || shift > THUMB_CACHE_SCALES) {
+        return NULL;
+    }
+    return (thumb_cache_entry_t *)&cache->entries[shift - 1];
+}
+
+const thumb_cache_entry_t *thumb_cache_lookup(const thumb_cache_t *cache, int shift, uint32_t seq)
+{
+    const thumb_cache_entry_t *entry = entry_for(cache, shift);
+    if (entry == NULL || entry->jpeg == NULL || entry->seq != seq) {
+        return NULL;
+    }
+    return entry;
+}
+
+uint8_t *thumb_cache_store(thumb_cache_t *cache, int shift, uint32_t seq, uint8_t *jpeg, size_t len)
+{
+    thumb_cache_entry_t *entry = entry_for(cache, shift);
+    if (entry == NULL) {
+        return jpeg;
+    }
+
+    uint8_t *old = entry->jpeg;
+    entry->jpeg = jpeg;
+    entry->len = len;
+    entry->seq = seq;
+    return old;
+}
+
+void thumb_cache_clear(thumb_cache_t *cache, int shift, void (*free_fn)(void *))
+{
+    for (int s = 1; s <= THUMB_CACHE_SCALES; s++) {
+        if (shift != 0 && s != shift) {
+            continue;
+        }
+        thumb_cache_entry_t *entry = &cache->entries[s - 1];
+        if (entry->jpeg != NULL && free_fn != NULL) {
+            free_fn(entry->jpeg);
+        }
+        entry->jpeg = NULL;
+        entry->len = 0;
+        entry->seq = 0;
+    }
+}
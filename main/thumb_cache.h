@@ -0,0 +1,44 @@
+#ifndef THUMB_CACHE_H
+#define THUMB_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-scale cache of /thumb results.
+//
+// One entry per scale (1/2, 1/4, 1/8), each holding the thumbnail of the
+// frame with sequence number `seq`. A request for a newer frame misses and
+// the rebuilt thumbnail replaces the entry; the other scales keep theirs
+// until they are asked for. The buffers are owned by the caller, which
+// allocates them and frees what store and clear hand back. No ESP-IDF
+// dependencies.
+
+#define THUMB_CACHE_SCALES 3    // shift 1..3: 1/2, 1/4, 1/8
+
+typedef struct {
+    uint32_t seq;
+    uint8_t *jpeg;              // NULL while empty
+    size_t len;
+} thumb_cache_entry_t;
+
+typedef struct {
+    thumb_cache_entry_t entries[THUMB_CACHE_SCALES];
+} thumb_cache_t;
+
+// "1/4" or "4" to the scale shift (1 for 1/2 ... 3 for 1/8); NULL or an
+// empty value gives the default 1/4. Returns false for anything else.
+bool thumb_cache_parse_scale(const char *value, int *shift);
+
+// The cached thumbnail of frame `seq` at `shift`, or NULL on a miss
+const thumb_cache_entry_t *thumb_cache_lookup(const thumb_cache_t *cache, int shift, uint32_t seq);
+
+// Replace the entry for `shift` with a thumbnail of frame `seq`, taking over
+// `jpeg`. Returns the buffer it held, for the caller to free (NULL if none).
+uint8_t *thumb_cache_store(thumb_cache_t *cache, int shift, uint32_t seq, uint8_t *jpeg, size_t len);
+
+// Empty one entry (shift 1..3) or all of them (shift 0), calling free_fn on
+// each buffer
+void thumb_cache_clear(thumb_cache_t *cache, int shift, void (*free_fn)(void *));
+
+#endif // THUMB_CACHE_H
@@ -0,0 +1,169 @@
+#include "thumbnail.h"
+#include "thumb_cache.h"
+#include "http_server.h"
+#include "capture_pipeline.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "img_converters.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "thumbnail";
+
+#define THUMB_JPEG_QUALITY 60 // img_converters scale, 1-100
+#define THUMB_FRAME_TIMEOUT_MS 1000
+
+// Held by thumb_handler() from the lookup until the cached thumbnail is sent,
+// and by thumbnail_deinit(), which runs on the lifecycle task and frees the
+// entries
+static SemaphoreHandle_t s_cache_lock = NULL;
+static thumb_cache_t s_cache;
+static thumbnail_stats_t s_stats;
+
+static bool parse_scale(httpd_req_t *req, jpg_scale_t *scale)
+{
+    char query[32];
+    char value[8] = "";
+    int shift;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "scale", value, sizeof(value));
+    }
+    if (!thumb_cache_parse_scale(value, &shift)) {
+        return false;
+    }
+    *scale = (jpg_scale_t)shift; // JPG_SCALE_2X == 1 ... JPG_SCALE_8X == 3
+    return true;
+}
+
+static esp_err_t thumb_build(const frame_t *frame, jpg_scale_t scale)
+{
+    int shift = (int)scale; // JPG_SCALE_2X == 1 ... JPG_SCALE_8X == 3
+    uint16_t width = frame->width >> shift;
+    uint16_t height = frame->height >> shift;
+    size_t rgb_len = (size_t)width * height * 2;
+    uint8_t *jpeg = NULL;
+    size_t jpeg_len = 0;
+    esp_err_t ret = ESP_OK;
+
+    // Scratch for the decode; larger sizes spill to PSRAM
+    session_arena_t *arena = http_server_arena_open();
+    uint8_t *rgb = arena != NULL ? session_arena_alloc(arena, rgb_len) : NULL;
+    if (rgb == NULL) {
+        http_server_arena_close(arena);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The decoder skips the IDCT work that the scale makes unnecessary; at
+    // 1/8 only the DC coefficients are used
+    if (!jpg2rgb565(frame->data, frame->len, rgb, scale)) {
+        ret = ESP_FAIL;
+    } else if (!fmt2jpg(rgb, rgb_len, width, height, PIXFORMAT_RGB565, THUMB_JPEG_QUALITY, &jpeg, &jpeg_len)) {
+        ret = ESP_FAIL;
+    }
+    http_server_arena_close(arena);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // fmt2jpg hands back its whole working buffer; keep only what is used
+    uint8_t *cached = heap_caps_malloc(jpeg_len, MALLOC_CAP_SPIRAM);
+    if (cached == NULL) {
+        cached = heap_caps_malloc(jpeg_len, MALLOC_CAP_8BIT);
+    }
+    if (cached == NULL) {
+        free(jpeg);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(cached, jpeg, jpeg_len);
+    free(jpeg);
+
+    heap_caps_free(thumb_cache_store(&s_cache, (int)scale, frame->seq, cached, jpeg_len));
+    return ESP_OK;
+}
+
+static esp_err_t thumb_handler(httpd_req_t *req)
+{
+    jpg_scale_t scale;
+
+    s_stats.requests++;
+    if (!parse_scale(req, &scale)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "scale must be 1/2, 1/4 or 1/8");
+    }
+
+    frame_t *frame = capture_pipeline_get_frame(0, THUMB_FRAME_TIMEOUT_MS);
+    if (frame == NULL) {
+        s_stats.failures++;
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+    const thumb_cache_entry_t *entry = thumb_cache_lookup(&s_cache, (int)scale, frame->seq);
+    if (entry != NULL) {
+        s_stats.cache_hits++;
+    } else {
+        int64_t start = esp_timer_get_time();
+        esp_err_t ret = frame->format == PIXFORMAT_JPEG ? thumb_build(frame, scale) : ESP_ERR_NOT_SUPPORTED;
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to build thumbnail: %s", esp_err_to_name(ret));
+            xSemaphoreGive(s_cache_lock);
+            frame_unref(frame);
+            s_stats.failures++;
+            httpd_resp_send_500(req);
+            return ret;
+        }
+        s_stats.last_build_ms = (esp_timer_get_time() - start) / 1000;
+        entry = thumb_cache_lookup(&s_cache, (int)scale, frame->seq);
+    }
+    frame_unref(frame);
+
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=thumb.jpg");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    esp_err_t res = httpd_resp_send(req, (const char *)entry->jpeg, entry->len);
+    xSemaphoreGive(s_cache_lock);
+    return res;
+}
+
+esp_err_t thumbnail_init(void)
+{
+    if (s_cache_lock == NULL) {
+        s_cache_lock = xSemaphoreCreateMutex();
+        if (s_cache_lock == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    httpd_uri_t thumb_uri = {
+        .uri = "/thumb",
+        .method = HTTP_GET,
+        .handler = thumb_handler,
+        .user_ctx = NULL
+    };
+
+    return http_server_register_handler(&thumb_uri);
+}
+
+esp_err_t thumbnail_deinit(void)
+{
+    esp_err_t ret = http_server_unregister_handler("/thumb", HTTP_GET);
+
+    // Waits for a request still sending a cached thumbnail
+    if (s_cache_lock != NULL) {
+        xSemaphoreTake(s_cache_lock, portMAX_DELAY);
+        thumb_cache_clear(&s_cache, 0, heap_caps_free);
+        xSemaphoreGive(s_cache_lock);
+    }
+    return ret;
+}
+
+void thumbnail_get_stats(thumbnail_stats_t *stats)
+{
+    *stats = s_stats;
+}
@@ -0,0 +1,25 @@
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Thumbnail statistics
+typedef struct {
+    uint32_t requests;
+    uint32_t cache_hits;
+    uint32_t failures;
+    uint32_t last_build_ms;     // decode + encode time of the last miss
+} thumbnail_stats_t;
+
+// Register GET /thumb?scale=1/2|1/4|1/8 (default 1/4). The latest frame is
+// decoded at the requested scale by the JPEG decoder itself and re-encoded;
+// the result is cached until the next frame is captured.
+esp_err_t thumbnail_init(void);
+
+// Unregister /thumb and free the cached thumbnails
+esp_err_t thumbnail_deinit(void);
+
+void thumbnail_get_stats(thumbnail_stats_t *stats);
+
+#endif // THUMBNAIL_H
@@ -1,106 +1,490 @@
 #include "video_stream.h"
 #include "camera_init.h"
+#include "capture_pipeline.h"
+#include "stream_client.h"
+#include "frame_waiters.h"
+#include "qos_arbiter.h"
+#include "dram_stream.h"
+#include "task_layout.h"
 #include "esp_log.h"
 #include "esp_camera.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char *TAG = "video_stream";
 static volatile video_stream_status_t s_stream_status = VIDEO_STREAM_STOPPED;
 static httpd_handle_t s_server_handle = NULL;
 
-// HTML page for video streaming
-static const char* index_html = 
-"<!DOCTYPE html>\n"
-"<html>\n"
-"<head>\n"
-"    <title>ESP32S3 Camera Live Stream</title>\n"
-"    <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
-"    <style>\n"
-"        body {\n"
-"            font-family: Arial, sans-serif;\n"
-"            margin: 0;\n"
-"            padding: 20px;\n"
-"            background-color: #f0f0f0;\n"
-"            text-align: center;\n"
-"        }\n"
-"        .container {\n"
-"            max-width: 800px;\n"
-"            margin: 0 auto;\n"
-"            background: white;\n"
-"            padding: 20px;\n"
-"            border-radius: 10px;\n"
-"            box-shadow: 0 4px 6px rgba(0,0,0,0.1);\n"
-"        }\n"
-"        h1 {\n"
-"            color: #333;\n"
-"            margin-bottom: 20px;\n"
-"        }\n"
-"        img {\n"
-"            max-width: 100%;\n"
-"            height: auto;\n"
-"            border: 2px solid #ddd;\n"
-"            border-radius: 8px;\n"
-"            box-shadow: 0 2px 4px rgba(0,0,0,0.1);\n"
-"        }\n"
-"        .controls {\n"
-"            margin: 20px 0;\n"
-"        }\n"
-"        button {\n"
-"            background-color: #4CAF50;\n"
-"            color: white;\n"
-"            padding: 10px 20px;\n"
-"            border: none;\n"
-"            border-radius: 4px;\n"
-"            cursor: pointer;\n"
-"            margin: 5px;\n"
-"            font-size: 16px;\n"
-"        }\n"
-"        button:hover {\n"
-"            background-color: #45a049;\n"
-"        }\n"
-"        .info {\n"
-"            background-color: #e7f3ff;\n"
-"            border: 1px solid #b3d9ff;\n"
-"            border-radius: 4px;\n"
-"            padding: 10px;\n"
-"            margin: 10px 0;\n"
-"        }\n"
-"    </style>\n"
-"</head>\n"
-"<body>\n"
-"    <div class=\"container\">\n"
-"        <h1>ESP32S3 Camera Live Stream</h1>\n"
-"        <div class=\"info\">\n"
-"            <p>XIAO ESP32S3 Sense - OV2640 Camera Module</p>\n"
-"        </div>\n"
-"        <div class=\"controls\">\n"
-"            <button onclick=\"location.reload()\">Refresh Stream</button>\n"
-"            <button onclick=\"captureImage()\">Capture Image</button>\n"
-"        </div>\n"
-"        <div>\n"
-"            <img id=\"stream\" src=\"/stream\" alt=\"Video Stream\">\n"
-"        </div>\n"
-"        <div class=\"info\">\n"
-"            <p>Stream URL: <strong>/stream</strong></p>\n"
-"            <p>Capture URL: <strong>/capture</strong></p>\n"
-"        </div>\n"
-"    </div>\n"
-"    <script>\n"
-"        function captureImage() {\n"
-"            window.open('/capture', '_blank');\n"
-"        }\n"
-"        \n"
-"        // Auto-refresh if stream fails\n"
-"        document.getElementById('stream').onerror = function() {\n"
-"            setTimeout(function() {\n"
-"                document.getElementById('stream').src = '/stream?' + new Date().getTime();\n"
-"            }, 5000);\n"
-"        };\n"
-"    </script>\n"
-"</body>\n"
-"</html>";
+// Stream clients are detached from the httpd task and served by a fixed pool
+// of sender tasks, so a stream does not block every other request. The tasks
+// are created on the first start and reused after a stop.
+static QueueHandle_t s_sender_queue = NULL;
+static SemaphoreHandle_t s_sender_slots = NULL;
+
+// /capture?after=N requests that have to wait for a frame are detached too,
+// and parked with one task that answers them as frames are published
+typedef struct {
+    httpd_req_t *req;
+    uint32_t after_seq;
+    uint32_t timeout_ms;
+} capture_poll_t;
+
+static QueueHandle_t s_poll_queue = NULL;
+static SemaphoreHandle_t s_poll_slots = NULL;
+static TaskHandle_t s_poll_task = NULL;
+
+#define CAPTURE_REPLY_HDR_LEN 320
+
+typedef struct {
+    httpd_req_t *req;           // NULL when the slot is free
+    int fd;
+    frame_t *frame;             // NULL for a 204
+    char hdr[CAPTURE_REPLY_HDR_LEN];
+    size_t hdr_len;
+    size_t offset;              // header and body bytes written
+    uint32_t deadline_ms;
+} capture_reply_t;
+
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static video_stream_stats_t s_stats;
+static video_stream_client_stats_t s_clients[STREAM_SENDER_COUNT];
+
+#define STREAM_INTERVAL_EWMA_SHIFT 4 // 1/16 weight per new frame
+#define STREAM_FRAME_TIMEOUT_MS 3000
+#define STREAM_QUEUE_DEPTH CONFIG_APP_STREAM_QUEUE_DEPTH
+#define STREAM_STALL_TIMEOUT_MS CONFIG_APP_STREAM_STALL_TIMEOUT_MS
+#define STREAM_WRITE_SLICE_MS 50 // how often a blocked writer looks for newer frames
+#define CAPTURE_POLL_CLIENTS CONFIG_APP_CAPTURE_POLL_CLIENTS
+#define CAPTURE_POLL_TIMEOUT_MS 10000     // unless the request asks for less
+#define CAPTURE_POLL_TIMEOUT_MAX_MS 30000
+#define CAPTURE_POLL_STACK_SIZE 4096
+#define CAPTURE_POLL_LATENCY_EWMA_SHIFT 4
+#define CAPTURE_POLL_SEND_TIMEOUT_MS 2000 // to write a whole answer
+#define CAPTURE_POLL_WRITE_SLICE_MS 10    // how often pending answers are retried
+
+#define CAPTURE_REPLY_FRAME \
+    "HTTP/1.1 200 OK\r\n" \
+    "Content-Type: image/jpeg\r\n" \
+    "Content-Length: %u\r\n" \
+    "Content-Disposition: inline; filename=capture.jpg\r\n" \
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n" \
+    "Pragma: no-cache\r\n" \
+    "Expires: 0\r\n" \
+    "X-Frame-Seq: %lu\r\n" \
+    "X-Timestamp-Us: %lld\r\n" \
+    "\r\n"
+#define CAPTURE_REPLY_NONE \
+    "HTTP/1.1 204 No Content\r\n" \
+    "Content-Length: 0\r\n" \
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n" \
+    "X-Frame-Seq: %lu\r\n" \
+    "\r\n"
+#define CAPTURE_REPLY_STOPPED \
+    "HTTP/1.1 503 Service Unavailable\r\n" \
+    "Content-Length: 0\r\n" \
+    "Retry-After: 5\r\n" \
+    "\r\n"
+#ifdef CONFIG_APP_STREAM_SUPPRESS_DUPLICATES
+#define STREAM_KEEPALIVE_MS CONFIG_APP_STREAM_KEEPALIVE_MS
+#else
+#define STREAM_KEEPALIVE_MS 0
+#endif
+
+static esp_err_t stream_frames(httpd_req_t *req, int sender);
+
+static void stream_stats_frame(int64_t interval_us, size_t bytes)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.frames_sent++;
+    s_stats.bytes_sent += bytes;
+    if (interval_us > 0) {
+        uint32_t interval = (uint32_t)interval_us;
+        if (s_stats.frame_interval_avg_us == 0) {
+            s_stats.frame_interval_avg_us = interval;
+        }
+        int32_t dev = (int32_t)interval - (int32_t)s_stats.frame_interval_avg_us;
+        s_stats.frame_interval_avg_us += dev >> STREAM_INTERVAL_EWMA_SHIFT;
+        uint32_t abs_dev = dev < 0 ? -dev : dev;
+        s_stats.frame_interval_jitter_us +=
+            ((int32_t)abs_dev - (int32_t)s_stats.frame_interval_jitter_us) >> STREAM_INTERVAL_EWMA_SHIFT;
+        if (interval > s_stats.frame_interval_max_us) {
+            s_stats.frame_interval_max_us = interval;
+        }
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void stream_stats_suppressed(void)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.frames_suppressed++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void stream_stats_throttled(void)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.frames_throttled++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void stream_stats_clients(int delta)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.active_clients += delta;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void stream_stats_client(int sender, int fd, const stream_client_t *client)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    video_stream_client_stats_t *info = &s_clients[sender];
+    s_stats.queue_drops += client->frames_dropped - info->frames_dropped;
+    info->active = true;
+    info->fd = fd;
+    info->queued = client->count;
+    info->frames_sent = client->frames_sent;
+    info->frames_dropped = client->frames_dropped;
+    info->bytes_sent = client->bytes_sent;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void stream_stats_client_end(int sender, bool stalled)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    memset(&s_clients[sender], 0, sizeof(s_clients[sender]));
+    s_clients[sender].fd = -1;
+    if (stalled) {
+        s_stats.stall_disconnects++;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void capture_stats_poll(int waiting, uint32_t delivered, uint32_t timeouts, int64_t latency_us)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.poll_waiting += waiting;
+    s_stats.poll_delivered += delivered;
+    s_stats.poll_timeouts += timeouts;
+    if (latency_us > 0) {
+        uint32_t latency = (uint32_t)latency_us;
+        if (s_stats.poll_latency_avg_us == 0) {
+            s_stats.poll_latency_avg_us = latency;
+        }
+        s_stats.poll_latency_avg_us +=
+            ((int32_t)latency - (int32_t)s_stats.poll_latency_avg_us) >> CAPTURE_POLL_LATENCY_EWMA_SHIFT;
+        if (latency > s_stats.poll_latency_max_us) {
+            s_stats.poll_latency_max_us = latency;
+        }
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void capture_stats_poll_rejected(void)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.poll_rejected++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void capture_stats_poll_send_timeout(void)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.poll_send_timeouts++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void video_stream_get_stats(video_stream_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+bool video_stream_get_client_stats(int sender, video_stream_client_stats_t *stats)
+{
+    if (sender < 0 || sender >= STREAM_SENDER_COUNT) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_clients[sender];
+    portEXIT_CRITICAL(&s_stats_lock);
+    return true;
+}
+
+static void stream_sender_task(void *pvParameters)
+{
+    int sender = (int)(intptr_t)pvParameters;
+    httpd_req_t *req;
+
+    while (true) {
+        if (xQueueReceive(s_sender_queue, &req, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        httpd_handle_t handle = req->handle;
+        int fd = httpd_req_to_sockfd(req);
+
+        stream_stats_clients(1);
+        stream_frames(req, sender);
+        stream_stats_clients(-1);
+
+        // The response was written to the socket directly, so the session
+        // cannot be reused for another request
+        httpd_req_async_handler_complete(req);
+        if (fd >= 0) {
+            httpd_sess_trigger_close(handle, fd);
+        }
+        xSemaphoreGive(s_sender_slots);
+    }
+}
+
+static esp_err_t stream_senders_start(void)
+{
+    if (s_sender_queue != NULL) {
+        return ESP_OK;
+    }
+
+    s_sender_queue = xQueueCreate(STREAM_SENDER_COUNT, sizeof(httpd_req_t *));
+    s_sender_slots = xSemaphoreCreateCounting(STREAM_SENDER_COUNT, STREAM_SENDER_COUNT);
+    if (s_sender_queue == NULL || s_sender_slots == NULL) {
+        ESP_LOGE(TAG, "Failed to create stream sender queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < STREAM_SENDER_COUNT; i++) {
+        char name[16];
+        s_clients[i].fd = -1;
+        snprintf(name, sizeof(name), "stream_tx%d", i);
+        if (xTaskCreatePinnedToCore(stream_sender_task, name, STREAM_SENDER_STACK_SIZE, (void *)(intptr_t)i,
+                                    STREAM_SENDER_PRIORITY, NULL, STREAM_SENDER_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create stream sender task %d", i);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    ESP_LOGI(TAG, "Started %d stream sender tasks", STREAM_SENDER_COUNT);
+    return ESP_OK;
+}
+
+// The session stays open: the response has a Content-Length, so a polling
+// client sends its next request on the same connection. One whose answer
+// could not be written is closed instead.
+static void capture_poll_finish(httpd_req_t *req, bool close)
+{
+    httpd_handle_t handle = req->handle;
+    int fd = httpd_req_to_sockfd(req);
+
+    httpd_req_async_handler_complete(req);
+    if (close && fd >= 0) {
+        httpd_sess_trigger_close(handle, fd);
+    }
+    xSemaphoreGive(s_poll_slots);
+}
+
+static uint32_t capture_poll_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Answer to a parked request, written by the poll task with non-blocking
+// sends so one slow client cannot hold up the others. There is one per poll
+// slot, which the request keeps until its answer is written.
+static capture_reply_t s_replies[CAPTURE_POLL_CLIENTS];
+
+// Take a reply slot for the request, or close it if there is none
+static capture_reply_t *capture_reply_claim(httpd_req_t *req, frame_t *frame, uint32_t now_ms)
+{
+    capture_reply_t *reply = NULL;
+    for (int i = 0; i < CAPTURE_POLL_CLIENTS && reply == NULL; i++) {
+        if (s_replies[i].req == NULL) {
+            reply = &s_replies[i];
+        }
+    }
+
+    int fd = httpd_req_to_sockfd(req);
+    if (reply == NULL || fd < 0) {
+        frame_unref(frame);
+        capture_poll_finish(req, true);
+        return NULL;
+    }
+
+    reply->req = req;
+    reply->fd = fd;
+    reply->frame = frame;
+    reply->offset = 0;
+    reply->deadline_ms = now_ms + CAPTURE_POLL_SEND_TIMEOUT_MS;
+    return reply;
+}
+
+// Same headers as capture_send_frame() and capture_send_none(); httpd is
+// bypassed only to avoid its blocking send
+static void capture_reply_start(httpd_req_t *req, frame_t *frame, uint32_t latest_seq, uint32_t now_ms)
+{
+    capture_reply_t *reply = capture_reply_claim(req, frame, now_ms);
+    if (reply == NULL) {
+        return;
+    }
+
+    if (frame != NULL) {
+        reply->hdr_len = snprintf(reply->hdr, sizeof(reply->hdr), CAPTURE_REPLY_FRAME, (unsigned)frame->len,
+                                  (unsigned long)frame->seq, (long long)frame->timestamp_us);
+    } else {
+        reply->hdr_len = snprintf(reply->hdr, sizeof(reply->hdr), CAPTURE_REPLY_NONE, (unsigned long)latest_seq);
+    }
+}
+
+// The stream was stopped while the request was parked
+static void capture_reply_stopped(httpd_req_t *req, uint32_t now_ms)
+{
+    capture_reply_t *reply = capture_reply_claim(req, NULL, now_ms);
+    if (reply != NULL) {
+        reply->hdr_len = strlen(CAPTURE_REPLY_STOPPED);
+        memcpy(reply->hdr, CAPTURE_REPLY_STOPPED, reply->hdr_len);
+    }
+}
+
+// Write what each socket takes of the pending answers. A written answer
+// completes its request; a failed one, or one not written within
+// CAPTURE_POLL_SEND_TIMEOUT_MS, closes its connection. Returns the number
+// still pending.
+static int capture_replies_send(uint32_t now_ms)
+{
+    int pending = 0;
+
+    for (int i = 0; i < CAPTURE_POLL_CLIENTS; i++) {
+        capture_reply_t *reply = &s_replies[i];
+        if (reply->req == NULL) {
+            continue;
+        }
+
+        size_t body_len = reply->frame != NULL ? reply->frame->len : 0;
+        size_t total = reply->hdr_len + body_len;
+        bool failed = false;
+        while (reply->offset < total) {
+            const uint8_t *data;
+            size_t len;
+            if (reply->offset < reply->hdr_len) {
+                data = (const uint8_t *)reply->hdr + reply->offset;
+                len = reply->hdr_len - reply->offset;
+            } else {
+                data = reply->frame->data + (reply->offset - reply->hdr_len);
+                len = total - reply->offset;
+            }
+            int sent = send(reply->fd, data, len, MSG_DONTWAIT);
+            if (sent > 0) {
+                reply->offset += sent;
+                continue;
+            }
+            failed = sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+            break;
+        }
+
+        if (reply->offset < total && !failed) {
+            if ((int32_t)(now_ms - reply->deadline_ms) < 0) {
+                pending++;
+                continue;
+            }
+            ESP_LOGW(TAG, "Long-poll client (fd %d) took over %d ms, disconnecting", reply->fd,
+                     CAPTURE_POLL_SEND_TIMEOUT_MS);
+            capture_stats_poll_send_timeout();
+            failed = true;
+        }
+
+        frame_unref(reply->frame);
+        capture_poll_finish(reply->req, failed);
+        memset(reply, 0, sizeof(*reply));
+    }
+    return pending;
+}
+
+// Woken by every publish and every parked request, so a request parked
+// while the others wait still gets the next frame, and by video_stream_stop(),
+// which has every parked request answered with 503
+static void capture_poll_task(void *pvParameters)
+{
+    frame_waiters_t waiters;
+    capture_poll_t poll;
+
+    frame_waiters_init(&waiters, CAPTURE_POLL_CLIENTS);
+    capture_pipeline_set_publish_notify(xTaskGetCurrentTaskHandle());
+
+    while (true) {
+        while (xQueueReceive(s_poll_queue, &poll, 0) == pdTRUE) {
+            frame_waiters_add(&waiters, poll.req, poll.after_seq, capture_poll_now_ms(), poll.timeout_ms);
+        }
+
+        if (s_stream_status == VIDEO_STREAM_STOPPED && waiters.count > 0) {
+            void *ctx;
+            ESP_LOGI(TAG, "Stream stopped, refusing %u parked requests", waiters.count);
+            while (frame_waiters_drop(&waiters, &ctx)) {
+                capture_stats_poll(-1, 0, 0, 0);
+                capture_reply_stopped(ctx, capture_poll_now_ms());
+            }
+        }
+
+        // Answer every waiter the latest frame satisfies or whose deadline passed
+        if (waiters.count > 0) {
+            frame_t *frame = capture_pipeline_get_frame(frame_waiters_min_after(&waiters), 0);
+            uint32_t latest_seq = frame != NULL ? frame->seq : capture_pipeline_latest_seq();
+            uint32_t now = capture_poll_now_ms();
+            frame_wait_result_t result;
+            void *ctx;
+            while ((result = frame_waiters_pop(&waiters, frame != NULL ? frame->seq : 0, now, &ctx)) !=
+                   FRAME_WAIT_NONE) {
+                if (result == FRAME_WAIT_READY) {
+                    capture_stats_poll(-1, 1, 0, esp_timer_get_time() - frame->timestamp_us);
+                    capture_reply_start(ctx, frame_ref(frame), latest_seq, now);
+                } else {
+                    capture_stats_poll(-1, 0, 1, 0);
+                    capture_reply_start(ctx, NULL, latest_seq, now);
+                }
+            }
+            frame_unref(frame);
+        }
+
+        int pending = capture_replies_send(capture_poll_now_ms());
+
+        // Sleep until the next publish, parked request or deadline; with
+        // answers pending, only until their sockets may have drained
+        uint32_t wait_ms = frame_waiters_next_timeout(&waiters, capture_poll_now_ms());
+        if (pending > 0 && wait_ms > CAPTURE_POLL_WRITE_SLICE_MS) {
+            wait_ms = CAPTURE_POLL_WRITE_SLICE_MS;
+        }
+        TickType_t ticks = wait_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+        ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+    }
+}
+
+static esp_err_t capture_poll_start(void)
+{
+    if (s_poll_queue != NULL) {
+        return ESP_OK;
+    }
+
+    s_poll_queue = xQueueCreate(CAPTURE_POLL_CLIENTS, sizeof(capture_poll_t));
+    s_poll_slots = xSemaphoreCreateCounting(CAPTURE_POLL_CLIENTS, CAPTURE_POLL_CLIENTS);
+    if (s_poll_queue == NULL || s_poll_slots == NULL) {
+        ESP_LOGE(TAG, "Failed to create capture poll queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Sends like a stream sender, so it runs like one
+    if (xTaskCreatePinnedToCore(capture_poll_task, "capture_poll", CAPTURE_POLL_STACK_SIZE, NULL,
+                                STREAM_SENDER_PRIORITY, &s_poll_task, STREAM_SENDER_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create capture poll task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
 
 esp_err_t video_stream_init(httpd_handle_t server)
 {
@@ -118,16 +502,11 @@ esp_err_t video_stream_init(httpd_handle_t server)
     s_server_handle = server;
     ESP_LOGI(TAG, "Starting video stream...");
 
-    // Register the index page handler
-    httpd_uri_t index_uri = {
-        .uri = "/",
-        .method = HTTP_GET,
-        .handler = index_handler,
-        .user_ctx = NULL
-    };
-    esp_err_t ret = httpd_register_uri_handler(server, &index_uri);
+    esp_err_t ret = stream_senders_start();
+    if (ret == ESP_OK) {
+        ret = capture_poll_start();
+    }
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register index handler: %s", esp_err_to_name(ret));
         s_stream_status = VIDEO_STREAM_ERROR;
         return ret;
     }
@@ -160,6 +539,20 @@ esp_err_t video_stream_init(httpd_handle_t server)
         return ret;
     }
 
+    // Register the region-of-interest handler
+    httpd_uri_t roi_uri = {
+        .uri = "/roi",
+        .method = HTTP_GET,
+        .handler = roi_handler,
+        .user_ctx = NULL
+    };
+    ret = httpd_register_uri_handler(server, &roi_uri);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register ROI handler: %s", esp_err_to_name(ret));
+        s_stream_status = VIDEO_STREAM_ERROR;
+        return ret;
+    }
+
     s_stream_status = VIDEO_STREAM_RUNNING;
     ESP_LOGI(TAG, "Video stream started successfully");
     return ESP_OK;
@@ -175,12 +568,17 @@ esp_err_t video_stream_stop(void)
     ESP_LOGI(TAG, "Stopping video stream...");
     
     if (s_server_handle != NULL) {
-        httpd_unregister_uri_handler(s_server_handle, "/", HTTP_GET);
         httpd_unregister_uri_handler(s_server_handle, "/stream", HTTP_GET);
         httpd_unregister_uri_handler(s_server_handle, "/capture", HTTP_GET);
+        httpd_unregister_uri_handler(s_server_handle, "/roi", HTTP_GET);
     }
     
+    // The sender tasks end their streams on their next frame and wait for
+    // the next start; the poll task answers whoever is parked with 503
     s_stream_status = VIDEO_STREAM_STOPPED;
+    if (s_poll_task != NULL) {
+        xTaskNotifyGive(s_poll_task);
+    }
     s_server_handle = NULL;
     ESP_LOGI(TAG, "Video stream stopped");
     return ESP_OK;
@@ -191,20 +589,96 @@ video_stream_status_t video_stream_get_status(void)
     return s_stream_status;
 }
 
-esp_err_t index_handler(httpd_req_t *req)
+// While the capture watchdog is resetting the camera, tell clients to come
+// back instead of failing; the HTTP server itself is unaffected
+static bool stream_camera_recovering(httpd_req_t *req)
+{
+    capture_watchdog_state_t health = capture_pipeline_health();
+    if (health == CAPTURE_WD_OK) {
+        return false;
+    }
+
+    ESP_LOGW(TAG, "Camera %s, rejecting request", capture_watchdog_state_name(health));
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", health == CAPTURE_WD_RECOVERING ? "5" : "60");
+    httpd_resp_send(req, health == CAPTURE_WD_RECOVERING ? "Camera recovering" : "Camera failed",
+                    HTTPD_RESP_USE_STRLEN);
+    return true;
+}
+
+static esp_err_t capture_send_frame(httpd_req_t *req, const frame_t *frame)
 {
-    httpd_resp_set_type(req, "text/html");
+    char seq[12];
+    char timestamp[24];
+
+    snprintf(seq, sizeof(seq), "%lu", (unsigned long)frame->seq);
+    snprintf(timestamp, sizeof(timestamp), "%lld", (long long)frame->timestamp_us);
+
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
     httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
     httpd_resp_set_hdr(req, "Pragma", "no-cache");
     httpd_resp_set_hdr(req, "Expires", "0");
-    
-    return httpd_resp_send(req, index_html, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    httpd_resp_set_hdr(req, "X-Timestamp-Us", timestamp);
+
+    esp_err_t res = httpd_resp_send(req, (const char *)frame->data, frame->len);
+    if (res == ESP_OK) {
+        ESP_LOGD(TAG, "Frame %lu sent, size: %zu bytes", (unsigned long)frame->seq, frame->len);
+    } else {
+        ESP_LOGE(TAG, "Failed to send captured image");
+    }
+    return res;
+}
+
+// A long poll that timed out: no newer frame, here is the latest number
+static esp_err_t capture_send_none(httpd_req_t *req, uint32_t latest_seq)
+{
+    char seq[12];
+
+    snprintf(seq, sizeof(seq), "%lu", (unsigned long)latest_seq);
+    httpd_resp_set_status(req, HTTPD_204);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
+    httpd_resp_set_hdr(req, "X-Frame-Seq", seq);
+    return httpd_resp_send(req, NULL, 0);
 }
 
+// Returns false only for a malformed value; `present` (may be NULL) tells
+// whether the key was given at all
+static bool query_u32(const char *query, const char *key, uint32_t *value, bool *present)
+{
+    char buf[12];
+
+    bool found = httpd_query_key_value(query, key, buf, sizeof(buf)) == ESP_OK;
+    if (present != NULL) {
+        *present = found;
+    }
+    if (!found) {
+        return true;
+    }
+    char *end;
+    unsigned long v = strtoul(buf, &end, 10);
+    if (end == buf || *end != '\0' || buf[0] == '-' || v > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t)v;
+    return true;
+}
+
+// GET /capture returns the latest frame. /capture?after=N returns the first
+// frame newer than N, waiting up to timeout_ms (10 s by default) for it, or
+// 204 with the latest X-Frame-Seq when none arrives in time. Polling with the
+// X-Frame-Seq of the last response gets every frame at most once.
 esp_err_t capture_handler(httpd_req_t *req)
 {
-    camera_fb_t *fb = NULL;
-    esp_err_t res = ESP_OK;
+    char query[48] = "";
+    uint32_t after_seq = 0;
+    uint32_t timeout_ms = CAPTURE_POLL_TIMEOUT_MS;
+    bool poll = false;
+
+    if (stream_camera_recovering(req)) {
+        return ESP_OK;
+    }
 
     if (camera_get_status() != CAM_STATUS_READY) {
         ESP_LOGE(TAG, "Camera is not ready for capture");
@@ -212,102 +686,351 @@ esp_err_t capture_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    fb = camera_get_frame();
-    if (!fb) {
-        ESP_LOGE(TAG, "Camera capture failed");
+    // No frame pool to take a frame from, or to long-poll; the next one
+    // comes straight from the driver
+    if (dram_stream_active()) {
+        return dram_stream_add_client(req, true);
+    }
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (!query_u32(query, "after", &after_seq, &poll) || !query_u32(query, "timeout_ms", &timeout_ms, NULL)) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "after and timeout_ms must be numbers");
+    }
+    if (timeout_ms > CAPTURE_POLL_TIMEOUT_MAX_MS) {
+        timeout_ms = CAPTURE_POLL_TIMEOUT_MAX_MS;
+    }
+
+    if (!poll) {
+        frame_t *frame = capture_pipeline_get_frame(0, STREAM_FRAME_TIMEOUT_MS);
+        if (!frame) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+        esp_err_t res = capture_send_frame(req, frame);
+        frame_unref(frame);
+        return res;
+    }
+
+    // A number from before a reboot; the client has not seen these frames
+    if (after_seq > capture_pipeline_latest_seq()) {
+        after_seq = 0;
+    }
+
+    frame_t *frame = capture_pipeline_get_frame(after_seq, 0);
+    if (frame != NULL) {
+        esp_err_t res = capture_send_frame(req, frame);
+        frame_unref(frame);
+        return res;
+    }
+    if (timeout_ms == 0) {
+        return capture_send_none(req, capture_pipeline_latest_seq());
+    }
+
+    if (xSemaphoreTake(s_poll_slots, 0) != pdTRUE) {
+        capture_stats_poll_rejected();
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, "Too many waiting clients", HTTPD_RESP_USE_STRLEN);
+    }
+
+    capture_poll_t poll_req = { .after_seq = after_seq, .timeout_ms = timeout_ms };
+    if (httpd_req_async_handler_begin(req, &poll_req.req) != ESP_OK) {
+        xSemaphoreGive(s_poll_slots);
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    // Cannot fail: there is a queue entry for every slot
+    xQueueSend(s_poll_queue, &poll_req, 0);
+    xTaskNotifyGive(s_poll_task);
+    capture_stats_poll(1, 0, 0, 0);
+    return ESP_OK;
+}
 
-    httpd_resp_set_type(req, "image/jpeg");
-    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
-    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
-    httpd_resp_set_hdr(req, "Pragma", "no-cache");
-    httpd_resp_set_hdr(req, "Expires", "0");
+static bool query_u16(const char *query, const char *key, uint16_t *value)
+{
+    char buf[8];
 
-    res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
-    camera_return_frame(fb);
+    if (httpd_query_key_value(query, key, buf, sizeof(buf)) != ESP_OK) {
+        return false;
+    }
+    char *end;
+    long v = strtol(buf, &end, 10);
+    if (end == buf || *end != '\0' || v < 0 || v > UINT16_MAX) {
+        return false;
+    }
+    *value = (uint16_t)v;
+    return true;
+}
 
-    if (res == ESP_OK) {
-        ESP_LOGI(TAG, "Image captured and sent, size: %zu bytes", fb->len);
+// GET /roi?x=&y=&w=&h= captures only that region (full-resolution sensor
+// pixels, 1600x1200) at up to the configured frame size; /roi?reset=1 goes
+// back to the full view and /roi alone reports the current window.
+esp_err_t roi_handler(httpd_req_t *req)
+{
+    char query[64] = "";
+    char reset[4];
+    char json[256];
+    sensor_roi_window_t win;
+    esp_err_t ret = ESP_OK;
+
+    if (stream_camera_recovering(req)) {
+        return ESP_OK;
+    }
+
+    if (camera_get_status() != CAM_STATUS_READY) {
+        ESP_LOGE(TAG, "Camera is not ready for ROI change");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+
+    if (httpd_query_key_value(query, "reset", reset, sizeof(reset)) == ESP_OK) {
+        ret = camera_reset_roi();
+        if (ret == ESP_OK) {
+            capture_pipeline_resync();
+        }
+    } else if (query[0] != '\0') {
+        sensor_roi_rect_t roi;
+        if (!query_u16(query, "x", &roi.x) || !query_u16(query, "y", &roi.y) ||
+            !query_u16(query, "w", &roi.w) || !query_u16(query, "h", &roi.h)) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected x, y, w and h (sensor pixels)");
+        }
+        ret = camera_set_roi(&roi, NULL);
+        if (ret == ESP_OK) {
+            // Streams pick up the new window with the next frame
+            capture_pipeline_resync();
+        }
+    }
+
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ROI is not supported by this sensor");
+    } else if (ret == ESP_ERR_INVALID_STATE) {
+        // The capture task is reinitializing the camera
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_send(req, "Camera busy", HTTPD_RESP_USE_STRLEN);
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ret;
+    }
+
+    if (camera_get_roi(&win)) {
+        snprintf(json, sizeof(json),
+                 "{\"active\":true,\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u,\"mode\":\"%s\","
+                 "\"output_w\":%u,\"output_h\":%u}",
+                 win.applied.x, win.applied.y, win.applied.w, win.applied.h, sensor_roi_mode_name(win.mode),
+                 win.out_w, win.out_h);
     } else {
-        ESP_LOGE(TAG, "Failed to send captured image");
+        snprintf(json, sizeof(json), "{\"active\":false,\"sensor_w\":%d,\"sensor_h\":%d}",
+                 SENSOR_ROI_FULL_W, SENSOR_ROI_FULL_H);
     }
 
-    return res;
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
 }
 
-esp_err_t stream_handler(httpd_req_t *req)
+static uint32_t stream_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Wait until the socket accepts more data. Returns > 0 when writable, 0 on
+// timeout and < 0 on error.
+static int stream_wait_writable(int fd, uint32_t timeout_ms)
 {
-    camera_fb_t *fb = NULL;
+    fd_set wfds;
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    return select(fd + 1, NULL, &wfds, NULL, &tv);
+}
+
+static esp_err_t stream_write_all(int fd, const char *data, size_t len, uint32_t timeout_ms)
+{
+    uint32_t start = stream_now_ms();
+
+    while (len > 0) {
+        int sent = send(fd, data, len, MSG_DONTWAIT);
+        if (sent > 0) {
+            data += sent;
+            len -= sent;
+            continue;
+        }
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            return ESP_FAIL;
+        }
+        if (stream_now_ms() - start > timeout_ms) {
+            return ESP_ERR_TIMEOUT;
+        }
+        stream_wait_writable(fd, STREAM_WRITE_SLICE_MS);
+    }
+    return ESP_OK;
+}
+
+// Serve one stream client until it disconnects, stalls or the camera stops
+// delivering frames. Frames go through a bounded per-client queue and are
+// written with non-blocking sends, so a slow client only loses frames and
+// never holds up the capture task or the other clients.
+static esp_err_t stream_frames(httpd_req_t *req, int sender)
+{
+    stream_client_t client;
     esp_err_t res = ESP_OK;
-    size_t _jpg_buf_len = 0;
-    uint8_t *_jpg_buf = NULL;
-    char part_buf[64];
+    bool stalled = false;
+    uint32_t last_seq = 0;
+    int64_t last_frame_us = 0;
+    uint32_t last_offer_ms;
 
-    if (camera_get_status() != CAM_STATUS_READY) {
-        ESP_LOGE(TAG, "Camera is not ready for streaming");
-        httpd_resp_send_500(req);
+    int fd = httpd_req_to_sockfd(req);
+    if (fd < 0) {
         return ESP_FAIL;
     }
 
-    res = httpd_resp_set_type(req, STREAM_CONTENT_TYPE);
+    res = stream_write_all(fd, STREAM_RESPONSE_HEADER, strlen(STREAM_RESPONSE_HEADER), STREAM_STALL_TIMEOUT_MS);
     if (res != ESP_OK) {
         return res;
     }
 
-    httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
-    httpd_resp_set_hdr(req, "Pragma", "no-cache");
-    httpd_resp_set_hdr(req, "Expires", "0");
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-
-    ESP_LOGI(TAG, "Starting video stream for client");
+    ESP_LOGI(TAG, "Starting video stream for client (fd %d)", fd);
+    capture_pipeline_acquire(CAPTURE_CONSUMER_STREAM);
+    stream_client_init(&client, STREAM_QUEUE_DEPTH, STREAM_STALL_TIMEOUT_MS, stream_now_ms());
+    // The first frame is always sent, changed or not
+    last_offer_ms = stream_now_ms() - STREAM_KEEPALIVE_MS;
 
     while (true) {
-        fb = camera_get_frame();
-        if (!fb) {
-            ESP_LOGE(TAG, "Camera capture failed");
-            res = ESP_FAIL;
-            break;
-        }
+        frame_t *current = stream_client_current(&client);
 
-        if (fb->format != PIXFORMAT_JPEG) {
-            ESP_LOGE(TAG, "Non-JPEG frame received");
-            camera_return_frame(fb);
-            res = ESP_FAIL;
+        if (s_stream_status == VIDEO_STREAM_STOPPED) {
+            ESP_LOGI(TAG, "Video stream stopped, ending stream for client (fd %d)", fd);
             break;
         }
 
-        _jpg_buf_len = fb->len;
-        _jpg_buf = fb->buf;
+        // While a frame is being written only look for a newer one; when idle,
+        // block until the capture task publishes the next frame, which paces
+        // the stream at the sensor frame rate
+        frame_t *frame = capture_pipeline_get_frame(last_seq, current ? 0 : STREAM_FRAME_TIMEOUT_MS);
+        uint32_t now = stream_now_ms();
+
+        if (frame) {
+            if (frame->format != PIXFORMAT_JPEG) {
+                ESP_LOGE(TAG, "Non-JPEG frame received");
+                frame_unref(frame);
+                res = ESP_FAIL;
+                break;
+            }
+            last_seq = frame->seq;
 
-        res = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
-        if (res != ESP_OK) {
-            camera_return_frame(fb);
+            // Static scene: only send a keepalive frame now and then
+            if (frame->unchanged && now - last_offer_ms < STREAM_KEEPALIVE_MS) {
+                frame_unref(frame);
+                stream_stats_suppressed();
+                continue;
+            }
+
+            // Paused or paced by the bandwidth arbiter (OTA running, egress cap)
+            if (!qos_arbiter_admit(QOS_FLOW_STREAM, last_offer_ms, now)) {
+                frame_unref(frame);
+                stream_stats_throttled();
+                continue;
+            }
+
+            last_offer_ms = now;
+            stream_client_offer(&client, frame, now);
+            current = stream_client_current(&client);
+        } else if (!current && capture_pipeline_health() == CAPTURE_WD_RECOVERING) {
+            // Keep the connection; frames resume once the camera is back
+            continue;
+        } else if (!current) {
+            ESP_LOGE(TAG, "Camera capture failed");
+            res = ESP_FAIL;
             break;
         }
 
-        size_t hlen = snprintf(part_buf, 64, STREAM_PART, _jpg_buf_len);
-        res = httpd_resp_send_chunk(req, part_buf, hlen);
-        if (res != ESP_OK) {
-            camera_return_frame(fb);
-            break;
+        if (client.hdr_len == 0) {
+            client.hdr_len = snprintf(client.hdr, sizeof(client.hdr), STREAM_BOUNDARY STREAM_PART,
+                                      (unsigned)current->len);
         }
 
-        res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-        if (res != ESP_OK) {
-            camera_return_frame(fb);
+        const uint8_t *data;
+        size_t pending = stream_client_pending(&client, &data);
+        int sent = send(fd, data, pending, MSG_DONTWAIT);
+
+        if (sent > 0) {
+            uint32_t frames_before = client.frames_sent;
+            size_t len = current->len;
+            stream_client_wrote(&client, sent, now);
+
+            if (client.frames_sent != frames_before) {
+                int64_t now_us = esp_timer_get_time();
+                stream_stats_frame(last_frame_us ? now_us - last_frame_us : 0, len);
+                last_frame_us = now_us;
+            }
+        } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            res = ESP_FAIL;
             break;
+        } else if (stream_client_stalled(&client, now)) {
+            ESP_LOGW(TAG, "Stream client (fd %d) stalled for %d ms, disconnecting", fd, STREAM_STALL_TIMEOUT_MS);
+            stalled = true;
+            res = ESP_ERR_TIMEOUT;
+            break;
+        } else {
+            // Socket buffer is full; wake up regularly so newer frames can
+            // replace the queued ones
+            stream_wait_writable(fd, STREAM_WRITE_SLICE_MS);
         }
 
-        camera_return_frame(fb);
-        fb = NULL;
-        _jpg_buf = NULL;
-        
-        // Small delay to prevent overwhelming the client
-        vTaskDelay(pdMS_TO_TICKS(33)); // ~30 FPS
+        stream_stats_client(sender, fd, &client);
     }
 
-    ESP_LOGI(TAG, "Video stream ended for client");
+    stream_stats_client(sender, fd, &client);
+    ESP_LOGI(TAG, "Video stream ended for client (fd %d): %lu frames sent, %lu dropped", fd,
+             (unsigned long)client.frames_sent, (unsigned long)client.frames_dropped);
+    stream_client_flush(&client);
+    capture_pipeline_release(CAPTURE_CONSUMER_STREAM);
+    stream_stats_client_end(sender, stalled);
     return res;
 }
+
+esp_err_t stream_handler(httpd_req_t *req)
+{
+    if (stream_camera_recovering(req)) {
+        return ESP_OK;
+    }
+
+    if (camera_get_status() != CAM_STATUS_READY) {
+        ESP_LOGE(TAG, "Camera is not ready for streaming");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    if (dram_stream_active()) {
+        return dram_stream_add_client(req, false);
+    }
+
+    if (s_sender_slots == NULL || xSemaphoreTake(s_sender_slots, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "All %d stream senders busy, rejecting client", STREAM_SENDER_COUNT);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        return httpd_resp_send(req, "Too many stream clients", HTTPD_RESP_USE_STRLEN);
+    }
+
+    // Detach the request from the httpd task and hand it to a sender
+    httpd_req_t *async_req = NULL;
+    esp_err_t res = httpd_req_async_handler_begin(req, &async_req);
+    if (res != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to detach stream request: %s", esp_err_to_name(res));
+        xSemaphoreGive(s_sender_slots);
+        httpd_resp_send_500(req);
+        return res;
+    }
+
+    // A slot was reserved above, so the queue always has room
+    xQueueSend(s_sender_queue, &async_req, 0);
+    return ESP_OK;
+}
@@ -1,6 +1,7 @@
 #ifndef VIDEO_STREAM_H
 #define VIDEO_STREAM_H
 
+#include <stdbool.h>
 #include "esp_err.h"
 #include "esp_http_server.h"
 
@@ -12,19 +13,65 @@ typedef enum {
     VIDEO_STREAM_ERROR
 } video_stream_status_t;
 
+// Aggregate streaming statistics
+typedef struct {
+    uint32_t active_clients;
+    uint32_t frames_sent;
+    uint64_t bytes_sent;
+    uint32_t frame_interval_avg_us;     // EWMA of per-client inter-frame interval
+    uint32_t frame_interval_jitter_us;  // EWMA of |interval - avg|
+    uint32_t frame_interval_max_us;
+    uint32_t queue_drops;               // frames replaced in a client queue by a newer one
+    uint32_t stall_disconnects;         // clients dropped after the stall timeout
+    uint32_t frames_suppressed;         // unchanged frames skipped between keepalives
+    uint32_t frames_throttled;          // frames skipped by the bandwidth arbiter
+    uint32_t poll_waiting;              // /capture?after= requests parked for a frame
+    uint32_t poll_delivered;            // parked requests answered with a frame
+    uint32_t poll_timeouts;             // parked requests answered with 204
+    uint32_t poll_rejected;             // 503, every poll slot was taken
+    uint32_t poll_send_timeouts;        // answers not written in time, connection closed
+    uint32_t poll_latency_avg_us;       // EWMA from capture to a parked request's answer
+    uint32_t poll_latency_max_us;
+} video_stream_stats_t;
+
+// Per-client statistics, one entry per stream sender
+typedef struct {
+    bool active;
+    int fd;
+    uint8_t queued;                     // frames waiting behind the one in flight
+    uint32_t frames_sent;
+    uint32_t frames_dropped;
+    uint64_t bytes_sent;
+} video_stream_client_stats_t;
+
 // Streaming configuration
 #define STREAM_CONTENT_TYPE "multipart/x-mixed-replace;boundary=123456789000000000000987654321"
 #define STREAM_BOUNDARY "\r\n--123456789000000000000987654321\r\n"
 #define STREAM_PART "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
 
+// Written directly to the socket; the body is not chunked and the connection
+// is closed when the stream ends
+#define STREAM_RESPONSE_HEADER \
+    "HTTP/1.1 200 OK\r\n" \
+    "Content-Type: " STREAM_CONTENT_TYPE "\r\n" \
+    "Cache-Control: no-cache, no-store, must-revalidate\r\n" \
+    "Pragma: no-cache\r\n" \
+    "Expires: 0\r\n" \
+    "Access-Control-Allow-Origin: *\r\n" \
+    "Connection: close\r\n" \
+    "\r\n"
+
 // Function declarations
 esp_err_t video_stream_init(httpd_handle_t server);
 esp_err_t video_stream_stop(void);
 video_stream_status_t video_stream_get_status(void);
+void video_stream_get_stats(video_stream_stats_t *stats);
+// Returns false if sender is out of range; inactive senders report active = false
+bool video_stream_get_client_stats(int sender, video_stream_client_stats_t *stats);
 
 // HTTP handlers
 esp_err_t stream_handler(httpd_req_t *req);
 esp_err_t capture_handler(httpd_req_t *req);
-esp_err_t index_handler(httpd_req_t *req);
+esp_err_t roi_handler(httpd_req_t *req);
 
 #endif // VIDEO_STREAM_H
@@ -0,0 +1,10 @@
+function captureImage() {
+    window.open('/capture', '_blank');
+}
+
+// Auto-refresh if stream fails
+document.getElementById('stream').onerror = function() {
+    setTimeout(function() {
+        document.getElementById('stream').src = '/stream?' + new Date().getTime();
+    }, 5000);
+};
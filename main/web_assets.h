@@ -0,0 +1,22 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Web UI assets, gzipped at build time by web_assets.py from main/web/ and
+// embedded in the firmware (the generated web_assets.c defines the table)
+typedef struct {
+    const char *uri;
+    const char *content_type;
+    const char *cache_control;
+    const char *etag;           // strong ETag, quoted, from the uncompressed content
+    const uint8_t *gzip_data;
+    size_t gzip_len;
+    size_t size;                // uncompressed size
+} web_asset_t;
+
+extern const web_asset_t web_assets[];
+extern const size_t web_assets_count;
+
+#endif // WEB_ASSETS_H
@@ -1,26 +1,122 @@
 #include "wifi_init.h"
 #include "wifi_config.h"
+#include "wifi_reconnect.h"
+#include "task_layout.h"
 #include "http_server.h"
-#include "ota_update.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include <string.h>
 
+ESP_EVENT_DEFINE_BASE(WIFI_LINK_EVENT);
+
 static const char *TAG = "wifi_init";
 static EventGroupHandle_t s_wifi_event_group;
 static volatile wifi_status_t s_wifi_status = WIFI_STATUS_DISCONNECTED;
 static esp_netif_t *s_sta_netif = NULL;
-static bool s_http_server_started = false;
+static wifi_reconnect_t s_reconnect;
+static uint8_t s_ap_bssid[6];
+static uint8_t s_ap_channel;
+static bool s_retry_pending = false;
+static wifi_reconnect_method_t s_retry_method;
+static uint32_t s_retry_at_ms;
 
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
-#define WIFI_RECONNECT_DELAY_MS 5000 // 5 seconds
-#define WIFI_TASK_STACK_SIZE 4096
-#define WIFI_TASK_PRIORITY 5
+#define WIFI_AP_BIT BIT2
+#define WIFI_LINK_GRACE_MS 10000 // Keep services up across drops shorter than this
+#define WIFI_POLL_INTERVAL_MS 200
+#define WIFI_EVENT_POST_TIMEOUT_MS 100 // Wait this long for room in the event loop queue
+
+#define WIFI_NVS_NAMESPACE "wifi_cache"
+#define WIFI_NVS_KEY_AP "ap"
+
+// Last associated AP, persisted so that boot and reconnects can skip the scan
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_ap_cache_t;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void wifi_load_ap_cache(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return;
+    }
+
+    wifi_ap_cache_t cache;
+    size_t len = sizeof(cache);
+    if (nvs_get_blob(nvs, WIFI_NVS_KEY_AP, &cache, &len) == ESP_OK && len == sizeof(cache))
+    {
+        wifi_reconnect_set_cache(&s_reconnect, cache.bssid, cache.channel);
+        ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d",
+                 cache.bssid[0], cache.bssid[1], cache.bssid[2],
+                 cache.bssid[3], cache.bssid[4], cache.bssid[5], cache.channel);
+    }
+    nvs_close(nvs);
+}
+
+static void wifi_save_ap_cache(void)
+{
+    wifi_ap_cache_t cache;
+    memcpy(cache.bssid, s_reconnect.cache_bssid, sizeof(cache.bssid));
+    cache.channel = s_reconnect.cache_channel;
+
+    nvs_handle_t nvs;
+    esp_err_t ret = nvs_open(WIFI_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to open NVS for AP cache: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    ret = nvs_set_blob(nvs, WIFI_NVS_KEY_AP, &cache, sizeof(cache));
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(nvs);
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to save AP cache: %s", esp_err_to_name(ret));
+    }
+    nvs_close(nvs);
+}
+
+// Point the STA config at the cached AP, or clear the pin for a normal scan
+static void wifi_apply_target(wifi_reconnect_method_t method)
+{
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+    {
+        return;
+    }
+
+    if (method == WIFI_RECONNECT_CACHED)
+    {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_reconnect.cache_bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = s_reconnect.cache_channel;
+    }
+    else
+    {
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+    }
+
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
@@ -28,23 +124,21 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
     {
         ESP_LOGI(TAG, "WiFi started, attempting to connect...");
         s_wifi_status = WIFI_STATUS_CONNECTING;
-        esp_wifi_connect();
+        xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
+    {
+        wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+        memcpy(s_ap_bssid, event->bssid, sizeof(s_ap_bssid));
+        s_ap_channel = event->channel;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_AP_BIT);
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
         wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
-        ESP_LOGW(TAG, "WiFi disconnected (reason: %d), will retry in %d seconds",
-                 event->reason, WIFI_RECONNECT_DELAY_MS / 1000);
+        ESP_LOGW(TAG, "WiFi disconnected (reason: %d)", event->reason);
         s_wifi_status = WIFI_STATUS_DISCONNECTED;
-
-        // Stop HTTP server when WiFi disconnects
-        if (s_http_server_started)
-        {
-            ESP_LOGI(TAG, "Stopping HTTP server due to WiFi disconnection");
-            http_server_stop();
-            s_http_server_started = false;
-        }
-
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
@@ -52,85 +146,115 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "WiFi connected! IP: " IPSTR, IP2STR(&event->ip_info.ip));
         s_wifi_status = WIFI_STATUS_CONNECTED;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    }
+}
 
-        // Start HTTP server and services when WiFi connects
-        if (!s_http_server_started)
-        {
-            ESP_LOGI(TAG, "Starting HTTP server...");
-            esp_err_t ret = http_server_init();
-            if (ret == ESP_OK)
-            {
-                ESP_LOGI(TAG, "HTTP server started successfully");
-                s_http_server_started = true;
-
-                // Initialize OTA functionality
-                ret = ota_init();
-                if (ret == ESP_OK)
-                {
-                    ESP_LOGI(TAG, "OTA service initialized");
-                }
-                else
-                {
-                    ESP_LOGE(TAG, "Failed to initialize OTA service");
-                }
-            }
-            else
-            {
-                ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(ret));
-            }
-        }
+static void wifi_post_link_event(int32_t event_id)
+{
+    esp_err_t ret = esp_event_post(WIFI_LINK_EVENT, event_id, NULL, 0, pdMS_TO_TICKS(WIFI_EVENT_POST_TIMEOUT_MS));
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to post link %s event: %s", event_id == WIFI_LINK_EVENT_UP ? "up" : "lost",
+                 esp_err_to_name(ret));
+    }
+}
 
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+static void wifi_connect(wifi_reconnect_method_t method)
+{
+    ESP_LOGI(TAG, "Attempting WiFi connection (%s)...",
+             method == WIFI_RECONNECT_CACHED ? "cached AP" : "scan");
+    s_wifi_status = WIFI_STATUS_CONNECTING;
+    wifi_apply_target(method);
+    esp_err_t ret = esp_wifi_connect();
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "WiFi connect failed: %s", esp_err_to_name(ret));
+        s_wifi_status = WIFI_STATUS_DISCONNECTED;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
     }
 }
 
+// Owns the reconnect policy: all wifi_reconnect_* calls happen on this task.
+// A backoff is a deadline rather than a sleep, so link events are still
+// handled while it runs.
 static void wifi_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "WiFi task started");
 
     while (1)
     {
-        if (s_wifi_status == WIFI_STATUS_DISCONNECTED)
+        uint32_t wait_ms = WIFI_POLL_INTERVAL_MS;
+        if (s_retry_pending)
         {
-            ESP_LOGI(TAG, "Attempting WiFi connection...");
-            s_wifi_status = WIFI_STATUS_CONNECTING;
-
-            esp_err_t ret = esp_wifi_connect();
-            if (ret != ESP_OK)
+            int32_t until = (int32_t)(s_retry_at_ms - now_ms());
+            if (until <= 0)
+            {
+                wait_ms = 0;
+            }
+            else if ((uint32_t)until < wait_ms)
             {
-                ESP_LOGE(TAG, "WiFi connect failed: %s", esp_err_to_name(ret));
-                s_wifi_status = WIFI_STATUS_DISCONNECTED;
+                wait_ms = (uint32_t)until;
             }
         }
 
-        // Wait for connection result or timeout
         EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                               WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+                                               WIFI_CONNECTED_BIT | WIFI_FAIL_BIT | WIFI_AP_BIT,
                                                pdTRUE,  // Clear bits after waiting
                                                pdFALSE, // Wait for any bit
-                                               pdMS_TO_TICKS(WIFI_RECONNECT_DELAY_MS));
+                                               pdMS_TO_TICKS(wait_ms));
+
+        if (bits & WIFI_AP_BIT)
+        {
+            if (wifi_reconnect_set_cache(&s_reconnect, s_ap_bssid, s_ap_channel))
+            {
+                wifi_save_ap_cache();
+            }
+        }
 
         if (bits & WIFI_CONNECTED_BIT)
         {
-            ESP_LOGI(TAG, "WiFi connection successful");
-            // Stay connected, wait for disconnection event
-            xEventGroupWaitBits(s_wifi_event_group, WIFI_FAIL_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+            s_retry_pending = false;
+            uint32_t latency = wifi_reconnect_on_connected(&s_reconnect, now_ms());
+            if (latency > 0)
+            {
+                ESP_LOGI(TAG, "WiFi reconnected in %lu ms (%s)", (unsigned long)latency,
+                         s_reconnect.last_method == WIFI_RECONNECT_CACHED ? "cached AP" : "scan");
+            }
+            wifi_post_link_event(WIFI_LINK_EVENT_UP);
         }
-        else if (bits & WIFI_FAIL_BIT)
+
+        // A stale failure that was already followed by a successful connect is
+        // ignored, and so is one that arrives while a retry is already scheduled
+        if ((bits & WIFI_FAIL_BIT) && s_wifi_status != WIFI_STATUS_CONNECTED && !s_retry_pending)
         {
-            ESP_LOGW(TAG, "WiFi connection failed, retrying in %d seconds", WIFI_RECONNECT_DELAY_MS / 1000);
+            wifi_reconnect_on_disconnected(&s_reconnect, now_ms());
+
+            uint32_t delay_ms = 0;
+            wifi_reconnect_method_t method = wifi_reconnect_next_attempt(&s_reconnect, &delay_ms);
+            if (delay_ms > 0)
+            {
+                ESP_LOGI(TAG, "Retrying WiFi connection in %lu ms", (unsigned long)delay_ms);
+                s_retry_pending = true;
+                s_retry_method = method;
+                s_retry_at_ms = now_ms() + delay_ms;
+            }
+            else
+            {
+                wifi_connect(method);
+            }
         }
-        else
+
+        if (s_retry_pending && (int32_t)(now_ms() - s_retry_at_ms) >= 0)
         {
-            // Timeout occurred
-            ESP_LOGW(TAG, "WiFi connection timeout, retrying...");
-            s_wifi_status = WIFI_STATUS_DISCONNECTED;
+            s_retry_pending = false;
+            wifi_connect(s_retry_method);
         }
 
-        // Small delay before next attempt if not connected
-        if (s_wifi_status != WIFI_STATUS_CONNECTED)
+        if (wifi_reconnect_poll_link_lost(&s_reconnect, now_ms()))
         {
-            vTaskDelay(pdMS_TO_TICKS(1000)); // 1 second delay before retry
+            ESP_LOGW(TAG, "WiFi down for more than %d ms, reporting link lost", WIFI_LINK_GRACE_MS);
+            wifi_post_link_event(WIFI_LINK_EVENT_LOST);
         }
     }
 }
@@ -145,6 +269,9 @@ void wifi_init_task(void)
         return;
     }
 
+    wifi_reconnect_init(&s_reconnect, WIFI_LINK_GRACE_MS);
+    wifi_load_ap_cache();
+
     // Initialize network interface
     esp_err_t ret = esp_netif_init();
     if (ret != ESP_OK)
@@ -230,8 +357,8 @@ void wifi_init_task(void)
     }
 
     // Create WiFi management task
-    BaseType_t task_ret = xTaskCreate(wifi_task, "wifi_task", WIFI_TASK_STACK_SIZE,
-                                      NULL, WIFI_TASK_PRIORITY, NULL);
+    BaseType_t task_ret = xTaskCreatePinnedToCore(wifi_task, "wifi_task", WIFI_TASK_STACK_SIZE,
+                                                  NULL, WIFI_TASK_PRIORITY, NULL, WIFI_TASK_CORE);
     if (task_ret != pdPASS)
     {
         ESP_LOGE(TAG, "Failed to create WiFi task");
@@ -266,5 +393,16 @@ bool wifi_get_ip_address(char *ip_str, size_t ip_str_len)
 
 bool wifi_is_http_server_running(void)
 {
-    return s_http_server_started && (s_wifi_status == WIFI_STATUS_CONNECTED);
+    return http_server_get_status() == HTTP_SERVER_RUNNING && (s_wifi_status == WIFI_STATUS_CONNECTED);
+}
+
+bool wifi_get_reconnect_stats(wifi_reconnect_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return false;
+    }
+
+    *stats = s_reconnect.stats;
+    return true;
 }
\ No newline at end of file
@@ -2,6 +2,19 @@
 #define WIFI_INIT_H
 
 #include "esp_wifi.h"
+#include "esp_event.h"
+#include "wifi_reconnect.h"
+
+// Link-level events posted to the default event loop. Unlike the raw WiFi
+// events, LOST is only posted once an outage outlasts the reconnect grace
+// period, so short drops keep the HTTP server and its handlers alive.
+ESP_EVENT_DECLARE_BASE(WIFI_LINK_EVENT);
+
+typedef enum
+{
+    WIFI_LINK_EVENT_UP,
+    WIFI_LINK_EVENT_LOST
+} wifi_link_event_t;
 
 // WiFi connection status
 typedef enum
@@ -23,4 +36,7 @@ bool wifi_get_ip_address(char *ip_str, size_t ip_str_len);
 // Check if HTTP server is running
 bool wifi_is_http_server_running(void);
 
+// Get reconnect latency statistics
+bool wifi_get_reconnect_stats(wifi_reconnect_stats_t *stats);
+
 #endif // WIFI_INIT_H
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "wifi_reconnect.h"
+#include <string.h>
+
+void wifi_reconnect_init(wifi_reconnect_t *rc, uint32_t grace_ms)
+{
+    memset(rc, 0, sizeof(*rc));
+    rc->grace_ms = grace_ms;
+    rc->backoff_ms = WIFI_RECONNECT_BACKOFF_MIN_MS;
+    rc->last_method = WIFI_RECONNECT_SCAN;
+}
+
+bool wifi_reconnect_set_cache(wifi_reconnect_t *rc, const uint8_t bssid[6], uint8_t channel)
+{
+    if (channel == 0) {
+        return false;
+    }
+
+    bool changed = !rc->have_cache || rc->cache_channel != channel ||
+                   memcmp(rc->cache_bssid, bssid, sizeof(rc->cache_bssid)) != 0;
+    memcpy(rc->cache_bssid, bssid, sizeof(rc->cache_bssid));
+    rc->cache_channel = channel;
+    rc->have_cache = true;
+    return changed;
+}
+
+void wifi_reconnect_clear_cache(wifi_reconnect_t *rc)
+{
+    rc->have_cache = false;
+    rc->cache_channel = 0;
+    memset(rc->cache_bssid, 0, sizeof(rc->cache_bssid));
+}
+
+void wifi_reconnect_on_disconnected(wifi_reconnect_t *rc, uint32_t now_ms)
+{
+    if (!rc->connected) {
+        return;
+    }
+
+    rc->connected = false;
+    rc->link_lost_reported = false;
+    rc->down_since_ms = now_ms;
+    rc->attempts = 0;
+    rc->backoff_ms = WIFI_RECONNECT_BACKOFF_MIN_MS;
+}
+
+uint32_t wifi_reconnect_on_connected(wifi_reconnect_t *rc, uint32_t now_ms)
+{
+    if (rc->connected) {
+        return 0;
+    }
+
+    bool first = !rc->ever_connected;
+    rc->connected = true;
+    rc->ever_connected = true;
+    rc->attempts = 0;
+    rc->backoff_ms = WIFI_RECONNECT_BACKOFF_MIN_MS;
+
+    if (first) {
+        return 0;
+    }
+
+    uint32_t latency = now_ms - rc->down_since_ms;
+    wifi_reconnect_stats_t *st = &rc->stats;
+    st->reconnects++;
+    st->last_latency_ms = latency;
+    if (st->reconnects == 1 || latency < st->min_latency_ms) {
+        st->min_latency_ms = latency;
+    }
+    if (latency > st->max_latency_ms) {
+        st->max_latency_ms = latency;
+    }
+    rc->total_latency_ms += latency;
+    st->avg_latency_ms = (uint32_t)(rc->total_latency_ms / st->reconnects);
+    if (rc->last_method == WIFI_RECONNECT_CACHED) {
+        st->cached_hits++;
+    }
+    return latency;
+}
+
+wifi_reconnect_method_t wifi_reconnect_next_attempt(wifi_reconnect_t *rc, uint32_t *delay_ms)
+{
+    rc->attempts++;
+
+    if (rc->have_cache && rc->attempts <= WIFI_RECONNECT_FAST_ATTEMPTS) {
+        *delay_ms = 0;
+        rc->last_method = WIFI_RECONNECT_CACHED;
+        return WIFI_RECONNECT_CACHED;
+    }
+
+    // First scan attempt after the fast path goes out immediately
+    if (rc->attempts == 1 || (rc->have_cache && rc->attempts == WIFI_RECONNECT_FAST_ATTEMPTS + 1)) {
+        *delay_ms = 0;
+    } else {
+        *delay_ms = rc->backoff_ms;
+        rc->backoff_ms *= 2;
+        if (rc->backoff_ms > WIFI_RECONNECT_BACKOFF_MAX_MS) {
+            rc->backoff_ms = WIFI_RECONNECT_BACKOFF_MAX_MS;
+        }
+    }
+    rc->last_method = WIFI_RECONNECT_SCAN;
+    return WIFI_RECONNECT_SCAN;
+}
+
+bool wifi_reconnect_poll_link_lost(wifi_reconnect_t *rc, uint32_t now_ms)
+{
+    if (rc->connected || !rc->ever_connected || rc->link_lost_reported) {
+        return false;
+    }
+
+    if (now_ms - rc->down_since_ms < rc->grace_ms) {
+        return false;
+    }
+
+    rc->link_lost_reported = true;
+    rc->stats.link_lost++;
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef WIFI_RECONNECT_H
+#define WIFI_RECONNECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// WiFi reconnect policy.
+//
+// Plain C with no ESP-IDF dependencies so it can be driven by simulated
+// events. wifi_task feeds it disconnect/connect events with a millisecond
+// timestamp and asks it how to make the next attempt:
+//  - the first attempts after a drop reuse the cached BSSID and channel, which
+//    skips the all-channel scan and usually reassociates in a few hundred ms
+//  - after that it falls back to a normal scan with exponential backoff
+//  - the link is only reported lost once an outage exceeds the grace period,
+//    so short drops do not tear down the HTTP server and its handlers
+
+#define WIFI_RECONNECT_FAST_ATTEMPTS   2
+#define WIFI_RECONNECT_BACKOFF_MIN_MS  250
+#define WIFI_RECONNECT_BACKOFF_MAX_MS  5000
+
+typedef enum {
+    WIFI_RECONNECT_CACHED,  // connect straight to the cached BSSID/channel
+    WIFI_RECONNECT_SCAN     // regular scan and connect
+} wifi_reconnect_method_t;
+
+typedef struct {
+    uint32_t reconnects;        // completed reconnects after a drop
+    uint32_t link_lost;         // outages that exceeded the grace period
+    uint32_t last_latency_ms;   // disconnect -> got IP
+    uint32_t min_latency_ms;
+    uint32_t max_latency_ms;
+    uint32_t avg_latency_ms;
+    uint32_t cached_hits;       // reconnects completed via the cached AP
+} wifi_reconnect_stats_t;
+
+typedef struct {
+    uint32_t grace_ms;
+    bool connected;
+    bool ever_connected;
+    bool link_lost_reported;
+    bool have_cache;
+    uint8_t cache_bssid[6];
+    uint8_t cache_channel;
+    uint32_t down_since_ms;
+    uint32_t attempts;
+    uint32_t backoff_ms;
+    wifi_reconnect_method_t last_method;
+    uint64_t total_latency_ms;
+    wifi_reconnect_stats_t stats;
+} wifi_reconnect_t;
+
+void wifi_reconnect_init(wifi_reconnect_t *rc, uint32_t grace_ms);
+
+// Update the cached AP. Returns true if it differs from the previous cache
+// (i.e. it should be persisted).
+bool wifi_reconnect_set_cache(wifi_reconnect_t *rc, const uint8_t bssid[6], uint8_t channel);
+void wifi_reconnect_clear_cache(wifi_reconnect_t *rc);
+
+// Record a disconnect (repeated events during one outage are fine)
+void wifi_reconnect_on_disconnected(wifi_reconnect_t *rc, uint32_t now_ms);
+
+// Record a successful connection (got IP). Returns the outage length in ms,
+// or 0 for the initial connection.
+uint32_t wifi_reconnect_on_connected(wifi_reconnect_t *rc, uint32_t now_ms);
+
+// Choose how and when to make the next connection attempt
+wifi_reconnect_method_t wifi_reconnect_next_attempt(wifi_reconnect_t *rc, uint32_t *delay_ms);
+
+// Returns true exactly once per outage, when it has lasted longer than the
+// grace period
+bool wifi_reconnect_poll_link_lost(wifi_reconnect_t *rc, uint32_t now_ms);
+
+#endif // WIFI_RECONNECT_H
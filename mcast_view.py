@@ -0,0 +1,298 @@
+#!/usr/bin/env python3
+"""
+ESP32S3 Camera multicast stream receiver
+
+Joins the group the device multicasts frames to (CONFIG_APP_MCAST_STREAM),
+reassembles the JPEG frames from their fragments and prints frames per
+second, throughput and losses. Frames can be saved to a directory, and
+re-served as MJPEG over HTTP so a browser on the same machine can view the
+stream without opening a connection to the device.
+
+Wire format, see main/mcast_frag.h: a 24-byte big-endian header per datagram
+followed by one slice of the frame. A frame is delivered once every slice
+has arrived; a frame still missing slices when a newer frame completes, or
+after --timeout seconds, is counted as incomplete and dropped.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+
+MAGIC = b'EM'
+VERSION = 1
+HEADER = struct.Struct('>2sBBIIIHHI')
+MAX_FRAME = 4 * 1024 * 1024
+RESET_WINDOW = 1000  # a sequence this far back means the device restarted
+BOUNDARY = 'mcast-view-frame'
+
+
+class Partial:
+    """A frame with some of its fragments."""
+
+    def __init__(self, length, count, timestamp_ms, now):
+        self.data = bytearray(length)
+        self.have = bytearray(count)
+        self.received = 0
+        self.timestamp_ms = timestamp_ms
+        self.started = now
+
+    @property
+    def missing(self):
+        return len(self.have) - self.received
+
+
+class Reassembler:
+    """Rebuilds frames from datagrams; no sockets, so it can be fed directly."""
+
+    def __init__(self, max_pending=4, timeout=1.0):
+        self.max_pending = max_pending
+        self.timeout = timeout
+        self.pending = {}
+        self.last_seq = None
+        self.frames = 0
+        self.bytes = 0
+        self.incomplete = 0
+        self.fragments = 0
+        self.fragments_missing = 0
+        self.duplicates = 0
+        self.late = 0
+        self.bad_datagrams = 0
+        self.bad_frames = 0
+        self.resets = 0
+
+    def _drop(self, seq):
+        partial = self.pending.pop(seq)
+        self.incomplete += 1
+        self.fragments_missing += partial.missing
+
+    def add(self, datagram, now):
+        """Take one datagram. Returns (seq, timestamp_ms, jpeg) when it completes a frame, else None."""
+        if len(datagram) < HEADER.size:
+            self.bad_datagrams += 1
+            return None
+        magic, version, _flags, seq, length, offset, index, count, ts = HEADER.unpack_from(datagram)
+        payload = memoryview(datagram)[HEADER.size:]
+        if (magic != MAGIC or version != VERSION or count == 0 or index >= count or length == 0 or
+                length > MAX_FRAME or offset + len(payload) > length or not payload):
+            self.bad_datagrams += 1
+            return None
+
+        if self.last_seq is not None and seq <= self.last_seq:
+            if seq + RESET_WINDOW >= self.last_seq:
+                self.late += 1
+                return None
+            for old in list(self.pending):
+                self._drop(old)
+            self.last_seq = None
+            self.resets += 1
+
+        partial = self.pending.get(seq)
+        if partial is None:
+            partial = Partial(length, count, ts, now)
+            self.pending[seq] = partial
+            while len(self.pending) > self.max_pending:
+                self._drop(min(self.pending))
+            if seq not in self.pending:
+                return None
+        elif len(partial.data) != length or len(partial.have) != count:
+            self.bad_datagrams += 1
+            return None
+
+        if partial.have[index]:
+            self.duplicates += 1
+            return None
+        partial.have[index] = 1
+        partial.received += 1
+        partial.data[offset:offset + len(payload)] = payload
+        self.fragments += 1
+        if partial.missing:
+            return None
+
+        # Complete: anything older can no longer be delivered in order
+        del self.pending[seq]
+        for old in [s for s in self.pending if s < seq]:
+            self._drop(old)
+        self.last_seq = seq
+
+        jpeg = bytes(partial.data)
+        if not jpeg.startswith(b'\xff\xd8') or not jpeg.endswith(b'\xff\xd9'):
+            self.bad_frames += 1
+            return None
+        self.frames += 1
+        self.bytes += len(jpeg)
+        return seq, partial.timestamp_ms, jpeg
+
+    def expire(self, now):
+        for seq in [s for s, p in self.pending.items() if now - p.started > self.timeout]:
+            self._drop(seq)
+
+    def finish(self):
+        for seq in list(self.pending):
+            self._drop(seq)
+
+    def loss_percent(self):
+        total = self.fragments + self.fragments_missing
+        return 100.0 * self.fragments_missing / total if total else 0.0
+
+
+class LatestFrame:
+    """The newest frame, for the HTTP viewers."""
+
+    def __init__(self):
+        self.cond = threading.Condition()
+        self.seq = 0
+        self.jpeg = None
+
+    def publish(self, seq, jpeg):
+        with self.cond:
+            self.seq = seq
+            self.jpeg = jpeg
+            self.cond.notify_all()
+
+    def wait(self, after, timeout):
+        with self.cond:
+            self.cond.wait_for(lambda: self.jpeg is not None and self.seq != after, timeout)
+            return self.seq, self.jpeg
+
+
+def make_handler(latest):
+    class Handler(BaseHTTPRequestHandler):
+        def log_message(self, fmt, *args):
+            pass
+
+        def do_GET(self):
+            if self.path == '/stream':
+                self.send_response(200)
+                self.send_header('Content-Type', f'multipart/x-mixed-replace;boundary={BOUNDARY}')
+                self.send_header('Cache-Control', 'no-cache')
+                self.end_headers()
+                seq = None
+                try:
+                    while True:
+                        seq, jpeg = latest.wait(seq, 5.0)
+                        if jpeg is None:
+                            continue
+                        self.wfile.write(f'--{BOUNDARY}\r\nContent-Type: image/jpeg\r\n'
+                                         f'Content-Length: {len(jpeg)}\r\n\r\n'.encode())
+                        self.wfile.write(jpeg)
+                        self.wfile.write(b'\r\n')
+                except OSError:
+                    pass
+            elif self.path == '/capture':
+                _, jpeg = latest.wait(None, 0)
+                if jpeg is None:
+                    self.send_error(503, 'No frame yet')
+                    return
+                self.send_response(200)
+                self.send_header('Content-Type', 'image/jpeg')
+                self.send_header('Content-Length', str(len(jpeg)))
+                self.end_headers()
+                self.wfile.write(jpeg)
+            else:
+                self.send_error(404)
+
+    return Handler
+
+
+def log(msg):
+    print(time.strftime('%H:%M:%S ') + msg, flush=True)
+
+
+def open_socket(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    if hasattr(socket, 'SO_REUSEPORT'):
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+    # A frame arrives as a burst of datagrams
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 * 1024 * 1024)
+    # Binding to the group keeps other groups on the same port out (Linux)
+    sock.bind((args.group if sys.platform.startswith('linux') else '', args.port))
+    mreq = socket.inet_aton(args.group) + socket.inet_aton(args.iface)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    sock.settimeout(0.2)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32S3 Camera multicast stream receiver')
+    parser.add_argument('--group', default='239.255.42.1', help='Multicast group (default: 239.255.42.1)')
+    parser.add_argument('--port', type=int, default=5004, help='UDP port (default: 5004)')
+    parser.add_argument('--iface', default='0.0.0.0', metavar='ADDR',
+                        help='Address of the local interface to join on (default: any)')
+    parser.add_argument('--save', metavar='DIR', help='Write every received frame to DIR')
+    parser.add_argument('--http', type=int, default=0, metavar='PORT',
+                        help='Serve the frames as /stream (MJPEG) and /capture on PORT')
+    parser.add_argument('--timeout', type=float, default=1.0, metavar='SEC',
+                        help='Drop a frame still missing fragments after SEC seconds (default: 1)')
+    parser.add_argument('--duration', type=float, default=0, metavar='SEC', help='Exit after SEC seconds')
+    parser.add_argument('--verbose', action='store_true', help='Report idle seconds and restarts')
+    args = parser.parse_args()
+
+    if args.save:
+        Path(args.save).mkdir(parents=True, exist_ok=True)
+
+    sock = open_socket(args)
+    log(f'Joined {args.group}:{args.port}')
+
+    latest = LatestFrame()
+    if args.http:
+        server = ThreadingHTTPServer(('0.0.0.0', args.http), make_handler(latest))
+        server.daemon_threads = True
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        log(f'Serving http://localhost:{args.http}/stream')
+
+    rx = Reassembler(timeout=args.timeout)
+    start = time.monotonic()
+    deadline = start + args.duration if args.duration else None
+    window_start, window_frames, window_bytes, window_incomplete = start, 0, 0, 0
+    resets = 0
+
+    try:
+        while deadline is None or time.monotonic() < deadline:
+            try:
+                datagram = sock.recv(65536)
+            except socket.timeout:
+                datagram = None
+            now = time.monotonic()
+
+            if datagram is not None:
+                frame = rx.add(datagram, now)
+                if frame is not None:
+                    seq, _, jpeg = frame
+                    window_frames += 1
+                    window_bytes += len(jpeg)
+                    latest.publish(seq, jpeg)
+                    if args.save:
+                        (Path(args.save) / f'{seq:08d}.jpg').write_bytes(jpeg)
+            rx.expire(now)
+
+            if rx.resets != resets and args.verbose:
+                log('  sequence restarted, device rebooted?')
+            resets = rx.resets
+
+            if now - window_start >= 1.0:
+                incomplete = rx.incomplete - window_incomplete
+                if window_frames or incomplete or args.verbose:
+                    log(f'  {window_frames} fps, {window_bytes * 8 / 1000:.0f} kbps, {incomplete} incomplete, '
+                        f'{rx.loss_percent():.1f}% fragments lost')
+                window_start, window_frames, window_bytes = now, 0, 0
+                window_incomplete = rx.incomplete
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sock.close()
+
+    rx.finish()
+    print(f'\nTotal: {rx.frames} frames, {rx.bytes} bytes, {rx.incomplete} incomplete, '
+          f'{rx.duplicates} duplicate fragments, {rx.late} late fragments, {rx.bad_datagrams} bad datagrams, '
+          f'{rx.bad_frames} bad frames')
+    return 0 if rx.bad_frames == 0 else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
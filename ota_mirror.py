@@ -0,0 +1,266 @@
+#!/usr/bin/env python3
+"""
+ESP32S3 Camera OTA mirror
+
+Serves firmware images to devices pulling updates (CONFIG_APP_OTA_PULL_URL):
+plain HTTP/1.1 with keep-alive and single-range requests, which the device
+uses to download several chunks at once and to resume a dropped connection.
+Logs every request, and can drop or stall responses to exercise the
+device's retries. `info` prints what a device would see in an image's
+header before deciding to download it.
+"""
+
+import argparse
+import os
+import re
+import socket
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from pathlib import Path
+
+IMAGE_MAGIC = 0xE9
+APP_DESC_MAGIC = 0xABCD5432
+APP_DESC_OFFSET = 32
+# esp_app_desc_t up to the fields read here: magic, secure_version,
+# reserv1[2], version[32], project_name[32], time[16], date[16], idf_ver[32]
+APP_DESC = struct.Struct('<II8s32s32s16s16s32s')
+CHIP_NAMES = {0: 'esp32', 2: 'esp32s2', 5: 'esp32c3', 9: 'esp32s3', 12: 'esp32c2', 13: 'esp32c6', 16: 'esp32h2'}
+RANGE_RE = re.compile(r'^bytes=(\d*)-(\d*)$')
+WRITE_SLICE = 16384
+
+
+def log(msg):
+    print(time.strftime('%H:%M:%S ') + msg, flush=True)
+
+
+def image_info(data):
+    """Fields of the image header and app description, or None."""
+    if len(data) < APP_DESC_OFFSET + APP_DESC.size or data[0] != IMAGE_MAGIC:
+        return None
+    fields = APP_DESC.unpack_from(data, APP_DESC_OFFSET)
+    if fields[0] != APP_DESC_MAGIC:
+        return None
+
+    def text(raw):
+        return raw.split(b'\0', 1)[0].decode('ascii', 'replace')
+
+    chip_id = struct.unpack_from('<H', data, 12)[0]
+    return {
+        'chip': CHIP_NAMES.get(chip_id, f'chip {chip_id}'),
+        'version': text(fields[3]),
+        'project': text(fields[4]),
+        'built': f'{text(fields[6])} {text(fields[5])}',
+        'idf': text(fields[7]),
+    }
+
+
+def parse_range(header, size):
+    """(start, end) inclusive for a single-range header, None for no range,
+    or 'unsatisfiable'."""
+    if header is None:
+        return None
+    m = RANGE_RE.match(header.strip())
+    if not m or (not m.group(1) and not m.group(2)):
+        return None
+    if not m.group(1):
+        length = int(m.group(2))
+        if length == 0:
+            return 'unsatisfiable'
+        return max(0, size - length), size - 1
+    start = int(m.group(1))
+    end = int(m.group(2)) if m.group(2) else size - 1
+    if start >= size or end < start:
+        return 'unsatisfiable'
+    return start, min(end, size - 1)
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.responses = 0
+        self.ranges = 0
+        self.bytes = 0
+        self.drops = 0
+        self.stalls = 0
+
+    def count(self):
+        with self.lock:
+            self.responses += 1
+            return self.responses
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    server_version = 'ota_mirror'
+    # The head and the body go out as separate writes
+    disable_nagle_algorithm = True
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def do_HEAD(self):
+        self.serve(head=True)
+
+    def do_GET(self):
+        self.serve(head=False)
+
+    def serve(self, head):
+        args = self.server.args
+        stats = self.server.stats
+        path = Path(args.dir, self.path.split('?', 1)[0].lstrip('/')).resolve()
+        if not str(path).startswith(str(Path(args.dir).resolve()) + os.sep) or not path.is_file():
+            self.send_error(404)
+            return
+        data = path.read_bytes()
+        size = len(data)
+
+        span = None if args.no_ranges else parse_range(self.headers.get('Range'), size)
+        if span == 'unsatisfiable':
+            self.send_response(416)
+            self.send_header('Content-Range', f'bytes */{size}')
+            self.send_header('Content-Length', '0')
+            self.end_headers()
+            log(f'{self.client_address[0]} {self.path} {self.headers.get("Range")} 416')
+            return
+
+        start, end = span if span else (0, size - 1)
+        body = data[start:end + 1]
+        self.send_response(206 if span else 200)
+        self.send_header('Content-Type', 'application/octet-stream')
+        self.send_header('Accept-Ranges', 'none' if args.no_ranges else 'bytes')
+        if span:
+            self.send_header('Content-Range', f'bytes {start}-{end}/{size}')
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        if head:
+            return
+
+        n = stats.count()
+        with stats.lock:
+            stats.ranges += 1 if span else 0
+        cut = len(body)
+        note = ''
+        # Only responses long enough to be cut in the middle
+        if args.drop_every and n % args.drop_every == 0 and len(body) > 1:
+            cut = len(body) // 2
+            note = f' dropped after {cut}'
+        stall_at = None
+        if args.stall_every and n % args.stall_every == 0 and len(body) > 1:
+            stall_at = len(body) // 2
+            note = f' stalled {args.stall}s at {stall_at}'
+
+        sent = 0
+        try:
+            while sent < cut:
+                if stall_at is not None and sent >= stall_at:
+                    with stats.lock:
+                        stats.stalls += 1
+                    time.sleep(args.stall)
+                    stall_at = None
+                piece = body[sent:min(cut, sent + WRITE_SLICE, stall_at if stall_at is not None else cut)]
+                self.wfile.write(piece)
+                sent += len(piece)
+                if args.rate_kbps:
+                    time.sleep(len(piece) * 8 / 1000 / args.rate_kbps)
+            self.wfile.flush()
+        except (BrokenPipeError, ConnectionResetError):
+            note += ' (client gone)'
+            self.close_connection = True
+        with stats.lock:
+            stats.bytes += sent
+        if cut < len(body):
+            with stats.lock:
+                stats.drops += 1
+            self.close_connection = True
+            try:
+                self.connection.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+
+        if not args.quiet:
+            what = f'bytes {start}-{end}' if span else 'full'
+            log(f'{self.client_address[0]} {self.path} {what} {sent}/{len(body)}{note}')
+
+
+def cmd_serve(args):
+    if not Path(args.dir).is_dir():
+        print(f'No such directory: {args.dir}', file=sys.stderr)
+        return 1
+    for path in sorted(Path(args.dir).glob('*.bin')):
+        info = image_info(path.read_bytes()[:APP_DESC_OFFSET + APP_DESC.size])
+        if info:
+            log(f'{path.name}: {info["project"]} {info["version"]} for {info["chip"]}, {path.stat().st_size} bytes')
+
+    server = ThreadingHTTPServer((args.bind, args.port), Handler)
+    server.daemon_threads = True
+    server.args = args
+    server.stats = Stats()
+    log(f'Serving {args.dir} on {args.bind}:{server.server_address[1]}')
+
+    deadline = time.monotonic() + args.duration if args.duration else None
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    try:
+        while deadline is None or time.monotonic() < deadline:
+            time.sleep(0.2)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.shutdown()
+
+    s = server.stats
+    print(f'\nTotal: {s.responses} responses, {s.ranges} ranges, {s.bytes} bytes, '
+          f'{s.drops} dropped, {s.stalls} stalled')
+    return 0
+
+
+def cmd_info(args):
+    status = 0
+    for name in args.images:
+        try:
+            data = Path(name).read_bytes()
+        except OSError as e:
+            print(f'{name}: {e}', file=sys.stderr)
+            status = 1
+            continue
+        info = image_info(data)
+        if info is None:
+            print(f'{name}: not an ESP-IDF app image')
+            status = 1
+            continue
+        print(f'{name}: {info["project"]} {info["version"]} for {info["chip"]}, {len(data)} bytes, '
+              f'built {info["built"]} with IDF {info["idf"]}')
+    return status
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Firmware mirror for devices pulling OTA updates')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    serve = sub.add_parser('serve', help='Serve the images in a directory')
+    serve.add_argument('dir', help='Directory with the firmware images (e.g. build/)')
+    serve.add_argument('--port', type=int, default=8070, help='Port to listen on, 0 for any (default: 8070)')
+    serve.add_argument('--bind', default='0.0.0.0', help='Address to listen on')
+    serve.add_argument('--no-ranges', action='store_true', help='Ignore Range headers, like a plain file server')
+    serve.add_argument('--drop-every', type=int, default=0, metavar='N',
+                       help='Close the connection halfway through every Nth response')
+    serve.add_argument('--stall-every', type=int, default=0, metavar='N',
+                       help='Pause halfway through every Nth response')
+    serve.add_argument('--stall', type=float, default=15, metavar='SEC', help='Length of a pause (default: 15)')
+    serve.add_argument('--rate-kbps', type=float, default=0, help='Limit each response to this rate')
+    serve.add_argument('--duration', type=float, default=0, metavar='SEC', help='Exit after SEC seconds')
+    serve.add_argument('--quiet', action='store_true', help='Do not log every request')
+
+    info = sub.add_parser('info', help="Print the version in an image's header")
+    info.add_argument('images', nargs='+', help='Firmware image files')
+
+    args = parser.parse_args()
+    if args.command == 'serve':
+        return cmd_serve(args)
+    return cmd_info(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
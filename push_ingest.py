@@ -0,0 +1,356 @@
+#!/usr/bin/env python3
+"""
+ESP32S3 Camera push ingest server
+
+Stand-in for the remote server the push uploader sends frames to. Accepts
+both transports on one port (the first bytes tell them apart): the chunked
+multipart POST used with http:// URLs and the framed records used with
+tcp:// URLs. Prints frames per second, throughput and connection events, and
+can drop or stall connections to exercise the uploader's reconnect logic.
+"""
+
+import argparse
+import signal
+import socket
+import struct
+import sys
+import threading
+import time
+from pathlib import Path
+
+BOUNDARY = b'push-5e8a0c3f71'
+TCP_MAGIC = b'ECF1'
+TCP_HEADER = struct.Struct('>4sIQI')
+MAX_FRAME = 4 * 1024 * 1024
+
+
+class ProtocolError(Exception):
+    pass
+
+
+class SocketReader:
+    """Buffered reads from a socket."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = bytearray()
+
+    def _fill(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError
+        self.buf += data
+
+    def peek(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        return bytes(self.buf[:n])
+
+    def read(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        out = bytes(self.buf[:n])
+        del self.buf[:n]
+        return out
+
+    def readline(self, limit=1024):
+        while True:
+            end = self.buf.find(b'\n')
+            if end >= 0:
+                return self.read(end + 1)
+            if len(self.buf) > limit:
+                raise ProtocolError('line too long')
+            self._fill()
+
+
+class ChunkedReader:
+    """Reads the payload of a chunked transfer-encoded body."""
+
+    def __init__(self, inner):
+        self.inner = inner
+        self.left = 0
+        self.done = False
+        self.chunks = 0
+
+    def _next_chunk(self):
+        if self.done:
+            raise EOFError
+        line = self.inner.readline().strip()
+        try:
+            self.left = int(line.split(b';')[0], 16)
+        except ValueError:
+            raise ProtocolError(f'bad chunk size {line!r}')
+        if self.left == 0:
+            # Last chunk: skip trailers up to the empty line
+            while self.inner.readline().strip():
+                pass
+            self.done = True
+            raise EOFError
+        self.chunks += 1
+
+    def read(self, n):
+        out = bytearray()
+        while len(out) < n:
+            if self.left == 0:
+                self._next_chunk()
+            part = self.inner.read(min(n - len(out), self.left))
+            self.left -= len(part)
+            out += part
+            if self.left == 0 and self.inner.read(2) != b'\r\n':
+                raise ProtocolError('chunk not terminated by CRLF')
+        return bytes(out)
+
+    def readline(self, limit=1024):
+        out = bytearray()
+        while not out.endswith(b'\n'):
+            if len(out) > limit:
+                raise ProtocolError('line too long')
+            out += self.read(1)
+        return bytes(out)
+
+
+class Stats:
+    """Counters shared by all connections, reported once per second."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.frames = 0
+        self.bytes = 0
+        self.total_frames = 0
+        self.total_bytes = 0
+        self.gaps = 0
+        self.bad_frames = 0
+        self.connections = 0
+        self.last_disconnect = {}
+
+    def frame(self, size):
+        with self.lock:
+            self.frames += 1
+            self.bytes += size
+            self.total_frames += 1
+            self.total_bytes += size
+
+    def take_window(self):
+        with self.lock:
+            frames, size = self.frames, self.bytes
+            self.frames = self.bytes = 0
+            return frames, size
+
+
+def log(msg):
+    print(time.strftime('%H:%M:%S ') + msg, flush=True)
+
+
+def read_http_frames(reader):
+    """Yield (seq, timestamp_us, jpeg) from a chunked multipart POST."""
+    request = reader.readline().decode('latin-1').strip()
+    headers = {}
+    while True:
+        line = reader.readline().decode('latin-1').strip()
+        if not line:
+            break
+        key, _, value = line.partition(':')
+        headers[key.strip().lower()] = value.strip()
+
+    if not request.startswith('POST ') or headers.get('transfer-encoding', '').lower() != 'chunked':
+        raise ProtocolError(f'unexpected request {request!r}')
+    if BOUNDARY.decode() not in headers.get('content-type', ''):
+        raise ProtocolError('unexpected content type ' + headers.get('content-type', ''))
+
+    body = ChunkedReader(reader)
+    yield headers.get('x-device-id', '?'), None
+    while True:
+        try:
+            line = body.readline().strip()
+        except EOFError:
+            if body.done:
+                return      # zero-length chunk: the uploader ended the session
+            raise
+        if not line:
+            continue
+        if line == b'--' + BOUNDARY + b'--':
+            return
+        if line != b'--' + BOUNDARY:
+            raise ProtocolError(f'expected boundary, got {line[:40]!r}')
+
+        part = {}
+        while True:
+            line = body.readline().decode('latin-1').strip()
+            if not line:
+                break
+            key, _, value = line.partition(':')
+            part[key.strip().lower()] = value.strip()
+
+        length = int(part.get('content-length', -1))
+        if length < 0 or length > MAX_FRAME:
+            raise ProtocolError(f'bad Content-Length {length}')
+        jpeg = body.read(length)
+        yield None, (int(part.get('x-frame-seq', 0)), int(part.get('x-timestamp-us', 0)), jpeg)
+
+
+def read_tcp_frames(reader):
+    """Yield (seq, timestamp_us, jpeg) from a tcp:// stream of framed records."""
+    hello = reader.readline().decode('latin-1').strip()
+    if not hello.startswith('ECAM/1'):
+        raise ProtocolError(f'unexpected hello {hello!r}')
+    yield hello[6:].strip() or '?', None
+    while True:
+        magic, seq, ts, length = TCP_HEADER.unpack(reader.read(TCP_HEADER.size))
+        if magic != TCP_MAGIC:
+            raise ProtocolError(f'bad record magic {magic!r}')
+        if length > MAX_FRAME:
+            raise ProtocolError(f'frame too large: {length}')
+        yield None, (seq, ts, reader.read(length))
+
+
+def handle_connection(sock, addr, args, stats):
+    peer = f'{addr[0]}:{addr[1]}'
+    reader = SocketReader(sock)
+    started = time.monotonic()
+    frames = 0
+    last_seq = None
+    stalled = False
+    device = '?'
+    mode = '?'
+
+    def drop():
+        log(f'  dropping {peer} after {args.drop_every} s')
+        try:
+            sock.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+
+    timer = threading.Timer(args.drop_every, drop) if args.drop_every else None
+    if timer:
+        timer.daemon = True
+        timer.start()
+
+    try:
+        first = reader.peek(4)
+        if first == b'POST':
+            mode, frames_iter = 'http', read_http_frames(reader)
+        elif first == b'ECAM':
+            mode, frames_iter = 'tcp', read_tcp_frames(reader)
+        else:
+            raise ProtocolError(f'unknown protocol {first!r}')
+
+        device, _ = next(frames_iter)
+        with stats.lock:
+            stats.connections += 1
+            gone = stats.last_disconnect.get(device)
+        since = f', {time.monotonic() - gone:.1f} s after last disconnect' if gone else ''
+        log(f'+ {peer} device={device} mode={mode}{since}')
+
+        while True:
+            try:
+                _, (seq, ts, jpeg) = next(frames_iter)
+            except StopIteration:
+                break
+
+            frames += 1
+            stats.frame(len(jpeg))
+            if not jpeg.startswith(b'\xff\xd8') or not jpeg.rstrip(b'\x00').endswith(b'\xff\xd9'):
+                with stats.lock:
+                    stats.bad_frames += 1
+            if last_seq is not None and seq != last_seq + 1:
+                with stats.lock:
+                    stats.gaps += 1
+                if args.verbose:
+                    log(f'  {peer} seq {last_seq} -> {seq}')
+            last_seq = seq
+
+            if args.save:
+                (Path(args.save) / f'{device}_{seq:08d}.jpg').write_bytes(jpeg)
+
+            if args.stall and not stalled and frames == args.stall_after:
+                log(f'  stalling {peer} for {args.stall} s')
+                time.sleep(args.stall)
+                stalled = True
+
+        if mode == 'http':
+            sock.sendall(b'HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n')
+    except EOFError:
+        pass
+    except (ProtocolError, ValueError) as e:
+        log(f'✗ {peer}: {e}')
+        if mode == 'http':
+            try:
+                sock.sendall(b'HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n')
+            except OSError:
+                pass
+    except OSError as e:
+        log(f'✗ {peer}: {e}')
+    finally:
+        if timer:
+            timer.cancel()
+        sock.close()
+        with stats.lock:
+            stats.last_disconnect[device] = time.monotonic()
+        log(f'- {peer} device={device} frames={frames} '
+            f'({time.monotonic() - started:.1f} s connected)')
+
+
+def report(stats, args, stop):
+    while not stop.wait(1.0):
+        frames, size = stats.take_window()
+        if frames or args.verbose:
+            log(f'  {frames} fps, {size * 8 / 1000:.0f} kbps')
+
+
+def stop_on_sigterm(signum, frame):
+    raise KeyboardInterrupt
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32S3 Camera push ingest server')
+    parser.add_argument('--port', type=int, default=8090, help='Port for both http and tcp mode, 0 for any (default: 8090)')
+    parser.add_argument('--bind', default='0.0.0.0', help='Address to listen on')
+    parser.add_argument('--save', metavar='DIR', help='Write every received frame to DIR')
+    parser.add_argument('--drop-every', type=float, default=0, metavar='SEC',
+                        help='Close each connection after SEC seconds to test reconnects')
+    parser.add_argument('--stall', type=float, default=0, metavar='SEC',
+                        help='Stop reading for SEC seconds once per connection')
+    parser.add_argument('--stall-after', type=int, default=50, metavar='N',
+                        help='Frames to receive before stalling (default: 50)')
+    parser.add_argument('--duration', type=float, default=0, metavar='SEC', help='Exit after SEC seconds')
+    parser.add_argument('--verbose', action='store_true', help='Report sequence gaps and idle seconds')
+    args = parser.parse_args()
+
+    if args.save:
+        Path(args.save).mkdir(parents=True, exist_ok=True)
+
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind((args.bind, args.port))
+    server.listen(4)
+    server.settimeout(0.5)
+    log(f'Listening on {args.bind}:{server.getsockname()[1]}')
+
+    stats = Stats()
+    stop = threading.Event()
+    threading.Thread(target=report, args=(stats, args, stop), daemon=True).start()
+    deadline = time.monotonic() + args.duration if args.duration else None
+    # Totals are printed on SIGTERM too (SIGINT is ignored in background jobs)
+    signal.signal(signal.SIGTERM, stop_on_sigterm)
+
+    try:
+        while deadline is None or time.monotonic() < deadline:
+            try:
+                sock, addr = server.accept()
+            except socket.timeout:
+                continue
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            threading.Thread(target=handle_connection, args=(sock, addr, args, stats), daemon=True).start()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stop.set()
+        server.close()
+
+    print(f'\nTotal: {stats.total_frames} frames, {stats.total_bytes} bytes, '
+          f'{stats.connections} connections, {stats.gaps} sequence gaps, {stats.bad_frames} bad frames')
+    return 0 if stats.bad_frames == 0 else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,520 @@
+#!/usr/bin/env python3
+"""
+ESP32S3 Camera stream load generator and soak test
+
+Opens N /stream and M /capture clients against a device and measures what
+each one gets: frames per second, inter-frame interval and jitter, bytes per
+second, connect latency and errors. /stream responses are parsed part by
+part with the STREAM_BOUNDARY from main/video_stream.h, so a framing
+regression shows up as an error rather than as a lower byte count. Runs for a
+fixed time or as a multi-hour soak, reconnecting clients that drop, and can
+write one CSV row per client per report interval and a JSON summary.
+"""
+
+import argparse
+import http.client
+import json
+import math
+import re
+import socket
+import sys
+import threading
+import time
+from pathlib import Path
+
+DEFAULT_HEADER = Path(__file__).resolve().parent / 'main' / 'video_stream.h'
+# Used when the tool runs outside the source tree
+FALLBACK_BOUNDARY = b'\r\n--123456789000000000000987654321\r\n'
+MAX_FRAME = 4 * 1024 * 1024
+BACKOFF_MIN = 1.0
+BACKOFF_MAX = 30.0
+HIST_MAX_MS = 10000
+
+CSV_FIELDS = ['time', 'elapsed_s', 'client', 'kind', 'frames', 'fps', 'kbps', 'interval_avg_ms',
+              'jitter_ms', 'interval_max_ms', 'connect_ms', 'errors', 'reconnects']
+
+
+class ProtocolError(Exception):
+    pass
+
+
+class Rejected(Exception):
+    """503 from the device: all senders or long-poll slots are taken."""
+
+    def __init__(self, retry_after):
+        super().__init__('503 Service Unavailable')
+        self.retry_after = retry_after
+
+
+def load_boundary(header):
+    """The part delimiter written before every frame, from video_stream.h."""
+    try:
+        text = Path(header).read_text()
+    except OSError:
+        return FALLBACK_BOUNDARY
+    m = re.search(r'#define\s+STREAM_BOUNDARY\s+"((?:[^"\\]|\\.)*)"', text)
+    if not m:
+        raise SystemExit(f'STREAM_BOUNDARY not found in {header}')
+    return m.group(1).encode('latin-1').decode('unicode_escape').encode('latin-1')
+
+
+def parse_duration(text):
+    """Seconds from '90', '90s', '30m' or '6h'."""
+    m = re.fullmatch(r'(\d+(?:\.\d+)?)([smh]?)', text.strip())
+    if not m:
+        raise argparse.ArgumentTypeError(f'invalid duration "{text}"')
+    return float(m.group(1)) * {'': 1, 's': 1, 'm': 60, 'h': 3600}[m.group(2)]
+
+
+class SocketReader:
+    """Buffered reads from a socket."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = bytearray()
+        self.received = 0
+
+    def _fill(self):
+        data = self.sock.recv(65536)
+        if not data:
+            raise EOFError
+        self.received += len(data)
+        self.buf += data
+
+    def read(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        out = bytes(self.buf[:n])
+        del self.buf[:n]
+        return out
+
+    def readline(self, limit=1024):
+        while True:
+            end = self.buf.find(b'\n')
+            if end >= 0:
+                return self.read(end + 1)
+            if len(self.buf) > limit:
+                raise ProtocolError('header line too long')
+            self._fill()
+
+
+def read_headers(reader):
+    headers = {}
+    while True:
+        line = reader.readline().decode('latin-1').strip()
+        if not line:
+            return headers
+        name, _, value = line.partition(':')
+        headers[name.strip().lower()] = value.strip()
+
+
+class ClientStats:
+    """One client's counters: totals for the summary and a window per report."""
+
+    def __init__(self, name, kind):
+        self.name = name
+        self.kind = kind
+        self.lock = threading.Lock()
+        self.frames = 0
+        self.bytes = 0
+        self.errors = {}
+        self.rejected = 0
+        self.reconnects = 0
+        self.connects = 0
+        self.connect_ms = []
+        self.first_frame_ms = []
+        self.duplicates = 0          # /capture: the same frame twice
+        self.skipped = 0             # /capture?after=: frames between two answers
+        self.hist = {}               # interval, whole ms -> count
+        self.interval_sum = 0.0
+        self.interval_sq = 0.0
+        self.intervals = 0
+        self.interval_max = 0.0
+        self.last_frame = None
+        self._reset_window()
+
+    def _reset_window(self):
+        self.w_frames = 0
+        self.w_bytes = 0
+        self.w_errors = 0
+        self.w_reconnects = 0
+        self.w_sum = 0.0
+        self.w_sq = 0.0
+        self.w_count = 0
+        self.w_max = 0.0
+        self.w_connect_ms = None
+
+    def connected(self, connect_ms):
+        with self.lock:
+            self.connects += 1
+            self.connect_ms.append(connect_ms)
+            self.w_connect_ms = connect_ms
+            # No interval across a reconnect
+            self.last_frame = None
+
+    def frame(self, size, now):
+        with self.lock:
+            self.frames += 1
+            self.bytes += size
+            self.w_frames += 1
+            self.w_bytes += size
+            if self.last_frame is not None:
+                ms = (now - self.last_frame) * 1000
+                self.interval_sum += ms
+                self.interval_sq += ms * ms
+                self.intervals += 1
+                self.interval_max = max(self.interval_max, ms)
+                bucket = min(int(ms), HIST_MAX_MS)
+                self.hist[bucket] = self.hist.get(bucket, 0) + 1
+                self.w_sum += ms
+                self.w_sq += ms * ms
+                self.w_count += 1
+                self.w_max = max(self.w_max, ms)
+            self.last_frame = now
+
+    def error(self, kind):
+        with self.lock:
+            self.errors[kind] = self.errors.get(kind, 0) + 1
+            self.w_errors += 1
+
+    def reconnect(self):
+        with self.lock:
+            self.reconnects += 1
+            self.w_reconnects += 1
+
+    def take_window(self, seconds):
+        with self.lock:
+            row = {
+                'client': self.name,
+                'kind': self.kind,
+                'frames': self.w_frames,
+                'fps': round(self.w_frames / seconds, 2),
+                'kbps': round(self.w_bytes * 8 / 1000 / seconds, 1),
+                'interval_avg_ms': round(self.w_sum / self.w_count, 1) if self.w_count else '',
+                'jitter_ms': round(stddev(self.w_sum, self.w_sq, self.w_count), 1) if self.w_count else '',
+                'interval_max_ms': round(self.w_max, 1) if self.w_count else '',
+                'connect_ms': round(self.w_connect_ms, 1) if self.w_connect_ms is not None else '',
+                'errors': self.w_errors,
+                'reconnects': self.w_reconnects,
+            }
+            self._reset_window()
+            return row
+
+    def percentile(self, p):
+        total = sum(self.hist.values())
+        if not total:
+            return None
+        rank = math.ceil(total * p / 100)
+        seen = 0
+        for bucket in sorted(self.hist):
+            seen += self.hist[bucket]
+            if seen >= rank:
+                return bucket
+        return None
+
+    def summary(self, seconds):
+        with self.lock:
+            return {
+                'client': self.name,
+                'kind': self.kind,
+                'frames': self.frames,
+                'bytes': self.bytes,
+                'fps': round(self.frames / seconds, 2) if seconds else 0,
+                'kbps': round(self.bytes * 8 / 1000 / seconds, 1) if seconds else 0,
+                'interval_avg_ms': round(self.interval_sum / self.intervals, 1) if self.intervals else None,
+                'jitter_ms': round(stddev(self.interval_sum, self.interval_sq, self.intervals), 1)
+                if self.intervals else None,
+                'interval_p50_ms': self.percentile(50),
+                'interval_p95_ms': self.percentile(95),
+                'interval_p99_ms': self.percentile(99),
+                'interval_max_ms': round(self.interval_max, 1) if self.intervals else None,
+                'connects': self.connects,
+                'connect_avg_ms': round(sum(self.connect_ms) / len(self.connect_ms), 1) if self.connect_ms else None,
+                'connect_max_ms': round(max(self.connect_ms), 1) if self.connect_ms else None,
+                'first_frame_avg_ms': round(sum(self.first_frame_ms) / len(self.first_frame_ms), 1)
+                if self.first_frame_ms else None,
+                'reconnects': self.reconnects,
+                'rejected': self.rejected,
+                'duplicates': self.duplicates,
+                'skipped': self.skipped,
+                'errors': dict(self.errors),
+            }
+
+
+def stddev(total, squares, count):
+    if count < 2:
+        return 0.0
+    mean = total / count
+    return math.sqrt(max(squares / count - mean * mean, 0.0))
+
+
+def log(msg):
+    print(time.strftime('%H:%M:%S ') + msg, flush=True)
+
+
+def stream_session(args, stats, boundary, stop):
+    """One /stream connection, parsed until it ends or the run stops."""
+    started = time.monotonic()
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    try:
+        stats.connected((time.monotonic() - started) * 1000)
+        sock.sendall(f'GET /stream HTTP/1.1\r\nHost: {args.host}\r\n\r\n'.encode())
+        reader = SocketReader(sock)
+
+        status = reader.readline().decode('latin-1').split()
+        headers = read_headers(reader)
+        if len(status) < 2:
+            raise ProtocolError('no status line')
+        if status[1] == '503':
+            raise Rejected(float(headers.get('retry-after', BACKOFF_MIN)))
+        if status[1] != '200':
+            raise ProtocolError(f'status {status[1]}')
+        expected = boundary.strip()[2:].decode('latin-1')
+        if f'boundary={expected}' not in headers.get('content-type', '').replace(' ', ''):
+            raise ProtocolError(f'Content-Type "{headers.get("content-type")}" does not use STREAM_BOUNDARY')
+
+        first = True
+        while not stop.is_set():
+            if reader.read(len(boundary)) != boundary:
+                raise ProtocolError('part does not start with STREAM_BOUNDARY')
+            part = read_headers(reader)
+            if 'content-length' not in part:
+                raise ProtocolError('part without Content-Length')
+            try:
+                length = int(part['content-length'])
+            except ValueError:
+                raise ProtocolError(f'Content-Length "{part["content-length"]}"')
+            if length <= 0 or length > MAX_FRAME:
+                raise ProtocolError(f'part length {length}')
+            jpeg = reader.read(length)
+            now = time.monotonic()
+            if not jpeg.startswith(b'\xff\xd8') or not jpeg.endswith(b'\xff\xd9'):
+                stats.error('bad_jpeg')
+            stats.frame(length, now)
+            if first:
+                with stats.lock:
+                    stats.first_frame_ms.append((now - started) * 1000)
+                first = False
+    finally:
+        sock.close()
+
+
+def capture_session(args, stats, stop):
+    """Repeated /capture requests on one keep-alive connection."""
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout + args.poll_timeout / 1000)
+    started = time.monotonic()
+    conn.connect()
+    stats.connected((time.monotonic() - started) * 1000)
+    last_seq = None
+    first = True
+    try:
+        while not stop.is_set():
+            if args.poll:
+                path = f'/capture?after={last_seq or 0}&timeout_ms={args.poll_timeout}'
+            else:
+                path = '/capture'
+            conn.request('GET', path)
+            resp = conn.getresponse()
+            body = resp.read()
+            now = time.monotonic()
+
+            if resp.status == 503:
+                raise Rejected(float(resp.getheader('Retry-After', BACKOFF_MIN)))
+            seq_header = resp.getheader('X-Frame-Seq')
+            seq = int(seq_header) if seq_header and seq_header.isdigit() else None
+            if resp.status == 204:
+                last_seq = seq if seq is not None else last_seq
+                continue
+            if resp.status != 200:
+                raise ProtocolError(f'status {resp.status}')
+            if not body.startswith(b'\xff\xd8') or not body.endswith(b'\xff\xd9'):
+                stats.error('bad_jpeg')
+
+            if seq is not None and last_seq is not None:
+                if seq == last_seq:
+                    with stats.lock:
+                        stats.duplicates += 1
+                    if args.capture_interval:
+                        stop.wait(args.capture_interval)
+                    continue
+                if seq > last_seq + 1:
+                    with stats.lock:
+                        stats.skipped += seq - last_seq - 1
+            last_seq = seq
+            stats.frame(len(body), now)
+            if first:
+                with stats.lock:
+                    stats.first_frame_ms.append((now - started) * 1000)
+                first = False
+            if args.capture_interval:
+                stop.wait(args.capture_interval)
+            if resp.will_close:
+                return
+    finally:
+        conn.close()
+
+
+def run_client(args, stats, boundary, stop):
+    backoff = BACKOFF_MIN
+    while not stop.is_set():
+        session_start = time.monotonic()
+        try:
+            if stats.kind == 'stream':
+                stream_session(args, stats, boundary, stop)
+            else:
+                capture_session(args, stats, stop)
+        except Rejected as e:
+            with stats.lock:
+                stats.rejected += 1
+            stats.error('rejected')
+            backoff = max(e.retry_after, BACKOFF_MIN)
+        except (socket.timeout, TimeoutError):
+            stats.error('timeout')
+        except EOFError:
+            stats.error('closed')
+        except ConnectionRefusedError:
+            stats.error('refused')
+        except (ProtocolError, http.client.HTTPException) as e:
+            stats.error('protocol')
+            if args.verbose:
+                log(f'  {stats.name}: {e}')
+        except OSError as e:
+            stats.error('socket')
+            if args.verbose:
+                log(f'  {stats.name}: {e}')
+        if stop.is_set():
+            break
+
+        # A session that ran for a while was healthy; start the backoff over
+        if time.monotonic() - session_start > BACKOFF_MAX:
+            backoff = BACKOFF_MIN
+        stats.reconnect()
+        if args.verbose:
+            log(f'  {stats.name}: reconnecting in {backoff:.0f} s')
+        stop.wait(backoff)
+        backoff = min(backoff * 2, BACKOFF_MAX)
+
+
+def format_row(row):
+    jitter = f'{row["jitter_ms"]} ms' if row['jitter_ms'] != '' else '-'
+    return (f'  {row["client"]:<10} {row["fps"]:6.2f} fps {row["kbps"]:8.1f} kbps  '
+            f'jitter {jitter:<9} errors {row["errors"]}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32S3 Camera stream load generator and soak test')
+    parser.add_argument('host', help='Device IP address or host name')
+    parser.add_argument('--port', type=int, default=80, help='HTTP port (default: 80)')
+    parser.add_argument('--streams', type=int, default=1, metavar='N', help='/stream clients (default: 1)')
+    parser.add_argument('--captures', type=int, default=0, metavar='N', help='/capture clients (default: 0)')
+    parser.add_argument('--poll', action='store_true',
+                        help='Capture clients long-poll /capture?after=<seq> instead of fetching the latest frame')
+    parser.add_argument('--poll-timeout', type=int, default=10000, metavar='MS',
+                        help='timeout_ms for long polls (default: 10000)')
+    parser.add_argument('--capture-interval', type=float, default=0, metavar='SEC',
+                        help='Pause between /capture requests (default: none)')
+    parser.add_argument('--duration', type=parse_duration, default=60.0, metavar='TIME',
+                        help='Run time: seconds, or with an s, m or h suffix (default: 60)')
+    parser.add_argument('--interval', type=parse_duration, default=10.0, metavar='TIME',
+                        help='Report interval (default: 10)')
+    parser.add_argument('--timeout', type=float, default=10.0, metavar='SEC',
+                        help='Socket timeout; a stream silent this long is reconnected (default: 10)')
+    parser.add_argument('--csv', metavar='FILE', help='Append one row per client per report interval')
+    parser.add_argument('--json', metavar='FILE', help='Write the summary as JSON')
+    parser.add_argument('--min-fps', type=float, default=0, metavar='FPS',
+                        help='Exit with 1 if any client averaged less than FPS')
+    parser.add_argument('--header', default=DEFAULT_HEADER, metavar='PATH',
+                        help='video_stream.h to take STREAM_BOUNDARY from')
+    parser.add_argument('--quiet', action='store_true', help='Only print the summary')
+    parser.add_argument('--verbose', action='store_true', help='Log every error and reconnect')
+    args = parser.parse_args()
+
+    if args.streams + args.captures == 0:
+        parser.error('nothing to do: --streams and --captures are both 0')
+
+    boundary = load_boundary(args.header)
+    clients = [ClientStats(f'stream{i + 1}', 'stream') for i in range(args.streams)]
+    clients += [ClientStats(f'capture{i + 1}', 'capture') for i in range(args.captures)]
+
+    csv_file = None
+    if args.csv:
+        new = not Path(args.csv).exists() or Path(args.csv).stat().st_size == 0
+        csv_file = open(args.csv, 'a', buffering=1)
+        if new:
+            csv_file.write(','.join(CSV_FIELDS) + '\n')
+
+    log(f'{args.streams} /stream and {args.captures} /capture{" long-poll" if args.poll else ""} clients '
+        f'against {args.host}:{args.port} for {args.duration:.0f} s')
+
+    stop = threading.Event()
+    threads = [threading.Thread(target=run_client, args=(args, c, boundary, stop), daemon=True) for c in clients]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+
+    deadline = start + args.duration
+    window_start = start
+    try:
+        while not stop.is_set():
+            now = time.monotonic()
+            if now >= deadline:
+                break
+            stop.wait(min(args.interval - (now - window_start), deadline - now))
+            now = time.monotonic()
+            if now - window_start < args.interval and now < deadline:
+                continue
+            seconds = now - window_start
+            window_start = now
+            rows = [c.take_window(seconds) for c in clients]
+            if not args.quiet:
+                log(f'{now - start:.0f} s')
+                for row in rows:
+                    print(format_row(row), flush=True)
+            if csv_file:
+                stamp = time.strftime('%Y-%m-%dT%H:%M:%S')
+                for row in rows:
+                    row.update(time=stamp, elapsed_s=round(now - start, 1))
+                    csv_file.write(','.join(str(row[f]) for f in CSV_FIELDS) + '\n')
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stop.set()
+    elapsed = time.monotonic() - start
+    for t in threads:
+        t.join(timeout=args.timeout)
+    if csv_file:
+        csv_file.close()
+
+    summaries = [c.summary(elapsed) for c in clients]
+    print(f'\nSummary over {elapsed:.0f} s:')
+    for s in summaries:
+        errors = sum(s['errors'].values())
+        p95 = f'{s["interval_p95_ms"]} ms' if s['interval_p95_ms'] is not None else '-'
+        jitter = f'{s["jitter_ms"]} ms' if s['jitter_ms'] is not None else '-'
+        connect = f'{s["connect_avg_ms"]} ms' if s['connect_avg_ms'] is not None else '-'
+        print(f'  {s["client"]:<10} {s["frames"]} frames, {s["fps"]:.2f} fps, {s["kbps"]:.1f} kbps, '
+              f'jitter {jitter}, p95 {p95}, connect {connect}, {s["reconnects"]} reconnects, {errors} errors')
+
+    failed = [s['client'] for s in summaries if s['frames'] == 0 or s['fps'] < args.min_fps]
+    if args.json:
+        report = {
+            'host': args.host,
+            'port': args.port,
+            'duration_s': round(elapsed, 1),
+            'boundary': boundary.decode('latin-1'),
+            'poll': args.poll,
+            'clients': summaries,
+            'total_frames': sum(s['frames'] for s in summaries),
+            'total_kbps': round(sum(s['kbps'] for s in summaries), 1),
+            'failed': failed,
+        }
+        Path(args.json).write_text(json.dumps(report, indent=2) + '\n')
+
+    if failed:
+        print(f'Below {args.min_fps} fps or no frames: {", ".join(failed)}')
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
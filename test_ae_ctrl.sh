@@ -0,0 +1,677 @@
+#!/bin/bash
+# Test script for the auto exposure controller
+# Usage: ./test_ae_ctrl.sh
+#
+# Builds main/ae_ctrl.c and main/luma_hist.c for the host and runs the
+# controller in closed loop against a synthetic sensor, the way exposure.c
+# does: each frame's 80x60 luma thumbnail comes from a scene's linear
+# radiance times the exposure programmed settle_frames frames earlier,
+# through a gamma curve with per-pixel noise and clipping. The light then
+# steps, ramps, flickers, goes past the exposure limits and lights a window
+# behind the subject. Checks that every change converges within the frame
+# and adjustment budgets, approaches the target from one side without
+# overshooting or reversing, holds still once converged, and still settles
+# without hunting when the sensor's gamma and gain table are off from the
+# model's.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "ae_ctrl.h"
+#include "luma_hist.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define THUMB_W 80          // 1/8 scale DC thumbnail of a VGA frame
+#define THUMB_H 60
+#define PIXELS (THUMB_W * THUMB_H)
+#define MAX_FRAMES 4000
+#define TARGET 110          // CONFIG_APP_AE_TARGET_LUMA
+#define TOLERANCE 8         // EXPOSURE_TOLERANCE
+
+// exposure.c with the Kconfig defaults
+static const ae_ctrl_config_t k_config = {
+    .target = TARGET,
+    .tolerance = TOLERANCE,
+    .exposure_min = 4,
+    .exposure_max = 600,
+    .gain_max = 15,
+    .settle_frames = 2,
+    .clip_permille = 20,
+};
+
+static uint32_t s_rand = 1;
+
+static uint32_t rnd(void)
+{
+    s_rand = s_rand * 1103515245u + 12345u;
+    return s_rand >> 8;
+}
+
+// Roughly gaussian, unit variance
+static float noise(void)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        sum += (float)(rnd() & 0xffff) / 65536.0f;
+    }
+    return (sum - 2.0f) * 1.732f;
+}
+
+typedef struct {
+    float gamma;            // the OV2640's curve, against the controller's 2.2
+    float gain_error;       // per gain step, e.g. 0.9: index + 1 gives 1 + 0.9 * index
+    float noise;            // luma levels rms per pixel at unity gain
+    int latency;            // frames after a write still exposed with the old setting
+} sensor_t;
+
+static const sensor_t k_nominal = { 2.2f, 1.0f, 1.5f, 2 };
+
+// Radiance in units where 1.0 at 1000 lines and unity gain is full scale
+typedef struct {
+    float radiance[PIXELS];
+} scene_t;
+
+// Desk and wall: a lit gradient with textured patches over 4 stops
+static void scene_indoor(scene_t *scene)
+{
+    for (int y = 0; y < THUMB_H; y++) {
+        for (int x = 0; x < THUMB_W; x++) {
+            float shade = 0.5f + 0.5f * (float)x / THUMB_W;
+            float patch = exp2f((float)(((x / 10) * 7 + (y / 10) * 3) % 9) / 2.0f);
+            float texture = 1.0f + 0.2f * noise();
+            scene->radiance[y * THUMB_W + x] = 0.2f * shade * patch * (texture > 0.2f ? texture : 0.2f);
+        }
+    }
+}
+
+// A dim room with a lamp shade over 5% of the frame, 12-50x brighter than
+// the room, and a window over 7% that is clipped at any exposure used here
+static void scene_backlit(scene_t *scene)
+{
+    for (int y = 0; y < THUMB_H; y++) {
+        for (int x = 0; x < THUMB_W; x++) {
+            float r = 0.01f * exp2f((float)((x * 3 + y * 5) % 13) / 6.0f);
+            if (x >= 60 && y < 16) {
+                r = 200.0f;
+            } else if (x >= 8 && x < 24 && y >= 30 && y < 45) {
+                r = 0.5f;
+            }
+            scene->radiance[y * THUMB_W + x] = r;
+        }
+    }
+}
+
+typedef struct {
+    const scene_t *scene;
+    sensor_t sensor;
+    ae_ctrl_t ae;
+    ae_setting_t programmed[MAX_FRAMES];    // after frame n
+    uint8_t mean[MAX_FRAMES];
+    uint8_t clip[MAX_FRAMES];               // permille in the top bin
+    uint8_t evaluated[MAX_FRAMES];          // not skipped while settling
+    uint8_t adjusted[MAX_FRAMES];
+    uint32_t total[MAX_FRAMES];             // exposure the frame was taken with
+    int frames;
+} run_t;
+
+static float sensor_gain(const sensor_t *sensor, uint8_t gain)
+{
+    return 1.0f + sensor->gain_error * gain;
+}
+
+// Expose frame n with the setting written latency frames before, meter it
+// and feed the controller, as exposure_process() does
+static void run_frame(run_t *run, float light)
+{
+    static uint8_t luma[PIXELS];
+    int n = run->frames;
+    int from = n - run->sensor.latency - 1;
+    ae_setting_t setting = from >= 0 ? run->programmed[from] : run->programmed[MAX_FRAMES - 1];
+    float gain = sensor_gain(&run->sensor, setting.gain);
+    float scale = light * setting.exposure * gain / 1000.0f;
+    float sigma = run->sensor.noise * sqrtf(gain);
+
+    for (int i = 0; i < PIXELS; i++) {
+        float lin = run->scene->radiance[i] * scale;
+        float v = lin >= 1.0f ? 255.0f : 255.0f * powf(lin, 1.0f / run->sensor.gamma);
+        v += sigma * noise() + 0.5f;
+        luma[i] = v < 0.0f ? 0 : v > 255.0f ? 255 : (uint8_t)v;
+    }
+
+    luma_hist_t hist;
+    luma_hist_compute(&hist, luma, THUMB_W, THUMB_H, 0);
+
+    uint32_t settling = run->ae.stats.settling;
+    run->adjusted[n] = ae_ctrl_update(&run->ae, &hist);
+    run->evaluated[n] = run->ae.stats.settling == settling;
+    run->programmed[n] = run->ae.setting;
+    run->mean[n] = hist.mean;
+    run->clip[n] = (uint8_t)(hist.clip_permille > 255 ? 255 : hist.clip_permille);
+    run->total[n] = (uint32_t)(setting.exposure * gain + 0.5f);
+    run->frames++;
+}
+
+static void run_init(run_t *run, const scene_t *scene, const sensor_t *sensor, ae_setting_t initial)
+{
+    memset(run, 0, sizeof(*run));
+    run->scene = scene;
+    run->sensor = *sensor;
+    ae_ctrl_init(&run->ae, &k_config, initial);
+    // Written before the first frame
+    run->programmed[MAX_FRAMES - 1] = initial;
+}
+
+typedef struct {
+    int adjustments;
+    int converge_frames;    // from the change to the first frame in the band, -1 if never
+    int reversals;          // adjustments against the direction of the first
+    int overshoots;         // evaluated frames out of band on the far side of the target
+    int late_adjustments;   // after converging
+    int max_error;          // on evaluated frames once converged
+} segment_t;
+
+// How frames [start, end) went after the light changed at start
+static segment_t segment_stats(const run_t *run, int start, int end)
+{
+    segment_t seg = { .converge_frames = -1 };
+    int dir = 0;
+    int side = 0;
+
+    for (int n = start; n < end; n++) {
+        int error = (int)run->mean[n] - TARGET;
+        if (run->adjusted[n]) {
+            int step = run->programmed[n].exposure * (run->programmed[n].gain + 1) >
+                       run->programmed[n - 1].exposure * (run->programmed[n - 1].gain + 1) ? 1 : -1;
+            if (seg.converge_frames >= 0) {
+                seg.late_adjustments++;
+            }
+            if (dir == 0) {
+                dir = step;
+            } else if (step != dir) {
+                seg.reversals++;
+            }
+            seg.adjustments++;
+        }
+        if (!run->evaluated[n]) {
+            continue;
+        }
+        if (seg.converge_frames < 0) {
+            if (abs(error) <= TOLERANCE) {
+                seg.converge_frames = n - start + 1;
+            } else if (side == 0) {
+                side = error > 0 ? 1 : -1;
+            } else if ((error > 0 ? 1 : -1) != side) {
+                seg.overshoots++;
+            }
+        } else if (abs(error) > seg.max_error) {
+            seg.max_error = abs(error);
+        }
+    }
+    return seg;
+}
+
+// Light level steps, held 100 frames each, 8 to 128x apart
+static const float k_steps[] = { 3.0f, 1.0f, 20.0f, 0.5f, 1.0f / 16, 2.0f, 0.25f, 1.0f };
+#define STEPS (int)(sizeof(k_steps) / sizeof(k_steps[0]))
+#define STEP_FRAMES 100
+
+// Run the step sequence; returns the worst segment
+static int run_steps(run_t *run, segment_t *worst, int max_adjustments, int max_frames, int max_reversals)
+{
+    memset(worst, 0, sizeof(*worst));
+    for (int s = 0; s < STEPS; s++) {
+        int start = run->frames;
+        for (int i = 0; i < STEP_FRAMES; i++) {
+            run_frame(run, k_steps[s]);
+        }
+        segment_t seg = segment_stats(run, start, run->frames);
+        float ratio = s > 0 ? k_steps[s] / k_steps[s - 1] : k_steps[0];
+        CHECK(seg.converge_frames >= 0, "step %d (x%.3g) never converged, mean %u at %u", s, ratio,
+              run->mean[run->frames - 1], run->total[run->frames - 1]);
+        CHECK(seg.converge_frames <= max_frames, "step %d (x%.3g) took %d frames", s, ratio, seg.converge_frames);
+        CHECK(seg.adjustments <= max_adjustments, "step %d (x%.3g) took %d adjustments", s, ratio, seg.adjustments);
+        CHECK(seg.reversals <= max_reversals, "step %d (x%.3g) reversed %d times", s, ratio, seg.reversals);
+        CHECK(max_reversals > 0 || seg.overshoots == 0, "step %d (x%.3g) overshot the target", s, ratio);
+        CHECK(seg.late_adjustments == 0, "step %d (x%.3g) adjusted %d times after converging",
+              s, ratio, seg.late_adjustments);
+        CHECK(seg.max_error <= 2 * TOLERANCE, "step %d (x%.3g) drifted %d from the target", s, ratio, seg.max_error);
+        if (seg.adjustments > worst->adjustments) {
+            worst->adjustments = seg.adjustments;
+        }
+        if (seg.converge_frames > worst->converge_frames) {
+            worst->converge_frames = seg.converge_frames;
+        }
+        worst->reversals += seg.reversals;
+    }
+    CHECK(run->ae.stats.max_converge_frames > 0, "max_converge_frames not recorded");
+    return 0;
+}
+
+// Light steps with the nominal sensor: one-sided, within the adjustment
+// budget a step of that size needs, and still afterwards
+static int test_steps(void)
+{
+    static scene_t scene;
+    static run_t run;
+    segment_t worst;
+
+    s_rand = 1;
+    scene_indoor(&scene);
+    run_init(&run, &scene, &k_nominal, (ae_setting_t){ .exposure = 300, .gain = 0 });
+    if (run_steps(&run, &worst, 4, 4 * (k_config.settle_frames + 1) + 1, 0) != 0) {
+        return 1;
+    }
+
+    // The README's claim: a 20x change settles in three adjustments
+    segment_t twenty = segment_stats(&run, 2 * STEP_FRAMES, 3 * STEP_FRAMES);
+    CHECK(twenty.adjustments <= 3, "20x took %d adjustments", twenty.adjustments);
+
+    printf("ok %d %d %d %u\n", worst.adjustments, worst.converge_frames, twenty.adjustments,
+           run.ae.stats.max_converge_frames);
+    return 0;
+}
+
+// Light around a level, with 100 Hz flicker beating at 1.5% and 1% noise
+static void run_flicker(run_t *run, float level, int frames, int *lo, int *hi, int *sum)
+{
+    *lo = 255;
+    *hi = 0;
+    *sum = 0;
+    for (int i = 0; i < frames; i++) {
+        run_frame(run, level * (1.0f + 0.015f * sinf((float)i * 0.37f) + 0.01f * noise()));
+        int mean = run->mean[run->frames - 1];
+        *lo = mean < *lo ? mean : *lo;
+        *hi = mean > *hi ? mean : *hi;
+        *sum += mean;
+    }
+}
+
+// Converged under heavy pixel noise and flicker: no adjustments in 2000
+// frames. Then the light drifts until the mean sits between one and two
+// tolerances off the target, which hysteresis must ride out
+static int test_steady(void)
+{
+    static scene_t scene;
+    static run_t run;
+    int lo;
+    int hi;
+    int sum;
+
+    s_rand = 2;
+    scene_indoor(&scene);
+    run_init(&run, &scene, &k_nominal, (ae_setting_t){ .exposure = 300, .gain = 0 });
+    run.sensor.noise = 4.0f;
+    for (int i = 0; i < 60; i++) {
+        run_frame(&run, 1.0f);
+    }
+    CHECK(run.ae.converged, "not converged after 60 frames, mean %u", run.mean[run.frames - 1]);
+
+    uint32_t adjustments = run.ae.stats.adjustments;
+    run_flicker(&run, 1.0f, 2000, &lo, &hi, &sum);
+    CHECK(run.ae.stats.adjustments == adjustments, "%u adjustments while steady, mean %d-%d",
+          run.ae.stats.adjustments - adjustments, lo, hi);
+    CHECK(lo >= TARGET - 2 * TOLERANCE && hi <= TARGET + 2 * TOLERANCE, "mean %d-%d", lo, hi);
+
+    // Luma goes with light^(1/2.2)
+    float level = powf((TARGET + 1.5f * TOLERANCE) / ((float)sum / 2000), 2.2f);
+    int drift_lo;
+    int drift_hi;
+    run_flicker(&run, level, 1000, &drift_lo, &drift_hi, &sum);
+    CHECK(run.ae.stats.adjustments == adjustments, "%u adjustments inside the hysteresis band, mean %d-%d",
+          run.ae.stats.adjustments - adjustments, drift_lo, drift_hi);
+    CHECK(drift_lo > TARGET + TOLERANCE && drift_hi <= TARGET + 2 * TOLERANCE,
+          "drifted mean %d-%d, not between the bands", drift_lo, drift_hi);
+    CHECK(run.ae.converged, "left convergence inside the hysteresis band");
+
+    printf("ok %d %d %d %d\n", lo, hi, drift_lo, drift_hi);
+    return 0;
+}
+
+// Sunset: the light falls 0.5% a frame for 800 frames, 55x in all. The
+// controller follows in steps, all of them the same way, each landing in
+// the band, and never lets the mean stray far outside it
+static int test_ramp(void)
+{
+    static scene_t scene;
+    static run_t run;
+
+    s_rand = 3;
+    scene_indoor(&scene);
+    run_init(&run, &scene, &k_nominal, (ae_setting_t){ .exposure = 16, .gain = 0 });
+    float light = 16.0f;
+    for (int i = 0; i < 60; i++) {
+        run_frame(&run, light);
+    }
+    CHECK(run.ae.converged, "not converged before the ramp, mean %u", run.mean[run.frames - 1]);
+
+    int start = run.frames;
+    uint32_t adjustments = run.ae.stats.adjustments;
+    int worst = 0;
+    for (int i = 0; i < 800; i++) {
+        light *= 0.995f;
+        run_frame(&run, light);
+        int n = run.frames - 1;
+        int error = abs((int)run.mean[n] - TARGET);
+        if (error > worst) {
+            worst = error;
+        }
+        if (run.adjusted[n]) {
+            CHECK(ae_ctrl_total(run.programmed[n]) > ae_ctrl_total(run.programmed[n - 1]),
+                  "exposure went down at frame %d while the light fell", n - start);
+        }
+    }
+    uint32_t steps = run.ae.stats.adjustments - adjustments;
+    CHECK(steps >= 8 && steps <= 60, "%u adjustments over the ramp", steps);
+    CHECK(worst <= 3 * TOLERANCE, "mean strayed %d from the target", worst);
+
+    printf("ok %u %d %u %u\n", steps, worst, run.programmed[run.frames - 1].exposure,
+           run.programmed[run.frames - 1].gain);
+    return 0;
+}
+
+// Darker than the longest exposure at full gain reaches, then brighter than
+// the shortest: the controller pins the limit, says so, and stops writing
+static int test_limits(void)
+{
+    static scene_t scene;
+    static run_t run;
+
+    s_rand = 4;
+    scene_indoor(&scene);
+    run_init(&run, &scene, &k_nominal, (ae_setting_t){ .exposure = 300, .gain = 0 });
+
+    for (int i = 0; i < 150; i++) {
+        run_frame(&run, 1.0f / 200);
+    }
+    segment_t dark = segment_stats(&run, 0, run.frames);
+    ae_setting_t s = run.ae.setting;
+    CHECK(s.exposure == k_config.exposure_max && s.gain == k_config.gain_max,
+          "dark: %u lines gain %u, not at the limit", s.exposure, s.gain);
+    CHECK(run.ae.limited && !run.ae.converged, "dark: limited %d converged %d", run.ae.limited, run.ae.converged);
+    CHECK(dark.reversals == 0 && dark.adjustments <= 4, "dark: %d adjustments, %d reversals",
+          dark.adjustments, dark.reversals);
+    uint8_t dark_mean = run.mean[run.frames - 1];
+
+    int start = run.frames;
+    for (int i = 0; i < 150; i++) {
+        run_frame(&run, 400.0f);
+    }
+    segment_t bright = segment_stats(&run, start, run.frames);
+    s = run.ae.setting;
+    CHECK(s.exposure == k_config.exposure_min && s.gain == 0,
+          "bright: %u lines gain %u, not at the limit", s.exposure, s.gain);
+    CHECK(run.ae.limited && !run.ae.converged, "bright: limited %d converged %d",
+          run.ae.limited, run.ae.converged);
+    CHECK(bright.reversals == 0 && bright.adjustments <= 5, "bright: %d adjustments, %d reversals",
+          bright.adjustments, bright.reversals);
+    // No further writes once pinned
+    for (int n = run.frames - 100; n < run.frames; n++) {
+        CHECK(!run.adjusted[n], "bright: still adjusting at frame %d", n - start);
+    }
+
+    printf("ok %u %u\n", dark_mean, run.mean[run.frames - 1]);
+    return 0;
+}
+
+// A window behind a dim subject: the window is clipped from the start and
+// must not hold the room dark, but the lamp shade may only clip 2% more per
+// step. Settles in band or limited, without hunting
+static int test_backlit(void)
+{
+    static scene_t scene;
+    static run_t run;
+
+    s_rand = 5;
+    scene_backlit(&scene);
+    run_init(&run, &scene, &k_nominal, (ae_setting_t){ .exposure = 20, .gain = 0 });
+    for (int i = 0; i < 200; i++) {
+        run_frame(&run, 1.0f);
+    }
+    segment_t seg = segment_stats(&run, 0, run.frames);
+    int n = run.frames - 1;
+    CHECK(run.total[n] > 8 * 20, "window held the room dark: %u lines, mean %u", run.total[n], run.mean[n]);
+    CHECK(seg.reversals == 0, "%d reversals", seg.reversals);
+    CHECK(seg.overshoots == 0, "overshot the target");
+    CHECK(run.ae.converged || run.ae.limited, "neither converged nor limited, mean %u", run.mean[n]);
+    for (int i = run.frames - 100; i < run.frames; i++) {
+        CHECK(!run.adjusted[i], "still adjusting at frame %d, mean %u", i, run.mean[i]);
+    }
+    // Each step clipped at most clip_permille more of the frame, as seen on
+    // the first frame exposed with it
+    for (int i = 0; i < run.frames; i++) {
+        if (!run.adjusted[i]) {
+            continue;
+        }
+        int next = i + 1;
+        while (next < run.frames && !run.evaluated[next]) {
+            next++;
+        }
+        CHECK(next < run.frames, "no frame after the step at frame %d", i);
+        CHECK(run.clip[next] <= run.clip[i] + k_config.clip_permille + 5,
+              "step at frame %d clipped %u permille, was %u", i, run.clip[next], run.clip[i]);
+    }
+
+    printf("ok %d %u %u %u %s\n", seg.adjustments, run.mean[n], run.clip[0], run.clip[n],
+           run.ae.converged ? "converged" : "limited");
+    return 0;
+}
+
+// The real sensor's curve and gain table are not the model's. Gamma 1.8 to
+// 2.6 and a gain table 15% off either way still converge, reverse at most
+// once per step and hold still afterwards; a shorter write latency than
+// settle_frames costs nothing
+static int test_mismatch(void)
+{
+    static scene_t scene;
+    static run_t run;
+    static const sensor_t sensors[] = {
+        { 1.8f, 1.0f, 1.5f, 2 },
+        { 2.6f, 1.0f, 1.5f, 2 },
+        { 2.2f, 0.85f, 1.5f, 2 },
+        { 2.2f, 1.15f, 1.5f, 2 },
+        { 1.8f, 1.15f, 1.5f, 2 },
+        { 2.6f, 0.85f, 1.5f, 2 },
+        { 2.2f, 1.0f, 1.5f, 1 },
+        { 2.2f, 1.0f, 1.5f, 0 },
+    };
+    int worst_adjustments = 0;
+    int worst_frames = 0;
+    int reversals = 0;
+
+    scene_indoor(&scene);
+    for (size_t i = 0; i < sizeof(sensors) / sizeof(sensors[0]); i++) {
+        segment_t worst;
+        s_rand = 6 + i;
+        run_init(&run, &scene, &sensors[i], (ae_setting_t){ .exposure = 300, .gain = 0 });
+        if (run_steps(&run, &worst, 6, 6 * (k_config.settle_frames + 1) + 1, 1) != 0) {
+            printf("  (gamma %.1f, gain x%.2f, latency %d)\n", sensors[i].gamma, sensors[i].gain_error,
+                   sensors[i].latency);
+            return 1;
+        }
+        if (worst.adjustments > worst_adjustments) {
+            worst_adjustments = worst.adjustments;
+        }
+        if (worst.converge_frames > worst_frames) {
+            worst_frames = worst.converge_frames;
+        }
+        reversals += worst.reversals;
+    }
+
+    printf("ok %zu %d %d %d\n", sizeof(sensors) / sizeof(sensors[0]), worst_adjustments, worst_frames, reversals);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim steps|steady|ramp|limits|backlit|mismatch\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "steps") == 0) {
+        return test_steps();
+    }
+    if (strcmp(argv[1], "steady") == 0) {
+        return test_steady();
+    }
+    if (strcmp(argv[1], "ramp") == 0) {
+        return test_ramp();
+    }
+    if (strcmp(argv[1], "limits") == 0) {
+        return test_limits();
+    }
+    if (strcmp(argv[1], "backlit") == 0) {
+        return test_backlit();
+    }
+    if (strcmp(argv[1], "mismatch") == 0) {
+        return test_mismatch();
+    }
+    fprintf(stderr, "usage: sim steps|steady|ramp|limits|backlit|mismatch\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/ae_ctrl.c main/luma_hist.c -o "$WORK_DIR/sim" -lm
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test convergence after light steps
+test_steps() {
+    print_test "Light steps of 3x to 128x with the nominal sensor..."
+
+    run_sim steps || return 1
+    read -r adjustments frames twenty max_frames <<< "$RESULT"
+    print_pass "each step converged in at most $adjustments adjustments and $frames frames\
+ (20x in $twenty), from one side, and held; max_converge_frames $max_frames"
+    return 0
+}
+
+# Test that a converged controller holds still under noise and flicker
+test_steady() {
+    print_test "Noise and flicker around the target for 2000 frames..."
+
+    run_sim steady || return 1
+    read -r lo hi drift_lo drift_hi <<< "$RESULT"
+    print_pass "no adjustments with the mean between $lo and $hi, nor once it drifted to $drift_lo-$drift_hi"
+    return 0
+}
+
+# Test following a slow fall in light
+test_ramp() {
+    print_test "Light falling 55x over 800 frames..."
+
+    run_sim ramp || return 1
+    read -r steps worst exposure gain <<< "$RESULT"
+    print_pass "$steps adjustments, all upwards, mean within $worst of the target,\
+ ending at $exposure lines gain $gain"
+    return 0
+}
+
+# Test pinning at the exposure limits
+test_limits() {
+    print_test "Light beyond the longest and the shortest exposure..."
+
+    run_sim limits || return 1
+    read -r dark bright <<< "$RESULT"
+    print_pass "pinned at 600 lines gain 15 (mean $dark) and at 4 lines (mean $bright), limited, no hunting"
+    return 0
+}
+
+# Test a clipped window behind a dim subject
+test_backlit() {
+    print_test "Window behind a dim subject..."
+
+    run_sim backlit || return 1
+    read -r adjustments mean clip_start clip_end state <<< "$RESULT"
+    print_pass "$state at mean $mean in $adjustments adjustments, clipped $clip_start to $clip_end permille"
+    return 0
+}
+
+# Test a sensor that differs from the controller's model
+test_mismatch() {
+    print_test "Gamma 1.8-2.6, gain table 15% off, shorter write latency..."
+
+    run_sim mismatch || return 1
+    read -r sensors adjustments frames reversals <<< "$RESULT"
+    print_pass "$sensors sensors converged in at most $adjustments adjustments and $frames frames per step,\
+ $reversals reversals in all, held afterwards"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Auto Exposure Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_steps test_steady test_ramp test_limits test_backlit test_mismatch; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,465 @@
+#!/bin/bash
+# Test script for the burst frame store
+# Usage: ./test_burst_buffer.sh
+#
+# Builds main/burst_buffer.c and main/frame_pool.c for the host and runs
+# bursts against a synthetic camera. The store is linear: frames are packed
+# back to back and a burst that reaches the byte or frame limit stops, and
+# the next burst starts over at offset 0 of the same region. Checks that a
+# frame that does not fit is refused whole without writing past the region,
+# that collection honours the interval and stops cleanly on overflow or a
+# stalled camera without leaking frame pool slabs, and that back-to-back
+# bursts reusing the region never see stale data.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "burst_buffer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define SLABS 4
+#define SLAB_SIZE 512
+#define CANARY 0xa5
+#define GUARD 64
+
+static uint8_t s_slabs[SLABS * SLAB_SIZE];
+static frame_pool_t s_pool;
+
+static size_t frame_len(uint32_t seq)
+{
+    return 50 + (seq * 37) % 400;
+}
+
+static uint8_t frame_byte(uint32_t seq, size_t i)
+{
+    return (uint8_t)(seq * 31 + i * 7);
+}
+
+static bool frame_intact(const uint8_t *data, size_t len, uint32_t seq)
+{
+    if (len != frame_len(seq)) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != frame_byte(seq, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Synthetic camera: a new frame every period_us, captured when a reader
+// waits for one, up to last_seq; the latest frame is kept like s_latest in
+// capture_pipeline.c
+typedef struct {
+    frame_t *latest;
+    uint32_t seq;
+    uint32_t last_seq;
+    int64_t now_us;
+    int64_t period_us;
+    uint32_t captured;
+} camera_t;
+
+static void camera_init(camera_t *cam, uint32_t first_seq, uint32_t frames, int64_t period_us)
+{
+    memset(cam, 0, sizeof(*cam));
+    cam->seq = first_seq;
+    cam->last_seq = first_seq + frames - 1;
+    cam->period_us = period_us;
+    cam->now_us = 1000000;
+}
+
+static bool camera_capture(camera_t *cam)
+{
+    if (cam->latest != NULL && cam->seq == cam->last_seq) {
+        return false;
+    }
+    frame_t *frame = frame_pool_alloc(&s_pool);
+    if (frame == NULL) {
+        return false;
+    }
+    uint32_t seq = cam->latest != NULL ? cam->seq + 1 : cam->seq;
+    uint8_t *slab = frame_pool_slab(frame);
+    frame->len = frame_len(seq);
+    for (size_t i = 0; i < frame->len; i++) {
+        slab[i] = frame_byte(seq, i);
+    }
+    frame->seq = seq;
+    frame->timestamp_us = cam->now_us;
+    frame->width = 320;
+    frame->height = 240;
+    if (cam->latest != NULL) {
+        frame_unref(cam->latest);
+    }
+    cam->latest = frame;
+    cam->seq = seq;
+    cam->now_us += cam->period_us;
+    cam->captured++;
+    return true;
+}
+
+static void camera_stop(camera_t *cam)
+{
+    if (cam->latest != NULL) {
+        frame_unref(cam->latest);
+        cam->latest = NULL;
+    }
+}
+
+static frame_t *camera_source(void *ctx, uint32_t after_seq, uint32_t timeout_ms)
+{
+    camera_t *cam = ctx;
+
+    if (cam->latest == NULL || cam->latest->seq <= after_seq) {
+        if (timeout_ms == 0 || !camera_capture(cam)) {
+            return NULL;
+        }
+    }
+    return frame_ref(cam->latest);
+}
+
+static uint32_t pool_in_use(void)
+{
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&s_pool, &stats);
+    return stats.in_use;
+}
+
+// Frames are contiguous from offset 0 and each is the one the camera
+// produced for its seq
+static int check_layout(const burst_buffer_t *burst)
+{
+    size_t offset = 0;
+
+    for (uint32_t i = 0; i < burst->count; i++) {
+        const burst_frame_t *f = &burst->frames[i];
+        CHECK(f->offset == offset, "frame %u at %zu, expected %zu", i, f->offset, offset);
+        CHECK(frame_intact(burst_buffer_frame_data(burst, i), f->len, f->seq), "frame %u (seq %u) corrupted",
+              i, f->seq);
+        CHECK(i == 0 || f->seq > burst->frames[i - 1].seq, "frame %u out of order", i);
+        offset += f->len;
+    }
+    CHECK(burst->used == offset, "used %zu, frames hold %zu", burst->used, offset);
+    return 0;
+}
+
+static int test_append(void)
+{
+    static uint8_t region[1000 + GUARD];
+    burst_buffer_t burst;
+    frame_t frame;
+    uint8_t data[1000];
+
+    memset(region, CANARY, sizeof(region));
+    memset(data, 0x11, sizeof(data));
+    memset(&frame, 0, sizeof(frame));
+    frame.data = data;
+    burst_buffer_init(&burst, region, 1000, 8);
+
+    // 300 + 300 + 300 + 100 fills the region exactly
+    frame.len = 300;
+    for (int i = 0; i < 3; i++) {
+        CHECK(burst_buffer_append(&burst, &frame), "300-byte frame %d refused", i);
+    }
+    CHECK(!burst_buffer_append(&burst, &frame), "300 bytes accepted with 100 left");
+    frame.len = 101;
+    CHECK(!burst_buffer_append(&burst, &frame), "101 bytes accepted with 100 left");
+    frame.len = 100;
+    CHECK(burst_buffer_append(&burst, &frame), "100 bytes refused with 100 left");
+    frame.len = 1;
+    CHECK(!burst_buffer_append(&burst, &frame), "1 byte accepted when full");
+    frame.len = 0;
+    CHECK(burst_buffer_append(&burst, &frame), "empty frame refused");
+    // capacity - used must not wrap around
+    frame.len = SIZE_MAX;
+    CHECK(!burst_buffer_append(&burst, &frame), "SIZE_MAX bytes accepted");
+    CHECK(burst.count == 5 && burst.used == 1000, "%u frames, %zu bytes", burst.count, burst.used);
+    for (int i = 0; i < GUARD; i++) {
+        CHECK(region[1000 + i] == CANARY, "written past the region at +%d", i);
+    }
+
+    // Frame limit, and max_frames clamped to BURST_MAX_FRAMES
+    static uint8_t big[BURST_MAX_FRAMES * 16 + 16];
+    burst_buffer_init(&burst, big, sizeof(big), BURST_MAX_FRAMES + 8);
+    CHECK(burst.max_frames == BURST_MAX_FRAMES, "max_frames %u", burst.max_frames);
+    frame.len = 16;
+    for (int i = 0; i < BURST_MAX_FRAMES; i++) {
+        CHECK(burst_buffer_append(&burst, &frame), "frame %d refused", i);
+    }
+    CHECK(!burst_buffer_append(&burst, &frame), "frame %d accepted", BURST_MAX_FRAMES);
+    burst_buffer_init(&burst, big, sizeof(big), 3);
+    for (int i = 0; i < 3; i++) {
+        CHECK(burst_buffer_append(&burst, &frame), "frame %d refused", i);
+    }
+    CHECK(!burst_buffer_append(&burst, &frame), "fourth frame accepted with max_frames 3");
+    printf("ok\n");
+    return 0;
+}
+
+static int test_collect(void)
+{
+    static uint8_t region[64 * 1024];
+    burst_buffer_t burst;
+    camera_t cam;
+
+    // Every frame: the one already waiting is not part of the burst
+    camera_init(&cam, 1, 100, 40000);
+    camera_capture(&cam);
+    burst_buffer_init(&burst, region, sizeof(region), BURST_MAX_FRAMES);
+    CHECK(burst_buffer_collect(&burst, camera_source, &cam, 10, 0, 1000) == 10, "%u frames", burst.count);
+    CHECK(burst.frames[0].seq == 2 && burst.frames[9].seq == 11, "seqs %u..%u", burst.frames[0].seq,
+          burst.frames[9].seq);
+    CHECK(burst.frames_skipped == 0, "%u skipped", burst.frames_skipped);
+    CHECK(burst_buffer_rate_mfps(&burst) == 25000, "%u mfps at 25 fps", burst_buffer_rate_mfps(&burst));
+    if (check_layout(&burst) != 0) {
+        return 1;
+    }
+    camera_stop(&cam);
+
+    // 100 ms apart at 25 fps: every third frame, two skipped in between
+    camera_init(&cam, 1, 100, 40000);
+    burst_buffer_init(&burst, region, sizeof(region), BURST_MAX_FRAMES);
+    CHECK(burst_buffer_collect(&burst, camera_source, &cam, 6, 100, 1000) == 6, "%u frames", burst.count);
+    for (uint32_t i = 1; i < burst.count; i++) {
+        int64_t gap = burst.frames[i].timestamp_us - burst.frames[i - 1].timestamp_us;
+        CHECK(gap == 120000, "frames %u and %u %lld us apart", i - 1, i, (long long)gap);
+    }
+    CHECK(burst.frames_skipped == 10, "%u skipped", burst.frames_skipped);
+    CHECK(burst_buffer_rate_mfps(&burst) == 8333, "%u mfps", burst_buffer_rate_mfps(&burst));
+    if (check_layout(&burst) != 0) {
+        return 1;
+    }
+    camera_stop(&cam);
+
+    // Camera stops after 4 frames: the burst ends early with what it has
+    camera_init(&cam, 1, 4, 40000);
+    burst_buffer_init(&burst, region, sizeof(region), BURST_MAX_FRAMES);
+    CHECK(burst_buffer_collect(&burst, camera_source, &cam, 10, 0, 1000) == 4, "%u frames", burst.count);
+    camera_stop(&cam);
+    CHECK(pool_in_use() == 0, "%u slabs held after a stall", pool_in_use());
+    printf("ok\n");
+    return 0;
+}
+
+static int test_overflow(void)
+{
+    static uint8_t region[1500 + GUARD];
+    burst_buffer_t burst;
+    camera_t cam;
+    uint32_t stopped = 0;
+
+    // Too small for the burst: collection stops at the first frame that
+    // does not fit, drops its reference and leaves the region intact
+    for (uint32_t first = 1; first <= 400; first++) {
+        memset(region, CANARY, sizeof(region));
+        camera_init(&cam, first, 100, 40000);
+        burst_buffer_init(&burst, region, 1500, BURST_MAX_FRAMES);
+        uint32_t n = burst_buffer_collect(&burst, camera_source, &cam, 20, 0, 1000);
+        camera_stop(&cam);
+
+        CHECK(n < 20 && n == burst.count, "seq %u: %u frames in 1500 bytes", first, n);
+        CHECK(burst.frames[n - 1].seq + 1 == cam.seq, "seq %u: stopped at %u, camera at %u", first,
+              burst.frames[n - 1].seq, cam.seq);
+        CHECK(burst.used + frame_len(cam.seq) > 1500, "seq %u: seq %u (%zu bytes) fits in %zu", first, cam.seq,
+              frame_len(cam.seq), 1500 - burst.used);
+        if (check_layout(&burst) != 0) {
+            return 1;
+        }
+        for (int i = 0; i < GUARD; i++) {
+            CHECK(region[1500 + i] == CANARY, "seq %u: written past the region at +%d", first, i);
+        }
+        CHECK(pool_in_use() == 0, "seq %u: %u slabs held", first, pool_in_use());
+        stopped += n;
+    }
+    printf("ok %u\n", stopped);
+    return 0;
+}
+
+// Back-to-back bursts into the same region, starting over at offset 0:
+// nothing from the previous burst may show through
+static int test_reuse(void)
+{
+    static uint8_t region[8 * 1024];
+    burst_buffer_t burst;
+    camera_t cam;
+    uint32_t frames = 0;
+
+    srand(34);
+    memset(region, CANARY, sizeof(region));
+    for (int round = 0; round < 2000; round++) {
+        size_t capacity = 512 + rand() % (sizeof(region) - 512);
+        uint32_t n = 1 + rand() % BURST_MAX_FRAMES;
+        uint32_t interval_ms = (uint32_t)(rand() % 4) * 50;
+
+        camera_init(&cam, 1 + rand() % 1000, 1 + rand() % 200, 33333);
+        if (rand() % 2) {
+            camera_capture(&cam);
+        }
+        burst_buffer_init(&burst, region, capacity, BURST_MAX_FRAMES);
+        uint32_t got = burst_buffer_collect(&burst, camera_source, &cam, n, interval_ms, 1000);
+        camera_stop(&cam);
+
+        CHECK(got <= n && burst.used <= capacity, "round %d: %u frames, %zu of %zu bytes", round, got,
+              burst.used, capacity);
+        CHECK(burst.frames_skipped + got <= cam.captured, "round %d: %u skipped, %u stored, %u captured", round,
+              burst.frames_skipped, got, cam.captured);
+        if (check_layout(&burst) != 0) {
+            return 1;
+        }
+        for (uint32_t i = 1; i < got; i++) {
+            int64_t gap = burst.frames[i].timestamp_us - burst.frames[i - 1].timestamp_us;
+            CHECK(gap >= (int64_t)interval_ms * 1000, "round %d: %lld us apart", round, (long long)gap);
+        }
+        CHECK(pool_in_use() == 0, "round %d: %u slabs held", round, pool_in_use());
+        frames += got;
+    }
+    printf("ok %u\n", frames);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (!frame_pool_init(&s_pool, s_slabs, SLAB_SIZE, SLABS)) {
+        printf("fail frame_pool_init\n");
+        return 1;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim append|collect|overflow|reuse\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "append") == 0) {
+        return test_append();
+    }
+    if (strcmp(argv[1], "collect") == 0) {
+        return test_collect();
+    }
+    if (strcmp(argv[1], "overflow") == 0) {
+        return test_overflow();
+    }
+    if (strcmp(argv[1], "reuse") == 0) {
+        return test_reuse();
+    }
+    fprintf(stderr, "usage: sim append|collect|overflow|reuse\n");
+    return 2;
+}
+EOF
+    gcc -std=c11 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/burst_buffer.c main/frame_pool.c \
+        -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the byte and frame limits
+test_append() {
+    print_test "Appending up to the byte and frame limits..."
+
+    run_sim append || return 1
+    print_pass "Region filled exactly, overflowing frames refused whole, nothing written past it"
+    return 0
+}
+
+# Test collection from the synthetic camera
+test_collect() {
+    print_test "Collecting bursts from a 25 fps camera..."
+
+    run_sim collect || return 1
+    print_pass "Consecutive and 100 ms bursts at the expected seqs and rate, early stop on a stall"
+    return 0
+}
+
+# Test a burst that outgrows the region
+test_overflow() {
+    print_test "Bursts larger than the region..."
+
+    run_sim overflow || return 1
+    print_pass "400 bursts stopped at the first frame that did not fit ($RESULT frames kept), no slab leaked"
+    return 0
+}
+
+# Test region reuse
+test_reuse() {
+    print_test "Back-to-back bursts reusing the region..."
+
+    run_sim reuse || return 1
+    print_pass "2000 bursts, $RESULT frames, all intact, contiguous from offset 0"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Burst Buffer Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_append test_collect test_overflow test_reuse; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,477 @@
+#!/bin/bash
+# Test script for the capture standby state machine
+# Usage: ./test_capture_demand.sh
+#
+# Drives main/capture_demand.c on a simulated millisecond clock: consumers
+# arrive and leave, the capture task polls it and delivers frames, and the
+# tests check when the sensor is suspended and resumed and what the resume
+# time measurements say.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "capture_demand.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IDLE_MS 30000
+#define TARGET_MS 300
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+static capture_demand_t d;
+
+// Polls once a millisecond from *now to until, as the capture task would
+// between frames; returns the first action and where it happened
+static capture_demand_action_t run_until(uint32_t *now, uint32_t until)
+{
+    while (*now != until) {
+        capture_demand_action_t action = capture_demand_poll(&d, *now);
+        if (action != CAPTURE_DEMAND_NONE) {
+            return action;
+        }
+        (*now)++;
+    }
+    return capture_demand_poll(&d, *now);
+}
+
+static int test_idle(void)
+{
+    uint32_t now = 1000;
+
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    capture_demand_action_t action = run_until(&now, 1000 + 2 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_SUSPEND, "no suspend without consumers");
+    CHECK(now == 1000 + IDLE_MS, "suspended after %lu ms", (unsigned long)(now - 1000));
+    CHECK(d.state == CAPTURE_DEMAND_STANDBY, "state %s", capture_demand_state_name(d.state));
+
+    // Nothing else happens in standby
+    action = run_until(&now, now + 10 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_NONE, "action %d in standby", action);
+    CHECK(capture_demand_standby_ms(&d, now) == 10 * IDLE_MS, "standby %llu ms",
+          (unsigned long long)capture_demand_standby_ms(&d, now));
+
+    // Never with idle_ms 0
+    capture_demand_init(&d, 0, TARGET_MS, 0);
+    now = 0;
+    action = run_until(&now, 10 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_NONE, "idle_ms 0 suspended");
+    printf("ok\n");
+    return 0;
+}
+
+static int test_holders(void)
+{
+    uint32_t now = 0;
+
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    now = 100;
+    CHECK(!capture_demand_acquire(&d, CAPTURE_CONSUMER_STREAM, now), "woke an active sensor");
+    CHECK(!capture_demand_acquire(&d, CAPTURE_CONSUMER_RECORDER, now), "woke an active sensor");
+    capture_demand_action_t action = run_until(&now, 10 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_NONE, "suspended with 2 holders");
+    CHECK(capture_demand_holders(&d) == 2, "%lu holders", (unsigned long)capture_demand_holders(&d));
+
+    capture_demand_release(&d, CAPTURE_CONSUMER_STREAM, now);
+    uint32_t released = now;
+    action = run_until(&now, now + 10 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_NONE, "suspended with the recorder holding");
+
+    // The idle time counts from the last release, not the first
+    capture_demand_release(&d, CAPTURE_CONSUMER_RECORDER, now);
+    released = now;
+    action = run_until(&now, now + 2 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_SUSPEND && now == released + IDLE_MS,
+          "suspended %lu ms after the last release", (unsigned long)(now - released));
+
+    // Releasing more than was acquired does not underflow
+    capture_demand_release(&d, CAPTURE_CONSUMER_STREAM, now);
+    CHECK(capture_demand_holders(&d) == 0, "%lu holders after extra release",
+          (unsigned long)capture_demand_holders(&d));
+    printf("ok\n");
+    return 0;
+}
+
+static int test_touch(void)
+{
+    uint32_t now = 0;
+
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    // A poller just inside idle_ms keeps the sensor running
+    for (int i = 0; i < 20; i++) {
+        capture_demand_action_t action = run_until(&now, now + IDLE_MS - 1);
+        CHECK(action == CAPTURE_DEMAND_NONE, "suspended between touches");
+        CHECK(!capture_demand_touch(&d, now), "touch woke an active sensor");
+    }
+    capture_demand_action_t action = run_until(&now, now + IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_SUSPEND, "no suspend after the last touch");
+    CHECK(d.stats.suspends == 1, "%lu suspends", (unsigned long)d.stats.suspends);
+    printf("ok\n");
+    return 0;
+}
+
+// Suspend, wake with wake(), let the capture task get its first frame after
+// frame_ms; returns 0 and the wake to frame time
+static int suspend_and_resume(uint32_t *now, int wake, uint32_t poll_ms, uint32_t frame_ms)
+{
+    capture_demand_action_t action = run_until(now, *now + 2 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_SUSPEND, "no suspend");
+    *now += 5000;
+
+    uint32_t woken = *now;
+    bool wake_up;
+    if (wake == 0) {
+        wake_up = capture_demand_touch(&d, *now);
+    } else {
+        wake_up = capture_demand_acquire(&d, CAPTURE_CONSUMER_STREAM, *now);
+        capture_demand_release(&d, CAPTURE_CONSUMER_STREAM, *now);
+    }
+    CHECK(wake_up, "standby not woken");
+    CHECK(!capture_demand_touch(&d, *now + 1), "second wake-up for one resume");
+
+    // The task notices after poll_ms
+    *now += poll_ms;
+    CHECK(capture_demand_poll(&d, *now) == CAPTURE_DEMAND_RESUME, "no resume");
+    CHECK(d.state == CAPTURE_DEMAND_RESUMING, "state %s", capture_demand_state_name(d.state));
+    CHECK(capture_demand_poll(&d, *now) == CAPTURE_DEMAND_NONE, "resumed twice");
+
+    *now += frame_ms;
+    bool slow = capture_demand_frame(&d, *now);
+    CHECK(d.state == CAPTURE_DEMAND_ACTIVE, "state %s", capture_demand_state_name(d.state));
+    CHECK(d.stats.last_resume_ms == *now - woken, "resume %lu ms, expected %lu",
+          (unsigned long)d.stats.last_resume_ms, (unsigned long)(*now - woken));
+    CHECK(slow == (*now - woken > TARGET_MS), "over target reported wrong");
+    CHECK(!capture_demand_frame(&d, *now + 1), "frame after the resume counted");
+    return 0;
+}
+
+static int test_resume(void)
+{
+    uint32_t now = 0;
+
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    // Touched, woken by a waiting task, fast sensor
+    if (suspend_and_resume(&now, 0, 0, 120) != 0) {
+        return 1;
+    }
+    // Acquired and released before the task even polled: still resumes
+    if (suspend_and_resume(&now, 1, 100, 150) != 0) {
+        return 1;
+    }
+    // Slow
+    if (suspend_and_resume(&now, 0, 10, 900) != 0) {
+        return 1;
+    }
+
+    // The reader that only touched gets a full idle period from its frame
+    uint32_t frame = now;
+    capture_demand_action_t action = run_until(&now, now + 2 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_SUSPEND && now == frame + IDLE_MS,
+          "suspended %lu ms after the resumed frame", (unsigned long)(now - frame));
+
+    CHECK(d.stats.suspends == 4 && d.stats.resumes == 3, "%lu suspends, %lu resumes",
+          (unsigned long)d.stats.suspends, (unsigned long)d.stats.resumes);
+    CHECK(d.stats.max_resume_ms == 910, "max %lu ms", (unsigned long)d.stats.max_resume_ms);
+    CHECK(d.stats.resume_ms_total == 120 + 250 + 910, "total %llu ms",
+          (unsigned long long)d.stats.resume_ms_total);
+    CHECK(d.stats.resumes_over_target == 1, "%lu over target",
+          (unsigned long)d.stats.resumes_over_target);
+    CHECK(d.stats.standby_ms == 3 * 5000 + 0 + 100 + 10, "standby %llu ms",
+          (unsigned long long)d.stats.standby_ms);
+    printf("ok %lu %lu %lu\n", (unsigned long)120, (unsigned long)250, (unsigned long)910);
+    return 0;
+}
+
+static int test_wrap(void)
+{
+    uint32_t now = UINT32_MAX - IDLE_MS / 2;
+
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    capture_demand_action_t action = run_until(&now, now + IDLE_MS - 1);
+    CHECK(action == CAPTURE_DEMAND_NONE, "suspended early across the wrap");
+    // Suspends on the next poll
+    if (suspend_and_resume(&now, 0, 0, 250) != 0) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static int test_restart(void)
+{
+    uint32_t now = 0;
+
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    CHECK(!capture_demand_restart(&d, now), "restart while running reported standby");
+
+    // Stopped in standby: the sensor has to be woken by start
+    run_until(&now, 2 * IDLE_MS);
+    now += 1000;
+    CHECK(capture_demand_restart(&d, now), "restart in standby not reported");
+    CHECK(d.state == CAPTURE_DEMAND_ACTIVE, "state %s", capture_demand_state_name(d.state));
+    CHECK(d.stats.standby_ms == 1000, "standby %llu ms", (unsigned long long)d.stats.standby_ms);
+
+    // Stopped while resuming: no frame will end the resume, restart does
+    run_until(&now, now + 2 * IDLE_MS);
+    capture_demand_touch(&d, now);
+    CHECK(capture_demand_poll(&d, now) == CAPTURE_DEMAND_RESUME, "no resume");
+    CHECK(!capture_demand_restart(&d, now), "restart while resuming reported standby");
+    CHECK(!capture_demand_frame(&d, now + 10) && d.stats.last_resume_ms == 0,
+          "frame after restart counted as a resume");
+
+    // A wake-up left pending is dropped, holders are kept
+    capture_demand_acquire(&d, CAPTURE_CONSUMER_RECORDER, now);
+    capture_demand_restart(&d, now);
+    CHECK(!d.wake_pending && capture_demand_holders(&d) == 1, "restart lost a holder");
+    capture_demand_action_t action = run_until(&now, now + 3 * IDLE_MS);
+    CHECK(action == CAPTURE_DEMAND_NONE, "suspended with a holder after restart");
+    printf("ok\n");
+    return 0;
+}
+
+// Random consumers against a model: never in standby with a holder, never
+// suspended early, every wake-up resumed on the next poll and ended by the
+// next frame
+static int test_random(void)
+{
+    uint32_t now = 0;
+    int holders[CAPTURE_CONSUMER_COUNT] = { 0 };
+    uint32_t last_demand = 0;
+    unsigned long suspends = 0, resumes = 0;
+
+    srand(49);
+    capture_demand_init(&d, IDLE_MS, TARGET_MS, now);
+    for (int step = 0; step < 200000; step++) {
+        now += rand() % 20000;
+        int consumer = rand() % CAPTURE_CONSUMER_COUNT;
+        switch (rand() % 8) {
+        case 0:
+            holders[consumer]++;
+            capture_demand_acquire(&d, consumer, now);
+            last_demand = now;
+            break;
+        case 1:
+        case 2:
+            if (holders[consumer] > 0) {
+                holders[consumer]--;
+                capture_demand_release(&d, consumer, now);
+                last_demand = now;
+            }
+            break;
+        case 3:
+            capture_demand_touch(&d, now);
+            last_demand = now;
+            break;
+        default:
+            break;
+        }
+
+        capture_demand_state_t before = d.state;
+        bool pending = d.wake_pending;
+        capture_demand_action_t action = capture_demand_poll(&d, now);
+        if (action == CAPTURE_DEMAND_SUSPEND) {
+            suspends++;
+            CHECK(holders[0] + holders[1] == 0, "suspended with holders");
+            CHECK(now - last_demand >= IDLE_MS, "suspended %lu ms after demand",
+                  (unsigned long)(now - last_demand));
+        } else if (action == CAPTURE_DEMAND_RESUME) {
+            resumes++;
+            CHECK(before == CAPTURE_DEMAND_STANDBY && pending, "resume without a wake-up");
+        } else {
+            CHECK(!(before == CAPTURE_DEMAND_STANDBY && pending), "wake-up not resumed");
+        }
+        CHECK(d.state != CAPTURE_DEMAND_STANDBY || d.wake_pending || holders[0] + holders[1] == 0,
+              "holder left waiting in standby");
+        CHECK(capture_demand_holders(&d) == (uint32_t)(holders[0] + holders[1]), "holder count off");
+
+        // The capture task delivers a frame whenever it is running
+        if (d.state != CAPTURE_DEMAND_STANDBY && rand() % 2) {
+            now += rand() % 400;
+            if (d.state == CAPTURE_DEMAND_RESUMING) {
+                last_demand = now;
+            }
+            capture_demand_frame(&d, now);
+            CHECK(d.state == CAPTURE_DEMAND_ACTIVE, "frame did not end the resume");
+        }
+    }
+    CHECK(d.stats.suspends == suspends && d.stats.resumes == resumes, "stats off");
+    CHECK(suspends > 100, "only %lu suspends", suspends);
+    printf("ok %lu %lu\n", suspends, resumes);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim idle|holders|touch|resume|wrap|restart|random\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "idle") == 0) {
+        return test_idle();
+    }
+    if (strcmp(argv[1], "holders") == 0) {
+        return test_holders();
+    }
+    if (strcmp(argv[1], "touch") == 0) {
+        return test_touch();
+    }
+    if (strcmp(argv[1], "resume") == 0) {
+        return test_resume();
+    }
+    if (strcmp(argv[1], "wrap") == 0) {
+        return test_wrap();
+    }
+    if (strcmp(argv[1], "restart") == 0) {
+        return test_restart();
+    }
+    if (strcmp(argv[1], "random") == 0) {
+        return test_random();
+    }
+    fprintf(stderr, "usage: sim idle|holders|touch|resume|wrap|restart|random\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/capture_demand.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test that the sensor is suspended exactly idle_ms after the last demand
+test_idle() {
+    print_test "Suspending without consumers..."
+
+    run_sim idle || return 1
+    print_pass "Suspended after 30000 ms, never with idle time 0"
+    return 0
+}
+
+# Test that holders keep the sensor running until the last one leaves
+test_holders() {
+    print_test "Holding the pipeline..."
+
+    run_sim holders || return 1
+    print_pass "Running while held, suspended 30000 ms after the last release"
+    return 0
+}
+
+# Test that one-shot readers keep it running while they keep coming
+test_touch() {
+    print_test "Polling /capture just inside the idle time..."
+
+    run_sim touch || return 1
+    print_pass "Running while polled, suspended once the polls stopped"
+    return 0
+}
+
+# Test the resume and its time to first frame
+test_resume() {
+    print_test "Resuming on demand..."
+
+    run_sim resume || return 1
+    read -r fast late slow <<< "$RESULT"
+    print_pass "Resumes measured at $fast, $late and $slow ms, the last over the 300 ms target"
+    return 0
+}
+
+# Test the idle and resume times across the 32-bit millisecond wrap
+test_wrap() {
+    print_test "Crossing the clock wrap..."
+
+    run_sim wrap || return 1
+    print_pass "Times right across the wrap"
+    return 0
+}
+
+# Test the capture task being stopped and started in each state
+test_restart() {
+    print_test "Restarting the capture task..."
+
+    run_sim restart || return 1
+    print_pass "Standby reported to start, resume and wake-ups dropped, holders kept"
+    return 0
+}
+
+# Test random consumers against the invariants
+test_random() {
+    print_test "Random consumers..."
+
+    run_sim random || return 1
+    read -r suspends resumes <<< "$RESULT"
+    print_pass "$suspends suspends, $resumes resumes, invariants held"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Capture Standby Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_idle test_holders test_touch test_resume test_wrap test_restart test_random; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,602 @@
+#!/bin/bash
+# Test script for the capture stall watchdog and its recovery ladder
+# Usage: ./test_capture_watchdog.sh
+#
+# Builds main/capture_watchdog.c and main/jpeg_check.c for the host and runs
+# them in a loop shaped like capture_task() against a fault-injecting mock
+# camera on a simulated clock. The mock fails captures the way the driver
+# does (a 4 s frame timeout), recovers only from the action that fixes its
+# fault and truncates frames at a high XCLK. Checks that the watchdog climbs
+# sensor reset (with a resync), driver reinit, restart in order, waits out
+# settle_ms between actions unless an action fails, retries once a minute
+# once it gives up, reports the real time to recovery, and that corrupt
+# frames are dropped and trigger the XCLK fallback instead of the watchdog.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per scenario. Prints "ok <actions>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "capture_watchdog.h"
+#include "jpeg_check.h"
+#include "jpeg_enc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+// Kconfig defaults and capture_pipeline.c constants
+#define STALL_MS 5000
+#define STALL_FAILURES 3
+#define SETTLE_MS 6000
+#define REINIT_ATTEMPTS 2
+#define FAILED_RETRY_MS 60000
+#define RETRY_DELAY_MS 100
+#define RESYNC_FRAMES 2
+#define CORRUPT_WINDOW 100
+#define FALLBACK_PERMILLE 20
+
+#define FRAME_MS 40
+#define FRAME_TIMEOUT_MS 4000   // esp_camera_fb_get() with no frame
+#define SENSOR_RESET_MS 50
+#define REINIT_MS 500
+#define XCLK_HZ 20000000
+#define XCLK_FALLBACK_HZ 10000000
+#define MAX_ACTIONS 32
+
+typedef enum {
+    FAULT_NONE,
+    FAULT_SENSOR,       // an SCCB reset clears it
+    FAULT_DRIVER,       // needs reinits_needed driver reinits
+    FAULT_DEAD,         // nothing helps until reseated
+} fault_t;
+
+typedef struct {
+    fault_t fault;
+    int reinits_needed;
+    bool init_fails;        // camera_init() errors while the fault lasts
+    bool reseated;          // FAULT_DEAD: the next reinit clears it
+    uint32_t xclk_hz;
+    uint16_t corrupt_permille; // above the fallback clock
+    uint32_t fault_at_ms;   // scenario time the fault starts
+} mock_camera_t;
+
+typedef struct {
+    capture_watchdog_action_t action;
+    uint32_t at_ms;
+} action_log_t;
+
+static mock_camera_t s_cam;
+static capture_watchdog_t s_wd;
+static jpeg_check_rate_t s_rate;
+static uint32_t s_now;
+static uint32_t s_start;
+static bool s_restarted;
+static action_log_t s_actions[MAX_ACTIONS];
+static int s_action_count;
+static uint32_t s_resync_skip;
+static uint32_t s_xclk_fallbacks;
+static uint32_t s_published;
+static uint32_t s_dropped_corrupt;
+static uint32_t s_last_published_ms;
+static uint32_t s_longest_gap_ms;   // between frames the camera delivered
+
+static uint8_t s_jpeg[4096];
+static size_t s_jpeg_len;
+static uint8_t s_frame[4096];
+
+static uint32_t elapsed(void)
+{
+    return s_now - s_start;
+}
+
+// esp_camera_fb_get(): a frame, possibly truncated, or NULL after the
+// driver's frame timeout
+static size_t mock_get_frame(void)
+{
+    if (s_cam.fault != FAULT_NONE && elapsed() >= s_cam.fault_at_ms) {
+        s_now += FRAME_TIMEOUT_MS;
+        return 0;
+    }
+    s_now += FRAME_MS;
+    memcpy(s_frame, s_jpeg, s_jpeg_len);
+    if (s_cam.xclk_hz > XCLK_FALLBACK_HZ && (uint32_t)(rand() % 1000) < s_cam.corrupt_permille) {
+        return 200 + rand() % (s_jpeg_len - 200);
+    }
+    return s_jpeg_len;
+}
+
+static bool mock_sensor_reset(void)
+{
+    s_now += SENSOR_RESET_MS;
+    if (s_cam.fault == FAULT_SENSOR) {
+        s_cam.fault = FAULT_NONE;
+    }
+    return true;
+}
+
+static bool mock_reinit(uint32_t xclk_hz)
+{
+    s_now += REINIT_MS;
+    s_cam.xclk_hz = xclk_hz;
+    if (s_cam.fault == FAULT_DRIVER && --s_cam.reinits_needed == 0) {
+        s_cam.fault = FAULT_NONE;
+    } else if (s_cam.fault == FAULT_DEAD && s_cam.reseated) {
+        s_cam.fault = FAULT_NONE;
+    }
+    return !(s_cam.init_fails && s_cam.fault != FAULT_NONE);
+}
+
+// capture_recover()
+static void recover(capture_watchdog_action_t action)
+{
+    bool ok = true;
+
+    if (s_action_count < MAX_ACTIONS) {
+        s_actions[s_action_count].action = action;
+        s_actions[s_action_count].at_ms = elapsed();
+        s_action_count++;
+    }
+    switch (action) {
+    case CAPTURE_WD_ACTION_SENSOR_RESET:
+        ok = mock_sensor_reset();
+        break;
+    case CAPTURE_WD_ACTION_REINIT:
+        ok = mock_reinit(s_cam.xclk_hz);
+        break;
+    case CAPTURE_WD_ACTION_RESTART:
+        s_restarted = true;
+        return;
+    default:
+        break;
+    }
+    s_resync_skip = RESYNC_FRAMES;
+    capture_watchdog_action_done(&s_wd, ok, s_now);
+}
+
+// One pass of capture_task()
+static void capture_step(void)
+{
+    size_t len = mock_get_frame();
+
+    if (len == 0) {
+        capture_watchdog_failure(&s_wd);
+        capture_watchdog_action_t action = capture_watchdog_poll(&s_wd, s_now);
+        if (action != CAPTURE_WD_ACTION_NONE) {
+            recover(action);
+        }
+        s_now += RETRY_DELAY_MS;
+        return;
+    }
+
+    if (s_now - s_last_published_ms > s_longest_gap_ms) {
+        s_longest_gap_ms = s_now - s_last_published_ms;
+    }
+    s_last_published_ms = s_now;
+    capture_watchdog_frame(&s_wd, s_now);
+    if (s_resync_skip > 0) {
+        s_resync_skip--;
+        return;
+    }
+
+    bool bad = jpeg_check(s_frame, len, true) != JPEG_CHECK_OK;
+    if (jpeg_check_rate_add(&s_rate, bad) && s_cam.xclk_hz > XCLK_FALLBACK_HZ) {
+        s_xclk_fallbacks++;
+        mock_reinit(XCLK_FALLBACK_HZ);
+        s_resync_skip = RESYNC_FRAMES;
+    }
+    if (bad) {
+        s_dropped_corrupt++;
+    } else {
+        s_published++;
+    }
+}
+
+static void run(const mock_camera_t *cam, bool allow_restart, uint32_t seconds)
+{
+    const capture_watchdog_config_t config = {
+        .stall_ms = STALL_MS,
+        .max_failures = STALL_FAILURES,
+        .settle_ms = SETTLE_MS,
+        .reinit_attempts = REINIT_ATTEMPTS,
+        .allow_restart = allow_restart,
+        .failed_retry_ms = FAILED_RETRY_MS,
+    };
+
+    // Start close to the 32-bit millisecond wrap, so every scenario crosses it
+    s_start = s_now = 0xffffffffu - 30000;
+    s_cam = *cam;
+    s_restarted = false;
+    s_action_count = 0;
+    s_resync_skip = 0;
+    s_xclk_fallbacks = 0;
+    s_published = 0;
+    s_dropped_corrupt = 0;
+    s_last_published_ms = s_now;
+    s_longest_gap_ms = 0;
+    capture_watchdog_init(&s_wd, &config, s_now);
+    jpeg_check_rate_init(&s_rate, CORRUPT_WINDOW, FALLBACK_PERMILLE);
+
+    while (!s_restarted && elapsed() < seconds * 1000) {
+        capture_step();
+    }
+}
+
+static const char *action_list(void)
+{
+    static char list[MAX_ACTIONS * 16];
+    list[0] = '\0';
+    for (int i = 0; i < s_action_count; i++) {
+        const char *name = s_actions[i].action == CAPTURE_WD_ACTION_SENSOR_RESET ? "reset" :
+                           s_actions[i].action == CAPTURE_WD_ACTION_REINIT ? "reinit" : "restart";
+        strcat(list, i ? "," : "");
+        strcat(list, name);
+    }
+    return list;
+}
+
+// Shared checks for a scenario that should end with the camera working
+static int check_recovered(const char *expected)
+{
+    CHECK(strcmp(action_list(), expected) == 0, "actions %s, expected %s", action_list(), expected);
+    CHECK(s_wd.state == CAPTURE_WD_OK && s_wd.stats.stalls == 1 && s_wd.stats.recoveries == 1,
+          "state %s, %u stalls, %u recoveries", capture_watchdog_state_name(s_wd.state), s_wd.stats.stalls,
+          s_wd.stats.recoveries);
+    // Time to recovery is the outage the clients saw
+    CHECK(s_wd.stats.last_recovery_ms == s_longest_gap_ms && s_wd.stats.max_recovery_ms == s_longest_gap_ms,
+          "time to recovery %u ms, max %u ms, longest gap %u ms", s_wd.stats.last_recovery_ms,
+          s_wd.stats.max_recovery_ms, s_longest_gap_ms);
+    for (int i = 1; i < s_action_count; i++) {
+        uint32_t gap = s_actions[i].at_ms - s_actions[i - 1].at_ms;
+        CHECK(gap >= SETTLE_MS, "action %d after %u ms, settle is %d ms", i, gap, SETTLE_MS);
+    }
+    CHECK(s_published > 100, "only %u frames after recovery", s_published);
+    return 0;
+}
+
+// A few failed captures below the threshold are not a stall
+static int test_transient(void)
+{
+    mock_camera_t cam = { .fault = FAULT_SENSOR, .xclk_hz = XCLK_FALLBACK_HZ, .fault_at_ms = 2000 };
+
+    run(&cam, true, 1);
+    s_cam.fault = FAULT_NONE;
+    for (int i = 0; i < 100; i++) {
+        capture_step();
+    }
+    s_cam.fault = FAULT_DRIVER;
+    s_cam.reinits_needed = 1;
+    capture_step();
+    s_cam.fault = FAULT_NONE;
+    for (int i = 0; i < 100; i++) {
+        capture_step();
+    }
+    CHECK(s_action_count == 0 && s_wd.stats.stalls == 0 && s_wd.stats.failures == 1,
+          "one failed capture: actions %s, %u stalls", action_list(), s_wd.stats.stalls);
+    printf("ok\n");
+    return 0;
+}
+
+static int test_sensor(void)
+{
+    mock_camera_t cam = { .fault = FAULT_SENSOR, .xclk_hz = XCLK_FALLBACK_HZ, .fault_at_ms = 2000 };
+
+    run(&cam, true, 30);
+    if (check_recovered("reset") != 0) {
+        return 1;
+    }
+    // Two driver timeouts make a stall, then one frame after the reset
+    CHECK(s_longest_gap_ms <= 2 * (FRAME_TIMEOUT_MS + RETRY_DELAY_MS) + SENSOR_RESET_MS + FRAME_MS,
+          "outage %u ms", s_longest_gap_ms);
+    printf("ok %s %u\n", action_list(), s_longest_gap_ms);
+    return 0;
+}
+
+static int test_driver(void)
+{
+    mock_camera_t cam = { .fault = FAULT_DRIVER, .reinits_needed = 2, .xclk_hz = XCLK_FALLBACK_HZ,
+                          .fault_at_ms = 2000 };
+
+    run(&cam, true, 60);
+    if (check_recovered("reset,reinit,reinit") != 0) {
+        return 1;
+    }
+    CHECK(!s_restarted && s_wd.stats.reinits == 2, "%u reinits", s_wd.stats.reinits);
+    uint32_t outage = s_longest_gap_ms;
+
+    // The next stall starts the ladder over
+    s_cam.fault = FAULT_DRIVER;
+    s_cam.reinits_needed = 2;
+    uint32_t until = elapsed() + 60000;
+    while (!s_restarted && elapsed() < until) {
+        capture_step();
+    }
+    CHECK(strcmp(action_list(), "reset,reinit,reinit,reset,reinit,reinit") == 0, "second stall: actions %s",
+          action_list());
+    CHECK(s_wd.state == CAPTURE_WD_OK && s_wd.stats.stalls == 2 && s_wd.stats.recoveries == 2,
+          "second stall: state %s, %u recoveries", capture_watchdog_state_name(s_wd.state), s_wd.stats.recoveries);
+    printf("ok reset,reinit,reinit %u\n", outage);
+    return 0;
+}
+
+static int test_restart(void)
+{
+    mock_camera_t cam = { .fault = FAULT_DEAD, .xclk_hz = XCLK_FALLBACK_HZ, .fault_at_ms = 2000 };
+
+    run(&cam, true, 120);
+    CHECK(s_restarted && strcmp(action_list(), "reset,reinit,reinit,restart") == 0, "actions %s",
+          action_list());
+    CHECK(s_wd.stats.restarts == 1 && s_wd.state == CAPTURE_WD_RECOVERING, "%u restarts, state %s",
+          s_wd.stats.restarts, capture_watchdog_state_name(s_wd.state));
+    printf("ok %s %u\n", action_list(), s_actions[s_action_count - 1].at_ms - cam.fault_at_ms);
+    return 0;
+}
+
+// Without restart: give up, then retry a reinit once a minute until the
+// sensor is reseated
+static int test_failed(void)
+{
+    mock_camera_t cam = { .fault = FAULT_DEAD, .xclk_hz = XCLK_FALLBACK_HZ, .fault_at_ms = 2000 };
+
+    run(&cam, false, 200);
+    CHECK(!s_restarted && s_wd.state == CAPTURE_WD_FAILED, "state %s", capture_watchdog_state_name(s_wd.state));
+    CHECK(strcmp(action_list(), "reset,reinit,reinit,reinit,reinit") == 0, "actions %s", action_list());
+    for (int i = 4; i < s_action_count; i++) {
+        uint32_t gap = s_actions[i].at_ms - s_actions[i - 1].at_ms;
+        CHECK(gap >= FAILED_RETRY_MS && gap < FAILED_RETRY_MS + 2 * FRAME_TIMEOUT_MS, "retry after %u ms", gap);
+    }
+
+    s_cam.reseated = true;
+    uint32_t until = elapsed() + 90000;
+    while (elapsed() < until) {
+        capture_step();
+    }
+    CHECK(s_wd.state == CAPTURE_WD_OK && s_wd.stats.recoveries == 1 && s_published > 100,
+          "after reseating: state %s, %u recoveries", capture_watchdog_state_name(s_wd.state),
+          s_wd.stats.recoveries);
+    CHECK(s_wd.stats.last_recovery_ms == s_longest_gap_ms, "time to recovery %u ms, outage %u ms",
+          s_wd.stats.last_recovery_ms, s_longest_gap_ms);
+    printf("ok %s %u\n", action_list(), s_longest_gap_ms);
+    return 0;
+}
+
+// A reinit that fails is escalated on the next failed capture, without
+// waiting out settle_ms
+static int test_init_fails(void)
+{
+    mock_camera_t cam = { .fault = FAULT_DEAD, .init_fails = true, .xclk_hz = XCLK_FALLBACK_HZ,
+                          .fault_at_ms = 2000 };
+
+    run(&cam, true, 120);
+    CHECK(s_restarted && strcmp(action_list(), "reset,reinit,reinit,restart") == 0, "actions %s",
+          action_list());
+    for (int i = 2; i < s_action_count; i++) {
+        uint32_t gap = s_actions[i].at_ms - s_actions[i - 1].at_ms;
+        CHECK(gap < SETTLE_MS, "action %d waited %u ms after a failed reinit", i, gap);
+    }
+    printf("ok %u\n", s_actions[s_action_count - 1].at_ms - s_actions[0].at_ms);
+    return 0;
+}
+
+// Corrupt frames still prove the sensor is alive: no watchdog action, but
+// none of them reach clients and the clock falls back after one window
+static int test_corrupt(void)
+{
+    mock_camera_t cam = { .xclk_hz = XCLK_HZ, .corrupt_permille = 100 };
+
+    run(&cam, true, 60);
+    CHECK(s_action_count == 0 && s_wd.stats.stalls == 0, "actions %s", action_list());
+    CHECK(s_xclk_fallbacks == 1 && s_cam.xclk_hz == XCLK_FALLBACK_HZ, "%u fallbacks, %u Hz", s_xclk_fallbacks,
+          s_cam.xclk_hz);
+    CHECK(s_dropped_corrupt > 0 && s_dropped_corrupt < CORRUPT_WINDOW, "%u corrupt frames dropped",
+          s_dropped_corrupt);
+    CHECK(s_published > 1000, "%u frames published", s_published);
+    printf("ok %u %u\n", s_dropped_corrupt, s_published);
+    return 0;
+}
+
+// A sensor hung at the high clock: reset with resync, reinit, then the
+// corrupt frames after the reinit bring the clock down
+static int test_ladder(void)
+{
+    mock_camera_t cam = { .fault = FAULT_DRIVER, .reinits_needed = 1, .xclk_hz = XCLK_HZ,
+                          .corrupt_permille = 100, .fault_at_ms = 2000 };
+
+    run(&cam, true, 60);
+    if (check_recovered("reset,reinit") != 0) {
+        return 1;
+    }
+    CHECK(s_xclk_fallbacks == 1 && s_cam.xclk_hz == XCLK_FALLBACK_HZ, "%u fallbacks, %u Hz", s_xclk_fallbacks,
+          s_cam.xclk_hz);
+    printf("ok %s,xclk %u\n", action_list(), s_longest_gap_ms);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        int (*fn)(void);
+    } tests[] = {
+        { "transient", test_transient },
+        { "sensor", test_sensor },
+        { "driver", test_driver },
+        { "restart", test_restart },
+        { "failed", test_failed },
+        { "init_fails", test_init_fails },
+        { "corrupt", test_corrupt },
+        { "ladder", test_ladder },
+    };
+    static uint8_t image[64 * 48];
+    jpeg_enc_t enc;
+
+    for (size_t i = 0; i < sizeof(image); i++) {
+        image[i] = (uint8_t)((i % 64) * 3 + (i / 64) * 2);
+    }
+    jpeg_enc_init(&enc, 75);
+    s_jpeg_len = jpeg_enc_encode(&enc, image, 64, 48, 0, JPEG_ENC_GRAYSCALE, s_jpeg, sizeof(s_jpeg));
+    if (s_jpeg_len == 0 || jpeg_check(s_jpeg, s_jpeg_len, true) != JPEG_CHECK_OK) {
+        printf("fail test frame\n");
+        return 1;
+    }
+
+    srand(40);
+    for (size_t i = 0; argc > 1 && i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (strcmp(argv[1], tests[i].name) == 0) {
+            return tests[i].fn();
+        }
+    }
+    fprintf(stderr, "usage: sim transient|sensor|driver|restart|failed|init_fails|corrupt|ladder\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Wextra -Werror -I main "$WORK_DIR/sim.c" main/capture_watchdog.c main/jpeg_check.c \
+        main/jpeg_enc.c -lm -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+test_transient() {
+    print_test "Single failed captures..."
+
+    run_sim transient || return 1
+    print_pass "No stall declared below the failure threshold"
+    return 0
+}
+
+test_sensor() {
+    print_test "Sensor hang cleared by an SCCB reset..."
+
+    run_sim sensor || return 1
+    read -r actions outage <<< "$RESULT"
+    print_pass "$actions, frames back after $outage ms, reported as the time to recovery"
+    return 0
+}
+
+test_driver() {
+    print_test "Driver hangs that take two reinits, twice..."
+
+    run_sim driver || return 1
+    read -r actions outage <<< "$RESULT"
+    print_pass "$actions, settle time between each, frames back after $outage ms"
+    return 0
+}
+
+test_restart() {
+    print_test "Dead sensor with restart allowed..."
+
+    run_sim restart || return 1
+    read -r actions after <<< "$RESULT"
+    print_pass "$actions, restart requested $after ms into the outage"
+    return 0
+}
+
+test_failed() {
+    print_test "Dead sensor without restart, reseated later..."
+
+    run_sim failed || return 1
+    read -r actions outage <<< "$RESULT"
+    print_pass "$actions, then once a minute; recovered after $outage ms"
+    return 0
+}
+
+test_init_fails() {
+    print_test "Reinits that fail..."
+
+    run_sim init_fails || return 1
+    print_pass "Escalated without waiting out settle time, restart $RESULT ms after the reset"
+    return 0
+}
+
+test_corrupt() {
+    print_test "Corrupt frames at 20 MHz XCLK..."
+
+    run_sim corrupt || return 1
+    read -r dropped published <<< "$RESULT"
+    print_pass "$dropped corrupt frames dropped, XCLK fallback after one window, no watchdog action,\
+ $published frames published"
+    return 0
+}
+
+test_ladder() {
+    print_test "Sensor hung at 20 MHz, corrupt after the reinit..."
+
+    run_sim ladder || return 1
+    read -r actions outage <<< "$RESULT"
+    print_pass "$actions, frames back after $outage ms"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Capture Watchdog Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_transient test_sensor test_driver test_restart test_failed test_init_fails test_corrupt \
+        test_ladder; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
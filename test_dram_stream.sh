@@ -0,0 +1,705 @@
+#!/bin/bash
+# Test script for the DRAM stream's frame fan-out
+# Usage: ./test_dram_stream.sh
+#
+# Builds main/frame_fanout.c for the host and runs the send loop of the
+# dram_tx task over socketpairs with small send buffers: every frame is
+# written to all clients at once with non-blocking sends, each part carrying
+# the frame's Content-Length, while reader threads drain the other ends at
+# their own pace. Fast readers must get every frame intact, a slow one must
+# miss frames rather than hold up the others, and one that stops reading
+# must be disconnected within the send timeout.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#define _DEFAULT_SOURCE
+#include "frame_fanout.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// As in video_stream.h
+#define STREAM_BOUNDARY "\r\n--123456789000000000000987654321\r\n"
+#define STREAM_PART "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n"
+#define RESPONSE_HEADER "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace\r\n\r\n"
+
+#define CLIENTS 3
+#define FRAME_MAX 16000
+#define FRAME_INTERVAL_MS 20
+#define SEND_TIMEOUT_MS 300
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+typedef enum {
+    CLIENT_NONE,
+    CLIENT_NEW,
+    CLIENT_LIVE,
+    CLIENT_CLOSED,
+} client_state_t;
+
+typedef struct {
+    client_state_t state;
+    int fd;
+    uint32_t last_sent_ms;
+    uint32_t closed_ms;
+} client_t;
+
+typedef struct {
+    int fd;
+    uint32_t rate_bps;          // 0 reads as fast as possible
+    uint32_t stop_after;        // stop reading after this many frames, 0 never
+    uint32_t start_ms;
+    uint32_t bytes;
+    uint32_t frames;
+    uint32_t last_seq;
+    uint32_t last_frame_ms;
+    uint32_t gaps;              // frames missed between two received ones
+    int errors;
+    char error[128];
+} reader_t;
+
+static frame_fanout_t fanout;
+static client_t clients[CLIENTS];
+static uint8_t frame[FRAME_MAX];
+static uint32_t frames_skipped, client_drops, send_ms_max;
+static uint64_t bytes_sent;
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void sleep_ms(uint32_t ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// Frame seq: its length varies, and every byte is stamped with seq
+static size_t make_frame(uint32_t seq)
+{
+    size_t len = 9000 + (seq * 1237) % (FRAME_MAX - 9000);
+    for (size_t i = 0; i < len; i++) {
+        frame[i] = (uint8_t)(seq * 7 + i);
+    }
+    return len;
+}
+
+static int read_exact(reader_t *r, uint8_t *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(r->fd, buf + got, len - got);
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+        r->bytes += n;
+        // Throttle: stay behind rate_bps since the first read
+        while (r->rate_bps && (uint64_t)r->bytes * 1000 / r->rate_bps > now_ms() - r->start_ms) {
+            sleep_ms(1);
+        }
+    }
+    return 0;
+}
+
+static int read_line(reader_t *r, char *line, size_t size)
+{
+    size_t n = 0;
+    while (n < size - 1) {
+        if (read_exact(r, (uint8_t *)&line[n], 1) != 0) {
+            return -1;
+        }
+        if (line[n++] == '\n') {
+            break;
+        }
+    }
+    line[n] = '\0';
+    return 0;
+}
+
+#define READER_FAIL(r, ...) do { \
+        snprintf((r)->error, sizeof((r)->error), __VA_ARGS__); \
+        (r)->errors++; \
+        return NULL; \
+    } while (0)
+
+// Reads the response header, then parts delimited by the boundary, each
+// taken by its Content-Length
+static void *reader(void *arg)
+{
+    reader_t *r = arg;
+    static __thread uint8_t body[FRAME_MAX];
+    char line[128];
+
+    do {
+        if (read_line(r, line, sizeof(line)) != 0) {
+            return NULL;
+        }
+    } while (strcmp(line, "\r\n") != 0);
+
+    while (r->stop_after == 0 || r->frames < r->stop_after) {
+        unsigned len = 0;
+        if (read_line(r, line, sizeof(line)) != 0) {
+            return NULL;
+        }
+        if (strcmp(line, "\r\n") != 0 || read_line(r, line, sizeof(line)) != 0 ||
+            strncmp(line, "--", 2) != 0) {
+            READER_FAIL(r, "frame %u not followed by a boundary", (unsigned)r->last_seq);
+        }
+        for (;;) {
+            if (read_line(r, line, sizeof(line)) != 0) {
+                return NULL;
+            }
+            if (strcmp(line, "\r\n") == 0) {
+                break;
+            }
+            sscanf(line, "Content-Length: %u", &len);
+        }
+        if (len == 0 || len > FRAME_MAX) {
+            READER_FAIL(r, "part after frame %u without a usable Content-Length", (unsigned)r->last_seq);
+        }
+        if (read_exact(r, body, len) != 0) {
+            return NULL;
+        }
+        // The stamp gives the frame number; its length and every byte must match
+        uint32_t seq;
+        for (seq = r->last_seq + 1; seq < r->last_seq + 1000; seq++) {
+            if ((uint8_t)(seq * 7) == body[0] && (uint8_t)(seq * 7 + 1) == body[1] &&
+                9000 + (seq * 1237) % (FRAME_MAX - 9000) == len) {
+                break;
+            }
+        }
+        for (unsigned i = 0; i < len; i++) {
+            if (body[i] != (uint8_t)(seq * 7 + i)) {
+                READER_FAIL(r, "%u byte part after frame %u corrupt at byte %u", len, (unsigned)r->last_seq, i);
+            }
+        }
+        r->gaps += seq - r->last_seq - 1;
+        r->last_seq = seq;
+        r->last_frame_ms = now_ms();
+        r->frames++;
+    }
+    // Stop reading but keep the socket open, like a frozen browser tab
+    sleep_ms(60000);
+    return NULL;
+}
+
+static bool writable(int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLOUT);
+}
+
+static void client_close(client_t *client, uint32_t now)
+{
+    shutdown(client->fd, SHUT_RDWR);
+    close(client->fd);
+    client->state = CLIENT_CLOSED;
+    client->closed_ms = now;
+    client_drops++;
+}
+
+// dram_stream_select(), dram_stream_write() and dram_stream_send() for one
+// frame
+static void send_frame(uint32_t seq)
+{
+    size_t len = make_frame(seq);
+    uint32_t start = now_ms();
+    char hdr[FRAME_FANOUT_HDR_LEN];
+
+    frame_fanout_begin(&fanout, frame, len, start, SEND_TIMEOUT_MS);
+    for (int i = 0; i < CLIENTS; i++) {
+        client_t *client = &clients[i];
+        if (client->state != CLIENT_NEW && client->state != CLIENT_LIVE) {
+            continue;
+        }
+        if (client->state == CLIENT_LIVE && !writable(client->fd)) {
+            if (start - client->last_sent_ms >= SEND_TIMEOUT_MS) {
+                client_close(client, start);
+            } else {
+                frames_skipped++;
+            }
+            continue;
+        }
+        int hdr_len;
+        if (client->state == CLIENT_NEW) {
+            hdr_len = snprintf(hdr, sizeof(hdr), RESPONSE_HEADER STREAM_BOUNDARY STREAM_PART, (unsigned)len);
+        } else {
+            hdr_len = snprintf(hdr, sizeof(hdr), STREAM_BOUNDARY STREAM_PART, (unsigned)len);
+        }
+        if (frame_fanout_add(&fanout, i, hdr, hdr_len)) {
+            client->state = CLIENT_LIVE;
+        }
+    }
+
+    while (fanout.sending > 0) {
+        struct pollfd pfds[CLIENTS];
+        int n = 0;
+        for (int i = 0; i < CLIENTS; i++) {
+            const uint8_t *data;
+            size_t pending = frame_fanout_pending(&fanout, i, &data);
+            if (pending == 0) {
+                continue;
+            }
+            ssize_t sent = send(clients[i].fd, data, pending, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent > 0) {
+                frame_fanout_wrote(&fanout, i, sent);
+            } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                frame_fanout_fail(&fanout, i);
+            }
+            if (frame_fanout_state(&fanout, i) == FRAME_FANOUT_SENDING) {
+                pfds[n].fd = clients[i].fd;
+                pfds[n].events = POLLOUT;
+                n++;
+            }
+        }
+        uint32_t now = now_ms();
+        if (fanout.sending == 0 || frame_fanout_expire(&fanout, now) > 0) {
+            break;
+        }
+        poll(pfds, n, frame_fanout_remaining(&fanout, now));
+    }
+
+    uint32_t now = now_ms();
+    for (int i = 0; i < CLIENTS; i++) {
+        frame_fanout_state_t state = frame_fanout_state(&fanout, i);
+        if (state == FRAME_FANOUT_DONE) {
+            clients[i].last_sent_ms = now;
+        } else if (state == FRAME_FANOUT_FAILED) {
+            client_close(&clients[i], now);
+        }
+    }
+    bytes_sent += fanout.bytes;
+    if (now - start > send_ms_max) {
+        send_ms_max = now - start;
+    }
+}
+
+// Connects a reader per entry of rates/stops, sends frames frames at
+// FRAME_INTERVAL_MS and lets the readers finish
+static int run(int count, const uint32_t *rates, const uint32_t *stops, uint32_t frames, reader_t *readers,
+               uint32_t *elapsed_ms)
+{
+    int sndbuf = 8192;
+
+    memset(clients, 0, sizeof(clients));
+    frames_skipped = client_drops = send_ms_max = 0;
+    bytes_sent = 0;
+    for (int i = 0; i < count; i++) {
+        int sv[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair: %s", strerror(errno));
+        setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+        clients[i].state = CLIENT_NEW;
+        clients[i].fd = sv[0];
+
+        reader_t *r = &readers[i];
+        memset(r, 0, sizeof(*r));
+        r->fd = sv[1];
+        r->rate_bps = rates[i];
+        r->stop_after = stops[i];
+        r->start_ms = now_ms();
+        pthread_t thread;
+        pthread_create(&thread, NULL, reader, r);
+        pthread_detach(thread);
+    }
+
+    uint32_t start = now_ms();
+    for (uint32_t seq = 1; seq <= frames; seq++) {
+        send_frame(seq);
+        // The next frame is captured FRAME_INTERVAL_MS after this one was
+        // handed over, or right away if sending took longer
+        uint32_t due = start + seq * FRAME_INTERVAL_MS;
+        if ((int32_t)(due - now_ms()) > 0) {
+            sleep_ms(due - now_ms());
+        }
+    }
+    *elapsed_ms = now_ms() - start;
+    for (int i = 0; i < count; i++) {
+        if (clients[i].state == CLIENT_LIVE || clients[i].state == CLIENT_NEW) {
+            shutdown(clients[i].fd, SHUT_WR);
+        }
+    }
+    // Let the readers finish the bytes still in flight
+    sleep_ms(200);
+    for (int i = 0; i < count; i++) {
+        CHECK(readers[i].errors == 0, "reader %d: %s", i, readers[i].error);
+    }
+    return 0;
+}
+
+static int test_fanout(void)
+{
+    static const uint8_t body[10] = "0123456789";
+    frame_fanout_t f;
+    const uint8_t *data;
+
+    frame_fanout_begin(&f, body, sizeof(body), 1000, 300);
+    CHECK(frame_fanout_add(&f, 1, "abc", 3) && frame_fanout_add(&f, 4, "wxyz", 4), "add failed");
+    CHECK(!frame_fanout_add(&f, FRAME_FANOUT_MAX, "a", 1) && !frame_fanout_add(&f, -1, "a", 1),
+          "slot out of range accepted");
+    CHECK(!frame_fanout_add(&f, 2, (const char *)body, FRAME_FANOUT_HDR_LEN + 1), "oversized header accepted");
+    CHECK(f.sending == 2, "%u sending after two adds", f.sending);
+    CHECK(frame_fanout_pending(&f, 0, &data) == 0 && data == NULL, "idle slot has data pending");
+
+    // Header first, then the body, across a write that spans both
+    CHECK(frame_fanout_pending(&f, 1, &data) == 3 && memcmp(data, "abc", 3) == 0, "header not pending");
+    frame_fanout_wrote(&f, 1, 2);
+    CHECK(frame_fanout_pending(&f, 1, &data) == 1 && *data == 'c', "rest of the header not pending");
+    frame_fanout_wrote(&f, 1, 5);
+    CHECK(frame_fanout_pending(&f, 1, &data) == 6 && data == body + 4, "body offset wrong after a spanning write");
+    frame_fanout_wrote(&f, 1, 100);
+    CHECK(frame_fanout_state(&f, 1) == FRAME_FANOUT_DONE && f.sending == 1, "slot not done after its last byte");
+    CHECK(frame_fanout_pending(&f, 1, &data) == 0, "done slot has data pending");
+    CHECK(f.bytes == 13, "%lu bytes counted for a 13 byte part", (unsigned long)f.bytes);
+
+    // Re-adding a sending slot starts it over without counting it twice
+    frame_fanout_wrote(&f, 4, 6);
+    CHECK(frame_fanout_add(&f, 4, "wxyz", 4) && f.sending == 1, "%u sending after re-add", f.sending);
+    CHECK(frame_fanout_pending(&f, 4, &data) == 4, "re-added slot did not start over");
+
+    // The deadline fails what is still sending and nothing else
+    CHECK(frame_fanout_remaining(&f, 1100) == 200, "%lu ms remaining", (unsigned long)frame_fanout_remaining(&f, 1100));
+    CHECK(frame_fanout_expire(&f, 1299) == 0, "expired before the deadline");
+    CHECK(frame_fanout_expire(&f, 1300) == 1, "deadline did not fail the sending slot");
+    CHECK(frame_fanout_state(&f, 4) == FRAME_FANOUT_FAILED && frame_fanout_state(&f, 1) == FRAME_FANOUT_DONE,
+          "wrong slots failed");
+    CHECK(f.sending == 0 && frame_fanout_remaining(&f, 1400) == 0, "deadline not passed");
+    frame_fanout_wrote(&f, 4, 3);
+    CHECK(f.bytes == 19, "write to a failed slot counted");
+
+    // A new frame clears every slot
+    frame_fanout_begin(&f, body, sizeof(body), 2000, 300);
+    for (int i = 0; i < FRAME_FANOUT_MAX; i++) {
+        CHECK(frame_fanout_state(&f, i) == FRAME_FANOUT_IDLE, "slot %d not idle", i);
+    }
+    CHECK(f.sending == 0 && f.bytes == 0, "counters not reset");
+    printf("ok\n");
+    return 0;
+}
+
+static int test_fast(void)
+{
+    static const uint32_t rates[CLIENTS] = { 0, 0, 0 };
+    static const uint32_t stops[CLIENTS] = { 0, 0, 0 };
+    reader_t readers[CLIENTS];
+    uint32_t elapsed;
+    uint64_t bytes_read = 0;
+
+    if (run(CLIENTS, rates, stops, 100, readers, &elapsed) != 0) {
+        return 1;
+    }
+    for (int i = 0; i < CLIENTS; i++) {
+        CHECK(readers[i].frames == 100 && readers[i].gaps == 0, "reader %d got %lu frames, %lu missed", i,
+              (unsigned long)readers[i].frames, (unsigned long)readers[i].gaps);
+        bytes_read += readers[i].bytes;
+    }
+    CHECK(frames_skipped == 0 && client_drops == 0, "%lu skipped, %lu dropped", (unsigned long)frames_skipped,
+          (unsigned long)client_drops);
+    CHECK(bytes_sent == bytes_read, "%llu bytes counted, %llu read", (unsigned long long)bytes_sent,
+          (unsigned long long)bytes_read);
+    CHECK(send_ms_max < 100, "a frame took %lu ms", (unsigned long)send_ms_max);
+    printf("ok %lu\n", (unsigned long)send_ms_max);
+    return 0;
+}
+
+static int test_slow(void)
+{
+    // 200 kB/s against about 600 kB/s of frames
+    static const uint32_t rates[CLIENTS] = { 0, 200000, 0 };
+    static const uint32_t stops[CLIENTS] = { 0, 0, 0 };
+    reader_t readers[CLIENTS];
+    uint32_t elapsed;
+
+    if (run(CLIENTS, rates, stops, 100, readers, &elapsed) != 0) {
+        return 1;
+    }
+    CHECK(client_drops == 0, "slow reader dropped");
+    uint32_t missed = readers[1].gaps + 100 - readers[1].last_seq;
+    CHECK(frames_skipped > 0 && missed == frames_skipped, "%lu frames skipped, slow reader missed %lu",
+          (unsigned long)frames_skipped, (unsigned long)missed);
+    CHECK(readers[1].frames > 10, "slow reader got only %lu frames", (unsigned long)readers[1].frames);
+    CHECK(readers[0].frames == 100 && readers[2].frames == 100, "fast readers got %lu and %lu frames",
+          (unsigned long)readers[0].frames, (unsigned long)readers[2].frames);
+    // A frame waits at most for the slow reader to take one frame, never
+    // for it to drain a backlog
+    CHECK(send_ms_max < SEND_TIMEOUT_MS / 2, "a frame took %lu ms", (unsigned long)send_ms_max);
+    printf("ok %lu %lu %lu\n", (unsigned long)readers[1].frames, (unsigned long)frames_skipped,
+           (unsigned long)send_ms_max);
+    return 0;
+}
+
+static int test_stall(void)
+{
+    // The middle reader stops reading after 5 frames
+    static const uint32_t rates[CLIENTS] = { 0, 0, 0 };
+    static const uint32_t stops[CLIENTS] = { 0, 5, 0 };
+    reader_t readers[CLIENTS];
+    uint32_t elapsed;
+
+    if (run(CLIENTS, rates, stops, 100, readers, &elapsed) != 0) {
+        return 1;
+    }
+    CHECK(client_drops == 1 && clients[1].state == CLIENT_CLOSED, "stopped reader not disconnected");
+    uint32_t detected = clients[1].closed_ms - readers[1].last_frame_ms;
+    CHECK(detected <= 2 * SEND_TIMEOUT_MS + 100, "disconnected %lu ms after its last frame",
+          (unsigned long)detected);
+    CHECK(send_ms_max <= SEND_TIMEOUT_MS + 50, "a frame took %lu ms", (unsigned long)send_ms_max);
+    CHECK(readers[0].frames == 100 && readers[0].gaps == 0 && readers[2].frames == 100 && readers[2].gaps == 0,
+          "fast readers got %lu and %lu frames", (unsigned long)readers[0].frames, (unsigned long)readers[2].frames);
+    // The frames it held up cost one send timeout, not one per frame
+    CHECK(elapsed < 100 * FRAME_INTERVAL_MS + SEND_TIMEOUT_MS + 300, "100 frames took %lu ms",
+          (unsigned long)elapsed);
+    printf("ok %lu %lu\n", (unsigned long)detected, (unsigned long)send_ms_max);
+    return 0;
+}
+
+// A socket still full at the start of a frame misses it, and is dropped once
+// it has been full for the send timeout
+static int test_full(void)
+{
+    static uint8_t fill[4096];
+    int sv[2];
+    int sndbuf = 8192;
+
+    memset(clients, 0, sizeof(clients));
+    frames_skipped = client_drops = 0;
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair: %s", strerror(errno));
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+    while (send(sv[0], fill, sizeof(fill), MSG_DONTWAIT) > 0) {
+    }
+
+    uint32_t start = now_ms();
+    clients[0].state = CLIENT_LIVE;
+    clients[0].fd = sv[0];
+    clients[0].last_sent_ms = start;
+    send_frame(1);
+    send_frame(2);
+    CHECK(frames_skipped == 2 && client_drops == 0 && clients[0].state == CLIENT_LIVE,
+          "%lu skipped, %lu dropped", (unsigned long)frames_skipped, (unsigned long)client_drops);
+    CHECK(now_ms() - start < 50, "skipping took %lu ms", (unsigned long)(now_ms() - start));
+    clients[0].last_sent_ms = start - SEND_TIMEOUT_MS;
+    send_frame(3);
+    CHECK(client_drops == 1 && clients[0].state == CLIENT_CLOSED, "client full for the send timeout kept");
+    close(sv[1]);
+    printf("ok\n");
+    return 0;
+}
+
+// A socket that fills up in the middle of a frame fails it at the deadline,
+// while a reader on another socket gets the frame right away
+static int test_deadline(void)
+{
+    int stuck[2], live[2];
+    int sndbuf = 1;
+    static reader_t r;
+
+    memset(clients, 0, sizeof(clients));
+    client_drops = send_ms_max = 0;
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, stuck) == 0 && socketpair(AF_UNIX, SOCK_STREAM, 0, live) == 0,
+          "socketpair: %s", strerror(errno));
+    // The smallest buffer the kernel allows, well below one frame
+    setsockopt(stuck[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    setsockopt(stuck[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+    clients[0].state = CLIENT_NEW;
+    clients[0].fd = stuck[0];
+    clients[1].state = CLIENT_NEW;
+    clients[1].fd = live[0];
+    memset(&r, 0, sizeof(r));
+    r.fd = live[1];
+    pthread_t thread;
+    pthread_create(&thread, NULL, reader, &r);
+    pthread_detach(thread);
+
+    uint32_t start = now_ms();
+    send_frame(1);
+    CHECK(clients[0].state == CLIENT_CLOSED && client_drops == 1, "stuck client not dropped");
+    CHECK(send_ms_max >= SEND_TIMEOUT_MS && send_ms_max <= SEND_TIMEOUT_MS + 50, "frame took %lu ms",
+          (unsigned long)send_ms_max);
+    CHECK(clients[1].state == CLIENT_LIVE, "live client dropped");
+    sleep_ms(50);
+    CHECK(r.errors == 0, "%s", r.error);
+    CHECK(r.frames == 1 && r.last_frame_ms - start < 50, "live reader got %lu frames after %lu ms",
+          (unsigned long)r.frames, (unsigned long)(r.last_frame_ms - start));
+    printf("ok %lu %lu\n", (unsigned long)send_ms_max, (unsigned long)(r.last_frame_ms - start));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim fanout|fast|slow|stall|full|deadline\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "fanout") == 0) {
+        return test_fanout();
+    }
+    if (strcmp(argv[1], "fast") == 0) {
+        return test_fast();
+    }
+    if (strcmp(argv[1], "slow") == 0) {
+        return test_slow();
+    }
+    if (strcmp(argv[1], "stall") == 0) {
+        return test_stall();
+    }
+    if (strcmp(argv[1], "full") == 0) {
+        return test_full();
+    }
+    if (strcmp(argv[1], "deadline") == 0) {
+        return test_deadline();
+    }
+    fprintf(stderr, "usage: sim fanout|fast|slow|stall|full|deadline\n");
+    return 2;
+}
+EOF
+    gcc -std=gnu11 -O2 -Wall -Werror -pthread -I main "$WORK_DIR/sim.c" main/frame_fanout.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the per-client offsets and the deadline on their own
+test_fanout() {
+    print_test "Header and body offsets, byte count and deadline..."
+
+    run_sim fanout || return 1
+    print_pass "Header then body written per slot, only the slots still sending failed at the deadline"
+    return 0
+}
+
+# Test readers that keep up
+test_fast() {
+    print_test "Three readers keeping up with 50 fps..."
+
+    run_sim fast || return 1
+    print_pass "Every frame read intact by its Content-Length, \
+slowest frame handed back after $RESULT ms"
+    return 0
+}
+
+# Test a throttled reader next to two fast ones
+test_slow() {
+    print_test "One reader throttled to 200 kB/s..."
+
+    run_sim slow || return 1
+    read -r frames skipped worst <<< "$RESULT"
+    print_pass "Slow reader got $frames frames and missed $skipped, \
+fast readers got all, slowest frame $worst ms"
+    return 0
+}
+
+# Test a reader that stops reading
+test_stall() {
+    print_test "Reader that stops reading..."
+
+    run_sim stall || return 1
+    read -r detected worst <<< "$RESULT"
+    print_pass "Disconnected $detected ms after its last frame, \
+slowest frame $worst ms, other readers got every frame"
+    return 0
+}
+
+# Test a socket that is full when a frame starts
+test_full() {
+    print_test "Socket full at the start of a frame..."
+
+    run_sim full || return 1
+    print_pass "Frames skipped without waiting, client dropped once full for the send timeout"
+    return 0
+}
+
+# Test a socket that fills up in the middle of a frame
+test_deadline() {
+    print_test "Socket full in the middle of a frame..."
+
+    run_sim deadline || return 1
+    read -r worst live <<< "$RESULT"
+    print_pass "Client dropped at the deadline after $worst ms, \
+the other reader had the frame after $live ms"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera DRAM Stream Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_fanout test_fast test_slow test_stall test_full test_deadline; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
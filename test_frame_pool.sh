@@ -0,0 +1,502 @@
+#!/bin/bash
+# Test script for the refcounted frame pool
+# Usage: ./test_frame_pool.sh
+#
+# Builds main/frame_pool.c for the host and hammers it from several pthreads:
+# threads racing on the CAS free bitmap must never be handed the same slab,
+# consumers holding references to published frames must never see their slab
+# recycled under them, and when everything is released the pool must be full
+# again. Also reports the cost of an alloc/release pair.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_stress() {
+    cat > "$WORK_DIR/stress.c" <<'EOF'
+#define _POSIX_C_SOURCE 200809L
+#include "frame_pool.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SLAB_SIZE 256
+#define SLABS 8
+#define THREADS 6
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+static frame_pool_t pool;
+static uint8_t memory[SLAB_SIZE * FRAME_POOL_MAX_SLABS];
+static atomic_uint owners[FRAME_POOL_MAX_SLABS];
+static atomic_uint errors;
+static atomic_bool stop;
+
+static uint32_t rng(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// No leak: every slab back in the free bitmap, nothing counted in use
+static int check_full(uint32_t slabs)
+{
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&pool, &stats);
+    unsigned int mask = atomic_load(&pool.free_mask);
+    unsigned int full = slabs == 32 ? 0xFFFFFFFFu : (1u << slabs) - 1;
+    CHECK(stats.in_use == 0, "%lu slabs still in use", (unsigned long)stats.in_use);
+    CHECK(mask == full, "free mask 0x%x, expected 0x%x", mask, full);
+    for (uint32_t i = 0; i < slabs; i++) {
+        CHECK(atomic_load(&pool.frames[i].refcount) == 0, "slab %lu refcount %u", (unsigned long)i,
+              atomic_load(&pool.frames[i].refcount));
+    }
+    return 0;
+}
+
+static int test_basic(void)
+{
+    frame_t *frames[SLABS];
+
+    CHECK(!frame_pool_init(&pool, memory, SLAB_SIZE, 0), "0 slabs accepted");
+    CHECK(!frame_pool_init(&pool, memory, SLAB_SIZE, FRAME_POOL_MAX_SLABS + 1), "33 slabs accepted");
+    CHECK(frame_pool_init(&pool, memory, SLAB_SIZE, SLABS), "init failed");
+    for (int i = 0; i < SLABS; i++) {
+        frames[i] = frame_pool_alloc(&pool);
+        CHECK(frames[i] != NULL, "alloc %d failed", i);
+        CHECK(frame_pool_slab(frames[i]) == memory + frames[i]->index * SLAB_SIZE, "slab %d misplaced", i);
+        for (int j = 0; j < i; j++) {
+            CHECK(frames[j] != frames[i], "slab %d handed out twice", i);
+        }
+    }
+    CHECK(frame_pool_alloc(&pool) == NULL, "alloc from an empty pool");
+
+    // A slab is recycled by the last unref only
+    frame_ref(frames[3]);
+    frame_unref(frames[3]);
+    CHECK(frame_pool_alloc(&pool) == NULL, "slab recycled with a reference left");
+    frame_unref(frames[3]);
+    frame_t *again = frame_pool_alloc(&pool);
+    CHECK(again == frames[3], "released slab not reused");
+    frame_unref(NULL);
+    for (int i = 0; i < SLABS; i++) {
+        frame_unref(frames[i]);
+    }
+
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&pool, &stats);
+    CHECK(stats.high_water == SLABS && stats.alloc_failures == 2, "high water %lu, %lu failures",
+          (unsigned long)stats.high_water, (unsigned long)stats.alloc_failures);
+    if (check_full(SLABS) != 0) {
+        return 1;
+    }
+
+    // All 32 slabs of the bitmap
+    CHECK(frame_pool_init(&pool, memory, SLAB_SIZE, 32), "init 32 failed");
+    frame_t *all[32];
+    for (int i = 0; i < 32; i++) {
+        all[i] = frame_pool_alloc(&pool);
+        CHECK(all[i] != NULL, "alloc %d of 32 failed", i);
+    }
+    CHECK(frame_pool_alloc(&pool) == NULL, "33rd alloc");
+    for (int i = 0; i < 32; i++) {
+        frame_unref(all[i]);
+    }
+    if (check_full(32) != 0) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
+
+// Threads racing on alloc/unref: a slab must never have two owners
+static void *cas_worker(void *arg)
+{
+    uint32_t seed = (uint32_t)(uintptr_t)arg * 2654435761u + 1;
+    frame_t *held[4];
+    int n = 0;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        if (n < 4 && rng(&seed) % 3 != 0) {
+            frame_t *frame = frame_pool_alloc(&pool);
+            if (frame != NULL) {
+                if (atomic_fetch_add(&owners[frame->index], 1) != 0) {
+                    atomic_fetch_add(&errors, 1);
+                }
+                memset(frame_pool_slab(frame), (int)(uintptr_t)arg, SLAB_SIZE);
+                held[n++] = frame;
+            }
+        } else if (n > 0) {
+            frame_t *frame = held[--n];
+            uint8_t *slab = frame_pool_slab(frame);
+            for (int i = 0; i < SLAB_SIZE; i += 37) {
+                if (slab[i] != (uint8_t)(uintptr_t)arg) {
+                    atomic_fetch_add(&errors, 1);
+                    break;
+                }
+            }
+            atomic_fetch_sub(&owners[frame->index], 1);
+            frame_unref(frame);
+        }
+    }
+    while (n > 0) {
+        frame_t *frame = held[--n];
+        atomic_fetch_sub(&owners[frame->index], 1);
+        frame_unref(frame);
+    }
+    return NULL;
+}
+
+static int test_cas(double seconds)
+{
+    pthread_t threads[THREADS];
+
+    frame_pool_init(&pool, memory, SLAB_SIZE, SLABS);
+    atomic_store(&stop, false);
+    atomic_store(&errors, 0);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, cas_worker, (void *)(uintptr_t)(i + 1));
+    }
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, true);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&pool, &stats);
+    CHECK(atomic_load(&errors) == 0, "%u slabs handed to two owners or overwritten", atomic_load(&errors));
+    CHECK(stats.alloc_failures > 0, "pool never ran dry, no contention");
+    if (check_full(SLABS) != 0) {
+        return 1;
+    }
+    printf("ok %lu\n", (unsigned long)stats.alloc_failures);
+    return 0;
+}
+
+// The capture pipeline shape: one producer publishes a latest frame, the
+// consumers take references to it, share them further and drop them later.
+// Each slab is stamped with its seq; a consumer holding a reference must
+// keep seeing that stamp.
+static pthread_mutex_t latest_lock = PTHREAD_MUTEX_INITIALIZER;
+static frame_t *latest;
+static atomic_uint published;
+static atomic_uint consumed;
+
+static void stamp(frame_t *frame, uint32_t seq)
+{
+    uint8_t *slab = frame_pool_slab(frame);
+    for (int i = 0; i < SLAB_SIZE; i += 4) {
+        memcpy(slab + i, &seq, 4);
+    }
+    frame->seq = seq;
+    frame->len = SLAB_SIZE;
+}
+
+static bool stamp_ok(const frame_t *frame, uint32_t seq)
+{
+    for (int i = 0; i < SLAB_SIZE; i += 4) {
+        uint32_t v;
+        memcpy(&v, frame->data + i, 4);
+        if (v != seq) {
+            return false;
+        }
+    }
+    return frame->seq == seq;
+}
+
+static void *producer(void *arg)
+{
+    uint32_t seq = 0;
+    (void)arg;
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        frame_t *frame = frame_pool_alloc(&pool);
+        if (frame == NULL) {
+            // Consumers hold everything; the capture task drops the frame
+            sched_yield();
+            continue;
+        }
+        stamp(frame, ++seq);
+        pthread_mutex_lock(&latest_lock);
+        frame_t *old = latest;
+        latest = frame;
+        pthread_mutex_unlock(&latest_lock);
+        frame_unref(old);
+        atomic_fetch_add(&published, 1);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    uint32_t seed = (uint32_t)(uintptr_t)arg * 40503u + 7;
+    frame_t *held[3] = { NULL };
+    uint32_t seqs[3] = { 0 };
+
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        int slot = rng(&seed) % 3;
+        if (held[slot] != NULL) {
+            if (!stamp_ok(held[slot], seqs[slot])) {
+                atomic_fetch_add(&errors, 1);
+            }
+            // Sometimes drop an extra reference taken for a second sender
+            if (rng(&seed) % 4 == 0) {
+                frame_unref(frame_ref(held[slot]));
+            }
+            frame_unref(held[slot]);
+            held[slot] = NULL;
+            atomic_fetch_add(&consumed, 1);
+        } else {
+            pthread_mutex_lock(&latest_lock);
+            frame_t *frame = latest != NULL ? frame_ref(latest) : NULL;
+            pthread_mutex_unlock(&latest_lock);
+            if (frame != NULL) {
+                held[slot] = frame;
+                seqs[slot] = frame->seq;
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (held[i] != NULL) {
+            if (!stamp_ok(held[i], seqs[i])) {
+                atomic_fetch_add(&errors, 1);
+            }
+            frame_unref(held[i]);
+        }
+    }
+    return NULL;
+}
+
+static int test_publish(double seconds)
+{
+    pthread_t threads[THREADS];
+
+    frame_pool_init(&pool, memory, SLAB_SIZE, SLABS);
+    latest = NULL;
+    atomic_store(&stop, false);
+    atomic_store(&errors, 0);
+    atomic_store(&published, 0);
+    atomic_store(&consumed, 0);
+    pthread_create(&threads[0], NULL, producer, NULL);
+    for (int i = 1; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, consumer, (void *)(uintptr_t)i);
+    }
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, true);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    frame_unref(latest);
+    latest = NULL;
+
+    CHECK(atomic_load(&errors) == 0, "%u frames recycled while referenced", atomic_load(&errors));
+    CHECK(atomic_load(&published) > 1000 && atomic_load(&consumed) > 1000, "only %u published, %u consumed",
+          atomic_load(&published), atomic_load(&consumed));
+    if (check_full(SLABS) != 0) {
+        return 1;
+    }
+    printf("ok %u %u\n", atomic_load(&published), atomic_load(&consumed));
+    return 0;
+}
+
+// Nanoseconds per alloc + unref, uncontended and with every thread at it
+static void *bench_worker(void *arg)
+{
+    unsigned long *count = arg;
+    while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+        for (int i = 0; i < 1000; i++) {
+            frame_unref(frame_pool_alloc(&pool));
+        }
+        *count += 1000;
+    }
+    return NULL;
+}
+
+static int test_bench(void)
+{
+    const int n = 5000000;
+
+    frame_pool_init(&pool, memory, SLAB_SIZE, SLABS);
+    double start = now_s();
+    for (int i = 0; i < n; i++) {
+        frame_t *frame = frame_pool_alloc(&pool);
+        frame_unref(frame);
+    }
+    double single_ns = (now_s() - start) * 1e9 / n;
+
+    pthread_t threads[THREADS];
+    unsigned long counts[THREADS] = { 0 };
+    atomic_store(&stop, false);
+    start = now_s();
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, bench_worker, &counts[i]);
+    }
+    struct timespec ts = { 0, 500000000 };
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, true);
+    unsigned long total = 0;
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total += counts[i];
+    }
+    double contended_ns = (now_s() - start) * 1e9 * THREADS / total;
+    if (check_full(SLABS) != 0) {
+        return 1;
+    }
+    printf("ok %.0f %.0f\n", single_ns, contended_ns);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: stress basic|cas|publish|bench [seconds]\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "basic") == 0) {
+        return test_basic();
+    }
+    if (strcmp(argv[1], "cas") == 0) {
+        return test_cas(seconds);
+    }
+    if (strcmp(argv[1], "publish") == 0) {
+        return test_publish(seconds);
+    }
+    if (strcmp(argv[1], "bench") == 0) {
+        return test_bench();
+    }
+    fprintf(stderr, "usage: stress basic|cas|publish|bench [seconds]\n");
+    return 2;
+}
+EOF
+    gcc -std=c11 -O2 -Wall -Werror -pthread -I main "$WORK_DIR/stress.c" main/frame_pool.c -o "$WORK_DIR/stress"
+}
+
+# Run one stress command; sets RESULT to what follows "ok"
+run_stress() {
+    local out
+    out=$("$WORK_DIR/stress" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test allocation, references and recycling on one thread
+test_basic() {
+    print_test "Allocating and releasing slabs..."
+
+    run_stress basic || return 1
+    print_pass "Distinct slabs, recycled on the last unref, empty pool reported"
+    return 0
+}
+
+# Test threads racing on the free bitmap
+test_cas() {
+    print_test "Racing alloc/unref on 6 threads for ${STRESS_SECONDS}s..."
+
+    run_stress cas "$STRESS_SECONDS" || return 1
+    print_pass "No slab handed out twice ($RESULT empty-pool allocs), no leak"
+    return 0
+}
+
+# Test published frames shared between consumers
+test_publish() {
+    print_test "Publishing frames to 5 consumers for ${STRESS_SECONDS}s..."
+
+    run_stress publish "$STRESS_SECONDS" || return 1
+    read -r published consumed <<< "$RESULT"
+    print_pass "$published frames published, $consumed references dropped, none recycled early, no leak"
+    return 0
+}
+
+# Measure alloc/release
+test_bench() {
+    print_test "Timing alloc + unref..."
+
+    run_stress bench || return 1
+    read -r single contended <<< "$RESULT"
+    print_pass "$single ns uncontended, $contended ns per thread with 6 threads"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Frame Pool Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    STRESS_SECONDS=${STRESS_SECONDS:-2}
+    local failed_tests=0
+
+    if ! build_stress; then
+        print_fail "Cannot build the stress test"
+        return 1
+    fi
+
+    for t in test_basic test_cas test_publish test_bench; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,551 @@
+#!/bin/bash
+# Test script for the long-poll waiter table
+# Usage: ./test_frame_waiters.sh
+#
+# Builds main/frame_waiters.c for the host. Parked /capture?after=N requests
+# are driven across frame publishes on a simulated millisecond clock that
+# wraps past 2^32: every waiter is answered exactly once, with a frame newer
+# than its after=N or at its deadline to the millisecond, never early. Then a
+# publisher thread, a poll thread shaped like capture_poll_task and several
+# client threads run in real time (STRESS_SECONDS, 2 by default) and the time
+# from publish, and from parking, to the answer is printed.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "frame_waiters.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define REQUESTERS 32
+
+// What the table should hold, per request
+typedef struct {
+    int parked;
+    uint32_t after;
+    uint32_t parked_ms;
+    uint32_t deadline_ms;
+    uint32_t answers;
+} model_t;
+
+static frame_waiters_t s_waiters;
+static model_t s_model[REQUESTERS];
+
+static uint32_t rand_below(uint32_t n)
+{
+    return (uint32_t)rand() % n;
+}
+
+static int test_model(void)
+{
+    uint32_t now = 0xffff0000u;     // wraps after about a minute
+    uint32_t seq = 1000;
+    uint32_t next_publish = now + 33;
+    uint32_t next_arrival = now;
+    uint32_t parked = 0, delivered = 0, timed_out = 0, rejected = 0, max_wait = 0;
+    int count = 0;
+    uint32_t wrapped = 0;
+
+    srand(44);
+    frame_waiters_init(&s_waiters, FRAME_WAITERS_MAX);
+    for (int step = 0; step < 500000; step++) {
+        // Step to the next event; a deadline is never stepped over
+        uint32_t to_timeout = frame_waiters_next_timeout(&s_waiters, now);
+        uint32_t next = next_publish;
+        if ((int32_t)(next_arrival - next) < 0) {
+            next = next_arrival;
+        }
+        if (to_timeout != UINT32_MAX && (int32_t)(now + to_timeout - next) < 0) {
+            next = now + to_timeout;
+        }
+        wrapped += next < now;
+        now = next;
+
+        // A publish; the pipeline may have skipped frames since the last look
+        if (now == next_publish) {
+            seq += 1 + rand_below(3);
+            // A stalled sensor now and then, so deadlines come due
+            next_publish = now + (rand_below(20) == 0 ? 200 + rand_below(400) : 1 + rand_below(60));
+        }
+
+        // A request parks, with what it has (sometimes already stale, or
+        // ahead of what was published)
+        if (now == next_arrival) {
+            int r = rand_below(REQUESTERS);
+            if (!s_model[r].parked) {
+                uint32_t after = seq - 2 + rand_below(5);
+                uint32_t timeout = 1 + rand_below(300);
+                bool added = frame_waiters_add(&s_waiters, &s_model[r], after, now, timeout);
+                CHECK(added == (count < FRAME_WAITERS_MAX), "step %d: add %s with %d parked", step,
+                      added ? "accepted" : "refused", count);
+                if (added) {
+                    s_model[r] = (model_t){ 1, after, now, now + timeout, 0 };
+                    count++;
+                    parked++;
+                } else {
+                    rejected++;
+                }
+            }
+            next_arrival = now + rand_below(15);
+        }
+
+        // The poll loop: answer everyone due
+        frame_wait_result_t result;
+        void *ctx;
+        while ((result = frame_waiters_pop(&s_waiters, seq, now, &ctx)) != FRAME_WAIT_NONE) {
+            model_t *m = ctx;
+            CHECK(m >= s_model && m < s_model + REQUESTERS, "step %d: unknown waiter", step);
+            CHECK(m->parked && m->answers == 0, "step %d: request %d answered twice", step, (int)(m - s_model));
+            m->answers++;
+            m->parked = 0;
+            count--;
+            if (result == FRAME_WAIT_READY) {
+                CHECK(seq > m->after, "step %d: frame %u for after=%u", step, seq, m->after);
+                delivered++;
+                if (now - m->parked_ms > max_wait) {
+                    max_wait = now - m->parked_ms;
+                }
+            } else {
+                CHECK(seq <= m->after, "step %d: timed out with frame %u for after=%u", step, seq, m->after);
+                CHECK(now == m->deadline_ms, "step %d: timed out at %u, deadline %u", step, now, m->deadline_ms);
+                timed_out++;
+            }
+        }
+
+        // Nobody left behind is due, and the summaries agree with the model
+        uint32_t min_after = UINT32_MAX;
+        uint32_t min_left = UINT32_MAX;
+        for (int r = 0; r < REQUESTERS; r++) {
+            model_t *m = &s_model[r];
+            if (!m->parked) {
+                m->answers = 0;
+                continue;
+            }
+            CHECK(seq <= m->after, "step %d: request %d left with frame %u for after=%u", step, r, seq, m->after);
+            CHECK((int32_t)(m->deadline_ms - now) > 0, "step %d: request %d left past its deadline", step, r);
+            min_after = m->after < min_after ? m->after : min_after;
+            min_left = m->deadline_ms - now < min_left ? m->deadline_ms - now : min_left;
+        }
+        CHECK(s_waiters.count == count, "step %d: %u in the table, %d in the model", step, s_waiters.count, count);
+        CHECK(frame_waiters_min_after(&s_waiters) == min_after, "step %d: min after %u, expected %u", step,
+              frame_waiters_min_after(&s_waiters), min_after);
+        CHECK(frame_waiters_next_timeout(&s_waiters, now) == min_left, "step %d: next timeout %u, expected %u",
+              step, frame_waiters_next_timeout(&s_waiters, now), min_left);
+    }
+
+    frame_waiters_stats_t *stats = &s_waiters.stats;
+    CHECK(wrapped > 0, "clock never wrapped");
+    CHECK(stats->parked == parked && stats->delivered == delivered && stats->timed_out == timed_out &&
+          stats->rejected == rejected, "stats %u/%u/%u/%u, model %u/%u/%u/%u", stats->parked, stats->delivered,
+          stats->timed_out, stats->rejected, parked, delivered, timed_out, rejected);
+    CHECK(stats->max_wait_ms == max_wait, "max wait %u, expected %u", stats->max_wait_ms, max_wait);
+    CHECK(timed_out > 1000 && delivered > 1000 && rejected > 0, "only %u delivered, %u timed out, %u rejected",
+          delivered, timed_out, rejected);
+    printf("ok %u %u %u\n", delivered, timed_out, rejected);
+    return 0;
+}
+
+// video_stream_stop(): every parked request comes out once, counted as
+// neither delivered nor timed out
+static int test_drop(void)
+{
+    model_t *ctx;
+    int seen[FRAME_WAITERS_MAX] = { 0 };
+
+    frame_waiters_init(&s_waiters, FRAME_WAITERS_MAX);
+    CHECK(!frame_waiters_drop(&s_waiters, (void **)&ctx), "dropped from an empty table");
+    for (int i = 0; i < FRAME_WAITERS_MAX; i++) {
+        CHECK(frame_waiters_add(&s_waiters, &s_model[i], 10 + i, 100, 1000), "waiter %d refused", i);
+    }
+    CHECK(!frame_waiters_add(&s_waiters, &s_model[FRAME_WAITERS_MAX], 10, 100, 1000), "full table took more");
+    for (int i = 0; i < FRAME_WAITERS_MAX; i++) {
+        CHECK(frame_waiters_drop(&s_waiters, (void **)&ctx), "waiter %d lost", i);
+        CHECK(ctx >= s_model && ctx < s_model + FRAME_WAITERS_MAX && !seen[ctx - s_model]++, "waiter dropped twice");
+    }
+    CHECK(!frame_waiters_drop(&s_waiters, (void **)&ctx), "dropped more than were parked");
+    CHECK(frame_waiters_min_after(&s_waiters) == UINT32_MAX && frame_waiters_next_timeout(&s_waiters, 0) == UINT32_MAX,
+          "empty table still has a waiter");
+    CHECK(frame_waiters_pop(&s_waiters, UINT32_MAX, 5000, (void **)&ctx) == FRAME_WAIT_NONE, "popped after drop");
+    CHECK(s_waiters.stats.delivered == 0 && s_waiters.stats.timed_out == 0 && s_waiters.stats.rejected == 1,
+          "drops counted: %u delivered, %u timed out", s_waiters.stats.delivered, s_waiters.stats.timed_out);
+    printf("ok\n");
+    return 0;
+}
+
+// Real time: a publisher, one poll thread shaped like capture_poll_task,
+// and FRAME_WAITERS_MAX clients each parking again as soon as answered.
+// The poll thread sleeps until a publish, a parked request or the next
+// deadline, like the task's notification wait.
+#define FRAME_PERIOD_US 5000
+#define POLL_TIMEOUT_MS 50
+#define LATENCY_SAMPLES 65536
+
+typedef struct {
+    pthread_cond_t answered;
+    uint32_t after;
+    int64_t parked_ns;
+    int pending;
+    frame_wait_result_t result;
+    uint32_t seq;
+} client_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_wake;     // on CLOCK_MONOTONIC, like now_ns()
+static int s_notified;
+static client_t *s_queue[FRAME_WAITERS_MAX];
+static int s_queued;
+static uint32_t s_seq;
+static int64_t s_published_ns;
+static atomic_bool s_stop;
+static atomic_int s_errors;
+static int64_t s_publish_latency[LATENCY_SAMPLES];
+static int64_t s_park_latency[LATENCY_SAMPLES];
+static uint32_t s_publish_samples;
+static uint32_t s_park_samples;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(now_ns() / 1000000);
+}
+
+static void notify(void)
+{
+    s_notified = 1;
+    pthread_cond_signal(&s_wake);
+}
+
+static void *publisher(void *arg)
+{
+    int64_t next = now_ns();
+    uint32_t frames = 0;
+
+    while (!atomic_load(&s_stop)) {
+        // A 200 ms stall every 200 frames, so parked clients time out
+        next += ++frames % 200 == 0 ? 200000000 : FRAME_PERIOD_US * 1000;
+        struct timespec ts = { next / 1000000000, next % 1000000000 };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        pthread_mutex_lock(&s_lock);
+        s_seq++;
+        s_published_ns = now_ns();
+        notify();
+        pthread_mutex_unlock(&s_lock);
+    }
+    return NULL;
+}
+
+static void answer(client_t *c, frame_wait_result_t result, uint32_t seq)
+{
+    if (!c->pending) {
+        atomic_fetch_add(&s_errors, 1);     // answered twice
+    }
+    c->pending = 0;
+    c->result = result;
+    c->seq = seq;
+    pthread_cond_signal(&c->answered);
+}
+
+static void *poll_thread(void *arg)
+{
+    frame_waiters_t *w = arg;
+
+    pthread_mutex_lock(&s_lock);
+    while (!atomic_load(&s_stop) || w->count > 0 || s_queued > 0) {
+        for (int i = 0; i < s_queued; i++) {
+            if (!frame_waiters_add(w, s_queue[i], s_queue[i]->after, now_ms(), POLL_TIMEOUT_MS)) {
+                atomic_fetch_add(&s_errors, 1);
+            }
+        }
+        s_queued = 0;
+
+        frame_wait_result_t result;
+        void *ctx;
+        int64_t now = now_ns();
+        while ((result = frame_waiters_pop(w, s_seq, now_ms(), &ctx)) != FRAME_WAIT_NONE) {
+            client_t *c = ctx;
+            if (result == FRAME_WAIT_READY) {
+                // Parked before the frame: time from its publish; parked
+                // after it: time from parking
+                if (c->parked_ns < s_published_ns) {
+                    if (s_publish_samples < LATENCY_SAMPLES) {
+                        s_publish_latency[s_publish_samples++] = now - s_published_ns;
+                    }
+                } else if (s_park_samples < LATENCY_SAMPLES) {
+                    s_park_latency[s_park_samples++] = now - c->parked_ns;
+                }
+            }
+            answer(c, result, s_seq);
+        }
+
+        uint32_t wait_ms = frame_waiters_next_timeout(w, now_ms());
+        while (!s_notified && !(atomic_load(&s_stop) && s_queued == 0 && w->count == 0)) {
+            if (wait_ms == UINT32_MAX) {
+                pthread_cond_wait(&s_wake, &s_lock);
+                continue;
+            }
+            int64_t until = now_ns() + (int64_t)wait_ms * 1000000;
+            struct timespec ts = { until / 1000000000, until % 1000000000 };
+            if (pthread_cond_timedwait(&s_wake, &s_lock, &ts) != 0) {
+                break;
+            }
+        }
+        s_notified = 0;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+typedef struct {
+    client_t client;
+    uint32_t delivered;
+    uint32_t timed_out;
+    uint32_t early;
+    uint32_t stale;
+} client_stats_t;
+
+static void *client_thread(void *arg)
+{
+    client_stats_t *cs = arg;
+    client_t *c = &cs->client;
+    uint32_t have = 0;
+    unsigned seed = (unsigned)(uintptr_t)arg;
+
+    pthread_mutex_lock(&s_lock);
+    while (!atomic_load(&s_stop)) {
+        // Mostly the frame last received; now and then one behind, which
+        // a frame already published satisfies
+        c->after = rand_r(&seed) % 8 == 0 && have > 0 ? have - 1 : have;
+        c->parked_ns = now_ns();
+        c->pending = 1;
+        s_queue[s_queued++] = c;
+        notify();
+        while (c->pending) {
+            pthread_cond_wait(&c->answered, &s_lock);
+        }
+        int64_t waited = now_ns() - c->parked_ns;
+        if (c->result == FRAME_WAIT_READY) {
+            cs->delivered++;
+            cs->stale += c->seq <= c->after;
+            have = c->seq;
+        } else {
+            cs->timed_out++;
+            // The table counts whole milliseconds from when it saw the request
+            cs->early += waited < (POLL_TIMEOUT_MS - 1) * 1000000LL;
+            cs->stale += c->seq > c->after;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return NULL;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(int64_t *v, uint32_t n, int p)
+{
+    return n == 0 ? 0 : v[(uint64_t)(n - 1) * p / 100] / 1000.0;
+}
+
+static int test_latency(double seconds)
+{
+    frame_waiters_t w;
+    pthread_t pub, poller, clients[FRAME_WAITERS_MAX];
+    client_stats_t cs[FRAME_WAITERS_MAX];
+    uint32_t delivered = 0, timed_out = 0;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_wake, &attr);
+
+    frame_waiters_init(&w, FRAME_WAITERS_MAX);
+    memset(cs, 0, sizeof(cs));
+    atomic_store(&s_stop, false);
+    pthread_create(&poller, NULL, poll_thread, &w);
+    pthread_create(&pub, NULL, publisher, NULL);
+    for (int i = 0; i < FRAME_WAITERS_MAX; i++) {
+        pthread_cond_init(&cs[i].client.answered, NULL);
+        pthread_create(&clients[i], NULL, client_thread, &cs[i]);
+    }
+
+    struct timespec ts = { (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&ts, NULL);
+    atomic_store(&s_stop, true);
+    pthread_join(pub, NULL);
+    for (int i = 0; i < FRAME_WAITERS_MAX; i++) {
+        pthread_join(clients[i], NULL);
+    }
+    pthread_mutex_lock(&s_lock);
+    notify();
+    pthread_mutex_unlock(&s_lock);
+    pthread_join(poller, NULL);
+
+    for (int i = 0; i < FRAME_WAITERS_MAX; i++) {
+        CHECK(cs[i].early == 0, "client %d: %u timeouts before %d ms", i, cs[i].early, POLL_TIMEOUT_MS);
+        CHECK(cs[i].stale == 0, "client %d: %u answers with the wrong frame", i, cs[i].stale);
+        delivered += cs[i].delivered;
+        timed_out += cs[i].timed_out;
+    }
+    CHECK(atomic_load(&s_errors) == 0, "%d requests answered twice or refused", atomic_load(&s_errors));
+    CHECK(w.stats.delivered == delivered && w.stats.timed_out == timed_out, "table counted %u/%u, clients %u/%u",
+          w.stats.delivered, w.stats.timed_out, delivered, timed_out);
+    CHECK(delivered > 0 && timed_out > 0, "%u delivered, %u timed out", delivered, timed_out);
+    CHECK(s_publish_samples > 0 && s_park_samples > 0, "no latency samples");
+
+    qsort(s_publish_latency, s_publish_samples, sizeof(int64_t), cmp_i64);
+    qsort(s_park_latency, s_park_samples, sizeof(int64_t), cmp_i64);
+    printf("ok %u %u %.0f %.0f %.0f %.0f %.0f\n", delivered, timed_out,
+           percentile_us(s_publish_latency, s_publish_samples, 50),
+           percentile_us(s_publish_latency, s_publish_samples, 99),
+           percentile_us(s_publish_latency, s_publish_samples, 100),
+           percentile_us(s_park_latency, s_park_samples, 50),
+           percentile_us(s_park_latency, s_park_samples, 99));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim model|drop|latency [seconds]\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "model") == 0) {
+        return test_model();
+    }
+    if (strcmp(argv[1], "drop") == 0) {
+        return test_drop();
+    }
+    if (strcmp(argv[1], "latency") == 0) {
+        return test_latency(argc > 2 ? atof(argv[2]) : 2.0);
+    }
+    fprintf(stderr, "usage: sim model|drop|latency [seconds]\n");
+    return 2;
+}
+EOF
+    gcc -std=gnu11 -O2 -Wall -Werror -pthread -I main "$WORK_DIR/sim.c" main/frame_waiters.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test waiters against a model on a simulated clock
+test_model() {
+    print_test "Parked requests across publishes, stalls and a clock wrap..."
+
+    run_sim model || return 1
+    read -r delivered timed_out rejected <<< "$RESULT"
+    print_pass "$delivered answered with a newer frame, $timed_out at their deadline to the ms, \
+$rejected refused on a full table; each exactly once"
+    return 0
+}
+
+# Test refusing every waiter on stop
+test_drop() {
+    print_test "Dropping parked requests on stop..."
+
+    run_sim drop || return 1
+    print_pass "Every request dropped once, not counted as delivered or timed out"
+    return 0
+}
+
+# Measure publish-to-answer latency with threads
+test_latency() {
+    print_test "Long-polling clients against a 200 fps publisher for ${STRESS_SECONDS}s..."
+
+    run_sim latency "$STRESS_SECONDS" || return 1
+    read -r delivered timed_out pub_p50 pub_p99 pub_max park_p50 park_p99 <<< "$RESULT"
+    print_pass "$delivered answered with a newer frame, $timed_out timed out no earlier than 50 ms, none twice"
+    print_pass "Publish to answer: ${pub_p50} us median, ${pub_p99} us p99, ${pub_max} us max"
+    print_pass "Park to answer with a newer frame already there: ${park_p50} us median, ${park_p99} us p99"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Frame Waiters Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    STRESS_SECONDS=${STRESS_SECONDS:-2}
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the waiter simulation"
+        return 1
+    fi
+
+    for t in test_model test_drop test_latency; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
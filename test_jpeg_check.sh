@@ -0,0 +1,636 @@
+#!/bin/bash
+# Test script for the JPEG frame validator
+# Usage: ./test_jpeg_check.sh [jpeg files...]
+#
+# Builds main/jpeg_check.c for the host, with the address and undefined
+# behaviour sanitizers when gcc has them, and runs it over a corpus: frames
+# from main/jpeg_enc.c at several sizes, qualities and formats, the same
+# frames with restart markers, and any JPEG files given on the command line
+# (e.g. frames saved from /capture). Every clean frame must pass. Each frame
+# is then corrupted the ways a marginal DVP link or a driver mix-up does it,
+# and the share caught by the basic check and by the segment walk is
+# checked per class. Random byte damage must never read out of bounds. Also
+# checks the corruption rate window and times both checks on a 640x480
+# frame. FUZZ_CASES sets the corrupted copies per frame and class.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+FUZZ_CASES=${FUZZ_CASES:-50}
+CORPUS_FILES=("$@")
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#define _POSIX_C_SOURCE 200809L
+#include "jpeg_check.h"
+#include "jpeg_enc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define MAX_FRAMES 160
+#define MAX_FRAME_LEN 400000
+#define RST_INTERVAL 64     // entropy bytes between inserted restart markers
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t scan;            // first entropy byte
+    bool restarts;
+    char name[48];
+} frame_t;
+
+static frame_t s_frames[MAX_FRAMES];
+static int s_frame_count;
+static uint8_t s_buf[MAX_FRAME_LEN * 2];
+static uint32_t s_seed = 41;
+
+static uint32_t rnd(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return s_seed >> 8;
+}
+
+static bool is_rst(uint8_t marker)
+{
+    return marker >= 0xD0 && marker <= 0xD7;
+}
+
+// Offset of the first entropy byte: after the SOS segment
+static size_t scan_start(const uint8_t *p, size_t len)
+{
+    size_t i = 2;
+    while (i + 4 <= len && p[i] == 0xFF) {
+        size_t seg_len = ((size_t)p[i + 2] << 8) | p[i + 3];
+        if (p[i + 1] == 0xDA) {
+            return i + 2 + seg_len;
+        }
+        i += 2 + seg_len;
+    }
+    return 0;
+}
+
+static void add_frame(const uint8_t *data, size_t len, bool restarts, const char *name)
+{
+    if (s_frame_count == MAX_FRAMES) {
+        return;
+    }
+    frame_t *f = &s_frames[s_frame_count++];
+    f->data = malloc(len);
+    memcpy(f->data, data, len);
+    f->len = len;
+    f->scan = scan_start(data, len);
+    f->restarts = restarts;
+    snprintf(f->name, sizeof(f->name), "%s", name);
+}
+
+// The same frame with a DRI segment and RSTn markers every RST_INTERVAL
+// entropy bytes, never between 0xFF and its stuffed 0x00. Not decodable,
+// but structurally what a sensor with restart intervals sends.
+static void add_restart_variant(const frame_t *src)
+{
+    static uint8_t out[MAX_FRAME_LEN * 2];
+    static const uint8_t dri[] = { 0xFF, 0xDD, 0x00, 0x04, 0x00, 0x10 };
+    size_t o = 0;
+    uint8_t rst = 0;
+    char name[48];
+
+    memcpy(out, src->data, 2);
+    o = 2;
+    memcpy(out + o, dri, sizeof(dri));
+    o += sizeof(dri);
+    memcpy(out + o, src->data + 2, src->scan - 2);
+    o += src->scan - 2;
+    for (size_t i = src->scan, run = 0; i < src->len - 2; i++) {
+        out[o++] = src->data[i];
+        if (++run >= RST_INTERVAL && src->data[i] != 0xFF) {
+            out[o++] = 0xFF;
+            out[o++] = 0xD0 + rst;
+            rst = (rst + 1) & 7;
+            run = 0;
+        }
+    }
+    out[o++] = 0xFF;
+    out[o++] = 0xD9;
+    snprintf(name, sizeof(name), "%s+rst", src->name);
+    add_frame(out, o, true, name);
+}
+
+static void build_corpus(int argc, char **argv)
+{
+    static const struct {
+        uint16_t w, h;
+    } sizes[] = { { 64, 48 }, { 160, 120 }, { 320, 240 }, { 352, 288 }, { 640, 480 }, { 800, 600 } };
+    static const int qualities[] = { 10, 30, 50, 75, 95 };
+    static uint8_t img[800 * 600 * 2];
+    static uint8_t jpeg[MAX_FRAME_LEN];
+    jpeg_enc_t enc;
+    char name[48];
+
+    jpeg_enc_init(&enc, 50);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint16_t w = sizes[s].w;
+        uint16_t h = sizes[s].h;
+        for (int format = 0; format < 2; format++) {
+            // Gradients, edges and some noise, different per size
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    uint8_t luma = (uint8_t)(((x * 255) / w + ((x / 16 + y / 16) & 1) * 60 + (rnd() & 15)) & 0xFF);
+                    if (format == 0) {
+                        img[y * w + x] = luma;
+                    } else {
+                        img[(y * w + x) * 2] = luma;
+                        img[(y * w + x) * 2 + 1] = (uint8_t)(128 + (x & 1 ? y - h / 2 : x - w / 2) / 4);
+                    }
+                }
+            }
+            for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+                jpeg_enc_set_quality(&enc, qualities[q]);
+                size_t len = jpeg_enc_encode(&enc, img, w, h, 0, format ? JPEG_ENC_YUYV : JPEG_ENC_GRAYSCALE, jpeg,
+                                             sizeof(jpeg));
+                if (len > 0) {
+                    snprintf(name, sizeof(name), "%ux%u %s q%d", w, h, format ? "yuyv" : "gray", qualities[q]);
+                    add_frame(jpeg, len, false, name);
+                }
+            }
+        }
+    }
+    int encoded = s_frame_count;
+    for (int i = 0; i < encoded; i++) {
+        add_restart_variant(&s_frames[i]);
+    }
+
+    for (int i = 2; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            continue;
+        }
+        size_t len = fread(jpeg, 1, sizeof(jpeg), f);
+        fclose(f);
+        add_frame(jpeg, len, false, argv[i]);
+    }
+}
+
+typedef enum {
+    CORRUPT_TRUNCATED,      // DMA stopped early
+    CORRUPT_TRAILING,       // junk after the EOI
+    CORRUPT_GLUED,          // a scan cut short, then a whole next frame
+    CORRUPT_SEGMENT_LEN,    // a header segment length off
+    CORRUPT_RST_ORDER,      // a restart marker skipped
+    CORRUPT_MARKER,         // a stray marker in the entropy data
+    CORRUPT_NOISE,          // 8 bit flips in the entropy data
+    CORRUPT_COUNT
+} corrupt_t;
+
+static const char *const s_corrupt_names[CORRUPT_COUNT] = {
+    "truncated", "trailing", "glued", "segment_len", "rst_order", "marker", "noise",
+};
+
+// Writes a corrupted copy of f to s_buf. Returns its length, or 0 if the
+// class does not apply to this frame.
+static size_t corrupt(const frame_t *f, corrupt_t type)
+{
+    size_t len = f->len;
+    size_t entropy = f->len - 2 - f->scan;
+
+    memcpy(s_buf, f->data, f->len);
+    switch (type) {
+    case CORRUPT_TRUNCATED:
+        return 2 + rnd() % (f->len - 2);
+
+    case CORRUPT_TRAILING: {
+        size_t extra = 1 + rnd() % 64;
+        for (size_t i = 0; i < extra; i++) {
+            s_buf[len + i] = (uint8_t)rnd();
+        }
+        if (s_buf[len + extra - 2] == 0xFF && s_buf[len + extra - 1] == 0xD9) {
+            s_buf[len + extra - 1] = 0;
+        }
+        return len + extra;
+    }
+
+    case CORRUPT_GLUED: {
+        const frame_t *next = &s_frames[rnd() % s_frame_count];
+        size_t cut = f->scan + rnd() % entropy;
+        memcpy(s_buf + cut, next->data, next->len);
+        return cut + next->len;
+    }
+
+    case CORRUPT_SEGMENT_LEN: {
+        // Pick one of the segments before the scan
+        size_t offsets[32];
+        int count = 0;
+        for (size_t i = 2; i < f->scan && count < 32;) {
+            offsets[count++] = i;
+            i += 2 + (((size_t)f->data[i + 2] << 8) | f->data[i + 3]);
+        }
+        size_t at = offsets[rnd() % count] + 2;
+        int delta = (int)(rnd() % 64) - 32;
+        uint16_t seg_len = (uint16_t)((s_buf[at] << 8 | s_buf[at + 1]) + (delta == 0 ? 1 : delta));
+        s_buf[at] = seg_len >> 8;
+        s_buf[at + 1] = seg_len & 0xFF;
+        return len;
+    }
+
+    case CORRUPT_RST_ORDER: {
+        if (!f->restarts) {
+            return 0;
+        }
+        size_t rsts[4096];
+        int count = 0;
+        for (size_t i = f->scan; i + 1 < f->len - 2 && count < 4096; i++) {
+            if (s_buf[i] == 0xFF && is_rst(s_buf[i + 1])) {
+                rsts[count++] = i + 1;
+            }
+        }
+        if (count == 0) {
+            return 0;
+        }
+        size_t at = rsts[rnd() % count];
+        s_buf[at] = 0xD0 + ((s_buf[at] - 0xD0 + 1 + rnd() % 7) & 7);
+        return len;
+    }
+
+    case CORRUPT_MARKER: {
+        static const uint8_t markers[] = { 0xD8, 0xD9, 0xC0, 0xC4, 0xDA, 0xDB, 0xE0, 0xFE, 0x01 };
+        size_t at = f->scan + rnd() % (entropy - 1);
+        if (s_buf[at - 1] == 0xFF) {
+            at++;
+        }
+        s_buf[at] = 0xFF;
+        s_buf[at + 1] = markers[rnd() % sizeof(markers)];
+        return len;
+    }
+
+    case CORRUPT_NOISE:
+        for (int i = 0; i < 8; i++) {
+            s_buf[f->scan + rnd() % entropy] ^= (uint8_t)(1 << (rnd() % 8));
+        }
+        return len;
+
+    default:
+        return 0;
+    }
+}
+
+static int test_clean(void)
+{
+    int restarts = 0;
+    for (int i = 0; i < s_frame_count; i++) {
+        const frame_t *f = &s_frames[i];
+        jpeg_check_result_t basic = jpeg_check(f->data, f->len, false);
+        jpeg_check_result_t walk = jpeg_check(f->data, f->len, true);
+        CHECK(basic == JPEG_CHECK_OK && walk == JPEG_CHECK_OK, "%s (%zu bytes): basic %s, walk %s", f->name, f->len,
+              jpeg_check_result_name(basic), jpeg_check_result_name(walk));
+        restarts += f->restarts;
+    }
+    printf("ok %d %d\n", s_frame_count, restarts);
+    return 0;
+}
+
+// Share of corrupted frames caught, per mille, that each class must reach
+static const struct {
+    uint16_t basic;
+    uint16_t walk;
+} k_expected[CORRUPT_COUNT] = {
+    [CORRUPT_TRUNCATED] = { 1000, 1000 },
+    [CORRUPT_TRAILING] = { 1000, 1000 },
+    [CORRUPT_GLUED] = { 0, 1000 },
+    // Missed when the wrong length lands on a 0xFF that reads as a marker:
+    // low-quality quantization tables are full of 255s
+    [CORRUPT_SEGMENT_LEN] = { 0, 980 },
+    [CORRUPT_RST_ORDER] = { 0, 1000 },
+    [CORRUPT_MARKER] = { 0, 1000 },
+    [CORRUPT_NOISE] = { 0, 100 },
+};
+
+static int test_corrupt(int cases)
+{
+    for (int type = 0; type < CORRUPT_COUNT; type++) {
+        uint32_t total = 0;
+        uint32_t basic_caught = 0;
+        uint32_t walk_caught = 0;
+
+        for (int i = 0; i < s_frame_count; i++) {
+            for (int c = 0; c < cases; c++) {
+                size_t len = corrupt(&s_frames[i], (corrupt_t)type);
+                if (len == 0) {
+                    break;
+                }
+                total++;
+                basic_caught += jpeg_check(s_buf, len, false) != JPEG_CHECK_OK;
+                walk_caught += jpeg_check(s_buf, len, true) != JPEG_CHECK_OK;
+            }
+        }
+        CHECK(total > 0, "%s: no cases", s_corrupt_names[type]);
+        uint32_t basic = basic_caught * 1000 / total;
+        uint32_t walk = walk_caught * 1000 / total;
+        CHECK(basic >= k_expected[type].basic && walk >= k_expected[type].walk,
+              "%s: caught %u/%u by the basic check, %u/%u by the walk", s_corrupt_names[type], basic_caught, total,
+              walk_caught, total);
+        // The walk starts with the basic check
+        CHECK(walk_caught >= basic_caught, "%s: walk caught less than the basic check", s_corrupt_names[type]);
+        printf("%s %u %u %u\n", s_corrupt_names[type], total, basic, walk);
+    }
+    printf("ok\n");
+    return 0;
+}
+
+// Arbitrary damage: only checks that nothing reads out of bounds, which
+// the sanitizers report
+static int test_random(int cases)
+{
+    uint32_t checked = 0;
+
+    for (int i = 0; i < s_frame_count; i++) {
+        const frame_t *f = &s_frames[i];
+        for (int c = 0; c < cases; c++) {
+            size_t len = 1 + rnd() % f->len;
+            uint8_t *copy = malloc(len);
+            memcpy(copy, f->data, len);
+            for (int k = 1 + rnd() % 32; k > 0; k--) {
+                copy[rnd() % len] = (uint8_t)rnd();
+            }
+            // Keep SOI and EOI so the walk runs
+            if (len >= 4 && (c & 1)) {
+                copy[0] = 0xFF;
+                copy[1] = 0xD8;
+                copy[len - 2] = 0xFF;
+                copy[len - 1] = 0xD9;
+            }
+            jpeg_check(copy, len, false);
+            jpeg_check(copy, len, true);
+            free(copy);
+            checked++;
+        }
+    }
+    // Short and hand-made inputs at exact sizes
+    for (size_t len = 0; len < 300; len++) {
+        uint8_t *copy = malloc(len ? len : 1);
+        for (size_t k = 0; k < len; k++) {
+            copy[k] = (k & 1) ? (uint8_t)rnd() : 0xFF;
+        }
+        if (len >= 4) {
+            copy[1] = 0xD8;
+            copy[len - 1] = 0xD9;
+        }
+        CHECK(len >= JPEG_CHECK_MIN_LEN || jpeg_check(copy, len, true) == JPEG_CHECK_TOO_SHORT,
+              "%zu bytes not too short", len);
+        jpeg_check(copy, len, true);
+        free(copy);
+        checked++;
+    }
+    CHECK(jpeg_check(NULL, 1000, true) == JPEG_CHECK_TOO_SHORT, "NULL frame");
+
+    // A header segment that runs past the EOI
+    const frame_t *f = &s_frames[0];
+    memcpy(s_buf, f->data, f->len);
+    s_buf[4] = (uint8_t)((f->len - 4) >> 8);
+    s_buf[5] = (uint8_t)(f->len - 4);
+    CHECK(jpeg_check(s_buf, f->len, true) == JPEG_CHECK_BAD_SEGMENT, "segment past the EOI: %s",
+          jpeg_check_result_name(jpeg_check(s_buf, f->len, true)));
+    printf("ok %u\n", checked);
+    return 0;
+}
+
+static int test_rate(void)
+{
+    jpeg_check_rate_t rate;
+
+    // 20 per mille of 100: two bad frames are within it, three are not
+    jpeg_check_rate_init(&rate, 100, 20);
+    for (int i = 0; i < 100; i++) {
+        CHECK(!jpeg_check_rate_add(&rate, i < 2), "window tripped at frame %d with 2 bad", i);
+    }
+    CHECK(rate.last_permille == 20 && rate.frames == 0 && rate.bad == 0, "last %u per mille", rate.last_permille);
+    for (int i = 0; i < 99; i++) {
+        CHECK(!jpeg_check_rate_add(&rate, i < 3), "tripped before the window closed");
+    }
+    CHECK(jpeg_check_rate_add(&rate, false) && rate.last_permille == 30, "3 bad in 100: %u per mille",
+          rate.last_permille);
+
+    // Windows are independent: bad frames do not carry over
+    for (int i = 0; i < 100; i++) {
+        CHECK(!jpeg_check_rate_add(&rate, false), "clean window tripped");
+    }
+    CHECK(rate.last_permille == 0, "clean window %u per mille", rate.last_permille);
+
+    jpeg_check_rate_init(&rate, 0, 20);
+    for (int i = 0; i < 1000; i++) {
+        CHECK(!jpeg_check_rate_add(&rate, true), "disabled window tripped");
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Both checks on the largest 640x480 YUYV frame in the corpus
+static int test_bench(void)
+{
+    const frame_t *f = NULL;
+    for (int i = 0; i < s_frame_count; i++) {
+        if (strncmp(s_frames[i].name, "640x480 yuyv", 12) == 0 && !s_frames[i].restarts &&
+            (f == NULL || s_frames[i].len > f->len)) {
+            f = &s_frames[i];
+        }
+    }
+    CHECK(f != NULL, "no 640x480 frame");
+
+    const int n = 2000;
+    volatile int sink = 0;
+    double start = now_us();
+    for (int i = 0; i < n; i++) {
+        sink += jpeg_check(f->data, f->len, false);
+    }
+    double basic_us = (now_us() - start) / n;
+    start = now_us();
+    for (int i = 0; i < n; i++) {
+        sink += jpeg_check(f->data, f->len, true);
+    }
+    double walk_us = (now_us() - start) / n;
+    CHECK(sink == 0, "bench frame rejected");
+    printf("ok %zu %.2f %.1f %.0f\n", f->len, basic_us, walk_us, f->len / walk_us);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim clean|corrupt|random|rate|bench [jpeg files...]\n");
+        return 2;
+    }
+    const char *cases_env = getenv("FUZZ_CASES");
+    int cases = cases_env != NULL ? atoi(cases_env) : 50;
+
+    build_corpus(argc, argv);
+    if (strcmp(argv[1], "clean") == 0) {
+        return test_clean();
+    }
+    if (strcmp(argv[1], "corrupt") == 0) {
+        return test_corrupt(cases);
+    }
+    if (strcmp(argv[1], "random") == 0) {
+        return test_random(cases);
+    }
+    if (strcmp(argv[1], "rate") == 0) {
+        return test_rate();
+    }
+    if (strcmp(argv[1], "bench") == 0) {
+        return test_bench();
+    }
+    fprintf(stderr, "usage: sim clean|corrupt|random|rate|bench [jpeg files...]\n");
+    return 2;
+}
+EOF
+    local sanitize="-fsanitize=address,undefined -fno-sanitize-recover=all"
+    if ! echo 'int main(void){return 0;}' | gcc $sanitize -x c - -o "$WORK_DIR/probe" 2>/dev/null; then
+        sanitize=""
+    fi
+    gcc -std=c99 -O2 -Wall -Werror $sanitize -I main "$WORK_DIR/sim.c" main/jpeg_check.c main/jpeg_enc.c -lm \
+        -o "$WORK_DIR/sim" || return 1
+    # Timed without the sanitizers
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/jpeg_check.c main/jpeg_enc.c -lm \
+        -o "$WORK_DIR/bench"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@" "${CORPUS_FILES[@]}" 2>&1)
+    local last=${out##*$'\n'}
+    if [ "${last%% *}" != "ok" ] && [ "$last" != "ok" ]; then
+        print_fail "${last#fail }"
+        return 1
+    fi
+    OUTPUT=$out
+    RESULT=${last#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test that every clean frame passes
+test_clean() {
+    print_test "Clean corpus..."
+
+    run_sim clean || return 1
+    read -r frames restarts <<< "$RESULT"
+    print_pass "$frames frames pass both checks, $restarts of them with restart markers"
+    return 0
+}
+
+# Test the share of corrupted frames caught per class
+test_corrupt() {
+    print_test "Corrupted frames, $FUZZ_CASES per frame and class..."
+
+    run_sim corrupt || return 1
+    while read -r name total basic walk; do
+        [ "$name" = "ok" ] && continue
+        printf "       %-12s %6d frames: basic %5s%%, segment walk %5s%%\n" "$name" "$total" \
+            "$((basic / 10)).$((basic % 10))" "$((walk / 10)).$((walk % 10))"
+    done <<< "$OUTPUT"
+    print_pass "Every class caught at least as often as expected"
+    return 0
+}
+
+# Test that damaged input never reads out of bounds
+test_random() {
+    print_test "Random damage..."
+
+    run_sim random || return 1
+    print_pass "$RESULT damaged frames checked without an out-of-bounds read"
+    return 0
+}
+
+# Test the corruption rate window
+test_rate() {
+    print_test "Corruption rate window..."
+
+    run_sim rate || return 1
+    print_pass "Trips above the threshold only, once per window"
+    return 0
+}
+
+# Time both checks
+test_bench() {
+    print_test "Timing a 640x480 frame..."
+
+    local out
+    out=$("$WORK_DIR/bench" bench "${CORPUS_FILES[@]}")
+    if [ "${out%% *}" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    read -r len basic walk mbps <<< "${out#ok }"
+    print_pass "$len-byte JPEG: basic check $basic us, segment walk $walk us ($mbps MB/s)"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera JPEG Check Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_clean test_corrupt test_random test_rate test_bench; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main
+exit $?
@@ -0,0 +1,474 @@
+#!/bin/bash
+# Test script for the on-device JPEG encoder: quality, size and speed
+# Usage: ./test_jpeg_enc.sh
+#
+# Builds main/jpeg_enc.c for the host and encodes synthetic scenes (smooth
+# gradients, hard edges, fine detail and sensor-like noise) in grayscale and
+# YUYV 4:2:2. libjpeg is the reference: it decodes every frame, which must
+# succeed without warnings at any size, and encodes the same pixels with the
+# same quality and subsampling. Across the quality range the encoder's PSNR
+# must be within a fraction of a dB of libjpeg's and its size within a few
+# per cent, both rising with quality. Also times QVGA and VGA encodes
+# against libjpeg. Skipped without gcc or the libjpeg headers.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#define _POSIX_C_SOURCE 200809L
+#include "jpeg_enc.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jpeglib.h>    // after stdio.h, which it needs
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define MAX_W 640
+#define MAX_H 480
+#define OUT_SIZE (MAX_W * MAX_H * 3)
+
+static uint8_t s_img[MAX_W * MAX_H * 2];
+static uint8_t s_out[OUT_SIZE];
+static uint8_t s_decoded[MAX_W * MAX_H * 3];
+
+// Smooth shading, a few hard-edged shapes, fine stripes and noise, so
+// every part of the quantization table matters
+static void make_scene(uint16_t w, uint16_t h, jpeg_enc_format_t format, uint32_t seed)
+{
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            seed = seed * 1103515245u + 12345u;
+            int luma = 40 + 120 * x / w + 60 * y / h;
+            int dx = x - w / 3;
+            int dy = y - h / 2;
+            if (dx * dx + dy * dy < (h / 4) * (h / 4)) {
+                luma = 220;                                 // disc
+            } else if (x > w * 2 / 3 && y > h / 4 && y < h * 3 / 4) {
+                luma = ((x / 2) & 1) ? 30 : 200;            // 2-pixel stripes
+            }
+            luma += (int)(seed >> 28) - 8;                  // noise
+            luma = luma < 0 ? 0 : luma > 255 ? 255 : luma;
+            if (format == JPEG_ENC_GRAYSCALE) {
+                s_img[y * w + x] = (uint8_t)luma;
+            } else {
+                uint8_t *p = &s_img[(y * w + x) * 2];
+                p[0] = (uint8_t)luma;
+                p[1] = (uint8_t)(x & 1 ? 128 + 90 * y / h - 45 : 128 + 90 * x / w - 45); // V, U
+            }
+        }
+    }
+}
+
+// Chroma of the pixel pair x belongs to
+static uint8_t yuyv_u(uint16_t w, int x, int y)
+{
+    return s_img[(y * w + (x & ~1)) * 2 + 1];
+}
+
+static uint8_t yuyv_v(uint16_t w, int x, int y)
+{
+    return s_img[(y * w + (x | 1)) * 2 + 1];
+}
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    int warnings;
+    bool failed;
+} error_mgr_t;
+
+static void on_error(j_common_ptr cinfo)
+{
+    ((error_mgr_t *)cinfo->err)->failed = true;
+}
+
+static void on_message(j_common_ptr cinfo, int level)
+{
+    if (level < 0) {
+        ((error_mgr_t *)cinfo->err)->warnings++;
+    }
+}
+
+// Decode to Y (and box-upsampled Cb Cr) with libjpeg. Returns false on an
+// error or a warning, e.g. corrupt data or premature end of data.
+static bool reference_decode(const uint8_t *jpeg, size_t len, uint16_t w, uint16_t h, int components)
+{
+    struct jpeg_decompress_struct cinfo;
+    error_mgr_t err;
+
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = on_error;
+    err.pub.emit_message = on_message;
+    err.warnings = 0;
+    err.failed = false;
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, len);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK || err.failed || cinfo.image_width != w ||
+        cinfo.image_height != h || cinfo.num_components != components) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    cinfo.out_color_space = components == 1 ? JCS_GRAYSCALE : JCS_YCbCr;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.dct_method = JDCT_FLOAT;
+    jpeg_start_decompress(&cinfo);
+    while (!err.failed && cinfo.output_scanline < h) {
+        JSAMPROW row = &s_decoded[cinfo.output_scanline * w * components];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    if (!err.failed) {
+        jpeg_finish_decompress(&cinfo);
+    }
+    jpeg_destroy_decompress(&cinfo);
+    return !err.failed && err.warnings == 0;
+}
+
+// Encode s_img with libjpeg at the same quality, standard tables and
+// subsampling (4:2:2 for YUYV)
+static size_t reference_encode(uint16_t w, uint16_t h, jpeg_enc_format_t format, int quality, uint8_t **out)
+{
+    static uint8_t row[MAX_W * 3];
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned long size = 0;
+
+    *out = NULL;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, out, &size);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = format == JPEG_ENC_GRAYSCALE ? 1 : 3;
+    cinfo.in_color_space = format == JPEG_ENC_GRAYSCALE ? JCS_GRAYSCALE : JCS_YCbCr;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_colorspace(&cinfo, cinfo.in_color_space);
+    if (format == JPEG_ENC_YUYV) {
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 1;
+    }
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.dct_method = JDCT_FLOAT;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < h) {
+        int y = cinfo.next_scanline;
+        JSAMPROW p = row;
+        for (int x = 0; x < w; x++) {
+            if (format == JPEG_ENC_GRAYSCALE) {
+                row[x] = s_img[y * w + x];
+            } else {
+                row[x * 3] = s_img[(y * w + x) * 2];
+                row[x * 3 + 1] = yuyv_u(w, x, y);
+                row[x * 3 + 2] = yuyv_v(w, x, y);
+            }
+        }
+        jpeg_write_scanlines(&cinfo, &p, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return size;
+}
+
+// PSNR of s_decoded against s_img; luma only, or luma and chroma
+static void psnr(uint16_t w, uint16_t h, jpeg_enc_format_t format, double *luma, double *chroma)
+{
+    double sy = 0;
+    double sc = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            if (format == JPEG_ENC_GRAYSCALE) {
+                double d = (double)s_decoded[y * w + x] - s_img[y * w + x];
+                sy += d * d;
+            } else {
+                const uint8_t *p = &s_decoded[(y * w + x) * 3];
+                double d = (double)p[0] - s_img[(y * w + x) * 2];
+                double du = (double)p[1] - yuyv_u(w, x, y);
+                double dv = (double)p[2] - yuyv_v(w, x, y);
+                sy += d * d;
+                sc += (du * du + dv * dv) / 2;
+            }
+        }
+    }
+    double n = (double)w * h;
+    *luma = sy > 0 ? 10 * log10(255.0 * 255.0 * n / sy) : 99;
+    *chroma = sc > 0 ? 10 * log10(255.0 * 255.0 * n / sc) : 99;
+}
+
+// Decodes cleanly at sizes that are not whole MCUs, and odd strides
+static int test_decode(void)
+{
+    static const struct {
+        uint16_t w, h;
+    } sizes[] = { { 8, 8 }, { 16, 8 }, { 17, 9 }, { 70, 36 }, { 96, 96 }, { 162, 121 }, { 320, 240 },
+                  { 352, 288 }, { 640, 480 } };
+    jpeg_enc_t enc;
+    int frames = 0;
+
+    jpeg_enc_init(&enc, 75);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (int f = 0; f < 2; f++) {
+            jpeg_enc_format_t format = f ? JPEG_ENC_YUYV : JPEG_ENC_GRAYSCALE;
+            uint16_t w = sizes[s].w;
+            uint16_t h = sizes[s].h;
+            if (format == JPEG_ENC_YUYV && (w & 1)) {
+                CHECK(jpeg_enc_encode(&enc, s_img, w, h, 0, format, s_out, OUT_SIZE) == 0,
+                      "YUYV at odd width %u accepted", w);
+                continue;
+            }
+            for (int q = 1; q <= 100; q += 33) {
+                jpeg_enc_set_quality(&enc, q);
+                make_scene(w, h, format, (uint32_t)(w * 7 + q));
+                size_t len = jpeg_enc_encode(&enc, s_img, w, h, 0, format, s_out, OUT_SIZE);
+                CHECK(len > 0, "%ux%u %s q%d: encode failed", w, h, f ? "yuyv" : "gray", q);
+                CHECK(reference_decode(s_out, len, w, h, f ? 3 : 1), "%ux%u %s q%d: libjpeg rejects it", w, h,
+                      f ? "yuyv" : "gray", q);
+                frames++;
+            }
+        }
+    }
+
+    // A window of a wider buffer, as a stage that crops would pass it
+    uint16_t stride = MAX_W;
+    make_scene(MAX_W, 100, JPEG_ENC_GRAYSCALE, 5);
+    size_t len = jpeg_enc_encode(&enc, s_img + 10 * stride + 16, 200, 80, stride, JPEG_ENC_GRAYSCALE, s_out,
+                                 OUT_SIZE);
+    CHECK(len > 0 && reference_decode(s_out, len, 200, 80, 1), "200x80 window with stride %u", stride);
+
+    // Too small an output buffer is an error, not an overrun
+    make_scene(320, 240, JPEG_ENC_GRAYSCALE, 6);
+    len = jpeg_enc_encode(&enc, s_img, 320, 240, 0, JPEG_ENC_GRAYSCALE, s_out, OUT_SIZE);
+    CHECK(jpeg_enc_encode(&enc, s_img, 320, 240, 0, JPEG_ENC_GRAYSCALE, s_out, len - 1) == 0,
+          "encoded into %zu bytes of %zu", len - 1, len);
+    printf("ok %d\n", frames + 1);
+    return 0;
+}
+
+// PSNR and size against libjpeg across the quality range, at QVGA
+static int test_quality(void)
+{
+    static const int qualities[] = { 10, 20, 30, 40, 50, 60, 70, 80, 90, 95 };
+    const uint16_t w = 320;
+    const uint16_t h = 240;
+    jpeg_enc_t enc;
+
+    jpeg_enc_init(&enc, 50);
+    for (int f = 0; f < 2; f++) {
+        jpeg_enc_format_t format = f ? JPEG_ENC_YUYV : JPEG_ENC_GRAYSCALE;
+        double last_psnr = 0;
+        size_t last_len = 0;
+
+        make_scene(w, h, format, 42);
+        for (size_t i = 0; i < sizeof(qualities) / sizeof(qualities[0]); i++) {
+            int q = qualities[i];
+            double y_ours, c_ours, y_ref, c_ref;
+
+            jpeg_enc_set_quality(&enc, q);
+            size_t len = jpeg_enc_encode(&enc, s_img, w, h, 0, format, s_out, OUT_SIZE);
+            CHECK(len > 0 && reference_decode(s_out, len, w, h, f ? 3 : 1), "q%d: decode failed", q);
+            psnr(w, h, format, &y_ours, &c_ours);
+
+            uint8_t *ref = NULL;
+            size_t ref_len = reference_encode(w, h, format, q, &ref);
+            CHECK(ref_len > 0 && reference_decode(ref, ref_len, w, h, f ? 3 : 1), "q%d: libjpeg round trip", q);
+            free(ref);
+            psnr(w, h, format, &y_ref, &c_ref);
+
+            const char *name = f ? "yuyv" : "gray";
+            CHECK(y_ours >= y_ref - 0.3, "%s q%d: luma PSNR %.2f dB, libjpeg %.2f dB", name, q, y_ours, y_ref);
+            CHECK(!f || c_ours >= c_ref - 0.3, "%s q%d: chroma PSNR %.2f dB, libjpeg %.2f dB", name, q, c_ours,
+                  c_ref);
+            CHECK(len * 100 <= ref_len * 104 && len * 100 >= ref_len * 96, "%s q%d: %zu bytes, libjpeg %zu", name,
+                  q, len, ref_len);
+            CHECK(y_ours > last_psnr && len > last_len, "%s q%d: %.2f dB, %zu bytes, not above q%d", name, q, y_ours,
+                  len, qualities[i - 1]);
+            last_psnr = y_ours;
+            last_len = len;
+            printf("%s %d %zu %.2f %.2f %zu %.2f\n", name, q, len, y_ours, f ? c_ours : 0.0, ref_len, y_ref);
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Encode time of QVGA and VGA YUYV at quality 80 (sensor quality 12)
+static int test_bench(void)
+{
+    static const struct {
+        uint16_t w, h;
+        int n;
+    } sizes[] = { { 320, 240, 200 }, { 640, 480, 50 } };
+    jpeg_enc_t enc;
+
+    jpeg_enc_init(&enc, 80);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint16_t w = sizes[s].w;
+        uint16_t h = sizes[s].h;
+        size_t len = 0;
+        size_t ref_len = 0;
+
+        make_scene(w, h, JPEG_ENC_YUYV, 7);
+        double start = now_us();
+        for (int i = 0; i < sizes[s].n; i++) {
+            len = jpeg_enc_encode(&enc, s_img, w, h, 0, JPEG_ENC_YUYV, s_out, OUT_SIZE);
+        }
+        double ours_us = (now_us() - start) / sizes[s].n;
+        start = now_us();
+        for (int i = 0; i < sizes[s].n; i++) {
+            uint8_t *ref = NULL;
+            ref_len = reference_encode(w, h, JPEG_ENC_YUYV, 80, &ref);
+            free(ref);
+        }
+        double ref_us = (now_us() - start) / sizes[s].n;
+        CHECK(len > 0 && ref_len > 0, "%ux%u: encode failed", w, h);
+        printf("%ux%u %zu %.0f %.1f %.0f\n", w, h, len, ours_us, w * h / ours_us, ref_us);
+    }
+    printf("ok\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim decode|quality|bench\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "decode") == 0) {
+        return test_decode();
+    }
+    if (strcmp(argv[1], "quality") == 0) {
+        return test_quality();
+    }
+    if (strcmp(argv[1], "bench") == 0) {
+        return test_bench();
+    }
+    fprintf(stderr, "usage: sim decode|quality|bench\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/jpeg_enc.c -ljpeg -lm -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets OUTPUT to its lines and RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    local last=${out##*$'\n'}
+    if [ "${last%% *}" != "ok" ] && [ "$last" != "ok" ]; then
+        print_fail "${last#fail }"
+        return 1
+    fi
+    OUTPUT=$out
+    RESULT=${last#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test that libjpeg decodes every frame cleanly
+test_decode() {
+    print_test "Decoding with libjpeg..."
+
+    run_sim decode || return 1
+    print_pass "$RESULT frames from 8x8 to 640x480, partial MCUs and a strided window, decoded without warnings"
+    return 0
+}
+
+# Test PSNR and size against libjpeg
+test_quality() {
+    print_test "PSNR and size against libjpeg at 320x240..."
+
+    run_sim quality || return 1
+    echo "       format  q   bytes  luma dB  chroma dB   libjpeg bytes  luma dB"
+    while read -r name q len y c ref_len ref_y; do
+        [ "$name" = "ok" ] && continue
+        [ "$name" = "gray" ] && c="-"
+        printf "       %-5s %3d %7d %8s %10s %15d %8s\n" "$name" "$q" "$len" "$y" "$c" "$ref_len" "$ref_y"
+    done <<< "$OUTPUT"
+    print_pass "Within 0.3 dB and 4% of libjpeg at every quality, rising with quality"
+    return 0
+}
+
+# Time the encoder
+test_bench() {
+    print_test "Timing YUYV encodes at quality 80..."
+
+    run_sim bench || return 1
+    while read -r size len us mpix ref_us; do
+        [ "$size" = "ok" ] && continue
+        print_pass "$size: $len bytes in $us us ($mpix Mpixel/s), libjpeg $ref_us us"
+    done <<< "$OUTPUT"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera JPEG Encoder Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+    if ! printf '#include <stdio.h>\n#include <jpeglib.h>\n' | gcc -E -x c - >/dev/null 2>&1; then
+        print_pass "libjpeg headers not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_decode test_quality test_bench; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
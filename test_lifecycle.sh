@@ -0,0 +1,420 @@
+#!/bin/bash
+# Test script for the service lifecycle state machine
+# Usage: ./test_lifecycle.sh
+#
+# Drives main/lifecycle.c the way app_main does: camera and WiFi report their
+# state, the start actions it returns are "executed" by reporting the service
+# UP (or FAILED), and the tests check that services start only after their
+# dependencies (HTTP after WiFi, stream after HTTP and camera, OTA after HTTP)
+# and are torn down when a dependency is lost.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "lifecycle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAMERA LIFECYCLE_SVC_CAMERA
+#define WIFI LIFECYCLE_SVC_WIFI
+#define HTTP LIFECYCLE_SVC_HTTP
+#define STREAM LIFECYCLE_SVC_STREAM
+#define OTA LIFECYCLE_SVC_OTA
+#define START(svc) LIFECYCLE_ACTION_START(svc)
+#define STOP(svc) LIFECYCLE_ACTION_STOP(svc)
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+static lifecycle_t lc;
+static uint32_t now;
+
+// Services started, in the order app_main would have started them
+static char trace[256];
+
+static void record(const char *what, lifecycle_service_t svc)
+{
+    char item[32];
+    snprintf(item, sizeof(item), "%s%s%s", trace[0] ? " " : "", what, lifecycle_service_name(svc));
+    strncat(trace, item, sizeof(trace) - strlen(trace) - 1);
+}
+
+// Report a state change and execute the actions as app_main does: stops in
+// reverse order, then starts in order, each start succeeding (or failing for
+// the services in fail_mask) and reported back
+static void report(lifecycle_service_t svc, lifecycle_state_t state, uint32_t fail_mask)
+{
+    uint32_t pending[8];
+    int n = 0;
+
+    now += 10;
+    pending[n++] = lifecycle_update(&lc, svc, state, now);
+    for (int i = 0; i < n; i++) {
+        uint32_t actions = pending[i];
+        for (int s = LIFECYCLE_SVC_COUNT - 1; s >= 0; s--) {
+            if (actions & STOP(s)) {
+                record("-", s);
+            }
+        }
+        for (int s = 0; s < LIFECYCLE_SVC_COUNT; s++) {
+            if (actions & START(s)) {
+                record("+", s);
+                now += 10;
+                lifecycle_state_t result = (fail_mask & (1u << s)) ? LIFECYCLE_STATE_FAILED : LIFECYCLE_STATE_UP;
+                if (n < 8) {
+                    pending[n++] = lifecycle_update(&lc, s, result, now);
+                }
+            }
+        }
+    }
+}
+
+static void boot(void)
+{
+    lifecycle_reset(&lc);
+    now = 0;
+    trace[0] = '\0';
+}
+
+static int test_order(void)
+{
+    // Camera first, as in most boots
+    boot();
+    report(CAMERA, LIFECYCLE_STATE_UP, 0);
+    CHECK(trace[0] == '\0', "camera alone started \"%s\"", trace);
+    report(WIFI, LIFECYCLE_STATE_UP, 0);
+    CHECK(strcmp(trace, "+http +stream +ota") == 0, "started \"%s\"", trace);
+    CHECK(lifecycle_all_up(&lc), "not all up");
+
+    // WiFi first: HTTP and OTA come up, the stream waits for the camera
+    boot();
+    report(WIFI, LIFECYCLE_STATE_UP, 0);
+    CHECK(strcmp(trace, "+http +ota") == 0, "started \"%s\" without the camera", trace);
+    CHECK(lc.state[STREAM] == LIFECYCLE_STATE_DOWN, "stream %s", lifecycle_state_name(lc.state[STREAM]));
+    CHECK(!lifecycle_all_up(&lc), "all up without the camera");
+    report(CAMERA, LIFECYCLE_STATE_UP, 0);
+    CHECK(strcmp(trace, "+http +ota +stream") == 0, "started \"%s\"", trace);
+    CHECK(lifecycle_all_up(&lc), "not all up");
+    printf("ok\n");
+    return 0;
+}
+
+static int test_start_actions(void)
+{
+    boot();
+    // Nothing managed starts before its dependencies are UP, not just starting
+    CHECK(lifecycle_update(&lc, WIFI, LIFECYCLE_STATE_STARTING, 1) == 0, "actions for WiFi starting");
+    CHECK(lifecycle_update(&lc, CAMERA, LIFECYCLE_STATE_UP, 2) == 0, "actions for the camera alone");
+    CHECK(lifecycle_update(&lc, WIFI, LIFECYCLE_STATE_UP, 3) == START(HTTP), "WiFi up did not start only HTTP");
+    CHECK(lc.state[HTTP] == LIFECYCLE_STATE_STARTING, "http %s", lifecycle_state_name(lc.state[HTTP]));
+    // A starting HTTP server is not enough for its dependents
+    CHECK(lifecycle_update(&lc, CAMERA, LIFECYCLE_STATE_UP, 4) == 0, "started on a starting HTTP");
+    CHECK(lifecycle_update(&lc, HTTP, LIFECYCLE_STATE_UP, 5) == (START(STREAM) | START(OTA)),
+          "HTTP up did not start stream and OTA");
+    // Reporting the same state again starts nothing twice
+    CHECK(lifecycle_update(&lc, HTTP, LIFECYCLE_STATE_UP, 6) == 0, "duplicate start");
+    CHECK(lc.up_count[HTTP] == 1 && lc.first_up_ms[HTTP] == 5, "http up %lu times, first at %lu",
+          (unsigned long)lc.up_count[HTTP], (unsigned long)lc.first_up_ms[HTTP]);
+    printf("ok\n");
+    return 0;
+}
+
+static int test_wifi_lost(void)
+{
+    boot();
+    report(CAMERA, LIFECYCLE_STATE_UP, 0);
+    report(WIFI, LIFECYCLE_STATE_UP, 0);
+    trace[0] = '\0';
+
+    // Everything on the HTTP server goes, dependents first
+    uint32_t actions = lifecycle_update(&lc, WIFI, LIFECYCLE_STATE_DOWN, ++now);
+    CHECK(actions == (STOP(HTTP) | STOP(STREAM) | STOP(OTA)), "actions 0x%lx", (unsigned long)actions);
+    for (int s = HTTP; s <= OTA; s++) {
+        CHECK(lc.state[s] == LIFECYCLE_STATE_DOWN, "%s %s", lifecycle_service_name(s),
+              lifecycle_state_name(lc.state[s]));
+    }
+    CHECK(lc.state[CAMERA] == LIFECYCLE_STATE_UP, "camera torn down with WiFi");
+
+    // And comes back in order
+    report(WIFI, LIFECYCLE_STATE_UP, 0);
+    CHECK(strcmp(trace, "+http +stream +ota") == 0, "restarted \"%s\"", trace);
+    CHECK(lc.up_count[HTTP] == 2 && lc.up_count[STREAM] == 2, "up counts %lu %lu",
+          (unsigned long)lc.up_count[HTTP], (unsigned long)lc.up_count[STREAM]);
+    printf("ok\n");
+    return 0;
+}
+
+static int test_dependency_lost(void)
+{
+    boot();
+    report(CAMERA, LIFECYCLE_STATE_UP, 0);
+    report(WIFI, LIFECYCLE_STATE_UP, 0);
+
+    // Losing the camera stops the stream only
+    uint32_t actions = lifecycle_update(&lc, CAMERA, LIFECYCLE_STATE_FAILED, ++now);
+    CHECK(actions == STOP(STREAM), "camera lost: actions 0x%lx", (unsigned long)actions);
+    CHECK(lc.state[HTTP] == LIFECYCLE_STATE_UP && lc.state[OTA] == LIFECYCLE_STATE_UP, "HTTP or OTA stopped");
+    // A failed camera blocks the stream for good, so the rest counts as all up
+    CHECK(lifecycle_all_up(&lc), "not all up with the camera failed");
+    actions = lifecycle_update(&lc, CAMERA, LIFECYCLE_STATE_UP, ++now);
+    CHECK(actions == START(STREAM), "camera back: actions 0x%lx", (unsigned long)actions);
+    lifecycle_update(&lc, STREAM, LIFECYCLE_STATE_UP, ++now);
+
+    // The HTTP server going down takes its dependents, not WiFi or the camera
+    actions = lifecycle_update(&lc, HTTP, LIFECYCLE_STATE_DOWN, ++now);
+    CHECK((actions & (STOP(STREAM) | STOP(OTA))) == (STOP(STREAM) | STOP(OTA)),
+          "http down: actions 0x%lx", (unsigned long)actions);
+    CHECK(!(actions & (STOP(WIFI) | STOP(CAMERA))), "stopped an external service");
+
+    // A dependency lost while a service is still starting stops it too
+    boot();
+    report(CAMERA, LIFECYCLE_STATE_UP, 0);
+    lifecycle_update(&lc, WIFI, LIFECYCLE_STATE_UP, ++now);
+    CHECK(lc.state[HTTP] == LIFECYCLE_STATE_STARTING, "http %s", lifecycle_state_name(lc.state[HTTP]));
+    actions = lifecycle_update(&lc, WIFI, LIFECYCLE_STATE_DOWN, ++now);
+    CHECK(actions == STOP(HTTP), "starting http not stopped: 0x%lx", (unsigned long)actions);
+    printf("ok\n");
+    return 0;
+}
+
+static int test_failed(void)
+{
+    boot();
+    report(CAMERA, LIFECYCLE_STATE_UP, 0);
+    // The HTTP server fails to start: nothing above it is attempted
+    report(WIFI, LIFECYCLE_STATE_UP, 1u << HTTP);
+    CHECK(strcmp(trace, "+http") == 0, "started \"%s\"", trace);
+    CHECK(lc.state[HTTP] == LIFECYCLE_STATE_FAILED, "http %s", lifecycle_state_name(lc.state[HTTP]));
+    CHECK(!lifecycle_all_up(&lc), "all up with HTTP failed");
+
+    // It is not retried while WiFi stays up, and gets a fresh attempt once
+    // WiFi has gone and come back
+    CHECK(lifecycle_update(&lc, CAMERA, LIFECYCLE_STATE_UP, ++now) == 0, "failed http retried");
+    CHECK(lifecycle_update(&lc, WIFI, LIFECYCLE_STATE_DOWN, ++now) == 0, "stop for a failed service");
+    CHECK(lc.state[HTTP] == LIFECYCLE_STATE_DOWN, "http %s", lifecycle_state_name(lc.state[HTTP]));
+    trace[0] = '\0';
+    report(WIFI, LIFECYCLE_STATE_UP, 0);
+    CHECK(strcmp(trace, "+http +stream +ota") == 0, "retried \"%s\"", trace);
+    printf("ok\n");
+    return 0;
+}
+
+// Random camera and WiFi changes and start results: a managed service is
+// only ever STARTING or UP while its dependencies are UP, and every service
+// whose dependencies are UP is not left DOWN
+static int test_random(void)
+{
+    static const uint32_t deps[LIFECYCLE_SVC_COUNT] = {
+        [HTTP] = 1u << WIFI,
+        [STREAM] = (1u << HTTP) | (1u << CAMERA),
+        [OTA] = 1u << HTTP,
+    };
+    unsigned long starts = 0, stops = 0;
+
+    boot();
+    srand(26);
+    for (int step = 0; step < 200000; step++) {
+        lifecycle_service_t svc = rand() % LIFECYCLE_SVC_COUNT;
+        lifecycle_state_t state;
+        if (svc == CAMERA || svc == WIFI) {
+            state = rand() % 4;
+        } else if (lc.state[svc] == LIFECYCLE_STATE_STARTING) {
+            state = rand() % 5 ? LIFECYCLE_STATE_UP : LIFECYCLE_STATE_FAILED;
+        } else if (lc.state[svc] == LIFECYCLE_STATE_UP && rand() % 10 == 0) {
+            state = LIFECYCLE_STATE_FAILED;
+        } else {
+            continue;
+        }
+        uint32_t actions = lifecycle_update(&lc, svc, state, ++now);
+
+        for (int s = 0; s < LIFECYCLE_SVC_COUNT; s++) {
+            CHECK(!((actions & START(s)) && (actions & STOP(s))), "%s started and stopped at once",
+                  lifecycle_service_name(s));
+            starts += (actions & START(s)) != 0;
+            stops += (actions & STOP(s)) != 0;
+            if (deps[s] == 0) {
+                CHECK(!(actions & (START(s) | STOP(s))), "action for external %s", lifecycle_service_name(s));
+                continue;
+            }
+            bool deps_up = true;
+            for (int d = 0; d < LIFECYCLE_SVC_COUNT; d++) {
+                if ((deps[s] & (1u << d)) && lc.state[d] != LIFECYCLE_STATE_UP) {
+                    deps_up = false;
+                }
+            }
+            if (lc.state[s] == LIFECYCLE_STATE_STARTING || lc.state[s] == LIFECYCLE_STATE_UP) {
+                CHECK(deps_up, "%s %s without its dependencies at step %d", lifecycle_service_name(s),
+                      lifecycle_state_name(lc.state[s]), step);
+            }
+            if (lc.state[s] == LIFECYCLE_STATE_DOWN && !(actions & STOP(s))) {
+                CHECK(!deps_up, "%s left down with its dependencies up at step %d", lifecycle_service_name(s),
+                      step);
+            }
+        }
+    }
+    CHECK(starts > 1000 && stops > 1000, "only %lu starts, %lu stops", starts, stops);
+    printf("ok %lu %lu\n", starts, stops);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim order|start|wifi_lost|dep_lost|failed|random\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "order") == 0) {
+        return test_order();
+    }
+    if (strcmp(argv[1], "start") == 0) {
+        return test_start_actions();
+    }
+    if (strcmp(argv[1], "wifi_lost") == 0) {
+        return test_wifi_lost();
+    }
+    if (strcmp(argv[1], "dep_lost") == 0) {
+        return test_dependency_lost();
+    }
+    if (strcmp(argv[1], "failed") == 0) {
+        return test_failed();
+    }
+    if (strcmp(argv[1], "random") == 0) {
+        return test_random();
+    }
+    fprintf(stderr, "usage: sim order|start|wifi_lost|dep_lost|failed|random\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/lifecycle.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the start order for both bring-up races
+test_order() {
+    print_test "Starting services as camera and WiFi come up..."
+
+    run_sim order || return 1
+    print_pass "HTTP after WiFi, stream after HTTP and camera, OTA after HTTP"
+    return 0
+}
+
+# Test the action masks for single state changes
+test_start() {
+    print_test "Start actions for each state change..."
+
+    run_sim start || return 1
+    print_pass "Started only on UP dependencies, never twice"
+    return 0
+}
+
+# Test teardown and restart when WiFi is lost
+test_wifi_lost() {
+    print_test "Losing WiFi..."
+
+    run_sim wifi_lost || return 1
+    print_pass "HTTP, stream and OTA stopped, camera kept, restarted in order"
+    return 0
+}
+
+# Test teardown when the camera or the HTTP server goes
+test_dep_lost() {
+    print_test "Losing the camera and the HTTP server..."
+
+    run_sim dep_lost || return 1
+    print_pass "Only the dependents stopped, a starting service too"
+    return 0
+}
+
+# Test a service that fails to start
+test_failed() {
+    print_test "HTTP server failing to start..."
+
+    run_sim failed || return 1
+    print_pass "Dependents not attempted, retried after WiFi came back"
+    return 0
+}
+
+# Test random state changes against the dependency invariants
+test_random() {
+    print_test "Random state changes..."
+
+    run_sim random || return 1
+    read -r starts stops <<< "$RESULT"
+    print_pass "$starts starts, $stops stops, invariants held"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Service Lifecycle Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_order test_start test_wifi_lost test_dep_lost test_failed test_random; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,576 @@
+#!/bin/bash
+# Test script for the lock-free log line ring
+# Usage: ./test_log_ring.sh
+#
+# Builds main/log_ring.c for the host and checks it against a FIFO model on
+# one thread, with the position counters started just below their 32-bit
+# wrap, then runs several pthread writers against one drain thread
+# (STRESS_SECONDS, 2 by default): lines from each writer come out whole and
+# in order, a full ring drops and counts instead of blocking, and every line
+# is either drained or counted as dropped. Also checks the per-call-site
+# rate limiter, across a wrap of the millisecond clock, and times the write
+# path of one log call (ns per line).
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_stress() {
+    cat > "$WORK_DIR/stress.c" <<'EOF'
+#include "log_ring.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define WRITERS 4
+
+static log_ring_slot_t s_slots[64];
+static log_ring_t s_ring;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Lines are "<writer> <n> " padded with a pattern derived from both, so a
+// torn or mixed-up slot shows
+static uint16_t format_line(char *text, uint32_t writer, uint32_t n)
+{
+    int len = snprintf(text, LOG_RING_LINE_MAX, "%u %u ", writer, n);
+    int total = 16 + (int)((writer * 7 + n) % (LOG_RING_LINE_MAX - 16));
+    for (int i = len; i < total; i++) {
+        text[i] = (char)('a' + (writer + n + i) % 26);
+    }
+    return (uint16_t)total;
+}
+
+static bool parse_line(const log_ring_slot_t *slot, uint32_t *writer, uint32_t *n)
+{
+    char text[LOG_RING_LINE_MAX];
+    char expect[LOG_RING_LINE_MAX];
+
+    if (slot->len == 0 || slot->len > LOG_RING_LINE_MAX) {
+        return false;
+    }
+    memcpy(text, slot->text, slot->len);
+    text[slot->len < LOG_RING_LINE_MAX ? slot->len : LOG_RING_LINE_MAX - 1] = '\0';
+    if (sscanf(text, "%u %u", writer, n) != 2) {
+        return false;
+    }
+    return format_line(expect, *writer, *n) == slot->len && memcmp(expect, slot->text, slot->len) == 0;
+}
+
+static bool write_line(log_ring_t *ring, uint32_t writer, uint32_t n)
+{
+    log_ring_slot_t *slot = log_ring_reserve(ring);
+    if (slot == NULL) {
+        return false;
+    }
+    slot->len = format_line(slot->text, writer, n);
+    slot->suppressed = 0;
+    log_ring_commit(ring, slot);
+    return true;
+}
+
+// Move both positions to `base` as if that many lines had gone through
+static void rebase(log_ring_t *ring, uint32_t base)
+{
+    uint32_t capacity = ring->mask + 1;
+    for (uint32_t k = 0; k < capacity; k++) {
+        atomic_store(&ring->slots[(base + k) & ring->mask].seq, base + k);
+    }
+    atomic_store(&ring->head, base);
+    ring->tail = base;
+}
+
+static int test_init(void)
+{
+    log_ring_stats_t stats;
+
+    CHECK(log_ring_init(&s_ring, s_slots, 1, 0, 0) == 0, "1 slot accepted");
+    log_ring_get_stats(&s_ring, &stats);
+    CHECK(stats.capacity == 0, "capacity %u without slots", stats.capacity);
+    CHECK(log_ring_init(&s_ring, s_slots, 2, 0, 0) == 2, "2 slots");
+    CHECK(log_ring_init(&s_ring, s_slots, 10, 0, 0) == 8, "10 slots not rounded down to 8");
+    CHECK(log_ring_init(&s_ring, s_slots, 64, 0, 0) == 64, "64 slots");
+    CHECK(log_ring_peek(&s_ring) == NULL, "line in an empty ring");
+    printf("ok\n");
+    return 0;
+}
+
+// Random writes and drains against a FIFO model, starting `base` lines in
+static int run_model(uint32_t base, int steps)
+{
+    uint32_t fifo[8];
+    uint32_t fifo_head = 0;
+    uint32_t fifo_len = 0;
+    uint32_t next = 0;
+    uint32_t drops = 0;
+    log_ring_stats_t stats;
+
+    log_ring_init(&s_ring, s_slots, 8, 0, 0);
+    rebase(&s_ring, base);
+    for (int step = 0; step < steps; step++) {
+        if (rand() % 2) {
+            bool ok = write_line(&s_ring, 0, next);
+            CHECK(ok == (fifo_len < 8), "base %u step %d: write %s with %u queued", base, step,
+                  ok ? "accepted" : "dropped", fifo_len);
+            if (ok) {
+                fifo[(fifo_head + fifo_len++) % 8] = next;
+            } else {
+                drops++;
+            }
+            next++;
+        } else {
+            log_ring_slot_t *slot = log_ring_peek(&s_ring);
+            CHECK((slot != NULL) == (fifo_len > 0), "base %u step %d: peek %s with %u queued", base, step,
+                  slot ? "found a line" : "empty", fifo_len);
+            if (slot == NULL) {
+                continue;
+            }
+            uint32_t writer;
+            uint32_t n;
+            CHECK(parse_line(slot, &writer, &n), "base %u step %d: torn line", base, step);
+            CHECK(n == fifo[fifo_head], "base %u step %d: line %u, expected %u", base, step, n, fifo[fifo_head]);
+            log_ring_release(&s_ring);
+            fifo_head = (fifo_head + 1) % 8;
+            fifo_len--;
+        }
+    }
+    log_ring_get_stats(&s_ring, &stats);
+    CHECK(stats.written == next - drops && stats.dropped == drops, "base %u: %u written, %u dropped, model %u/%u",
+          base, stats.written, stats.dropped, next - drops, drops);
+    return 0;
+}
+
+static int test_ring(void)
+{
+    log_ring_stats_t stats;
+
+    // Fill, overflow, drain part, refill
+    log_ring_init(&s_ring, s_slots, 8, 0, 0);
+    for (uint32_t i = 0; i < 8; i++) {
+        CHECK(write_line(&s_ring, 1, i), "line %u dropped", i);
+    }
+    CHECK(!write_line(&s_ring, 1, 8), "ninth line accepted");
+    for (uint32_t i = 0; i < 3; i++) {
+        uint32_t writer;
+        uint32_t n;
+        log_ring_slot_t *slot = log_ring_peek(&s_ring);
+        CHECK(slot != NULL && parse_line(slot, &writer, &n) && n == i, "line %u not first", i);
+        log_ring_release(&s_ring);
+    }
+    for (uint32_t i = 9; i < 12; i++) {
+        CHECK(write_line(&s_ring, 1, i), "line %u dropped after a drain", i);
+    }
+    CHECK(!write_line(&s_ring, 1, 12), "line 12 accepted");
+    log_ring_get_stats(&s_ring, &stats);
+    CHECK(stats.written == 11 && stats.dropped == 2, "%u written, %u dropped", stats.written, stats.dropped);
+
+    // An empty ring stays empty right at the 32-bit position wrap
+    for (uint32_t base = 0xfffffffcu; base != 4; base++) {
+        uint32_t writer;
+        uint32_t n;
+        log_ring_init(&s_ring, s_slots, 8, 0, 0);
+        rebase(&s_ring, base);
+        CHECK(log_ring_peek(&s_ring) == NULL, "line in an empty ring at %u", base);
+        CHECK(write_line(&s_ring, 2, base), "line dropped at %u", base);
+        log_ring_slot_t *slot = log_ring_peek(&s_ring);
+        CHECK(slot != NULL && parse_line(slot, &writer, &n) && n == base, "line lost at %u", base);
+        log_ring_release(&s_ring);
+        CHECK(log_ring_peek(&s_ring) == NULL, "line seen twice at %u", base);
+    }
+
+    // Long random runs, from zero and across the 32-bit position wrap
+    srand(36);
+    if (run_model(0, 200000) != 0 || run_model(0xfffffff0u, 200000) != 0 ||
+        run_model(0x7ffffff8u, 200000) != 0) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static int test_limit(void)
+{
+    static const char site_a[] = "frame %u late";
+    static const char site_b[] = "socket %d closed";
+    uintptr_t a = (uintptr_t)site_a;
+    uintptr_t b = (uintptr_t)site_b;
+    uint32_t suppressed;
+    int admitted = 0;
+
+    // 3 lines per second per call site
+    log_ring_init(&s_ring, s_slots, 8, 3, 1000);
+    for (int i = 0; i < 10; i++) {
+        admitted += log_ring_admit(&s_ring, a, 5000 + i, &suppressed);
+        CHECK(suppressed == 0, "suppressed %u inside the first window", suppressed);
+    }
+    CHECK(admitted == 3, "%d of 10 admitted", admitted);
+    CHECK(log_ring_admit(&s_ring, 0, 5000, &suppressed), "key 0 limited");
+    CHECK(log_ring_admit(&s_ring, a, 5999, &suppressed) == false, "admitted before the window ended");
+    CHECK(log_ring_admit(&s_ring, a, 6000, &suppressed) && suppressed == 8,
+          "next window: %u suppressed reported, expected 8", suppressed);
+    CHECK(log_ring_admit(&s_ring, a, 6001, &suppressed) && suppressed == 0, "suppressed count reported twice");
+
+    // Call sites are limited independently, unless they share a table
+    // entry (then the later one is not limited at all)
+    int b_admitted = 0;
+    for (int i = 0; i < 10; i++) {
+        b_admitted += log_ring_admit(&s_ring, b, 6002, &suppressed);
+    }
+    CHECK(b_admitted == 3 || b_admitted == 10, "%d of 10 from a second site", b_admitted);
+
+    // The millisecond clock wraps after 49 days
+    log_ring_init(&s_ring, s_slots, 8, 2, 1000);
+    uint32_t t = 0xffffff00u;
+    admitted = 0;
+    for (int i = 0; i < 6; i++) {
+        admitted += log_ring_admit(&s_ring, a, t + i, &suppressed);
+    }
+    CHECK(admitted == 2, "%d of 6 admitted before the wrap", admitted);
+    CHECK(!log_ring_admit(&s_ring, a, t + 999, &suppressed), "admitted across the wrap inside the window");
+    CHECK(log_ring_admit(&s_ring, a, t + 1000, &suppressed) && suppressed == 5,
+          "after the wrap: %u suppressed, expected 5", suppressed);
+
+    log_ring_stats_t stats;
+    log_ring_get_stats(&s_ring, &stats);
+    CHECK(stats.suppressed == 5, "%u suppressed in stats", stats.suppressed);
+    printf("ok\n");
+    return 0;
+}
+
+static atomic_bool s_stop;
+static atomic_uint s_attempts;
+
+static void *writer_task(void *arg)
+{
+    uint32_t writer = (uint32_t)(uintptr_t)arg;
+    uint32_t n = 0;
+
+    while (!atomic_load(&s_stop)) {
+        bool written = write_line(&s_ring, writer, n++);
+        atomic_fetch_add(&s_attempts, 1);
+        if (!written) {
+            // Give the drain thread a chance on a small host
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static int test_stress(double seconds)
+{
+    pthread_t threads[WRITERS];
+    int64_t last[WRITERS + 1];
+    uint32_t drained = 0;
+    uint32_t gaps = 0;
+
+    log_ring_init(&s_ring, s_slots, 64, 0, 0);
+    atomic_store(&s_stop, false);
+    for (int i = 1; i <= WRITERS; i++) {
+        last[i] = -1;
+        pthread_create(&threads[i - 1], NULL, writer_task, (void *)(uintptr_t)i);
+    }
+
+    // Drain; writers stop when the time is up, then the rest is drained
+    double end = now_s() + seconds;
+    bool stopping = false;
+    while (true) {
+        log_ring_slot_t *slot = log_ring_peek(&s_ring);
+        if (slot == NULL) {
+            if (stopping) {
+                break;
+            }
+            if (now_s() >= end) {
+                atomic_store(&s_stop, true);
+                for (int i = 0; i < WRITERS; i++) {
+                    pthread_join(threads[i], NULL);
+                }
+                stopping = true;
+            }
+            continue;
+        }
+        uint32_t writer;
+        uint32_t n;
+        CHECK(parse_line(slot, &writer, &n) && writer >= 1 && writer <= WRITERS, "torn line after %u", drained);
+        CHECK((int64_t)n > last[writer], "writer %u: line %u after %lld", writer, n, (long long)last[writer]);
+        gaps += (int64_t)n != last[writer] + 1;
+        last[writer] = n;
+        log_ring_release(&s_ring);
+        drained++;
+    }
+
+    log_ring_stats_t stats;
+    log_ring_get_stats(&s_ring, &stats);
+    uint32_t attempts = atomic_load(&s_attempts);
+    CHECK(stats.written == drained, "%u written, %u drained", stats.written, drained);
+    CHECK(stats.written + stats.dropped == attempts, "%u written + %u dropped != %u lines", stats.written,
+          stats.dropped, attempts);
+    CHECK(stats.dropped == 0 || gaps > 0, "%u dropped without a gap", stats.dropped);
+    printf("ok %u %u\n", drained, stats.dropped);
+    return 0;
+}
+
+// The write path of async_log_vprintf: admit, reserve, format, commit
+static bool log_line(log_ring_t *ring, uint32_t now_ms, const char *fmt, ...)
+{
+    uint32_t suppressed;
+    if (!log_ring_admit(ring, (uintptr_t)fmt, now_ms, &suppressed)) {
+        return false;
+    }
+    log_ring_slot_t *slot = log_ring_reserve(ring);
+    if (slot == NULL) {
+        return false;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    va_end(args);
+    slot->len = len < (int)sizeof(slot->text) ? len : sizeof(slot->text) - 1;
+    slot->suppressed = suppressed;
+    log_ring_commit(ring, slot);
+    return true;
+}
+
+static const char s_bench_fmt[] = "W (%u) video_stream: frame %u late by %d ms\n";
+
+// Nanoseconds per log call: written into a ring with room, refused by the
+// rate limiter, and with every writer thread at it together. The contended
+// ring is big enough that nothing is dropped, so it is the write that is
+// timed and not the drop path.
+#define BENCH_LINES_PER_WRITER 16384
+
+static log_ring_t s_bench_ring;
+static atomic_int s_bench_ready;
+
+static void *bench_writer(void *arg)
+{
+    double *elapsed = arg;
+    // Start together
+    atomic_fetch_add(&s_bench_ready, 1);
+    while (atomic_load(&s_bench_ready) < WRITERS) {
+    }
+    double start = now_s();
+    for (uint32_t n = 0; n < BENCH_LINES_PER_WRITER; n++) {
+        log_line(&s_bench_ring, n, s_bench_fmt, n, n, (int)(n % 100));
+    }
+    *elapsed = now_s() - start;
+    return NULL;
+}
+
+static int test_bench(void)
+{
+    const int n = 2000000;
+    const uint32_t batch = 64;
+    double written_s = 0;
+
+    // Fill the ring, time only the writes, drain it and go again
+    log_ring_init(&s_ring, s_slots, batch, 0, 0);
+    for (int done = 0; done < n; done += batch) {
+        double start = now_s();
+        for (uint32_t i = 0; i < batch; i++) {
+            log_line(&s_ring, i, s_bench_fmt, done + i, done + i, (int)(i % 100));
+        }
+        written_s += now_s() - start;
+        for (uint32_t i = 0; i < batch; i++) {
+            CHECK(log_ring_peek(&s_ring) != NULL, "line %u of a batch missing", i);
+            log_ring_release(&s_ring);
+        }
+    }
+    double written_ns = written_s * 1e9 / n;
+
+    // One call site over its burst: the limiter turns the rest away
+    log_ring_init(&s_ring, s_slots, batch, 3, 1000);
+    double start = now_s();
+    for (int i = 0; i < n; i++) {
+        log_line(&s_ring, 5000, s_bench_fmt, i, i, i % 100);
+    }
+    double limited_ns = (now_s() - start) * 1e9 / n;
+    log_ring_stats_t stats;
+    log_ring_get_stats(&s_ring, &stats);
+    CHECK(stats.written == 3 && stats.suppressed == (uint32_t)n - 3, "%u written, %u suppressed", stats.written,
+          stats.suppressed);
+
+    const int rounds = 8;
+    log_ring_slot_t *slots = malloc(sizeof(*slots) * WRITERS * BENCH_LINES_PER_WRITER);
+    double contended_s = 0;
+    CHECK(slots != NULL, "no memory for the contended ring");
+    for (int round = 0; round < rounds; round++) {
+        pthread_t threads[WRITERS];
+        double elapsed[WRITERS];
+        log_ring_init(&s_bench_ring, slots, WRITERS * BENCH_LINES_PER_WRITER, 0, 0);
+        atomic_store(&s_bench_ready, 0);
+        for (int i = 0; i < WRITERS; i++) {
+            pthread_create(&threads[i], NULL, bench_writer, &elapsed[i]);
+        }
+        for (int i = 0; i < WRITERS; i++) {
+            pthread_join(threads[i], NULL);
+            contended_s += elapsed[i];
+        }
+        log_ring_get_stats(&s_bench_ring, &stats);
+        CHECK(stats.written == WRITERS * BENCH_LINES_PER_WRITER && stats.dropped == 0, "%u written, %u dropped",
+              stats.written, stats.dropped);
+    }
+    free(slots);
+    double contended_ns = contended_s * 1e9 / ((double)rounds * WRITERS * BENCH_LINES_PER_WRITER);
+    printf("ok %.0f %.0f %.0f\n", written_ns, limited_ns, contended_ns);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: stress init|ring|limit|stress|bench [seconds]\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "init") == 0) {
+        return test_init();
+    }
+    if (strcmp(argv[1], "ring") == 0) {
+        return test_ring();
+    }
+    if (strcmp(argv[1], "limit") == 0) {
+        return test_limit();
+    }
+    if (strcmp(argv[1], "stress") == 0) {
+        return test_stress(argc > 2 ? atof(argv[2]) : 2.0);
+    }
+    if (strcmp(argv[1], "bench") == 0) {
+        return test_bench();
+    }
+    fprintf(stderr, "usage: stress init|ring|limit|stress|bench [seconds]\n");
+    return 2;
+}
+EOF
+    gcc -std=c11 -O2 -Wall -Werror -pthread -I main "$WORK_DIR/stress.c" main/log_ring.c -o "$WORK_DIR/stress"
+}
+
+# Run one stress command; sets RESULT to what follows "ok"
+run_stress() {
+    local out
+    out=$("$WORK_DIR/stress" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test slot count rounding
+test_init() {
+    print_test "Ring sizes..."
+
+    run_stress init || return 1
+    print_pass "Slot counts rounded down to a power of two, fewer than 2 refused"
+    return 0
+}
+
+# Test order and overflow on one thread
+test_ring() {
+    print_test "Order and overflow against a FIFO model..."
+
+    run_stress ring || return 1
+    print_pass "Lines in order, full ring drops and counts, positions wrap past 2^32"
+    return 0
+}
+
+# Test the per-call-site limiter
+test_limit() {
+    print_test "Per-call-site rate limit..."
+
+    run_stress limit || return 1
+    print_pass "Burst per window, suppressed count reported once, across a clock wrap"
+    return 0
+}
+
+# Test writers racing one drain thread
+test_stress() {
+    print_test "4 writers against one drain thread for ${STRESS_SECONDS}s..."
+
+    run_stress stress "$STRESS_SECONDS" || return 1
+    read -r drained dropped <<< "$RESULT"
+    print_pass "$drained lines drained whole and in order per writer, $dropped dropped and counted"
+    return 0
+}
+
+# Measure one log call
+test_bench() {
+    print_test "Timing the log write path..."
+
+    run_stress bench || return 1
+    read -r written limited contended <<< "$RESULT"
+    print_pass "$written ns uncontended, $contended ns per thread with 4 writers, $limited ns when rate limited"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Log Ring Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    STRESS_SECONDS=${STRESS_SECONDS:-2}
+    local failed_tests=0
+
+    if ! build_stress; then
+        print_fail "Cannot build the stress test"
+        return 1
+    fi
+
+    for t in test_init test_ring test_limit test_stress test_bench; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
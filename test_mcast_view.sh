@@ -0,0 +1,326 @@
+#!/bin/bash
+# Test script for the multicast stream fragmenter and mcast_view.py
+# Usage: ./test_mcast_view.sh
+#
+# Builds a host sender around main/mcast_frag.c and multicasts synthetic
+# frames over loopback to mcast_view.py, with and without injected loss.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+GROUP="239.255.42.99"
+PORT=$((40000 + RANDOM % 20000))
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# Host sender: writes every frame it sends to a directory so the receiver's
+# output can be compared byte for byte. Loss is injected per frame sequence:
+#   seq % drop == 0      one fragment other than the last is never sent,
+#                        unless the previous frame has a late fragment
+#   seq % late == 0      the last fragment is sent after the next frame
+# Every third frame goes out in reverse fragment order, and every fifth one
+# sent in order repeats its first fragment; neither may cost a frame.
+build_sender() {
+    cat > "$WORK_DIR/sender.c" <<'EOF'
+#include "mcast_frag.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int s_fd;
+static struct sockaddr_in s_group;
+
+static void send_fragment(const uint8_t *hdr, const uint8_t *payload, size_t len)
+{
+    uint8_t buf[MCAST_FRAG_DATAGRAM_MAX];
+    memcpy(buf, hdr, MCAST_FRAG_HEADER_LEN);
+    memcpy(buf + MCAST_FRAG_HEADER_LEN, payload, len);
+    sendto(s_fd, buf, MCAST_FRAG_HEADER_LEN + len, 0, (struct sockaddr *)&s_group, sizeof(s_group));
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 8) {
+        fprintf(stderr, "usage: sender GROUP PORT FRAMES DROP LATE PAYLOAD OUTDIR\n");
+        return 2;
+    }
+    int frames = atoi(argv[3]), drop = atoi(argv[4]), late = atoi(argv[5]), payload_max = atoi(argv[6]);
+    static uint8_t hdrs[256][MCAST_FRAG_HEADER_LEN];
+    static const uint8_t *payloads[256];
+    static size_t lens[256];
+    static uint8_t held_hdr[MCAST_FRAG_HEADER_LEN];
+    const uint8_t *held_payload = NULL;
+    size_t held_len = 0;
+
+    s_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct in_addr lo = { .s_addr = htonl(INADDR_LOOPBACK) };
+    unsigned char loop = 1;
+    setsockopt(s_fd, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo));
+    setsockopt(s_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    s_group.sin_family = AF_INET;
+    s_group.sin_port = htons(atoi(argv[2]));
+    inet_aton(argv[1], &s_group.sin_addr);
+
+    // Not a frame at all; the receiver has to shrug it off
+    sendto(s_fd, "hello", 5, 0, (struct sockaddr *)&s_group, sizeof(s_group));
+
+    srand(1);
+    for (uint32_t seq = 1; seq <= (uint32_t)frames; seq++) {
+        size_t len = 2000 + (size_t)rand() % 58000;
+        uint8_t *frame = malloc(len);
+        frame[0] = 0xFF;
+        frame[1] = 0xD8;
+        for (size_t i = 2; i < len - 2; i++) {
+            frame[i] = (uint8_t)rand();
+        }
+        frame[len - 2] = 0xFF;
+        frame[len - 1] = 0xD9;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%08u.jpg", argv[7], seq);
+        FILE *f = fopen(path, "wb");
+        fwrite(frame, 1, len, f);
+        fclose(f);
+
+        mcast_frag_t frag;
+        if (!mcast_frag_begin(&frag, frame, len, seq, seq * 40, payload_max)) {
+            return 1;
+        }
+        int n = 0;
+        while ((lens[n] = mcast_frag_next(&frag, hdrs[n], &payloads[n])) > 0) {
+            n++;
+        }
+
+        for (int k = 0; k < n; k++) {
+            int i = seq % 3 == 0 ? n - 1 - k : k;
+            if (drop && seq % drop == 0 && !(late && (seq - 1) % late == 0) && i == (int)(seq % (n - 1))) {
+                continue;
+            }
+            if (late && seq % late == 0 && i == n - 1) {
+                memcpy(held_hdr, hdrs[i], MCAST_FRAG_HEADER_LEN);
+                held_payload = payloads[i];
+                held_len = lens[i];
+                continue;
+            }
+            send_fragment(hdrs[i], payloads[i], lens[i]);
+            if (seq % 5 == 0 && seq % 3 != 0 && i == 0) {
+                send_fragment(hdrs[i], payloads[i], lens[i]);
+            }
+        }
+        // Frames are not freed: a held fragment points into its frame
+        if (held_payload != NULL && (seq % late) != 0) {
+            send_fragment(held_hdr, held_payload, held_len);
+            held_payload = NULL;
+        }
+        usleep(3000);
+    }
+    return 0;
+}
+EOF
+    gcc -std=c99 -D_DEFAULT_SOURCE -Wall -Werror -I main "$WORK_DIR/sender.c" main/mcast_frag.c -o "$WORK_DIR/sender"
+}
+
+# Run the receiver, send FRAMES frames, and leave its summary in $WORK_DIR/$1.log
+# Usage: run_case NAME FRAMES DROP LATE PAYLOAD
+run_case() {
+    local name=$1
+    mkdir -p "$WORK_DIR/$name/sent" "$WORK_DIR/$name/recv"
+
+    python3 mcast_view.py --group "$GROUP" --port "$PORT" --iface 127.0.0.1 \
+        --save "$WORK_DIR/$name/recv" --duration 4 > "$WORK_DIR/$name.log" 2>&1 &
+    local pid=$!
+
+    for _ in $(seq 50); do
+        grep -q "Joined" "$WORK_DIR/$name.log" 2>/dev/null && break
+        sleep 0.1
+    done
+
+    "$WORK_DIR/sender" "$GROUP" "$PORT" "$2" "$3" "$4" "$5" "$WORK_DIR/$name/sent"
+    wait $pid
+}
+
+# The total count of one field from the receiver's summary line
+summary_field() {
+    grep "^Total:" "$WORK_DIR/$1.log" | grep -o "[0-9]* $2" | awk '{print $1}'
+}
+
+# Every received frame must be byte-identical to the one sent
+compare_frames() {
+    local name=$1
+    for f in "$WORK_DIR/$name/recv"/*.jpg; do
+        [ -e "$f" ] || continue
+        if ! cmp -s "$f" "$WORK_DIR/$name/sent/$(basename "$f")"; then
+            print_fail "$name: $(basename "$f") differs from the frame sent"
+            return 1
+        fi
+    done
+    return 0
+}
+
+# Test that the fragmenter splits frames at the payload size
+test_fragmenter() {
+    print_test "Checking fragment layout..."
+
+    cat > "$WORK_DIR/frag.c" <<'EOF'
+#include "mcast_frag.h"
+#include <stdio.h>
+
+int main(void)
+{
+    static uint8_t frame[3000];
+    uint8_t hdr[MCAST_FRAG_HEADER_LEN];
+    const uint8_t *payload;
+    mcast_frag_t frag;
+    size_t len, total = 0;
+    int n = 0;
+
+    if (mcast_frag_begin(&frag, frame, 0, 1, 0, 1000) || mcast_frag_begin(&frag, frame, 10, 1, 0, 0) ||
+        mcast_frag_begin(&frag, frame, 10, 1, 0, MCAST_FRAG_PAYLOAD_MAX + 1)) {
+        return 1;
+    }
+    if (!mcast_frag_begin(&frag, frame, sizeof(frame), 0x01020304, 7, 1000) || mcast_frag_count(&frag) != 3) {
+        return 2;
+    }
+    while ((len = mcast_frag_next(&frag, hdr, &payload)) > 0) {
+        unsigned offset = (unsigned)hdr[12] << 24 | hdr[13] << 16 | hdr[14] << 8 | hdr[15];
+        if (hdr[0] != 'E' || hdr[1] != 'M' || hdr[2] != 1 || hdr[7] != 4 || hdr[17] != n || hdr[19] != 3 ||
+            hdr[23] != 7 || payload != frame + offset || offset != total) {
+            return 3;
+        }
+        total += len;
+        n++;
+    }
+    return total == sizeof(frame) && n == 3 ? 0 : 4;
+}
+EOF
+    if gcc -std=c99 -Wall -Werror -I main "$WORK_DIR/frag.c" main/mcast_frag.c -o "$WORK_DIR/frag" && "$WORK_DIR/frag"; then
+        print_pass "Fragments cover the frame in order with correct headers"
+    else
+        print_fail "Fragment layout is wrong (exit $?)"
+        return 1
+    fi
+    return 0
+}
+
+# Test that a clean stream arrives complete and intact
+test_lossless() {
+    print_test "Multicasting 60 frames over loopback..."
+
+    run_case lossless 60 0 0 1448
+    local frames=$(summary_field lossless "frames,")
+    local incomplete=$(summary_field lossless "incomplete")
+    local bad=$(summary_field lossless "bad datagrams")
+
+    if [ "$frames" != "60" ] || [ "$incomplete" != "0" ]; then
+        print_fail "Received $frames frames, $incomplete incomplete; expected 60 and 0"
+        cat "$WORK_DIR/lossless.log"
+        return 1
+    fi
+    compare_frames lossless || return 1
+    print_pass "60 frames reassembled byte for byte, reordered and duplicated fragments included"
+
+    if [ "$bad" != "1" ]; then
+        print_fail "Expected the one stray datagram to be counted, got $bad"
+        return 1
+    fi
+    print_pass "Stray datagram ignored"
+    return 0
+}
+
+# Test that frames with a lost or late fragment are dropped, and only those
+test_loss() {
+    print_test "Multicasting 70 frames with injected loss..."
+
+    # Hold back a fragment of every 7th frame (10) and drop one of every 4th
+    # that does not follow a late frame (14), 2 frames are both. The last
+    # late fragment is never sent, the other 9 arrive after a newer frame.
+    run_case loss 70 4 7 1000
+    local frames=$(summary_field loss "frames,")
+    local incomplete=$(summary_field loss "incomplete")
+    local late=$(summary_field loss "late fragments")
+
+    if [ "$frames" != "48" ] || [ "$incomplete" != "22" ]; then
+        print_fail "Received $frames frames, $incomplete incomplete; expected 48 and 22"
+        cat "$WORK_DIR/loss.log"
+        return 1
+    fi
+    print_pass "Exactly the 22 damaged frames were dropped"
+
+    if [ "$late" != "9" ]; then
+        print_fail "Expected 9 late fragments, got $late"
+        return 1
+    fi
+    print_pass "Fragments arriving after a newer frame are counted late"
+
+    compare_frames loss || return 1
+    for seq in 4 7 28 70; do
+        if [ -e "$WORK_DIR/loss/recv/$(printf '%08d' $seq).jpg" ]; then
+            print_fail "Damaged frame $seq was delivered"
+            return 1
+        fi
+    done
+    print_pass "Delivered frames are intact"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Multicast Stream Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    failed_tests=0
+
+    if ! build_sender; then
+        print_fail "Cannot build the host sender"
+        return 1
+    fi
+
+    if ! test_fragmenter; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_lossless; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_loss; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
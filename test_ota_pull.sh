@@ -0,0 +1,513 @@
+#!/bin/bash
+# Test script for the pull OTA downloader
+# Usage: ./test_ota_pull.sh
+#
+# Builds main/ota_fetch.c into a small host client and downloads generated
+# firmware images from ota_mirror.py on localhost: one and several
+# connections, dropped and stalled responses, a mirror without range
+# support, and paced reads. Every download is compared with the image.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+MIRROR_PID=""
+trap 'kill $MIRROR_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+IMAGE_SIZE=600000
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# The host client. Prints "ok <details>" or "fail <reason>".
+build_client() {
+    cat > "$WORK_DIR/client.c" <<'EOF'
+#include "ota_fetch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+typedef struct {
+    FILE *out;
+    uint64_t written;
+    uint32_t chunks;
+    uint32_t rate_kbps;
+} sink_t;
+
+static bool sink_write(void *ctx, const uint8_t *data, size_t len)
+{
+    sink_t *sink = ctx;
+    sink->written += len;
+    sink->chunks++;
+    return fwrite(data, 1, len, sink->out) == len;
+}
+
+// Same shape as the bandwidth arbiter's OTA cap: wait until the bytes so
+// far fit the rate
+static uint32_t sink_pace(void *ctx, uint64_t received, uint32_t elapsed_ms)
+{
+    sink_t *sink = ctx;
+    uint64_t due_ms = received * 8 / sink->rate_kbps;
+    return due_ms > elapsed_ms ? (uint32_t)(due_ms - elapsed_ms) : 0;
+}
+
+static int test_versions(void)
+{
+    static const struct {
+        const char *a, *b;
+        int cmp;
+    } cases[] = {
+        { "1.2.3", "1.2.3", 0 }, { "1.2.3", "1.2.4", -1 }, { "1.10.0", "1.9.9", 1 },
+        { "v2.0", "2.0.0", 0 }, { "2.0-rc1", "2.0", 0 }, { "1.2", "1.2.1", -1 },
+        { "3", "2.99.99", 1 }, { "1.0.0-5-gabc123", "1.0.1", -1 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int cmp = ota_fetch_version_cmp(cases[i].a, cases[i].b);
+        cmp = cmp < 0 ? -1 : cmp > 0;
+        CHECK(cmp == cases[i].cmp, "%s vs %s: %d", cases[i].a, cases[i].b, cmp);
+    }
+    CHECK(ota_fetch_is_newer("1.4.0", "1.5.0"), "1.5.0 not newer than 1.4.0");
+    CHECK(!ota_fetch_is_newer("1.5.0", "1.4.0"), "downgrade offered");
+    CHECK(!ota_fetch_is_newer("1.5.0", "v1.5"), "same version offered");
+    CHECK(ota_fetch_is_newer("a1b2c3d", "e4f5a6b"), "different hash not offered");
+    CHECK(!ota_fetch_is_newer("a1b2c3d", "a1b2c3d"), "same hash offered");
+    return 0;
+}
+
+static int test_http(void)
+{
+    ota_fetch_target_t target = { "mirror.local", 8070, "/fw/ESP32S3Cam.bin" };
+    char buf[OTA_FETCH_REQUEST_MAX];
+    ota_fetch_response_t r;
+
+    CHECK(ota_fetch_request(&target, 16384, 32768, buf, sizeof(buf)) > 0, "request does not fit");
+    CHECK(strstr(buf, "GET /fw/ESP32S3Cam.bin HTTP/1.1\r\n") == buf, "request line: %s", buf);
+    CHECK(strstr(buf, "\r\nHost: mirror.local:8070\r\n") != NULL, "host: %s", buf);
+    CHECK(strstr(buf, "\r\nRange: bytes=16384-32767\r\n") != NULL, "range: %s", buf);
+    CHECK(ota_fetch_request(&target, 0, 1, buf, 32) == -1, "overflow not reported");
+
+    const char *partial = "HTTP/1.1 206 Partial Content\r\ncontent-range: bytes 100-199/1000\r\n"
+                          "Content-Length:100\r\n\r\n";
+    CHECK(ota_fetch_parse_response(partial, strlen(partial), &r), "206 not parsed");
+    CHECK(r.status == 206 && r.has_range && r.range_start == 100 && r.range_end == 199 &&
+          r.range_total == 1000 && r.content_length == 100 && r.keep_alive, "206 parsed wrong");
+
+    const char *closing = "HTTP/1.0 200 OK\r\nContent-Length: 5\r\n\r\n";
+    CHECK(ota_fetch_parse_response(closing, strlen(closing), &r), "200 not parsed");
+    CHECK(r.status == 200 && !r.has_range && !r.keep_alive, "HTTP/1.0 kept alive");
+    const char *close11 = "HTTP/1.1 206 Partial Content\r\nConnection: close\r\n"
+                          "Content-Range: bytes */1000\r\n\r\n";
+    CHECK(ota_fetch_parse_response(close11, strlen(close11), &r), "close not parsed");
+    CHECK(!r.keep_alive && !r.has_range, "Connection: close or bad range ignored");
+    CHECK(!ota_fetch_parse_response("SSH-2.0\r\n\r\n", 11, &r), "garbage parsed");
+    return 0;
+}
+
+static int test_image(void)
+{
+    uint8_t buf[OTA_FETCH_PROBE_LEN] = { 0xE9, 1 };
+    ota_fetch_image_t image;
+
+    buf[12] = 9;
+    memcpy(buf + 32, "\x32\x54\xcd\xab", 4);
+    strcpy((char *)buf + 48, "1.4.0");
+    memset(buf + 80, 'x', 32);      // no NUL: truncated
+    CHECK(ota_fetch_parse_image(buf, sizeof(buf), &image), "image not parsed");
+    CHECK(image.chip_id == 9 && strcmp(image.version, "1.4.0") == 0 && strlen(image.project) == 31,
+          "image parsed wrong");
+    CHECK(!ota_fetch_parse_image(buf, sizeof(buf) - 1, &image), "short image parsed");
+    buf[33] = 0;
+    CHECK(!ota_fetch_parse_image(buf, sizeof(buf), &image), "bad app desc magic parsed");
+    return 0;
+}
+
+// Chunks received in random pieces and order, connections failing, written
+// as soon as they are next: every byte reaches the sink once, in order
+static int test_plan(void)
+{
+    srand(50);
+    for (int round = 0; round < 2000; round++) {
+        ota_fetch_plan_t plan;
+        uint32_t size = rand() % 200000;
+        uint32_t chunk = 1 + rand() % 20000;
+        int slots = 1 + rand() % OTA_FETCH_MAX_CONNECTIONS;
+        uint32_t written = 0;
+
+        ota_fetch_plan_init(&plan, size, chunk, slots);
+        for (int steps = 0; !ota_fetch_plan_done(&plan); steps++) {
+            CHECK(steps < 1000000, "stuck at %lu of %lu", (unsigned long)plan.written, (unsigned long)size);
+            int slot = rand() % slots;
+            uint32_t start, end;
+            if (ota_fetch_plan_next(&plan, slot, &start, &end)) {
+                CHECK(start < end && end - start <= chunk && end <= size, "bad range %lu-%lu",
+                      (unsigned long)start, (unsigned long)end);
+                // Part of the rest, as a dropped connection would
+                uint32_t len = rand() % 3 ? end - start : (uint32_t)(rand() % (end - start + 1));
+                ota_fetch_plan_received(&plan, slot, len);
+            }
+            int w;
+            while ((w = ota_fetch_plan_writable(&plan)) >= 0) {
+                CHECK(plan.chunks[w].start == written, "chunk at %lu written at %lu",
+                      (unsigned long)plan.chunks[w].start, (unsigned long)written);
+                written = plan.chunks[w].end;
+                ota_fetch_plan_written(&plan, w);
+            }
+        }
+        CHECK(written == size, "%lu of %lu written", (unsigned long)written, (unsigned long)size);
+    }
+    return 0;
+}
+
+static int cmd_unit(void)
+{
+    if (test_versions() || test_http() || test_image() || test_plan()) {
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static int cmd_probe(ota_fetch_target_t *target)
+{
+    ota_fetch_image_t image;
+    uint32_t size;
+
+    ota_fetch_err_t err = ota_fetch_probe(target, 2000, &image, &size);
+    CHECK(err == OTA_FETCH_OK, "%s", ota_fetch_err_name(err));
+    printf("ok %s %s %u %lu\n", image.project, image.version, image.chip_id, (unsigned long)size);
+    return 0;
+}
+
+static int cmd_get(ota_fetch_target_t *target, int argc, char **argv)
+{
+    sink_t sink = { 0 };
+    ota_fetch_image_t image;
+    uint32_t size;
+    ota_fetch_result_t result;
+
+    ota_fetch_err_t err = ota_fetch_probe(target, 2000, &image, &size);
+    CHECK(err == OTA_FETCH_OK, "probe: %s", ota_fetch_err_name(err));
+
+    ota_fetch_config_t config = {
+        .target = *target,
+        .connections = atoi(argv[0]),
+        .chunk_size = atoi(argv[1]) * 1024,
+        .timeout_ms = atoi(argv[2]),
+        .max_retries = 20,
+        .sink = sink_write,
+        .ctx = &sink,
+    };
+    if (argc > 3) {
+        sink.rate_kbps = atoi(argv[3]);
+        config.pace = sink_pace;
+    }
+    config.buffers = malloc((size_t)config.connections * config.chunk_size);
+    sink.out = fopen(argv[-1], "wb");
+    CHECK(config.buffers != NULL && sink.out != NULL, "setup");
+
+    err = ota_fetch_run(&config, size, &result);
+    fclose(sink.out);
+    free(config.buffers);
+    CHECK(err == OTA_FETCH_OK, "%s", ota_fetch_err_name(err));
+    CHECK(sink.written == size, "%llu of %lu bytes written", (unsigned long long)sink.written,
+          (unsigned long)size);
+    printf("ok %lu %lu %lu %lu %lu %lu %lu\n", (unsigned long)result.requests, (unsigned long)result.connects,
+           (unsigned long)result.resumes, (unsigned long)result.retries, (unsigned long)sink.chunks,
+           (unsigned long)result.elapsed_ms, (unsigned long)result.rate_kbps);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "unit") == 0) {
+        return cmd_unit();
+    }
+    if (argc < 4) {
+        fprintf(stderr, "usage: client unit | probe PORT PATH | get PORT PATH OUT CONNS CHUNK_KB TIMEOUT_MS [KBPS]\n");
+        return 2;
+    }
+    ota_fetch_target_t target = { "127.0.0.1", (uint16_t)atoi(argv[2]), argv[3] };
+    if (strcmp(argv[1], "probe") == 0) {
+        return cmd_probe(&target);
+    }
+    if (strcmp(argv[1], "get") == 0 && argc >= 8) {
+        return cmd_get(&target, argc - 5, argv + 5);
+    }
+    fprintf(stderr, "usage: client unit | probe PORT PATH | get PORT PATH OUT CONNS CHUNK_KB TIMEOUT_MS [KBPS]\n");
+    return 2;
+}
+EOF
+    gcc -std=gnu99 -O2 -Wall -Werror -I main "$WORK_DIR/client.c" main/ota_fetch.c -o "$WORK_DIR/client"
+}
+
+# An app image with a real header and app description, random contents
+make_image() {
+    python3 - "$1" "$2" "$3" <<'EOF'
+import random, struct, sys
+path, version, size = sys.argv[1], sys.argv[2], int(sys.argv[3])
+rng = random.Random(version)
+data = bytearray(rng.getrandbits(8) for _ in range(size))
+struct.pack_into('<BBBBIB3sH', data, 0, 0xE9, 4, 2, 0x2f, 0x40375a1c, 0xee, b'\0\0\0', 9)
+struct.pack_into('<II', data, 24, 0x3c120020, 256)
+struct.pack_into('<II8s32s32s16s16s32s', data, 32, 0xABCD5432, 0, b'', version.encode(),
+                 b'ESP32S3Cam', b'12:00:00', b'Oct 18 2026', b'v5.4.1')
+open(path, 'wb').write(data)
+EOF
+}
+
+start_mirror() {
+    python3 ota_mirror.py serve "$WORK_DIR/www" --port 0 --bind 127.0.0.1 "$@" > "$WORK_DIR/mirror.log" 2>&1 &
+    MIRROR_PID=$!
+    for _ in $(seq 50); do
+        PORT=$(sed -n 's/.*Serving .* on 127.0.0.1:\([0-9]*\)$/\1/p' "$WORK_DIR/mirror.log" 2>/dev/null)
+        [ -n "$PORT" ] && return 0
+        sleep 0.1
+    done
+    print_fail "Mirror did not start"
+    cat "$WORK_DIR/mirror.log"
+    return 1
+}
+
+stop_mirror() {
+    kill $MIRROR_PID 2>/dev/null
+    wait $MIRROR_PID 2>/dev/null
+    MIRROR_PID=""
+}
+
+# Run one client command; sets RESULT to what follows "ok"
+run_client() {
+    local out
+    out=$("$WORK_DIR/client" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Download with CONNS and CHUNK_KB and compare; sets the result fields
+download() {
+    rm -f "$WORK_DIR/out.bin"
+    run_client get "$PORT" /ESP32S3Cam.bin "$WORK_DIR/out.bin" "$@" || return 1
+    read -r requests connects resumes retries chunks elapsed kbps <<< "$RESULT"
+    if ! cmp -s "$WORK_DIR/out.bin" "$WORK_DIR/www/ESP32S3Cam.bin"; then
+        print_fail "Downloaded image differs"
+        return 1
+    fi
+    return 0
+}
+
+# Test versions, response parsing, image headers and the chunk planner
+test_unit() {
+    print_test "Checking versions, HTTP parsing and the chunk planner..."
+
+    run_client unit || return 1
+    print_pass "Version order, range responses, image header, 2000 random plans written in order"
+    return 0
+}
+
+# Test reading the version and size before downloading
+test_probe() {
+    print_test "Reading the image header from the mirror..."
+
+    start_mirror || return 1
+    run_client probe "$PORT" /ESP32S3Cam.bin
+    local rc=$?
+    local probe=$RESULT
+    run_client probe "$PORT" /missing.bin > /dev/null 2>&1
+    local missing=$?
+    stop_mirror
+    [ $rc -eq 0 ] || return 1
+
+    if [ "$probe" != "ESP32S3Cam 1.4.0 9 $IMAGE_SIZE" ]; then
+        print_fail "Probe read \"$probe\""
+        return 1
+    fi
+    if [ $missing -eq 0 ]; then
+        print_fail "Probe of a missing image succeeded"
+        return 1
+    fi
+    if ! python3 ota_mirror.py info "$WORK_DIR/www/ESP32S3Cam.bin" | grep -q "ESP32S3Cam 1.4.0 for esp32s3"; then
+        print_fail "ota_mirror.py info does not show the version"
+        return 1
+    fi
+    print_pass "ESP32S3Cam 1.4.0 for chip 9, $IMAGE_SIZE bytes, from the first $(grep -c 'bytes 0-287' "$WORK_DIR/mirror.log") range request"
+    return 0
+}
+
+# Test a download over one kept-alive connection
+test_single() {
+    print_test "Downloading over one connection..."
+
+    start_mirror --quiet || return 1
+    download 1 16 2000
+    local rc=$?
+    stop_mirror
+    [ $rc -eq 0 ] || return 1
+
+    local expected=$(( (IMAGE_SIZE + 16383) / 16384 ))
+    if [ "$requests" -ne "$expected" ] || [ "$connects" -ne 1 ] || [ "$chunks" -ne "$expected" ]; then
+        print_fail "$requests requests on $connects connections, expected $expected on 1"
+        return 1
+    fi
+    print_pass "$requests range requests on one connection, $kbps kbit/s"
+    return 0
+}
+
+# Test several connections fetching chunks ahead of the one being written
+test_parallel() {
+    print_test "Downloading over four connections..."
+
+    start_mirror --quiet || return 1
+    download 4 8 2000
+    local rc=$?
+    stop_mirror
+    [ $rc -eq 0 ] || return 1
+
+    local expected=$(( (IMAGE_SIZE + 8191) / 8192 ))
+    if [ "$requests" -ne "$expected" ] || [ "$connects" -ne 4 ]; then
+        print_fail "$requests requests on $connects connections, expected $expected on 4"
+        return 1
+    fi
+    print_pass "$requests range requests on 4 connections, written in order, $kbps kbit/s"
+    return 0
+}
+
+# Test that dropped responses are resumed where they stopped
+test_drops() {
+    print_test "Downloading while the mirror drops every third response..."
+
+    start_mirror --drop-every 3 || return 1
+    download 2 32 2000
+    local rc=$?
+    stop_mirror
+    [ $rc -eq 0 ] || return 1
+
+    local drops=$(grep -c "dropped after" "$WORK_DIR/mirror.log")
+    if [ "$drops" -eq 0 ] || [ "$resumes" -lt "$drops" ] || [ "$retries" -ne "$drops" ]; then
+        print_fail "$drops drops, $resumes resumes, $retries retries"
+        return 1
+    fi
+    # A resumed request starts in the middle of a 32 KB chunk
+    if ! awk '$4 == "bytes" { split($5, r, "-"); if (r[1] % 32768 != 0) found = 1 } END { exit !found }' \
+            "$WORK_DIR/mirror.log"; then
+        print_fail "No request continued a chunk"
+        return 1
+    fi
+    print_pass "$drops dropped responses resumed with $resumes range requests mid-chunk"
+    return 0
+}
+
+# Test that a stalled connection is given up and its chunk resumed
+test_stall() {
+    print_test "Downloading while the mirror stalls every tenth response..."
+
+    start_mirror --stall-every 10 --stall 3 --quiet || return 1
+    download 2 32 800
+    local rc=$?
+    stop_mirror
+    [ $rc -eq 0 ] || return 1
+
+    if [ "$retries" -eq 0 ] || [ "$resumes" -eq 0 ]; then
+        print_fail "$retries retries, $resumes resumes"
+        return 1
+    fi
+    print_pass "$retries stalled connections given up after 800 ms and resumed, $elapsed ms in total"
+    return 0
+}
+
+# Test that a mirror ignoring Range is reported instead of misread
+test_no_ranges() {
+    print_test "Probing a mirror without range support..."
+
+    start_mirror --no-ranges --quiet || return 1
+    local out
+    out=$("$WORK_DIR/client" probe "$PORT" /ESP32S3Cam.bin)
+    stop_mirror
+
+    if [ "$out" != "fail no_ranges" ]; then
+        print_fail "Probe said \"$out\""
+        return 1
+    fi
+    print_pass "Reported as no_ranges"
+    return 0
+}
+
+# Test that reads are paced like the bandwidth arbiter's OTA cap asks
+test_pace() {
+    print_test "Downloading at a paced 4000 kbit/s..."
+
+    start_mirror --quiet || return 1
+    download 2 16 2000 4000
+    local rc=$?
+    stop_mirror
+    [ $rc -eq 0 ] || return 1
+
+    # 600000 bytes at 4000 kbit/s: 1.2 s
+    if [ "$elapsed" -lt 1100 ] || [ "$kbps" -gt 4400 ]; then
+        print_fail "$kbps kbit/s in $elapsed ms"
+        return 1
+    fi
+    print_pass "$kbps kbit/s, $elapsed ms"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Pull OTA Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1 || ! command -v python3 >/dev/null 2>&1; then
+        print_pass "gcc or python3 not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_client; then
+        print_fail "Cannot build the host client"
+        return 1
+    fi
+    mkdir -p "$WORK_DIR/www"
+    make_image "$WORK_DIR/www/ESP32S3Cam.bin" 1.4.0 $IMAGE_SIZE
+
+    for t in test_unit test_probe test_single test_parallel test_drops test_stall test_no_ranges test_pace; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
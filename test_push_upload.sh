@@ -0,0 +1,690 @@
+#!/bin/bash
+# Test script for the push uploader
+# Usage: ./test_push_upload.sh
+#
+# Builds main/push_upload.c, push_proto.c, push_batch.c and frame_pool.c for
+# the host against thin FreeRTOS/ESP-IDF shims (pthreads, POSIX sockets with
+# lwIP's 5760-byte send buffer) and a synthetic capture pipeline, and pushes
+# to push_ingest.py on localhost over both transports. Checks that every
+# frame arrives intact, the upload rate, and reconnects: a server that drops
+# the connection, one that stops reading (stall timeout) and one that is not
+# up yet (connect failures and backoff).
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+INGEST_PID=""
+trap 'kill $INGEST_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# Just enough of ESP-IDF and FreeRTOS for push_upload.c
+write_shims() {
+    local shim="$WORK_DIR/shim"
+    mkdir -p "$shim/freertos" "$shim/lwip"
+
+    cat > "$shim/sim_config.h" <<'EOF'
+#define CONFIG_APP_PUSH_UPLOAD 1
+#define CONFIG_APP_PUSH_URL sim_push_url
+#define CONFIG_APP_PUSH_DEVICE_ID "host-sim"
+#define CONFIG_APP_PUSH_BATCH_KB 16
+#define CONFIG_APP_PUSH_BATCH_MS 40
+#define CONFIG_APP_PUSH_STALL_TIMEOUT_MS 1000
+#define CONFIG_APP_PUSH_BACKOFF_MAX_MS 2000
+extern const char *sim_push_url;
+EOF
+
+    cat > "$shim/esp_err.h" <<'EOF'
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+EOF
+
+    cat > "$shim/esp_log.h" <<'EOF'
+#pragma once
+#include <stdio.h>
+#define ESP_LOG_AT(level, tag, fmt, ...) fprintf(stderr, level " %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) ESP_LOG_AT("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) ESP_LOG_AT("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_AT("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+EOF
+
+    cat > "$shim/esp_timer.h" <<'EOF'
+#pragma once
+#include <stdint.h>
+#include <time.h>
+static inline int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+EOF
+
+    cat > "$shim/esp_heap_caps.h" <<'EOF'
+#pragma once
+#include <stdlib.h>
+#define MALLOC_CAP_SPIRAM 1
+#define MALLOC_CAP_INTERNAL 2
+#define MALLOC_CAP_8BIT 4
+#define heap_caps_malloc(size, caps) malloc(size)
+#define heap_caps_free(ptr) free(ptr)
+EOF
+
+    cat > "$shim/freertos/FreeRTOS.h" <<'EOF'
+#pragma once
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef uint32_t EventBits_t;
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+#define portMAX_DELAY UINT32_MAX
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define BIT0 (1u << 0)
+EOF
+
+    cat > "$shim/freertos/task.h" <<'EOF'
+#pragma once
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+typedef void *TaskHandle_t;
+typedef struct {
+    void (*fn)(void *);
+    void *arg;
+} sim_task_t;
+static void *sim_task_main(void *p)
+{
+    sim_task_t task = *(sim_task_t *)p;
+    free(p);
+    task.fn(task.arg);
+    return NULL;
+}
+static inline BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                                 int prio, TaskHandle_t *handle, int core)
+{
+    pthread_t thread;
+    sim_task_t *task = malloc(sizeof(*task));
+    task->fn = fn;
+    task->arg = arg;
+    if (pthread_create(&thread, NULL, sim_task_main, task) != 0) {
+        free(task);
+        return 0;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+#define vTaskDelay(ticks) usleep((ticks) * 1000)
+#define vTaskDelete(handle) do { } while (0)
+EOF
+
+    cat > "$shim/freertos/event_groups.h" <<'EOF'
+#pragma once
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    EventBits_t bits;
+} sim_event_group_t;
+typedef sim_event_group_t *EventGroupHandle_t;
+static inline EventGroupHandle_t xEventGroupCreate(void)
+{
+    EventGroupHandle_t group = calloc(1, sizeof(*group));
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->cond, NULL);
+    return group;
+}
+static inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->lock);
+    return bits;
+}
+static inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t old = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return old;
+}
+// Only what push_upload.c uses: wait forever for any of `bits`
+static inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                              BaseType_t all, TickType_t ticks)
+{
+    pthread_mutex_lock(&group->lock);
+    while ((group->bits & bits) == 0) {
+        pthread_cond_wait(&group->cond, &group->lock);
+    }
+    EventBits_t out = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return out;
+}
+EOF
+
+    # lwIP on the device has a 5760-byte send buffer; Linux would otherwise
+    # absorb seconds of frames and hide stalls
+    cat > "$shim/lwip/sockets.h" <<'EOF'
+#pragma once
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+static inline int sim_socket(int domain, int type, int protocol)
+{
+    int fd = socket(domain, type, protocol);
+    int size = 5760;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    return fd;
+}
+#define socket sim_socket
+EOF
+
+    cat > "$shim/lwip/netdb.h" <<'EOF'
+#pragma once
+#include <netdb.h>
+EOF
+
+    cat > "$shim/task_layout.h" <<'EOF'
+#pragma once
+#define PUSH_TASK_CORE 1
+#define PUSH_TASK_PRIORITY 4
+#define PUSH_TASK_STACK_SIZE 6144
+EOF
+
+    cat > "$shim/qos_arbiter.h" <<'EOF'
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+typedef enum {
+    QOS_FLOW_UPLOAD
+} qos_flow_t;
+bool qos_arbiter_admit(qos_flow_t flow, uint32_t last_ms, uint32_t now_ms);
+EOF
+
+    cat > "$shim/capture_pipeline.h" <<'EOF'
+#pragma once
+#include "frame_pool.h"
+typedef enum {
+    CAPTURE_CONSUMER_RECORDER
+} capture_consumer_t;
+frame_t *capture_pipeline_get_frame(uint32_t after_seq, uint32_t timeout_ms);
+void capture_pipeline_acquire(capture_consumer_t consumer);
+void capture_pipeline_release(capture_consumer_t consumer);
+EOF
+}
+
+# The uploader with a synthetic camera. Prints "ok <stats>" or "fail <reason>".
+build_sim() {
+    write_shims
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "capture_pipeline.h"
+#include "push_upload.h"
+#include "qos_arbiter.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SLABS 8
+#define SLAB_SIZE (48 * 1024)
+
+const char *sim_push_url;
+
+static frame_pool_t s_pool;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static frame_t *s_latest;
+static uint32_t s_seq;
+static atomic_int s_consumers;
+static atomic_bool s_stop;
+static uint32_t s_fps;
+static size_t s_min_len;
+static size_t s_max_len;
+static uint32_t s_captured;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Same sizes and bytes as check_frames() in the test script
+static size_t frame_len(uint32_t seq)
+{
+    return s_min_len + (size_t)seq * 7919 % (s_max_len - s_min_len + 1);
+}
+
+static void *camera_task(void *arg)
+{
+    int64_t next_us = now_us();
+
+    while (!atomic_load(&s_stop)) {
+        next_us += 1000000 / s_fps;
+        int64_t wait_us = next_us - now_us();
+        if (wait_us > 0) {
+            usleep(wait_us);
+        }
+
+        frame_t *frame = frame_pool_alloc(&s_pool);
+        if (frame == NULL) {
+            continue;
+        }
+        uint32_t seq = s_seq + 1;
+        uint8_t *data = frame_pool_slab(frame);
+        size_t len = frame_len(seq);
+        data[0] = 0xff;
+        data[1] = 0xd8;
+        for (size_t i = 2; i < len - 2; i++) {
+            data[i] = (uint8_t)(seq * 31 + i * 7);
+        }
+        data[len - 2] = 0xff;
+        data[len - 1] = 0xd9;
+        frame->len = len;
+        frame->width = 640;
+        frame->height = 480;
+        frame->seq = seq;
+        frame->timestamp_us = now_us();
+
+        pthread_mutex_lock(&s_lock);
+        if (s_latest != NULL) {
+            frame_unref(s_latest);
+        }
+        s_latest = frame;
+        s_seq = seq;
+        s_captured++;
+        pthread_cond_broadcast(&s_cond);
+        pthread_mutex_unlock(&s_lock);
+    }
+    return NULL;
+}
+
+frame_t *capture_pipeline_get_frame(uint32_t after_seq, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    frame_t *frame = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&s_lock);
+    while (s_latest == NULL || s_latest->seq <= after_seq) {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) != 0) {
+            break;
+        }
+    }
+    if (s_latest != NULL && s_latest->seq > after_seq) {
+        frame = frame_ref(s_latest);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return frame;
+}
+
+void capture_pipeline_acquire(capture_consumer_t consumer)
+{
+    atomic_fetch_add(&s_consumers, 1);
+}
+
+void capture_pipeline_release(capture_consumer_t consumer)
+{
+    atomic_fetch_sub(&s_consumers, 1);
+}
+
+bool qos_arbiter_admit(qos_flow_t flow, uint32_t last_ms, uint32_t now_ms)
+{
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 6) {
+        fprintf(stderr, "usage: sim <url> <seconds> <fps> <min_bytes> <max_bytes>\n");
+        return 2;
+    }
+    sim_push_url = argv[1];
+    double seconds = atof(argv[2]);
+    s_fps = (uint32_t)atoi(argv[3]);
+    s_min_len = (size_t)atol(argv[4]);
+    s_max_len = (size_t)atol(argv[5]);
+
+    // lwIP reports a closed peer as an error, not a signal
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    if (!frame_pool_init(&s_pool, malloc(SLABS * SLAB_SIZE), SLAB_SIZE, SLABS) || s_max_len > SLAB_SIZE ||
+        s_min_len < 4 || s_min_len > s_max_len) {
+        printf("fail setup\n");
+        return 1;
+    }
+
+    pthread_t camera;
+    pthread_create(&camera, NULL, camera_task, NULL);
+    int64_t start_us = now_us();
+    if (push_upload_start() != ESP_OK) {
+        printf("fail push_upload_start\n");
+        return 1;
+    }
+    usleep((useconds_t)(seconds * 1000000));
+    push_upload_stop();
+    int64_t elapsed_us = now_us() - start_us;
+    atomic_store(&s_stop, true);
+    pthread_join(camera, NULL);
+
+    push_upload_stats_t stats;
+    push_upload_get_stats(&stats);
+    frame_pool_stats_t pool;
+    frame_pool_get_stats(&s_pool, &pool);
+    if (atomic_load(&s_consumers) != 0 || stats.connected) {
+        printf("fail pipeline still held after stop\n");
+        return 1;
+    }
+    // Only the latest frame is still referenced
+    if (pool.in_use != 1) {
+        printf("fail %u slabs held after stop\n", pool.in_use);
+        return 1;
+    }
+    printf("ok %u %u %u %u %u %u %llu %u %lu\n", stats.connects, stats.connect_failures, stats.disconnects,
+           stats.frames_sent, stats.frames_dropped, stats.batches_sent, (unsigned long long)stats.bytes_sent,
+           s_captured, (unsigned long)(stats.bytes_sent * 8 / 1000 * 1000000 / elapsed_us));
+    return 0;
+}
+EOF
+    # Copied so its quoted includes find the shims before the real headers
+    cp main/push_upload.c "$WORK_DIR/push_upload.c"
+    gcc -std=gnu11 -O2 -Wall -Werror -Wno-unused-function -pthread -include "$WORK_DIR/shim/sim_config.h" \
+        -I "$WORK_DIR/shim" -I main "$WORK_DIR/sim.c" "$WORK_DIR/push_upload.c" main/push_proto.c \
+        main/push_batch.c main/frame_pool.c -o "$WORK_DIR/sim"
+}
+
+# A free port on localhost
+free_port() {
+    python3 -c 'import socket; s = socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1])'
+}
+
+start_ingest() {
+    rm -rf "$WORK_DIR/frames"
+    python3 push_ingest.py --bind 127.0.0.1 --save "$WORK_DIR/frames" "$@" > "$WORK_DIR/ingest.log" 2>&1 &
+    INGEST_PID=$!
+    for _ in $(seq 50); do
+        PORT=$(sed -n 's/.*Listening on 127.0.0.1:\([0-9]*\)$/\1/p' "$WORK_DIR/ingest.log" 2>/dev/null)
+        [ -n "$PORT" ] && return 0
+        sleep 0.1
+    done
+    print_fail "push_ingest.py did not start"
+    cat "$WORK_DIR/ingest.log"
+    return 1
+}
+
+# Stop the server and read its totals into the server_* fields
+stop_ingest() {
+    # Let the connection threads read what the uploader sent before it exited
+    sleep 0.5
+    kill $INGEST_PID 2>/dev/null
+    wait $INGEST_PID 2>/dev/null
+    INGEST_PID=""
+    read -r server_frames server_bytes server_connections server_gaps server_bad <<< "$(sed -n \
+        's/^Total: \([0-9]*\) frames, \([0-9]*\) bytes, \([0-9]*\) connections, \([0-9]*\) sequence gaps, \([0-9]*\) bad frames$/\1 \2 \3 \4 \5/p' \
+        "$WORK_DIR/ingest.log")"
+    if [ -z "$server_frames" ]; then
+        print_fail "No totals from push_ingest.py"
+        return 1
+    fi
+    return 0
+}
+
+# Every saved frame must be byte for byte the one the camera made
+check_frames() {
+    python3 - "$WORK_DIR/frames" "$1" "$2" <<'EOF'
+import os, sys
+folder, lo, hi = sys.argv[1], int(sys.argv[2]), int(sys.argv[3])
+count = 0
+for name in os.listdir(folder):
+    seq = int(name.rsplit('_', 1)[1].split('.')[0])
+    length = lo + seq * 7919 % (hi - lo + 1)
+    body = bytes((seq * 31 + i * 7) & 0xff for i in range(2, length - 2))
+    if open(os.path.join(folder, name), 'rb').read() != b'\xff\xd8' + body + b'\xff\xd9':
+        print(f'frame {seq} differs')
+        sys.exit(1)
+    count += 1
+print(count)
+EOF
+}
+
+# Run the uploader; sets the client_* fields
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@" 2> "$WORK_DIR/sim.log")
+    if [ "${out%% *}" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    read -r connects connect_failures disconnects frames_sent frames_dropped batches bytes captured kbps <<< "${out#ok }"
+    return 0
+}
+
+# Push a steady stream over one transport and compare both ends
+push_steady() {
+    local scheme=$1 path=$2
+
+    start_ingest --port 0 || return 1
+    run_sim "$scheme://127.0.0.1:$PORT$path" 3 25 2000 30000
+    local rc=$?
+    stop_ingest || return 1
+    [ $rc -eq 0 ] || return 1
+
+    local saved
+    saved=$(check_frames 2000 30000) || { print_fail "$saved"; return 1; }
+    if [ "$connects" -ne 1 ] || [ "$server_connections" -ne 1 ] || [ "$disconnects" -ne 0 ]; then
+        print_fail "$connects connects, $disconnects disconnects, server saw $server_connections"
+        return 1
+    fi
+    if [ "$server_frames" -ne "$frames_sent" ] || [ "$saved" -ne "$server_frames" ] || [ "$server_bad" -ne 0 ]; then
+        print_fail "Sent $frames_sent, server got $server_frames ($server_bad bad), $saved saved"
+        return 1
+    fi
+    if [ $((frames_sent + frames_dropped)) -gt "$captured" ] || [ $((frames_sent * 10)) -lt $((captured * 8)) ]; then
+        print_fail "$frames_sent sent and $frames_dropped dropped of $captured captured"
+        return 1
+    fi
+    return 0
+}
+
+# Test the tcp:// transport
+test_tcp() {
+    print_test "Pushing 25 fps over tcp://..."
+
+    push_steady tcp "" || return 1
+    print_pass "$frames_sent of $captured frames received intact on one connection ($batches batched writes, $kbps kbit/s)"
+    return 0
+}
+
+# Test the chunked multipart POST
+test_http() {
+    print_test "Pushing 25 fps over a chunked POST..."
+
+    push_steady http /ingest || return 1
+    print_pass "$frames_sent of $captured frames received intact on one connection ($batches batched writes, $kbps kbit/s)"
+    return 0
+}
+
+# Measure the upload rate with a camera faster than the link
+test_throughput() {
+    print_test "Pushing as fast as the link takes..."
+
+    start_ingest --port 0 || return 1
+    run_sim "tcp://127.0.0.1:$PORT" 3 400 2000 12000
+    local rc=$?
+    stop_ingest || return 1
+    [ $rc -eq 0 ] || return 1
+
+    if [ "$server_bad" -ne 0 ] || [ "$server_frames" -ne "$frames_sent" ]; then
+        print_fail "Sent $frames_sent, server got $server_frames ($server_bad bad)"
+        return 1
+    fi
+    print_pass "$kbps kbit/s, $((frames_sent / 3)) fps of $((captured / 3)) captured, $frames_dropped replaced while the link was busy"
+    return 0
+}
+
+# Test reconnects after the server drops the connection
+test_drops() {
+    print_test "Pushing while the server drops every connection after 1 s..."
+
+    start_ingest --port 0 --drop-every 1 || return 1
+    run_sim "http://127.0.0.1:$PORT/ingest" 8 25 2000 30000
+    local rc=$?
+    stop_ingest || return 1
+    [ $rc -eq 0 ] || return 1
+
+    local saved
+    saved=$(check_frames 2000 30000) || { print_fail "$saved"; return 1; }
+    if [ "$connects" -lt 3 ] || [ "$disconnects" -lt 2 ] || [ "$server_bad" -ne 0 ] || [ "$saved" -eq 0 ]; then
+        print_fail "$connects connects, $disconnects disconnects, $server_bad bad frames"
+        return 1
+    fi
+    # Backoff doubles from 500 ms up to the 2 s maximum
+    local gaps
+    gaps=$(sed -n 's/.*, \([0-9.]*\) s after last disconnect$/\1/p' "$WORK_DIR/ingest.log" | tr '\n' ' ')
+    if ! awk -v gaps="$gaps" 'BEGIN {
+            n = split(gaps, g, " ")
+            if (n < 2 || g[1] < 0.45) exit 1
+            for (i = 2; i <= n; i++) if (g[i] < g[i - 1] * 1.6 && g[i] < 1.9) exit 1
+        }'; then
+        print_fail "Reconnect gaps $gaps"
+        return 1
+    fi
+    print_pass "$connects sessions, reconnected after ${gaps% } s, $saved frames intact"
+    return 0
+}
+
+# Test the stall timeout against a server that stops reading
+test_stall() {
+    print_test "Pushing while the server stops reading for 4 s..."
+
+    start_ingest --port 0 --stall 4 --stall-after 20 || return 1
+    run_sim "tcp://127.0.0.1:$PORT" 4 100 8000 30000
+    local rc=$?
+    stop_ingest || return 1
+    [ $rc -eq 0 ] || return 1
+
+    if ! grep -q "accepted nothing for 1000 ms" "$WORK_DIR/sim.log" || [ "$connects" -lt 2 ] ||
+            [ "$server_bad" -ne 0 ]; then
+        print_fail "$connects connects, $disconnects disconnects, $server_bad bad frames"
+        sed -n '1,20p' "$WORK_DIR/sim.log"
+        return 1
+    fi
+    print_pass "Stall given up after 1 s, reconnected ($connects sessions), no bad frames"
+    return 0
+}
+
+# Test connect failures while the server is not up yet
+test_late_server() {
+    print_test "Pushing before the server is up..."
+
+    local port
+    port=$(free_port)
+    "$WORK_DIR/sim" "tcp://127.0.0.1:$port" 6 25 2000 30000 > "$WORK_DIR/late.out" 2> "$WORK_DIR/sim.log" &
+    local sim_pid=$!
+    sleep 2.5
+    start_ingest --port "$port" || { wait $sim_pid; return 1; }
+    wait $sim_pid
+    stop_ingest || return 1
+
+    local out
+    out=$(cat "$WORK_DIR/late.out")
+    if [ "${out%% *}" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    read -r connects connect_failures disconnects frames_sent frames_dropped batches bytes captured kbps <<< "${out#ok }"
+    # Attempts at 0, 0.5, 1.5 s fail, 3.5 s connects
+    if [ "$connect_failures" -lt 3 ] || [ "$connects" -ne 1 ] || [ "$server_frames" -ne "$frames_sent" ] ||
+            [ "$frames_sent" -eq 0 ]; then
+        print_fail "$connect_failures failures, $connects connects, sent $frames_sent, server got $server_frames"
+        return 1
+    fi
+    print_pass "$connect_failures refused attempts with backoff, then $frames_sent frames on one connection"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Push Upload Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1 || ! command -v python3 >/dev/null 2>&1; then
+        print_pass "gcc or python3 not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the uploader"
+        return 1
+    fi
+
+    for t in test_tcp test_http test_throughput test_drops test_stall test_late_server; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
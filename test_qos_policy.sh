@@ -0,0 +1,382 @@
+#!/bin/bash
+# Test script for the bandwidth policy engine
+# Usage: ./test_qos_policy.sh
+#
+# Builds main/qos_policy.c for the host and runs it in closed loop, the way
+# qos_arbiter.c does: every 500 ms it gets the bytes and frames sent, and its
+# decision paces two 25 fps consumers and sets the JPEG quality the frame
+# sizes come from. The egress cap then changes through unlimited, roomy,
+# tight, starved and roomy again. Checks that quality only steps (by 4, at
+# most every 2 s) when the frame rate would otherwise fall below the
+# minimum, that it settles without flapping and steps back once there is
+# twice the headroom, that egress stays under the cap, and the OTA policies.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "qos_policy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define SAMPLE_MS 500       // QOS_SAMPLE_INTERVAL_MS
+#define CAMERA_MS 40        // 25 fps
+#define FLOWS 2
+#define BASE_Q 12
+#define MAX_Q 40
+#define MIN_FPS 5
+
+static const qos_policy_config_t k_config = {
+    .mode = QOS_POLICY_NONE,
+    .base_quality = BASE_Q,
+    .max_quality = MAX_Q,
+    .min_fps = MIN_FPS,
+    .ota_fps = 2,
+    .ota_quality = 30,
+    .ota_kbps = 1000,
+};
+
+// Coarser quality, smaller frames: 10 KB at the base quality, about 4 KB at
+// the coarsest, +-5% from frame to frame
+static uint32_t frame_bytes(uint8_t quality)
+{
+    return 200000 / (quality + 8) * (95 + rand() % 11) / 100;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t cap_kbps;
+    uint32_t seconds;
+} phase_t;
+
+typedef struct {
+    uint8_t quality;
+    uint32_t fps_x10;       // per consumer
+    uint32_t kbps;
+    uint32_t steps;
+    uint32_t late_changes;  // in the second half of the phase
+} phase_result_t;
+
+static int run_phases(const phase_t *phases, int count, phase_result_t *results)
+{
+    qos_policy_t policy;
+    qos_sample_t sample = { .streams = FLOWS };
+    uint32_t last_sent[FLOWS] = { 0 };
+    uint32_t now = 100000;
+    uint32_t camera_ms = now;
+    uint32_t last_step_ms = 0;
+    int last_dir = 0;
+    uint8_t quality = BASE_Q;
+
+    srand(39);
+    qos_policy_init(&policy, &k_config, now);
+    for (int p = 0; p < count; p++) {
+        qos_policy_config_t config = k_config;
+        phase_result_t *r = &results[p];
+        uint32_t end = now + phases[p].seconds * 1000;
+        uint32_t half = now + phases[p].seconds * 500;
+        uint64_t half_bytes = 0;
+        uint32_t half_frames = 0;
+        int reversals = 0;
+
+        config.egress_cap_kbps = phases[p].cap_kbps;
+        qos_policy_configure(&policy, &config);
+        memset(r, 0, sizeof(*r));
+
+        while (now < end) {
+            // The consumers send what the decision admits, at the quality it set
+            for (; camera_ms < now + SAMPLE_MS; camera_ms += CAMERA_MS) {
+                uint32_t t = camera_ms;
+                for (int f = 0; f < FLOWS; f++) {
+                    if (qos_decision_admit(&policy.decision, QOS_FLOW_STREAM, last_sent[f], t)) {
+                        uint32_t bytes = frame_bytes(quality);
+                        sample.egress_bytes += bytes;
+                        sample.egress_frames++;
+                        last_sent[f] = t;
+                        if (t >= half) {
+                            half_bytes += bytes;
+                            half_frames++;
+                        }
+                    }
+                }
+            }
+            now += SAMPLE_MS;
+            qos_policy_update(&policy, &sample, now);
+
+            uint8_t next = policy.decision.quality;
+            if (next != quality) {
+                int dir = next > quality ? 1 : -1;
+                int step = abs((int)next - (int)quality);
+                CHECK(step == 4 || next == MAX_Q || next == BASE_Q, "%s: quality %u -> %u", phases[p].name,
+                      quality, next);
+                CHECK(last_step_ms == 0 || now - last_step_ms >= 2000, "%s: quality steps %u ms apart",
+                      phases[p].name, now - last_step_ms);
+                CHECK(next >= BASE_Q && next <= MAX_Q, "%s: quality %u outside %d..%d", phases[p].name, next,
+                      BASE_Q, MAX_Q);
+                if (last_dir != 0 && dir != last_dir) {
+                    reversals++;
+                }
+                last_dir = dir;
+                last_step_ms = now;
+                r->steps++;
+                if (now > half) {
+                    r->late_changes++;
+                }
+                quality = next;
+            }
+        }
+        // One change of direction when the cap moves, never a flip-flop
+        CHECK(reversals <= 1, "%s: quality changed direction %d times", phases[p].name, reversals);
+        r->quality = quality;
+        r->kbps = (uint32_t)(half_bytes * 8 / (phases[p].seconds * 500));
+        r->fps_x10 = half_frames * 10 / FLOWS / (phases[p].seconds / 2);
+    }
+    return 0;
+}
+
+static int test_steps(void)
+{
+    static const phase_t phases[] = {
+        { "unlimited", 0, 20 },
+        { "8 Mbit/s", 8000, 20 },
+        { "600 kbit/s", 600, 40 },
+        { "150 kbit/s", 150, 60 },
+        { "8 Mbit/s again", 8000, 60 },
+    };
+    phase_result_t r[5];
+
+    if (run_phases(phases, 5, r) != 0) {
+        return 1;
+    }
+
+    // Plenty of room: full frame rate at the base quality
+    CHECK(r[0].quality == BASE_Q && r[0].fps_x10 == 250 && r[0].steps == 0, "unlimited: q%u, %u.%u fps, %u steps",
+          r[0].quality, r[0].fps_x10 / 10, r[0].fps_x10 % 10, r[0].steps);
+    CHECK(r[1].quality == BASE_Q && r[1].fps_x10 == 250 && r[1].steps == 0, "8 Mbit/s: q%u, %u.%u fps",
+          r[1].quality, r[1].fps_x10 / 10, r[1].fps_x10 % 10);
+
+    // Tight: 2 x 10 KB x 5 fps is 800 kbit/s, so quality steps until the
+    // frames are small enough for the minimum frame rate, then holds
+    CHECK(r[2].quality > BASE_Q && r[2].quality < MAX_Q && r[2].late_changes == 0,
+          "600 kbit/s: q%u, %u changes after settling", r[2].quality, r[2].late_changes);
+    CHECK(r[2].fps_x10 >= MIN_FPS * 10 && r[2].kbps <= 600 * 105 / 100, "600 kbit/s: %u.%u fps, %u kbit/s",
+          r[2].fps_x10 / 10, r[2].fps_x10 % 10, r[2].kbps);
+
+    // Starved: the coarsest quality is not enough, the frame rate gives
+    CHECK(r[3].quality == MAX_Q && r[3].late_changes == 0 && r[3].kbps <= 150 * 105 / 100 &&
+          r[3].fps_x10 < MIN_FPS * 10, "150 kbit/s: q%u, %u.%u fps, %u kbit/s", r[3].quality, r[3].fps_x10 / 10,
+          r[3].fps_x10 % 10, r[3].kbps);
+
+    // Room again: back down to the base quality, one step at a time
+    CHECK(r[4].quality == BASE_Q && r[4].steps == (MAX_Q - BASE_Q) / 4 && r[4].fps_x10 == 250,
+          "8 Mbit/s again: q%u after %u steps, %u.%u fps", r[4].quality, r[4].steps, r[4].fps_x10 / 10,
+          r[4].fps_x10 % 10);
+
+    printf("ok %u %u %u %u %u %u\n", r[2].quality, r[2].fps_x10, r[2].kbps, r[3].fps_x10, r[3].kbps, r[4].steps);
+    return 0;
+}
+
+// Caps just around the point where a step is needed: with a noisy frame
+// size the quality must settle and stay, never step up and back down
+static int test_hysteresis(void)
+{
+    uint32_t settled = 0;
+
+    for (uint32_t cap = 560; cap <= 1000; cap += 8) {
+        phase_t phases[] = { { "unlimited", 0, 10 }, { "cap", cap, 120 } };
+        phase_result_t r[2];
+
+        if (run_phases(phases, 2, r) != 0) {
+            printf("fail at %u kbit/s\n", cap);
+            return 1;
+        }
+        CHECK(r[1].late_changes == 0, "%u kbit/s: quality still changing after 60 s", cap);
+        CHECK(r[1].kbps <= cap * 105 / 100, "%u kbit/s: sent %u kbit/s", cap, r[1].kbps);
+        CHECK(r[1].fps_x10 >= MIN_FPS * 10 || r[1].quality == MAX_Q, "%u kbit/s: %u.%u fps at q%u", cap,
+              r[1].fps_x10 / 10, r[1].fps_x10 % 10, r[1].quality);
+        settled++;
+    }
+    printf("ok %u\n", settled);
+    return 0;
+}
+
+static int test_ota(void)
+{
+    qos_policy_t policy;
+    qos_policy_config_t config = k_config;
+    qos_sample_t sample = { .streams = 1, .upload = true, .egress_bytes = 0, .egress_frames = 0 };
+    uint32_t now = 1000;
+
+    static const qos_policy_mode_t modes[] = {
+        QOS_POLICY_NONE, QOS_POLICY_OTA_PAUSE, QOS_POLICY_OTA_DEGRADE, QOS_POLICY_STREAM_FIRST,
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        qos_policy_mode_t parsed;
+        config.mode = modes[i];
+        CHECK(qos_policy_mode_parse(qos_policy_mode_name(modes[i]), &parsed) && parsed == modes[i],
+              "mode %d name round trip", modes[i]);
+        qos_policy_init(&policy, &config, now);
+
+        sample.ota = true;
+        qos_policy_update(&policy, &sample, now += 500);
+        const qos_decision_t *d = &policy.decision;
+        bool paused = d->paused[QOS_FLOW_STREAM] && d->paused[QOS_FLOW_UPLOAD];
+        CHECK(paused == (modes[i] == QOS_POLICY_OTA_PAUSE), "%s: paused %d", qos_policy_mode_name(modes[i]),
+              paused);
+        CHECK(modes[i] != QOS_POLICY_OTA_DEGRADE || (d->frame_interval_ms == 500 && d->quality == 30),
+              "ota_degrade: %u ms, q%u", d->frame_interval_ms, d->quality);
+        CHECK((d->ota_kbps == 1000) == (modes[i] == QOS_POLICY_STREAM_FIRST), "%s: OTA cap %u",
+              qos_policy_mode_name(modes[i]), d->ota_kbps);
+        CHECK(!qos_decision_admit(d, QOS_FLOW_UPLOAD, now - 10000, now) == paused, "%s: admit",
+              qos_policy_mode_name(modes[i]));
+
+        // Restored when the update ends
+        sample.ota = false;
+        qos_policy_update(&policy, &sample, now += 500);
+        CHECK(!d->paused[QOS_FLOW_STREAM] && !d->paused[QOS_FLOW_UPLOAD] && d->frame_interval_ms == 0 &&
+              d->quality == BASE_Q && d->ota_kbps == 0, "%s: not restored after OTA", qos_policy_mode_name(modes[i]));
+        CHECK(!qos_policy_update(&policy, &sample, now += 500), "%s: decision changed without a reason",
+              qos_policy_mode_name(modes[i]));
+    }
+    qos_policy_mode_t parsed;
+    CHECK(!qos_policy_mode_parse("fast", &parsed), "unknown mode accepted");
+
+    // OTA pacing: 1000 kbit/s is 125 bytes per ms, capped at 1 s per wait
+    CHECK(qos_pace_delay_ms(12500, 50, 1000) == 50, "pace 12500 B after 50 ms: %u",
+          qos_pace_delay_ms(12500, 50, 1000));
+    CHECK(qos_pace_delay_ms(12500, 200, 1000) == 0, "pace when behind");
+    CHECK(qos_pace_delay_ms(1000000, 0, 1000) == 1000, "pace not capped");
+    CHECK(qos_pace_delay_ms(1000000, 0, 0) == 0, "pace with no cap");
+    printf("ok\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim steps|hysteresis|ota\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "steps") == 0) {
+        return test_steps();
+    }
+    if (strcmp(argv[1], "hysteresis") == 0) {
+        return test_hysteresis();
+    }
+    if (strcmp(argv[1], "ota") == 0) {
+        return test_ota();
+    }
+    fprintf(stderr, "usage: sim steps|hysteresis|ota\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/qos_policy.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test quality steps as the cap changes
+test_steps() {
+    print_test "Quality as the egress cap goes 0, 8000, 600, 150, 8000 kbit/s..."
+
+    run_sim steps || return 1
+    read -r tight_q tight_fps tight_kbps starved_fps starved_kbps back_steps <<< "$RESULT"
+    print_pass "600 kbit/s: q$tight_q at $((tight_fps / 10)).$((tight_fps % 10)) fps, $tight_kbps kbit/s;\
+ 150 kbit/s: q40 at $((starved_fps / 10)).$((starved_fps % 10)) fps, $starved_kbps kbit/s;\
+ back to q12 in $back_steps steps"
+    return 0
+}
+
+# Test that quality settles near the stepping point
+test_hysteresis() {
+    print_test "Settling at caps around the stepping point..."
+
+    run_sim hysteresis || return 1
+    print_pass "$RESULT caps from 560 to 1000 kbit/s settle without flapping, under the cap"
+    return 0
+}
+
+# Test the OTA policies
+test_ota() {
+    print_test "OTA policies..."
+
+    run_sim ota || return 1
+    print_pass "ota_pause pauses, ota_degrade slows and coarsens, stream_first caps OTA, all restored after"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera QoS Policy Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_steps test_hysteresis test_ota; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
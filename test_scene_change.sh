@@ -0,0 +1,574 @@
+#!/bin/bash
+# Test script for DC-only JPEG decoding and static-scene detection
+# Usage: ./test_scene_change.sh
+#
+# Builds main/jpeg_dc.c and main/scene_change.c for the host. Fixed JPEG
+# fixtures (64x48 grayscale scenes and a 70x36 YUYV 4:2:2 frame, encoded once
+# at quality 75) are decoded to their luma DC thumbnails, which are checked
+# for size and against the block means of the source images, and run through
+# the scene-change detector with the decisions the pipeline relies on. Also
+# times the DC decode and the comparison on a 640x480 frame encoded with
+# main/jpeg_enc.c.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#define _POSIX_C_SOURCE 200809L
+#include "jpeg_dc.h"
+#include "jpeg_enc.h"
+#include "scene_change.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+// Fixtures: main/jpeg_enc.c at quality 75 on the images below
+static const uint8_t k_desk[460] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x08, 0x06, 0x06, 0x07, 0x06, 0x05, 0x08,
+    0x07, 0x07, 0x07, 0x09, 0x09, 0x08, 0x0a, 0x0c, 0x14, 0x0d, 0x0c, 0x0b, 0x0b, 0x0c, 0x19, 0x12,
+    0x13, 0x0f, 0x14, 0x1d, 0x1a, 0x1f, 0x1e, 0x1d, 0x1a, 0x1c, 0x1c, 0x20, 0x24, 0x2e, 0x27, 0x20,
+    0x22, 0x2c, 0x23, 0x1c, 0x1c, 0x28, 0x37, 0x29, 0x2c, 0x30, 0x31, 0x34, 0x34, 0x34, 0x1f, 0x27,
+    0x39, 0x3d, 0x38, 0x32, 0x3c, 0x2e, 0x33, 0x34, 0x32, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x30,
+    0x00, 0x40, 0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04,
+    0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03,
+    0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00,
+    0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32,
+    0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94,
+    0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+    0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6,
+    0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda,
+    0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0xf3, 0x18, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85,
+    0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x61, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14, 0xaf, 0x16,
+    0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85, 0x2b, 0x46, 0x14, 0xad,
+    0x08, 0x52, 0xb4, 0x21, 0x4a, 0xf1, 0x68, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14,
+    0xad, 0x18, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14, 0xaf, 0x16, 0x85, 0x2b, 0x89,
+    0xa2, 0xbd, 0x9a, 0x14, 0xad, 0x18, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14, 0xaf,
+    0x16, 0x85, 0x2b, 0x81, 0xa2, 0xbd, 0xbe, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85,
+    0x2b, 0x42, 0x14, 0xaf, 0x16, 0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x61, 0x4a, 0xd0,
+    0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a, 0xff, 0xd9,
+};
+
+static const uint8_t k_desk_noise[483] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x08, 0x06, 0x06, 0x07, 0x06, 0x05, 0x08,
+    0x07, 0x07, 0x07, 0x09, 0x09, 0x08, 0x0a, 0x0c, 0x14, 0x0d, 0x0c, 0x0b, 0x0b, 0x0c, 0x19, 0x12,
+    0x13, 0x0f, 0x14, 0x1d, 0x1a, 0x1f, 0x1e, 0x1d, 0x1a, 0x1c, 0x1c, 0x20, 0x24, 0x2e, 0x27, 0x20,
+    0x22, 0x2c, 0x23, 0x1c, 0x1c, 0x28, 0x37, 0x29, 0x2c, 0x30, 0x31, 0x34, 0x34, 0x34, 0x1f, 0x27,
+    0x39, 0x3d, 0x38, 0x32, 0x3c, 0x2e, 0x33, 0x34, 0x32, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x30,
+    0x00, 0x40, 0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04,
+    0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03,
+    0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00,
+    0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32,
+    0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94,
+    0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+    0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6,
+    0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda,
+    0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0xf3, 0x18, 0x53, 0xa7, 0x15, 0xa3, 0x0a, 0x74,
+    0xad, 0x08, 0x50, 0x71, 0x5a, 0x10, 0xa7, 0x4a, 0xbf, 0x0a, 0x56, 0x84, 0x29, 0xd2, 0xb4, 0x21,
+    0x8f, 0xa5, 0x68, 0xc2, 0x9e, 0xd5, 0xe2, 0xf0, 0xa5, 0x68, 0x42, 0x9d, 0x2b, 0x42, 0x14, 0xe9,
+    0x57, 0xe1, 0x4a, 0xd1, 0x85, 0x3b, 0x55, 0xf8, 0x53, 0xa5, 0x68, 0xc4, 0x95, 0x7e, 0x14, 0xf6,
+    0xaf, 0x18, 0x85, 0x2a, 0xfc, 0x29, 0x5a, 0x30, 0xad, 0x68, 0x42, 0x95, 0xa1, 0x0a, 0x55, 0xf8,
+    0x53, 0x35, 0xa1, 0x0a, 0x74, 0xad, 0x18, 0x53, 0xd2, 0xbc, 0x5a, 0x14, 0xe9, 0x5c, 0x4d, 0x15,
+    0xec, 0xd0, 0xa7, 0x7a, 0xd0, 0x85, 0x3a, 0x56, 0x84, 0x29, 0x5a, 0x30, 0x27, 0x4a, 0xbf, 0x0a,
+    0x74, 0xaf, 0x18, 0x85, 0x2b, 0x80, 0xa2, 0xbd, 0xbe, 0x14, 0xad, 0x08, 0x53, 0xa5, 0x5f, 0x85,
+    0x2b, 0x42, 0x14, 0xad, 0x08, 0x53, 0xa5, 0x78, 0xc4, 0x29, 0x5a, 0x10, 0xa5, 0x5f, 0x85, 0x2b,
+    0x42, 0x14, 0xe9, 0x5a, 0x30, 0xa5, 0x5f, 0x85, 0x2b, 0x42, 0x14, 0xe9, 0x9a, 0xd0, 0x85, 0x3a,
+    0x57, 0xff, 0xd9,
+};
+
+static const uint8_t k_desk_object[456] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x08, 0x06, 0x06, 0x07, 0x06, 0x05, 0x08,
+    0x07, 0x07, 0x07, 0x09, 0x09, 0x08, 0x0a, 0x0c, 0x14, 0x0d, 0x0c, 0x0b, 0x0b, 0x0c, 0x19, 0x12,
+    0x13, 0x0f, 0x14, 0x1d, 0x1a, 0x1f, 0x1e, 0x1d, 0x1a, 0x1c, 0x1c, 0x20, 0x24, 0x2e, 0x27, 0x20,
+    0x22, 0x2c, 0x23, 0x1c, 0x1c, 0x28, 0x37, 0x29, 0x2c, 0x30, 0x31, 0x34, 0x34, 0x34, 0x1f, 0x27,
+    0x39, 0x3d, 0x38, 0x32, 0x3c, 0x2e, 0x33, 0x34, 0x32, 0xff, 0xc0, 0x00, 0x0b, 0x08, 0x00, 0x30,
+    0x00, 0x40, 0x01, 0x01, 0x11, 0x00, 0xff, 0xc4, 0x00, 0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04,
+    0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03,
+    0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00,
+    0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32,
+    0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94,
+    0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2,
+    0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6,
+    0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda,
+    0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0xf3, 0x18, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85,
+    0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x61, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14, 0xaf, 0x16,
+    0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a, 0xf7, 0xca, 0x2b, 0xcd, 0x21, 0x4a,
+    0xd0, 0x85, 0x2b, 0xc5, 0xa1, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xbd, 0xd2,
+    0x8a, 0xf3, 0xc8, 0x52, 0xb4, 0x21, 0x4a, 0xf1, 0x68, 0x52, 0xb8, 0x9a, 0x2b, 0xd9, 0xa1, 0x4a,
+    0xd1, 0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a, 0xf1, 0x68, 0x52, 0xb8, 0x1a,
+    0x2b, 0xdb, 0xe1, 0x4a, 0xd0, 0x85, 0x2b, 0x42, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a, 0xf1,
+    0x68, 0x52, 0xb4, 0x21, 0x4a, 0xd0, 0x85, 0x2b, 0x46, 0x14, 0xad, 0x08, 0x52, 0xb4, 0x21, 0x4a,
+    0xd0, 0x85, 0x2b, 0x42, 0x14, 0xaf, 0xff, 0xd9,
+};
+
+static const uint8_t k_yuyv[860] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x84, 0x00, 0x08, 0x06, 0x06, 0x07, 0x06, 0x05, 0x08,
+    0x07, 0x07, 0x07, 0x09, 0x09, 0x08, 0x0a, 0x0c, 0x14, 0x0d, 0x0c, 0x0b, 0x0b, 0x0c, 0x19, 0x12,
+    0x13, 0x0f, 0x14, 0x1d, 0x1a, 0x1f, 0x1e, 0x1d, 0x1a, 0x1c, 0x1c, 0x20, 0x24, 0x2e, 0x27, 0x20,
+    0x22, 0x2c, 0x23, 0x1c, 0x1c, 0x28, 0x37, 0x29, 0x2c, 0x30, 0x31, 0x34, 0x34, 0x34, 0x1f, 0x27,
+    0x39, 0x3d, 0x38, 0x32, 0x3c, 0x2e, 0x33, 0x34, 0x32, 0x01, 0x09, 0x09, 0x09, 0x0c, 0x0b, 0x0c,
+    0x18, 0x0d, 0x0d, 0x18, 0x32, 0x21, 0x1c, 0x21, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32,
+    0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32,
+    0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32,
+    0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0x32, 0xff, 0xc0, 0x00, 0x11, 0x08, 0x00,
+    0x24, 0x00, 0x46, 0x03, 0x01, 0x21, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xff, 0xc4, 0x00,
+    0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4,
+    0x00, 0xb5, 0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00,
+    0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13,
+    0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15,
+    0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25,
+    0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46,
+    0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66,
+    0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86,
+    0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4,
+    0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2,
+    0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+    0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5,
+    0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00, 0x1f, 0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+    0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00, 0x02, 0x01, 0x02, 0x04,
+    0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11,
+    0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08,
+    0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a,
+    0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93,
+    0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa,
+    0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+    0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6,
+    0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda, 0x00,
+    0x0c, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00, 0xf1, 0x9b, 0x6e, 0xd5, 0xb1,
+    0x6d, 0xda, 0xa3, 0x98, 0xbe, 0x53, 0x62, 0xdb, 0xb5, 0x6c, 0x5b, 0x76, 0xa3, 0x98, 0x39, 0x4d,
+    0x8b, 0x6e, 0xd5, 0xb3, 0x6d, 0xda, 0x8e, 0x60, 0xe5, 0x36, 0x2d, 0xbb, 0x56, 0xc5, 0xb7, 0x6a,
+    0x39, 0x83, 0x94, 0xd6, 0x83, 0xee, 0xd4, 0xd4, 0x73, 0x07, 0x29, 0xf1, 0xd5, 0xb7, 0x6a, 0xd8,
+    0xb6, 0xed, 0x58, 0x73, 0x1b, 0xf2, 0x9b, 0x16, 0xdd, 0xab, 0x62, 0xdb, 0xb5, 0x1c, 0xc1, 0xca,
+    0x6c, 0x5b, 0x76, 0xad, 0x9b, 0x6e, 0xd4, 0x73, 0x07, 0x29, 0xb1, 0x6d, 0xda, 0xb6, 0x2d, 0xbb,
+    0x51, 0xcc, 0x1c, 0xa6, 0xb4, 0x1f, 0x76, 0xa6, 0xa3, 0x98, 0x39, 0x4f, 0x8e, 0xad, 0xbb, 0x56,
+    0xc5, 0xb7, 0x6a, 0xc3, 0x98, 0xdf, 0x94, 0xd8, 0xb6, 0xed, 0x5b, 0x16, 0xdd, 0xa8, 0xe6, 0x0e,
+    0x53, 0x62, 0xdb, 0xb5, 0x6c, 0xdb, 0x76, 0xa3, 0x98, 0x39, 0x4d, 0x8b, 0x6e, 0xd5, 0xb1, 0x6d,
+    0xda, 0x8e, 0x60, 0xe5, 0x35, 0xa0, 0xfb, 0xb5, 0x35, 0x1c, 0xc1, 0xca, 0x7c, 0x75, 0x6d, 0xda,
+    0xb6, 0x2d, 0xbb, 0x56, 0x1c, 0xc6, 0xfc, 0xa6, 0xc5, 0xb7, 0x6a, 0xd8, 0xb6, 0xed, 0x47, 0x30,
+    0x72, 0x9b, 0x16, 0xdd, 0xab, 0x66, 0xdb, 0xb5, 0x1c, 0xc1, 0xca, 0x6c, 0x5b, 0x76, 0xad, 0x8b,
+    0x6e, 0xd4, 0x73, 0x07, 0x29, 0xad, 0x07, 0xdd, 0xa9, 0xa8, 0xe6, 0x0e, 0x53, 0xe3, 0xab, 0x6e,
+    0xd5, 0xb1, 0x6d, 0xda, 0xb1, 0xb9, 0xb5, 0x8d, 0x8b, 0x6e, 0xd5, 0xb1, 0x6d, 0xda, 0x8b, 0x85,
+    0x8d, 0x8b, 0x6e, 0xd5, 0xb3, 0x6d, 0xda, 0x8b, 0x85, 0x8d, 0x8b, 0x6e, 0xd5, 0xb1, 0x6d, 0xda,
+    0x8b, 0x85, 0x8d, 0x68, 0x3e, 0xed, 0x4d, 0x45, 0xc2, 0xc7, 0xff, 0xd9,
+};
+
+// Source of k_desk: a gradient with a dark rectangle
+static uint8_t desk(int x, int y)
+{
+    if (x >= 8 && x < 24 && y >= 24 && y < 40) {
+        return 20;
+    }
+    return 40 + x * 2 + y;
+}
+
+// k_desk_object adds a bright 16x16 square at (32, 8), four blocks
+static uint8_t desk_object(int x, int y)
+{
+    return x >= 32 && x < 48 && y >= 8 && y < 24 ? 230 : desk(x, y);
+}
+
+// k_yuyv luma
+static uint8_t yuyv_luma(int x, int y)
+{
+    (void)y;
+    return 16 + x * 3;
+}
+
+static jpeg_dc_decoder_t dec;
+static uint8_t thumb[80 * 60];
+
+// Decoded thumbnail against the source's 8x8 block means (edge blocks
+// averaged over the pixels that exist)
+static int check_thumb(const char *name, const uint8_t *jpeg, size_t len, uint8_t (*src)(int, int),
+                       int width, int height, int want_w, int want_h, int tolerance)
+{
+    jpeg_dc_info_t info;
+    uint16_t w, h;
+
+    CHECK(jpeg_dc_size(jpeg, len, &w, &h) && w == width && h == height, "%s: size %ux%u", name, w, h);
+    CHECK(jpeg_dc_luma(&dec, jpeg, len, thumb, sizeof(thumb), &info), "%s: not decoded", name);
+    CHECK(info.width == width && info.height == height, "%s: %ux%u", name, info.width, info.height);
+    CHECK(info.thumb_w == want_w && info.thumb_h == want_h, "%s: thumbnail %ux%u, expected %dx%d", name,
+          info.thumb_w, info.thumb_h, want_w, want_h);
+    for (int by = 0; by < want_h; by++) {
+        for (int bx = 0; bx < want_w; bx++) {
+            int sum = 0, n = 0;
+            for (int y = by * 8; y < by * 8 + 8 && y < height; y++) {
+                for (int x = bx * 8; x < bx * 8 + 8 && x < width; x++) {
+                    sum += src(x, y);
+                    n++;
+                }
+            }
+            int mean = (sum + n / 2) / n;
+            int got = thumb[by * want_w + bx];
+            // Edge blocks are padded by the encoder, so only full blocks are exact
+            int tol = n == 64 ? tolerance : 40;
+            CHECK(abs(got - mean) <= tol, "%s: block (%d,%d) %d, source mean %d", name, bx, by, got, mean);
+        }
+    }
+    return 0;
+}
+
+static int test_decode(void)
+{
+    if (check_thumb("desk", k_desk, sizeof(k_desk), desk, 64, 48, 8, 6, 2) != 0 ||
+        check_thumb("desk+noise", k_desk_noise, sizeof(k_desk_noise), desk, 64, 48, 8, 6, 2) != 0 ||
+        check_thumb("desk+object", k_desk_object, sizeof(k_desk_object), desk_object, 64, 48, 8, 6, 2) != 0 ||
+        check_thumb("yuyv", k_yuyv, sizeof(k_yuyv), yuyv_luma, 70, 36, 9, 5, 2) != 0) {
+        return 1;
+    }
+
+    // The thumbnail must fit
+    jpeg_dc_info_t info;
+    CHECK(!jpeg_dc_luma(&dec, k_desk, sizeof(k_desk), thumb, 47, &info), "47 bytes took a 48-block thumbnail");
+    CHECK(info.thumb_w == 8 && info.thumb_h == 6, "size not reported when too large");
+    printf("ok\n");
+    return 0;
+}
+
+static int test_reject(void)
+{
+    uint8_t buf[1024];
+    jpeg_dc_info_t info;
+
+    // Progressive: the same file with SOF0 turned into SOF2
+    memcpy(buf, k_desk, sizeof(k_desk));
+    size_t sof = 0;
+    for (size_t i = 2; i + 1 < sizeof(k_desk); i++) {
+        if (buf[i] == 0xFF && buf[i + 1] == 0xC0) {
+            sof = i;
+            break;
+        }
+    }
+    CHECK(sof != 0, "no SOF0 in the fixture");
+    buf[sof + 1] = 0xC2;
+    CHECK(!jpeg_dc_luma(&dec, buf, sizeof(k_desk), thumb, sizeof(thumb), &info), "progressive accepted");
+
+    // Truncated anywhere: never a crash, never a bogus success before the scan
+    int decoded = 0;
+    for (size_t len = 0; len < sizeof(k_desk) - 2; len++) {
+        bool ok = jpeg_dc_luma(&dec, k_desk, len, thumb, sizeof(thumb), &info);
+        decoded += ok;
+        CHECK(!ok || len > sof, "decoded from %zu bytes", len);
+    }
+    CHECK(!jpeg_dc_luma(&dec, (const uint8_t *)"not a jpeg", 10, thumb, sizeof(thumb), &info), "text accepted");
+    printf("ok %d\n", decoded);
+    return 0;
+}
+
+static uint8_t buf_a[80 * 60], buf_b[80 * 60];
+
+static int test_decisions(void)
+{
+    scene_change_t sc;
+
+    // Blocks moving by more than 8, in more than 5 % of the blocks
+    scene_change_init(&sc, buf_a, buf_b, sizeof(buf_a), 8, 50);
+    CHECK(scene_change_update(&sc, k_desk, sizeof(k_desk)), "first frame unchanged");
+    CHECK(!scene_change_update(&sc, k_desk, sizeof(k_desk)), "same frame changed");
+    CHECK(!scene_change_update(&sc, k_desk_noise, sizeof(k_desk_noise)), "sensor noise changed");
+    CHECK(sc.thumb == sc.current, "unchanged frame's thumbnail not current");
+    // 4 of 48 blocks = 83 permille
+    CHECK(scene_change_update(&sc, k_desk_object, sizeof(k_desk_object)), "object not detected");
+    CHECK(sc.thumb == sc.reference, "changed frame's thumbnail not the reference");
+    CHECK(!scene_change_update(&sc, k_desk_object, sizeof(k_desk_object)), "object changed twice");
+    CHECK(scene_change_update(&sc, k_desk, sizeof(k_desk)), "object leaving not detected");
+
+    // With a 10 % threshold four blocks are not enough
+    scene_change_init(&sc, buf_a, buf_b, sizeof(buf_a), 8, 100);
+    scene_change_update(&sc, k_desk, sizeof(k_desk));
+    CHECK(!scene_change_update(&sc, k_desk_object, sizeof(k_desk_object)), "4 blocks over 10 %%");
+
+    // A different size always counts as changed
+    CHECK(scene_change_update(&sc, k_yuyv, sizeof(k_yuyv)), "new frame size unchanged");
+    CHECK(!scene_change_update(&sc, k_yuyv, sizeof(k_yuyv)), "same yuyv frame changed");
+
+    // Corrupt entropy data: changed, flagged, and the reference is dropped
+    uint8_t bad[1024];
+    memcpy(bad, k_desk, sizeof(k_desk));
+    memset(bad + sizeof(k_desk) - 60, 0xFF, 20);
+    bool changed = scene_change_update(&sc, bad, sizeof(k_desk));
+    if (!sc.undecodable) {
+        // The damage decoded as data; it must still not match the yuyv frame
+        CHECK(changed, "corrupt frame matched");
+    } else {
+        CHECK(changed && !sc.has_reference && sc.thumb == NULL, "undecodable frame kept the reference");
+    }
+    CHECK(scene_change_update(&sc, k_desk, sizeof(k_desk)) && !sc.undecodable, "recovery not reported");
+
+    // Too large for the buffers: changed but not undecodable
+    scene_change_init(&sc, buf_a, buf_b, 40, 8, 50);
+    CHECK(scene_change_update(&sc, k_desk, sizeof(k_desk)) && !sc.undecodable, "oversize frame undecodable");
+
+    // The counting kernel stops once over the limit
+    uint8_t a[100] = { 0 }, b[100];
+    memset(b, 20, sizeof(b));
+    CHECK(scene_change_count(a, b, 100, 8, 1000) == 100, "count %lu",
+          (unsigned long)scene_change_count(a, b, 100, 8, 1000));
+    CHECK(scene_change_count(a, b, 100, 8, 10) == 11, "no early stop");
+    CHECK(scene_change_count(a, b, 100, 20, 0) == 0, "delta not exclusive");
+    printf("ok\n");
+    return 0;
+}
+
+// A slow brightness drift is caught once it adds up against the reference
+static int test_drift(void)
+{
+    static uint8_t img[64 * 48];
+    static uint8_t jpeg[8192];
+    jpeg_enc_t enc;
+    scene_change_t sc;
+    int changes = 0, first_change = -1;
+
+    jpeg_enc_init(&enc, 75);
+    scene_change_init(&sc, buf_a, buf_b, sizeof(buf_a), 8, 50);
+    for (int step = 0; step < 30; step++) {
+        for (int y = 0; y < 48; y++) {
+            for (int x = 0; x < 64; x++) {
+                img[y * 64 + x] = desk(x, y) + step;
+            }
+        }
+        size_t len = jpeg_enc_encode(&enc, img, 64, 48, 0, JPEG_ENC_GRAYSCALE, jpeg, sizeof(jpeg));
+        CHECK(len > 0, "encode failed");
+        if (scene_change_update(&sc, jpeg, len) && step > 0) {
+            changes++;
+            if (first_change < 0) {
+                first_change = step;
+            }
+        }
+    }
+    // +1 per frame against a threshold of 8: roughly every ninth frame
+    CHECK(first_change >= 8 && first_change <= 10, "first drift change at step %d", first_change);
+    CHECK(changes >= 2 && changes <= 4, "%d changes in 30 steps", changes);
+    printf("ok %d %d\n", first_change, changes);
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// DC decode and comparison of a 640x480 YUYV frame
+static int test_bench(void)
+{
+    static uint8_t img[640 * 480 * 2];
+    static uint8_t jpeg[200000];
+    static uint8_t ta[80 * 60], tb[80 * 60];
+    jpeg_enc_t enc;
+    jpeg_dc_info_t info;
+    scene_change_t sc;
+    uint32_t seed = 31;
+
+    for (int y = 0; y < 480; y++) {
+        for (int x = 0; x < 640; x++) {
+            seed = seed * 1103515245u + 12345u;
+            uint8_t *p = &img[(y * 640 + x) * 2];
+            p[0] = (uint8_t)((x ^ y) + (seed >> 28));
+            p[1] = 128 + (x & 1 ? y : -y) / 8;
+        }
+    }
+    jpeg_enc_init(&enc, 75);
+    size_t len = jpeg_enc_encode(&enc, img, 640, 480, 0, JPEG_ENC_YUYV, jpeg, sizeof(jpeg));
+    CHECK(len > 0, "encode failed");
+    CHECK(jpeg_dc_luma(&dec, jpeg, len, thumb, sizeof(thumb), &info) && info.thumb_w == 80 && info.thumb_h == 60,
+          "640x480 thumbnail %ux%u", info.thumb_w, info.thumb_h);
+
+    const int n = 200;
+    double start = now_us();
+    for (int i = 0; i < n; i++) {
+        jpeg_dc_luma(&dec, jpeg, len, thumb, sizeof(thumb), &info);
+    }
+    double decode_us = (now_us() - start) / n;
+
+    scene_change_init(&sc, ta, tb, sizeof(ta), 8, 50);
+    start = now_us();
+    for (int i = 0; i < n; i++) {
+        scene_change_update(&sc, jpeg, len);
+    }
+    double update_us = (now_us() - start) / n;
+    printf("ok %zu %.0f %.0f\n", len, decode_us, update_us);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim decode|reject|decisions|drift|bench\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "decode") == 0) {
+        return test_decode();
+    }
+    if (strcmp(argv[1], "reject") == 0) {
+        return test_reject();
+    }
+    if (strcmp(argv[1], "decisions") == 0) {
+        return test_decisions();
+    }
+    if (strcmp(argv[1], "drift") == 0) {
+        return test_drift();
+    }
+    if (strcmp(argv[1], "bench") == 0) {
+        return test_bench();
+    }
+    fprintf(stderr, "usage: sim decode|reject|decisions|drift|bench\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/jpeg_dc.c main/scene_change.c main/jpeg_enc.c \
+        -lm -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the DC thumbnails of the fixtures
+test_decode() {
+    print_test "Decoding DC thumbnails of the fixtures..."
+
+    run_sim decode || return 1
+    print_pass "8x6 and 9x5 thumbnails within 2 of the source block means"
+    return 0
+}
+
+# Test unsupported and damaged files
+test_reject() {
+    print_test "Rejecting progressive and truncated files..."
+
+    run_sim reject || return 1
+    print_pass "Progressive rejected; $RESULT truncated copies decoded, none cut before the scan"
+    return 0
+}
+
+# Test the change decisions
+test_decisions() {
+    print_test "Scene-change decisions on the fixtures..."
+
+    run_sim decisions || return 1
+    print_pass "Noise unchanged, a 4-block object changed at 5 % but not 10 %, size change and corruption changed"
+    return 0
+}
+
+# Test a slow drift
+test_drift() {
+    print_test "Slow brightness drift..."
+
+    run_sim drift || return 1
+    read -r first changes <<< "$RESULT"
+    print_pass "First reported at step $first, $changes changes in 30 steps"
+    return 0
+}
+
+# Time the decode and the comparison
+test_bench() {
+    print_test "Timing a 640x480 frame..."
+
+    run_sim bench || return 1
+    read -r len decode update <<< "$RESULT"
+    print_pass "$len-byte JPEG: DC decode $decode us, scene_change_update $update us"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Scene Change Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_decode test_reject test_decisions test_drift test_bench; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
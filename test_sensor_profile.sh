@@ -0,0 +1,453 @@
+#!/bin/bash
+# Test script for the sensor profile loader
+# Usage: ./test_sensor_profile.sh
+#
+# Runs main/sensor_profile.c against a mock OV2640 on a mock SCCB bus. The
+# mock writes registers the way esp32-camera's set_reg() does (bank select
+# when it changes, read, write) and counts the bus transactions, so the
+# tests check both what ends up in the registers and what it cost.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# The mock sensor and one command per test. Prints "ok <details>" or
+# "fail <reason>".
+build_mock() {
+    cat > "$WORK_DIR/mock.c" <<'EOF'
+#include "sensor_profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SENSOR(addr) SENSOR_REG(SENSOR_BANK_SENSOR, addr)
+#define DSP(addr) SENSOR_REG(SENSOR_BANK_DSP, addr)
+
+static uint8_t s_regs[2][256];
+static uint8_t s_reset[2][256];
+static int s_bank = -1;
+static unsigned s_calls, s_writes, s_reads, s_bank_selects, s_fail_at;
+
+static void mock_reset(void)
+{
+    for (int b = 0; b < 2; b++) {
+        for (int i = 0; i < 256; i++) {
+            s_reset[b][i] = (uint8_t)rand();
+        }
+    }
+    memcpy(s_regs, s_reset, sizeof(s_regs));
+    s_bank = -1;
+}
+
+static void mock_count_reset(void)
+{
+    s_calls = s_writes = s_reads = s_bank_selects = 0;
+}
+
+// One transaction: set_reg() for every register, as the device does
+static bool mock_write(void *ctx, const sensor_reg_t *regs, size_t count)
+{
+    s_calls++;
+    for (size_t i = 0; i < count; i++) {
+        int bank = SENSOR_REG_BANK(regs[i].reg);
+        uint8_t addr = regs[i].reg & 0xFF;
+        if (s_fail_at && s_writes + 1 == s_fail_at) {
+            return false;
+        }
+        if (bank != s_bank) {
+            s_bank = bank;
+            s_bank_selects++;
+        }
+        s_reads++;
+        s_regs[bank][addr] = (uint8_t)((s_regs[bank][addr] & ~regs[i].mask) | (regs[i].value & regs[i].mask));
+        s_writes++;
+    }
+    return true;
+}
+
+static uint8_t reg(uint16_t r)
+{
+    return s_regs[SENSOR_REG_BANK(r)][r & 0xFF];
+}
+
+// Every bit the table sets is in the sensor, every other bit is as reset left it
+static bool mock_matches(const sensor_reg_table_t *table)
+{
+    for (int b = 0; b < 2; b++) {
+        for (int a = 0; a < 256; a++) {
+            uint8_t mask = 0, value = 0;
+            for (int i = 0; i < table->count; i++) {
+                if (table->regs[i].reg == SENSOR_REG(b, a)) {
+                    mask = table->regs[i].mask;
+                    value = table->regs[i].value;
+                }
+            }
+            if ((s_regs[b][a] & ~mask) != (s_reset[b][a] & ~mask) || (s_regs[b][a] & mask) != (value & mask)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static const sensor_reg_table_t *table(const char *name)
+{
+    static sensor_reg_table_t tables[8];
+    static const char *names[8];
+    for (int i = 0; i < 8; i++) {
+        if (names[i] == NULL) {
+            names[i] = name;
+            sensor_profile_compile(sensor_profile_find(name), &tables[i]);
+        }
+        if (strcmp(names[i], name) == 0) {
+            return &tables[i];
+        }
+    }
+    return NULL;
+}
+
+static int fail(const char *reason)
+{
+    printf("fail %s\n", reason);
+    return 0;
+}
+
+static int test_compile(void)
+{
+    for (int p = 0; sensor_profile_get(p) != NULL; p++) {
+        const sensor_profile_t *profile = sensor_profile_get(p);
+        const sensor_reg_table_t *t = table(profile->name);
+        if (sensor_profile_find(profile->name) != profile) {
+            return fail("lookup");
+        }
+        for (int i = 1; i < t->count; i++) {
+            if (t->regs[i - 1].reg >= t->regs[i].reg) {
+                return fail("table not sorted or register repeated");
+            }
+        }
+        if (t->count != (profile->quality >= 0 ? 9 : 8)) {
+            return fail("register count");
+        }
+    }
+    if (sensor_profile_find("dusk") != NULL || sensor_profile_get(4) != NULL) {
+        return fail("unknown profile found");
+    }
+
+    // Spot checks against the driver's setters
+    const sensor_reg_table_t *day = table("day"), *night = table("night"), *lowbw = table("lowbw");
+    for (int i = 0; i < day->count; i++) {
+        const sensor_reg_t *r = &day->regs[i];
+        if ((r->reg == SENSOR(0x13) && (r->mask != 0x05 || r->value != 0x05)) ||
+            (r->reg == DSP(0xC3) && (r->mask != 0x2E || r->value != 0x2E)) ||
+            (r->reg == DSP(0x87) && (r->mask != 0xC0 || r->value != 0x40)) ||
+            (r->reg == SENSOR(0x14) && (r->mask != 0xFF || r->value != 0x08)) ||
+            (r->reg == SENSOR(0x04) && (r->mask != 0xD0 || r->value != 0x00))) {
+            return fail("day register value");
+        }
+    }
+    for (int i = 0; i < night->count; i++) {
+        const sensor_reg_t *r = &night->regs[i];
+        if ((r->reg == SENSOR(0x14) && r->value != 0x88) || (r->reg == DSP(0xC2) && r->value != 0x80)) {
+            return fail("night register value");
+        }
+    }
+    if (lowbw->regs[0].reg != DSP(0x44) || lowbw->regs[0].value != 30) {
+        return fail("lowbw quality");
+    }
+    printf("ok %u\n", day->count);
+    return 0;
+}
+
+static int test_cold(void)
+{
+    sensor_reg_cache_t cache;
+    sensor_apply_result_t res;
+
+    mock_reset();
+    sensor_reg_cache_clear(&cache);
+    mock_count_reset();
+    if (!sensor_profile_apply(&cache, table("day"), mock_write, NULL, &res)) {
+        return fail("apply");
+    }
+    if (s_calls != 1 || s_writes != table("day")->count || res.written != s_writes || res.unchanged != 0) {
+        return fail("cold load did not write every register in one batch");
+    }
+    if (s_bank_selects > 2 || res.bank_switches != 1) {
+        return fail("bank switched more than once");
+    }
+    if (!mock_matches(table("day"))) {
+        return fail("registers");
+    }
+    unsigned cold = s_writes;
+
+    mock_count_reset();
+    sensor_profile_apply(&cache, table("day"), mock_write, NULL, &res);
+    if (s_calls != 0 || res.written != 0 || res.unchanged != table("day")->count) {
+        return fail("reload touched the bus");
+    }
+
+    // After a sensor reset everything is written again
+    mock_reset();
+    sensor_reg_cache_clear(&cache);
+    mock_count_reset();
+    sensor_profile_apply(&cache, table("day"), mock_write, NULL, &res);
+    if (s_writes != cold || !mock_matches(table("day"))) {
+        return fail("load after clear");
+    }
+    printf("ok %u\n", cold);
+    return 0;
+}
+
+// Loads FROM then TO; prints the registers the switch wrote
+static int test_switch(const char *from, const char *to, unsigned expect)
+{
+    sensor_reg_cache_t cache;
+    sensor_apply_result_t res;
+
+    mock_reset();
+    sensor_reg_cache_clear(&cache);
+    sensor_profile_apply(&cache, table(from), mock_write, NULL, NULL);
+    mock_count_reset();
+    if (!sensor_profile_apply(&cache, table(to), mock_write, NULL, &res)) {
+        return fail("apply");
+    }
+    if (s_writes != expect || res.written != expect || s_calls != (expect > 0)) {
+        printf("fail %u registers written, expected %u\n", s_writes, expect);
+        return 0;
+    }
+
+    // Bits from `from` that `to` does not set stay; the ones it sets match
+    const sensor_reg_table_t *t = table(to);
+    for (int i = 0; i < t->count; i++) {
+        if ((reg(t->regs[i].reg) & t->regs[i].mask) != (t->regs[i].value & t->regs[i].mask)) {
+            return fail("registers");
+        }
+    }
+    printf("ok %u\n", s_writes);
+    return 0;
+}
+
+static int test_failure(void)
+{
+    sensor_reg_cache_t cache;
+    sensor_apply_result_t res;
+
+    mock_reset();
+    sensor_reg_cache_clear(&cache);
+    sensor_profile_apply(&cache, table("day"), mock_write, NULL, NULL);
+
+    // The second of three writes fails
+    mock_count_reset();
+    s_fail_at = 2;
+    if (sensor_profile_apply(&cache, table("night"), mock_write, NULL, &res) || res.written != 0) {
+        return fail("failed write reported as success");
+    }
+    s_fail_at = 0;
+
+    // The whole batch is written again, nothing else
+    mock_count_reset();
+    if (!sensor_profile_apply(&cache, table("night"), mock_write, NULL, &res) || s_writes != 3) {
+        return fail("retry did not rewrite the failed batch");
+    }
+    if (!mock_matches(table("night"))) {
+        return fail("registers after retry");
+    }
+    printf("ok\n");
+    return 0;
+}
+
+// Random switches, with the registers changed behind the cache's back and
+// the cache cleared as the device does when that happens
+static int test_random(void)
+{
+    sensor_reg_cache_t cache;
+    unsigned writes = 0, loads = 0;
+
+    mock_reset();
+    sensor_reg_cache_clear(&cache);
+    for (int i = 0; i < 5000; i++) {
+        if (rand() % 10 == 0) {
+            const sensor_reg_t *r = &table("day")->regs[rand() % table("day")->count];
+            s_regs[SENSOR_REG_BANK(r->reg)][r->reg & 0xFF] ^= (uint8_t)(1 << rand() % 8);
+            sensor_reg_cache_clear(&cache);
+        }
+        const sensor_profile_t *profile = sensor_profile_get(rand() % 4);
+        const sensor_reg_table_t *t = table(profile->name);
+        mock_count_reset();
+        if (!sensor_profile_apply(&cache, t, mock_write, NULL, NULL) || s_calls > 1) {
+            return fail("apply");
+        }
+        for (int j = 0; j < t->count; j++) {
+            if ((reg(t->regs[j].reg) & t->regs[j].mask) != (t->regs[j].value & t->regs[j].mask)) {
+                printf("fail load %d of %s left register 0x%03x wrong\n", i, profile->name, t->regs[j].reg);
+                return 0;
+            }
+        }
+        writes += s_writes;
+        loads++;
+    }
+    printf("ok %u %u\n", loads, writes);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    srand(1);
+    if (argc == 2 && strcmp(argv[1], "compile") == 0) {
+        return test_compile();
+    }
+    if (argc == 2 && strcmp(argv[1], "cold") == 0) {
+        return test_cold();
+    }
+    if (argc == 5 && strcmp(argv[1], "switch") == 0) {
+        return test_switch(argv[2], argv[3], (unsigned)atoi(argv[4]));
+    }
+    if (argc == 2 && strcmp(argv[1], "failure") == 0) {
+        return test_failure();
+    }
+    if (argc == 2 && strcmp(argv[1], "random") == 0) {
+        return test_random();
+    }
+    fprintf(stderr, "usage: mock compile|cold|switch FROM TO WRITES|failure|random\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/mock.c" main/sensor_profile.c -o "$WORK_DIR/mock"
+}
+
+# Run one mock command; sets RESULT to what follows "ok"
+run_mock() {
+    local out
+    out=$("$WORK_DIR/mock" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test that every profile compiles to one sorted entry per register
+test_compile() {
+    print_test "Compiling the built-in profiles..."
+
+    run_mock compile || return 1
+    print_pass "day, night, lowbw, highfps: one entry per register, day in $RESULT registers"
+    return 0
+}
+
+# Test a load with nothing cached, then the same profile again
+test_cold_load() {
+    print_test "Loading a profile onto a freshly reset sensor..."
+
+    run_mock cold || return 1
+    print_pass "$RESULT registers in one batch with one bank switch, the same profile again writes nothing"
+    return 0
+}
+
+# Test that a switch writes only the registers the profiles set differently
+test_switch() {
+    print_test "Switching between profiles..."
+
+    # CTRL0, CTRL3, COM9
+    run_mock switch day night 3 || return 1
+    run_mock switch night day 3 || return 1
+    # QS
+    run_mock switch day lowbw 1 || return 1
+    # QS, COM9
+    run_mock switch lowbw highfps 2 || return 1
+    # COM9; day keeps the quality highfps set
+    run_mock switch highfps day 1 || return 1
+    print_pass "Only the changed registers were written"
+    return 0
+}
+
+# Test that a failed batch is written again on the next load
+test_failure() {
+    print_test "Failing a write in the middle of a batch..."
+
+    run_mock failure || return 1
+    print_pass "Load failed, the next one rewrote the batch"
+    return 0
+}
+
+# Test random switches with registers changed behind the cache's back
+test_random() {
+    print_test "Switching profiles at random with outside writes..."
+
+    run_mock random || return 1
+    read -r loads writes <<< "$RESULT"
+    print_pass "$loads loads, $writes register writes, registers always right"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Sensor Profile Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    failed_tests=0
+
+    if ! build_mock; then
+        print_fail "Cannot build the mock sensor"
+        return 1
+    fi
+
+    if ! test_compile; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_cold_load; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_switch; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_failure; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_random; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
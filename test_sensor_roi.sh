@@ -0,0 +1,352 @@
+#!/bin/bash
+# Test script for the ROI to OV2640 window mapping
+# Usage: ./test_sensor_roi.sh
+#
+# Builds main/sensor_roi.c for the host and checks sensor_roi_map() on a few
+# known ROIs, then fuzzes it with random and edge-case ROIs and output sizes
+# (FUZZ_CASES, 2M by default) against the invariants camera_roi_set() relies
+# on: register alignment, the window inside the mode's readout, no
+# upscaling, the aspect ratio kept, the most binned usable mode chosen, and
+# the applied ROI within one alignment step of the requested one.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "sensor_roi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define ROI_FMT "roi %u,%u %ux%u out %ux%u"
+#define ROI_ARGS(r, mw, mh) (r)->x, (r)->y, (r)->w, (r)->h, (mw), (mh)
+
+// Readout size and binning of each mode, indexed by sensor_roi_mode_t
+static const struct {
+    unsigned div;
+    unsigned max_w;
+    unsigned max_h;
+} k_modes[3] = {
+    [SENSOR_ROI_MODE_UXGA] = { 1, 1600, 1200 },
+    [SENSOR_ROI_MODE_SVGA] = { 2, 800, 600 },
+    [SENSOR_ROI_MODE_CIF] = { 4, 400, 296 },
+};
+
+// esp32-camera frame sizes the /roi handler maps to
+static const uint16_t k_frame_sizes[][2] = {
+    { 96, 96 }, { 160, 120 }, { 176, 144 }, { 240, 176 }, { 240, 240 }, { 320, 240 },
+    { 400, 296 }, { 480, 320 }, { 640, 480 }, { 800, 600 }, { 1024, 768 }, { 1280, 720 },
+    { 1280, 1024 }, { 1600, 1200 },
+};
+
+static uint32_t s_rng = 0x2545f491;
+
+static uint32_t rnd(uint32_t n)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng % n;
+}
+
+// Coordinates near the interesting edges: 0, the minimum size, the sensor
+// size and past it
+static uint16_t fuzz_coord(uint32_t full, uint32_t min)
+{
+    switch (rnd(6)) {
+    case 0:
+        return rnd(8);
+    case 1:
+        return min - 4 + rnd(8);
+    case 2:
+        return full - 8 + rnd(16);
+    case 3:
+        return 0xffff - rnd(4);
+    default:
+        return rnd(full + 64);
+    }
+}
+
+static unsigned full_w(const sensor_roi_rect_t *roi)
+{
+    return roi->w < SENSOR_ROI_MIN_W ? SENSOR_ROI_MIN_W : (roi->w > SENSOR_ROI_FULL_W ? SENSOR_ROI_FULL_W : roi->w);
+}
+
+static unsigned full_h(const sensor_roi_rect_t *roi)
+{
+    return roi->h < SENSOR_ROI_MIN_H ? SENSOR_ROI_MIN_H : (roi->h > SENSOR_ROI_FULL_H ? SENSOR_ROI_FULL_H : roi->h);
+}
+
+// Everything sensor_roi_map() promises for one call
+static int check_map(const sensor_roi_rect_t *roi, uint16_t max_w, uint16_t max_h)
+{
+    sensor_roi_window_t win;
+    bool ok = sensor_roi_map(roi, max_w, max_h, &win);
+
+    CHECK(ok == (max_w >= 16 && max_h >= 8), ROI_FMT " %s", ROI_ARGS(roi, max_w, max_h),
+          ok ? "mapped" : "refused");
+    if (!ok) {
+        return 0;
+    }
+    CHECK(win.mode <= SENSOR_ROI_MODE_CIF, ROI_FMT " mode %d", ROI_ARGS(roi, max_w, max_h), win.mode);
+
+    unsigned div = k_modes[win.mode].div;
+    const char *mode = sensor_roi_mode_name(win.mode);
+
+    // Register alignment and readout bounds
+    CHECK(win.window_w % 4 == 0 && win.window_h % 4 == 0 && win.out_w % 16 == 0 && win.out_h % 8 == 0,
+          ROI_FMT " misaligned %s window %ux%u out %ux%u", ROI_ARGS(roi, max_w, max_h), mode,
+          win.window_w, win.window_h, win.out_w, win.out_h);
+    CHECK(win.out_w >= 16 && win.out_h >= 8 && win.out_w <= max_w && win.out_h <= max_h,
+          ROI_FMT " output %ux%u", ROI_ARGS(roi, max_w, max_h), win.out_w, win.out_h);
+    CHECK(win.offset_x + win.window_w <= k_modes[win.mode].max_w &&
+          win.offset_y + win.window_h <= k_modes[win.mode].max_h,
+          ROI_FMT " %s window %u,%u %ux%u outside the readout", ROI_ARGS(roi, max_w, max_h), mode,
+          win.offset_x, win.offset_y, win.window_w, win.window_h);
+
+    // The DSP only scales down
+    CHECK(win.out_w <= win.window_w && win.out_h <= win.window_h,
+          ROI_FMT " upscales %s window %ux%u to %ux%u", ROI_ARGS(roi, max_w, max_h), mode,
+          win.window_w, win.window_h, win.out_w, win.out_h);
+
+    // Applied ROI: the window in full-resolution pixels, on the sensor and
+    // within one alignment step of the clamped request
+    unsigned rw = full_w(roi);
+    unsigned rh = full_h(roi);
+    unsigned rx = roi->x + rw > SENSOR_ROI_FULL_W ? SENSOR_ROI_FULL_W - rw : roi->x;
+    unsigned ry = roi->y + rh > SENSOR_ROI_FULL_H ? SENSOR_ROI_FULL_H - rh : roi->y;
+    const sensor_roi_rect_t *a = &win.applied;
+
+    CHECK(a->x == win.offset_x * div && a->y == win.offset_y * div && a->w == win.window_w * div &&
+          a->h == win.window_h * div, ROI_FMT " applied %u,%u %ux%u is not the %s window",
+          ROI_ARGS(roi, max_w, max_h), a->x, a->y, a->w, a->h, mode);
+    CHECK(a->x + a->w <= SENSOR_ROI_FULL_W && a->y + a->h <= SENSOR_ROI_FULL_H,
+          ROI_FMT " applied %u,%u %ux%u off the sensor", ROI_ARGS(roi, max_w, max_h), a->x, a->y, a->w, a->h);
+    CHECK(a->w <= rw && a->w + 4 * div > rw && a->h <= rh && a->h + 4 * div > rh,
+          ROI_FMT " applied %ux%u for %ux%u in %s", ROI_ARGS(roi, max_w, max_h), a->w, a->h, rw, rh, mode);
+    CHECK(a->x <= rx && a->x + div > rx, ROI_FMT " applied x %u for %u in %s", ROI_ARGS(roi, max_w, max_h),
+          a->x, rx, mode);
+    // CIF reads 296 of 300 lines: a ROI at the bottom edge moves up by at
+    // most those 4 lines, in full-resolution pixels
+    unsigned slack_y = win.mode == SENSOR_ROI_MODE_CIF ? 16 : 0;
+    CHECK(a->y <= ry && a->y + div + slack_y > ry, ROI_FMT " applied y %u for %u in %s",
+          ROI_ARGS(roi, max_w, max_h), a->y, ry, mode);
+
+    // Aspect ratio, up to the 16x8 rounding (the 16x8 floor can distort
+    // very narrow ROIs further)
+    if (win.out_w > 16 && win.out_h > 8) {
+        long err = (long)win.out_w * rh - (long)win.out_h * rw;
+        long tol = 17L * rh + 9L * rw;
+        CHECK(labs(err) <= tol, ROI_FMT " output %ux%u for ROI %ux%u", ROI_ARGS(roi, max_w, max_h),
+              win.out_w, win.out_h, rw, rh);
+    }
+
+    // Most binned usable mode: the next more binned one would upscale or
+    // not fit its readout
+    if (win.mode != SENSOR_ROI_MODE_CIF) {
+        sensor_roi_mode_t more = win.mode == SENSOR_ROI_MODE_UXGA ? SENSOR_ROI_MODE_SVGA : SENSOR_ROI_MODE_CIF;
+        unsigned d = k_modes[more].div;
+        unsigned ww = (rw / d) & ~3u;
+        unsigned wh = (rh / d) & ~3u;
+        bool usable = ww >= win.out_w && wh >= win.out_h && rx / d + ww <= k_modes[more].max_w &&
+                      wh <= k_modes[more].max_h;
+        CHECK(!usable, ROI_FMT " %s chosen, %s usable", ROI_ARGS(roi, max_w, max_h), mode,
+              sensor_roi_mode_name(more));
+    }
+    return 0;
+}
+
+static int test_known(void)
+{
+    static const struct {
+        sensor_roi_rect_t roi;
+        uint16_t max_w;
+        uint16_t max_h;
+        sensor_roi_mode_t mode;
+        uint16_t out_w;
+        uint16_t out_h;
+    } cases[] = {
+        // Full sensor to VGA: 4x binned readout of 400x296 is too small,
+        // SVGA is enough
+        { { 0, 0, 1600, 1200 }, 640, 480, SENSOR_ROI_MODE_SVGA, 640, 480 },
+        // CIF reads out 296 lines, so the full 1200 need SVGA even at QVGA;
+        // 1184 of them fit
+        { { 0, 0, 1600, 1200 }, 320, 240, SENSOR_ROI_MODE_SVGA, 320, 240 },
+        { { 0, 0, 1600, 1184 }, 320, 240, SENSOR_ROI_MODE_CIF, 320, 232 },
+        { { 0, 0, 1600, 1200 }, 1600, 1200, SENSOR_ROI_MODE_UXGA, 1600, 1200 },
+        // A 400x300 crop at VGA needs every sensor pixel and is not
+        // upscaled
+        { { 600, 450, 400, 300 }, 640, 480, SENSOR_ROI_MODE_UXGA, 400, 296 },
+        // Wide strip keeps its aspect ratio
+        { { 0, 500, 1600, 200 }, 800, 600, SENSOR_ROI_MODE_SVGA, 800, 96 },
+        // Too small an output
+        { { 0, 0, 1600, 1200 }, 8, 8, SENSOR_ROI_MODE_UXGA, 0, 0 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        sensor_roi_window_t win;
+        bool ok = sensor_roi_map(&cases[i].roi, cases[i].max_w, cases[i].max_h, &win);
+
+        if (cases[i].out_w == 0) {
+            CHECK(!ok, "case %zu mapped", i);
+            continue;
+        }
+        CHECK(ok, "case %zu refused", i);
+        CHECK(win.mode == cases[i].mode && win.out_w == cases[i].out_w && win.out_h == cases[i].out_h,
+              "case %zu: %s %ux%u, expected %s %ux%u", i, sensor_roi_mode_name(win.mode), win.out_w, win.out_h,
+              sensor_roi_mode_name(cases[i].mode), cases[i].out_w, cases[i].out_h);
+        if (check_map(&cases[i].roi, cases[i].max_w, cases[i].max_h) != 0) {
+            return 1;
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static int test_fuzz(long cases)
+{
+    long per_mode[3] = { 0 };
+
+    for (long i = 0; i < cases; i++) {
+        sensor_roi_rect_t roi = {
+            .x = fuzz_coord(SENSOR_ROI_FULL_W, 0),
+            .y = fuzz_coord(SENSOR_ROI_FULL_H, 0),
+            .w = fuzz_coord(SENSOR_ROI_FULL_W, SENSOR_ROI_MIN_W),
+            .h = fuzz_coord(SENSOR_ROI_FULL_H, SENSOR_ROI_MIN_H),
+        };
+        uint16_t max_w;
+        uint16_t max_h;
+
+        if (rnd(4) != 0) {
+            uint32_t f = rnd(sizeof(k_frame_sizes) / sizeof(k_frame_sizes[0]));
+            max_w = k_frame_sizes[f][0];
+            max_h = k_frame_sizes[f][1];
+        } else {
+            max_w = rnd(1700);
+            max_h = rnd(1300);
+        }
+        if (check_map(&roi, max_w, max_h) != 0) {
+            return 1;
+        }
+
+        sensor_roi_window_t win;
+        if (sensor_roi_map(&roi, max_w, max_h, &win)) {
+            per_mode[win.mode]++;
+        }
+    }
+    printf("ok %ld %ld %ld %ld\n", cases, per_mode[SENSOR_ROI_MODE_CIF], per_mode[SENSOR_ROI_MODE_SVGA],
+           per_mode[SENSOR_ROI_MODE_UXGA]);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "known") == 0) {
+        return test_known();
+    }
+    if (argc >= 3 && strcmp(argv[1], "fuzz") == 0) {
+        return test_fuzz(atol(argv[2]));
+    }
+    fprintf(stderr, "usage: sim known | fuzz <cases>\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/sensor_roi.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test hand-checked mappings
+test_known() {
+    print_test "Known ROIs..."
+
+    run_sim known || return 1
+    print_pass "Full sensor, crops and strips map to the expected mode and output size"
+    return 0
+}
+
+# Test the invariants on random ROIs
+test_fuzz() {
+    print_test "Fuzzing $FUZZ_CASES ROIs..."
+
+    run_sim fuzz "$FUZZ_CASES" || return 1
+    read -r cases cif svga uxga <<< "$RESULT"
+    print_pass "$cases cases hold every invariant (CIF $cif, SVGA $svga, UXGA $uxga)"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Sensor ROI Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    FUZZ_CASES=${FUZZ_CASES:-2000000}
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_known test_fuzz; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
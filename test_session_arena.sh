@@ -0,0 +1,409 @@
+#!/bin/bash
+# Test script for the per-request session arenas
+# Usage: ./test_session_arena.sh
+#
+# Builds main/session_arena.c for the host and checks that an arena is
+# reset when it is reopened, that a request that outgrows its block spills
+# to the heap and gets every spill freed on close, and that connect /
+# disconnect churn (one thread with many sessions open, then several
+# pthreads for STRESS_SECONDS) reuses the same blocks without touching the
+# heap or letting two sessions share memory.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_stress() {
+    cat > "$WORK_DIR/stress.c" <<'EOF'
+#include "session_arena.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define BLOCK 1024
+#define ARENAS 8
+#define THREADS 6
+
+static _Alignas(8) uint8_t s_memory[BLOCK * SESSION_ARENA_MAX];
+static session_arena_pool_t s_pool;
+static atomic_int s_spills_live;
+static atomic_int s_spill_allocs;
+
+static void *spill_alloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if (ptr != NULL) {
+        atomic_fetch_add(&s_spills_live, 1);
+        atomic_fetch_add(&s_spill_allocs, 1);
+    }
+    return ptr;
+}
+
+static void spill_free(void *ptr)
+{
+    atomic_fetch_sub(&s_spills_live, 1);
+    free(ptr);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool in_region(const void *ptr, size_t size)
+{
+    const uint8_t *p = ptr;
+    return p >= s_memory && p + size <= s_memory + sizeof(s_memory);
+}
+
+static long heap_in_use(void)
+{
+#ifdef __GLIBC__
+    return (long)mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static int test_basic(void)
+{
+    session_arena_stats_t stats;
+
+    CHECK(!session_arena_pool_init(&s_pool, s_memory, BLOCK, 0, NULL, NULL), "0 arenas accepted");
+    CHECK(!session_arena_pool_init(&s_pool, s_memory, BLOCK, SESSION_ARENA_MAX + 1, NULL, NULL),
+          "%d arenas accepted", SESSION_ARENA_MAX + 1);
+    CHECK(!session_arena_pool_init(&s_pool, s_memory, 4, 1, NULL, NULL), "4-byte blocks accepted");
+    CHECK(session_arena_pool_init(&s_pool, s_memory, BLOCK + 5, 2, spill_alloc, spill_free), "init failed");
+    session_arena_get_stats(&s_pool, &stats);
+    CHECK(stats.block_size == BLOCK, "block size %u, expected %d rounded down", stats.block_size, BLOCK);
+
+    // Bump allocation, 8-byte aligned, filling the block exactly
+    session_arena_t *arena = session_arena_open(&s_pool);
+    CHECK(arena != NULL, "open failed");
+    uint8_t *first = session_arena_alloc(arena, 1);
+    uint8_t *second = session_arena_alloc(arena, 13);
+    CHECK(first != NULL && second == first + 8, "1 byte then 13: %p, %p", (void *)first, (void *)second);
+    CHECK(((uintptr_t)second % 8) == 0, "misaligned");
+    CHECK(session_arena_alloc(arena, BLOCK - 24) == second + 16, "rest of the block not handed out");
+    CHECK(atomic_load(&s_spill_allocs) == 0, "spilled before the block was full");
+
+    // Full: spills up to SESSION_ARENA_MAX_SPILLS, then NULL
+    for (int i = 0; i < SESSION_ARENA_MAX_SPILLS; i++) {
+        void *ptr = session_arena_alloc(arena, 8);
+        CHECK(ptr != NULL && !in_region(ptr, 8), "spill %d", i);
+    }
+    CHECK(session_arena_alloc(arena, 8) == NULL, "spill %d allowed", SESSION_ARENA_MAX_SPILLS);
+    // Size rounding must not wrap into a tiny in-block allocation
+    session_arena_t *other = session_arena_open(&s_pool);
+    CHECK(other != NULL && session_arena_alloc(other, SIZE_MAX - 3) == NULL, "SIZE_MAX - 3 bytes allocated");
+    CHECK(atomic_load(&s_spills_live) == SESSION_ARENA_MAX_SPILLS, "%d spills live",
+          atomic_load(&s_spills_live));
+
+    // Both in use: a third open fails and is counted
+    CHECK(session_arena_open(&s_pool) == NULL, "third arena from a pool of 2");
+    session_arena_close(other);
+    session_arena_close(arena);
+    session_arena_close(NULL);
+    CHECK(atomic_load(&s_spills_live) == 0, "%d spills leaked on close", atomic_load(&s_spills_live));
+
+    // Reopened: the same block, reset to empty
+    session_arena_t *again = session_arena_open(&s_pool);
+    CHECK(again == arena, "different arena after close");
+    CHECK(session_arena_alloc(again, BLOCK) == first, "reopened arena not reset");
+    session_arena_close(again);
+
+    session_arena_get_stats(&s_pool, &stats);
+    CHECK(stats.in_use == 0 && stats.high_water == 2 && stats.opens == 3 && stats.exhausted == 1 &&
+          stats.spills == SESSION_ARENA_MAX_SPILLS && stats.spill_failures == 2 && stats.peak_used == BLOCK,
+          "stats: in_use %u high_water %u opens %u exhausted %u spills %u failures %u peak %u", stats.in_use,
+          stats.high_water, stats.opens, stats.exhausted, stats.spills, stats.spill_failures, stats.peak_used);
+    printf("ok\n");
+    return 0;
+}
+
+// A session: its arena and the bytes it wrote, to be found intact at close
+typedef struct {
+    session_arena_t *arena;
+    uint8_t *ptrs[16];
+    size_t sizes[16];
+    uint32_t count;
+    uint8_t tag;
+} session_t;
+
+static int session_fill(session_t *s, size_t budget)
+{
+    size_t left = budget;
+
+    s->count = 0;
+    while (s->count < 16 && left > 8) {
+        size_t size = 1 + rand() % (left < 200 ? left : 200);
+        uint8_t *ptr = session_arena_alloc(s->arena, size);
+        CHECK(ptr != NULL && in_region(ptr, size), "in-budget allocation of %zu outside the region", size);
+        memset(ptr, s->tag, size);
+        s->ptrs[s->count] = ptr;
+        s->sizes[s->count++] = size;
+        left -= (size + 7) & ~(size_t)7;
+    }
+    return 0;
+}
+
+static int session_check(const session_t *s)
+{
+    for (uint32_t i = 0; i < s->count; i++) {
+        for (size_t j = 0; j < s->sizes[i]; j++) {
+            CHECK(s->ptrs[i][j] == s->tag, "session %u overwritten", s->tag);
+        }
+    }
+    return 0;
+}
+
+// Connect/disconnect churn on one thread with up to ARENAS sessions open
+static int test_reuse(void)
+{
+    session_t sessions[ARENAS + 2];
+    session_arena_stats_t stats;
+    uint32_t open = 0;
+    uint8_t tag = 0;
+
+    session_arena_pool_init(&s_pool, s_memory, BLOCK, ARENAS, spill_alloc, spill_free);
+    atomic_store(&s_spill_allocs, 0);
+    srand(37);
+    long heap_before = heap_in_use();
+    for (int step = 0; step < 500000; step++) {
+        if (open > 0 && (rand() % 2 || open == ARENAS + 2)) {
+            uint32_t victim = rand() % open;
+            if (session_check(&sessions[victim]) != 0) {
+                return 1;
+            }
+            session_arena_close(sessions[victim].arena);
+            sessions[victim] = sessions[--open];
+            continue;
+        }
+        session_t *s = &sessions[open];
+        s->arena = session_arena_open(&s_pool);
+        if (s->arena == NULL) {
+            CHECK(open == ARENAS, "open failed with %u of %d in use", open, ARENAS);
+            continue;
+        }
+        s->tag = ++tag;
+        if (session_fill(s, BLOCK) != 0) {
+            return 1;
+        }
+        open++;
+    }
+    while (open > 0) {
+        session_arena_close(sessions[--open].arena);
+    }
+    long heap_growth = heap_in_use() - heap_before;
+
+    session_arena_get_stats(&s_pool, &stats);
+    CHECK(stats.in_use == 0 && stats.high_water == ARENAS, "in_use %u, high water %u", stats.in_use,
+          stats.high_water);
+    CHECK(stats.peak_used <= BLOCK && stats.spills == 0 && atomic_load(&s_spill_allocs) == 0,
+          "peak %u, %u spills", stats.peak_used, stats.spills);
+    CHECK(heap_growth == 0, "heap grew by %ld bytes", heap_growth);
+    printf("ok %u %u\n", stats.opens, stats.exhausted);
+    return 0;
+}
+
+static atomic_bool s_stop;
+static atomic_uint s_cycles;
+
+static void *churn_worker(void *arg)
+{
+    uint8_t tag = (uint8_t)(uintptr_t)arg;
+    unsigned int seed = tag;
+    long failed = 0;
+
+    while (!atomic_load(&s_stop)) {
+        session_arena_t *arena = session_arena_open(&s_pool);
+        if (arena == NULL) {
+            continue;
+        }
+        // Mostly within the block, sometimes a spill
+        size_t size = 64 + rand_r(&seed) % (BLOCK + 256);
+        uint8_t *ptr = session_arena_alloc(arena, size);
+        if (ptr == NULL) {
+            failed++;
+        } else {
+            memset(ptr, tag, size);
+            for (size_t i = 0; i < size; i++) {
+                if (ptr[i] != tag) {
+                    failed++;
+                    break;
+                }
+            }
+        }
+        session_arena_close(arena);
+        atomic_fetch_add(&s_cycles, 1);
+    }
+    return (void *)failed;
+}
+
+static int test_stress(double seconds)
+{
+    pthread_t threads[THREADS];
+    session_arena_stats_t stats;
+    long failed = 0;
+
+    session_arena_pool_init(&s_pool, s_memory, BLOCK, THREADS - 2, spill_alloc, spill_free);
+    atomic_store(&s_stop, false);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, churn_worker, (void *)(uintptr_t)(i + 1));
+    }
+    double end = now_s() + seconds;
+    while (now_s() < end) {
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    atomic_store(&s_stop, true);
+    for (int i = 0; i < THREADS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        failed += (long)ret;
+    }
+
+    session_arena_get_stats(&s_pool, &stats);
+    CHECK(failed == 0, "%ld allocations failed or were overwritten by another session", failed);
+    CHECK(stats.in_use == 0 && stats.high_water <= THREADS - 2, "in_use %u, high water %u", stats.in_use,
+          stats.high_water);
+    CHECK(atomic_load(&s_spills_live) == 0, "%d spills leaked", atomic_load(&s_spills_live));
+    CHECK(stats.opens == atomic_load(&s_cycles), "%u opens, %u cycles", stats.opens, atomic_load(&s_cycles));
+    printf("ok %u %u\n", stats.opens, stats.spills);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: stress basic|reuse|stress [seconds]\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "basic") == 0) {
+        return test_basic();
+    }
+    if (strcmp(argv[1], "reuse") == 0) {
+        return test_reuse();
+    }
+    if (strcmp(argv[1], "stress") == 0) {
+        return test_stress(argc > 2 ? atof(argv[2]) : 2.0);
+    }
+    fprintf(stderr, "usage: stress basic|reuse|stress [seconds]\n");
+    return 2;
+}
+EOF
+    gcc -std=gnu11 -O2 -Wall -Werror -pthread -I main "$WORK_DIR/stress.c" main/session_arena.c \
+        -o "$WORK_DIR/stress"
+}
+
+# Run one stress command; sets RESULT to what follows "ok"
+run_stress() {
+    local out
+    out=$("$WORK_DIR/stress" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test allocation, spills and reset on reopen
+test_basic() {
+    print_test "Allocating, spilling and reopening..."
+
+    run_stress basic || return 1
+    print_pass "Aligned bump allocation, spills capped and freed on close, reopened arena reset"
+    return 0
+}
+
+# Test churn with many sessions open
+test_reuse() {
+    print_test "Session churn on one thread..."
+
+    run_stress reuse || return 1
+    read -r opens exhausted <<< "$RESULT"
+    print_pass "$opens sessions in the same 8 blocks ($exhausted refused when all were open), no heap growth"
+    return 0
+}
+
+# Test threads racing on the pool
+test_stress() {
+    print_test "Racing open/alloc/close on 6 threads for ${STRESS_SECONDS}s..."
+
+    run_stress stress "$STRESS_SECONDS" || return 1
+    read -r opens spills <<< "$RESULT"
+    print_pass "$opens sessions, no block shared, $spills spills all freed"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Session Arena Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    STRESS_SECONDS=${STRESS_SECONDS:-2}
+    local failed_tests=0
+
+    if ! build_stress; then
+        print_fail "Cannot build the stress test"
+        return 1
+    fi
+
+    for t in test_basic test_reuse test_stress; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,474 @@
+#!/bin/bash
+# Test script for the per-client stream queue
+# Usage: ./test_stream_client.sh
+#
+# Builds main/stream_client.c and main/frame_pool.c for the host and runs the
+# send loop of stream_frames() over a socketpair with a small send buffer:
+# frames are offered at a fixed rate while a reader thread drains the other
+# end at a throttled rate. A slow reader must lose frames, never receive a
+# corrupt or out-of-order one, and the frames held for it must stay bounded
+# by the queue depth; a reader that stops must be detected as stalled.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#define _DEFAULT_SOURCE
+#include "stream_client.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRAME_LEN 6000
+#define SLABS 8
+#define DEPTH 2
+#define FRAME_INTERVAL_MS 10
+#define STALL_MS 400
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+static frame_pool_t pool;
+static uint8_t memory[FRAME_LEN * SLABS];
+
+typedef struct {
+    int fd;
+    uint32_t rate_bps;          // 0 reads as fast as possible
+    uint32_t stop_after;        // stop reading after this many frames, 0 never
+    uint32_t start_ms;
+    uint32_t bytes;
+    uint32_t frames;
+    uint32_t last_seq;
+    uint32_t gaps;              // frames skipped between two received ones
+    int errors;
+    char error[128];
+} reader_t;
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void sleep_ms(uint32_t ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static int read_exact(reader_t *r, uint8_t *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(r->fd, buf + got, len - got);
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+        r->bytes += n;
+        // Throttle: stay behind rate_bps since the first read
+        while (r->rate_bps && (uint64_t)r->bytes * 1000 / r->rate_bps > now_ms() - r->start_ms) {
+            sleep_ms(1);
+        }
+    }
+    return 0;
+}
+
+// Parses "seq len\n" and a body of len bytes stamped with seq
+static void *reader(void *arg)
+{
+    reader_t *r = arg;
+    static uint8_t body[FRAME_LEN];
+    char line[32];
+
+    while (r->stop_after == 0 || r->frames < r->stop_after) {
+        size_t n = 0;
+        while (n < sizeof(line) - 1) {
+            if (read_exact(r, (uint8_t *)&line[n], 1) != 0) {
+                return NULL;
+            }
+            if (line[n++] == '\n') {
+                break;
+            }
+        }
+        line[n] = '\0';
+        unsigned seq, len;
+        if (sscanf(line, "%u %u", &seq, &len) != 2 || len != FRAME_LEN) {
+            snprintf(r->error, sizeof(r->error), "bad part header \"%.20s\"", line);
+            r->errors++;
+            return NULL;
+        }
+        if (read_exact(r, body, len) != 0) {
+            return NULL;
+        }
+        for (unsigned i = 0; i < len; i++) {
+            if (body[i] != (uint8_t)(seq + i)) {
+                snprintf(r->error, sizeof(r->error), "frame %u corrupt at byte %u", seq, i);
+                r->errors++;
+                return NULL;
+            }
+        }
+        if (seq <= r->last_seq) {
+            snprintf(r->error, sizeof(r->error), "frame %u after %u", seq, (unsigned)r->last_seq);
+            r->errors++;
+            return NULL;
+        }
+        r->gaps += seq - r->last_seq - 1;
+        r->last_seq = seq;
+        r->frames++;
+    }
+    // Stop reading but keep the socket open, like a frozen browser tab
+    sleep_ms(60000);
+    return NULL;
+}
+
+typedef struct {
+    uint32_t offered;
+    uint32_t max_in_use;
+    bool stalled;
+    stream_client_t client;
+} result_t;
+
+// The send loop of stream_frames(): offer a new frame every
+// FRAME_INTERVAL_MS, write what is pending with non-blocking sends, wait a
+// little for the socket when it is full
+static void run_sender(int fd, uint32_t duration_ms, result_t *res)
+{
+    stream_client_t *client = &res->client;
+    uint32_t start = now_ms();
+    uint32_t next_frame = start;
+    uint32_t seq = 0;
+
+    frame_pool_init(&pool, memory, FRAME_LEN, SLABS);
+    stream_client_init(client, DEPTH, STALL_MS, start);
+    res->offered = 0;
+    res->max_in_use = 0;
+    res->stalled = false;
+
+    while (now_ms() - start < duration_ms) {
+        uint32_t now = now_ms();
+        if ((int32_t)(now - next_frame) >= 0) {
+            next_frame += FRAME_INTERVAL_MS;
+            frame_t *frame = frame_pool_alloc(&pool);
+            if (frame != NULL) {
+                uint8_t *slab = frame_pool_slab(frame);
+                seq++;
+                for (int i = 0; i < FRAME_LEN; i++) {
+                    slab[i] = (uint8_t)(seq + i);
+                }
+                frame->len = FRAME_LEN;
+                frame->seq = seq;
+                stream_client_offer(client, frame, now);
+                res->offered++;
+            }
+        }
+
+        frame_pool_stats_t stats;
+        frame_pool_get_stats(&pool, &stats);
+        if (stats.in_use > res->max_in_use) {
+            res->max_in_use = stats.in_use;
+        }
+
+        frame_t *current = stream_client_current(client);
+        if (current == NULL) {
+            sleep_ms(1);
+            continue;
+        }
+        if (client->hdr_len == 0) {
+            client->hdr_len = snprintf(client->hdr, sizeof(client->hdr), "%u %u\n", (unsigned)current->seq,
+                                       (unsigned)current->len);
+        }
+        const uint8_t *data;
+        size_t pending = stream_client_pending(client, &data);
+        ssize_t sent = send(fd, data, pending, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent > 0) {
+            stream_client_wrote(client, sent, now);
+        } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            break;
+        } else if (stream_client_stalled(client, now)) {
+            res->stalled = true;
+            break;
+        } else {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            poll(&pfd, 1, 2);
+        }
+    }
+    stream_client_flush(client);
+}
+
+static int run(uint32_t rate_bps, uint32_t stop_after, uint32_t duration_ms, reader_t *r, result_t *res)
+{
+    int sv[2];
+    int sndbuf = 8192;
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0, "socketpair: %s", strerror(errno));
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    setsockopt(sv[1], SOL_SOCKET, SO_RCVBUF, &sndbuf, sizeof(sndbuf));
+    memset(r, 0, sizeof(*r));
+    r->fd = sv[1];
+    r->rate_bps = rate_bps;
+    r->stop_after = stop_after;
+    r->start_ms = now_ms();
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, reader, r);
+    pthread_detach(thread);
+    run_sender(sv[0], duration_ms, res);
+    close(sv[0]);
+    // Let the reader finish the bytes still in flight
+    sleep_ms(200);
+
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&pool, &stats);
+    CHECK(r->errors == 0, "%s", r->error);
+    CHECK(stats.in_use == 0, "%lu frames leaked", (unsigned long)stats.in_use);
+    CHECK(res->max_in_use <= DEPTH + 1, "%lu frames held for one client", (unsigned long)res->max_in_use);
+    CHECK(res->client.frames_sent + res->client.frames_dropped <= res->offered, "counted %lu + %lu of %lu",
+          (unsigned long)res->client.frames_sent, (unsigned long)res->client.frames_dropped,
+          (unsigned long)res->offered);
+    return 0;
+}
+
+static int test_fast(void)
+{
+    reader_t r;
+    result_t res;
+
+    if (run(0, 0, 1000, &r, &res) != 0) {
+        return 1;
+    }
+    CHECK(res.client.frames_dropped == 0, "%lu frames dropped for a fast reader",
+          (unsigned long)res.client.frames_dropped);
+    CHECK(r.frames + 1 >= res.offered && r.gaps == 0, "read %lu of %lu frames, %lu gaps",
+          (unsigned long)r.frames, (unsigned long)res.offered, (unsigned long)r.gaps);
+    CHECK(!res.stalled, "fast reader reported stalled");
+    printf("ok %lu\n", (unsigned long)r.frames);
+    return 0;
+}
+
+static int test_slow(void)
+{
+    reader_t r;
+    result_t res;
+
+    // 150 kB/s against 600 kB/s offered: about 3 in 4 frames must go
+    if (run(150000, 0, 2000, &r, &res) != 0) {
+        return 1;
+    }
+    CHECK(!res.stalled, "slow reader reported stalled");
+    CHECK(res.client.frames_dropped > res.offered / 2, "only %lu of %lu frames dropped",
+          (unsigned long)res.client.frames_dropped, (unsigned long)res.offered);
+    CHECK(r.frames > 20, "only %lu frames read", (unsigned long)r.frames);
+    CHECK(r.gaps > 0, "no frames skipped");
+    // Every frame written completely arrived; the others were dropped
+    CHECK(r.frames == res.client.frames_sent, "%lu frames sent, %lu read", (unsigned long)res.client.frames_sent,
+          (unsigned long)r.frames);
+    printf("ok %lu %lu %lu %lu\n", (unsigned long)res.offered, (unsigned long)r.frames,
+           (unsigned long)res.client.frames_dropped, (unsigned long)res.max_in_use);
+    return 0;
+}
+
+static int test_stall(void)
+{
+    reader_t r;
+    result_t res;
+    uint32_t start = now_ms();
+
+    // Reads 5 frames, then stops reading with the connection open
+    if (run(0, 5, 5000, &r, &res) != 0) {
+        return 1;
+    }
+    uint32_t elapsed = now_ms() - start - 200;
+    CHECK(res.stalled, "stopped reader not detected");
+    CHECK(elapsed < 2000, "stall detected after %lu ms", (unsigned long)elapsed);
+    CHECK(res.client.frames_dropped > 10, "only %lu dropped while stalled",
+          (unsigned long)res.client.frames_dropped);
+    printf("ok %lu %lu\n", (unsigned long)elapsed, (unsigned long)res.max_in_use);
+    return 0;
+}
+
+static int test_queue(void)
+{
+    stream_client_t client;
+    frame_t *frames[6];
+
+    frame_pool_init(&pool, memory, FRAME_LEN, SLABS);
+    stream_client_init(&client, DEPTH, STALL_MS, 0);
+    for (int i = 0; i < 6; i++) {
+        frames[i] = frame_pool_alloc(&pool);
+        frames[i]->len = 10;
+        frames[i]->seq = i + 1;
+        stream_client_offer(&client, frames[i], 0);
+    }
+    // Latest frame wins: the two newest are queued, the rest released
+    frame_pool_stats_t stats;
+    frame_pool_get_stats(&pool, &stats);
+    CHECK(client.count == DEPTH && client.frames_dropped == 4, "%u queued, %lu dropped", client.count,
+          (unsigned long)client.frames_dropped);
+    CHECK(stats.in_use == DEPTH, "%lu frames held", (unsigned long)stats.in_use);
+    CHECK(stream_client_current(&client)->seq == 5, "oldest survivor is not frame 5");
+
+    // An in-flight frame is not dropped by newer ones
+    stream_client_wrote(&client, 3, 10);
+    stream_client_offer(&client, frame_pool_alloc(&pool), 10);
+    stream_client_offer(&client, frame_pool_alloc(&pool), 10);
+    CHECK(stream_client_current(&client)->seq == 5 && client.offset == 3, "in-flight frame replaced");
+    frame_pool_get_stats(&pool, &stats);
+    CHECK(stats.in_use == DEPTH + 1, "%lu frames held", (unsigned long)stats.in_use);
+
+    // Depth is clamped
+    stream_client_flush(&client);
+    stream_client_init(&client, 0, STALL_MS, 0);
+    CHECK(client.depth == 1, "depth %u", client.depth);
+    stream_client_init(&client, 9, STALL_MS, 0);
+    CHECK(client.depth == STREAM_CLIENT_QUEUE_MAX, "depth %u", client.depth);
+    frame_pool_get_stats(&pool, &stats);
+    CHECK(stats.in_use == 0, "%lu frames leaked by flush", (unsigned long)stats.in_use);
+    printf("ok\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim queue|fast|slow|stall\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "queue") == 0) {
+        return test_queue();
+    }
+    if (strcmp(argv[1], "fast") == 0) {
+        return test_fast();
+    }
+    if (strcmp(argv[1], "slow") == 0) {
+        return test_slow();
+    }
+    if (strcmp(argv[1], "stall") == 0) {
+        return test_stall();
+    }
+    fprintf(stderr, "usage: sim queue|fast|slow|stall\n");
+    return 2;
+}
+EOF
+    gcc -std=c11 -O2 -Wall -Werror -pthread -I main "$WORK_DIR/sim.c" main/stream_client.c main/frame_pool.c \
+        -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the latest-frame-wins queue on its own
+test_queue() {
+    print_test "Offering frames to a full queue..."
+
+    run_sim queue || return 1
+    print_pass "Oldest queued frames dropped and released, in-flight frame kept"
+    return 0
+}
+
+# Test a reader that keeps up
+test_fast() {
+    print_test "Reader keeping up with 100 fps..."
+
+    run_sim fast || return 1
+    print_pass "$RESULT frames read, none dropped"
+    return 0
+}
+
+# Test a throttled reader
+test_slow() {
+    print_test "Reader throttled to 150 kB/s against 600 kB/s of frames..."
+
+    run_sim slow || return 1
+    read -r offered read dropped held <<< "$RESULT"
+    print_pass "$read of $offered frames read intact and in order, $dropped dropped, at most $held held"
+    return 0
+}
+
+# Test a reader that stops reading
+test_stall() {
+    print_test "Reader that stops reading..."
+
+    run_sim stall || return 1
+    read -r elapsed held <<< "$RESULT"
+    print_pass "Disconnected as stalled after $elapsed ms, at most $held frames held"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Stream Client Queue Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_queue test_fast test_slow test_stall; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,340 @@
+#!/bin/bash
+# Test script for the stream load generator
+# Usage: ./test_stream_load.sh [device_ip]
+#
+# Runs stream_load.py against a stand-in device on localhost that serves
+# /stream with the STREAM_BOUNDARY from main/video_stream.h and /capture
+# (with ?after= long polls) at 20 fps. With a device IP it also runs a short
+# load against the device.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+PORT=$((40000 + RANDOM % 20000))
+WORK_DIR=$(mktemp -d)
+SERVER_PID=""
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# Start the stand-in device. With "broken", every /stream connection sends a
+# part with a wrong delimiter after 5 frames; with "nolength", parts have no
+# Content-Length.
+start_server() {
+    cat > "$WORK_DIR/fake_device.py" <<'EOF'
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+sys.path.insert(0, '.')
+from stream_load import load_boundary, DEFAULT_HEADER
+
+BOUNDARY = load_boundary(DEFAULT_HEADER)
+FPS = 20
+START = time.monotonic()
+JPEG = b'\xff\xd8' + bytes(range(256)) * 20 + b'\xff\xd9'
+broken = len(sys.argv) > 2 and sys.argv[2] == 'broken'
+nolength = len(sys.argv) > 2 and sys.argv[2] == 'nolength'
+
+
+def current_seq():
+    return int((time.monotonic() - START) * FPS) + 1
+
+
+def wait_frame(after, timeout):
+    deadline = time.monotonic() + timeout
+    while current_seq() <= after:
+        if time.monotonic() >= deadline:
+            return None
+        time.sleep(START + current_seq() / FPS - time.monotonic() + 0.0005)
+    return current_seq()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def do_GET(self):
+        if self.path == '/stream':
+            self.send_response(200)
+            self.send_header('Content-Type', 'multipart/x-mixed-replace;boundary=' +
+                             BOUNDARY.strip()[2:].decode())
+            self.send_header('Connection', 'close')
+            self.end_headers()
+            seq = current_seq()
+            sent = 0
+            try:
+                while True:
+                    seq = wait_frame(seq, 5)
+                    delimiter = b'\r\n--wrong\r\n' if broken and sent == 5 else BOUNDARY
+                    length = b'' if nolength else b'Content-Length: %d\r\n' % len(JPEG)
+                    self.wfile.write(delimiter + b'Content-Type: image/jpeg\r\n' + length + b'\r\n')
+                    self.wfile.write(JPEG)
+                    sent += 1
+            except OSError:
+                pass
+            self.close_connection = True
+            return
+
+        if self.path.startswith('/capture'):
+            query = dict(p.split('=') for p in self.path.partition('?')[2].split('&') if '=' in p)
+            seq = current_seq()
+            if 'after' in query:
+                seq = wait_frame(int(query['after']), int(query.get('timeout_ms', 10000)) / 1000)
+                if seq is None:
+                    self.send_response(204)
+                    self.send_header('X-Frame-Seq', str(current_seq()))
+                    self.send_header('Content-Length', '0')
+                    self.end_headers()
+                    return
+            self.send_response(200)
+            self.send_header('Content-Type', 'image/jpeg')
+            self.send_header('Content-Length', str(len(JPEG)))
+            self.send_header('X-Frame-Seq', str(seq))
+            self.end_headers()
+            self.wfile.write(JPEG)
+            return
+        self.send_error(404)
+
+
+server = ThreadingHTTPServer(('127.0.0.1', int(sys.argv[1])), Handler)
+server.daemon_threads = True
+print('ready', flush=True)
+server.serve_forever()
+EOF
+    python3 "$WORK_DIR/fake_device.py" "$PORT" "$1" > "$WORK_DIR/server.log" 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 50); do
+        grep -q ready "$WORK_DIR/server.log" 2>/dev/null && return 0
+        sleep 0.1
+    done
+    print_fail "Stand-in device did not start"
+    cat "$WORK_DIR/server.log"
+    return 1
+}
+
+stop_server() {
+    kill $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+    SERVER_PID=""
+}
+
+# Read one value from the JSON summary: json_field FILE CLIENT KEY
+json_field() {
+    python3 -c "import json,sys; r=json.load(open(sys.argv[1])); c={c['client']: c for c in r['clients']}[sys.argv[2]]; \
+v=c[sys.argv[3]]; print(sum(v.values()) if isinstance(v, dict) else v)" "$1" "$2" "$3"
+}
+
+# Check that FIELD of CLIENT is within [LOW, HIGH]
+expect_range() {
+    local value=$(json_field "$1" "$2" "$3")
+    if python3 -c "import sys; sys.exit(0 if $4 <= float(sys.argv[1]) <= $5 else 1)" "$value" 2>/dev/null; then
+        return 0
+    fi
+    print_fail "$2 $3 is $value, expected $4..$5"
+    return 1
+}
+
+# Test the CLI and the boundary taken from video_stream.h
+test_cli() {
+    print_test "Checking the CLI..."
+
+    if python3 stream_load.py --help > /dev/null 2>&1; then
+        print_pass "stream_load.py --help works"
+    else
+        print_fail "stream_load.py --help failed"
+        return 1
+    fi
+
+    expected=$(sed -n 's/^#define STREAM_BOUNDARY "\(.*\)"$/\1/p' main/video_stream.h)
+    actual=$(python3 -c "from stream_load import load_boundary, DEFAULT_HEADER; print(repr(load_boundary(DEFAULT_HEADER))[2:-1])")
+    if [ -n "$expected" ] && [ "$expected" = "$actual" ]; then
+        print_pass "STREAM_BOUNDARY read from video_stream.h"
+    else
+        print_fail "Boundary \"$actual\" does not match video_stream.h \"$expected\""
+        return 1
+    fi
+    return 0
+}
+
+# Test that /stream and /capture clients measure the stand-in's frame rate
+test_load() {
+    print_test "Loading the stand-in device with 2 /stream and 1 /capture clients..."
+
+    start_server || return 1
+    python3 stream_load.py 127.0.0.1 --port "$PORT" --streams 2 --captures 1 --capture-interval 0.1 \
+        --duration 4 --interval 1 --csv "$WORK_DIR/load.csv" --json "$WORK_DIR/load.json" --quiet \
+        > "$WORK_DIR/load.log" 2>&1
+    local rc=$?
+    stop_server
+
+    if [ $rc -ne 0 ] || [ ! -f "$WORK_DIR/load.json" ]; then
+        print_fail "stream_load.py exited with $rc"
+        cat "$WORK_DIR/load.log"
+        return 1
+    fi
+
+    expect_range "$WORK_DIR/load.json" stream1 fps 17 21 || return 1
+    expect_range "$WORK_DIR/load.json" stream2 fps 17 21 || return 1
+    expect_range "$WORK_DIR/load.json" stream1 interval_avg_ms 45 55 || return 1
+    expect_range "$WORK_DIR/load.json" stream1 jitter_ms 0 15 || return 1
+    expect_range "$WORK_DIR/load.json" stream1 errors 0 0 || return 1
+    expect_range "$WORK_DIR/load.json" stream1 connect_avg_ms 0 100 || return 1
+    print_pass "Streams measured at 20 fps, 50 ms interval, no errors"
+
+    expect_range "$WORK_DIR/load.json" capture1 fps 5 11 || return 1
+    expect_range "$WORK_DIR/load.json" capture1 errors 0 0 || return 1
+    print_pass "/capture client measured"
+
+    rows=$(grep -c ",stream1," "$WORK_DIR/load.csv")
+    if head -1 "$WORK_DIR/load.csv" | grep -q "^time,elapsed_s,client" && [ "$rows" -ge 3 ]; then
+        print_pass "CSV has a row per client per interval ($rows for stream1)"
+    else
+        print_fail "CSV is missing rows"
+        cat "$WORK_DIR/load.csv"
+        return 1
+    fi
+    return 0
+}
+
+# Test that long polls get every frame once
+test_poll() {
+    print_test "Long-polling /capture?after=..."
+
+    start_server || return 1
+    python3 stream_load.py 127.0.0.1 --port "$PORT" --streams 0 --captures 2 --poll \
+        --duration 3 --json "$WORK_DIR/poll.json" --quiet > "$WORK_DIR/poll.log" 2>&1
+    stop_server
+
+    expect_range "$WORK_DIR/poll.json" capture1 fps 17 21 || return 1
+    expect_range "$WORK_DIR/poll.json" capture2 duplicates 0 0 || return 1
+    expect_range "$WORK_DIR/poll.json" capture2 skipped 0 0 || return 1
+    print_pass "Every frame delivered once to each poller"
+    return 0
+}
+
+# Test that a framing error is caught and the client reconnects
+test_broken() {
+    print_test "Streaming from a device with a broken part delimiter..."
+
+    start_server broken || return 1
+    python3 stream_load.py 127.0.0.1 --port "$PORT" --streams 1 --duration 3 \
+        --json "$WORK_DIR/broken.json" --quiet > "$WORK_DIR/broken.log" 2>&1
+    stop_server
+
+    expect_range "$WORK_DIR/broken.json" stream1 errors 1 10 || return 1
+    expect_range "$WORK_DIR/broken.json" stream1 reconnects 1 10 || return 1
+    print_pass "Framing error counted and the client reconnected"
+
+    start_server || return 1
+    python3 stream_load.py 127.0.0.1 --port "$PORT" --streams 1 --duration 2 --min-fps 50 --quiet \
+        > "$WORK_DIR/minfps.log" 2>&1
+    local rc=$?
+    stop_server
+    if [ $rc -eq 1 ]; then
+        print_pass "--min-fps fails a run below the threshold"
+    else
+        print_fail "--min-fps returned $rc"
+        return 1
+    fi
+    return 0
+}
+
+# Test that every part must carry its length
+test_no_length() {
+    print_test "Streaming parts without Content-Length..."
+
+    start_server nolength || return 1
+    python3 stream_load.py 127.0.0.1 --port "$PORT" --streams 1 --duration 3 \
+        --json "$WORK_DIR/nolength.json" --quiet > "$WORK_DIR/nolength.log" 2>&1
+    stop_server
+
+    expect_range "$WORK_DIR/nolength.json" stream1 frames 0 0 || return 1
+    expect_range "$WORK_DIR/nolength.json" stream1 errors 1 10 || return 1
+    expect_range "$WORK_DIR/nolength.json" stream1 reconnects 1 10 || return 1
+    print_pass "Part without Content-Length counted as a framing error"
+    return 0
+}
+
+# Short load against a real device
+test_device() {
+    print_test "Loading $1 for 20 s..."
+
+    if ! curl -s -o /dev/null --max-time 5 "http://$1/metrics"; then
+        print_pass "No device at $1 - skipped"
+        return 0
+    fi
+    if python3 stream_load.py "$1" --streams 2 --captures 1 --duration 20 --interval 5 --min-fps 1; then
+        print_pass "Device streamed to every client"
+    else
+        print_fail "A client got no frames"
+        return 1
+    fi
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Stream Load Test Suite ==="
+    echo ""
+
+    failed_tests=0
+
+    if ! test_cli; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_load; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_poll; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_broken; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_no_length; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if [ -n "$1" ]; then
+        if ! test_device "$1"; then
+            ((failed_tests++))
+        fi
+        echo ""
+    fi
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
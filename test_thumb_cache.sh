@@ -0,0 +1,487 @@
+#!/bin/bash
+# Test script for the /thumb per-scale cache
+# Usage: ./test_thumb_cache.sh
+#
+# Builds main/thumb_cache.c for the host and replays /thumb requests the way
+# thumb_handler() makes them: look up the latest frame's seq at the requested
+# scale, build and store on a miss. Checks scale parsing, that a thumbnail is
+# served from the cache only for the frame it was built from, that a new
+# frame invalidates each scale independently, and that every buffer handed
+# back is freed exactly once. With the libjpeg headers it also times the
+# build step of a miss for VGA and SVGA frames: a scaled decode (libjpeg
+# standing in for the driver's jpg2rgb565) and the re-encode at quality 60.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "thumb_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+// Thumbnail buffers: "scale/seq" strings, counted so leaks and double frees
+// show up
+static int live;
+static int frees;
+
+static uint8_t *build(int shift, uint32_t seq, size_t *len)
+{
+    char *buf = malloc(32);
+    *len = (size_t)snprintf(buf, 32, "1/%d@%lu", 1 << shift, (unsigned long)seq) + 1;
+    live++;
+    return (uint8_t *)buf;
+}
+
+static void release(void *buf)
+{
+    if (buf != NULL) {
+        free(buf);
+        live--;
+        frees++;
+    }
+}
+
+static int builds;
+static int hits;
+
+// thumb_handler(): returns the served thumbnail
+static const thumb_cache_entry_t *request(thumb_cache_t *cache, int shift, uint32_t seq)
+{
+    const thumb_cache_entry_t *entry = thumb_cache_lookup(cache, shift, seq);
+    if (entry != NULL) {
+        hits++;
+        return entry;
+    }
+    size_t len;
+    uint8_t *jpeg = build(shift, seq, &len);
+    builds++;
+    release(thumb_cache_store(cache, shift, seq, jpeg, len));
+    return thumb_cache_lookup(cache, shift, seq);
+}
+
+static int served_ok(const thumb_cache_entry_t *entry, int shift, uint32_t seq)
+{
+    char want[32];
+    snprintf(want, sizeof(want), "1/%d@%lu", 1 << shift, (unsigned long)seq);
+    CHECK(entry != NULL, "nothing served for %s", want);
+    CHECK(strcmp((const char *)entry->jpeg, want) == 0 && entry->len == strlen(want) + 1,
+          "served %s for %s", (const char *)entry->jpeg, want);
+    return 0;
+}
+
+static int test_parse(void)
+{
+    static const struct {
+        const char *value;
+        bool ok;
+        int shift;
+    } cases[] = {
+        { NULL, true, 2 }, { "", true, 2 },
+        { "1/2", true, 1 }, { "1/4", true, 2 }, { "1/8", true, 3 },
+        { "2", true, 1 }, { "4", true, 2 }, { "8", true, 3 },
+        { "1/3", false, 0 }, { "16", false, 0 }, { "1/16", false, 0 }, { "0", false, 0 },
+        { "2/4", false, 0 }, { "4x", false, 0 }, { "1/", false, 0 }, { "abc", false, 0 }, { "-4", false, 0 },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int shift = -1;
+        bool ok = thumb_cache_parse_scale(cases[i].value, &shift);
+        CHECK(ok == cases[i].ok, "\"%s\" %s", cases[i].value ? cases[i].value : "(null)",
+              ok ? "accepted" : "rejected");
+        CHECK(!ok || shift == cases[i].shift, "\"%s\" gave shift %d", cases[i].value ? cases[i].value : "(null)",
+              shift);
+    }
+    printf("ok\n");
+    return 0;
+}
+
+static int test_hits(void)
+{
+    thumb_cache_t cache;
+
+    memset(&cache, 0, sizeof(cache));
+    builds = hits = 0;
+    // Empty cache: even seq 0 misses
+    CHECK(thumb_cache_lookup(&cache, 2, 0) == NULL, "hit on an empty cache");
+
+    // Repeated requests for one frame are built once per scale
+    for (int i = 0; i < 5; i++) {
+        for (int shift = 1; shift <= 3; shift++) {
+            if (served_ok(request(&cache, shift, 7), shift, 7) != 0) {
+                return 1;
+            }
+        }
+    }
+    CHECK(builds == 3 && hits == 12, "%d builds, %d hits", builds, hits);
+
+    // A new frame invalidates a scale when that scale is asked for; the
+    // others keep their entry (still for frame 7) until then
+    if (served_ok(request(&cache, 2, 8), 2, 8) != 0) {
+        return 1;
+    }
+    CHECK(builds == 4 && live == 3 && frees == 1, "%d builds, %d live, %d freed", builds, live, frees);
+    CHECK(thumb_cache_lookup(&cache, 1, 7) != NULL && thumb_cache_lookup(&cache, 1, 8) == NULL,
+          "1/2 entry changed by a 1/4 request");
+    CHECK(thumb_cache_lookup(&cache, 2, 7) == NULL, "stale 1/4 thumbnail still served");
+
+    // An older frame than the cached one misses too (seq compared for equality)
+    if (served_ok(request(&cache, 3, 6), 3, 6) != 0) {
+        return 1;
+    }
+
+    // Out-of-range scales are never cached and hand the buffer back
+    size_t len;
+    uint8_t *jpeg = build(0, 1, &len);
+    CHECK(thumb_cache_store(&cache, 4, 1, jpeg, len) == jpeg, "scale 1/16 stored");
+    release(jpeg);
+    CHECK(thumb_cache_lookup(&cache, 0, 1) == NULL && thumb_cache_lookup(&cache, 4, 1) == NULL,
+          "lookup outside 1..3");
+
+    // Clearing one scale, then all (thumbnail_deinit)
+    thumb_cache_clear(&cache, 1, release);
+    CHECK(thumb_cache_lookup(&cache, 1, 7) == NULL && live == 2, "1/2 not cleared, %d live", live);
+    thumb_cache_clear(&cache, 0, release);
+    CHECK(live == 0, "%d buffers leaked", live);
+    thumb_cache_clear(&cache, 0, release);
+    CHECK(live == 0 && frees == 6, "%d frees", frees);
+    printf("ok\n");
+    return 0;
+}
+
+// Viewers polling random scales while the camera advances: a request is a
+// hit exactly when its scale was last built for the current frame, and the
+// served thumbnail always matches the frame and scale
+static int test_random(void)
+{
+    thumb_cache_t cache;
+    uint32_t built_for[4] = { 0 };
+    bool built[4] = { false };
+    uint32_t seq = 1;
+    int expected_hits = 0;
+
+    memset(&cache, 0, sizeof(cache));
+    builds = hits = frees = 0;
+    srand(32);
+    for (int i = 0; i < 200000; i++) {
+        // About 10 fps against 25 requests/s
+        if (rand() % 5 < 2) {
+            seq++;
+        }
+        int shift = 1 + rand() % 3;
+        if (rand() % 10 < 7) {
+            shift = 2; // most viewers use the default
+        }
+        if (built[shift] && built_for[shift] == seq) {
+            expected_hits++;
+        }
+        if (served_ok(request(&cache, shift, seq), shift, seq) != 0) {
+            return 1;
+        }
+        built[shift] = true;
+        built_for[shift] = seq;
+        CHECK(live <= 3, "%d thumbnails held", live);
+    }
+    CHECK(hits == expected_hits, "%d hits, expected %d", hits, expected_hits);
+    thumb_cache_clear(&cache, 0, release);
+    CHECK(live == 0 && frees == builds, "%d built, %d freed", builds, frees);
+    printf("ok %d %d\n", hits, builds);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim parse|hits|random\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "parse") == 0) {
+        return test_parse();
+    }
+    if (strcmp(argv[1], "hits") == 0) {
+        return test_hits();
+    }
+    if (strcmp(argv[1], "random") == 0) {
+        return test_random();
+    }
+    fprintf(stderr, "usage: sim parse|hits|random\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/thumb_cache.c -o "$WORK_DIR/sim"
+}
+
+# Frames from main/jpeg_enc.c, decoded at 1/2, 1/4 and 1/8 by libjpeg's
+# scaled IDCT and encoded again. Prints "size scale WxH ms" per combination,
+# then "ok".
+build_bench() {
+    cat > "$WORK_DIR/bench.c" <<'EOF'
+#define _POSIX_C_SOURCE 200809L
+#include "jpeg_enc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jpeglib.h>    // after stdio.h, which it needs
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define MAX_W 800
+#define MAX_H 600
+#define OUT_SIZE (MAX_W * MAX_H * 2)
+#define FRAME_QUALITY 80        // about the sensor's quality 12
+#define THUMB_QUALITY 60        // THUMB_JPEG_QUALITY in thumbnail.c
+#define BENCH_US 300000         // per combination
+
+static uint8_t s_img[MAX_W * MAX_H * 2];
+static uint8_t s_frame[OUT_SIZE];
+static uint8_t s_ycc[MAX_W * MAX_H * 3];
+static uint8_t s_thumb[OUT_SIZE];
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Shading, a disc, stripes and noise, so the frame costs what a real one does
+static void make_scene(uint16_t w, uint16_t h)
+{
+    uint32_t seed = 7;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            seed = seed * 1103515245u + 12345u;
+            int luma = 40 + 120 * x / w + 60 * y / h;
+            int dx = x - w / 3;
+            int dy = y - h / 2;
+            if (dx * dx + dy * dy < (h / 4) * (h / 4)) {
+                luma = 220;
+            } else if (x > w * 2 / 3 && y > h / 4 && y < h * 3 / 4) {
+                luma = ((x / 2) & 1) ? 30 : 200;
+            }
+            luma += (int)(seed >> 28) - 8;
+            luma = luma < 0 ? 0 : luma > 255 ? 255 : luma;
+            uint8_t *p = &s_img[(y * w + x) * 2];
+            p[0] = (uint8_t)luma;
+            p[1] = (uint8_t)(x & 1 ? 128 + 90 * y / h - 45 : 128 + 90 * x / w - 45);
+        }
+    }
+}
+
+// One thumbnail: scaled decode, then encode. Returns its size, 0 on error.
+static size_t thumb_build(size_t frame_len, int denom, const jpeg_enc_t *enc, uint16_t *out_w, uint16_t *out_h)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr err;
+
+    cinfo.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, s_frame, frame_len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = denom;
+    cinfo.out_color_space = JCS_YCbCr;
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&cinfo);
+    uint16_t w = cinfo.output_width;
+    uint16_t h = cinfo.output_height;
+    while (cinfo.output_scanline < h) {
+        JSAMPROW row = &s_ycc[cinfo.output_scanline * w * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    // YCbCr to YUYV in place, two bytes a pixel like the RGB565 buffer on
+    // the device
+    for (int i = 0; i < w * h; i += 2) {
+        const uint8_t *p = &s_ycc[i * 3];
+        uint8_t *q = &s_ycc[i * 2];
+        uint8_t y0 = p[0], u = p[1], y1 = p[3], v = p[5];
+        q[0] = y0;
+        q[1] = u;
+        q[2] = y1;
+        q[3] = v;
+    }
+    *out_w = w;
+    *out_h = h;
+    return jpeg_enc_encode(enc, s_ycc, w, h, 0, JPEG_ENC_YUYV, s_thumb, sizeof(s_thumb));
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        uint16_t w, h;
+    } sizes[] = { { "VGA", 640, 480 }, { "SVGA", 800, 600 } };
+    jpeg_enc_t frame_enc, thumb_enc;
+
+    jpeg_enc_init(&frame_enc, FRAME_QUALITY);
+    jpeg_enc_init(&thumb_enc, THUMB_QUALITY);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        make_scene(sizes[s].w, sizes[s].h);
+        size_t frame_len = jpeg_enc_encode(&frame_enc, s_img, sizes[s].w, sizes[s].h, 0, JPEG_ENC_YUYV, s_frame,
+                                           sizeof(s_frame));
+        CHECK(frame_len > 0, "%s frame not encoded", sizes[s].name);
+
+        for (int shift = 1; shift <= 3; shift++) {
+            uint16_t w = 0, h = 0;
+            int n = 0;
+            double start = now_us();
+            do {
+                CHECK(thumb_build(frame_len, 1 << shift, &thumb_enc, &w, &h) > 0, "%s 1/%d thumbnail failed",
+                      sizes[s].name, 1 << shift);
+                n++;
+            } while (now_us() - start < BENCH_US);
+            double ms = (now_us() - start) / n / 1000;
+            CHECK(w == sizes[s].w >> shift && h == sizes[s].h >> shift, "%s 1/%d thumbnail is %ux%u",
+                  sizes[s].name, 1 << shift, w, h);
+            printf("%s 1/%d %ux%u %.2f\n", sizes[s].name, 1 << shift, w, h, ms);
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/bench.c" main/jpeg_enc.c -ljpeg -o "$WORK_DIR/bench"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the scale parameter
+test_parse() {
+    print_test "Parsing scale=..."
+
+    run_sim parse || return 1
+    print_pass "1/2, 1/4, 1/8 and 2, 4, 8 accepted, 1/4 by default, the rest rejected"
+    return 0
+}
+
+# Test hits and invalidation
+test_hits() {
+    print_test "Cache hits and invalidation..."
+
+    run_sim hits || return 1
+    print_pass "Built once per frame and scale, invalidated per scale, every buffer freed once"
+    return 0
+}
+
+# Test random requests against a model
+test_random() {
+    print_test "Random scales against an advancing camera..."
+
+    run_sim random || return 1
+    read -r hits builds <<< "$RESULT"
+    print_pass "$hits hits, $builds builds, all as predicted, no leak"
+    return 0
+}
+
+# Time the build step of a cache miss
+test_bench() {
+    print_test "Timing thumbnail builds from VGA and SVGA frames..."
+
+    if ! printf '#include <stdio.h>\n#include <jpeglib.h>\n' | gcc -E -x c - >/dev/null 2>&1; then
+        print_pass "libjpeg headers not available, skipped"
+        return 0
+    fi
+    if ! build_bench; then
+        print_fail "Cannot build the benchmark"
+        return 1
+    fi
+
+    local out
+    out=$("$WORK_DIR/bench")
+    local last=${out##*$'\n'}
+    if [ "$last" != "ok" ]; then
+        print_fail "${last#fail }"
+        return 1
+    fi
+    while read -r size scale dims ms; do
+        [ "$size" = "ok" ] && continue
+        print_pass "$size at $scale: $dims thumbnail in $ms ms on this host"
+    done <<< "$out"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Thumbnail Cache Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_parse test_hits test_random test_bench; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,591 @@
+#!/bin/bash
+# Test script for the web UI asset build step
+# Usage: ./test_web_assets.sh [device_ip]
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WEB_DIR="main/web"
+OUT_DIR=$(mktemp -d)
+OUT_DIR2=$(mktemp -d)
+trap 'rm -rf "$OUT_DIR" "$OUT_DIR2"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# Read one field of one asset from the generated manifest
+manifest_field() {
+    python3 -c "import json,sys; m={a['name']: a for a in json.load(open(sys.argv[1]))}; print(m[sys.argv[2]][sys.argv[3]])" \
+        "$OUT_DIR/web_assets.json" "$1" "$2"
+}
+
+# Test that the generator runs
+test_build() {
+    print_test "Building web assets..."
+
+    if python3 web_assets.py build "$WEB_DIR" "$OUT_DIR"; then
+        print_pass "web_assets.py build works"
+    else
+        print_fail "web_assets.py build failed"
+        return 1
+    fi
+
+    if [ -f "$OUT_DIR/web_assets.c" ] && [ -f "$OUT_DIR/web_assets.json" ]; then
+        print_pass "web_assets.c and manifest generated"
+    else
+        print_fail "Generated files missing"
+        return 1
+    fi
+
+    return 0
+}
+
+# Test that every compressed asset round-trips to its source
+test_roundtrip() {
+    print_test "Checking compressed assets..."
+
+    for src in "$WEB_DIR"/*; do
+        name=$(basename "$src")
+        gz="$OUT_DIR/$name.gz"
+
+        # The HTML is served with its references pointing at the hashed names
+        if [ "${name##*.}" = "html" ]; then
+            expected="$OUT_DIR/$name.expected"
+            python3 -c "import json,sys; from web_assets import rewrite_references; \
+uris={a['name']: a['uri'] for a in json.load(open(sys.argv[1]))}; \
+sys.stdout.write(rewrite_references(open(sys.argv[2], encoding='utf-8').read(), uris))" \
+                "$OUT_DIR/web_assets.json" "$src" > "$expected"
+            if grep -qE '(src|href)="/(app\.js|style\.css)"' "$expected"; then
+                print_fail "$name still refers to unhashed assets"
+                return 1
+            fi
+            src="$expected"
+        fi
+
+        if ! gzip -dc "$gz" | cmp -s - "$src"; then
+            print_fail "$name does not decompress to its source"
+            return 1
+        fi
+
+        size=$(stat -c %s "$src")
+        gzip_size=$(stat -c %s "$gz")
+        if [ "$size" != "$(manifest_field "$name" size)" ] || \
+           [ "$gzip_size" != "$(manifest_field "$name" gzip_size)" ]; then
+            print_fail "$name sizes do not match the manifest"
+            return 1
+        fi
+        print_pass "$name: $size bytes -> $gzip_size bytes gzipped"
+    done
+
+    return 0
+}
+
+# Test that unchanged assets keep their ETag and bytes
+test_deterministic() {
+    print_test "Checking build is deterministic..."
+
+    python3 web_assets.py build "$WEB_DIR" "$OUT_DIR2" --quiet
+    if cmp -s "$OUT_DIR/web_assets.c" "$OUT_DIR2/web_assets.c"; then
+        print_pass "Two builds produce identical output"
+    else
+        print_fail "Builds differ; ETags would change on every flash"
+        return 1
+    fi
+
+    return 0
+}
+
+# Test that the generated source compiles against web_assets.h
+test_compile() {
+    print_test "Compiling generated source..."
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    if gcc -std=c99 -Wall -Werror -c -I main "$OUT_DIR/web_assets.c" -o "$OUT_DIR/web_assets.o"; then
+        print_pass "web_assets.c compiles"
+    else
+        print_fail "web_assets.c does not compile"
+        return 1
+    fi
+
+    return 0
+}
+
+# Stand-ins for the ESP-IDF headers static_assets.c includes
+write_shim() {
+    mkdir -p "$OUT_DIR/shim"
+    cat > "$OUT_DIR/shim/esp_err.h" <<'EOF'
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_HTTPD_HANDLERS_FULL 0xb001
+#define ESP_ERR_HTTPD_RESULT_TRUNC 0xb005
+#define ESP_ERR_HTTPD_RESP_HDR 0xb006
+EOF
+    cat > "$OUT_DIR/shim/esp_log.h" <<'EOF'
+#pragma once
+#define ESP_LOGI(tag, ...) ((void)(tag))
+#define ESP_LOGW(tag, ...) ((void)(tag))
+#define ESP_LOGE(tag, ...) ((void)(tag))
+EOF
+    cat > "$OUT_DIR/shim/esp_http_server.h" <<'EOF'
+#pragma once
+#include "esp_err.h"
+#include <stddef.h>
+#include <sys/types.h>
+typedef void *httpd_handle_t;
+typedef enum { HTTP_GET, HTTP_POST } httpd_method_t;
+typedef struct httpd_req {
+    void *user_ctx;
+} httpd_req_t;
+typedef struct {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+} httpd_uri_t;
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size);
+EOF
+}
+
+# static_assets.c on a stub httpd that records each response. Prints
+# "ok <details>" or "fail <reason>".
+build_sim() {
+    write_shim
+    cat > "$OUT_DIR/sim.c" <<'EOF'
+#include "static_assets.h"
+#include "web_assets.h"
+#include "http_server.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+#define MAX_HANDLERS 32
+#define MAX_RESP_HEADERS 8      // config.max_resp_headers in http_server.c
+#define IF_NONE_MATCH_LEN 128   // STATIC_ASSETS_IF_NONE_MATCH_LEN
+
+static httpd_uri_t s_handlers[MAX_HANDLERS];
+static int s_handler_count;
+static const char *s_if_none_match;
+static const char *s_status;
+static const char *s_type;
+static const char *s_hdr_names[MAX_RESP_HEADERS];
+static const char *s_hdr_values[MAX_RESP_HEADERS];
+static int s_hdr_count;
+static bool s_hdr_overflow;
+static const char *s_body;
+static ssize_t s_body_len;
+
+esp_err_t http_server_register_handler(const httpd_uri_t *uri_handler)
+{
+    for (int i = 0; i < s_handler_count; i++) {
+        if (strcmp(s_handlers[i].uri, uri_handler->uri) == 0) {
+            return ESP_FAIL;
+        }
+    }
+    if (s_handler_count >= MAX_HANDLERS) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    s_handlers[s_handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+esp_err_t http_server_unregister_handler(const char *uri, httpd_method_t method)
+{
+    for (int i = 0; i < s_handler_count; i++) {
+        if (strcmp(s_handlers[i].uri, uri) == 0 && s_handlers[i].method == method) {
+            s_handlers[i] = s_handlers[--s_handler_count];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    if (s_hdr_count >= MAX_RESP_HEADERS) {
+        s_hdr_overflow = true;
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    s_hdr_names[s_hdr_count] = field;
+    s_hdr_values[s_hdr_count++] = value;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    s_status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    s_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    s_body = buf;
+    s_body_len = buf_len;
+    return ESP_OK;
+}
+
+// Like httpd: a value that does not fit is an error
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (strcmp(field, "If-None-Match") != 0 || s_if_none_match == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    snprintf(val, val_size, "%s", s_if_none_match);
+    return strlen(s_if_none_match) >= val_size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+static const char *header(const char *name)
+{
+    for (int i = 0; i < s_hdr_count; i++) {
+        if (strcmp(s_hdr_names[i], name) == 0) {
+            return s_hdr_values[i];
+        }
+    }
+    return NULL;
+}
+
+static const httpd_uri_t *handler(const char *uri)
+{
+    for (int i = 0; i < s_handler_count; i++) {
+        if (strcmp(s_handlers[i].uri, uri) == 0) {
+            return &s_handlers[i];
+        }
+    }
+    return NULL;
+}
+
+// One GET of `asset` through the handler registered for the static assets;
+// returns the status code
+static int get(const web_asset_t *asset, const char *if_none_match)
+{
+    httpd_req_t req = { .user_ctx = (void *)asset };
+
+    s_if_none_match = if_none_match;
+    s_status = "200 OK";
+    s_type = NULL;
+    s_hdr_count = 0;
+    s_body = NULL;
+    s_body_len = -1;
+    handler(web_assets[0].uri)->handler(&req);
+    return atoi(s_status);
+}
+
+static int test_register(void)
+{
+    CHECK(static_assets_init() == ESP_OK, "init failed");
+    CHECK(s_handler_count == (int)web_assets_count, "%d handlers for %zu assets", s_handler_count,
+          web_assets_count);
+    for (size_t i = 0; i < web_assets_count; i++) {
+        const httpd_uri_t *h = handler(web_assets[i].uri);
+        CHECK(h != NULL && h->method == HTTP_GET && h->user_ctx == &web_assets[i], "%s not registered",
+              web_assets[i].uri);
+    }
+    CHECK(static_assets_deinit() == ESP_OK && s_handler_count == 0, "%d handlers left", s_handler_count);
+    CHECK(static_assets_init() == ESP_OK, "init after deinit failed");
+    printf("ok %zu\n", web_assets_count);
+    return 0;
+}
+
+static int test_serve(void)
+{
+    static_assets_stats_t stats;
+    uint64_t bytes = 0;
+
+    CHECK(static_assets_init() == ESP_OK, "init failed");
+    for (size_t i = 0; i < web_assets_count; i++) {
+        const web_asset_t *a = &web_assets[i];
+        CHECK(get(a, NULL) == 200, "%s: %s", a->uri, s_status);
+        CHECK(!s_hdr_overflow, "%s: more than %d headers", a->uri, MAX_RESP_HEADERS);
+        CHECK(header("ETag") != NULL && strcmp(header("ETag"), a->etag) == 0, "%s: ETag", a->uri);
+        CHECK(header("Cache-Control") != NULL && strcmp(header("Cache-Control"), a->cache_control) == 0,
+              "%s: Cache-Control", a->uri);
+        CHECK(header("Content-Encoding") != NULL && strcmp(header("Content-Encoding"), "gzip") == 0,
+              "%s: not gzip", a->uri);
+        CHECK(header("Vary") != NULL && strcmp(header("Vary"), "Accept-Encoding") == 0, "%s: Vary", a->uri);
+        CHECK(s_type != NULL && strcmp(s_type, a->content_type) == 0, "%s: Content-Type", a->uri);
+        CHECK(s_body == (const char *)a->gzip_data && s_body_len == (ssize_t)a->gzip_len, "%s: body", a->uri);
+        // Only the HTML is revalidated; the rest is named after its content
+        if (strcmp(a->uri, "/") == 0) {
+            CHECK(strcmp(a->cache_control, "no-cache") == 0, "/ is %s", a->cache_control);
+        } else {
+            CHECK(strstr(a->cache_control, "immutable") != NULL, "%s is %s", a->uri, a->cache_control);
+            char digest[32];
+            snprintf(digest, sizeof(digest), ".%.16s.", a->etag + 1);
+            CHECK(strstr(a->uri, digest) != NULL, "%s not named after ETag %s", a->uri, a->etag);
+        }
+        bytes += a->gzip_len;
+    }
+    static_assets_get_stats(&stats);
+    CHECK(stats.responses == web_assets_count && stats.not_modified == 0 && stats.bytes_sent == bytes,
+          "stats %lu/%lu/%llu", (unsigned long)stats.responses, (unsigned long)stats.not_modified,
+          (unsigned long long)stats.bytes_sent);
+    printf("ok\n");
+    return 0;
+}
+
+static int test_revalidate(void)
+{
+    // Made-up assets, so one ETag is a prefix of the other without quotes
+    static const uint8_t body[4] = { 1, 2, 3, 4 };
+    static const web_asset_t short_tag = { "/a", "text/plain", "no-cache", "\"abc\"", body, 4, 4 };
+    static const web_asset_t long_tag = { "/b", "text/plain", "no-cache", "\"abcd\"", body, 4, 4 };
+    static const struct {
+        const web_asset_t *asset;
+        const char *if_none_match;
+        int status;
+    } cases[] = {
+        { &short_tag, "\"abc\"", 304 },
+        { &short_tag, "W/\"abc\"", 304 },
+        { &short_tag, "*", 304 },
+        { &short_tag, "\"x\", \"abc\"", 304 },
+        { &short_tag, "\"x\",W/\"abc\",\"y\"", 304 },
+        { &short_tag, "  \"abc\"  ", 304 },
+        { &short_tag, "\"abcd\"", 200 },        // longer tag starting with ours
+        { &long_tag, "\"abc\"", 200 },          // ours starts with it
+        { &long_tag, "\"abc\", \"abcde\"", 200 },
+        { &short_tag, "\"abc\"d", 200 },        // runs on past the tag
+        { &short_tag, "abc", 200 },             // unquoted
+        { &short_tag, "W/abc", 200 },
+        { &short_tag, "\"ABC\"", 200 },         // case matters
+        { &short_tag, "", 200 },
+        { &short_tag, NULL, 200 },
+    };
+    static_assets_stats_t before, after;
+    char list[2 * IF_NONE_MATCH_LEN];
+    int not_modified = 0;
+
+    CHECK(static_assets_init() == ESP_OK, "init failed");
+    static_assets_get_stats(&before);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int status = get(cases[i].asset, cases[i].if_none_match);
+        CHECK(status == cases[i].status, "%s with If-None-Match %s: %d, expected %d", cases[i].asset->etag,
+              cases[i].if_none_match ? cases[i].if_none_match : "(none)", status, cases[i].status);
+        if (status == 304) {
+            not_modified++;
+            CHECK(s_body_len == 0 && header("Content-Encoding") == NULL, "304 with a body");
+            CHECK(header("ETag") != NULL && strcmp(header("ETag"), cases[i].asset->etag) == 0, "304 without ETag");
+        }
+    }
+
+    // Every built asset revalidates with its own ETag and no other's
+    for (size_t i = 0; i < web_assets_count; i++) {
+        for (size_t j = 0; j < web_assets_count; j++) {
+            int expect = i == j ? 304 : 200;
+            CHECK(get(&web_assets[i], web_assets[j].etag) == expect, "%s with %s's ETag", web_assets[i].uri,
+                  web_assets[j].uri);
+            not_modified += i == j;
+        }
+    }
+
+    // A list too long for the buffer is a miss, never a false 304
+    snprintf(list, sizeof(list), "%s", "\"x\"");
+    while (strlen(list) < IF_NONE_MATCH_LEN) {
+        strcat(list, ", \"x\"");
+    }
+    strcat(list, ", \"abc\"");
+    CHECK(get(&short_tag, list) == 200, "overlong If-None-Match matched");
+
+    static_assets_get_stats(&after);
+    CHECK(after.not_modified - before.not_modified == (uint32_t)not_modified, "%lu 304s counted, %d sent",
+          (unsigned long)(after.not_modified - before.not_modified), not_modified);
+    printf("ok %zu\n", sizeof(cases) / sizeof(cases[0]));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim register|serve|revalidate\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "register") == 0) {
+        return test_register();
+    }
+    if (strcmp(argv[1], "serve") == 0) {
+        return test_serve();
+    }
+    if (strcmp(argv[1], "revalidate") == 0) {
+        return test_revalidate();
+    }
+    fprintf(stderr, "usage: sim register|serve|revalidate\n");
+    return 2;
+}
+EOF
+    gcc -std=gnu11 -O2 -Wall -Werror -I "$OUT_DIR/shim" -I main "$OUT_DIR/sim.c" main/static_assets.c \
+        "$OUT_DIR/web_assets.c" -o "$OUT_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$OUT_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the handlers of static_assets.c on a stub httpd
+test_handler() {
+    print_test "Serving the assets through static_assets.c..."
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+    if ! build_sim; then
+        print_fail "Cannot build static_assets.c against the stub httpd"
+        return 1
+    fi
+
+    run_sim register || return 1
+    print_pass "$RESULT handlers registered, removed and registered again"
+    run_sim serve || return 1
+    print_pass "ETag, Cache-Control, Content-Type, gzip Content-Encoding and body per asset"
+    run_sim revalidate || return 1
+    print_pass "304 for a matching If-None-Match ($RESULT cases: lists, W/, *, prefixes), \
+200 otherwise"
+    return 0
+}
+
+# Test headers served by a running device
+test_device() {
+    local ip=$1
+    local headers="$OUT_DIR/headers"
+
+    print_test "Checking web UI served by $ip..."
+
+    if ! curl -s -o /dev/null -D "$headers" --max-time 5 "http://$ip/"; then
+        print_pass "No device at $ip - skipped"
+        return 0
+    fi
+
+    if ! grep -qi "^Content-Encoding: gzip" "$headers"; then
+        print_fail "/ is not served gzipped"
+        return 1
+    fi
+
+    length=$(grep -i "^Content-Length:" "$headers" | tr -d '\r' | awk '{print $2}')
+    if [ "$length" != "$(manifest_field index.html gzip_size)" ]; then
+        print_fail "/ Content-Length $length does not match the gzipped size"
+        return 1
+    fi
+    print_pass "/ served gzipped ($length bytes)"
+
+    etag=$(grep -i "^ETag:" "$headers" | tr -d '\r' | cut -d' ' -f2-)
+    if [ "$etag" != "$(manifest_field index.html etag)" ]; then
+        print_fail "/ ETag $etag does not match the build"
+        return 1
+    fi
+
+    status=$(curl -s -o /dev/null -w '%{http_code}' --max-time 5 -H "If-None-Match: $etag" "http://$ip/")
+    if [ "$status" = "304" ]; then
+        print_pass "Revalidation returns 304 Not Modified"
+    else
+        print_fail "Revalidation returned $status"
+        return 1
+    fi
+
+    app_uri=$(manifest_field app.js uri)
+    curl -s -o /dev/null -D "$headers" --max-time 5 "http://$ip$app_uri"
+    if grep -qi "^Cache-Control: public, max-age=31536000, immutable" "$headers"; then
+        print_pass "$app_uri is cached for good"
+    else
+        print_fail "$app_uri is missing its Cache-Control"
+        return 1
+    fi
+
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera Web Asset Test Suite ==="
+    echo ""
+
+    failed_tests=0
+
+    if ! test_build; then
+        print_fail "Cannot continue without generated assets"
+        return 1
+    fi
+    echo ""
+
+    if ! test_roundtrip; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_deterministic; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_compile; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if ! test_handler; then
+        ((failed_tests++))
+    fi
+    echo ""
+
+    if [ -n "$1" ]; then
+        if ! test_device "$1"; then
+            ((failed_tests++))
+        fi
+        echo ""
+    fi
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed. Please fix the issues above."
+        return 1
+    fi
+
+    return 0
+}
+
+main "$@"
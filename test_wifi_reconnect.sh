@@ -0,0 +1,366 @@
+#!/bin/bash
+# Test script for the WiFi reconnect policy
+# Usage: ./test_wifi_reconnect.sh
+#
+# Drives main/wifi_reconnect.c on a simulated millisecond clock the way
+# wifi_task does: the link drops, each attempt is made after the delay the
+# policy asks for and fails or succeeds, and the tests check the cached
+# BSSID -> scan -> backoff sequence (250 ms doubling to a 5 s cap) and that
+# the link is reported lost once, only after the 10 s grace period.
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+NC='\033[0m'
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+print_test() {
+    echo -e "${YELLOW}[TEST]${NC} $1"
+}
+
+print_pass() {
+    echo -e "${GREEN}[PASS]${NC} $1"
+}
+
+print_fail() {
+    echo -e "${RED}[FAIL]${NC} $1"
+}
+
+# One command per test. Prints "ok <details>" or "fail <reason>".
+build_sim() {
+    cat > "$WORK_DIR/sim.c" <<'EOF'
+#include "wifi_reconnect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRACE_MS 10000
+#define CACHED WIFI_RECONNECT_CACHED
+#define SCAN WIFI_RECONNECT_SCAN
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("fail "); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            return 1; \
+        } \
+    } while (0)
+
+static const uint8_t bssid[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+static wifi_reconnect_t rc;
+
+// Connected at boot, with the AP cached as after a first association
+static void boot(uint32_t now, bool cached)
+{
+    wifi_reconnect_init(&rc, GRACE_MS);
+    if (cached) {
+        wifi_reconnect_set_cache(&rc, bssid, 6);
+    }
+    wifi_reconnect_on_connected(&rc, now);
+}
+
+// Runs an outage as wifi_task does: every attempt fails after attempt_ms
+// until `up_at`, when the next attempt succeeds. Returns the reconnect
+// latency; *lost is set when the link was reported lost, at *lost_at.
+static uint32_t outage(uint32_t *now, uint32_t up_at, uint32_t attempt_ms, bool *lost, uint32_t *lost_at)
+{
+    *lost = false;
+    wifi_reconnect_on_disconnected(&rc, *now);
+    while (1) {
+        uint32_t delay_ms;
+        wifi_reconnect_next_attempt(&rc, &delay_ms);
+        // wifi_task keeps polling for link lost during the backoff
+        for (uint32_t end = *now + delay_ms + attempt_ms; *now < end; *now += 1) {
+            if (wifi_reconnect_poll_link_lost(&rc, *now)) {
+                if (*lost) {
+                    return UINT32_MAX;
+                }
+                *lost = true;
+                *lost_at = *now;
+            }
+        }
+        if (*now >= up_at) {
+            return wifi_reconnect_on_connected(&rc, *now);
+        }
+        wifi_reconnect_on_disconnected(&rc, *now);
+    }
+}
+
+static int test_sequence(void)
+{
+    static const uint32_t expected[] = { 0, 0, 0, 250, 500, 1000, 2000, 4000, 5000, 5000, 5000 };
+    uint32_t delay_ms;
+
+    boot(0, true);
+    wifi_reconnect_on_disconnected(&rc, 1000);
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        wifi_reconnect_method_t method = wifi_reconnect_next_attempt(&rc, &delay_ms);
+        wifi_reconnect_method_t want = i < WIFI_RECONNECT_FAST_ATTEMPTS ? CACHED : SCAN;
+        CHECK(method == want, "attempt %zu: %s", i + 1, method == CACHED ? "cached" : "scan");
+        CHECK(delay_ms == expected[i], "attempt %zu after %lu ms, expected %lu", i + 1,
+              (unsigned long)delay_ms, (unsigned long)expected[i]);
+    }
+
+    // Without a cached AP the first attempt scans at once, then backs off
+    static const uint32_t uncached[] = { 0, 250, 500, 1000, 2000, 4000, 5000 };
+    boot(0, false);
+    wifi_reconnect_on_disconnected(&rc, 1000);
+    for (size_t i = 0; i < sizeof(uncached) / sizeof(uncached[0]); i++) {
+        wifi_reconnect_method_t method = wifi_reconnect_next_attempt(&rc, &delay_ms);
+        CHECK(method == SCAN, "uncached attempt %zu used the cache", i + 1);
+        CHECK(delay_ms == uncached[i], "uncached attempt %zu after %lu ms", i + 1, (unsigned long)delay_ms);
+    }
+
+    // A new outage starts the sequence again
+    boot(0, true);
+    wifi_reconnect_on_disconnected(&rc, 10);
+    for (int i = 0; i < 8; i++) {
+        wifi_reconnect_next_attempt(&rc, &delay_ms);
+    }
+    wifi_reconnect_on_connected(&rc, 50000);
+    wifi_reconnect_on_disconnected(&rc, 60000);
+    CHECK(wifi_reconnect_next_attempt(&rc, &delay_ms) == CACHED && delay_ms == 0, "sequence not reset");
+    printf("ok\n");
+    return 0;
+}
+
+static int test_short_drop(void)
+{
+    uint32_t now = 5000;
+    bool lost;
+    uint32_t lost_at;
+
+    boot(now, true);
+    // The cached AP answers on the second attempt
+    uint32_t latency = outage(&now, now + 500, 300, &lost, &lost_at);
+    CHECK(latency == 600, "latency %lu ms", (unsigned long)latency);
+    CHECK(!lost, "short drop reported as link lost");
+    CHECK(rc.stats.reconnects == 1 && rc.stats.cached_hits == 1, "%lu reconnects, %lu cached",
+          (unsigned long)rc.stats.reconnects, (unsigned long)rc.stats.cached_hits);
+    // An AP back after 5 s is found by the scan after the 2000 ms backoff:
+    // 3 immediate attempts, then 250, 500, 1000 and 2000 ms, 300 ms each
+    latency = outage(&now, now + 5000, 300, &lost, &lost_at);
+    CHECK(latency == 7 * 300 + 250 + 500 + 1000 + 2000, "latency %lu ms", (unsigned long)latency);
+    CHECK(!lost, "drop of %lu ms reported as link lost", (unsigned long)latency);
+    CHECK(rc.stats.reconnects == 2 && rc.stats.cached_hits == 1, "%lu reconnects, %lu cached",
+          (unsigned long)rc.stats.reconnects, (unsigned long)rc.stats.cached_hits);
+    CHECK(rc.stats.min_latency_ms == 600 && rc.stats.max_latency_ms == latency &&
+          rc.stats.avg_latency_ms == (600 + latency) / 2, "stats %lu/%lu/%lu",
+          (unsigned long)rc.stats.min_latency_ms, (unsigned long)rc.stats.avg_latency_ms,
+          (unsigned long)rc.stats.max_latency_ms);
+    printf("ok %lu\n", (unsigned long)latency);
+    return 0;
+}
+
+static int test_grace(void)
+{
+    uint32_t now = 1000;
+    bool lost;
+    uint32_t lost_at;
+
+    boot(now, true);
+    uint32_t down = now;
+    uint32_t latency = outage(&now, now + 30000, 300, &lost, &lost_at);
+    CHECK(latency != UINT32_MAX, "link lost reported twice in one outage");
+    CHECK(lost, "30 s outage not reported");
+    CHECK(lost_at == down + GRACE_MS, "reported after %lu ms", (unsigned long)(lost_at - down));
+    CHECK(rc.stats.link_lost == 1, "%lu link lost", (unsigned long)rc.stats.link_lost);
+    CHECK(latency >= 30000 && latency <= 30000 + 5000 + 300, "latency %lu ms", (unsigned long)latency);
+
+    // Not before the first connection, and not while connected
+    wifi_reconnect_init(&rc, GRACE_MS);
+    CHECK(!wifi_reconnect_poll_link_lost(&rc, 60000), "lost before the first connection");
+    wifi_reconnect_on_connected(&rc, 60000);
+    CHECK(!wifi_reconnect_poll_link_lost(&rc, 90000), "lost while connected");
+
+    // Repeated disconnect events in one outage keep its start
+    wifi_reconnect_on_disconnected(&rc, 100000);
+    wifi_reconnect_on_disconnected(&rc, 105000);
+    CHECK(!wifi_reconnect_poll_link_lost(&rc, 100000 + GRACE_MS - 1), "lost early");
+    CHECK(wifi_reconnect_poll_link_lost(&rc, 100000 + GRACE_MS), "outage start moved by a repeated event");
+    printf("ok %lu\n", (unsigned long)latency);
+    return 0;
+}
+
+static int test_cache(void)
+{
+    uint8_t other[6];
+
+    wifi_reconnect_init(&rc, GRACE_MS);
+    CHECK(!wifi_reconnect_set_cache(&rc, bssid, 0), "channel 0 cached");
+    CHECK(!rc.have_cache, "channel 0 cached");
+    CHECK(wifi_reconnect_set_cache(&rc, bssid, 6), "first AP not reported as changed");
+    CHECK(!wifi_reconnect_set_cache(&rc, bssid, 6), "same AP reported as changed");
+    CHECK(wifi_reconnect_set_cache(&rc, bssid, 11), "channel change not reported");
+    memcpy(other, bssid, sizeof(other));
+    other[5] ^= 1;
+    CHECK(wifi_reconnect_set_cache(&rc, other, 11), "BSSID change not reported");
+
+    // A cleared cache goes straight to scanning
+    uint32_t delay_ms;
+    wifi_reconnect_on_connected(&rc, 0);
+    wifi_reconnect_clear_cache(&rc);
+    wifi_reconnect_on_disconnected(&rc, 1000);
+    CHECK(wifi_reconnect_next_attempt(&rc, &delay_ms) == SCAN, "cleared cache used");
+    printf("ok\n");
+    return 0;
+}
+
+// Random outages: the cached AP comes back at a random time. The first
+// attempts always use the cache, delays never exceed the cap, and the link
+// is reported lost exactly for the outages longer than the grace period
+static int test_random(void)
+{
+    uint32_t now = 1000;
+    unsigned long outages = 0, reported = 0, expected = 0;
+
+    srand(27);
+    boot(now, true);
+    for (int i = 0; i < 5000; i++) {
+        bool lost;
+        uint32_t lost_at;
+        now += 1000 + rand() % 60000;
+        uint32_t down = now;
+        uint32_t up_at = now + (rand() % 4 == 0 ? rand() % 40000 : rand() % 2000);
+        uint32_t latency = outage(&now, up_at, 50 + rand() % 500, &lost, &lost_at);
+        CHECK(latency != UINT32_MAX, "link lost reported twice in one outage");
+        CHECK(latency == now - down, "latency %lu for an outage of %lu ms", (unsigned long)latency,
+              (unsigned long)(now - down));
+        outages++;
+        reported += lost;
+        expected += latency > GRACE_MS;
+        CHECK(lost == (latency > GRACE_MS), "outage of %lu ms %sreported", (unsigned long)latency,
+              lost ? "" : "not ");
+        CHECK(rc.backoff_ms <= WIFI_RECONNECT_BACKOFF_MAX_MS, "backoff %lu", (unsigned long)rc.backoff_ms);
+    }
+    CHECK(rc.stats.reconnects == outages && rc.stats.link_lost == expected, "stats off");
+    CHECK(reported > 100, "only %lu long outages", reported);
+    printf("ok %lu %lu %lu\n", outages, reported, (unsigned long)rc.stats.avg_latency_ms);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: sim sequence|short|grace|cache|random\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "sequence") == 0) {
+        return test_sequence();
+    }
+    if (strcmp(argv[1], "short") == 0) {
+        return test_short_drop();
+    }
+    if (strcmp(argv[1], "grace") == 0) {
+        return test_grace();
+    }
+    if (strcmp(argv[1], "cache") == 0) {
+        return test_cache();
+    }
+    if (strcmp(argv[1], "random") == 0) {
+        return test_random();
+    }
+    fprintf(stderr, "usage: sim sequence|short|grace|cache|random\n");
+    return 2;
+}
+EOF
+    gcc -std=c99 -O2 -Wall -Werror -I main "$WORK_DIR/sim.c" main/wifi_reconnect.c -o "$WORK_DIR/sim"
+}
+
+# Run one sim command; sets RESULT to what follows "ok"
+run_sim() {
+    local out
+    out=$("$WORK_DIR/sim" "$@")
+    if [ "${out%% *}" != "ok" ] && [ "$out" != "ok" ]; then
+        print_fail "${out#fail }"
+        return 1
+    fi
+    RESULT=${out#ok}
+    RESULT=${RESULT# }
+    return 0
+}
+
+# Test the attempt sequence and the backoff
+test_sequence() {
+    print_test "Attempt sequence after a drop..."
+
+    run_sim sequence || return 1
+    print_pass "Cached AP twice, a scan at once, then 250 ms doubling to 5000 ms"
+    return 0
+}
+
+# Test drops shorter than the grace period
+test_short() {
+    print_test "Short drops..."
+
+    run_sim short || return 1
+    print_pass "Reconnected in 600 and $RESULT ms without reporting the link lost"
+    return 0
+}
+
+# Test the grace period
+test_grace() {
+    print_test "Outage longer than the grace period..."
+
+    run_sim grace || return 1
+    print_pass "Link lost reported once, 10000 ms into the outage; reconnected after $RESULT ms"
+    return 0
+}
+
+# Test the AP cache updates
+test_cache() {
+    print_test "Caching the AP..."
+
+    run_sim cache || return 1
+    print_pass "Changes to BSSID or channel reported for saving, cleared cache skipped"
+    return 0
+}
+
+# Test random outages against the invariants
+test_random() {
+    print_test "Random outages..."
+
+    run_sim random || return 1
+    read -r outages reported avg <<< "$RESULT"
+    print_pass "$outages outages, $reported reported lost, average reconnect $avg ms"
+    return 0
+}
+
+# Main test runner
+main() {
+    echo "=== ESP32S3 Camera WiFi Reconnect Test Suite ==="
+    echo ""
+
+    if ! command -v gcc >/dev/null 2>&1; then
+        print_pass "gcc not available, skipped"
+        return 0
+    fi
+
+    local failed_tests=0
+
+    if ! build_sim; then
+        print_fail "Cannot build the simulator"
+        return 1
+    fi
+
+    for t in test_sequence test_short test_grace test_cache test_random; do
+        if ! $t; then
+            ((failed_tests++))
+        fi
+        echo ""
+    done
+
+    if [ $failed_tests -eq 0 ]; then
+        print_pass "All tests passed!"
+    else
+        print_fail "$failed_tests test(s) failed"
+    fi
+
+    return $failed_tests
+}
+
+main "$@"
+exit $?
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+ESP32S3 Camera web asset builder
+
+Gzips every file of the web UI and generates a C source that embeds them as
+byte arrays with their content type, strong ETag and cache policy. Everything
+but the HTML is served under a content-hashed name (/app.<hash>.js), which the
+HTML's references are rewritten to. Runs as a build step from
+main/CMakeLists.txt; the output is deterministic so unchanged assets keep
+their ETag and name across builds.
+"""
+
+import argparse
+import gzip
+import hashlib
+import json
+import re
+import sys
+from pathlib import Path
+
+CONTENT_TYPES = {
+    '.html': 'text/html; charset=utf-8',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.json': 'application/json',
+    '.svg': 'image/svg+xml',
+    '.png': 'image/png',
+    '.ico': 'image/x-icon',
+}
+
+# HTML is revalidated on every load (a 304 when unchanged) so a firmware
+# update is picked up immediately. Everything else has the hash of its content
+# in its name, so a changed file is a new URL and the old one can be cached
+# for good.
+CACHE_HTML = 'no-cache'
+CACHE_STATIC = 'public, max-age=31536000, immutable'
+
+
+def content_hash(raw):
+    return hashlib.sha256(raw).hexdigest()[:16]
+
+
+def hashed_uri(name, digest):
+    """/app.js -> /app.<digest>.js"""
+    stem, dot, suffix = name.rpartition('.')
+    if not dot:
+        return '/%s.%s' % (name, digest)
+    return '/%s.%s.%s' % (stem, digest, suffix)
+
+
+def rewrite_references(html, uris):
+    """Point src= and href= attributes at the hashed names."""
+    def replace(match):
+        target = match.group(3).lstrip('/')
+        if target not in uris:
+            return match.group(0)
+        return '%s=%s%s%s' % (match.group(1), match.group(2), uris[target], match.group(2))
+    return re.sub(r'(src|href)=(["\'])([^"\']*)\2', replace, html)
+
+
+def build_asset(name, raw, uri, html):
+    """Return the description and gzipped bytes of one asset."""
+    # mtime=0 and no file name keep the output identical across builds
+    packed = gzip.compress(raw, compresslevel=9, mtime=0)
+    return {
+        'name': name,
+        'uri': uri,
+        'content_type': CONTENT_TYPES.get(Path(name).suffix, 'application/octet-stream'),
+        'cache_control': CACHE_HTML if html else CACHE_STATIC,
+        'etag': '"%s"' % content_hash(raw),
+        'size': len(raw),
+        'gzip_size': len(packed),
+    }, packed
+
+
+def build_assets(files, web_dir):
+    """Hashed names first, then the HTML that refers to them."""
+    uris = {}
+    assets = []
+    for path in files:
+        if path.suffix == '.html':
+            continue
+        name = path.relative_to(web_dir).as_posix()
+        raw = path.read_bytes()
+        uris[name] = hashed_uri(name, content_hash(raw))
+        assets.append(build_asset(name, raw, uris[name], False))
+
+    for path in files:
+        if path.suffix != '.html':
+            continue
+        name = path.relative_to(web_dir).as_posix()
+        raw = rewrite_references(path.read_text(encoding='utf-8'), uris).encode('utf-8')
+        uri = '/' if name == 'index.html' else '/' + name
+        assets.append(build_asset(name, raw, uri, True))
+
+    return sorted(assets, key=lambda a: a[0]['name'])
+
+
+def c_identifier(name):
+    return 'asset_' + ''.join(c if c.isalnum() else '_' for c in name)
+
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def write_c_source(assets, out_path):
+    lines = [
+        '// Generated by web_assets.py - do not edit',
+        '#include "web_assets.h"',
+        '',
+    ]
+
+    for asset, packed in assets:
+        lines.append('static const uint8_t %s[%d] = {' % (c_identifier(asset['name']), len(packed)))
+        for i in range(0, len(packed), 16):
+            lines.append('    ' + ', '.join('0x%02x' % b for b in packed[i:i + 16]) + ',')
+        lines.append('};')
+        lines.append('')
+
+    lines.append('const web_asset_t web_assets[] = {')
+    for asset, packed in assets:
+        lines.append('    { %s, %s, %s, %s, %s, sizeof(%s), %d },' % (
+            c_string(asset['uri']), c_string(asset['content_type']), c_string(asset['cache_control']),
+            c_string(asset['etag']), c_identifier(asset['name']), c_identifier(asset['name']), asset['size']))
+    lines.append('};')
+    lines.append('')
+    lines.append('const size_t web_assets_count = %d;' % len(assets))
+    lines.append('')
+
+    out_path.write_text('\n'.join(lines))
+
+
+def cmd_build(args):
+    web_dir = Path(args.web_dir)
+    out_dir = Path(args.out_dir)
+    out_dir.mkdir(parents=True, exist_ok=True)
+
+    files = sorted(p for p in web_dir.rglob('*') if p.is_file())
+    if not files:
+        print(f"✗ No assets found in {web_dir}", file=sys.stderr)
+        return 1
+
+    assets = build_assets(files, web_dir)
+    write_c_source(assets, out_dir / 'web_assets.c')
+
+    # Manifest and .gz files are for inspection and tests only
+    manifest = []
+    for asset, packed in assets:
+        (out_dir / (asset['name'] + '.gz')).parent.mkdir(parents=True, exist_ok=True)
+        (out_dir / (asset['name'] + '.gz')).write_bytes(packed)
+        manifest.append(asset)
+    (out_dir / 'web_assets.json').write_text(json.dumps(manifest, indent=2) + '\n')
+
+    if not args.quiet:
+        total = sum(a['size'] for a, _ in assets)
+        packed = sum(a['gzip_size'] for a, _ in assets)
+        print(f"✓ {len(assets)} web assets: {total} bytes -> {packed} bytes gzipped")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32S3 Camera web asset builder')
+    subparsers = parser.add_subparsers(dest='command', help='Available commands')
+
+    build_parser = subparsers.add_parser('build', help='Gzip assets and generate web_assets.c')
+    build_parser.add_argument('web_dir', help='Directory with the web UI sources')
+    build_parser.add_argument('out_dir', help='Output directory')
+    build_parser.add_argument('--quiet', action='store_true', help='Only report errors')
+
+    args = parser.parse_args()
+    if args.command == 'build':
+        return cmd_build(args)
+
+    parser.print_help()
+    return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())